@@ -0,0 +1,2202 @@
+//
+//  CoreTests.c
+//  Stereogram Benchmarks
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+//  Deterministic checks of the image kernels which don't need UIKit, run with "make check".
+//  The app-level behaviour is covered by the XCTest targets in "Stereogram Tests".
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef PW_HAVE_LIBJPEG
+#include <jpeglib.h>
+#include <setjmp.h>
+#endif
+
+#include "PWAlign.h"
+#include "PWAnaglyph.h"
+#include "PWDisparity.h"
+#include "PWBufferPool.h"
+#include "PWExifThumbnail.h"
+#include "PWExport.h"
+#include "PWImageBuffer.h"
+#include "PWImport.h"
+#include "PWJournal.h"
+#include "PWJPEGDecoder.h"
+#include "PWJPEGEncoder.h"
+#include "PWLibrary.h"
+#include "PWMPO.h"
+#include "PWMemoryStorage.h"
+#include "PWOrientation.h"
+#include "PWParallel.h"
+#include "PWPerceptualHash.h"
+#include "PWResample.h"
+#include "PWSHA256.h"
+#include "PWSequence.h"
+#include "PWStereoPair.h"
+#include "PWStorage.h"
+#include "PWSync.h"
+#include "PWThumbnail.h"
+#include "PWTilePyramid.h"
+
+static unsigned failures = 0;
+
+#define CHECK(condition, ...) do {                                  \
+    if (!(condition)) {                                             \
+        fprintf(stderr, "%s:%d: FAILED: ", __FILE__, __LINE__);     \
+        fprintf(stderr, __VA_ARGS__);                               \
+        fputc('\n', stderr);                                        \
+        failures++;                                                 \
+    }                                                               \
+} while (0)
+
+static const PWPixelFormat AllFormats[] = { PWPixelFormat_RGBA8888, PWPixelFormat_Gray8, PWPixelFormat_RGB888, PWPixelFormat_YCbCr420 };
+static const size_t FormatCount = sizeof(AllFormats) / sizeof(AllFormats[0]);
+
+// MARK: - Helpers
+
+    /// A buffer filled with reproducible noise. RGBA pixels are made opaque so they are valid premultiplied colours.
+static PWImageBuffer *makeNoise(size_t width, size_t height, PWPixelFormat format, uint32_t seed) {
+    PWImageBuffer *buffer = PWImageBufferCreate(width, height, format);
+    if (!buffer) {
+        return NULL;
+    }
+    uint32_t random = seed;
+    size_t rowBytes = width * PWPixelFormatBytesPerPixel(format);
+    for (size_t y = 0; y < height; y++) {
+        uint8_t *row = PWImageBufferRow(buffer, y);
+        for (size_t i = 0; i < rowBytes; i++) {
+            random = random * 1664525u + 1013904223u;
+            row[i] = (format == PWPixelFormat_RGBA8888 && i % 4 == 3) ? 255 : (uint8_t)(random >> 24);
+        }
+    }
+    if (PWPixelFormatIsPlanar(format)) {
+        for (int plane = 0; plane < 2; plane++) {
+            for (size_t y = 0; y < (height + 1) / 2; y++) {
+                for (size_t x = 0; x < (width + 1) / 2; x++) {
+                    random = random * 1664525u + 1013904223u;
+                    buffer->chroma[plane][y * buffer->chromaBytesPerRow + x] = (uint8_t)(random >> 24);
+                }
+            }
+        }
+    }
+    return buffer;
+}
+
+static PWImageBuffer *makeFilled(size_t width, size_t height, PWPixelFormat format, uint8_t value) {
+    PWImageBuffer *buffer = PWImageBufferCreate(width, height, format);
+    if (buffer) {
+        memset(buffer->data, value, buffer->bytesPerRow * height);
+        if (PWPixelFormatIsPlanar(format)) {
+            memset(buffer->chroma[0], value, buffer->chromaBytesPerRow * ((height + 1) / 2));
+            memset(buffer->chroma[1], value, buffer->chromaBytesPerRow * ((height + 1) / 2));
+        }
+    }
+    return buffer;
+}
+
+    /// True if A and B have the same size, format and pixels, ignoring row padding.
+static bool buffersEqual(const PWImageBuffer *a, const PWImageBuffer *b) {
+    if (!a || !b || a->width != b->width || a->height != b->height || a->format != b->format) {
+        return false;
+    }
+    size_t rowBytes = a->width * PWPixelFormatBytesPerPixel(a->format);
+    for (size_t y = 0; y < a->height; y++) {
+        if (memcmp(PWImageBufferRow(a, y), PWImageBufferRow(b, y), rowBytes) != 0) {
+            return false;
+        }
+    }
+    if (PWPixelFormatIsPlanar(a->format)) {
+        for (int plane = 0; plane < 2; plane++) {
+            for (size_t y = 0; y < (a->height + 1) / 2; y++) {
+                if (memcmp(a->chroma[plane] + y * a->chromaBytesPerRow, b->chroma[plane] + y * b->chromaBytesPerRow, (a->width + 1) / 2) != 0) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+    /// True if A and B are the same size and format and no byte differs by more than TOLERANCE. Only the first plane is compared.
+static bool buffersNear(const PWImageBuffer *a, const PWImageBuffer *b, int tolerance) {
+    if (!a || !b || a->width != b->width || a->height != b->height || a->format != b->format) {
+        return false;
+    }
+    size_t rowBytes = a->width * PWPixelFormatBytesPerPixel(a->format);
+    for (size_t y = 0; y < a->height; y++) {
+        const uint8_t *rowA = PWImageBufferRow(a, y), *rowB = PWImageBufferRow(b, y);
+        for (size_t i = 0; i < rowBytes; i++) {
+            if (abs(rowA[i] - rowB[i]) > tolerance) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+    /// True if every byte of the (packed) image is within TOLERANCE of VALUE.
+static bool allNear(const PWImageBuffer *buffer, uint8_t value, int tolerance) {
+    size_t rowBytes = buffer->width * PWPixelFormatBytesPerPixel(buffer->format);
+    for (size_t y = 0; y < buffer->height; y++) {
+        const uint8_t *row = PWImageBufferRow(buffer, y);
+        for (size_t i = 0; i < rowBytes; i++) {
+            if (abs(row[i] - value) > tolerance) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// MARK: - Crops
+
+static void testSubImageSharesPixels(void) {
+    for (size_t f = 0; f < FormatCount; f++) {
+        PWImageBuffer *source = makeNoise(20, 10, AllFormats[f], 21);
+        PWImageRect rect = { 4, 2, 30, 5 };
+        PWImageBuffer *crop = PWImageBufferCreateSubImage(source, rect);
+        CHECK(crop && crop->width == 16 && crop->height == 5, "format %d: sub-image is not clipped to the image", AllFormats[f]);
+            // The crop must keep the pixels alive on its own.
+        PWImageBuffer *expected = PWImageBufferCreate(16, 5, AllFormats[f]);
+        size_t bytesPerPixel = PWPixelFormatBytesPerPixel(AllFormats[f]);
+        for (size_t y = 0; y < 5; y++) {
+            memcpy(PWImageBufferRow(expected, y), PWImageBufferRow(source, y + 2) + 4 * bytesPerPixel, 16 * bytesPerPixel);
+        }
+        if (PWPixelFormatIsPlanar(AllFormats[f])) {
+            for (int plane = 0; plane < 2; plane++) {
+                for (size_t y = 0; y < 3; y++) {
+                    memcpy(expected->chroma[plane] + y * expected->chromaBytesPerRow,
+                           source->chroma[plane] + (y + 1) * source->chromaBytesPerRow + 2, 8);
+                }
+            }
+        }
+        PWImageBufferRelease(source);
+        CHECK(buffersEqual(crop, expected), "format %d: sub-image shows the wrong pixels", AllFormats[f]);
+        PWImageBufferRelease(crop);
+        PWImageBufferRelease(expected);
+    }
+    PWImageBuffer *planar = makeFilled(8, 8, PWPixelFormat_YCbCr420, 0);
+    PWImageRect odd = { 1, 0, 4, 4 }, outside = { 8, 0, 4, 4 };
+    CHECK(!PWImageBufferCreateSubImage(planar, odd), "planar sub-image accepted an odd origin");
+    CHECK(!PWImageBufferCreateSubImage(planar, outside), "sub-image accepted a rectangle outside the image");
+    PWImageBufferRelease(planar);
+}
+
+static void testAlignCropRectToBlocks(void) {
+    PWJPEGInfo info = { .width = 100, .height = 60, .componentCount = 3, .format = PWPixelFormat_YCbCr420,
+                        .blockWidth = 16, .blockHeight = 16 };
+    PWImageRect rect = { 20, 5, 50, 200 };
+    PWImageRect aligned = PWJPEGAlignCropRect(rect, &info);
+    CHECK(aligned.x == 16 && aligned.y == 0 && aligned.width == 54 && aligned.height == 60,
+          "aligned crop is (%zu, %zu, %zu, %zu)", aligned.x, aligned.y, aligned.width, aligned.height);
+}
+
+static void testShiftedViewsMoveRightPhoto(void) {
+    PWImageBuffer *left = makeNoise(20, 6, PWPixelFormat_RGB888, 31), *right = makeNoise(20, 6, PWPixelFormat_RGB888, 32);
+    const long offsets[] = { 3, -5, 0 };
+    for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+        long offset = offsets[i];
+        size_t shift = (size_t)labs(offset);
+        PWImageBuffer *leftView = NULL, *rightView = NULL;
+        PWError error = PWImageBufferCreateShiftedViews(left, right, offset, &leftView, &rightView);
+        CHECK(error == PWError_None && leftView->width == 20 - shift && rightView->width == 20 - shift,
+              "offset %ld: views are the wrong width", offset);
+            // Column X of each view must come from the photo column that puts the right photo OFFSET pixels to the right.
+        if (error == PWError_None) {
+            size_t leftX = offset > 0 ? shift : 0, rightX = offset < 0 ? shift : 0;
+            CHECK(PWImageBufferRow(leftView, 2)  == PWImageBufferRow(left, 2)  + leftX * 3
+               && PWImageBufferRow(rightView, 2) == PWImageBufferRow(right, 2) + rightX * 3, "offset %ld: views show the wrong columns", offset);
+        }
+        PWImageBufferRelease(leftView);
+        PWImageBufferRelease(rightView);
+    }
+    PWImageBuffer *leftView = NULL, *rightView = NULL;
+    CHECK(PWImageBufferCreateShiftedViews(left, right, 20, &leftView, &rightView) == PWError_InvalidParameter && !leftView && !rightView,
+          "shifting a photo by its whole width should fail");
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+
+        // Planar offsets are rounded towards zero so the chroma stays on whole samples.
+    PWImageBuffer *planarLeft = makeNoise(16, 8, PWPixelFormat_YCbCr420, 33), *planarRight = makeNoise(16, 8, PWPixelFormat_YCbCr420, 34);
+    CHECK(PWImageBufferCreateShiftedViews(planarLeft, planarRight, -3, &leftView, &rightView) == PWError_None
+          && leftView->width == 14 && rightView->chroma[0] == planarRight->chroma[0] + 1, "planar offset was not rounded to even");
+    PWImageBufferRelease(leftView);
+    PWImageBufferRelease(rightView);
+    PWImageBufferRelease(planarLeft);
+    PWImageBufferRelease(planarRight);
+}
+
+// MARK: - Buffer pool
+
+static void testBufferPoolReusesSizeClasses(void) {
+    PWBufferPoolTrim(0);
+    PWBufferPoolResetStatistics();
+    PWBufferPoolStatistics statistics;
+
+        // 640 and 641 pixels wide round up to the same class, so the second image gets the first one's memory.
+    PWImageBuffer *first = PWImageBufferCreate(640, 480, PWPixelFormat_RGBA8888);
+    uint8_t *pixels = first->data;
+    PWImageBufferRelease(first);
+    PWImageBuffer *second = PWImageBufferCreate(641, 480, PWPixelFormat_RGBA8888);
+    CHECK(second->data == pixels, "an image of nearly the same size didn't reuse the pool's block");
+    PWImageBufferRelease(second);
+    PWImageBufferRelease(PWImageBufferCreate(10, 10, PWPixelFormat_RGBA8888));
+    PWBufferPoolGetStatistics(&statistics);
+    CHECK(statistics.hits == 1 && statistics.misses == 1 && statistics.recycled == 2 && statistics.idleBlocks == 1,
+          "expected 1 hit, 1 miss and 2 recycled; got %llu, %llu and %llu", (unsigned long long)statistics.hits,
+          (unsigned long long)statistics.misses, (unsigned long long)statistics.recycled);
+
+        // Nothing is kept over the limit, and trimming empties the pool.
+    size_t idleBytes = statistics.idleBytes;
+    PWBufferPoolSetLimit(idleBytes);
+    PWImageBuffer *extra = PWImageBufferCreate(640, 480, PWPixelFormat_RGBA8888), *overLimit = PWImageBufferCreate(640, 480, PWPixelFormat_RGBA8888);
+    PWImageBufferRelease(extra);
+    PWImageBufferRelease(overLimit);
+    PWBufferPoolGetStatistics(&statistics);
+    CHECK(statistics.discarded == 1 && statistics.idleBytes == idleBytes, "pool kept more than its limit");
+    PWBufferPoolSetLimit(PWBufferPoolDefaultLimit);
+    PWBufferPoolTrim(0);
+    PWBufferPoolGetStatistics(&statistics);
+    CHECK(statistics.idleBlocks == 0 && statistics.idleBytes == 0 && statistics.trimmedBytes == idleBytes, "trimming left blocks in the pool");
+}
+
+static void testBufferPoolSteadyStateAllocatesNothing(void) {
+    PWImageBuffer *left = makeNoise(640, 480, PWPixelFormat_YCbCr420, 35), *right = makeNoise(640, 480, PWPixelFormat_YCbCr420, 36);
+    PWBufferPoolTrim(0);
+    PWBufferPoolResetStatistics();
+        // Changing the depth back and forth makes stereograms a few columns apart, which should all share blocks.
+    const long offsets[] = { 0, 20, -12, 6, 0, 20, -12, 6 };
+    for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+        PWImageBuffer *leftView = NULL, *rightView = NULL, *stereogram = NULL;
+        if (PWImageBufferCreateShiftedViews(left, right, offsets[i], &leftView, &rightView) == PWError_None) {
+            stereogram = PWImageBufferCreateSideBySide(leftView, rightView);
+        }
+        CHECK(stereogram, "offset %ld: couldn't make the stereogram", offsets[i]);
+        PWImageBufferRelease(leftView);
+        PWImageBufferRelease(rightView);
+        PWImageBufferRelease(stereogram);
+    }
+    PWBufferPoolStatistics statistics;
+    PWBufferPoolGetStatistics(&statistics);
+    CHECK(statistics.misses == 1 && statistics.hits == 7, "expected 1 miss and 7 hits, got %llu and %llu",
+          (unsigned long long)statistics.misses, (unsigned long long)statistics.hits);
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+}
+
+// MARK: - Resampling
+
+static void testResampleKeepsFlatImagesFlat(void) {
+    const size_t sizes[][2] = { { 1, 1 }, { 37, 23 }, { 250, 250 }, { 1000, 3 } };
+    for (size_t f = 0; f < FormatCount; f++) {
+        PWImageBuffer *flat = makeFilled(200, 150, AllFormats[f], 77);
+        for (int filter = 0; filter < PWResampleFilter_NUM_FILTERS; filter++) {
+            for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+                PWImageBuffer *scaled = PWResampleCreate(flat, sizes[s][0], sizes[s][1], filter);
+                CHECK(scaled && scaled->width == sizes[s][0] && scaled->height == sizes[s][1], "format %d filter %d: wrong size", AllFormats[f], filter);
+                CHECK(scaled && allNear(scaled, 77, 0), "format %d filter %d size %zux%zu: flat image changed", AllFormats[f], filter, sizes[s][0], sizes[s][1]);
+                PWImageBufferRelease(scaled);
+            }
+        }
+        PWImageBufferRelease(flat);
+    }
+}
+
+static void testAreaHalvingMatchesHalfSize(void) {
+        // The rows are rounded to 8 bits between the two passes, so this can be 1 out from averaging all 4 pixels at once.
+    for (size_t f = 0; f < FormatCount; f++) {
+        PWImageBuffer *source = makeNoise(64, 48, AllFormats[f], 5);
+        PWImageBuffer *half = PWImageBufferCreateHalfSize(source);
+        PWImageBuffer *scaled = PWResampleCreate(source, 32, 24, PWResampleFilter_Area);
+        CHECK(buffersNear(half, scaled, 1), "format %d: area halving differs from PWImageBufferCreateHalfSize()", AllFormats[f]);
+        PWImageBufferRelease(source);
+        PWImageBufferRelease(half);
+        PWImageBufferRelease(scaled);
+    }
+}
+
+static void testResampleSameSizeIsCopy(void) {
+    for (size_t f = 0; f < FormatCount; f++) {
+        PWImageBuffer *source = makeNoise(90, 60, AllFormats[f], 6);
+        for (int filter = 0; filter < PWResampleFilter_NUM_FILTERS; filter++) {
+            PWImageBuffer *scaled = PWResampleCreate(source, 90, 60, filter);
+            CHECK(buffersEqual(source, scaled), "format %d filter %d: scaling to the same size changed the image", AllFormats[f], filter);
+            PWImageBufferRelease(scaled);
+        }
+        PWImageBufferRelease(source);
+    }
+}
+
+static void testResampleIgnoresThreadCount(void) {
+    for (size_t f = 0; f < FormatCount; f++) {
+        PWImageBuffer *source = makeNoise(613, 419, AllFormats[f], 7);
+        for (int filter = 0; filter < PWResampleFilter_NUM_FILTERS; filter++) {
+            PWParallelSetThreadCount(1);
+            PWImageBuffer *single = PWResampleCreate(source, 301, 97, filter);
+            PWParallelSetThreadCount(5);
+            PWImageBuffer *several = PWResampleCreate(source, 301, 97, filter);
+            PWParallelSetThreadCount(0);
+            CHECK(buffersEqual(single, several), "format %d filter %d: result depends on the number of threads", AllFormats[f], filter);
+            PWImageBufferRelease(single);
+            PWImageBufferRelease(several);
+        }
+        PWImageBufferRelease(source);
+    }
+}
+
+static void testLanczosKeepsPremultipliedColoursValid(void) {
+        // Hard edges between transparent and opaque make Lanczos overshoot.
+    PWImageBuffer *source = makeNoise(64, 64, PWPixelFormat_RGBA8888, 8);
+    for (size_t y = 0; y < source->height; y++) {
+        uint8_t *pixel = PWImageBufferRow(source, y);
+        for (size_t x = 0; x < source->width; x++, pixel += 4) {
+            if ((x / 4 + y / 4) % 2) {
+                memset(pixel, 0, 4);
+            }
+        }
+    }
+    PWImageBuffer *scaled = PWResampleCreate(source, 150, 150, PWResampleFilter_Lanczos3);
+    bool valid = scaled != NULL;
+    for (size_t y = 0; valid && y < scaled->height; y++) {
+        const uint8_t *pixel = PWImageBufferRow(scaled, y);
+        for (size_t x = 0; x < scaled->width; x++, pixel += 4) {
+            valid = valid && pixel[0] <= pixel[3] && pixel[1] <= pixel[3] && pixel[2] <= pixel[3];
+        }
+    }
+    CHECK(valid, "Lanczos produced a colour brighter than its alpha");
+    PWImageBufferRelease(source);
+    PWImageBufferRelease(scaled);
+}
+
+static void testThumbnailDoesNotAlias(void) {
+        // A one-pixel checkerboard averages to mid-grey. Point sampling would pick out black or white.
+        // Each thumbnail pixel covers 6x6 board pixels, so it should be exactly half black and half white.
+    PWImageBuffer *board = PWImageBufferCreate(1200, 600, PWPixelFormat_Gray8);
+    for (size_t y = 0; y < board->height; y++) {
+        for (size_t x = 0; x < board->width; x++) {
+            PWImageBufferRow(board, y)[x] = (x + y) % 2 ? 255 : 0;
+        }
+    }
+    PWImageBuffer *thumbnail = PWThumbnailCreate(board, 100);
+    CHECK(thumbnail && thumbnail->width == 100 && thumbnail->height == 100, "thumbnail has the wrong size");
+    CHECK(thumbnail && allNear(thumbnail, 128, 2), "thumbnail of a checkerboard is not grey");
+    PWImageBufferRelease(board);
+    PWImageBufferRelease(thumbnail);
+}
+
+static void testThumbnailBorderAndCorners(void) {
+    enum { Size = 100, Border = 5, Radius = 20 };
+    PWThumbnailOptions options = PWThumbnailOptionsInit();
+    options.borderSize = Border;
+    options.cornerRadius = Radius;
+    for (size_t f = 0; f < FormatCount; f++) {
+        PWImageBuffer *source = makeNoise(613, 419, AllFormats[f], 9);
+        PWImageBuffer *plain = PWThumbnailCreate(source, Size);
+        PWParallelSetThreadCount(1);
+        PWImageBuffer *single = PWThumbnailCreateWithOptions(source, Size, &options);
+        PWParallelSetThreadCount(5);
+        PWImageBuffer *thumbnail = PWThumbnailCreateWithOptions(source, Size, &options);
+        PWParallelSetThreadCount(0);
+        CHECK(thumbnail && thumbnail->width == Size + 2 * Border && thumbnail->height == Size + 2 * Border
+              && thumbnail->format == PWPixelFormat_RGBA8888, "format %d: thumbnail has the wrong size or format", AllFormats[f]);
+        CHECK(buffersEqual(single, thumbnail), "format %d: thumbnail depends on the number of threads", AllFormats[f]);
+        bool borderClear = true, colourValid = true, insideMatches = true;
+        size_t partlyCovered = 0;
+        for (size_t y = 0; plain && thumbnail && y < thumbnail->height; y++) {
+            const uint8_t *pixel = PWImageBufferRow(thumbnail, y);
+            for (size_t x = 0; x < thumbnail->width; x++, pixel += 4) {
+                bool inBorder = x < Border || y < Border || x >= Border + Size || y >= Border + Size;
+                borderClear = borderClear && (!inBorder || (pixel[0] | pixel[1] | pixel[2] | pixel[3]) == 0);
+                colourValid = colourValid && pixel[0] <= pixel[3] && pixel[1] <= pixel[3] && pixel[2] <= pixel[3];
+                partlyCovered += pixel[3] > 0 && pixel[3] < 255;
+                bool nearCorner = (x < Border + Radius || x >= Border + Size - Radius) && (y < Border + Radius || y >= Border + Size - Radius);
+                if (!inBorder && !nearCorner) {
+                    uint8_t expected[4];
+                    PWImageBufferConvertRowToRGBX(plain, y - Border, x - Border, 1, expected);
+                    insideMatches = insideMatches && memcmp(pixel, expected, 4) == 0;
+                }
+            }
+        }
+        CHECK(borderClear, "format %d: border is not transparent", AllFormats[f]);
+        CHECK(colourValid, "format %d: masking left a colour brighter than its alpha", AllFormats[f]);
+        CHECK(insideMatches, "format %d: inside of the thumbnail differs from PWThumbnailCreate()", AllFormats[f]);
+        CHECK(thumbnail && PWImageBufferRow(thumbnail, Border)[Border * 4 + 3] == 0, "format %d: corner is not transparent", AllFormats[f]);
+        CHECK(partlyCovered >= 4, "format %d: corners are not anti-aliased", AllFormats[f]);
+        PWImageBufferRelease(source);
+        PWImageBufferRelease(plain);
+        PWImageBufferRelease(single);
+        PWImageBufferRelease(thumbnail);
+    }
+}
+
+// MARK: - Orientation
+
+static void testOrientationRoundTrips(void) {
+        // Each orientation followed by the one that undoes it.
+    const PWOrientation inverses[][2] = {
+        { PWOrientation_UpMirrored, PWOrientation_UpMirrored }, { PWOrientation_Down, PWOrientation_Down },
+        { PWOrientation_DownMirrored, PWOrientation_DownMirrored }, { PWOrientation_LeftMirrored, PWOrientation_LeftMirrored },
+        { PWOrientation_Right, PWOrientation_Left }, { PWOrientation_RightMirrored, PWOrientation_RightMirrored },
+        { PWOrientation_Left, PWOrientation_Right },
+    };
+    for (size_t f = 0; f < FormatCount; f++) {
+        PWImageBuffer *source = makeNoise(70, 46, AllFormats[f], 9);
+        PWImageBuffer *copy = PWImageBufferCreateOriented(source, PWOrientation_Up);
+        CHECK(buffersEqual(source, copy), "format %d: orienting an upright image changed it", AllFormats[f]);
+        PWImageBufferRelease(copy);
+        for (size_t i = 0; i < sizeof(inverses) / sizeof(inverses[0]); i++) {
+            PWImageBuffer *turned = PWImageBufferCreateOriented(source, inverses[i][0]);
+            bool swapped = PWOrientationSwapsAxes(inverses[i][0]);
+            CHECK(turned && turned->width == (swapped ? source->height : source->width), "format %d orientation %d: wrong size", AllFormats[f], inverses[i][0]);
+            PWImageBuffer *back = PWImageBufferCreateOriented(turned, inverses[i][1]);
+            CHECK(buffersEqual(source, back), "format %d orientation %d: didn't round trip", AllFormats[f], inverses[i][0]);
+            PWImageBufferRelease(turned);
+            PWImageBufferRelease(back);
+        }
+        PWImageBufferRelease(source);
+    }
+}
+
+static void testOrientationMovesCorners(void) {
+        // Mark the top-left pixel of a 3x2 image and check where each orientation puts it.
+    PWImageBuffer *source = makeFilled(3, 2, PWPixelFormat_Gray8, 0);
+    PWImageBufferRow(source, 0)[0] = 1;
+    const struct { PWOrientation orientation; size_t x, y; } expected[] = {
+        { PWOrientation_Up, 0, 0 }, { PWOrientation_UpMirrored, 2, 0 }, { PWOrientation_Down, 2, 1 }, { PWOrientation_DownMirrored, 0, 1 },
+        { PWOrientation_LeftMirrored, 0, 0 }, { PWOrientation_Right, 1, 0 }, { PWOrientation_RightMirrored, 1, 2 }, { PWOrientation_Left, 0, 2 },
+    };
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        PWImageBuffer *turned = PWImageBufferCreateOriented(source, expected[i].orientation);
+        CHECK(turned && PWImageBufferRow(turned, expected[i].y)[expected[i].x] == 1,
+              "orientation %d: top-left pixel is not at (%zu, %zu)", expected[i].orientation, expected[i].x, expected[i].y);
+        PWImageBufferRelease(turned);
+    }
+    PWImageBufferRelease(source);
+}
+
+// MARK: - Alignment
+
+    /// A photo-like image: coarse noise enlarged smoothly, so there is detail at every level of the alignment pyramid.
+static PWImageBuffer *makeScene(size_t width, size_t height, PWPixelFormat format, uint32_t seed) {
+    PWImageBuffer *noise = makeNoise(width / 8, height / 8, format, seed);
+    PWImageBuffer *scene = PWResampleCreate(noise, width, height, PWResampleFilter_Bilinear);
+    PWImageBufferRelease(noise);
+    return scene;
+}
+
+static void testAlignFindsOffsetAndRotation(void) {
+    const PWPixelFormat formats[] = { PWPixelFormat_RGB888, PWPixelFormat_YCbCr420 };
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        PWImageBuffer *scene = makeScene(1024, 768, formats[f], 41);
+            // Correcting the scene against itself by the opposite of a misalignment makes a pair with that misalignment.
+        PWAlignment misalignment = { .verticalOffset = -9, .rotation = -0.01 }, found;
+        PWImageBuffer *left = NULL, *right = NULL;
+        CHECK(PWAlignCreateCorrectedPair(scene, scene, misalignment, &left, &right) == PWError_None, "format %d: correction failed", formats[f]);
+        CHECK(PWAlignEstimate(left, right, &found) == PWError_None, "format %d: estimate failed", formats[f]);
+        CHECK(fabs(found.verticalOffset - 9) < 1 && fabs(found.rotation - 0.01) < 0.002,
+              "format %d: found offset %.2f and rotation %.4f, expected 9 and 0.01", formats[f], found.verticalOffset, found.rotation);
+        PWImageBufferRelease(left);
+        PWImageBufferRelease(right);
+        PWImageBufferRelease(scene);
+    }
+    PWImageBuffer *flat = makeFilled(400, 300, PWPixelFormat_Gray8, 128);
+    PWAlignment found;
+    CHECK(PWAlignEstimate(flat, flat, &found) == PWError_NotSupported, "a featureless image should not be aligned");
+    PWImageBufferRelease(flat);
+}
+
+static void testAlignOffsetUsesViews(void) {
+    PWImageBuffer *left = makeNoise(40, 30, PWPixelFormat_YCbCr420, 42), *right = makeNoise(40, 30, PWPixelFormat_YCbCr420, 43);
+    PWAlignment alignment = { .verticalOffset = 5.2 };
+    PWImageBuffer *leftOutput = NULL, *rightOutput = NULL;
+    CHECK(PWAlignCreateCorrectedPair(left, right, alignment, &leftOutput, &rightOutput) == PWError_None, "vertical correction failed");
+        // 5.2 rows rounds to 4 for YCbCr. The right photo is lower, so its top rows go.
+    CHECK(leftOutput && leftOutput->height == 26 && leftOutput->data == left->data
+          && rightOutput->height == 26 && rightOutput->data == PWImageBufferRow(right, 4), "vertical correction should just take views");
+    PWImageBufferRelease(leftOutput);
+    PWImageBufferRelease(rightOutput);
+    alignment.verticalOffset = 0.4;
+    CHECK(PWAlignCreateCorrectedPair(left, right, alignment, &leftOutput, &rightOutput) == PWError_None
+          && leftOutput == left && rightOutput == right, "a negligible correction should return the photos");
+    PWImageBufferRelease(leftOutput);
+    PWImageBufferRelease(rightOutput);
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+}
+
+// MARK: - Disparity
+
+    /// A pair of SCENE with the background moved BACKGROUNDSHIFT pixels to the right in the right photo, and a nearer
+    /// square of different detail in the middle moved FOREGROUNDSHIFT.
+static void makeDepthPair(const PWImageBuffer *scene, const PWImageBuffer *object, long backgroundShift, long foregroundShift,
+                          PWImageBuffer **left, PWImageBuffer **right) {
+    *left = PWImageBufferCreate(scene->width, scene->height, scene->format);
+    *right = PWImageBufferCreate(scene->width, scene->height, scene->format);
+    long width = (long)scene->width, first = width * 3 / 8, end = width * 5 / 8;
+    size_t channels = PWPixelFormatBytesPerPixel(scene->format);
+    for (size_t y = 0; y < scene->height && *left && *right; y++) {
+        bool inObject = y >= scene->height * 3 / 8 && y < scene->height * 5 / 8;
+        const uint8_t *sceneRow = PWImageBufferRow(scene, y), *objectRow = PWImageBufferRow(object, y);
+        uint8_t *leftRow = PWImageBufferRow(*left, y), *rightRow = PWImageBufferRow(*right, y);
+        for (long x = 0; x < width; x++) {
+            bool leftObject = inObject && x >= first && x < end;
+            bool rightObject = inObject && x >= first + foregroundShift && x < end + foregroundShift;
+            long sceneX = x - backgroundShift < 0 ? 0 : x - backgroundShift;
+            memcpy(leftRow + x * channels, (leftObject ? objectRow : sceneRow) + x * channels, channels);
+            memcpy(rightRow + x * channels, rightObject ? objectRow + (x - foregroundShift) * channels : sceneRow + sceneX * channels, channels);
+        }
+    }
+}
+
+static void testDisparityFindsShifts(void) {
+    PWImageBuffer *scene = makeScene(640, 480, PWPixelFormat_RGB888, 51), *object = makeScene(640, 480, PWPixelFormat_RGB888, 52);
+    PWImageBuffer *left = NULL, *right = NULL;
+    makeDepthPair(scene, object, 8, 24, &left, &right);
+    PWDisparityMap map;
+    CHECK(left && right && PWDisparityEstimate(left, right, &map) == PWError_None, "couldn't estimate the disparity");
+    double background = PWDisparityMapShiftAt(&map, 100, 100), foreground = PWDisparityMapShiftAt(&map, 320, 240);
+    CHECK(fabs(background - 8) < 1 && fabs(foreground - 24) < 2,
+          "found shifts of %.2f and %.2f, expected 8 and 24", background, foreground);
+
+        // The map doesn't depend on the number of threads.
+    PWDisparityMap single;
+    PWParallelSetThreadCount(1);
+    CHECK(PWDisparityEstimate(left, right, &single) == PWError_None && single.columns == map.columns && single.rows == map.rows
+          && memcmp(single.shifts, map.shifts, map.columns * map.rows * sizeof(float)) == 0, "the map changed with the thread count");
+    PWParallelSetThreadCount(0);
+    PWDisparityMapFree(&single);
+    PWDisparityMapFree(&map);
+
+    PWImageBuffer *flat = makeFilled(400, 300, PWPixelFormat_Gray8, 128);
+    CHECK(PWDisparityEstimate(flat, flat, &map) == PWError_NotSupported && !map.shifts, "a featureless pair should not be matched");
+    CHECK(PWDisparityEstimate(flat, scene, &map) == PWError_InvalidParameter, "photos of different sizes should be refused");
+    PWImageBufferRelease(flat);
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+    PWImageBufferRelease(object);
+    PWImageBufferRelease(scene);
+}
+
+static void testDisparityViewsLieBetweenPhotos(void) {
+    const PWPixelFormat formats[] = { PWPixelFormat_RGBA8888, PWPixelFormat_YCbCr420 };
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        PWImageBuffer *scene = makeScene(480, 320, formats[f], 53), *left = NULL, *right = NULL;
+        PWImageRect leftRect = { 16, 0, 448, 320 }, rightRect = { 0, 0, 448, 320 }, middleRect = { 8, 0, 448, 320 };
+        left = PWImageBufferCreateSubImage(scene, leftRect);
+        right = PWImageBufferCreateSubImage(scene, rightRect);
+        PWDisparityMap map;
+        CHECK(PWDisparityEstimate(left, right, &map) == PWError_None, "format %d: couldn't estimate the disparity", formats[f]);
+        PWImageBuffer *start = PWDisparityCreateView(left, right, &map, 0), *end = PWDisparityCreateView(left, right, &map, 1);
+        CHECK(buffersEqual(start, left) && buffersEqual(end, right), "format %d: the ends should be the photos", formats[f]);
+
+            // The whole scene moves 16 pixels, so half way it has moved 8, apart from the edge the right photo doesn't show.
+        PWImageBuffer *middle = PWDisparityCreateView(left, right, &map, 0.5), *expected = PWImageBufferCreateSubImage(scene, middleRect);
+        PWImageRect inside = { 16, 0, 416, 320 };
+        PWImageBuffer *middleInside = middle ? PWImageBufferCreateSubImage(middle, inside) : NULL;
+        PWImageBuffer *expectedInside = PWImageBufferCreateSubImage(expected, inside);
+        CHECK(buffersNear(middleInside, expectedInside, 8), "format %d: the middle view should be half way", formats[f]);
+        PWParallelSetThreadCount(1);
+        PWImageBuffer *single = PWDisparityCreateView(left, right, &map, 0.5);
+        PWParallelSetThreadCount(0);
+        CHECK(buffersEqual(single, middle), "format %d: the view changed with the thread count", formats[f]);
+        PWImageBufferRelease(single);
+        PWImageBufferRelease(middleInside);
+        PWImageBufferRelease(expectedInside);
+        PWImageBufferRelease(middle);
+        PWImageBufferRelease(expected);
+        PWImageBufferRelease(start);
+        PWImageBufferRelease(end);
+        PWDisparityMapFree(&map);
+        PWImageBufferRelease(left);
+        PWImageBufferRelease(right);
+        PWImageBufferRelease(scene);
+    }
+}
+
+// MARK: - Stereo pairs
+
+static void testStereoPairCropRoundsToEvenPixels(void) {
+    PWImageBuffer *photo = makeNoise(40, 30, PWPixelFormat_YCbCr420, 42);
+    PWImageBuffer *cropped = PWStereoPairCreateCroppedPhoto(photo, (PWCropRect) { 3.5, 5, 20.2, 11 });
+        // Whole pixels 3...24 x 5...16. The left and top edges move out to 2 and 4, giving an even 22 x 12.
+    CHECK(cropped && cropped->width == 22 && cropped->height == 12 && cropped->data == PWImageBufferRow(photo, 4) + 2,
+          "crop was not rounded to even pixels");
+    PWImageBufferRelease(cropped);
+    PWCropRect unchanged[] = { { 0, 0, 0, 0 }, { 50, 40, 10, 10 }, { 0, 0, NAN, 10 } };
+    for (size_t i = 0; i < sizeof(unchanged) / sizeof(unchanged[0]); i++) {
+        cropped = PWStereoPairCreateCroppedPhoto(photo, unchanged[i]);
+        CHECK(cropped == photo, "crop %zu should have left the photo as it was", i);
+        PWImageBufferRelease(cropped);
+    }
+    PWImageBufferRelease(photo);
+}
+
+static void testStereoPairRotationUsesCropCentre(void) {
+        // Rotated about the middle of the photo, a crop at the right-hand edge is lower by half its offset from the centre.
+    PWImageBuffer *left = makeNoise(200, 40, PWPixelFormat_Gray8, 42), *right = makeNoise(200, 40, PWPixelFormat_Gray8, 43);
+    PWImageBuffer *leftOutput = NULL, *rightOutput = NULL;
+    PWAlignment alignment = { .rotation = atan(0.1) };
+    PWCropRect cropRect = { 160, 0, 40, 40 };
+    CHECK(PWStereoPairCreatePhotos(left, right, cropRect, alignment, &leftOutput, &rightOutput) == PWError_None,
+          "correcting a cropped pair failed");
+    PWImageBuffer *leftExpected = NULL, *rightExpected = NULL;
+    PWImageBuffer *leftCrop = PWStereoPairCreateCroppedPhoto(left, cropRect), *rightCrop = PWStereoPairCreateCroppedPhoto(right, cropRect);
+    alignment.verticalOffset = 8.0;
+    CHECK(PWAlignCreateCorrectedPair(leftCrop, rightCrop, alignment, &leftExpected, &rightExpected) == PWError_None
+          && buffersEqual(leftOutput, leftExpected) && buffersEqual(rightOutput, rightExpected),
+          "the rotation was not allowed for at the centre of the crop");
+    PWImageBufferRelease(leftExpected);
+    PWImageBufferRelease(rightExpected);
+    PWImageBufferRelease(leftCrop);
+    PWImageBufferRelease(rightCrop);
+    PWImageBufferRelease(leftOutput);
+    PWImageBufferRelease(rightOutput);
+
+        // A stored offset bigger than a later crop is limited rather than rejected.
+    CHECK(PWStereoPairCreateShiftedViews(left, right, -500, &leftOutput, &rightOutput) == PWError_None
+          && leftOutput->width == 2 && rightOutput->width == 2, "a large disparity offset should leave 2 columns");
+    PWImageBufferRelease(leftOutput);
+    PWImageBufferRelease(rightOutput);
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+}
+
+static void testLibraryReadsProperties(void) {
+    char directory[] = "/tmp/stereogram-core-tests-XXXXXX";
+    CHECK(mkdtemp(directory), "couldn't create a temporary directory");
+    char path[sizeof(directory) + 32];
+    snprintf(path, sizeof(path), "%s/%s", directory, PWLibraryPropertyListFileName);
+    FILE *file = fopen(path, "w");
+    CHECK(file, "couldn't write a property list");
+    if (file) {
+            // As written by NSPropertyListSerialization.
+        fputs("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<plist version=\"1.0\">\n<dict>\n"
+              "\t<key>AlignmentOffset</key>\n\t<real>-3.25</real>\n"
+              "\t<key>AlignmentRotation</key>\n\t<real>0.0125</real>\n"
+              "\t<key>CropRect</key>\n\t<string>{{12.5, 0}, {1600, 1200}}</string>\n"
+              "\t<key>DateTaken</key>\n\t<date>2026-10-19T09:00:00Z</date>\n"
+              "\t<key>DisparityOffset</key>\n\t<integer>-14</integer>\n"
+              "\t<key>PerceptualHash</key>\n\t<string>f0e1d2c3b4a59687</string>\n"
+              "\t<key>ViewingMethod</key>\n\t<integer>2</integer>\n"
+              "</dict>\n</plist>\n", file);
+        fclose(file);
+    }
+    PWLibraryProperties properties;
+    CHECK(PWLibraryReadProperties(directory, &properties) == PWError_None, "couldn't read the property list");
+    CHECK(properties.viewingMethod == 2 && properties.disparityOffset == -14
+          && properties.alignment.verticalOffset == -3.25 && properties.alignment.rotation == 0.0125
+          && properties.cropRect.x == 12.5 && properties.cropRect.y == 0
+          && properties.cropRect.width == 1600 && properties.cropRect.height == 1200
+          && properties.hasPerceptualHash && properties.perceptualHash == 0xf0e1d2c3b4a59687ull, "property list was misread");
+    unlink(path);
+    CHECK(PWLibraryReadProperties(directory, &properties) == PWError_IO && properties.viewingMethod == 0
+          && properties.cropRect.width == 0 && !properties.hasPerceptualHash, "a missing property list should give the defaults");
+    rmdir(directory);
+}
+
+// MARK: - Perceptual hashes
+
+static uint64_t hashOf(const PWImageBuffer *image) {
+    uint64_t hash = 0;
+    CHECK(PWPerceptualHashCompute(image, &hash) == PWError_None, "couldn't hash a %zux%zu image", image->width, image->height);
+    return hash;
+}
+
+static void testPerceptualHashFindsReshoots(void) {
+    PWImageBuffer *scene = makeScene(640, 480, PWPixelFormat_RGB888, 51), *other = makeScene(640, 480, PWPixelFormat_RGB888, 52);
+        // The same scene taken again a little to one side, smaller and compressed harder.
+    PWImageBuffer *moved = PWImageBufferCreateSubImage(scene, (PWImageRect) { 6, 4, 628, 472 });
+    PWImageBuffer *smaller = PWResampleCreate(moved, 400, 300, PWResampleFilter_Bilinear), *reshoot = NULL;
+    PWJPEGEncodeOptions options;
+    PWJPEGEncodeOptionsInit(&options);
+    options.quality = 60;
+    PWDataBuffer jpeg;
+    PWDataBufferInit(&jpeg, 0);
+    CHECK(PWJPEGEncode(smaller, &options, &jpeg) == PWError_None && PWJPEGDecode(jpeg.bytes, jpeg.length, &reshoot) == PWError_None,
+          "couldn't recompress the scene");
+    uint64_t sceneHash = hashOf(scene);
+    unsigned reshootDistance = PWPerceptualHashDistance(sceneHash, reshoot ? hashOf(reshoot) : ~sceneHash);
+    unsigned otherDistance = PWPerceptualHashDistance(sceneHash, hashOf(other));
+    CHECK(reshootDistance <= PWPerceptualHashNearDuplicateDistance, "a re-shoot is %u bits from the original", reshootDistance);
+    CHECK(otherDistance > 2 * PWPerceptualHashNearDuplicateDistance, "a different scene is only %u bits from the original", otherDistance);
+    PWDataBufferFree(&jpeg);
+    PWImageBufferRelease(reshoot);
+    PWImageBufferRelease(smaller);
+    PWImageBufferRelease(moved);
+    PWImageBufferRelease(other);
+    PWImageBufferRelease(scene);
+}
+
+    /// The groups PWPerceptualHashGroup() should find, worked out the slow way from every pair.
+static void groupEveryPair(const uint64_t *hashes, size_t count, unsigned maximumDistance, size_t *expected) {
+    for (size_t i = 0; i < count; i++) {
+        expected[i] = i;
+        for (size_t j = 0; j < i; j++) {
+            if (PWPerceptualHashDistance(hashes[i], hashes[j]) <= maximumDistance) {
+                expected[i] = expected[j];
+                break;
+            }
+        }
+    }
+        // A hash can match two groups made earlier, in which case they are one group named by the lower.
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (size_t i = 0; i < count; i++) {
+            for (size_t j = 0; j < i; j++) {
+                if (PWPerceptualHashDistance(hashes[i], hashes[j]) <= maximumDistance && expected[i] != expected[j]) {
+                    size_t from = expected[i] > expected[j] ? expected[i] : expected[j], to = expected[i] + expected[j] - from;
+                    for (size_t k = 0; k < count; k++) {
+                        expected[k] = expected[k] == from ? to : expected[k];
+                    }
+                    changed = true;
+                }
+            }
+        }
+    }
+}
+
+static void testPerceptualHashGroupsMatchPairs(void) {
+        // Clusters of up to four hashes a few bits apart, with one cluster chained to the next through a middle hash.
+    enum { Count = 1500, MaximumDistance = 6 };
+    uint64_t *hashes = malloc(Count * sizeof(uint64_t)), random = 0x9E3779B97F4A7C15ull;
+    size_t *expected = malloc(Count * sizeof(size_t)), *groups = malloc(Count * sizeof(size_t));
+    for (size_t i = 0; i < Count; i++) {
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        hashes[i] = i % 4 == 0 ? random : hashes[i - 1] ^ (1ull << (random % 64)) ^ (1ull << (random >> 58)) ^ (1ull << (random >> 40 & 63));
+    }
+    hashes[1000] = hashes[996] ^ 0x7;
+    hashes[1001] = hashes[1000] ^ 0x70;
+    hashes[1002] = hashes[1001] ^ 0x700;
+
+        // The first distance is small enough for the hashes to be indexed; at the second every pair is compared.
+    const unsigned distances[] = { MaximumDistance, 24 }, threadCounts[] = { 1, 3 };
+    for (size_t d = 0; d < sizeof(distances) / sizeof(distances[0]); d++) {
+        groupEveryPair(hashes, Count, distances[d], expected);
+        CHECK(expected[1002] == expected[996], "the chained test hashes should be one group");
+        for (size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); t++) {
+            PWParallelSetThreadCount(threadCounts[t]);
+            CHECK(PWPerceptualHashGroup(hashes, Count, distances[d], groups) == PWError_None, "grouping failed");
+            CHECK(memcmp(groups, expected, Count * sizeof(size_t)) == 0,
+                  "distance %u, %u threads: groups differ from comparing every pair", distances[d], threadCounts[t]);
+        }
+    }
+    PWParallelSetThreadCount(0);
+
+    size_t matches[8], found = PWPerceptualHashFind(hashes, Count, hashes[1001], MaximumDistance, matches, 8), total = 0;
+    bool ordered = found >= 1 && found <= 8, hasSelf = false;
+    for (size_t i = 0; i < Count; i++) {
+        total += PWPerceptualHashDistance(hashes[i], hashes[1001]) <= MaximumDistance;
+    }
+    for (size_t i = 0; ordered && i < found; i++) {
+        ordered = i == 0 || matches[i - 1] < matches[i];
+        hasSelf = hasSelf || matches[i] == 1001;
+    }
+    CHECK(found == total && ordered && hasSelf, "found %zu of %zu matches", found, total);
+    free(hashes);
+    free(expected);
+    free(groups);
+}
+
+// MARK: - Sequences
+
+    /// Makes noise frames, and records how far ahead of the sink the producer has got.
+typedef struct TestSequence {
+    size_t failAt, frameCount, sunkFrames, maximumAhead;
+    PWDataBuffer output;
+} TestSequence;
+
+static PWError makeTestFrame(void *context, size_t index, PWImageBuffer **left, PWImageBuffer **right) {
+    TestSequence *sequence = context;
+    size_t ahead = index - __atomic_load_n(&sequence->sunkFrames, __ATOMIC_SEQ_CST);
+    if (ahead > sequence->maximumAhead) {
+        sequence->maximumAhead = ahead;
+    }
+    if (index == sequence->failAt) {
+        return PWError_InvalidFormat;
+    }
+    *left = makeNoise(32, 24, PWPixelFormat_YCbCr420, (uint32_t)index * 2);
+    *right = makeNoise(32, 24, PWPixelFormat_YCbCr420, (uint32_t)index * 2 + 1);
+    return PWError_None;
+}
+
+static bool collectOutput(void *context, const uint8_t *bytes, size_t length) {
+    TestSequence *sequence = context;
+    __atomic_fetch_add(&sequence->sunkFrames, 1, __ATOMIC_SEQ_CST);
+    return PWDataBufferAppend(&sequence->output, bytes, length);
+}
+
+static void testSequenceLookAheadIsBounded(void) {
+    PWSequenceOptions options;
+    PWSequenceOptionsInit(&options);
+    PWDataBuffer expected = { NULL, 0, 0 };
+    for (size_t lookAhead = 0; lookAhead <= 3; lookAhead++) {
+        TestSequence sequence = { .failAt = SIZE_MAX, .frameCount = 20 };
+        PWDataBufferInit(&sequence.output, 0);
+        options.lookAhead = lookAhead;
+        CHECK(PWSequenceEncodeGIF(20, makeTestFrame, &sequence, &options, collectOutput, &sequence) == PWError_None,
+              "look-ahead %zu: encoding the sequence failed", lookAhead);
+        CHECK(sequence.maximumAhead <= lookAhead + 1, "look-ahead %zu: frame fetched %zu ahead of the output", lookAhead, sequence.maximumAhead);
+        CHECK(sequence.output.length > 6 && memcmp(sequence.output.bytes, "GIF89a", 6) == 0
+              && sequence.output.bytes[sequence.output.length - 1] == 0x3B, "look-ahead %zu: not a complete GIF file", lookAhead);
+        if (lookAhead == 0) {
+            expected = sequence.output;
+        } else {
+            CHECK(sequence.output.length == expected.length && memcmp(sequence.output.bytes, expected.bytes, expected.length) == 0,
+                  "look-ahead %zu changed the output", lookAhead);
+            PWDataBufferFree(&sequence.output);
+        }
+    }
+    PWDataBufferFree(&expected);
+
+        // An error part way through stops the producer, and the frames it made are freed.
+    TestSequence failing = { .failAt = 7, .frameCount = 20 };
+    PWDataBufferInit(&failing.output, 0);
+    options.lookAhead = 2;
+    CHECK(PWSequenceEncodeGIF(20, makeTestFrame, &failing, &options, collectOutput, &failing) == PWError_InvalidFormat,
+          "the frame source's error was not returned");
+    PWDataBufferFree(&failing.output);
+}
+
+static void testSequenceStoredInLibrary(void) {
+    char directory[] = "/tmp/stereogram-core-tests-XXXXXX";
+    CHECK(mkdtemp(directory), "couldn't create a temporary directory");
+    PWImageBuffer *photo = makeNoise(48, 32, PWPixelFormat_RGB888, 42);
+    PWDataBuffer jpeg;
+    PWDataBufferInit(&jpeg, 0);
+    CHECK(photo && PWJPEGEncode(photo, NULL, &jpeg) == PWError_None, "couldn't encode a photo");
+    CHECK(PWLibraryCreateStereogram(directory, "Sequence", &jpeg, &jpeg, 0) == PWError_None, "couldn't create a stereogram");
+    char path[sizeof(directory) + 16];
+    snprintf(path, sizeof(path), "%s/Sequence", directory);
+    CHECK(PWLibrarySequenceFrameCount(path) == 1, "a new stereogram should have one frame");
+    size_t index = 0;
+    for (size_t frame = 1; frame < 4; frame++) {
+        CHECK(PWLibraryAddSequenceFrame(path, &jpeg, &jpeg, &index) == PWError_None && index == frame, "couldn't add frame %zu", frame);
+    }
+    CHECK(PWLibrarySequenceFrameCount(path) == 4, "the sequence should have four frames");
+
+    TestSequence sink = { 0 };
+    PWDataBufferInit(&sink.output, 0);
+    CHECK(PWSequenceWriteGIF(path, NULL, collectOutput, &sink) == PWError_None && sink.sunkFrames == 5,
+          "the stored sequence should be written a frame at a time, then the trailer");
+    PWDataBufferFree(&sink.output);
+    size_t count = 0;
+    CHECK(PWLibraryEnumerate(directory, NULL, NULL, &count) == PWError_None && count == 1, "the frames shouldn't look like stereograms");
+    CHECK(PWLibraryDeleteAll(directory, &count) == PWError_None && count == 1, "couldn't delete the sequence");
+    CHECK(rmdir(directory) == 0, "deleting the sequence left files behind");
+    PWDataBufferFree(&jpeg);
+    PWImageBufferRelease(photo);
+}
+
+// MARK: - Anaglyphs
+
+static void testAnaglyphTakesRedFromLeft(void) {
+        // Wider than one conversion chunk, and of different sizes and formats, so only the shared area is used.
+    PWImageBuffer *left = makeNoise(300, 20, PWPixelFormat_RGB888, 11), *right = makeNoise(310, 18, PWPixelFormat_RGBA8888, 12);
+    PWImageBuffer *anaglyph = PWAnaglyphCreate(left, right, PWAnaglyph_Colour);
+    CHECK(anaglyph && anaglyph->width == 300 && anaglyph->height == 18 && anaglyph->format == PWPixelFormat_RGB888,
+          "colour anaglyph has the wrong size or format");
+    for (size_t y = 0; anaglyph && y < anaglyph->height; y++) {
+        const uint8_t *out = PWImageBufferRow(anaglyph, y), *l = PWImageBufferRow(left, y), *r = PWImageBufferRow(right, y);
+        bool matches = true;
+        for (size_t x = 0; x < anaglyph->width; x++) {
+            matches = matches && out[x * 3] == l[x * 3] && out[x * 3 + 1] == r[x * 4 + 1] && out[x * 3 + 2] == r[x * 4 + 2];
+        }
+        CHECK(matches, "colour anaglyph row %zu doesn't take red from the left and green and blue from the right", y);
+    }
+    PWImageBufferRelease(anaglyph);
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+}
+
+static void testAnaglyphKeepsGreyGrey(void) {
+        // Each row of every mix adds up to 1, so a scene with no depth and no colour comes out as it went in.
+    for (PWAnaglyphMethod method = 0; method < PWAnaglyph_NUM_METHODS; method++) {
+        for (size_t f = 0; f < FormatCount; f++) {
+            PWImageBuffer *left = makeFilled(40, 10, AllFormats[f], 128), *right = makeFilled(40, 10, AllFormats[f], 128);
+            PWImageBuffer *anaglyph = PWAnaglyphCreate(left, right, method);
+            CHECK(anaglyph && allNear(anaglyph, 128, 1), "anaglyph method %d of grey format %d is not grey", method, AllFormats[f]);
+            PWImageBufferRelease(anaglyph);
+            PWImageBufferRelease(left);
+            PWImageBufferRelease(right);
+        }
+    }
+}
+
+static void testAnaglyphIgnoresThreadCount(void) {
+    PWImageBuffer *left = makeNoise(333, 101, PWPixelFormat_YCbCr420, 13), *right = makeNoise(333, 101, PWPixelFormat_YCbCr420, 14);
+    PWParallelSetThreadCount(1);
+    PWImageBuffer *single = PWAnaglyphCreate(left, right, PWAnaglyph_Optimised);
+    PWParallelSetThreadCount(5);
+    PWImageBuffer *several = PWAnaglyphCreate(left, right, PWAnaglyph_Optimised);
+    PWParallelSetThreadCount(0);
+    CHECK(buffersEqual(single, several), "anaglyph depends on the number of threads");
+    PWImageBufferRelease(single);
+    PWImageBufferRelease(several);
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+}
+
+// MARK: - MPO files
+
+static bool decodesEqual(const uint8_t *a, size_t aLength, const uint8_t *b, size_t bLength) {
+    PWImageBuffer *first = NULL, *second = NULL;
+    bool equal = PWJPEGDecode(a, aLength, &first) == PWError_None && PWJPEGDecode(b, bLength, &second) == PWError_None
+              && buffersEqual(first, second);
+    PWImageBufferRelease(first);
+    PWImageBufferRelease(second);
+    return equal;
+}
+
+static void testMPORoundTrips(void) {
+    PWImageBuffer *left = makeNoise(48, 32, PWPixelFormat_RGB888, 15), *right = makeNoise(48, 32, PWPixelFormat_RGB888, 16);
+    PWDataBuffer leftJPEG, rightJPEG, mpo, again;
+    PWDataBufferInit(&leftJPEG, 0);
+    PWDataBufferInit(&rightJPEG, 0);
+    PWDataBufferInit(&mpo, 0);
+    PWDataBufferInit(&again, 0);
+    CHECK(PWJPEGEncode(left, NULL, &leftJPEG) == PWError_None && PWJPEGEncode(right, NULL, &rightJPEG) == PWError_None,
+          "couldn't encode the test photos");
+    CHECK(PWMPOCreate(leftJPEG.bytes, leftJPEG.length, rightJPEG.bytes, rightJPEG.length, &mpo) == PWError_None,
+          "couldn't write an MPO file");
+
+        // Each picture is its photo with an MPF segment added, and decodes to the same pixels.
+    PWMPOImage leftImage = { 0, 0 }, rightImage = { 0, 0 };
+    CHECK(PWMPOFindStereoPair(mpo.bytes, mpo.length, &leftImage, &rightImage) == PWError_None, "couldn't read the MPO file back");
+    CHECK(leftImage.offset == 0 && rightImage.offset == leftImage.length && rightImage.offset + rightImage.length == mpo.length,
+          "MPO pictures should fill the file in order");
+    CHECK(decodesEqual(mpo.bytes + leftImage.offset, leftImage.length, leftJPEG.bytes, leftJPEG.length)
+          && decodesEqual(mpo.bytes + rightImage.offset, rightImage.length, rightJPEG.bytes, rightJPEG.length),
+          "MPO pictures don't decode to the photos they were made from");
+
+        // Writing the split pictures again replaces their MPF segments rather than adding more.
+    CHECK(PWMPOCreate(mpo.bytes + leftImage.offset, leftImage.length, mpo.bytes + rightImage.offset, rightImage.length, &again) == PWError_None
+          && again.length == mpo.length && memcmp(again.bytes, mpo.bytes, mpo.length) == 0,
+          "an MPO file made from split pictures should be the same as the original");
+
+    CHECK(PWMPOFindStereoPair(leftJPEG.bytes, leftJPEG.length, &leftImage, &rightImage) == PWError_InvalidFormat,
+          "a plain JPEG file is not an MPO file");
+    size_t length = again.length;
+    CHECK(PWMPOCreate(leftJPEG.bytes, leftJPEG.length - 2, rightJPEG.bytes, rightJPEG.length, &again) == PWError_InvalidFormat
+          && again.length == length, "a truncated photo should fail without changing the output");
+    PWDataBufferFree(&leftJPEG);
+    PWDataBufferFree(&rightJPEG);
+    PWDataBufferFree(&mpo);
+    PWDataBufferFree(&again);
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+}
+
+// MARK: - JPEG decoding
+
+#ifdef PW_HAVE_LIBJPEG
+
+    /// libjpeg error handler which returns to the caller instead of exiting.
+typedef struct ReferenceError {
+    struct jpeg_error_mgr manager;
+    jmp_buf recover;
+} ReferenceError;
+
+static void referenceErrorExit(j_common_ptr info) {
+    longjmp(((ReferenceError *)info->err)->recover, 1);
+}
+
+    /// Encodes IMAGE (RGB888 or Gray8) at quality 90 with libjpeg, taking one chroma sample per HORIZONTAL x VERTICAL luma samples.
+    /// The file is returned in *BYTES, which the caller must free.
+static bool referenceEncode(const PWImageBuffer *image, int horizontal, int vertical, unsigned char **bytes, unsigned long *length) {
+    struct jpeg_compress_struct info;
+    ReferenceError error;
+    *bytes = NULL;
+    *length = 0;
+    info.err = jpeg_std_error(&error.manager);
+    error.manager.error_exit = referenceErrorExit;
+    if (setjmp(error.recover)) {
+        jpeg_destroy_compress(&info);
+        free(*bytes);
+        *bytes = NULL;
+        return false;
+    }
+    jpeg_create_compress(&info);
+    jpeg_mem_dest(&info, bytes, length);
+    bool grey = image->format == PWPixelFormat_Gray8;
+    info.image_width = (JDIMENSION)image->width;
+    info.image_height = (JDIMENSION)image->height;
+    info.input_components = grey ? 1 : 3;
+    info.in_color_space = grey ? JCS_GRAYSCALE : JCS_RGB;
+    jpeg_set_defaults(&info);
+    jpeg_set_quality(&info, 90, TRUE);
+    if (!grey) {
+        info.comp_info[0].h_samp_factor = horizontal;
+        info.comp_info[0].v_samp_factor = vertical;
+    }
+    jpeg_start_compress(&info, TRUE);
+    while (info.next_scanline < info.image_height) {
+        JSAMPROW row = PWImageBufferRow(image, info.next_scanline);
+        jpeg_write_scanlines(&info, &row, 1);
+    }
+    jpeg_finish_compress(&info);
+    jpeg_destroy_compress(&info);
+    return true;
+}
+
+    /// Decodes the JPEG file in BYTES to RGB888 with libjpeg, using the float IDCT and plain chroma replication like PWJPEGDecode.
+static PWImageBuffer *referenceDecode(const uint8_t *bytes, size_t length) {
+    struct jpeg_decompress_struct info;
+    ReferenceError error;
+    PWImageBuffer *volatile image = NULL;
+    info.err = jpeg_std_error(&error.manager);
+    error.manager.error_exit = referenceErrorExit;
+    if (setjmp(error.recover)) {
+        jpeg_destroy_decompress(&info);
+        PWImageBufferRelease(image);
+        return NULL;
+    }
+    jpeg_create_decompress(&info);
+    jpeg_mem_src(&info, (unsigned char *)bytes, (unsigned long)length);
+    jpeg_read_header(&info, TRUE);
+    info.out_color_space = JCS_RGB;
+    info.dct_method = JDCT_FLOAT;
+    info.do_fancy_upsampling = FALSE;
+    jpeg_start_decompress(&info);
+    image = PWImageBufferCreate(info.output_width, info.output_height, PWPixelFormat_RGB888);
+    while (image && info.output_scanline < info.output_height) {
+        JSAMPROW row = PWImageBufferRow(image, info.output_scanline);
+        jpeg_read_scanlines(&info, &row, 1);
+    }
+    jpeg_finish_decompress(&info);
+    jpeg_destroy_decompress(&info);
+    return image;
+}
+
+    /// Largest difference between a colour channel of IMAGE, in any format, and the RGB888 image REFERENCE, or -1 if their sizes
+    /// differ. DIFFERING is set to the number of channels which aren't equal.
+static int differenceFromReference(const PWImageBuffer *image, const PWImageBuffer *reference, size_t *differing) {
+    *differing = 0;
+    if (!image || !reference || image->width != reference->width || image->height != reference->height) {
+        return -1;
+    }
+    int largest = 0;
+    uint8_t *rgbx = malloc(image->width * 4);
+    for (size_t y = 0; rgbx && y < image->height; y++) {
+        PWImageBufferConvertRowToRGBX(image, y, 0, image->width, rgbx);
+        const uint8_t *expected = PWImageBufferRow(reference, y);
+        for (size_t x = 0; x < image->width; x++) {
+            for (int c = 0; c < 3; c++) {
+                int difference = abs(rgbx[x * 4 + c] - expected[x * 3 + c]);
+                largest = difference > largest ? difference : largest;
+                *differing += difference != 0;
+            }
+        }
+    }
+    free(rgbx);
+    return rgbx ? largest : -1;
+}
+
+#endif
+
+static void testJPEGDecodeMatchesLibjpeg(void) {
+#ifdef PW_HAVE_LIBJPEG
+        // Both IDCTs are float, but libjpeg's SIMD version adds in a different order, so now and then a sample rounds the other
+        // way. One level out in luma and chroma can make two in a colour channel. Anything more, or more often, is a real bug.
+    static const struct { const char *name; int horizontal, vertical; } samplings[] = {
+        { "grey", 1, 1 }, { "4:4:4", 1, 1 }, { "4:2:2", 2, 1 }, { "4:2:0", 2, 2 }
+    };
+    for (size_t i = 0; i < sizeof(samplings) / sizeof(samplings[0]); i++) {
+        PWImageBuffer *photo = makeNoise(203, 149, i == 0 ? PWPixelFormat_Gray8 : PWPixelFormat_RGB888, 61), *decoded = NULL;
+        unsigned char *file;
+        unsigned long length;
+        CHECK(referenceEncode(photo, samplings[i].horizontal, samplings[i].vertical, &file, &length), "%s: libjpeg couldn't encode", samplings[i].name);
+        CHECK(PWJPEGDecode(file, length, &decoded) == PWError_None, "%s: couldn't decode", samplings[i].name);
+        PWImageBuffer *expected = referenceDecode(file, length);
+        size_t differing;
+        int difference = differenceFromReference(decoded, expected, &differing);
+        CHECK(difference >= 0 && difference <= (i == 0 ? 1 : 2) && differing * 1000 < photo->width * photo->height * 3,
+              "%s: %zu channels differ from libjpeg's, by up to %d levels", samplings[i].name, differing, difference);
+        free(file);
+        PWImageBufferRelease(photo);
+        PWImageBufferRelease(decoded);
+        PWImageBufferRelease(expected);
+    }
+#else
+    printf("libjpeg wasn't found, so the decoder isn't compared with it.\n");
+#endif
+}
+
+// MARK: - JPEG encoding
+
+    /// Number of restart markers in the JPEG file DATA. Stuffed 0xFF bytes are followed by 0, so they don't count.
+static size_t countRestartMarkers(const PWDataBuffer *data) {
+    size_t count = 0;
+    for (size_t i = 0; i + 1 < data->length; i++) {
+        if (data->bytes[i] == 0xFF && data->bytes[i + 1] >= 0xD0 && data->bytes[i + 1] <= 0xD7) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static void testJPEGStripsDecodeAsOne(void) {
+    PWImageBuffer *photo = makeScene(640, 480, PWPixelFormat_RGB888, 41);
+    PWJPEGEncodeOptions options;
+    PWJPEGEncodeOptionsInit(&options);
+    PWDataBuffer single, several, unbroken;
+    PWDataBufferInit(&single, 0);
+    PWDataBufferInit(&several, 0);
+    PWDataBufferInit(&unbroken, 0);
+    PWParallelSetThreadCount(1);
+    CHECK(PWJPEGEncode(photo, &options, &single) == PWError_None, "couldn't encode on one thread");
+    PWParallelSetThreadCount(5);
+    CHECK(PWJPEGEncode(photo, &options, &several) == PWError_None, "couldn't encode on several threads");
+    PWParallelSetThreadCount(0);
+    CHECK(single.length == several.length && memcmp(single.bytes, several.bytes, single.length) == 0,
+          "JPEG file depends on the number of threads");
+
+        // 30 MCU rows make 8 strips. Restart markers change only how the data is coded, not the pixels.
+    CHECK(countRestartMarkers(&several) == 7, "expected 7 restart markers, found %zu", countRestartMarkers(&several));
+    options.restartRows = 0;
+    CHECK(PWJPEGEncode(photo, &options, &unbroken) == PWError_None && countRestartMarkers(&unbroken) == 0,
+          "a file without restart markers has some");
+    CHECK(decodesEqual(several.bytes, several.length, unbroken.bytes, unbroken.length),
+          "a file cut into strips decodes differently from one that isn't");
+    PWDataBufferFree(&single);
+    PWDataBufferFree(&several);
+    PWDataBufferFree(&unbroken);
+    PWImageBufferRelease(photo);
+}
+
+static void testJPEGReducedDecodeMatchesAreaScaling(void) {
+    PWPixelFormat formats[] = { PWPixelFormat_Gray8, PWPixelFormat_RGB888 };
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+            // 1 pixel over a multiple of the block size, which the reduced image rounds up to a whole pixel.
+        PWImageBuffer *photo = makeScene(641, 481, formats[i], 43);
+        PWDataBuffer file;
+        PWDataBufferInit(&file, 0);
+        CHECK(PWJPEGEncode(photo, NULL, &file) == PWError_None, "couldn't encode format %d", formats[i]);
+        PWImageBuffer *full = NULL, *reduced = NULL;
+        CHECK(PWJPEGDecode(file.bytes, file.length, &full) == PWError_None, "couldn't decode format %d", formats[i]);
+        CHECK(PWJPEGDecodeReduced(file.bytes, file.length, &reduced) == PWError_None && reduced
+              && reduced->width == 81 && reduced->height == 61 && full && reduced->format == full->format,
+              "reduced decode of format %d should be 81 x 61 in the full decode's format", formats[i]);
+        if (full && reduced) {
+                // The DC coefficients are the block means, so compare the whole blocks with an area filter.
+            PWImageBuffer *blocks = PWImageBufferCreateSubImage(full, (PWImageRect) { 0, 0, 640, 480 });
+            PWImageBuffer *expected = PWResampleCreate(blocks, 80, 60, PWResampleFilter_Area);
+            PWImageBuffer *actual = PWImageBufferCreateSubImage(reduced, (PWImageRect) { 0, 0, 80, 60 });
+            CHECK(expected && actual && buffersNear(expected, actual, 3),
+                  "reduced decode of format %d differs from the area-scaled full decode", formats[i]);
+            PWImageBufferRelease(blocks);
+            PWImageBufferRelease(expected);
+            PWImageBufferRelease(actual);
+        }
+        PWImageBufferRelease(full);
+        PWImageBufferRelease(reduced);
+        PWDataBufferFree(&file);
+        PWImageBufferRelease(photo);
+    }
+}
+
+    /// True if libjpeg decodes the JPEG file in BYTES to a WIDTH x HEIGHT image, or if libjpeg isn't available.
+static bool referenceDecodes(const uint8_t *bytes, size_t length, size_t width, size_t height) {
+#ifdef PW_HAVE_LIBJPEG
+    PWImageBuffer *image = referenceDecode(bytes, length);
+    bool decodes = image && image->width == width && image->height == height;
+    PWImageBufferRelease(image);
+    return decodes;
+#else
+    (void)bytes, (void)length, (void)width, (void)height;
+    return true;
+#endif
+}
+
+    /// True if the progressive JPEG file in BYTES decodes to the same pixels as IMAGE saved without progressive scans using OPTIONS.
+    /// Only libjpeg can decode progressive files, so this is always true without it.
+static bool progressiveMatchesBaseline(const uint8_t *bytes, size_t length, const PWImageBuffer *image, const PWJPEGEncodeOptions *options) {
+#ifdef PW_HAVE_LIBJPEG
+    PWJPEGEncodeOptions baselineOptions = *options;
+    baselineOptions.progressive = false;
+    PWDataBuffer baseline;
+    PWDataBufferInit(&baseline, 0);
+    PWImageBuffer *progressive = referenceDecode(bytes, length), *expected = NULL;
+    if (PWJPEGEncode(image, &baselineOptions, &baseline) == PWError_None) {
+        expected = referenceDecode(baseline.bytes, baseline.length);
+    }
+    bool equal = expected && buffersEqual(progressive, expected);
+    PWDataBufferFree(&baseline);
+    PWImageBufferRelease(progressive);
+    PWImageBufferRelease(expected);
+    return equal;
+#else
+    (void)bytes, (void)length, (void)image, (void)options;
+    return true;
+#endif
+}
+
+static void testJPEGEncodesPlanarAndProgressive(void) {
+    PWImageBuffer *photo = makeScene(200, 150, PWPixelFormat_RGB888, 42), *decoded = NULL, *again = NULL;
+    PWJPEGEncodeOptions options;
+    PWJPEGEncodeOptionsInit(&options);
+    options.quality = 100;
+    PWDataBuffer file, planarFile, progressiveFile;
+    PWDataBufferInit(&file, 0);
+    PWDataBufferInit(&planarFile, 0);
+    PWDataBufferInit(&progressiveFile, 0);
+    CHECK(PWJPEGEncode(photo, &options, &file) == PWError_None && PWJPEGDecode(file.bytes, file.length, &decoded) == PWError_None
+          && decoded->format == PWPixelFormat_YCbCr420, "couldn't make a planar test photo");
+
+        // A decoded photo can be saved again without converting its colours, and comes back almost the same.
+    CHECK(decoded && PWJPEGEncode(decoded, &options, &planarFile) == PWError_None
+          && PWJPEGDecode(planarFile.bytes, planarFile.length, &again) == PWError_None, "couldn't encode a planar photo");
+    CHECK(buffersNear(decoded, again, 3), "planar photo changed when saved again");
+
+    options.progressive = true;
+    PWJPEGInfo info;
+    CHECK(PWJPEGEncode(photo, &options, &progressiveFile) == PWError_None
+          && PWJPEGReadInfo(progressiveFile.bytes, progressiveFile.length, &info) == PWError_None
+          && info.progressive && info.width == photo->width && info.height == photo->height, "couldn't write a progressive file");
+    CHECK(progressiveMatchesBaseline(progressiveFile.bytes, progressiveFile.length, photo, &options),
+          "progressive file doesn't decode to the same pixels as a baseline one");
+    PWDataBufferFree(&progressiveFile);
+    PWDataBufferInit(&progressiveFile, 0);
+    CHECK(decoded && PWJPEGEncode(decoded, &options, &progressiveFile) == PWError_None
+          && progressiveMatchesBaseline(progressiveFile.bytes, progressiveFile.length, decoded, &options),
+          "progressive planar file doesn't decode to the same pixels as a baseline one");
+    PWDataBufferFree(&file);
+    PWDataBufferFree(&planarFile);
+    PWDataBufferFree(&progressiveFile);
+    PWImageBufferRelease(photo);
+    PWImageBufferRelease(decoded);
+    PWImageBufferRelease(again);
+}
+
+static void testJPEGMeetsTargetLength(void) {
+    PWImageBuffer *photo = makeNoise(256, 192, PWPixelFormat_RGB888, 43), *decoded = NULL;
+    PWJPEGEncodeOptions options;
+    PWJPEGEncodeOptionsInit(&options);
+    PWDataBuffer full, target;
+    PWDataBufferInit(&full, 0);
+    PWDataBufferInit(&target, 0);
+    CHECK(PWJPEGEncode(photo, &options, &full) == PWError_None, "couldn't encode the test photo");
+    options.targetLength = full.length / 3;
+    CHECK(PWJPEGEncode(photo, &options, &target) == PWError_None && target.length <= options.targetLength
+          && target.length > options.targetLength / 2, "file of %zu bytes doesn't suit a target of %zu", target.length, options.targetLength);
+    CHECK(PWJPEGDecode(target.bytes, target.length, &decoded) == PWError_None, "file made to a target length doesn't decode");
+    PWImageBufferRelease(decoded);
+
+        // A target that can't be met gives the smallest file there is.
+    size_t length = target.length;
+    options.targetLength = 100;
+    CHECK(PWJPEGEncode(photo, &options, &target) == PWError_None && target.length > length + 100
+          && target.length - length < options.targetLength * 100, "an impossible target should give the quality 1 file");
+    PWDataBufferFree(&full);
+    PWDataBufferFree(&target);
+    PWImageBufferRelease(photo);
+}
+
+static void testExportMakesEverySize(void) {
+    enum { PresetCount = 5 };
+    const PWExportPreset presets[PresetCount] = {
+        { 100, PWExportFormat_JPEG, 0 }, { 0, PWExportFormat_JPEG, 0 }, { 400, PWExportFormat_JPEG, 80 },
+        { 100, PWExportFormat_GIF, 0 }, { 5000, PWExportFormat_JPEG, 0 }
+    };
+    PWImageBuffer *stereogram = makeScene(900, 300, PWPixelFormat_RGBA8888, 44);
+    PWDataBuffer outputs[PresetCount], again[PresetCount], single;
+    for (size_t i = 0; i < PresetCount; i++) {
+        PWDataBufferInit(&outputs[i], 0);
+        PWDataBufferInit(&again[i], 0);
+        PWDataBufferAppend(&outputs[i], "x", 1);
+    }
+    PWDataBufferInit(&single, 0);
+    PWParallelSetThreadCount(1);
+    CHECK(PWExportCreateFiles(stereogram, presets, PresetCount, again) == PWError_None, "couldn't export on one thread");
+    PWParallelSetThreadCount(0);
+    CHECK(PWExportCreateFiles(stereogram, presets, PresetCount, outputs) == PWError_None, "couldn't export");
+
+    for (size_t i = 0; i < PresetCount; i++) {
+        size_t width, height;
+        PWExportPresetSize(&presets[i], stereogram->width, stereogram->height, &width, &height);
+        const uint8_t *file = outputs[i].bytes + 1;
+        size_t length = outputs[i].length - 1;
+        CHECK(outputs[i].bytes[0] == 'x', "preset %zu: file wasn't appended to the buffer", i);
+        CHECK(length == again[i].length && memcmp(file, again[i].bytes, length) == 0,
+              "preset %zu: file depends on the number of threads", i);
+        if (presets[i].format == PWExportFormat_GIF) {
+            CHECK(length > 10 && memcmp(file, "GIF89a", 6) == 0 && file[6] + 256u * file[7] == width && file[8] + 256u * file[9] == height,
+                  "preset %zu: not a %zux%zu GIF", i, width, height);
+        } else {
+            PWJPEGInfo info;
+            CHECK(PWJPEGReadInfo(file, length, &info) == PWError_None && info.progressive && info.width == width && info.height == height,
+                  "preset %zu: not a progressive %zux%zu JPEG", i, width, height);
+            CHECK(referenceDecodes(file, length, width, height), "preset %zu: libjpeg can't decode the file", i);
+        }
+    }
+    size_t width, height;
+    PWExportPresetSize(&presets[2], stereogram->width, stereogram->height, &width, &height);
+    CHECK(width == 400 && height == 133, "export size should keep the image's shape, not %zux%zu", width, height);
+
+        // A full-size file is the same as exporting the stereogram on its own.
+    PWJPEGEncodeOptions options;
+    PWJPEGEncodeOptionsInit(&options);
+    options.progressive = true;
+    CHECK(PWJPEGEncode(stereogram, &options, &single) == PWError_None && single.length == outputs[1].length - 1
+          && memcmp(single.bytes, outputs[1].bytes + 1, single.length) == 0, "full-size file differs from a single export");
+    CHECK(progressiveMatchesBaseline(single.bytes, single.length, stereogram, &options),
+          "exported file doesn't decode to the same pixels as a baseline one");
+
+    PWExportPreset bad = { 0, PWExportFormat_JPEG, 101 };
+    size_t lengthBefore = outputs[0].length;
+    CHECK(PWExportCreateFiles(stereogram, &bad, 1, outputs) == PWError_InvalidParameter && outputs[0].length == lengthBefore,
+          "a bad preset should change nothing");
+    for (size_t i = 0; i < PresetCount; i++) {
+        PWDataBufferFree(&outputs[i]);
+        PWDataBufferFree(&again[i]);
+    }
+    PWDataBufferFree(&single);
+    PWImageBufferRelease(stereogram);
+}
+
+// MARK: - EXIF thumbnails
+
+static bool writeFile(const char *path, const PWDataBuffer *data) {
+    FILE *file = fopen(path, "wb");
+    bool written = file && fwrite(data->bytes, 1, data->length, file) == data->length;
+    if (file) {
+        written = fclose(file) == 0 && written;
+    }
+    return written;
+}
+
+    /// Find the EXIF orientation value in a file written by PWExifThumbnailAdd(), which puts it first in IFD0.
+static uint8_t *exifOrientationByte(PWDataBuffer *file) {
+    for (size_t i = 0; i + 32 < file->length; i++) {
+        if (memcmp(file->bytes + i, "Exif\0\0MM", 8) == 0) {
+            return file->bytes + i + 6 + 8 + 2 + 9;
+        }
+    }
+    return NULL;
+}
+
+static void testExifThumbnailRoundTrips(void) {
+    char directory[] = "/tmp/stereogram-core-tests-XXXXXX";
+    CHECK(mkdtemp(directory), "couldn't create a temporary directory");
+    char path[sizeof(directory) + 32];
+    snprintf(path, sizeof(path), "%s/LeftPhoto.jpg", directory);
+
+    PWImageBuffer *photo = makeScene(1024, 768, PWPixelFormat_RGB888, 21), *small = makeNoise(32, 24, PWPixelFormat_RGB888, 22);
+    PWDataBuffer plain, withThumbnail, again, thumbnail;
+    PWDataBufferInit(&plain, 0);
+    PWDataBufferInit(&withThumbnail, 0);
+    PWDataBufferInit(&again, 0);
+    PWDataBufferInit(&thumbnail, 0);
+    CHECK(PWJPEGEncode(photo, NULL, &plain) == PWError_None, "couldn't encode the test photo");
+    CHECK(PWExifThumbnailAdd(plain.bytes, plain.length, photo, &withThumbnail) == PWError_None, "couldn't add a thumbnail");
+    CHECK(decodesEqual(withThumbnail.bytes, withThumbnail.length, plain.bytes, plain.length),
+          "adding a thumbnail shouldn't change the photo");
+
+        // The thumbnail comes back from the first few kilobytes of the file.
+    PWExifThumbnailPhotoInfo photoInfo = { 0, 0, 0 };
+    size_t bytesRead = 0, length;
+    CHECK(writeFile(path, &withThumbnail), "couldn't write the test photo");
+    CHECK(PWExifThumbnailRead(path, &thumbnail, &photoInfo, &bytesRead) == PWError_None,
+          "couldn't read the thumbnail back");
+    CHECK(photoInfo.width == photo->width && photoInfo.height == photo->height && photoInfo.orientation == PWOrientation_Up,
+          "the photo's size and orientation were misread");
+    CHECK(bytesRead <= thumbnail.length + 1024 && bytesRead < withThumbnail.length / 4,
+          "reading the thumbnail read %zu bytes of %zu", bytesRead, withThumbnail.length);
+    PWJPEGInfo info;
+    CHECK(PWJPEGReadInfo(thumbnail.bytes, thumbnail.length, &info) == PWError_None
+          && info.width == PWExifThumbnailMaximumSize && info.height == PWExifThumbnailMaximumSize * 3 / 4,
+          "thumbnail should fit in %d pixels and keep the photo's shape", PWExifThumbnailMaximumSize);
+
+        // Adding a thumbnail again replaces the old one, keeping the orientation.
+    uint8_t *orientationByte = exifOrientationByte(&withThumbnail);
+    CHECK(orientationByte && *orientationByte == 1, "couldn't find the orientation tag");
+    if (orientationByte) {
+        *orientationByte = PWOrientation_Right;
+    }
+    CHECK(PWExifThumbnailAdd(withThumbnail.bytes, withThumbnail.length, NULL, &again) == PWError_None
+          && again.length <= withThumbnail.length + 1024, "adding a thumbnail to a file with one should replace it");
+    PWJPEGInfo againInfo;
+    CHECK(PWJPEGReadInfo(again.bytes, again.length, &againInfo) == PWError_None && againInfo.orientation == PWOrientation_Right,
+          "the photo's orientation should be kept");
+    PWImageBuffer *upright = NULL;
+    CHECK(writeFile(path, &again) && PWExifThumbnailCreateImage(path, &upright, &photoInfo) == PWError_None && upright
+          && upright->width == info.height && upright->height == info.width && photoInfo.orientation == PWOrientation_Right,
+          "the thumbnail should be turned upright by the photo's orientation");
+    PWImageBufferRelease(upright);
+
+    length = thumbnail.length;
+    CHECK(writeFile(path, &plain) && PWExifThumbnailRead(path, &thumbnail, NULL, NULL) == PWError_NotSupported
+          && thumbnail.length == length, "a file without a thumbnail should say so");
+    length = again.length;
+    CHECK(PWExifThumbnailAdd(plain.bytes, plain.length, small, &again) == PWError_InvalidParameter && again.length == length,
+          "a photo of the wrong size should fail without changing the output");
+    CHECK(PWExifThumbnailAdd(plain.bytes + 2, plain.length - 2, NULL, &again) == PWError_InvalidFormat && again.length == length,
+          "a file which isn't a JPEG should fail without changing the output");
+    unlink(path);
+    rmdir(directory);
+    PWDataBufferFree(&plain);
+    PWDataBufferFree(&withThumbnail);
+    PWDataBufferFree(&again);
+    PWDataBufferFree(&thumbnail);
+    PWImageBufferRelease(photo);
+    PWImageBufferRelease(small);
+}
+
+static void testPreviewPhotosPreferThumbnails(void) {
+    char directory[] = "/tmp/stereogram-core-tests-XXXXXX";
+    CHECK(mkdtemp(directory), "couldn't create a temporary directory");
+    char leftPath[sizeof(directory) + 32], rightPath[sizeof(directory) + 32];
+    snprintf(leftPath, sizeof(leftPath), "%s/LeftPhoto.jpg", directory);
+    snprintf(rightPath, sizeof(rightPath), "%s/RightPhoto.jpg", directory);
+
+    PWImageBuffer *leftPhoto = makeScene(1024, 768, PWPixelFormat_RGB888, 31);
+    PWImageBuffer *rightPhoto = makeScene(1024, 768, PWPixelFormat_RGB888, 32);
+    PWDataBuffer left, right, leftWithThumbnail, rightWithThumbnail;
+    PWDataBufferInit(&left, 0);
+    PWDataBufferInit(&right, 0);
+    PWDataBufferInit(&leftWithThumbnail, 0);
+    PWDataBufferInit(&rightWithThumbnail, 0);
+    CHECK(PWJPEGEncode(leftPhoto, NULL, &left) == PWError_None && PWJPEGEncode(rightPhoto, NULL, &right) == PWError_None
+          && PWExifThumbnailAdd(left.bytes, left.length, leftPhoto, &leftWithThumbnail) == PWError_None
+          && PWExifThumbnailAdd(right.bytes, right.length, rightPhoto, &rightWithThumbnail) == PWError_None,
+          "couldn't encode the test photos");
+
+        // The crop and alignment are in pixels of the full photos, and come out scaled to the preview.
+    PWCropRect cropRect = { 128, 64, 512, 512 };
+    PWAlignment alignment = { 0, 0, 0 };
+    PWImageBuffer *leftPreview = NULL, *rightPreview = NULL;
+    double scale = 0;
+    CHECK(writeFile(leftPath, &leftWithThumbnail) && writeFile(rightPath, &rightWithThumbnail)
+          && PWStereoPairCreatePreviewPhotos(leftPath, rightPath, cropRect, alignment, &leftPreview, &rightPreview, &scale)
+             == PWError_None, "couldn't make previews from the thumbnails");
+    CHECK(scale == (double)PWExifThumbnailMaximumSize / 1024 && leftPreview && rightPreview
+          && leftPreview->width == 128 && leftPreview->height == 128 && rightPreview->width == 128,
+          "previews should be the crop of the thumbnails, at scale %g", scale);
+    PWImageBufferRelease(leftPreview);
+    PWImageBufferRelease(rightPreview);
+
+        // Only one photo has a thumbnail, so both must be decoded at 1/8 size to match.
+    CHECK(writeFile(rightPath, &right)
+          && PWStereoPairCreatePreviewPhotos(leftPath, rightPath, cropRect, alignment, &leftPreview, &rightPreview, &scale)
+             == PWError_None, "couldn't make previews by reduced decoding");
+    CHECK(scale == 1.0 / 8 && leftPreview && rightPreview && leftPreview->width == 64 && leftPreview->height == 64
+          && rightPreview->width == 64 && rightPreview->height == 64 && leftPreview->format == rightPreview->format,
+          "previews should be the crop of the reduced photos, at scale %g", scale);
+    PWImageBufferRelease(leftPreview);
+    PWImageBufferRelease(rightPreview);
+
+    unlink(rightPath);
+    CHECK(PWStereoPairCreatePreviewPhotos(leftPath, rightPath, cropRect, alignment, &leftPreview, &rightPreview, NULL)
+          == PWError_IO && !leftPreview && !rightPreview, "a missing photo should fail");
+    unlink(leftPath);
+    rmdir(directory);
+    PWDataBufferFree(&left);
+    PWDataBufferFree(&right);
+    PWDataBufferFree(&leftWithThumbnail);
+    PWDataBufferFree(&rightWithThumbnail);
+    PWImageBufferRelease(leftPhoto);
+    PWImageBufferRelease(rightPhoto);
+}
+
+// MARK: - Import
+
+    /// Decode the halves LEFTJPEG and RIGHTJPEG and check they are the same pixels as the halves of WHOLE, swapped if CROSSEYED.
+static bool halvesMatch(PWImageBuffer *whole, const PWDataBuffer *leftJPEG, const PWDataBuffer *rightJPEG, bool crossEyed) {
+    PWImageBuffer *left = NULL, *right = NULL;
+    size_t half = whole->width / 2;
+    PWImageBuffer *first  = PWImageBufferCreateSubImage(whole, (PWImageRect) { 0, 0, half, whole->height });
+    PWImageBuffer *second = PWImageBufferCreateSubImage(whole, (PWImageRect) { half, 0, half, whole->height });
+    bool match = PWJPEGDecode(leftJPEG->bytes, leftJPEG->length, &left) == PWError_None
+              && PWJPEGDecode(rightJPEG->bytes, rightJPEG->length, &right) == PWError_None
+              && buffersEqual(left, crossEyed ? second : first) && buffersEqual(right, crossEyed ? first : second);
+    PWImageBufferRelease(first);
+    PWImageBufferRelease(second);
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+    return match;
+}
+
+static void testImportSplitsSideBySideLosslessly(void) {
+    PWPixelFormat formats[] = { PWPixelFormat_Gray8, PWPixelFormat_RGB888 };
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+            // The encoder puts restart markers between strips, which the coefficient reader has to step over.
+        PWImageBuffer *scene = makeScene(1024, 384, formats[i], 51), *whole = NULL;
+        PWDataBuffer file, left, right;
+        PWDataBufferInit(&file, 0);
+        PWDataBufferInit(&left, 0);
+        PWDataBufferInit(&right, 0);
+        CHECK(PWJPEGEncode(scene, NULL, &file) == PWError_None && PWJPEGDecode(file.bytes, file.length, &whole) == PWError_None,
+              "couldn't encode a side-by-side image of format %d", formats[i]);
+        for (int crossEyed = 0; crossEyed < 2 && whole; crossEyed++) {
+            bool lossless = false;
+            left.length = right.length = 0;
+            CHECK(PWImportSplitSideBySide(file.bytes, file.length, crossEyed, &left, &right, &lossless) == PWError_None
+                  && lossless, "couldn't split format %d losslessly", formats[i]);
+            CHECK(halvesMatch(whole, &left, &right, crossEyed),
+                  "split photos of format %d should hold exactly the decoded halves (cross-eyed %d)", formats[i], crossEyed);
+        }
+        PWImageBufferRelease(whole);
+        PWDataBufferFree(&file);
+        PWDataBufferFree(&left);
+        PWDataBufferFree(&right);
+        PWImageBufferRelease(scene);
+    }
+
+        // Halves 500 pixels wide don't end on an MCU boundary, so the image is decoded and encoded again.
+    PWImageBuffer *scene = makeScene(1000, 300, PWPixelFormat_RGB888, 52), *left = NULL;
+    PWDataBuffer file, leftJPEG, rightJPEG;
+    PWDataBufferInit(&file, 0);
+    PWDataBufferInit(&leftJPEG, 0);
+    PWDataBufferInit(&rightJPEG, 0);
+    bool lossless = true;
+    CHECK(PWJPEGEncode(scene, NULL, &file) == PWError_None
+          && PWImportSplitSideBySide(file.bytes, file.length, false, &leftJPEG, &rightJPEG, &lossless) == PWError_None
+          && !lossless, "an unaligned image should be split by re-encoding");
+    CHECK(PWJPEGDecode(leftJPEG.bytes, leftJPEG.length, &left) == PWError_None && left->width == 500 && left->height == 300,
+          "the re-encoded left photo should be half the image");
+    PWImageBufferRelease(left);
+    PWDataBufferFree(&file);
+    PWDataBufferFree(&leftJPEG);
+    PWDataBufferFree(&rightJPEG);
+    PWImageBufferRelease(scene);
+}
+
+static void testImportCreatesStereograms(void) {
+    char directory[] = "/tmp/stereogram-core-tests-XXXXXX";
+    CHECK(mkdtemp(directory), "couldn't create a temporary directory");
+    char sourcePath[sizeof(directory) + 32], missingPath[sizeof(directory) + 32];
+    snprintf(sourcePath, sizeof(sourcePath), "%s/SideBySide.jpg", directory);
+    snprintf(missingPath, sizeof(missingPath), "%s/Missing.jpg", directory);
+    PWImageBuffer *scene = makeScene(640, 240, PWPixelFormat_RGB888, 53);
+    PWDataBuffer file;
+    PWDataBufferInit(&file, 0);
+    CHECK(PWJPEGEncode(scene, NULL, &file) == PWError_None && writeFile(sourcePath, &file), "couldn't write a side-by-side image");
+
+    const char *names[] = { "First", "Second", "Third" }, *paths[] = { sourcePath, missingPath, sourcePath };
+    PWImportOptions options = { true, 2 };
+    PWImportResult results[3];
+    CHECK(PWImportSideBySideFiles(directory, names, paths, 3, &options, results) == 2, "two of the three files should be imported");
+    CHECK(results[0].error == PWError_None && results[0].lossless && results[0].bytesRead == file.length
+          && results[0].bytesWritten > 0 && results[1].error == PWError_IO && results[2].error == PWError_None,
+          "the results should describe each file");
+    unlink(sourcePath);
+
+    size_t count = 0;
+    PWLibraryProperties properties;
+    char path[sizeof(directory) + 16];
+    snprintf(path, sizeof(path), "%s/First", directory);
+    CHECK(PWLibraryEnumerate(directory, NULL, NULL, &count) == PWError_None && count == 2, "the imports should be complete stereograms");
+    CHECK(PWLibraryReadProperties(path, &properties) == PWError_None && properties.viewingMethod == 2,
+          "the imports should store the viewing method");
+    CHECK(PWLibraryDeleteAll(directory, &count) == PWError_None && count == 2, "couldn't delete the imports");
+    CHECK(rmdir(directory) == 0, "deleting the imports left files behind");
+    PWDataBufferFree(&file);
+    PWImageBufferRelease(scene);
+}
+
+// MARK: - Storage
+
+static bool countItem(const char *name, PWStorageItemKind kind, void *context) {
+    (void)name;
+    size_t *counts = context;
+    counts[kind]++;
+    return true;
+}
+
+static void testMemoryStorageBehavesLikeFiles(void) {
+    PWStorage *storage = PWMemoryStorageCreate();
+    CHECK(storage && PWMemoryStorageIsMemoryStorage(storage) && !PWMemoryStorageIsMemoryStorage(PWStoragePOSIX()),
+          "couldn't create a memory storage");
+    CHECK(PWStorageWriteFile(storage, "/Photos/File", "x", 1, false) == PWError_IO, "a file needs its directory");
+    CHECK(PWStorageMakeDirectory(storage, "/Photos", true) == PWError_None
+          && PWStorageMakeDirectory(storage, "/Photos/", false) == PWError_None
+          && PWStorageMakeDirectory(storage, "/Photos", true) == PWError_IO, "only new directories should be made");
+    CHECK(PWStorageWriteFile(storage, "/Photos/File", "abcdef", 6, true) == PWError_None
+          && PWStorageWriteFile(storage, "/Photos/Other", "", 0, false) == PWError_None
+          && PWStorageMakeDirectory(storage, "/Photos/Frames", true) == PWError_None, "couldn't fill the directory");
+
+    PWDataBuffer contents;
+    PWDataBufferInit(&contents, 0);
+    CHECK(PWStorageReadFile(storage, "/Photos/File", 2, 3, &contents) == PWError_None
+          && contents.length == 3 && memcmp(contents.bytes, "cde", 3) == 0, "a read should start at its offset");
+    CHECK(PWStorageReadFile(storage, "/Photos//File", 4, PWStorageWholeFile, &contents) == PWError_None
+          && contents.length == 5 && memcmp(contents.bytes, "cdeef", 5) == 0, "reads should append, up to the end of the file");
+    CHECK(PWStorageReadFile(storage, "/Photos/Frames", 0, PWStorageWholeFile, &contents) == PWError_IO
+          && PWStorageReadFile(storage, "/Missing", 0, PWStorageWholeFile, &contents) == PWError_IO,
+          "only files should be read");
+    PWDataBufferFree(&contents);
+
+    PWStorageItemInfo info;
+    CHECK(PWStorageGetInfo(storage, "/Photos/File", &info) == PWError_None && info.kind == PWStorageItem_File && info.length == 6,
+          "the file should be listed with its length");
+    CHECK(PWStorageGetInfo(storage, "/Photos/Missing", &info) == PWError_None && info.kind == PWStorageItem_None,
+          "nothing should be found at a missing path");
+    size_t counts[3] = { 0, 0, 0 };
+    CHECK(PWStorageListDirectory(storage, "/Photos", countItem, counts) == PWError_None
+          && counts[PWStorageItem_File] == 2 && counts[PWStorageItem_Directory] == 1, "the directory should list what is in it");
+    CHECK(PWStorageRemoveDirectory(storage, "/Photos") == PWError_IO, "a directory with files in it shouldn't be removed");
+    CHECK(PWStorageMoveItem(storage, "/Photos", "/Photos/Frames/Photos") == PWError_IO
+          && PWStorageMoveItem(storage, "/Photos/File", "/Photos/Other") == PWError_IO,
+          "nothing should be moved into itself or over another file");
+    CHECK(PWStorageMoveItem(storage, "/Photos", "/Moved") == PWError_None
+          && PWStorageFileExists(storage, "/Moved/File") && !PWStorageFileExists(storage, "/Photos/File"),
+          "a directory should move with its files");
+
+    PWMemoryStorageStatistics statistics;
+    PWMemoryStorageGetStatistics(storage, &statistics);
+    CHECK(statistics.files == 2 && statistics.directories == 2 && statistics.bytesStored == 6 && statistics.bytesWritten == 6
+          && statistics.bytesRead == 5 && statistics.operations[2] == 3, "the statistics should count what was done");
+    CHECK(PWStorageRemoveTree(storage, "/Moved") == PWError_None && PWStorageRemoveTree(storage, "/Moved") == PWError_None,
+          "couldn't remove the tree");
+    PWMemoryStorageGetStatistics(storage, &statistics);
+    CHECK(statistics.files == 0 && statistics.directories == 0 && statistics.bytesStored == 0, "the storage should be empty");
+    PWStorageRelease(storage);
+}
+
+static void testLibraryRunsInMemory(void) {
+    PWStorage *storage = PWMemoryStorageCreate();
+    PWStorageSetDefault(storage);
+    PWImageBuffer *photo = makeNoise(48, 32, PWPixelFormat_RGB888, 7);
+    PWDataBuffer jpeg;
+    PWDataBufferInit(&jpeg, 0);
+    CHECK(photo && PWJPEGEncode(photo, NULL, &jpeg) == PWError_None, "couldn't encode a photo");
+    CHECK(PWStorageMakeDirectory(PWStorageDefault(), "/Photos", true) == PWError_None, "couldn't make the photo folder");
+    char name[16];
+    for (int i = 0; i < 20; i++) {
+        snprintf(name, sizeof(name), "%02d", i);
+        CHECK(PWLibraryCreateStereogram("/Photos", name, &jpeg, &jpeg, i % 3) == PWError_None, "couldn't create stereogram %d", i);
+    }
+    CHECK(PWLibraryCreateStereogram("/Photos", "07", &jpeg, &jpeg, 0) == PWError_IO, "an existing stereogram shouldn't be replaced");
+    size_t count = 0, index = 0;
+    PWLibraryProperties properties;
+    CHECK(PWLibraryEnumerate("/Photos", NULL, NULL, &count) == PWError_None && count == 20, "the stereograms should be enumerated");
+    CHECK(PWLibraryReadProperties("/Photos/07", &properties) == PWError_None && properties.viewingMethod == 1,
+          "the properties should be read back");
+    CHECK(PWLibraryAddSequenceFrame("/Photos/07", &jpeg, &jpeg, &index) == PWError_None && index == 1
+          && PWLibrarySequenceFrameCount("/Photos/07") == 2, "couldn't add a frame");
+    CHECK(!PWStorageFileExists(PWStoragePOSIX(), "/Photos/07/LeftPhoto.jpg"), "nothing should be written to disk");
+    CHECK(PWLibraryDeleteAll("/Photos", &count) == PWError_None && count == 20, "couldn't delete the stereograms");
+
+    PWMemoryStorageStatistics statistics;
+    PWMemoryStorageGetStatistics(storage, &statistics);
+    CHECK(statistics.files == 0 && statistics.directories == 1 && statistics.faults == 0, "deleting should leave only the folder");
+    PWStorageSetDefault(NULL);
+    CHECK(PWStorageDefault() == PWStoragePOSIX(), "the default should go back to the file system");
+    PWStorageRelease(storage);
+    PWDataBufferFree(&jpeg);
+    PWImageBufferRelease(photo);
+}
+
+static void testInterruptedSavesLeaveLibraryReadable(void) {
+    PWStorage *storage = PWMemoryStorageCreate();
+    PWStorageSetDefault(storage);
+    PWDataBuffer jpeg = { (uint8_t *)"not really a JPEG", 17, 17 };
+    CHECK(PWStorageMakeDirectory(storage, "/Photos", true) == PWError_None, "couldn't make the photo folder");
+    CHECK(PWLibraryCreateStereogram("/Photos", "Kept", &jpeg, &jpeg, 0) == PWError_None, "couldn't create a stereogram");
+
+        // Stop every change after the first N, as if the app were killed there, for each N until the save completes.
+    PWError created = PWError_IO;
+    size_t count = 0;
+    for (uint64_t after = 0; created != PWError_None && after < 20; after++) {
+        PWMemoryStorageFault fault = { PWStorageOperation_Changes, after, PWError_IO, true, true };
+        PWMemoryStorageSetFault(storage, &fault);
+        created = PWLibraryCreateStereogram("/Photos", "New", &jpeg, &jpeg, 0);
+        PWMemoryStorageSetFault(storage, NULL);
+        CHECK(PWLibraryEnumerate("/Photos", NULL, NULL, &count) == PWError_None && count == (created == PWError_None ? 2 : 1),
+              "stopping after %llu changes should leave a readable library", (unsigned long long)after);
+    }
+    CHECK(created == PWError_None, "the stereogram should be saved once there are no faults");
+
+        // A frame whose right photo is cut short isn't counted, and the next one replaces it.
+    PWMemoryStorageFault tornWrite = { PWStorageOperation_WriteFile, 1, PWError_IO, true, true };
+    size_t index = 0;
+    PWMemoryStorageSetFault(storage, &tornWrite);
+    CHECK(PWLibraryAddSequenceFrame("/Photos/Kept", &jpeg, &jpeg, &index) == PWError_IO, "the write should fail");
+    PWMemoryStorageSetFault(storage, NULL);
+    CHECK(PWLibrarySequenceFrameCount("/Photos/Kept") == 1, "a torn frame shouldn't be counted");
+    CHECK(PWLibraryAddSequenceFrame("/Photos/Kept", &jpeg, &jpeg, &index) == PWError_None && index == 1,
+          "the next frame should replace the torn one");
+
+        // A fault which isn't persistent fails one operation only.
+    PWMemoryStorageFault once = { PWStorageOperation_ReadFile, 0, PWError_IO, false, false };
+    PWLibraryProperties properties;
+    PWMemoryStorageSetFault(storage, &once);
+    CHECK(PWLibraryReadProperties("/Photos/Kept", &properties) == PWError_IO
+          && PWLibraryReadProperties("/Photos/Kept", &properties) == PWError_None, "only the first read should fail");
+    PWMemoryStorageStatistics statistics;
+    PWMemoryStorageGetStatistics(storage, &statistics);
+    CHECK(statistics.faults > 2, "the faults should be counted");
+    PWStorageSetDefault(NULL);
+    PWStorageRelease(storage);
+}
+
+// MARK: - Tile pyramids
+
+    /// True if A and B are the same size and each of their R, G and B bytes differ by no more than TOLERANCE, whatever their formats.
+static bool colorsNear(const PWImageBuffer *a, const PWImageBuffer *b, int tolerance) {
+    if (!a || !b || a->width != b->width || a->height != b->height) {
+        return false;
+    }
+    uint8_t *rowA = malloc(a->width * 4), *rowB = malloc(b->width * 4);
+    bool near = rowA && rowB;
+    for (size_t y = 0; near && y < a->height; y++) {
+        PWImageBufferConvertRowToRGBX(a, y, 0, a->width, rowA);
+        PWImageBufferConvertRowToRGBX(b, y, 0, b->width, rowB);
+        for (size_t i = 0; near && i < a->width * 4; i++) {
+            near = i % 4 == 3 || abs(rowA[i] - rowB[i]) <= tolerance;
+        }
+    }
+    free(rowA);
+    free(rowB);
+    return near;
+}
+
+static void testTilePyramidWritesEveryLevel(void) {
+    PWStorage *storage = PWMemoryStorageCreate();
+    PWStorageSetDefault(storage);
+        // 600 x 300 halves to 300 x 150, then 150 x 75, which fits in one tile. The scene is grey, so the comparison
+        // below only has to allow for the JPEG coding of the detail and not for the tiles' halved colour resolution.
+    PWImageBuffer *image = makeScene(600, 300, PWPixelFormat_Gray8, 47);
+    PWTilePyramidInfo written, read;
+    CHECK(image && PWTilePyramidWrite(image, "/Tiles", 256, NULL, NULL, NULL, &written) == PWError_None,
+          "couldn't write the pyramid");
+    CHECK(PWTilePyramidReadInfo("/Tiles", &read) == PWError_None && read.width == 600 && read.height == 300
+          && read.tileSize == 256 && read.levelCount == 3 && written.levelCount == 3, "the manifest should describe 3 levels");
+
+    const size_t expectedWidths[] = { 600, 300, 150 }, expectedHeights[] = { 300, 150, 75 };
+    const size_t expectedColumns[] = { 3, 2, 1 }, expectedRows[] = { 2, 1, 1 };
+    PWImageBuffer *level = PWImageBufferRetain(image);
+    PWDataBuffer contents;
+    PWDataBufferInit(&contents, 0);
+    char path[256];
+    for (unsigned levelIndex = 0; levelIndex < 3 && level; levelIndex++) {
+        size_t width, height, columns, rows;
+        PWTilePyramidLevelSize(&read, levelIndex, &width, &height);
+        PWTilePyramidTileGrid(&read, levelIndex, &columns, &rows);
+        CHECK(width == expectedWidths[levelIndex] && height == expectedHeights[levelIndex]
+              && columns == expectedColumns[levelIndex] && rows == expectedRows[levelIndex],
+              "level %u should be %zu x %zu in %zu x %zu tiles, not %zu x %zu in %zu x %zu", levelIndex,
+              expectedWidths[levelIndex], expectedHeights[levelIndex], expectedColumns[levelIndex], expectedRows[levelIndex],
+              width, height, columns, rows);
+        for (size_t row = 0; row < rows; row++) {
+            for (size_t column = 0; column < columns; column++) {
+                    // Edge tiles are cut down to the level; the rest are whole tiles from the same place in the halved image.
+                size_t x = column * 256, y = row * 256;
+                PWImageRect rect = { x, y, width - x < 256 ? width - x : 256, height - y < 256 ? height - y : 256 };
+                PWImageBuffer *expected = PWImageBufferCreateSubImage(level, rect), *tile = NULL;
+                contents.length = 0;
+                CHECK(PWTilePyramidTilePath(path, sizeof(path), "/Tiles", levelIndex, column, row)
+                      && PWStorageReadFile(storage, path, 0, PWStorageWholeFile, &contents) == PWError_None
+                      && PWJPEGDecode(contents.bytes, contents.length, &tile) == PWError_None,
+                      "couldn't read tile %u-%zu-%zu", levelIndex, column, row);
+                CHECK(colorsNear(expected, tile, 16), "tile %u-%zu-%zu doesn't match its part of the level", levelIndex, column, row);
+                PWImageBufferRelease(expected);
+                PWImageBufferRelease(tile);
+            }
+        }
+        PWImageBuffer *smaller = PWImageBufferCreateHalfSize(level);
+        PWImageBufferRelease(level);
+        level = smaller;
+    }
+    CHECK(PWTilePyramidTilePath(path, sizeof(path), "/Tiles", 3, 0, 0) && !PWStorageFileExists(storage, path),
+          "there should be no level past the one which fits in a tile");
+    PWImageBufferRelease(level);
+    PWDataBufferFree(&contents);
+    PWImageBufferRelease(image);
+    PWStorageSetDefault(NULL);
+    PWStorageRelease(storage);
+}
+
+    /// PWTilePyramidShouldContinue allowing the number of tiles in CONTEXT, then stopping.
+static bool allowTiles(void *context) {
+    size_t *tilesLeft = context;
+    if (*tilesLeft == 0) {
+        return false;
+    }
+    (*tilesLeft)--;
+    return true;
+}
+
+static void testTilePyramidStopsWhenCancelled(void) {
+    PWStorage *storage = PWMemoryStorageCreate();
+    PWStorageSetDefault(storage);
+    PWImageBuffer *image = makeScene(600, 300, PWPixelFormat_RGB888, 47);
+        // The whole pyramid is 6 + 2 + 1 tiles, so stopping after 7 leaves the last level and the manifest unwritten.
+    size_t tilesLeft = 7;
+    PWTilePyramidInfo info;
+    CHECK(image && PWTilePyramidWrite(image, "/Tiles", 256, NULL, allowTiles, &tilesLeft, NULL) == PWError_Cancelled,
+          "the build should report that it was cancelled");
+    char path[256];
+    CHECK(PWTilePyramidTilePath(path, sizeof(path), "/Tiles", 1, 0, 0) && PWStorageFileExists(storage, path)
+          && PWTilePyramidTilePath(path, sizeof(path), "/Tiles", 1, 1, 0) && !PWStorageFileExists(storage, path),
+          "no tile should be written once the build is cancelled");
+    CHECK(PWTilePyramidReadInfo("/Tiles", &info) == PWError_IO, "a cancelled pyramid shouldn't have a manifest");
+
+        // A build which is allowed every tile is stopped before it writes the manifest.
+    tilesLeft = 9;
+    CHECK(PWTilePyramidWrite(image, "/Tiles", 256, NULL, allowTiles, &tilesLeft, NULL) == PWError_Cancelled
+          && PWTilePyramidReadInfo("/Tiles", &info) == PWError_IO, "the manifest shouldn't be written after a cancel");
+    tilesLeft = 10;
+    CHECK(PWTilePyramidWrite(image, "/Tiles", 256, NULL, allowTiles, &tilesLeft, NULL) == PWError_None
+          && PWTilePyramidReadInfo("/Tiles", &info) == PWError_None && info.levelCount == 3, "an uncancelled build should finish");
+    PWImageBufferRelease(image);
+    PWStorageSetDefault(NULL);
+    PWStorageRelease(storage);
+}
+
+// MARK: - Journal and sync
+
+static void testSHA256MatchesKnownDigests(void) {
+    const char *inputs[] = { "", "abc", "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq" };
+    const char *expected[] = {
+        "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+        "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+        "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"
+    };
+    PWSHA256Digest digest, parsed;
+    char hex[PWSHA256HexLength + 1];
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+        PWSHA256Compute(inputs[i], strlen(inputs[i]), &digest);
+        PWSHA256Format(&digest, hex);
+        CHECK(strcmp(hex, expected[i]) == 0, "wrong digest of \"%s\": %s", inputs[i], hex);
+        CHECK(PWSHA256Parse(hex, &parsed) && memcmp(&parsed, &digest, sizeof(digest)) == 0, "the digest should be read back");
+    }
+    CHECK(!PWSHA256Parse("not a digest", &parsed), "only hex digits should be read");
+
+    uint8_t data[1000];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i * 7);
+    }
+    PWSHA256Digest whole;
+    PWSHA256Compute(data, sizeof(data), &whole);
+    PWSHA256Context context;
+    PWSHA256Init(&context);
+    for (size_t offset = 0, piece = 1; offset < sizeof(data); offset += piece, piece = piece * 3 % 97 + 1) {
+        PWSHA256Update(&context, data + offset, piece < sizeof(data) - offset ? piece : sizeof(data) - offset);
+    }
+    PWSHA256Final(&context, &digest);
+    CHECK(memcmp(&digest, &whole, sizeof(digest)) == 0, "hashing in pieces should give the same digest");
+}
+
+typedef struct JournalSummary {
+    size_t begins, puts, deletes;
+    uint64_t lastSequence;
+    bool ordered, sawTornPath;
+} JournalSummary;
+
+static bool summariseJournalEntry(const PWJournalEntry *entry, void *context) {
+    JournalSummary *summary = context;
+    summary->begins += entry->kind == PWJournalEntry_Begin;
+    summary->puts += entry->kind == PWJournalEntry_Put;
+    summary->deletes += entry->kind == PWJournalEntry_Delete;
+    summary->ordered = summary->ordered && (entry->kind == PWJournalEntry_Begin ? entry->sequence == 0
+                                                                                 : entry->sequence == summary->lastSequence + 1);
+    summary->sawTornPath = summary->sawTornPath || strcmp(entry->path, "C/x") == 0;
+    summary->lastSequence = entry->sequence;
+    return true;
+}
+
+static JournalSummary summariseJournal(const char *rootPath) {
+    JournalSummary summary = { 0, 0, 0, 0, true, false };
+    CHECK(PWJournalRead(rootPath, summariseJournalEntry, &summary) == PWError_None, "couldn't read the journal");
+    return summary;
+}
+
+static void testJournalRecordsChanges(void) {
+    PWStorage *storage = PWMemoryStorageCreate();
+    PWStorageSetDefault(storage);
+    PWDataBuffer jpeg = { (uint8_t *)"not really a JPEG", 17, 17 };
+    CHECK(PWStorageMakeDirectory(storage, "/Photos", true) == PWError_None
+          && PWLibraryCreateStereogram("/Photos", "A", &jpeg, &jpeg, 0) == PWError_None
+          && PWLibraryCreateStereogram("/Photos", "B", &jpeg, &jpeg, 0) == PWError_None, "couldn't make a library");
+    CHECK(!PWJournalExists("/Photos") && PWJournalRead("/Photos", summariseJournalEntry, NULL) == PWError_NotSupported,
+          "there should be no journal until one is made");
+
+    CHECK(PWJournalCreate("/Photos") == PWError_None && PWJournalExists("/Photos"), "couldn't make the journal");
+    JournalSummary summary = summariseJournal("/Photos");
+    CHECK(summary.begins == 1 && summary.puts == 6 && summary.deletes == 0 && summary.ordered && summary.lastSequence == 6,
+          "the journal should start with the files already there");
+
+    size_t index = 0, count = 0;
+    CHECK(PWLibraryAddSequenceFrame("/Photos/A", &jpeg, &jpeg, &index) == PWError_None
+          && PWLibraryDeleteStereogram("/Photos/B") == PWError_None
+          && PWLibraryCreateStereogram("/Photos", "C", &jpeg, &jpeg, 0) == PWError_None, "couldn't change the library");
+    summary = summariseJournal("/Photos");
+    CHECK(summary.puts == 11 && summary.deletes == 1 && summary.ordered && summary.lastSequence == 12,
+          "each change should be numbered in turn");
+    CHECK(PWLibraryEnumerate("/Photos", NULL, NULL, &count) == PWError_None && count == 2, "the journal isn't a stereogram");
+
+        // A line cut short by a crash is ignored, and doesn't spoil the next one.
+    CHECK(PWStorageAppendFile(storage, "/Photos/.Journal", "13 put 5 C/x", 12) == PWError_None, "couldn't tear the journal");
+    CHECK(PWLibraryDeleteStereogram("/Photos/C") == PWError_None, "couldn't delete a stereogram");
+    summary = summariseJournal("/Photos");
+    CHECK(summary.puts == 11 && summary.deletes == 2 && summary.ordered && summary.lastSequence == 13 && !summary.sawTornPath,
+          "a torn line should be skipped");
+    PWStorageSetDefault(NULL);
+    PWStorageRelease(storage);
+}
+
+    /// The last put in a journal.
+typedef struct LastPut {
+    char path[256];
+    PWSHA256Digest digest;
+} LastPut;
+
+static bool findLastPut(const PWJournalEntry *entry, void *context) {
+    LastPut *lastPut = context;
+    if (entry->kind == PWJournalEntry_Put) {
+        snprintf(lastPut->path, sizeof(lastPut->path), "%s", entry->path);
+        lastPut->digest = entry->digest;
+    }
+    return true;
+}
+
+    /// True if the last put in the journal of /Photos describes what the file it names holds now.
+static bool lastPutMatchesFile(void) {
+    LastPut lastPut = { "", { { 0 } } };
+    char path[300];
+    PWDataBuffer contents;
+    PWSHA256Digest digest;
+    if (PWJournalRead("/Photos", findLastPut, &lastPut) != PWError_None || !PWDataBufferInit(&contents, 0)) {
+        return false;
+    }
+    snprintf(path, sizeof(path), "/Photos/%s", lastPut.path);
+    bool matches = PWStorageReadFile(PWStorageDefault(), path, 0, PWStorageWholeFile, &contents) == PWError_None;
+    PWSHA256Compute(contents.bytes, contents.length, &digest);
+    PWDataBufferFree(&contents);
+    return matches && memcmp(&digest, &lastPut.digest, sizeof(digest)) == 0;
+}
+
+static void testJournalSkipsFailedWrites(void) {
+    PWStorage *storage = PWMemoryStorageCreate();
+    PWStorageSetDefault(storage);
+    PWDataBuffer jpeg = { (uint8_t *)"not really a JPEG", 17, 17 };
+    CHECK(PWStorageMakeDirectory(storage, "/Photos", true) == PWError_None
+          && PWLibraryCreateStereogram("/Photos", "A", &jpeg, &jpeg, 0) == PWError_None
+          && PWJournalCreate("/Photos") == PWError_None, "couldn't make a library");
+    JournalSummary before = summariseJournal("/Photos");
+
+        // A save which fails leaves no put behind, so a sync never looks for contents which were never stored.
+    PWMemoryStorageFault fault = { PWStorageOperation_WriteFile, 0, PWError_IO, false, false };
+    PWMemoryStorageSetFault(storage, &fault);
+    CHECK(PWJournalWriteFile("/Photos/A", PWLibraryPropertyListFileName, "changed", 7, true) == PWError_IO,
+          "the write should fail");
+    JournalSummary after = summariseJournal("/Photos");
+    CHECK(after.puts == before.puts && after.lastSequence == before.lastSequence, "a failed write shouldn't be journalled");
+    CHECK(PWJournalWriteFile("/Photos/A", PWLibraryPropertyListFileName, "changed", 7, true) == PWError_None
+          && lastPutMatchesFile(), "a write which succeeds should be journalled with what was stored");
+
+        // Only the left photo of a frame whose right photo can't be written is recorded.
+    fault.after = 1;
+    PWMemoryStorageSetFault(storage, &fault);
+    CHECK(PWLibraryAddSequenceFrame("/Photos/A", &jpeg, &jpeg, NULL) == PWError_IO, "the frame should fail");
+    PWMemoryStorageSetFault(storage, NULL);
+    after = summariseJournal("/Photos");
+    CHECK(after.puts == before.puts + 2 && lastPutMatchesFile(), "only the photo which was written should be journalled");
+
+        // A stereogram which can't be moved into place isn't recorded at all.
+    fault = (PWMemoryStorageFault) { PWStorageOperation_MoveItem, 0, PWError_IO, false, false };
+    PWMemoryStorageSetFault(storage, &fault);
+    CHECK(PWLibraryCreateStereogram("/Photos", "B", &jpeg, &jpeg, 0) == PWError_IO, "the stereogram shouldn't be saved");
+    PWMemoryStorageSetFault(storage, NULL);
+    CHECK(summariseJournal("/Photos").puts == after.puts, "a stereogram which wasn't saved shouldn't be journalled");
+    PWStorageSetDefault(NULL);
+    PWStorageRelease(storage);
+}
+
+    /// Make a library of COUNT stereograms named S00, S01... in /Photos in the default storage, with a journal.
+static bool makeJournalledLibrary(size_t count, const PWDataBuffer *jpeg) {
+    bool ok = PWStorageMakeDirectory(PWStorageDefault(), "/Photos", true) == PWError_None;
+    char name[16];
+    for (size_t i = 0; i < count && ok; i++) {
+        snprintf(name, sizeof(name), "S%02zu", i);
+        ok = PWLibraryCreateStereogram("/Photos", name, jpeg, jpeg, 0) == PWError_None;
+    }
+    return ok && PWJournalCreate("/Photos") == PWError_None;
+}
+
+static void testSyncSendsOnlyChanges(void) {
+    PWStorage *storage = PWMemoryStorageCreate(), *target = PWMemoryStorageCreate();
+    PWStorageSetDefault(storage);
+    PWDataBuffer jpeg = { (uint8_t *)"not really a JPEG", 17, 17 };
+    CHECK(makeJournalledLibrary(2, &jpeg), "couldn't make a library");
+    PWSyncStatistics statistics;
+    CHECK(PWSyncLibrary("/Photos", target, "/Backup", NULL, &statistics) == PWError_None
+          && statistics.filesSent == 6 && statistics.filesUnchanged == 0 && statistics.firstSequence == 1 && statistics.lastSequence == 6,
+          "the first sync should send everything");
+    CHECK(PWSyncLibrary("/Photos", target, "/Backup", NULL, &statistics) == PWError_None
+          && statistics.filesSent == 0 && statistics.bytesSent == 0 && statistics.firstSequence > statistics.lastSequence,
+          "a sync with nothing changed should send nothing");
+
+    size_t index = 0, count = 0;
+    CHECK(PWLibraryAddSequenceFrame("/Photos/S00", &jpeg, &jpeg, &index) == PWError_None
+          && PWLibraryDeleteStereogram("/Photos/S01") == PWError_None
+          && PWLibraryCreateStereogram("/Photos", "New", &jpeg, &jpeg, 0) == PWError_None, "couldn't change the library");
+    CHECK(PWSyncLibrary("/Photos", target, "/Backup", NULL, &statistics) == PWError_None
+          && statistics.filesSent == 5 && statistics.itemsDeleted == 1 && statistics.firstSequence == 7,
+          "only the changes should be sent");
+    PWStorageSetDefault(target);
+    CHECK(PWLibraryEnumerate("/Backup", NULL, NULL, &count) == PWError_None && count == 2
+          && PWLibrarySequenceFrameCount("/Backup/S00") == 2, "the target should be a copy of the library");
+    PWStorageSetDefault(storage);
+
+        // A new journal is gone through from the start, but nothing the target already has is sent.
+    CHECK(PWStorageRemoveFile(storage, "/Photos/.Journal") == PWError_None && PWJournalCreate("/Photos") == PWError_None,
+          "couldn't make the journal again");
+    CHECK(PWSyncLibrary("/Photos", target, "/Backup", NULL, &statistics) == PWError_None
+          && statistics.filesSent == 0 && statistics.filesUnchanged == 8, "a new journal shouldn't send files again");
+    PWStorageSetDefault(NULL);
+    PWStorageRelease(target);
+    PWStorageRelease(storage);
+}
+
+static bool countLine(const PWJournalEntry *entry, void *context) {
+    (void)entry;
+    (*(size_t *)context)++;
+    return true;
+}
+
+static void testSyncCompactsManifest(void) {
+    PWStorage *storage = PWMemoryStorageCreate(), *target = PWMemoryStorageCreate();
+    PWStorageSetDefault(storage);
+    PWDataBuffer jpeg = { (uint8_t *)"not really a JPEG", 17, 17 }, manifest;
+    CHECK(makeJournalledLibrary(30, &jpeg), "couldn't make a library");
+    CHECK(PWSyncLibrary("/Photos", target, "/Backup", NULL, NULL) == PWError_None, "couldn't sync");
+    size_t count = 0, lines = 0;
+    CHECK(PWLibraryDeleteAll("/Photos", &count) == PWError_None && count == 30 && PWJournalExists("/Photos"),
+          "couldn't empty the library");
+    CHECK(PWLibraryCreateStereogram("/Photos", "Kept", &jpeg, &jpeg, 0) == PWError_None, "couldn't make a stereogram");
+    PWSyncStatistics statistics;
+    CHECK(PWSyncLibrary("/Photos", target, "/Backup", NULL, &statistics) == PWError_None
+          && statistics.itemsDeleted == 30 && statistics.filesSent == 3, "couldn't sync the deletes");
+    PWDataBufferInit(&manifest, 0);
+    CHECK(PWStorageReadFile(target, "/Backup/.Manifest", 0, PWStorageWholeFile, &manifest) == PWError_None, "couldn't read the manifest");
+    PWJournalParseLines(manifest.bytes, manifest.length, countLine, &lines);
+    CHECK(lines == 4, "the manifest should be rewritten with only the files kept, not %zu lines", lines);
+    PWDataBufferFree(&manifest);
+    CHECK(PWSyncLibrary("/Photos", target, "/Backup", NULL, &statistics) == PWError_None && statistics.filesSent == 0,
+          "the rewritten manifest should still say what the target holds");
+    PWStorageSetDefault(NULL);
+    PWStorageRelease(target);
+    PWStorageRelease(storage);
+}
+
+static void testSyncResumesInterruptedUploads(void) {
+    PWStorage *storage = PWMemoryStorageCreate(), *target = PWMemoryStorageCreate();
+    PWStorageSetDefault(storage);
+    uint8_t photo[10000];
+    for (size_t i = 0; i < sizeof(photo); i++) {
+        photo[i] = (uint8_t)(i * 13 + i / 256);
+    }
+    PWDataBuffer jpeg = { photo, sizeof(photo), sizeof(photo) }, sent;
+    CHECK(makeJournalledLibrary(1, &jpeg), "couldn't make a library");
+
+        // Stop the upload part way through a chunk, as if the connection had gone. The info file is sent first, and its
+        // manifest line is the first append, so the left photo fails after its first 1000-byte write, two appends and half
+        // of the third.
+    PWSyncOptions options = { 1000 };
+    PWMemoryStorageFault fault = { PWStorageOperation_AppendFile, 3, PWError_IO, false, true };
+    PWMemoryStorageSetFault(target, &fault);
+    PWSyncStatistics statistics;
+    CHECK(PWSyncLibrary("/Photos", target, "/Backup", &options, &statistics) == PWError_IO && statistics.filesSent == 1,
+          "the sync should stop at the fault");
+    CHECK(PWSyncLibrary("/Photos", target, "/Backup", &options, &statistics) == PWError_None && statistics.filesSent == 2,
+          "the next sync should finish");
+    CHECK(statistics.bytesResumed == 3500 && statistics.bytesSent == 2 * sizeof(photo) - 3500,
+          "the interrupted upload should carry on where it stopped, not from %llu bytes",
+          (unsigned long long)statistics.bytesResumed);
+    PWDataBufferInit(&sent, 0);
+    CHECK(PWStorageReadFile(target, "/Backup/S00/LeftPhoto.jpg", 0, PWStorageWholeFile, &sent) == PWError_None
+          && sent.length == sizeof(photo) && memcmp(sent.bytes, photo, sizeof(photo)) == 0, "the resumed file should be whole");
+    PWDataBufferFree(&sent);
+    PWStorageSetDefault(NULL);
+    PWStorageRelease(target);
+    PWStorageRelease(storage);
+}
+
+static void testSyncToDirectory(void) {
+    char directory[] = "/tmp/stereogram-core-tests-XXXXXX";
+    CHECK(mkdtemp(directory), "couldn't create a temporary directory");
+    char backupPath[sizeof(directory) + 16];
+    snprintf(backupPath, sizeof(backupPath), "%s/Backup", directory);
+    PWStorage *storage = PWMemoryStorageCreate();
+    PWStorageSetDefault(storage);
+    PWDataBuffer jpeg = { (uint8_t *)"not really a JPEG", 17, 17 };
+    CHECK(makeJournalledLibrary(3, &jpeg), "couldn't make a library");
+    PWSyncStatistics statistics;
+    CHECK(PWSyncLibrary("/Photos", PWStoragePOSIX(), backupPath, NULL, &statistics) == PWError_None && statistics.filesSent == 9,
+          "couldn't sync to a directory");
+    PWStorageSetDefault(NULL);
+    size_t count = 0;
+    CHECK(PWLibraryEnumerate(backupPath, NULL, NULL, &count) == PWError_None && count == 3, "the directory should hold the library");
+    CHECK(PWStorageRemoveTree(PWStoragePOSIX(), directory) == PWError_None, "couldn't remove the directory");
+    PWStorageRelease(storage);
+}
+
+int main(void) {
+    testSubImageSharesPixels();
+    testAlignCropRectToBlocks();
+    testShiftedViewsMoveRightPhoto();
+    testBufferPoolReusesSizeClasses();
+    testBufferPoolSteadyStateAllocatesNothing();
+    testResampleKeepsFlatImagesFlat();
+    testAreaHalvingMatchesHalfSize();
+    testResampleSameSizeIsCopy();
+    testResampleIgnoresThreadCount();
+    testLanczosKeepsPremultipliedColoursValid();
+    testThumbnailDoesNotAlias();
+    testThumbnailBorderAndCorners();
+    testOrientationRoundTrips();
+    testOrientationMovesCorners();
+    testAlignFindsOffsetAndRotation();
+    testAlignOffsetUsesViews();
+    testDisparityFindsShifts();
+    testDisparityViewsLieBetweenPhotos();
+    testStereoPairCropRoundsToEvenPixels();
+    testStereoPairRotationUsesCropCentre();
+    testLibraryReadsProperties();
+    testAnaglyphTakesRedFromLeft();
+    testAnaglyphKeepsGreyGrey();
+    testAnaglyphIgnoresThreadCount();
+    testMPORoundTrips();
+    testJPEGDecodeMatchesLibjpeg();
+    testJPEGStripsDecodeAsOne();
+    testJPEGReducedDecodeMatchesAreaScaling();
+    testJPEGEncodesPlanarAndProgressive();
+    testJPEGMeetsTargetLength();
+    testExportMakesEverySize();
+    testExifThumbnailRoundTrips();
+    testPreviewPhotosPreferThumbnails();
+    testImportSplitsSideBySideLosslessly();
+    testImportCreatesStereograms();
+    testMemoryStorageBehavesLikeFiles();
+    testLibraryRunsInMemory();
+    testInterruptedSavesLeaveLibraryReadable();
+    testTilePyramidWritesEveryLevel();
+    testTilePyramidStopsWhenCancelled();
+    testSHA256MatchesKnownDigests();
+    testJournalRecordsChanges();
+    testJournalSkipsFailedWrites();
+    testSyncSendsOnlyChanges();
+    testSyncCompactsManifest();
+    testSyncResumesInterruptedUploads();
+    testSyncToDirectory();
+    testSequenceLookAheadIsBounded();
+    testSequenceStoredInLibrary();
+    testPerceptualHashFindsReshoots();
+    testPerceptualHashGroupsMatchPairs();
+    if (failures) {
+        fprintf(stderr, "%u check(s) failed.\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All image core tests passed.\n");
+    return EXIT_SUCCESS;
+}
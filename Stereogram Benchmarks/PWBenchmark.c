@@ -0,0 +1,117 @@
+//
+//  PWBenchmark.c
+//  Stereogram Benchmarks
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWBenchmark.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+void PWBenchmarkOptionsInit(PWBenchmarkOptions *options) {
+    options->warmup = 3;
+    options->repetitions = 20;
+    options->filter = NULL;
+    options->output = stdout;
+}
+
+bool PWBenchmarkIsSelected(const PWBenchmarkOptions *options, const char *benchmarkName) {
+    return !options->filter || strstr(benchmarkName, options->filter) != NULL;
+}
+
+uint64_t PWBenchmarkNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static int compareSamples(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+    /// Nearest-rank percentile of a sorted array.
+static uint64_t percentile(const uint64_t *sorted, size_t count, double fraction) {
+    size_t rank = (size_t)ceil(fraction * (double)count);
+    return sorted[rank == 0 ? 0 : rank - 1];
+}
+
+static void reportFailure(const PWBenchmark *benchmark, const PWBenchmarkOptions *options, const char *stage) {
+    fprintf(options->output, "{\"name\":\"%s\",\"error\":\"%s failed\"}\n", benchmark->name, stage);
+    fflush(options->output);
+}
+
+bool PWBenchmarkRun(const PWBenchmark *benchmark, const PWBenchmarkOptions *options) {
+    if (!PWBenchmarkIsSelected(options, benchmark->name)) {
+        return true;
+    }
+    unsigned repetitions = options->repetitions ? options->repetitions : 1;
+    uint64_t *samples = malloc(repetitions * sizeof(uint64_t));
+    if (!samples) {
+        reportFailure(benchmark, options, "allocation");
+        return false;
+    }
+
+    for (unsigned i = 0; i < options->warmup + repetitions; i++) {
+        if (benchmark->setup && !benchmark->setup(benchmark->context)) {
+            reportFailure(benchmark, options, "setup");
+            free(samples);
+            return false;
+        }
+        uint64_t start = PWBenchmarkNow();
+        bool ok = benchmark->run(benchmark->context);
+        uint64_t elapsed = PWBenchmarkNow() - start;
+        if (!ok) {
+            reportFailure(benchmark, options, "run");
+            free(samples);
+            return false;
+        }
+        if (i >= options->warmup) {
+            samples[i - options->warmup] = elapsed;
+        }
+    }
+
+    double sum = 0;
+    for (unsigned i = 0; i < repetitions; i++) {
+        sum += (double)samples[i];
+    }
+    double mean = sum / repetitions, variance = 0;
+    for (unsigned i = 0; i < repetitions; i++) {
+        double difference = (double)samples[i] - mean;
+        variance += difference * difference;
+    }
+    double standardDeviation = repetitions > 1 ? sqrt(variance / (repetitions - 1)) : 0;
+    qsort(samples, repetitions, sizeof(uint64_t), compareSamples);
+    uint64_t median = percentile(samples, repetitions, 0.5);
+
+    fprintf(options->output,
+            "{\"name\":\"%s\",\"warmup\":%u,\"repetitions\":%u,"
+            "\"min_ns\":%llu,\"p50_ns\":%llu,\"p90_ns\":%llu,\"p99_ns\":%llu,\"max_ns\":%llu,"
+            "\"mean_ns\":%.0f,\"stddev_ns\":%.0f",
+            benchmark->name, options->warmup, repetitions,
+            (unsigned long long)samples[0], (unsigned long long)median,
+            (unsigned long long)percentile(samples, repetitions, 0.9),
+            (unsigned long long)percentile(samples, repetitions, 0.99),
+            (unsigned long long)samples[repetitions - 1], mean, standardDeviation);
+    if (benchmark->itemsPerIteration && median > 0) {
+            // Throughput is based on the median so one slow outlier doesn't skew it.
+        fprintf(options->output, ",\"items\":%llu,\"items_per_sec\":%.0f",
+                (unsigned long long)benchmark->itemsPerIteration,
+                (double)benchmark->itemsPerIteration * 1e9 / (double)median);
+    }
+    if (benchmark->residentBytes) {
+        fprintf(options->output, ",\"resident_bytes\":%llu", (unsigned long long)benchmark->residentBytes);
+    }
+    if (benchmark->outputLength) {
+        fprintf(options->output, ",\"output_bytes\":%zu", *benchmark->outputLength);
+    }
+    fprintf(options->output, "}\n");
+    fflush(options->output);
+    free(samples);
+    return true;
+}
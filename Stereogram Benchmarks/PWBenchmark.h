@@ -0,0 +1,83 @@
+/*!
+ @header PWBenchmark
+ @abstract A minimal timing harness producing stable, machine-readable results.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ Each benchmark is run a number of times untimed to warm up caches and the allocator, then timed for a fixed
+ number of repetitions. Results are written as one JSON object per line so two runs can be compared with diff
+ or any JSON tool.
+ */
+
+#ifndef PWBenchmark_h
+#define PWBenchmark_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Settings shared by every benchmark in a run. */
+typedef struct PWBenchmarkOptions {
+        /*! Number of untimed iterations before measuring. */
+    unsigned warmup;
+        /*! Number of timed iterations. */
+    unsigned repetitions;
+        /*! If not NULL, only benchmarks whose name contains this string are run. */
+    const char *filter;
+        /*! Where to write the results. */
+    FILE *output;
+} PWBenchmarkOptions;
+
+/*! Called before each iteration (untimed) to prepare CONTEXT. Return false to abort the benchmark. */
+typedef bool (*PWBenchmarkSetupFunction)(void *context);
+
+/*! The code being measured. Return false if it failed, which aborts the benchmark. */
+typedef bool (*PWBenchmarkFunction)(void *context);
+
+/*! Description of a single benchmark. */
+typedef struct PWBenchmark {
+        /*! Unique name, used for filtering and as the key in the output. */
+    const char *name;
+        /*! Optional per-iteration setup, excluded from the timings. */
+    PWBenchmarkSetupFunction setup;
+        /*! The function to time. */
+    PWBenchmarkFunction run;
+        /*! Passed to SETUP and RUN. */
+    void *context;
+        /*! Number of items (pixels, files etc.) processed per iteration, used to report throughput. 0 to omit. */
+    uint64_t itemsPerIteration;
+        /*! Bytes of memory held by whatever one iteration produces, reported as "resident_bytes". 0 to omit. */
+    uint64_t residentBytes;
+        /*! If not NULL, the length of whatever the last iteration wrote, e.g. an encoded file, reported as "output_bytes". */
+    const size_t *outputLength;
+} PWBenchmark;
+
+/*! Fill OPTIONS with the defaults: 3 warm-up runs, 20 repetitions, no filter and output to stdout. */
+void PWBenchmarkOptionsInit(PWBenchmarkOptions *options);
+
+/*! True if BENCHMARKNAME passes the filter in OPTIONS. Use this to skip expensive fixture setup. */
+bool PWBenchmarkIsSelected(const PWBenchmarkOptions *options, const char *benchmarkName);
+
+/*!
+ * Run BENCHMARK according to OPTIONS and write one line of results.
+ *
+ * The line contains the name, iteration counts and min, median, 90th and 99th percentile, max, mean and
+ * standard deviation of the timed iterations in nanoseconds. Failures are reported with an "error" field.
+ *
+ * @return false if the benchmark failed.
+ */
+bool PWBenchmarkRun(const PWBenchmark *benchmark, const PWBenchmarkOptions *options);
+
+/*! Monotonic clock reading in nanoseconds. */
+uint64_t PWBenchmarkNow(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWBenchmark_h */
@@ -0,0 +1,1059 @@
+//
+//  main.c
+//  Stereogram Benchmarks
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+//  Benchmarks for the portable image core and library code. See README.md for how to build and run them.
+//
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "PWAlign.h"
+#include "PWAnaglyph.h"
+#include "PWBufferPool.h"
+#include "PWDisparity.h"
+#include "PWExifThumbnail.h"
+#include "PWExport.h"
+#include "PWBenchmark.h"
+#include "PWGIFEncoder.h"
+#include "PWImageBuffer.h"
+#include "PWImport.h"
+#include "PWJournal.h"
+#include "PWJPEGDecoder.h"
+#include "PWJPEGEncoder.h"
+#include "PWLibrary.h"
+#include "PWMPO.h"
+#include "PWMemoryStorage.h"
+#include "PWOrientation.h"
+#include "PWParallel.h"
+#include "PWPerceptualHash.h"
+#include "PWResample.h"
+#include "PWSequence.h"
+#include "PWStorage.h"
+#include "PWSync.h"
+#include "PWThumbnail.h"
+#include "PWTilePyramid.h"
+
+    /// Each photo is half of an 8MP camera image, as saved by -[PhotoStore createStereogramFromLeftImage:rightImage:error:].
+enum { PhotoWidth = 1632, PhotoHeight = 1224 };
+
+    /// Rows of a stereogram converted for display in one go, roughly what fills the screen at full resolution.
+enum { DisplayRows = 320 };
+
+    /// Size of the thumbnails shown in the collection view, and the border and corners of framed ones.
+enum { ThumbnailSize = 100, ThumbnailBorder = 2, ThumbnailCornerRadius = 12 };
+
+    /// Width in pixels of the screen the tiled viewer first draws on. The first paint uses the first pyramid level no wider than this.
+enum { ScreenWidth = 1024 };
+
+    /// Number of pairs in the sequence streamed by the sequence benchmark.
+enum { SequenceFrames = 8 };
+
+    /// Largest file the size-limited JPEG export may write, e.g. for a message attachment.
+enum { JPEGTargetLength = 256 * 1024 };
+
+    /// Number of stereograms deleted in one iteration of the batch-delete benchmark.
+enum { DeleteBatchSize = 100 };
+
+    /// Number of stereograms added between the syncs of the incremental sync benchmark.
+enum { SyncBatchSize = 10 };
+
+    /// Views made between the two photos for the animated viewing method, as the app does.
+enum { AnimationInBetweenViews = 2 };
+
+    /// Number of stereograms searched for duplicates, one perceptual hash each.
+enum { DuplicateSearchCount = 10000 };
+
+    /// Number of side-by-side files imported in one iteration of the import benchmark.
+enum { ImportBatchSize = 8 };
+
+// MARK: - Fixtures
+
+    /// Fill BUFFER with a deterministic photo-like image: smooth gradients with some noise, so the encoders have realistic work to do.
+static void fillSyntheticPhoto(PWImageBuffer *buffer, uint32_t seed) {
+    uint32_t random = seed;
+    for (size_t y = 0; y < buffer->height; y++) {
+        uint8_t *pixel = PWImageBufferRow(buffer, y);
+        for (size_t x = 0; x < buffer->width; x++, pixel += 4) {
+            random = random * 1664525u + 1013904223u;
+            int noise = (int)(random >> 28) - 8;
+            int r = (int)(x * 255 / buffer->width) + noise;
+            int g = (int)(y * 255 / buffer->height) + noise;
+            int b = (int)(((x + y) * 255 / (buffer->width + buffer->height)) ^ (seed & 0x3F)) + noise;
+            pixel[0] = (uint8_t)(r < 0 ? 0 : r > 255 ? 255 : r);
+            pixel[1] = (uint8_t)(g < 0 ? 0 : g > 255 ? 255 : g);
+            pixel[2] = (uint8_t)(b < 0 ? 0 : b > 255 ? 255 : b);
+            pixel[3] = 255;
+        }
+    }
+}
+
+typedef struct ImageFixture {
+    PWImageBuffer *left, *right, *stereogram;
+        /// The stereogram as the app caches it when built from the JPEG files.
+    PWImageBuffer *compact;
+        /// An anaglyph decoded from the files, to report how much memory the cached image takes.
+    PWImageBuffer *anaglyph;
+    PWDataBuffer output;
+        /// The photos as saved to disk, for the benchmarks which start from the files.
+    PWDataBuffer leftJPEG, rightJPEG;
+} ImageFixture;
+
+    /// Decode both photo files and composite them, keeping the decoder's own pixel format as the app's cache does.
+static PWImageBuffer *decodeCompactStereogram(const ImageFixture *fixture) {
+    PWImageBuffer *left = NULL, *right = NULL, *stereogram = NULL;
+    if (PWJPEGDecode(fixture->leftJPEG.bytes, fixture->leftJPEG.length, &left) == PWError_None
+        && PWJPEGDecode(fixture->rightJPEG.bytes, fixture->rightJPEG.length, &right) == PWError_None) {
+        stereogram = PWImageBufferCreateSideBySide(left, right);
+    }
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+    return stereogram;
+}
+
+    /// Decode both photo files and mix them into an anaglyph, as the app does for the anaglyph viewing methods.
+static PWImageBuffer *decodeAnaglyph(const ImageFixture *fixture) {
+    PWImageBuffer *left = NULL, *right = NULL, *anaglyph = NULL;
+    if (PWJPEGDecode(fixture->leftJPEG.bytes, fixture->leftJPEG.length, &left) == PWError_None
+        && PWJPEGDecode(fixture->rightJPEG.bytes, fixture->rightJPEG.length, &right) == PWError_None) {
+        anaglyph = PWAnaglyphCreate(left, right, PWAnaglyph_Optimised);
+    }
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+    return anaglyph;
+}
+
+static bool makeImageFixture(ImageFixture *fixture) {
+    memset(fixture, 0, sizeof(ImageFixture));
+    fixture->left  = PWImageBufferCreate(PhotoWidth, PhotoHeight, PWPixelFormat_RGBA8888);
+    fixture->right = PWImageBufferCreate(PhotoWidth, PhotoHeight, PWPixelFormat_RGBA8888);
+    if (!fixture->left || !fixture->right || !PWDataBufferInit(&fixture->output, 4 * 1024 * 1024)) {
+        return false;
+    }
+    fillSyntheticPhoto(fixture->left, 1);
+    fillSyntheticPhoto(fixture->right, 2);
+    fixture->stereogram = PWImageBufferCreateSideBySide(fixture->left, fixture->right);
+    return fixture->stereogram != NULL
+        && PWDataBufferInit(&fixture->leftJPEG, 1024 * 1024) && PWJPEGEncode(fixture->left, NULL, &fixture->leftJPEG) == PWError_None
+        && PWDataBufferInit(&fixture->rightJPEG, 1024 * 1024) && PWJPEGEncode(fixture->right, NULL, &fixture->rightJPEG) == PWError_None
+        && (fixture->compact = decodeCompactStereogram(fixture)) != NULL
+        && (fixture->anaglyph = decodeAnaglyph(fixture)) != NULL
+        && PWDataBufferReserve(&fixture->output, fixture->compact->width * 4 * DisplayRows);
+}
+
+static void freeImageFixture(ImageFixture *fixture) {
+    PWImageBufferRelease(fixture->left);
+    PWImageBufferRelease(fixture->right);
+    PWImageBufferRelease(fixture->stereogram);
+    PWImageBufferRelease(fixture->compact);
+    PWImageBufferRelease(fixture->anaglyph);
+    PWDataBufferFree(&fixture->output);
+    PWDataBufferFree(&fixture->leftJPEG);
+    PWDataBufferFree(&fixture->rightJPEG);
+}
+
+    /// A photo folder in the default storage, populated with synthetic stereograms.
+typedef struct LibraryFixture {
+    char rootPath[PATH_MAX];
+    size_t stereogramCount;
+    const PWDataBuffer *photoData;
+    unsigned nextName;
+} LibraryFixture;
+
+static bool populateLibrary(LibraryFixture *library, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        char name[48];
+        snprintf(name, sizeof(name), "%08X-0000-0000-0000-000000000000", library->nextName++);
+        if (PWLibraryCreateStereogram(library->rootPath, name, library->photoData, library->photoData, (int)(i % 3)) != PWError_None) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool makeLibraryFixture(LibraryFixture *library, const char *parentPath, const char *name,
+                               size_t count, const PWDataBuffer *photoData) {
+    memset(library, 0, sizeof(LibraryFixture));
+    library->stereogramCount = count;
+    library->photoData = photoData;
+    snprintf(library->rootPath, sizeof(library->rootPath), "%s/%s", parentPath, name);
+    if (PWStorageMakeDirectory(PWStorageDefault(), library->rootPath, true) != PWError_None) {
+        return false;
+    }
+    return populateLibrary(library, count);
+}
+
+static void freeLibraryFixture(LibraryFixture *library) {
+    PWLibraryDeleteAll(library->rootPath, NULL);
+    PWStorageRemoveDirectory(PWStorageDefault(), library->rootPath);
+}
+
+    /// A tile pyramid of the compact stereogram, written to disk.
+typedef struct PyramidFixture {
+    const PWImageBuffer *image;
+    char directory[PATH_MAX];
+    PWTilePyramidInfo info;
+        /// The level the viewer shows when the whole stereogram fits on screen.
+    unsigned firstPaintLevel;
+    PWDataBuffer file;
+} PyramidFixture;
+
+static bool makePyramidFixture(PyramidFixture *pyramid, const char *parentPath, const PWImageBuffer *image) {
+    memset(pyramid, 0, sizeof(PyramidFixture));
+    pyramid->image = image;
+    int length = snprintf(pyramid->directory, sizeof(pyramid->directory), "%s/Tiles", parentPath);
+    if (length <= 0 || length >= (int)sizeof(pyramid->directory) || !PWDataBufferInit(&pyramid->file, 64 * 1024)
+        || PWTilePyramidWrite(image, pyramid->directory, PWTilePyramidDefaultTileSize, NULL, NULL, NULL, &pyramid->info) != PWError_None) {
+        return false;
+    }
+    size_t width = image->width, height = image->height;
+    while (width > ScreenWidth && pyramid->firstPaintLevel + 1 < pyramid->info.levelCount) {
+        PWTilePyramidLevelSize(&pyramid->info, ++pyramid->firstPaintLevel, &width, &height);
+    }
+    return true;
+}
+
+static void freePyramidFixture(PyramidFixture *pyramid) {
+    PWLibraryRemoveDirectory(pyramid->directory);
+    PWDataBufferFree(&pyramid->file);
+}
+
+    /// The left photo saved to disk with and without an EXIF thumbnail, for the tile loading benchmarks.
+typedef struct ThumbnailFixture {
+    char plainPath[PATH_MAX], exifPath[PATH_MAX];
+    PWDataBuffer file;
+} ThumbnailFixture;
+
+static bool writeFile(const char *path, const uint8_t *bytes, size_t length) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+    bool written = fwrite(bytes, 1, length, file) == length;
+    return fclose(file) == 0 && written;
+}
+
+static bool makeThumbnailFixture(ThumbnailFixture *thumbnails, const char *parentPath, const ImageFixture *images) {
+    memset(thumbnails, 0, sizeof(ThumbnailFixture));
+    int plainLength = snprintf(thumbnails->plainPath, sizeof(thumbnails->plainPath), "%s/PlainPhoto.jpg", parentPath);
+    int exifLength = snprintf(thumbnails->exifPath, sizeof(thumbnails->exifPath), "%s/ExifPhoto.jpg", parentPath);
+    return plainLength > 0 && plainLength < (int)sizeof(thumbnails->plainPath)
+        && exifLength > 0 && exifLength < (int)sizeof(thumbnails->exifPath)
+        && PWDataBufferInit(&thumbnails->file, images->leftJPEG.length + 64 * 1024)
+        && PWExifThumbnailAdd(images->leftJPEG.bytes, images->leftJPEG.length, images->left, &thumbnails->file) == PWError_None
+        && writeFile(thumbnails->exifPath, thumbnails->file.bytes, thumbnails->file.length)
+        && writeFile(thumbnails->plainPath, images->leftJPEG.bytes, images->leftJPEG.length);
+}
+
+static void freeThumbnailFixture(ThumbnailFixture *thumbnails) {
+    unlink(thumbnails->plainPath);
+    unlink(thumbnails->exifPath);
+    PWDataBufferFree(&thumbnails->file);
+}
+
+static bool readFile(const char *path, PWDataBuffer *contents) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    contents->length = 0;
+    size_t length;
+    while (PWDataBufferReserve(contents, 16 * 1024)
+           && (length = fread(contents->bytes + contents->length, 1, contents->capacity - contents->length, file)) > 0) {
+        contents->length += length;
+    }
+    fclose(file);
+    return contents->length > 0;
+}
+
+// MARK: - Benchmarks
+
+static bool benchmarkComposite(void *context) {
+    ImageFixture *fixture = context;
+    PWImageBuffer *stereogram = PWImageBufferCreateSideBySide(fixture->left, fixture->right);
+    PWImageBufferRelease(stereogram);
+    return stereogram != NULL;
+}
+
+static bool benchmarkDecodeComposite(void *context) {
+    PWImageBuffer *stereogram = decodeCompactStereogram(context);
+    PWImageBufferRelease(stereogram);
+    return stereogram != NULL;
+}
+
+    /// As decode_composite_compact with the buffer pool turned off, so every image is a fresh allocation the kernel has to fault in.
+static bool benchmarkDecodeCompositeUnpooled(void *context) {
+    size_t limit = PWBufferPoolLimit();
+    PWBufferPoolSetLimit(0);
+    bool ok = benchmarkDecodeComposite(context);
+    PWBufferPoolSetLimit(limit);
+    return ok;
+}
+
+    /// What each step of the convergence slider costs at full size: shifting views of the cached photos and putting them side by side.
+static bool benchmarkRecompositeShifted(void *context) {
+    ImageFixture *fixture = context;
+    PWImageRect leftRect = { 0, 0, PhotoWidth, PhotoHeight }, rightRect = { PhotoWidth, 0, PhotoWidth, PhotoHeight };
+    PWImageBuffer *left = PWImageBufferCreateSubImage(fixture->compact, leftRect), *right = PWImageBufferCreateSubImage(fixture->compact, rightRect);
+    PWImageBuffer *leftView = NULL, *rightView = NULL, *stereogram = NULL;
+    if (PWImageBufferCreateShiftedViews(left, right, 48, &leftView, &rightView) == PWError_None) {
+        stereogram = PWImageBufferCreateSideBySide(leftView, rightView);
+    }
+    PWImageBufferRelease(stereogram);
+    PWImageBufferRelease(leftView);
+    PWImageBufferRelease(rightView);
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+    return stereogram != NULL;
+}
+
+    /// Run when a pair is first saved, on the photos at the size the app keeps them.
+static bool benchmarkAlignEstimate(void *context) {
+    ImageFixture *fixture = context;
+    PWAlignment alignment;
+    PWError error = PWAlignEstimate(fixture->left, fixture->right, &alignment);
+    return error == PWError_None || error == PWError_NotSupported;
+}
+
+    /// A pair cut from one synthetic photo a little apart, as if the camera had moved sideways, for the disparity benchmarks.
+typedef struct DisparityFixture {
+    PWImageBuffer *left, *right;
+} DisparityFixture;
+
+static bool makeDisparityFixture(DisparityFixture *fixture, size_t width, size_t height) {
+    size_t shift = width / 40;
+    PWImageBuffer *scene = PWImageBufferCreate(width + shift, height, PWPixelFormat_RGBA8888);
+    if (!scene) {
+        fixture->left = fixture->right = NULL;
+        return false;
+    }
+    fillSyntheticPhoto(scene, 4);
+    PWImageRect leftRect = { shift, 0, width, height }, rightRect = { 0, 0, width, height };
+    fixture->left = PWImageBufferCreateSubImage(scene, leftRect);
+    fixture->right = PWImageBufferCreateSubImage(scene, rightRect);
+    PWImageBufferRelease(scene);
+    return fixture->left && fixture->right;
+}
+
+static bool benchmarkDisparityEstimate(void *context) {
+    DisparityFixture *fixture = context;
+    PWDisparityMap map;
+    PWError error = PWDisparityEstimate(fixture->left, fixture->right, &map);
+    PWDisparityMapFree(&map);
+    return error == PWError_None;
+}
+
+    /// What the animated viewing method adds to building the image: matching the decoded photos and making the views between them.
+static bool benchmarkAnimationInBetween(void *context) {
+    ImageFixture *fixture = context;
+    PWImageRect leftRect = { 0, 0, PhotoWidth, PhotoHeight }, rightRect = { PhotoWidth, 0, PhotoWidth, PhotoHeight };
+    PWImageBuffer *left = PWImageBufferCreateSubImage(fixture->compact, leftRect), *right = PWImageBufferCreateSubImage(fixture->compact, rightRect);
+    PWDisparityMap map;
+    bool ok = left && right && PWDisparityEstimate(left, right, &map) == PWError_None;
+    for (int i = 1; i <= AnimationInBetweenViews && ok; i++) {
+        PWImageBuffer *view = PWDisparityCreateView(left, right, &map, (double)i / (AnimationInBetweenViews + 1));
+        ok = view != NULL;
+        PWImageBufferRelease(view);
+    }
+    if (ok) {
+        PWDisparityMapFree(&map);
+    }
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+    return ok;
+}
+
+    /// The extra work compositing a pair with some rotation to take out, on top of composite_side_by_side_1632x1224.
+static bool benchmarkAlignCorrect(void *context) {
+    ImageFixture *fixture = context;
+    PWAlignment alignment = { 6.0, 0.01, 0.0 };
+    PWImageBuffer *left = NULL, *right = NULL;
+    PWError error = PWAlignCreateCorrectedPair(fixture->left, fixture->right, alignment, &left, &right);
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+    return error == PWError_None;
+}
+
+    /// Converting one screen's worth of rows is the cost a compact image adds each time it is drawn.
+static bool benchmarkDisplayRows(void *context) {
+    ImageFixture *fixture = context;
+    size_t byteCount = fixture->compact->width * 4 * DisplayRows;
+    return PWImageBufferReadRGBX(fixture->compact, 0, byteCount, fixture->output.bytes) == byteCount;
+}
+
+static bool benchmarkAnaglyph(void *context) {
+    ImageFixture *fixture = context;
+    PWImageBuffer *anaglyph = PWAnaglyphCreate(fixture->left, fixture->right, PWAnaglyph_Optimised);
+    PWImageBufferRelease(anaglyph);
+    return anaglyph != NULL;
+}
+
+    /// Compare with decode_composite_compact: the same work up to the point the two photos are combined.
+static bool benchmarkDecodeAnaglyph(void *context) {
+    PWImageBuffer *anaglyph = decodeAnaglyph(context);
+    PWImageBufferRelease(anaglyph);
+    return anaglyph != NULL;
+}
+
+    /// Turning a photo taken in portrait upright: every row of the source becomes a column of the result.
+static bool benchmarkOrientRight(void *context) {
+    ImageFixture *fixture = context;
+    PWImageBuffer *upright = PWImageBufferCreateOriented(fixture->left, PWOrientation_Right);
+    PWImageBufferRelease(upright);
+    return upright != NULL;
+}
+
+    /// Rotating by 180 degrees keeps rows as rows, so this is the best case for comparison.
+static bool benchmarkOrientDown(void *context) {
+    ImageFixture *fixture = context;
+    PWImageBuffer *upright = PWImageBufferCreateOriented(fixture->left, PWOrientation_Down);
+    PWImageBufferRelease(upright);
+    return upright != NULL;
+}
+
+static bool benchmarkOrientCompact(void *context) {
+    ImageFixture *fixture = context;
+    PWImageBuffer *upright = PWImageBufferCreateOriented(fixture->compact, PWOrientation_Right);
+    PWImageBufferRelease(upright);
+    return upright != NULL;
+}
+
+    /// Halving a camera photo, as PhotoStore does to every new stereogram, with each filter in turn.
+static bool resampleHalf(ImageFixture *fixture, PWResampleFilter filter) {
+    PWImageBuffer *half = PWResampleCreate(fixture->left, PhotoWidth / 2, PhotoHeight / 2, filter);
+    PWImageBufferRelease(half);
+    return half != NULL;
+}
+
+static bool benchmarkResampleArea(void *context) {
+    return resampleHalf(context, PWResampleFilter_Area);
+}
+
+static bool benchmarkResampleBilinear(void *context) {
+    return resampleHalf(context, PWResampleFilter_Bilinear);
+}
+
+static bool benchmarkResampleLanczos(void *context) {
+    return resampleHalf(context, PWResampleFilter_Lanczos3);
+}
+
+static bool benchmarkThumbnail(void *context) {
+    ImageFixture *fixture = context;
+    PWImageBuffer *thumbnail = PWThumbnailCreate(fixture->stereogram, ThumbnailSize);
+    PWImageBufferRelease(thumbnail);
+    return thumbnail != NULL;
+}
+
+    /// The fused border and corner mask, against the four redraws of -thumbnailImage:transparentBorder:cornerRadius:...
+static bool benchmarkThumbnailBorderRounded(void *context) {
+    ImageFixture *fixture = context;
+    PWThumbnailOptions options = PWThumbnailOptionsInit();
+    options.borderSize = ThumbnailBorder;
+    options.cornerRadius = ThumbnailCornerRadius;
+    PWImageBuffer *thumbnail = PWThumbnailCreateWithOptions(fixture->stereogram, ThumbnailSize, &options);
+    PWImageBufferRelease(thumbnail);
+    return thumbnail != NULL;
+}
+
+    /// Worked out once for each new stereogram, from the left photo.
+    /// The cost of adding a thumbnail as a photo is saved.
+static bool benchmarkAddExifThumbnail(void *context) {
+    ImageFixture *fixture = context;
+    fixture->output.length = 0;
+    return PWExifThumbnailAdd(fixture->leftJPEG.bytes, fixture->leftJPEG.length, fixture->left, &fixture->output) == PWError_None;
+}
+
+    /// Make a collection view tile from a photo saved without a thumbnail, reading and decoding the whole file.
+static bool benchmarkTileFromPhoto(void *context) {
+    ThumbnailFixture *thumbnails = context;
+    PWImageBuffer *photo = NULL, *tile = NULL;
+    if (readFile(thumbnails->plainPath, &thumbnails->file)
+        && PWJPEGDecode(thumbnails->file.bytes, thumbnails->file.length, &photo) == PWError_None) {
+        tile = PWThumbnailCreate(photo, ThumbnailSize);
+    }
+    PWImageBufferRelease(photo);
+    PWImageBufferRelease(tile);
+    return tile != NULL;
+}
+
+    /// Make the same tile from the EXIF thumbnail, which reads only the start of the file.
+static bool benchmarkTileFromExif(void *context) {
+    ThumbnailFixture *thumbnails = context;
+    PWImageBuffer *thumbnail = NULL, *tile = NULL;
+    if (PWExifThumbnailCreateImage(thumbnails->exifPath, &thumbnail, NULL) == PWError_None) {
+        tile = PWThumbnailCreate(thumbnail, ThumbnailSize);
+    }
+    PWImageBufferRelease(thumbnail);
+    PWImageBufferRelease(tile);
+    return tile != NULL;
+}
+
+    /// The first paint of the full-size view: a small stereogram from the photos' previews. Both sides use the same file.
+static bool previewStereogram(const char *path) {
+    PWImageBuffer *left = NULL, *right = NULL, *stereogram = NULL;
+    PWCropRect noCrop = { 0, 0, 0, 0 };
+    PWAlignment aligned = { 0, 0, 0 };
+    if (PWStereoPairCreatePreviewPhotos(path, path, noCrop, aligned, &left, &right, NULL) == PWError_None) {
+        stereogram = PWImageBufferCreateSideBySide(left, right);
+    }
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+    PWImageBufferRelease(stereogram);
+    return stereogram != NULL;
+}
+
+    /// From the EXIF thumbnails, reading only the start of each file.
+static bool benchmarkPreviewFromExif(void *context) {
+    ThumbnailFixture *thumbnails = context;
+    return previewStereogram(thumbnails->exifPath);
+}
+
+    /// From the DC coefficients of photos saved without thumbnails, reading the whole files but skipping the IDCT.
+static bool benchmarkPreviewReducedDecode(void *context) {
+    ThumbnailFixture *thumbnails = context;
+    return previewStereogram(thumbnails->plainPath);
+}
+
+static bool benchmarkPerceptualHash(void *context) {
+    ImageFixture *fixture = context;
+    uint64_t hash;
+    return PWPerceptualHashCompute(fixture->left, &hash) == PWError_None;
+}
+
+static bool benchmarkJPEGExport(void *context) {
+    ImageFixture *fixture = context;
+    fixture->output.length = 0;
+    return PWJPEGEncode(fixture->stereogram, NULL, &fixture->output) == PWError_None;
+}
+
+    /// The stereogram as cached, in the decoder's YCbCr 4:2:0, is encoded without converting it to RGB first.
+static bool benchmarkJPEGExportCompact(void *context) {
+    ImageFixture *fixture = context;
+    fixture->output.length = 0;
+    return PWJPEGEncode(fixture->compact, NULL, &fixture->output) == PWError_None;
+}
+
+static bool benchmarkJPEGExportProgressive(void *context) {
+    ImageFixture *fixture = context;
+    PWJPEGEncodeOptions options;
+    PWJPEGEncodeOptionsInit(&options);
+    options.progressive = true;
+    fixture->output.length = 0;
+    return PWJPEGEncode(fixture->stereogram, &options, &fixture->output) == PWError_None;
+}
+
+    /// The sizes shared from the app at once: full size for the camera roll, one for email and a preview.
+    /// Compare with export_jpeg_q90_progressive, which makes the first of them alone.
+static bool benchmarkExportShareBundle(void *context) {
+    ImageFixture *fixture = context;
+    const PWExportPreset presets[] = {
+        { 0, PWExportFormat_JPEG, 0 }, { PWExportEmailSize, PWExportFormat_JPEG, 0 }, { PWExportPreviewSize, PWExportFormat_JPEG, 0 }
+    };
+    enum { PresetCount = sizeof(presets) / sizeof(presets[0]) };
+    PWDataBuffer outputs[PresetCount];
+    for (size_t i = 0; i < PresetCount; i++) {
+        PWDataBufferInit(&outputs[i], 0);
+    }
+    bool ok = PWExportCreateFiles(fixture->stereogram, presets, PresetCount, outputs) == PWError_None;
+    fixture->output.length = 0;
+    for (size_t i = 0; i < PresetCount; i++) {
+        ok = ok && PWDataBufferAppend(&fixture->output, outputs[i].bytes, outputs[i].length);
+        PWDataBufferFree(&outputs[i]);
+    }
+    return ok;
+}
+
+    /// Rate control encodes the image several times, so this is the worst case for an export limited in size.
+static bool benchmarkJPEGExportTargetLength(void *context) {
+    ImageFixture *fixture = context;
+    PWJPEGEncodeOptions options;
+    PWJPEGEncodeOptionsInit(&options);
+    options.targetLength = JPEGTargetLength;
+    fixture->output.length = 0;
+    return PWJPEGEncode(fixture->stereogram, &options, &fixture->output) == PWError_None
+        && fixture->output.length <= JPEGTargetLength;
+}
+
+    /// The animated GIF viewing method alternates between the left and right photos.
+static bool benchmarkGIFExport(void *context) {
+    ImageFixture *fixture = context;
+    fixture->output.length = 0;
+    PWGIFEncoder *encoder = PWGIFEncoderCreate(&fixture->output, PhotoWidth, PhotoHeight, 0);
+    if (!encoder) {
+        return false;
+    }
+    PWGIFEncoderAddFrame(encoder, fixture->left, 25);
+    PWGIFEncoderAddFrame(encoder, fixture->right, 25);
+    return PWGIFEncoderFinish(encoder) == PWError_None;
+}
+
+    /// Every frame of the sequence is the saved pair, decoded again as it would be from the files of a real sequence.
+static PWError decodeSequenceFrame(void *context, size_t index, PWImageBuffer **left, PWImageBuffer **right) {
+    (void)index;
+    ImageFixture *fixture = context;
+    PWError error = PWJPEGDecode(fixture->leftJPEG.bytes, fixture->leftJPEG.length, left);
+    if (error == PWError_None) {
+        error = PWJPEGDecode(fixture->rightJPEG.bytes, fixture->rightJPEG.length, right);
+    }
+    if (error != PWError_None) {
+        PWImageBufferRelease(*left);
+    }
+    return error;
+}
+
+static bool discardOutput(void *context, const uint8_t *bytes, size_t length) {
+    (void)bytes;
+    *(size_t *)context += length;
+    return true;
+}
+
+    /// A burst streamed into an anaglyph animation, decoding each pair on the producer thread while the last is encoded.
+static bool benchmarkSequenceGIF(void *context) {
+    PWSequenceOptions options;
+    PWSequenceOptionsInit(&options);
+    options.layout = PWSequenceLayout_Anaglyph;
+    size_t length = 0;
+    return PWSequenceEncodeGIF(SequenceFrames, decodeSequenceFrame, context, &options, discardOutput, &length) == PWError_None;
+}
+
+    /// Exporting the pair as an MPO file copies the two saved JPEG files, so compare with export_jpeg_q90.
+static bool benchmarkMPOExport(void *context) {
+    ImageFixture *fixture = context;
+    fixture->output.length = 0;
+    return PWMPOCreate(fixture->leftJPEG.bytes, fixture->leftJPEG.length, fixture->rightJPEG.bytes, fixture->rightJPEG.length,
+                       &fixture->output) == PWError_None;
+}
+
+static bool setupTilePyramid(void *context) {
+    PyramidFixture *pyramid = context;
+    return PWLibraryRemoveDirectory(pyramid->directory) == PWError_None;
+}
+
+static bool benchmarkTilePyramid(void *context) {
+    PyramidFixture *pyramid = context;
+    return PWTilePyramidWrite(pyramid->image, pyramid->directory, PWTilePyramidDefaultTileSize, NULL, NULL, NULL, NULL) == PWError_None;
+}
+
+    /// Load and decode every tile the viewer needs to show the whole stereogram at screen size.
+static bool benchmarkTileFirstPaint(void *context) {
+    PyramidFixture *pyramid = context;
+    size_t columns, rows;
+    PWTilePyramidTileGrid(&pyramid->info, pyramid->firstPaintLevel, &columns, &rows);
+    char path[PATH_MAX];
+    for (size_t row = 0; row < rows; row++) {
+        for (size_t column = 0; column < columns; column++) {
+            PWImageBuffer *tile = NULL;
+            if (!PWTilePyramidTilePath(path, sizeof(path), pyramid->directory, pyramid->firstPaintLevel, column, row)
+                || !readFile(path, &pyramid->file)
+                || PWJPEGDecode(pyramid->file.bytes, pyramid->file.length, &tile) != PWError_None) {
+                return false;
+            }
+            PWImageBufferRelease(tile);
+        }
+    }
+    return true;
+}
+
+static bool countEntry(const PWLibraryEntry *entry, void *context) {
+    size_t *methodTotal = context;
+    *methodTotal += (size_t)entry->viewingMethod;
+    return true;
+}
+
+static bool benchmarkEnumerate(void *context) {
+    LibraryFixture *library = context;
+    size_t count = 0, methodTotal = 0;
+    return PWLibraryEnumerate(library->rootPath, countEntry, &methodTotal, &count) == PWError_None
+        && count == library->stereogramCount;
+}
+
+static bool setupBatchDelete(void *context) {
+    return populateLibrary(context, DeleteBatchSize);
+}
+
+static bool benchmarkBatchDelete(void *context) {
+    LibraryFixture *library = context;
+    size_t count = 0;
+    return PWLibraryDeleteAll(library->rootPath, &count) == PWError_None && count == DeleteBatchSize;
+}
+
+    /// A journalled library and a copy of it in another storage, brought up to date by each sync.
+typedef struct SyncFixture {
+    LibraryFixture library;
+    PWStorage *target;
+} SyncFixture;
+
+static bool setupSyncIncremental(void *context) {
+    return populateLibrary(&((SyncFixture *)context)->library, SyncBatchSize);
+}
+
+static bool benchmarkSyncIncremental(void *context) {
+    SyncFixture *sync = context;
+    PWSyncStatistics statistics;
+    return PWSyncLibrary(sync->library.rootPath, sync->target, "/Backup", NULL, &statistics) == PWError_None
+        && statistics.filesSent == SyncBatchSize * 3;
+}
+
+    /// The stored hashes of a library, and room for the groups found in them.
+typedef struct HashFixture {
+    uint64_t *hashes;
+    size_t *groups;
+} HashFixture;
+
+    /// Make hashes in fours a few bits apart, like a library where every scene was shot several times. Hashes of
+    /// different scenes are about as random as these.
+static bool makeHashFixture(HashFixture *fixture) {
+    fixture->hashes = malloc(DuplicateSearchCount * sizeof(uint64_t));
+    fixture->groups = malloc(DuplicateSearchCount * sizeof(size_t));
+    uint64_t random = 0x9E3779B97F4A7C15ull;
+    for (size_t i = 0; fixture->hashes && i < DuplicateSearchCount; i++) {
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        fixture->hashes[i] = i % 4 == 0 ? random : fixture->hashes[i - 1] ^ (1ull << (random % 64)) ^ (1ull << (random >> 58));
+    }
+    return fixture->hashes && fixture->groups;
+}
+
+static bool benchmarkFindDuplicates(void *context) {
+    HashFixture *fixture = context;
+    return PWPerceptualHashGroup(fixture->hashes, DuplicateSearchCount, PWPerceptualHashNearDuplicateDistance,
+                                 fixture->groups) == PWError_None;
+}
+
+    /// A side-by-side stereogram saved by another tool, and a photo folder to import it into.
+typedef struct ImportFixture {
+    char rootPath[PATH_MAX], sourcePath[PATH_MAX];
+    PWDataBuffer file, leftJPEG, rightJPEG;
+} ImportFixture;
+
+static bool makeImportFixture(ImportFixture *fixture, const char *parentPath, const ImageFixture *images) {
+    memset(fixture, 0, sizeof(ImportFixture));
+    int rootLength = snprintf(fixture->rootPath, sizeof(fixture->rootPath), "%s/import", parentPath);
+    int sourceLength = snprintf(fixture->sourcePath, sizeof(fixture->sourcePath), "%s/SideBySide.jpg", parentPath);
+    return rootLength > 0 && rootLength < (int)sizeof(fixture->rootPath)
+        && sourceLength > 0 && sourceLength < (int)sizeof(fixture->sourcePath)
+        && mkdir(fixture->rootPath, 0755) == 0
+        && PWDataBufferInit(&fixture->file, 0) && PWDataBufferInit(&fixture->leftJPEG, 0) && PWDataBufferInit(&fixture->rightJPEG, 0)
+        && PWJPEGEncode(images->stereogram, NULL, &fixture->file) == PWError_None
+        && writeFile(fixture->sourcePath, fixture->file.bytes, fixture->file.length);
+}
+
+static void freeImportFixture(ImportFixture *fixture) {
+    size_t count;
+    PWLibraryDeleteAll(fixture->rootPath, &count);
+    rmdir(fixture->rootPath);
+    unlink(fixture->sourcePath);
+    PWDataBufferFree(&fixture->file);
+    PWDataBufferFree(&fixture->leftJPEG);
+    PWDataBufferFree(&fixture->rightJPEG);
+}
+
+    /// Cutting the stereogram in half through its DCT coefficients, without decoding it.
+static bool benchmarkSplitCoefficients(void *context) {
+    ImportFixture *fixture = context;
+    bool lossless = false;
+    fixture->leftJPEG.length = fixture->rightJPEG.length = 0;
+    return PWImportSplitSideBySide(fixture->file.bytes, fixture->file.length, false, &fixture->leftJPEG, &fixture->rightJPEG,
+                                   &lossless) == PWError_None && lossless;
+}
+
+    /// Compare with split_side_by_side_coefficients: decoding the stereogram and encoding each half again.
+static bool benchmarkSplitReencode(void *context) {
+    ImportFixture *fixture = context;
+    PWImageBuffer *stereogram = NULL;
+    if (PWJPEGDecode(fixture->file.bytes, fixture->file.length, &stereogram) != PWError_None) {
+        return false;
+    }
+    size_t half = stereogram->width / 2;
+    PWImageBuffer *left = PWImageBufferCreateSubImage(stereogram, (PWImageRect) { 0, 0, half, stereogram->height });
+    PWImageBuffer *right = PWImageBufferCreateSubImage(stereogram, (PWImageRect) { half, 0, half, stereogram->height });
+    fixture->leftJPEG.length = fixture->rightJPEG.length = 0;
+    bool ok = left && right && PWJPEGEncode(left, NULL, &fixture->leftJPEG) == PWError_None
+           && PWJPEGEncode(right, NULL, &fixture->rightJPEG) == PWError_None;
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+    PWImageBufferRelease(stereogram);
+    return ok;
+}
+
+static bool setupImport(void *context) {
+    ImportFixture *fixture = context;
+    size_t count;
+    return PWLibraryDeleteAll(fixture->rootPath, &count) == PWError_None;
+}
+
+static bool benchmarkImport(void *context) {
+    ImportFixture *fixture = context;
+    char names[ImportBatchSize][16];
+    const char *namePointers[ImportBatchSize], *paths[ImportBatchSize];
+    for (size_t i = 0; i < ImportBatchSize; i++) {
+        snprintf(names[i], sizeof(names[i]), "Import%zu", i);
+        namePointers[i] = names[i];
+        paths[i] = fixture->sourcePath;
+    }
+    PWImportOptions options = { false, 0 };
+    PWImportResult results[ImportBatchSize];
+    return PWImportSideBySideFiles(fixture->rootPath, namePointers, paths, ImportBatchSize, &options, results) == ImportBatchSize;
+}
+
+// MARK: - Main
+
+static void printUsage(const char *program) {
+    fprintf(stderr, "Usage: %s [-w warmup] [-r repetitions] [-f filter] [-o output.jsonl] [-d scratch-directory] [-t threads]\n", program);
+}
+
+int main(int argc, char *argv[]) {
+    PWBenchmarkOptions options;
+    PWBenchmarkOptionsInit(&options);
+    const char *scratchParent = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    int option;
+    while ((option = getopt(argc, argv, "w:r:f:o:d:t:h")) != -1) {
+        switch (option) {
+            case 'w': options.warmup = (unsigned)strtoul(optarg, NULL, 10); break;
+            case 'r': options.repetitions = (unsigned)strtoul(optarg, NULL, 10); break;
+            case 'f': options.filter = optarg; break;
+            case 'd': scratchParent = optarg; break;
+            case 't': PWParallelSetThreadCount((unsigned)strtoul(optarg, NULL, 10)); break;
+            case 'o':
+                options.output = fopen(optarg, "w");
+                if (!options.output) {
+                    perror(optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                printUsage(argv[0]);
+                return option == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    bool ok = true;
+    ImageFixture images;
+    if (!makeImageFixture(&images)) {
+        fprintf(stderr, "Failed to create the test images.\n");
+        return EXIT_FAILURE;
+    }
+    uint64_t photoPixels = (uint64_t)PhotoWidth * PhotoHeight, stereogramPixels = photoPixels * 2;
+    const PWBenchmark imageBenchmarks[] = {
+        { "composite_side_by_side_1632x1224", NULL, benchmarkComposite      , &images, stereogramPixels, PWImageBufferByteCount(images.stereogram), NULL },
+        { "decode_composite_compact"        , NULL, benchmarkDecodeComposite, &images, stereogramPixels, PWImageBufferByteCount(images.compact), NULL },
+        { "decode_composite_unpooled"       , NULL, benchmarkDecodeCompositeUnpooled, &images, stereogramPixels, PWImageBufferByteCount(images.compact), NULL },
+        { "recomposite_shifted_compact"     , NULL, benchmarkRecompositeShifted, &images, stereogramPixels, 0, NULL },
+        { "align_estimate_1632x1224"        , NULL, benchmarkAlignEstimate  , &images, photoPixels, 0, NULL },
+        { "align_correct_rotated_1632x1224" , NULL, benchmarkAlignCorrect   , &images, photoPixels, 0, NULL },
+        { "animation_inbetween_compact"     , NULL, benchmarkAnimationInBetween, &images, photoPixels * AnimationInBetweenViews, 0, NULL },
+        { "display_rows_compact"            , NULL, benchmarkDisplayRows    , &images, images.compact->width * DisplayRows, 0, NULL },
+        { "anaglyph_optimised_1632x1224"    , NULL, benchmarkAnaglyph       , &images, photoPixels, PWImageBufferByteCount(images.anaglyph), NULL },
+        { "decode_anaglyph_compact"         , NULL, benchmarkDecodeAnaglyph , &images, photoPixels, PWImageBufferByteCount(images.anaglyph), NULL },
+        { "orient_right_1632x1224"          , NULL, benchmarkOrientRight    , &images, photoPixels, 0, NULL },
+        { "orient_down_1632x1224"           , NULL, benchmarkOrientDown     , &images, photoPixels, 0, NULL },
+        { "orient_right_compact"            , NULL, benchmarkOrientCompact  , &images, stereogramPixels, 0, NULL },
+        { "resample_half_area"              , NULL, benchmarkResampleArea    , &images, photoPixels, 0, NULL },
+        { "resample_half_bilinear"          , NULL, benchmarkResampleBilinear, &images, photoPixels, 0, NULL },
+        { "resample_half_lanczos3"          , NULL, benchmarkResampleLanczos , &images, photoPixels, 0, NULL },
+        { "thumbnail_100"                   , NULL, benchmarkThumbnail      , &images, stereogramPixels, 0, NULL },
+        { "thumbnail_100_border_rounded"    , NULL, benchmarkThumbnailBorderRounded, &images, stereogramPixels, 0, NULL },
+        { "add_exif_thumbnail_1632x1224"    , NULL, benchmarkAddExifThumbnail, &images, photoPixels, 0, NULL },
+        { "perceptual_hash_1632x1224"       , NULL, benchmarkPerceptualHash , &images, photoPixels, 0, NULL },
+        { "export_jpeg_q90"                 , NULL, benchmarkJPEGExport     , &images, stereogramPixels, 0, &images.output.length },
+        { "export_jpeg_q90_compact"         , NULL, benchmarkJPEGExportCompact, &images, stereogramPixels, 0, &images.output.length },
+        { "export_jpeg_q90_progressive"     , NULL, benchmarkJPEGExportProgressive, &images, stereogramPixels, 0, &images.output.length },
+        { "export_share_bundle"             , NULL, benchmarkExportShareBundle, &images, stereogramPixels, 0, &images.output.length },
+        { "export_jpeg_target_256k"         , NULL, benchmarkJPEGExportTargetLength, &images, stereogramPixels, 0, &images.output.length },
+        { "export_gif_2_frames"             , NULL, benchmarkGIFExport      , &images, stereogramPixels, 0, NULL },
+        { "export_mpo"                      , NULL, benchmarkMPOExport      , &images, stereogramPixels, 0, NULL },
+        { "sequence_gif_anaglyph_8_frames"  , NULL, benchmarkSequenceGIF    , &images, photoPixels * SequenceFrames, 0, NULL },
+    };
+    for (size_t i = 0; i < sizeof(imageBenchmarks) / sizeof(imageBenchmarks[0]); i++) {
+        ok = PWBenchmarkRun(&imageBenchmarks[i], &options) && ok;
+    }
+
+        // Matching takes about the same time whatever the size of the photos; only scaling them down grows with it.
+    const struct { const char *name; size_t width, height; } disparitySizes[] = {
+        { "disparity_estimate_640x480", 640, 480 }, { "disparity_estimate_1632x1224", 1632, 1224 },
+        { "disparity_estimate_3264x2448", 3264, 2448 }
+    };
+    for (size_t i = 0; i < sizeof(disparitySizes) / sizeof(disparitySizes[0]); i++) {
+        if (!PWBenchmarkIsSelected(&options, disparitySizes[i].name)) {
+            continue;
+        }
+        DisparityFixture disparity;
+        if (makeDisparityFixture(&disparity, disparitySizes[i].width, disparitySizes[i].height)) {
+            PWBenchmark benchmark = { disparitySizes[i].name, NULL, benchmarkDisparityEstimate, &disparity,
+                                      disparitySizes[i].width * disparitySizes[i].height, 0, NULL };
+            ok = PWBenchmarkRun(&benchmark, &options) && ok;
+        } else {
+            fprintf(stderr, "Out of memory.\n");
+            ok = false;
+        }
+        PWImageBufferRelease(disparity.left);
+        PWImageBufferRelease(disparity.right);
+    }
+
+        // The library benchmarks only need small files on disk; the cost being measured is the file system work.
+    PWImageBuffer *smallPhoto = PWImageBufferCreate(64, 48, PWPixelFormat_RGBA8888);
+    PWDataBuffer photoData;
+    if (!smallPhoto || !PWDataBufferInit(&photoData, 4096)) {
+        fprintf(stderr, "Out of memory.\n");
+        return EXIT_FAILURE;
+    }
+    fillSyntheticPhoto(smallPhoto, 3);
+    PWJPEGEncode(smallPhoto, NULL, &photoData);
+    PWImageBufferRelease(smallPhoto);
+
+    char scratchPath[PATH_MAX];
+    snprintf(scratchPath, sizeof(scratchPath), "%s/StereogramBenchmarks.XXXXXX", scratchParent);
+    if (!mkdtemp(scratchPath)) {
+        perror(scratchPath);
+        return EXIT_FAILURE;
+    }
+
+        // The library benchmarks run on disk, then in memory, which shows how much of their time the file system takes.
+    PWStorage *memoryStorage = PWMemoryStorageCreate();
+    const struct { const char *suffix, *parentPath; PWStorage *storage; } libraryStorages[] = {
+        { "", scratchPath, PWStoragePOSIX() }, { "_memory", "", memoryStorage }
+    };
+    const size_t libraryCounts[] = { 10, 1000, 10000 };
+    for (size_t s = 0; s < sizeof(libraryStorages) / sizeof(libraryStorages[0]) && libraryStorages[s].storage; s++) {
+        PWStorageSetDefault(libraryStorages[s].storage);
+        for (size_t i = 0; i < sizeof(libraryCounts) / sizeof(libraryCounts[0]); i++) {
+            char name[64];
+            snprintf(name, sizeof(name), "enumerate_library_%zu%s", libraryCounts[i], libraryStorages[s].suffix);
+            if (!PWBenchmarkIsSelected(&options, name)) {
+                continue;
+            }
+            LibraryFixture library;
+            if (makeLibraryFixture(&library, libraryStorages[s].parentPath, name, libraryCounts[i], &photoData)) {
+                PWBenchmark benchmark = { name, NULL, benchmarkEnumerate, &library, libraryCounts[i], 0, NULL };
+                ok = PWBenchmarkRun(&benchmark, &options) && ok;
+            } else {
+                fprintf(stderr, "Failed to create library fixture %s.\n", library.rootPath);
+                ok = false;
+            }
+            freeLibraryFixture(&library);
+        }
+
+        char name[64];
+        snprintf(name, sizeof(name), "delete_batch_100%s", libraryStorages[s].suffix);
+        if (PWBenchmarkIsSelected(&options, name)) {
+            LibraryFixture library;
+            if (makeLibraryFixture(&library, libraryStorages[s].parentPath, "delete_batch", 0, &photoData)) {
+                PWBenchmark benchmark = { name, setupBatchDelete, benchmarkBatchDelete, &library, DeleteBatchSize, 0, NULL };
+                ok = PWBenchmarkRun(&benchmark, &options) && ok;
+            } else {
+                ok = false;
+            }
+            freeLibraryFixture(&library);
+        }
+    }
+
+        // Syncing 10 new stereograms out of 1000, in memory so it is the journal and manifest being timed, not the disk.
+    if (PWBenchmarkIsSelected(&options, "sync_incremental_10_of_1000")) {
+        SyncFixture sync = { .target = PWMemoryStorageCreate() };
+        PWStorageSetDefault(memoryStorage);
+        if (sync.target && makeLibraryFixture(&sync.library, "", "sync", 1000, &photoData)
+            && PWJournalCreate(sync.library.rootPath) == PWError_None
+            && PWSyncLibrary(sync.library.rootPath, sync.target, "/Backup", NULL, NULL) == PWError_None) {
+            PWBenchmark benchmark = { "sync_incremental_10_of_1000", setupSyncIncremental, benchmarkSyncIncremental, &sync,
+                                      SyncBatchSize, 0, NULL };
+            ok = PWBenchmarkRun(&benchmark, &options) && ok;
+        } else {
+            fprintf(stderr, "Failed to create sync fixture.\n");
+            ok = false;
+        }
+        char journalPath[PATH_MAX + 16];
+        snprintf(journalPath, sizeof(journalPath), "%s/%s", sync.library.rootPath, PWJournalFileName);
+        PWStorageRemoveFile(memoryStorage, journalPath);
+        freeLibraryFixture(&sync.library);
+        PWStorageRelease(sync.target);
+    }
+    PWStorageSetDefault(NULL);
+    PWStorageRelease(memoryStorage);
+
+    if (PWBenchmarkIsSelected(&options, "find_duplicates_10000")) {
+        HashFixture hashes;
+        if (makeHashFixture(&hashes)) {
+            PWBenchmark benchmark = { "find_duplicates_10000", NULL, benchmarkFindDuplicates, &hashes, DuplicateSearchCount, 0, NULL };
+            ok = PWBenchmarkRun(&benchmark, &options) && ok;
+        } else {
+            fprintf(stderr, "Out of memory.\n");
+            ok = false;
+        }
+        free(hashes.hashes);
+        free(hashes.groups);
+    }
+
+    if (PWBenchmarkIsSelected(&options, "tile_pyramid_256") || PWBenchmarkIsSelected(&options, "tile_first_paint")) {
+        PyramidFixture pyramid;
+        if (makePyramidFixture(&pyramid, scratchPath, images.compact)) {
+            size_t firstPaintWidth, firstPaintHeight;
+            PWTilePyramidLevelSize(&pyramid.info, pyramid.firstPaintLevel, &firstPaintWidth, &firstPaintHeight);
+            const PWBenchmark pyramidBenchmarks[] = {
+                { "tile_pyramid_256", setupTilePyramid, benchmarkTilePyramid   , &pyramid, stereogramPixels, 0, NULL },
+                { "tile_first_paint", NULL            , benchmarkTileFirstPaint, &pyramid, firstPaintWidth * firstPaintHeight, 0, NULL },
+            };
+            for (size_t i = 0; i < sizeof(pyramidBenchmarks) / sizeof(pyramidBenchmarks[0]); i++) {
+                ok = PWBenchmarkRun(&pyramidBenchmarks[i], &options) && ok;
+            }
+        } else {
+            fprintf(stderr, "Failed to create tile pyramid fixture %s.\n", pyramid.directory);
+            ok = false;
+        }
+        freePyramidFixture(&pyramid);
+    }
+
+    if (PWBenchmarkIsSelected(&options, "tile_from_photo") || PWBenchmarkIsSelected(&options, "tile_from_exif")
+        || PWBenchmarkIsSelected(&options, "preview_from_exif") || PWBenchmarkIsSelected(&options, "preview_reduced_decode")) {
+        ThumbnailFixture thumbnails;
+        if (makeThumbnailFixture(&thumbnails, scratchPath, &images)) {
+            const PWBenchmark thumbnailBenchmarks[] = {
+                { "tile_from_photo", NULL, benchmarkTileFromPhoto, &thumbnails, photoPixels, 0, NULL },
+                { "tile_from_exif" , NULL, benchmarkTileFromExif , &thumbnails, photoPixels, 0, NULL },
+                { "preview_from_exif"     , NULL, benchmarkPreviewFromExif    , &thumbnails, stereogramPixels, 0, NULL },
+                { "preview_reduced_decode", NULL, benchmarkPreviewReducedDecode, &thumbnails, stereogramPixels, 0, NULL },
+            };
+            for (size_t i = 0; i < sizeof(thumbnailBenchmarks) / sizeof(thumbnailBenchmarks[0]); i++) {
+                ok = PWBenchmarkRun(&thumbnailBenchmarks[i], &options) && ok;
+            }
+        } else {
+            fprintf(stderr, "Failed to create thumbnail fixture in %s.\n", scratchPath);
+            ok = false;
+        }
+        freeThumbnailFixture(&thumbnails);
+    }
+
+    if (PWBenchmarkIsSelected(&options, "split_side_by_side_coefficients") || PWBenchmarkIsSelected(&options, "split_side_by_side_reencode")
+        || PWBenchmarkIsSelected(&options, "import_side_by_side_8_files")) {
+        ImportFixture import;
+        if (makeImportFixture(&import, scratchPath, &images)) {
+            const PWBenchmark importBenchmarks[] = {
+                { "split_side_by_side_coefficients", NULL       , benchmarkSplitCoefficients, &import, stereogramPixels, 0, &import.leftJPEG.length },
+                { "split_side_by_side_reencode"    , NULL       , benchmarkSplitReencode    , &import, stereogramPixels, 0, &import.leftJPEG.length },
+                { "import_side_by_side_8_files"    , setupImport, benchmarkImport           , &import, ImportBatchSize, 0, NULL },
+            };
+            for (size_t i = 0; i < sizeof(importBenchmarks) / sizeof(importBenchmarks[0]); i++) {
+                ok = PWBenchmarkRun(&importBenchmarks[i], &options) && ok;
+            }
+        } else {
+            fprintf(stderr, "Failed to create import fixture in %s.\n", scratchPath);
+            ok = false;
+        }
+        freeImportFixture(&import);
+    }
+
+    rmdir(scratchPath);
+    PWDataBufferFree(&photoData);
+    freeImageFixture(&images);
+    if (options.output != stdout) {
+        fclose(options.output);
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,117 @@
+//
+//  PWWorkPool.c
+//  Stereogram Convert
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWWorkPool.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+    /// The indexes a worker has still to do, NEXT up to but not including END.
+    /// The owner takes from the front and thieves from the back, both holding the lock; each job is long enough that
+    /// an uncontended mutex costs nothing worth measuring.
+typedef struct WorkRange {
+    pthread_mutex_t lock;
+    size_t next, end;
+} WorkRange;
+
+typedef struct WorkPool {
+    WorkRange *ranges;
+    unsigned workerCount;
+    void *context;
+    PWWorkPoolFunction function;
+    size_t stolen;
+} WorkPool;
+
+typedef struct Worker {
+    WorkPool *pool;
+    unsigned index;
+} Worker;
+
+static bool takeNext(WorkRange *range, size_t *index) {
+    pthread_mutex_lock(&range->lock);
+    bool found = range->next < range->end;
+    if (found) {
+        *index = range->next++;
+    }
+    pthread_mutex_unlock(&range->lock);
+    return found;
+}
+
+    /// Move the back half of another worker's range into THIEF's, which is empty. Returns false if there was nothing left anywhere.
+static bool steal(WorkPool *pool, unsigned thief) {
+    for (unsigned i = 1; i < pool->workerCount; i++) {
+        WorkRange *victim = &pool->ranges[(thief + i) % pool->workerCount];
+        pthread_mutex_lock(&victim->lock);
+        size_t remaining = victim->end - victim->next, taken = (remaining + 1) / 2;
+        victim->end -= taken;
+        size_t start = victim->end;
+        pthread_mutex_unlock(&victim->lock);
+        if (taken > 0) {
+            WorkRange *range = &pool->ranges[thief];
+            pthread_mutex_lock(&range->lock);
+            range->next = start;
+            range->end = start + taken;
+            pthread_mutex_unlock(&range->lock);
+            __atomic_fetch_add(&pool->stolen, taken, __ATOMIC_RELAXED);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void *runWorker(void *argument) {
+    Worker *worker = argument;
+    WorkPool *pool = worker->pool;
+    size_t index;
+    do {
+        while (takeNext(&pool->ranges[worker->index], &index)) {
+            pool->function(pool->context, index, worker->index);
+        }
+    } while (steal(pool, worker->index));
+    return NULL;
+}
+
+size_t PWWorkPoolRun(size_t count, unsigned threadCount, void *context, PWWorkPoolFunction function) {
+    unsigned workerCount = threadCount < 1 ? 1 : count < threadCount ? (unsigned)count : threadCount;
+    WorkRange *ranges = workerCount > 1 ? calloc(workerCount, sizeof(WorkRange)) : NULL;
+    Worker *workers = workerCount > 1 ? calloc(workerCount, sizeof(Worker)) : NULL;
+    pthread_t *threads = workerCount > 1 ? calloc(workerCount, sizeof(pthread_t)) : NULL;
+    if (!ranges || !workers || !threads) {
+        free(ranges);
+        free(workers);
+        free(threads);
+        for (size_t index = 0; index < count; index++) {
+            function(context, index, 0);
+        }
+        return 0;
+    }
+
+    WorkPool pool = { ranges, workerCount, context, function, 0 };
+    for (unsigned i = 0; i < workerCount; i++) {
+        pthread_mutex_init(&ranges[i].lock, NULL);
+        ranges[i].next = count * i / workerCount;
+        ranges[i].end = count * (i + 1) / workerCount;
+        workers[i] = (Worker) { &pool, i };
+    }
+        // The ranges of any workers which couldn't be started are stolen by the others.
+    unsigned started = 1;
+    while (started < workerCount && pthread_create(&threads[started], NULL, runWorker, &workers[started]) == 0) {
+        started++;
+    }
+    runWorker(&workers[0]);
+    for (unsigned i = 1; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (unsigned i = 0; i < workerCount; i++) {
+        pthread_mutex_destroy(&ranges[i].lock);
+    }
+    free(ranges);
+    free(workers);
+    free(threads);
+    return pool.stolen;
+}
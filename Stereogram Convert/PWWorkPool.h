@@ -0,0 +1,43 @@
+/*!
+ @header PWWorkPool
+ @abstract A work-stealing thread pool for running one job per stereogram over a whole library.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ PWParallelFor() suits many small, equal pieces of one image. Converting a library is the opposite: a few thousand
+ jobs, each taking tens of milliseconds, and varying a lot with the size of the photos. Here each worker starts with
+ an equal run of consecutive indexes and works through it from the front. A worker which runs out takes the back half
+ of what is left of another's run, so the workers only contend when one is stealing, and each mostly works through
+ neighbouring entries, which are usually neighbouring directories on disk.
+ */
+
+#ifndef PWWorkPool_h
+#define PWWorkPool_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Does one job. WORKER is the number of the thread running it, from 0 to one less than the thread count, so the job
+ * can keep per-thread state in an array without locking.
+ */
+typedef void (*PWWorkPoolFunction)(void *context, size_t index, unsigned worker);
+
+/*!
+ * Call FUNCTION once for each index from 0 to COUNT - 1 on THREADCOUNT threads, and wait for them all to finish.
+ *
+ * The calling thread is worker 0. If some threads can't be started, the others do their work.
+ *
+ * @return The number of jobs each worker stole from another, summed, or 0 if everything ran on one thread.
+ */
+size_t PWWorkPoolRun(size_t count, unsigned threadCount, void *context, PWWorkPoolFunction function);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWWorkPool_h */
@@ -0,0 +1,612 @@
+//
+//  main.c
+//  Stereogram Convert
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+//  Converts a whole library of stereograms in the app's on-disk layout, without the app. See README.md for how to build and run it.
+//
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "PWGIFEncoder.h"
+#include "PWImageBuffer.h"
+#include "PWJPEGEncoder.h"
+#include "PWLibrary.h"
+#include "PWParallel.h"
+#include "PWStereoPair.h"
+#include "PWThumbnail.h"
+#include "PWWorkPool.h"
+
+    /// Lists the stereograms already converted into the output directory, one path relative to the library per line.
+static const char *const JournalFileName = "Converted.journal";
+
+    /// Names of the files written for each stereogram, in a directory with the same relative path as its own.
+static const char *const SideBySideFileName = "SideBySide.jpg", *const SwappedFileName = "Swapped.jpg";
+static const char *const AnimationFileName = "Animation.gif", *const ThumbnailFileName = "Thumbnail.jpg";
+
+    /// Size of the thumbnails, as in Stereogram.m.
+enum { ThumbnailSize = 100 };
+
+    /// Hundredths of a second each frame of the animation is shown. Stereogram.m shows both photos in 0.25 seconds.
+enum { FrameDelay = 13 };
+
+/*!
+ * @enum
+ * @brief The steps in converting one stereogram, each timed separately.
+ * @constant Stage_Decode     Reading and decoding the photos, and cropping, aligning and shifting them as the app does.
+ * @constant Stage_SideBySide Compositing and encoding the cross-eyed stereogram.
+ * @constant Stage_Swap       Compositing and encoding the wall-eyed stereogram, with the photos swapped.
+ * @constant Stage_GIF        Encoding the two-frame animation.
+ * @constant Stage_Thumbnail  Shrinking the cropped left photo and encoding it.
+ * @constant Stage_Write      Writing the output files.
+ */
+typedef enum Stage {
+    Stage_Decode,
+    Stage_SideBySide,
+    Stage_Swap,
+    Stage_GIF,
+    Stage_Thumbnail,
+    Stage_Write,
+
+    Stage_NUM_STAGES
+} Stage;
+
+    /// Names used in the report, and for the stages which make an output, in the -s option.
+static const char *const StageNames[Stage_NUM_STAGES] = { "decode", "side_by_side", "swap", "gif", "thumbnail", "write" };
+
+    /// The stages which make an output file, and so can be chosen with -s.
+static const unsigned OutputStages = 1u << Stage_SideBySide | 1u << Stage_Swap | 1u << Stage_GIF | 1u << Stage_Thumbnail;
+
+    /// What one worker has done in one stage. Each worker has its own, so they are only added together at the end.
+typedef struct StageTotals {
+    uint64_t items, nanoseconds, pixels, bytes;
+} StageTotals;
+
+    /// A list of paths relative to the library, kept sorted so the journal can be searched.
+typedef struct PathList {
+    char **paths;
+    size_t count, capacity;
+} PathList;
+
+typedef struct Converter {
+    const char *libraryPath, *outputPath;
+    PathList entries, converted;
+    unsigned stages;
+    PWJPEGEncodeOptions jpegOptions;
+    FILE *journal;
+    pthread_mutex_t journalLock;
+        /// Indexed by worker, then stage.
+    StageTotals (*totals)[Stage_NUM_STAGES];
+    size_t convertedCount, skippedCount, failedCount;
+} Converter;
+
+    /// Set by SIGINT. Stereograms already started are finished, so the journal stays accurate; the rest are left for the next run.
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop(int signalNumber) {
+    (void)signalNumber;
+    stopRequested = 1;
+}
+
+static uint64_t now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000ull + (uint64_t)time.tv_nsec;
+}
+
+// MARK: - Files
+
+static bool joinPath(char *output, const char *directory, const char *name) {
+    int length = snprintf(output, PATH_MAX, "%s/%s", directory, name);
+    return length > 0 && length < PATH_MAX;
+}
+
+static bool isFile(const char *directory, const char *name) {
+    char path[PATH_MAX];
+    struct stat info;
+    return joinPath(path, directory, name) && stat(path, &info) == 0 && S_ISREG(info.st_mode);
+}
+
+static PWError readFile(const char *directory, const char *name, PWDataBuffer *contents) {
+    char path[PATH_MAX];
+    if (!joinPath(path, directory, name)) {
+        return PWError_InvalidParameter;
+    }
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return PWError_IO;
+    }
+    PWError error = PWError_IO;
+    long length;
+    if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) >= 0 && fseek(file, 0, SEEK_SET) == 0) {
+        if (!PWDataBufferReserve(contents, (size_t)length)) {
+            error = PWError_OutOfMemory;
+        } else if (fread(contents->bytes + contents->length, 1, (size_t)length, file) == (size_t)length) {
+            contents->length += (size_t)length;
+            error = PWError_None;
+        }
+    }
+    fclose(file);
+    return error;
+}
+
+    /// Write to a temporary name and rename, so an interrupted run never leaves a truncated file under the real name.
+static PWError writeFile(const char *directory, const char *name, const PWDataBuffer *contents) {
+    char path[PATH_MAX], temporaryPath[PATH_MAX + 8];
+    if (!joinPath(path, directory, name)) {
+        return PWError_InvalidParameter;
+    }
+    snprintf(temporaryPath, sizeof(temporaryPath), "%s.partial", path);
+    FILE *file = fopen(temporaryPath, "wb");
+    if (!file) {
+        return PWError_IO;
+    }
+    bool ok = fwrite(contents->bytes, 1, contents->length, file) == contents->length;
+    ok = (fclose(file) == 0) && ok;
+    ok = ok && rename(temporaryPath, path) == 0;
+    if (!ok) {
+        unlink(temporaryPath);
+    }
+    return ok ? PWError_None : PWError_IO;
+}
+
+    /// Create PATH and any missing parents, as mkdir -p does.
+static bool makeDirectories(const char *path) {
+    char partial[PATH_MAX];
+    size_t length = strlen(path);
+    if (length >= sizeof(partial)) {
+        return false;
+    }
+    memcpy(partial, path, length + 1);
+    for (char *slash = strchr(partial + 1, '/'); ; slash = strchr(slash + 1, '/')) {
+        if (slash) {
+            *slash = '\0';
+        }
+        if (mkdir(partial, 0755) != 0 && errno != EEXIST) {
+            return false;
+        }
+        if (!slash) {
+            return true;
+        }
+        *slash = '/';
+    }
+}
+
+// MARK: - Finding the stereograms
+
+static bool appendPath(PathList *list, const char *path) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 256;
+        char **paths = realloc(list->paths, capacity * sizeof(char *));
+        if (!paths) {
+            return false;
+        }
+        list->paths = paths;
+        list->capacity = capacity;
+    }
+    char *copy = strdup(path);
+    if (!copy) {
+        return false;
+    }
+    list->paths[list->count++] = copy;
+    return true;
+}
+
+static void freePaths(PathList *list) {
+    for (size_t i = 0; i < list->count; i++) {
+        free(list->paths[i]);
+    }
+    free(list->paths);
+    *list = (PathList) { NULL, 0, 0 };
+}
+
+static int comparePaths(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static bool containsPath(const PathList *list, const char *path) {
+    return list->count > 0 && bsearch(&path, list->paths, list->count, sizeof(char *), comparePaths) != NULL;
+}
+
+    /// Add every stereogram under ROOT/RELATIVE to LIST. Unlike PWLibraryEnumerate(), this goes down through any
+    /// directories which aren't stereograms themselves, so a back catalogue can be organised into folders.
+static PWError collectEntries(const char *root, const char *relative, PathList *list) {
+    char path[PATH_MAX];
+    if (!(relative[0] ? joinPath(path, root, relative) : snprintf(path, sizeof(path), "%s", root) < PATH_MAX)) {
+        return PWError_InvalidParameter;
+    }
+    if (isFile(path, PWLibraryLeftPhotoFileName) && isFile(path, PWLibraryRightPhotoFileName) && isFile(path, PWLibraryPropertyListFileName)) {
+        return appendPath(list, relative) ? PWError_None : PWError_OutOfMemory;
+    }
+    DIR *directory = opendir(path);
+    if (!directory) {
+        return PWError_IO;
+    }
+    PWError error = PWError_None;
+    char childPath[PATH_MAX], child[PATH_MAX];
+    struct dirent *item;
+    while (error == PWError_None && (item = readdir(directory)) != NULL) {
+        struct stat info;
+        if (item->d_name[0] == '.') {
+            continue;  // Hidden files, and the . and .. entries, as in PWLibraryEnumerate().
+        }
+        if (!joinPath(childPath, path, item->d_name)
+            || !(relative[0] ? joinPath(child, relative, item->d_name) : snprintf(child, sizeof(child), "%s", item->d_name) < PATH_MAX)) {
+            error = PWError_InvalidParameter;
+        } else if (stat(childPath, &info) == 0 && S_ISDIR(info.st_mode)) {
+            error = collectEntries(root, child, list);
+        }
+    }
+    closedir(directory);
+    return error;
+}
+
+    /// Read the journal left by an earlier run into CONVERTED. A missing journal just means nothing has been done yet.
+    /// A last line without a newline was cut off by the interruption, so it is ignored.
+static PWError loadJournal(const char *path, PathList *converted) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return errno == ENOENT ? PWError_None : PWError_IO;
+    }
+    PWError error = PWError_None;
+    char line[PATH_MAX + 1];
+    while (error == PWError_None && fgets(line, sizeof(line), file)) {
+        size_t length = strlen(line);
+        if (length > 1 && line[length - 1] == '\n') {
+            line[length - 1] = '\0';
+            error = appendPath(converted, line) ? PWError_None : PWError_OutOfMemory;
+        }
+    }
+    fclose(file);
+    qsort(converted->paths, converted->count, sizeof(char *), comparePaths);
+    return error;
+}
+
+// MARK: - Converting one stereogram
+
+static void record(Converter *converter, unsigned worker, Stage stage, uint64_t start, uint64_t pixels, uint64_t bytes) {
+    StageTotals *totals = &converter->totals[worker][stage];
+    totals->items++;
+    totals->nanoseconds += now() - start;
+    totals->pixels += pixels;
+    totals->bytes += bytes;
+}
+
+    /// Return SOURCE, retained, if it is packed RGB, or otherwise a packed RGBA8888 copy of it.
+static PWImageBuffer *createPackedImage(PWImageBuffer *source) {
+    if (source->format == PWPixelFormat_RGBA8888 || source->format == PWPixelFormat_RGB888) {
+        return PWImageBufferRetain(source);
+    }
+    PWImageBuffer *packed = PWImageBufferCreate(source->width, source->height, PWPixelFormat_RGBA8888);
+    if (packed) {
+        for (size_t y = 0; y < source->height; y++) {
+            PWImageBufferConvertRowToRGBX(source, y, 0, source->width, PWImageBufferRow(packed, y));
+        }
+    }
+    return packed;
+}
+
+    /// The encoder takes every pixel format, so a decoded photo stays in YCbCr 4:2:0 on its way back to JPEG.
+static PWError encodeJPEG(PWImageBuffer *image, const PWJPEGEncodeOptions *options, PWDataBuffer *output) {
+    return image ? PWJPEGEncode(image, options, output) : PWError_OutOfMemory;
+}
+
+static PWError encodeAnimation(PWImageBuffer *leftView, PWImageBuffer *rightView, PWDataBuffer *output) {
+    size_t height = leftView->height > rightView->height ? leftView->height : rightView->height;
+    PWGIFEncoder *encoder = PWGIFEncoderCreate(output, leftView->width, height, 0);
+    if (!encoder) {
+        return PWError_OutOfMemory;
+    }
+    PWError error = PWGIFEncoderAddFrame(encoder, leftView, FrameDelay);
+    if (error == PWError_None) {
+        error = PWGIFEncoderAddFrame(encoder, rightView, FrameDelay);
+    }
+    PWError finishError = PWGIFEncoderFinish(encoder);
+    return error == PWError_None ? finishError : error;
+}
+
+static uint64_t pixelCount(const PWImageBuffer *image) {
+    return image ? (uint64_t)image->width * image->height : 0;
+}
+
+    /// Do one of the output stages, writing the result to DIRECTORY/NAME.
+static PWError convert(Converter *converter, unsigned worker, Stage stage, const char *directory,
+                       PWImageBuffer *leftPhoto, PWImageBuffer *leftView, PWImageBuffer *rightView, PWDataBuffer *output) {
+    uint64_t start = now();
+    output->length = 0;
+    PWImageBuffer *image = NULL;
+    PWError error;
+    const char *name;
+    switch (stage) {
+        case Stage_SideBySide:
+            image = PWImageBufferCreateSideBySide(leftView, rightView);
+            error = encodeJPEG(image, &converter->jpegOptions, output);
+            name = SideBySideFileName;
+            break;
+        case Stage_Swap:
+            image = PWImageBufferCreateSideBySide(rightView, leftView);
+            error = encodeJPEG(image, &converter->jpegOptions, output);
+            name = SwappedFileName;
+            break;
+        case Stage_GIF:
+            error = encodeAnimation(leftView, rightView, output);
+            name = AnimationFileName;
+            break;
+        case Stage_Thumbnail:
+                // As -[Stereogram thumbnailImage:], the thumbnail is of the cropped left photo alone.
+            image = PWThumbnailCreate(leftPhoto, ThumbnailSize);
+            error = encodeJPEG(image, &converter->jpegOptions, output);
+            name = ThumbnailFileName;
+            break;
+        default:
+            return PWError_InvalidParameter;
+    }
+    uint64_t pixels = stage == Stage_Thumbnail ? pixelCount(leftPhoto) : pixelCount(leftView) + pixelCount(rightView);
+    PWImageBufferRelease(image);
+    if (error != PWError_None) {
+        return error;
+    }
+    record(converter, worker, stage, start, pixels, output->length);
+
+    start = now();
+    error = writeFile(directory, name, output);
+    if (error == PWError_None) {
+        record(converter, worker, Stage_Write, start, 0, output->length);
+    }
+    return error;
+}
+
+static void convertStereogram(void *context, size_t index, unsigned worker) {
+    Converter *converter = context;
+    const char *relative = converter->entries.paths[index];
+    if (stopRequested) {
+        return;
+    }
+    if (containsPath(&converter->converted, relative)) {
+        __atomic_fetch_add(&converter->skippedCount, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    char source[PATH_MAX], destination[PATH_MAX];
+    const char *failure = NULL;
+    PWError error = PWError_InvalidParameter;
+    if (!joinPath(source, converter->libraryPath, relative) || !joinPath(destination, converter->outputPath, relative)) {
+        failure = "path is too long";
+    } else if (!makeDirectories(destination)) {
+        failure = "couldn't create the output directory";
+        error = PWError_IO;
+    }
+
+    PWDataBuffer leftFile = { 0 }, rightFile = { 0 }, output = { 0 };
+    PWImageBuffer *leftDecoded = NULL, *rightDecoded = NULL, *left = NULL, *right = NULL;
+    PWImageBuffer *leftPhoto = NULL, *rightPhoto = NULL, *leftView = NULL, *rightView = NULL;
+    PWLibraryProperties properties;
+    uint64_t start = now();
+    if (!failure) {
+        if (!PWDataBufferInit(&leftFile, 0) || !PWDataBufferInit(&rightFile, 0) || !PWDataBufferInit(&output, 1 << 20)) {
+            error = PWError_OutOfMemory;
+            failure = "out of memory";
+        } else if ((error = PWLibraryReadProperties(source, &properties)) != PWError_None) {
+            failure = "couldn't read the property list";
+        } else if ((error = readFile(source, PWLibraryLeftPhotoFileName, &leftFile)) != PWError_None
+                   || (error = readFile(source, PWLibraryRightPhotoFileName, &rightFile)) != PWError_None) {
+            failure = "couldn't read the photos";
+        } else if ((error = PWStereoPairDecodePhoto(leftFile.bytes, leftFile.length, &leftDecoded)) != PWError_None
+                   || (error = PWStereoPairDecodePhoto(rightFile.bytes, rightFile.length, &rightDecoded)) != PWError_None) {
+            failure = error == PWError_NotSupported ? "the photos use a kind of JPEG the image core can't decode" : "couldn't decode the photos";
+        }
+    }
+    if (!failure) {
+            // The app falls back to UIKit for photos in different formats, e.g. one greyscale; here both are made RGBA.
+        if (leftDecoded->format != rightDecoded->format) {
+            left = createPackedImage(leftDecoded);
+            right = createPackedImage(rightDecoded);
+        } else {
+            left = PWImageBufferRetain(leftDecoded);
+            right = PWImageBufferRetain(rightDecoded);
+        }
+        if (!left || !right) {
+            error = PWError_OutOfMemory;
+            failure = "out of memory";
+        } else if ((error = PWStereoPairCreatePhotos(left, right, properties.cropRect, properties.alignment, &leftPhoto, &rightPhoto)) != PWError_None
+                   || (error = PWStereoPairCreateShiftedViews(leftPhoto, rightPhoto, properties.disparityOffset, &leftView, &rightView)) != PWError_None) {
+            failure = "couldn't crop and align the photos";
+        } else {
+            record(converter, worker, Stage_Decode, start, pixelCount(leftDecoded) + pixelCount(rightDecoded), leftFile.length + rightFile.length);
+        }
+    }
+    PWImageBuffer *croppedLeft = NULL;
+    for (Stage stage = Stage_SideBySide; !failure && stage < Stage_Write; stage++) {
+        if (!(converter->stages & 1u << stage)) {
+            continue;
+        }
+        PWImageBuffer *photo = NULL;
+        if (stage == Stage_Thumbnail) {
+            croppedLeft = PWStereoPairCreateCroppedPhoto(left, properties.cropRect);
+            photo = croppedLeft;
+        }
+        error = convert(converter, worker, stage, destination, photo, leftView, rightView, &output);
+        if (error != PWError_None) {
+            failure = error == PWError_IO ? "couldn't write the output" : "couldn't convert the photos";
+        }
+    }
+
+    if (!failure) {
+        pthread_mutex_lock(&converter->journalLock);
+        bool journalled = fprintf(converter->journal, "%s\n", relative) > 0 && fflush(converter->journal) == 0;
+        pthread_mutex_unlock(&converter->journalLock);
+        if (!journalled) {
+            error = PWError_IO;
+            failure = "couldn't update the journal";
+        }
+    }
+    if (failure) {
+        fprintf(stderr, "%s: %s (error %d)\n", source, failure, error);
+        __atomic_fetch_add(&converter->failedCount, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&converter->convertedCount, 1, __ATOMIC_RELAXED);
+    }
+
+    PWImageBufferRelease(croppedLeft);
+    PWImageBufferRelease(leftView);
+    PWImageBufferRelease(rightView);
+    PWImageBufferRelease(leftPhoto);
+    PWImageBufferRelease(rightPhoto);
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+    PWImageBufferRelease(leftDecoded);
+    PWImageBufferRelease(rightDecoded);
+    PWDataBufferFree(&leftFile);
+    PWDataBufferFree(&rightFile);
+    PWDataBufferFree(&output);
+}
+
+// MARK: - Main
+
+    /// Turn a comma-separated list of output stage names into a mask of stages, or return 0 if any name isn't one.
+static unsigned parseStages(const char *list) {
+    unsigned stages = 0;
+    while (*list) {
+        size_t length = strcspn(list, ",");
+        unsigned found = 0;
+        for (unsigned stage = 0; stage < Stage_NUM_STAGES; stage++) {
+            if ((OutputStages & 1u << stage) && strlen(StageNames[stage]) == length && strncmp(list, StageNames[stage], length) == 0) {
+                found = 1u << stage;
+            }
+        }
+        if (!found) {
+            return 0;
+        }
+        stages |= found;
+        list += length + (list[length] == ',');
+    }
+    return stages;
+}
+
+    /// One line per stage, then a summary, in the style of the benchmark results.
+    /// Stage times are summed over the workers, so ITEMS_PER_SEC is what one thread manages.
+static void printReport(const Converter *converter, unsigned threadCount, uint64_t elapsed, size_t stolen) {
+    for (unsigned stage = 0; stage < Stage_NUM_STAGES; stage++) {
+        StageTotals sum = { 0, 0, 0, 0 };
+        for (unsigned worker = 0; worker < threadCount; worker++) {
+            const StageTotals *totals = &converter->totals[worker][stage];
+            sum.items += totals->items;
+            sum.nanoseconds += totals->nanoseconds;
+            sum.pixels += totals->pixels;
+            sum.bytes += totals->bytes;
+        }
+        if (sum.items == 0) {
+            continue;
+        }
+        double seconds = (double)sum.nanoseconds / 1e9;
+        printf("{\"stage\":\"%s\",\"items\":%llu,\"thread_seconds\":%.3f,\"items_per_sec\":%.1f",
+               StageNames[stage], (unsigned long long)sum.items, seconds, seconds > 0 ? (double)sum.items / seconds : 0.0);
+        if (sum.pixels) {
+            printf(",\"megapixels_per_sec\":%.1f", seconds > 0 ? (double)sum.pixels / 1e6 / seconds : 0.0);
+        }
+        printf(",\"bytes\":%llu}\n", (unsigned long long)sum.bytes);
+    }
+    double seconds = (double)elapsed / 1e9;
+    printf("{\"stage\":\"total\",\"stereograms\":%zu,\"converted\":%zu,\"skipped\":%zu,\"failed\":%zu,"
+           "\"threads\":%u,\"stolen\":%zu,\"seconds\":%.3f,\"items_per_sec\":%.1f}\n",
+           converter->entries.count, converter->convertedCount, converter->skippedCount, converter->failedCount,
+           threadCount, stolen, seconds, seconds > 0 ? (double)converter->convertedCount / seconds : 0.0);
+}
+
+static void printUsage(const char *program) {
+    fprintf(stderr, "Usage: %s [-j threads] [-s side_by_side,swap,gif,thumbnail] [-q quality] [-p] [-l max_bytes] [-f] library-directory output-directory\n", program);
+}
+
+int main(int argc, char *argv[]) {
+    Converter converter = { .stages = OutputStages };
+    PWJPEGEncodeOptionsInit(&converter.jpegOptions);
+    unsigned threadCount = PWParallelThreadCount();
+    bool startAgain = false;
+    int option;
+    while ((option = getopt(argc, argv, "j:s:q:pl:fh")) != -1) {
+        switch (option) {
+            case 'j': threadCount = (unsigned)strtoul(optarg, NULL, 10); break;
+            case 'q': converter.jpegOptions.quality = (int)strtol(optarg, NULL, 10); break;
+            case 'p': converter.jpegOptions.progressive = true; break;
+            case 'l': converter.jpegOptions.targetLength = (size_t)strtoull(optarg, NULL, 10); break;
+            case 'f': startAgain = true; break;
+            case 's':
+                converter.stages = parseStages(optarg);
+                if (!converter.stages) {
+                    fprintf(stderr, "Unknown stage in \"%s\".\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                printUsage(argv[0]);
+                return option == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (argc - optind != 2 || threadCount < 1 || converter.jpegOptions.quality < 1 || converter.jpegOptions.quality > 100) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    converter.libraryPath = argv[optind];
+    converter.outputPath = argv[optind + 1];
+
+    char journalPath[PATH_MAX];
+    if (!makeDirectories(converter.outputPath) || !joinPath(journalPath, converter.outputPath, JournalFileName)) {
+        perror(converter.outputPath);
+        return EXIT_FAILURE;
+    }
+    PWError error = collectEntries(converter.libraryPath, "", &converter.entries);
+    if (error != PWError_None) {
+        fprintf(stderr, "%s: couldn't read the library (error %d)\n", converter.libraryPath, error);
+        return EXIT_FAILURE;
+    }
+    qsort(converter.entries.paths, converter.entries.count, sizeof(char *), comparePaths);
+    if (startAgain) {
+        unlink(journalPath);
+    } else if ((error = loadJournal(journalPath, &converter.converted)) != PWError_None) {
+        fprintf(stderr, "%s: couldn't read the journal (error %d)\n", journalPath, error);
+        return EXIT_FAILURE;
+    }
+    converter.journal = fopen(journalPath, "a");
+    converter.totals = calloc(threadCount, sizeof(*converter.totals));
+    if (!converter.journal || !converter.totals) {
+        perror(journalPath);
+        return EXIT_FAILURE;
+    }
+    pthread_mutex_init(&converter.journalLock, NULL);
+
+        // Each stereogram is converted on one thread, which keeps the cores busier than splitting each image, so
+        // the image kernels are kept to one thread each unless there is only one worker.
+    if (threadCount > 1) {
+        PWParallelSetThreadCount(1);
+    }
+    struct sigaction action = { .sa_handler = requestStop, .sa_flags = SA_RESETHAND };
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+
+    uint64_t start = now();
+    size_t stolen = PWWorkPoolRun(converter.entries.count, threadCount, &converter, convertStereogram);
+    printReport(&converter, threadCount, now() - start, stolen);
+    if (stopRequested) {
+        fprintf(stderr, "Interrupted. Run the same command again to carry on.\n");
+    }
+
+    fclose(converter.journal);
+    pthread_mutex_destroy(&converter.journalLock);
+    free(converter.totals);
+    freePaths(&converter.entries);
+    freePaths(&converter.converted);
+    return converter.failedCount == 0 && !stopRequested ? EXIT_SUCCESS : EXIT_FAILURE;
+}
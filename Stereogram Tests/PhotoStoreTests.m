@@ -145,6 +145,27 @@
 	}
 }
 
+	/// Photos from the camera are tagged with the rotation needed to show them. The saved stereogram should be upright and half size.
+-(void) testCreateStereogramFromRotatedPhotos {
+	NSError *error = nil;
+	PhotoStore *photoStore = [[PhotoStore alloc] initWithFolderURL:self.emptyDirURL error:&error];
+	XCTAssertNotNil(photoStore, @"Failed to create photo store with error %@", error);
+
+	UIImage *left  = [UIImage imageWithCGImage:self.leftImage.CGImage  scale:1.0 orientation:UIImageOrientationRight];
+	UIImage *right = [UIImage imageWithCGImage:self.rightImage.CGImage scale:1.0 orientation:UIImageOrientationRight];
+	Stereogram *stereogram = [photoStore createStereogramFromLeftImage:left rightImage:right error:&error];
+	XCTAssertNotNil(stereogram, @"createStereogram failed with error %@.", error);
+
+		// Rotating swaps the width and height of each photo; halving rounds up.
+	size_t photoWidth = (CGImageGetHeight(self.leftImage.CGImage) + 1) / 2, photoHeight = (CGImageGetWidth(self.leftImage.CGImage) + 1) / 2;
+	stereogram.viewingMethod = ViewingMethod_CrossEye;
+	UIImage *image = [stereogram stereogramImage:&error];
+	XCTAssertNotNil(image, @"Stereogram %@ failed to create stereogram image with error %@.", stereogram, error);
+	XCTAssertEqual(image.imageOrientation, UIImageOrientationUp, @"Stereogram image is not upright.");
+	XCTAssertEqual(CGImageGetWidth(image.CGImage), photoWidth * 2, @"Stereogram image has the wrong width.");
+	XCTAssertEqual(CGImageGetHeight(image.CGImage), photoHeight, @"Stereogram image has the wrong height.");
+}
+
 -(void) testRemoveOneStereogram {
 	NSError *error = nil;
 	PhotoStore *photoStore = [[PhotoStore alloc] initWithFolderURL:self.emptyDirURL error:&error];
@@ -9,6 +9,8 @@
 #import "StereogramTestCase.h"
 #import "Stereogram.h"
 #import "PhotoStore.h"
+#import "UIImage+PWImageBuffer.h"
+#import "PWTilePyramid.h"
 
 static NSString *sz(CGSize size) {
 	return [NSString stringWithFormat:@"(w:%0.2f, h:%0.2f)", size.width, size.height];
@@ -259,6 +261,18 @@ NSArray *map(NSArray *array, transformFn fn) {
 				   , @"Mime type for AnimatedGIF is %@ should be image/gif", mimeType);
 }
 
+-(void) testExportPresets {
+	Stereogram *stereogram = [self makeStereogram:self.emptyDirURL];
+	const PWExportPreset presets[] = { { 0, PWExportFormat_JPEG, 0 }, { PWExportPreviewSize, PWExportFormat_GIF, 0 } };
+	NSArray *mimeTypes = nil;
+	NSError *error = nil;
+	NSArray *allData = [stereogram exportDataForPresets:presets count:2 mimeTypes:&mimeTypes error:&error];
+	XCTAssertEqual(allData.count, 2, @"Stereogram %@ failed to export with error %@", stereogram, error);
+	XCTAssertEqualObjects(mimeTypes, (@[@"image/jpeg", @"image/gif"]), @"Mime types %@ don't match the presets", mimeTypes);
+	UIImage *preview = [UIImage imageWithData:allData.lastObject];
+	XCTAssertEqual(MAX(preview.size.width, preview.size.height), PWExportPreviewSize, @"Preview %@ is the wrong size", preview);
+}
+
 -(void) testStereogramImage {
 	CGSize const combinedSize = CGSizeMake(self.leftImage.size.width + self.rightImage.size.width, self.leftImage.size.height);
 	Stereogram *stereogram = [self makeStereogram:self.emptyDirURL];
@@ -272,6 +286,12 @@ NSArray *map(NSArray *array, transformFn fn) {
 				   , "Resultant image %@ size %@ should be %@", crossImage, sz(crossImage.size), sz(combinedSize));
 	XCTAssertNil(crossImage.images, @"Crosseyed image should not have animation frames.");
 
+		// Side-by-side images built from the JPEG files should stay in a compact format, smaller than a 32-bit bitmap.
+	NSUInteger fullBytes = (NSUInteger)(combinedSize.width * combinedSize.height * 4);
+	XCTAssertGreaterThan(crossImage.imageBufferByteCount, 0, @"Crosseyed image %@ was not built from the JPEG data.", crossImage);
+	XCTAssertLessThan(crossImage.imageBufferByteCount, fullBytes, @"Crosseyed image uses %lu bytes, no better than a 32-bit bitmap."
+					  , (unsigned long)crossImage.imageBufferByteCount);
+
 		// checkWalleyed
 	stereogram.viewingMethod = ViewingMethod_WallEye;
 	error = nil;
@@ -290,6 +310,170 @@ NSArray *map(NSArray *array, transformFn fn) {
 	XCTAssertNotNil(gifImage.images, "Animated image has no animation frames.");
 	XCTAssertEqual(gifImage.images.count, 2
 				   , @"Animated image has %lu animation frames, should be 2", (unsigned long)gifImage.images.count);
+
+		// checkAnaglyphs: one photo wide, and no bigger in memory than half a 32-bit side-by-side image.
+	for (ViewingMethod method = ViewingMethod_Anaglyph; method <= ViewingMethod_AnaglyphOptimised; method++) {
+		stereogram.viewingMethod = method;
+		error = nil;
+		UIImage *anaglyphImage = [stereogram stereogramImage:&error];
+		XCTAssertNotNil(anaglyphImage, @"Stereogram %@ failed to create anaglyph %d with error %@.", stereogram, method, error);
+		XCTAssert(CGSizeEqualToSize(anaglyphImage.size, self.leftImage.size)
+				  , "Anaglyph %@ size %@ should be %@", anaglyphImage, sz(anaglyphImage.size), sz(self.leftImage.size));
+		XCTAssertNil(anaglyphImage.images, @"Anaglyph should not have animation frames.");
+		XCTAssertGreaterThan(anaglyphImage.imageBufferByteCount, 0, @"Anaglyph %@ was not built by the image core.", anaglyphImage);
+		XCTAssertLessThanOrEqual(anaglyphImage.imageBufferByteCount, fullBytes / 2, @"Anaglyph uses %lu bytes."
+								 , (unsigned long)anaglyphImage.imageBufferByteCount);
+	}
+}
+
+-(void)testCropRect {
+	Stereogram *stereogram = [self makeStereogram:self.emptyDirURL];
+	XCTAssert(CGRectIsNull(stereogram.cropRect), @"New stereogram should not be cropped, but has crop %@", NSStringFromCGRect(stereogram.cropRect));
+
+	CGRect const cropRect = CGRectMake(10, 20, 100, 60);
+	NSDate *modified = nil;
+	NSURL *leftURL = [stereogram.baseURL URLByAppendingPathComponent:@"LeftPhoto.jpg"];
+	[leftURL getResourceValue:&modified forKey:NSURLContentModificationDateKey error:nil];
+	stereogram.cropRect = cropRect;
+
+	NSError *error = nil;
+	UIImage *crossImage = [stereogram stereogramImage:&error];
+	XCTAssertNotNil(crossImage, @"Stereogram %@ failed to create a cropped image with error %@.", stereogram, error);
+	XCTAssert(CGSizeEqualToSize(crossImage.size, CGSizeMake(cropRect.size.width * 2, cropRect.size.height))
+			  , @"Cropped image %@ size %@ should be two crops side by side", crossImage, sz(crossImage.size));
+	stereogram.viewingMethod = ViewingMethod_AnaglyphOptimised;
+	UIImage *anaglyphImage = [stereogram stereogramImage:&error];
+	XCTAssert(CGSizeEqualToSize(anaglyphImage.size, cropRect.size), @"Cropped anaglyph %@ size %@ should match the crop", anaglyphImage, sz(anaglyphImage.size));
+
+		// The crop is only metadata: the photos are untouched, and it survives a reload.
+	NSDate *modifiedAfter = nil;
+	[leftURL getResourceValue:&modifiedAfter forKey:NSURLContentModificationDateKey error:nil];
+	XCTAssertEqualObjects(modified, modifiedAfter, @"Cropping rewrote the photo file.");
+	Stereogram *reloaded = [Stereogram stereogramWithURL:stereogram.baseURL error:&error];
+	XCTAssertNotNil(reloaded, @"Stereogram at %@ couldn't be reloaded: %@", stereogram.baseURL, error);
+	XCTAssert(CGRectEqualToRect(reloaded.cropRect, cropRect), @"Reloaded crop %@ should be %@"
+			  , NSStringFromCGRect(reloaded.cropRect), NSStringFromCGRect(cropRect));
+
+	stereogram.cropRect = CGRectNull;
+	XCTAssert(CGRectIsNull(stereogram.cropRect), @"Crop could not be removed.");
+}
+
+-(void)testDisparityOffset {
+	Stereogram *stereogram = [self makeStereogram:self.emptyDirURL];
+	XCTAssertEqual(stereogram.disparityOffset, 0, @"New stereogram should not be shifted, but has offset %ld", (long)stereogram.disparityOffset);
+
+	NSError *error = nil;
+	CGSize photoSize = stereogram.photoSize;
+	stereogram.disparityOffset = 9;
+	XCTAssertEqual(stereogram.disparityOffset, 8, @"Offset should be rounded to even, but is %ld", (long)stereogram.disparityOffset);
+	UIImage *crossImage = [stereogram stereogramImage:&error];
+	XCTAssert(CGSizeEqualToSize(crossImage.size, CGSizeMake((photoSize.width - 8) * 2, photoSize.height))
+			  , @"Shifted image %@ size %@ should be two photos each 8 pixels narrower", crossImage, sz(crossImage.size));
+
+		// The preview is made from cached photos, and doesn't change the stored offset.
+	UIImage *preview = [stereogram disparityPreviewImageWithOffset:-20 maximumSize:CGSizeMake(200, 200) error:&error];
+	XCTAssertNotNil(preview, @"Stereogram %@ failed to create a disparity preview with error %@.", stereogram, error);
+	XCTAssert(preview.size.width <= 200 && preview.size.height <= 200, @"Preview size %@ is larger than asked for", sz(preview.size));
+	[stereogram disparityPreviewImageWithOffset:20 maximumSize:CGSizeMake(200, 200) error:&error];
+	ImageCacheStatistics statistics = stereogram.cacheStatistics;
+	XCTAssertEqual(statistics.hits[ImageCacheTier_Preview], 1, @"Second preview should reuse the cached photos.");
+	XCTAssertEqual(stereogram.disparityOffset, 8, @"Previewing changed the stored offset.");
+	[stereogram discardDisparityPreview];
+	statistics = stereogram.cacheStatistics;
+	XCTAssertEqual(statistics.liveBytes[ImageCacheTier_Preview], 0, @"Preview photos were not released.");
+
+	Stereogram *reloaded = [Stereogram stereogramWithURL:stereogram.baseURL error:&error];
+	XCTAssertEqual(reloaded.disparityOffset, 8, @"Reloaded offset should be 8, but is %ld", (long)reloaded.disparityOffset);
+}
+
+-(void)testAlignment {
+	Stereogram *stereogram = [self makeStereogram:self.emptyDirURL];
+	NSError *error = nil;
+	CGSize photoSize = stereogram.photoSize;
+
+		// A vertical offset alone leaves rows out of both photos, so the image is shorter by that much.
+	stereogram.alignment = (PWAlignment) { .verticalOffset = 6.0, .rotation = 0.0 };
+	UIImage *crossImage = [stereogram stereogramImage:&error];
+	XCTAssert(CGSizeEqualToSize(crossImage.size, CGSizeMake(photoSize.width * 2, photoSize.height - 6))
+			  , @"Aligned image %@ size %@ should be two photos each 6 pixels shorter", crossImage, sz(crossImage.size));
+
+	Stereogram *reloaded = [Stereogram stereogramWithURL:stereogram.baseURL error:&error];
+	XCTAssertNotNil(reloaded, @"Stereogram at %@ couldn't be reloaded: %@", stereogram.baseURL, error);
+	XCTAssertEqual(reloaded.alignment.verticalOffset, 6.0, @"Reloaded offset should be 6, but is %f", reloaded.alignment.verticalOffset);
+
+		// The alignment measured at capture includes a rotation, which must come back exactly as saved.
+	PWAlignment const measured = { .verticalOffset = -3.25, .rotation = 0.0125 };
+	stereogram.alignment = measured;
+	reloaded = [Stereogram stereogramWithURL:stereogram.baseURL error:&error];
+	XCTAssertEqual(reloaded.alignment.verticalOffset, measured.verticalOffset
+				   , @"Reloaded offset should be %f, but is %f", measured.verticalOffset, reloaded.alignment.verticalOffset);
+	XCTAssertEqual(reloaded.alignment.rotation, measured.rotation
+				   , @"Reloaded rotation should be %f, but is %f", measured.rotation, reloaded.alignment.rotation);
+
+	stereogram.alignment = (PWAlignment) { .verticalOffset = 0.0, .rotation = 0.0 };
+	crossImage = [stereogram stereogramImage:&error];
+	XCTAssert(CGSizeEqualToSize(crossImage.size, CGSizeMake(photoSize.width * 2, photoSize.height))
+			  , @"Image %@ size %@ should be back to full size once the alignment is cleared", crossImage, sz(crossImage.size));
+}
+
+-(void)testPerceptualHashSurvivesReload {
+	Stereogram *stereogram = [self makeStereogram:self.emptyDirURL];
+	NSError *error = nil;
+		// A value no photo would hash to, so a hash worked out again from the photos would show up.
+	uint64_t const storedHash = 0x0123456789abcdefULL;
+	stereogram.perceptualHash = storedHash;
+
+	Stereogram *reloaded = [Stereogram stereogramWithURL:stereogram.baseURL error:&error];
+	XCTAssertNotNil(reloaded, @"Stereogram at %@ couldn't be reloaded: %@", stereogram.baseURL, error);
+	XCTAssert(reloaded.hasPerceptualHash, @"Reloaded stereogram %@ lost its perceptual hash", reloaded);
+	XCTAssertEqual(reloaded.perceptualHash, storedHash, @"Reloaded hash %016llx should be %016llx"
+				   , (unsigned long long)reloaded.perceptualHash, (unsigned long long)storedHash);
+}
+
+-(void)testInitStoresAlignmentAndHash {
+	NSError *error = nil;
+	PWAlignment const measured = { .verticalOffset = -3.25, .rotation = 0.0125 };
+	uint64_t const storedHash = 0x0123456789abcdefULL;
+	Stereogram *stereogram = [Stereogram stereogramWithDirectoryURL:self.emptyDirURL
+														  leftImage:self.leftImage
+														 rightImage:self.rightImage
+														  alignment:measured
+													 perceptualHash:@(storedHash)
+															  error:&error];
+	XCTAssertNotNil(stereogram, @"Stereogram initializer failed with error %@", error);
+
+		// Both are in the properties file written when the stereogram was made.
+	Stereogram *reloaded = [Stereogram stereogramWithURL:stereogram.baseURL error:&error];
+	XCTAssertNotNil(reloaded, @"Stereogram at %@ couldn't be reloaded: %@", stereogram.baseURL, error);
+	XCTAssertEqual(reloaded.alignment.verticalOffset, measured.verticalOffset
+				   , @"Reloaded offset should be %f, but is %f", measured.verticalOffset, reloaded.alignment.verticalOffset);
+	XCTAssertEqual(reloaded.alignment.rotation, measured.rotation
+				   , @"Reloaded rotation should be %f, but is %f", measured.rotation, reloaded.alignment.rotation);
+	XCTAssertEqual(reloaded.perceptualHash, storedHash, @"Reloaded hash %016llx should be %016llx"
+				   , (unsigned long long)reloaded.perceptualHash, (unsigned long long)storedHash);
+
+	Stereogram *plain = [self makeStereogram:self.emptyDirURL];
+	XCTAssertFalse(plain.hasPerceptualHash, @"A stereogram made without a hash shouldn't have one");
+	XCTAssertEqual(plain.alignment.verticalOffset, 0.0, @"A stereogram made without an alignment shouldn't have one");
+}
+
+-(void)testMPORoundTrip {
+	Stereogram *stereogram = [self makeStereogram:self.emptyDirURL];
+	NSError *error = nil;
+	NSData *mpoData = [stereogram MPOData:&error];
+	XCTAssertNotNil(mpoData, @"Stereogram %@ failed to export an MPO file with error %@", stereogram, error);
+
+	Stereogram *imported = [Stereogram stereogramWithDirectoryURL:self.emptyDirURL MPOData:mpoData error:&error];
+	XCTAssertNotNil(imported, @"Failed to import the MPO file with error %@", error);
+	XCTAssert(CGSizeEqualToSize(imported.photoSize, stereogram.photoSize)
+			  , @"Imported photo size %@ should match the original %@", sz(imported.photoSize), sz(stereogram.photoSize));
+	XCTAssertNotNil([imported stereogramImage:&error], @"Imported stereogram %@ couldn't make an image: %@", imported, error);
+
+		// A plain JPEG file is not an MPO file, and nothing should be left behind.
+	NSUInteger count = [Stereogram allStereogramsUnderURL:self.emptyDirURL error:&error].count;
+	NSData *jpegData = UIImageJPEGRepresentation([UIImage imageWithData:mpoData], 1.0);
+	XCTAssertNil([Stereogram stereogramWithDirectoryURL:self.emptyDirURL MPOData:jpegData error:&error], @"A JPEG file was imported as an MPO file");
+	XCTAssertEqual([Stereogram allStereogramsUnderURL:self.emptyDirURL error:&error].count, count, @"A failed import left a stereogram behind");
 }
 
 -(void)testThumbnailImage {
@@ -297,7 +481,82 @@ NSArray *map(NSArray *array, transformFn fn) {
 }
 
 -(void)testImageCaching {
-		//		XCTFail("Test not implemented.")
+	Stereogram *stereogram = [self makeStereogram:self.emptyDirURL];
+	ImageCacheStatistics statistics = stereogram.cacheStatistics;
+	XCTAssertEqual(ImageCacheStatisticsTotalLiveBytes(&statistics), 0, @"New stereogram should not have any cached images.");
+
+		// First request builds the image, the second should come from the cache.
+	NSError *error = nil;
+	UIImage *first = [stereogram stereogramImage:&error], *second = [stereogram stereogramImage:&error];
+	XCTAssertNotNil(first, @"Stereogram %@ failed to create stereogram image with error %@.", stereogram, error);
+	XCTAssertEqual(first, second, @"Second request for the stereogram image did not return the cached image.");
+	statistics = stereogram.cacheStatistics;
+	XCTAssertEqual(statistics.misses[ImageCacheTier_Stereogram], 1, @"Expected 1 miss, got %lu", (unsigned long)statistics.misses[ImageCacheTier_Stereogram]);
+	XCTAssertEqual(statistics.hits[ImageCacheTier_Stereogram], 1, @"Expected 1 hit, got %lu", (unsigned long)statistics.hits[ImageCacheTier_Stereogram]);
+	XCTAssertEqual(statistics.regenerations[ImageCacheTier_Stereogram], 0, @"Nothing should have been regenerated yet.");
+	XCTAssertGreaterThan(statistics.liveBytes[ImageCacheTier_Stereogram], 0, @"Cached stereogram image is not being counted.");
+	XCTAssertEqual(statistics.peakBytes, ImageCacheStatisticsTotalLiveBytes(&statistics), @"Peak should match the current total.");
+
+		// Changing the viewing method keeps the old image for the old method; the request for the new one is a regeneration.
+	NSUInteger peak = statistics.peakBytes, firstBytes = statistics.liveBytes[ImageCacheTier_Stereogram];
+	stereogram.viewingMethod = ViewingMethod_WallEye;
+	statistics = stereogram.cacheStatistics;
+	XCTAssertEqual(statistics.liveBytes[ImageCacheTier_Stereogram], 0, @"Changing the viewing method should empty the stereogram cache.");
+	XCTAssertEqual(statistics.liveBytes[ImageCacheTier_OtherMethods], firstBytes, @"The old image should be kept for the old method.");
+	XCTAssertEqual(statistics.peakBytes, peak, @"Peak should not rise when an image moves between caches.");
+	XCTAssertTrue([stereogram hasCachedImageForViewingMethod:ViewingMethod_CrossEye], @"The old method's image was not kept.");
+
+	XCTAssertNotNil([stereogram stereogramImage:&error], @"Failed to regenerate the stereogram image: %@", error);
+	statistics = stereogram.cacheStatistics;
+	XCTAssertEqual(statistics.misses[ImageCacheTier_Stereogram], 2, @"Expected 2 misses, got %lu", (unsigned long)statistics.misses[ImageCacheTier_Stereogram]);
+	XCTAssertEqual(statistics.regenerations[ImageCacheTier_Stereogram], 1, @"Expected 1 regeneration, got %lu", (unsigned long)statistics.regenerations[ImageCacheTier_Stereogram]);
+
+		// Changing back, or to a method built ahead of time, uses the cached image.
+	stereogram.viewingMethod = ViewingMethod_CrossEye;
+	XCTAssertEqual([stereogram stereogramImage:&error], first, @"Changing back did not reuse the old image.");
+	XCTAssertTrue([stereogram cacheImageForViewingMethod:ViewingMethod_AnaglyphOptimised error:&error], @"Failed to build the anaglyph ahead of time: %@", error);
+	XCTAssertTrue([stereogram hasCachedImageForViewingMethod:ViewingMethod_AnaglyphOptimised], @"The anaglyph built ahead of time was not kept.");
+	stereogram.viewingMethod = ViewingMethod_AnaglyphOptimised;
+	XCTAssertNotNil([stereogram stereogramImage:&error], @"Failed to get the anaglyph: %@", error);
+	statistics = stereogram.cacheStatistics;
+	XCTAssertEqual(statistics.misses[ImageCacheTier_Stereogram], 2, @"Images built ahead of time should not miss, got %lu misses", (unsigned long)statistics.misses[ImageCacheTier_Stereogram]);
+
+		// Anything the images depend on throws them all away.
+	stereogram.disparityOffset = 10;
+	XCTAssertFalse([stereogram hasCachedImageForViewingMethod:ViewingMethod_CrossEye], @"Images for other methods were kept after the offset changed.");
+	XCTAssertNotNil([stereogram stereogramImage:&error], @"Failed to regenerate the stereogram image: %@", error);
+	XCTAssertTrue([stereogram cacheImageForViewingMethod:ViewingMethod_WallEye error:&error], @"Failed to build the wall-eyed image ahead of time: %@", error);
+	statistics = stereogram.cacheStatistics;
+
+		// A memory warning should release everything and record the eviction.
+	NSUInteger liveBytes = statistics.liveBytes[ImageCacheTier_Stereogram];
+	[[NSNotificationCenter defaultCenter] postNotificationName:UIApplicationDidReceiveMemoryWarningNotification object:nil];
+	statistics = stereogram.cacheStatistics;
+	XCTAssertEqual(ImageCacheStatisticsTotalLiveBytes(&statistics), 0, @"Memory warning did not empty the caches.");
+	XCTAssertEqual(statistics.evictions[ImageCacheTier_Stereogram], 1, @"Expected 1 eviction, got %lu", (unsigned long)statistics.evictions[ImageCacheTier_Stereogram]);
+	XCTAssertEqual(statistics.evictedBytes[ImageCacheTier_Stereogram], liveBytes, @"Evicted bytes don't match what was cached.");
+	XCTAssertEqual(statistics.evictions[ImageCacheTier_OtherMethods], 1, @"Expected 1 eviction of other methods, got %lu", (unsigned long)statistics.evictions[ImageCacheTier_OtherMethods]);
+}
+
+-(void)testTilePyramid {
+	Stereogram *stereogram = [self makeStereogram:self.emptyDirURL];
+	stereogram.viewingMethod = ViewingMethod_CrossEye;
+	XCTAssertFalse(stereogram.hasTilePyramid, @"New stereogram %@ should not have any tiles.", stereogram);
+
+	NSError *error = nil;
+	NSURL *pyramidURL = [stereogram tilePyramidURL:&error];
+	XCTAssertNotNil(pyramidURL, @"Stereogram %@ failed to create tiles with error %@.", stereogram, error);
+	XCTAssertTrue(stereogram.hasTilePyramid, @"Stereogram %@ does not report the tiles it just built.", stereogram);
+	NSURL *manifestURL = [pyramidURL URLByAppendingPathComponent:@(PWTilePyramidManifestFileName)];
+	XCTAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:manifestURL.path], @"No pyramid manifest at %@", manifestURL);
+
+		// The tiles show the old image, so changing the viewing method must throw them away.
+	stereogram.viewingMethod = ViewingMethod_WallEye;
+	XCTAssertFalse(stereogram.hasTilePyramid, @"Tiles were kept after the viewing method changed.");
+	XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:manifestURL.path], @"Old pyramid was not deleted from disk.");
+
+	stereogram.viewingMethod = ViewingMethod_AnimatedGIF;
+	XCTAssertNil([stereogram tilePyramidURL:&error], @"Animated stereograms should not have tiles.");
 }
 
 @end
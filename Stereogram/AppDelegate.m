@@ -131,6 +131,39 @@ didFinishLaunchingWithOptions: (NSDictionary *)launchOptions {
 }
 
 
+    /// Called when the user opens an MPO file, or a side-by-side JPEG, in this app from another one, e.g. Mail or Files.
+    /// The system has already copied it into our Inbox folder, which we should tidy up once it has been read.
+-(BOOL) application: (UIApplication *)application
+            openURL: (NSURL *)url
+            options: (NSDictionary<UIApplicationOpenURLOptionsKey, id> *)options {
+    if (!_photoStore || !url.isFileURL) {
+        return NO;
+    }
+    NSError *error = nil;
+    NSString *extension = url.pathExtension.lowercaseString;
+    BOOL isJPEG = [extension isEqualToString:@"jpg"] || [extension isEqualToString:@"jpeg"];
+    Stereogram *stereogram = nil;
+    if (isJPEG) {
+            // Side-by-side images shared online are nearly always cross-eyed, as this app makes them.
+        stereogram = [_photoStore importSideBySideJPEGsFromURLs:@[url] crossEyed:YES error:&error].firstObject;
+    } else {
+        stereogram = [_photoStore importStereogramFromMPOURL:url error:&error];
+    }
+    [[NSFileManager defaultManager] removeItemAtURL:url error:nil];
+
+    UINavigationController *navigationController = (UINavigationController *)self.window.rootViewController;
+    PhotoViewController *photoViewController = (PhotoViewController *)navigationController.viewControllers.firstObject;
+    [navigationController popToRootViewControllerAnimated:NO];
+    if (!stereogram) {
+        [error showAlertWithTitle:isJPEG ? @"Error opening the JPEG file" : @"Error opening the MPO file"
+             parentViewController:photoViewController];
+        return NO;
+    }
+    [photoViewController showImportedStereogram:stereogram];
+    return YES;
+}
+
+
 - (void)applicationWillResignActive:(UIApplication *)application {
     // Sent when the application is about to move from active to inactive state. This can occur for certain types of temporary interruptions (such as an incoming phone call or SMS message) or when the user quits the application and it begins the transition to the background state.
     // Use this method to pause ongoing tasks, disable timers, and throttle down OpenGL ES frame rates. Games should use this method to pause the game.
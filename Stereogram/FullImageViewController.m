@@ -12,6 +12,7 @@
 #import "Stereogram.h"
 #import "PWAlertView.h"
 #import "PWActionSheet.h"
+#import "TiledImageView.h"
 
 @interface FullImageViewController () {
     Stereogram *_stereogram;
@@ -19,6 +20,12 @@
     id _userInfo;
     UIBarButtonItem __weak *_selectViewModeButtonItem;
     PWAlertView *_alertView;
+        /// Shows the stereogram from its tile pyramid, replacing imageView once the pyramid exists. nil until then.
+    TiledImageView *_tiledImageView;
+        /// Moves the right photo relative to the left one. See Stereogram.disparityOffset.
+    UISlider *_disparitySlider;
+        /// YES once the stereogram has cached the photos for its disparity previews, so the slider can redraw on the main thread.
+    BOOL _disparityPreviewReady;
 }
 @property (nonatomic, weak) IBOutlet UIImageView *imageView;
 @property (nonatomic, weak) IBOutlet UIScrollView *scrollView;
@@ -83,6 +90,14 @@
         } else {
             self.navigationItem.rightBarButtonItem = selectViewMethodButtonItem;
         }
+
+        _disparitySlider = [[UISlider alloc] initWithFrame:CGRectMake(0, 0, 240, 31)];
+        _disparitySlider.continuous = YES;
+        [_disparitySlider addTarget:self action:@selector(disparitySliderTouched:)  forControlEvents:UIControlEventTouchDown];
+        [_disparitySlider addTarget:self action:@selector(disparitySliderChanged:)  forControlEvents:UIControlEventValueChanged];
+        [_disparitySlider addTarget:self action:@selector(disparitySliderReleased:) forControlEvents:UIControlEventTouchUpInside | UIControlEventTouchUpOutside | UIControlEventTouchCancel];
+        UIBarButtonItem *space = [[UIBarButtonItem alloc] initWithBarButtonSystemItem:UIBarButtonSystemItemFlexibleSpace target:nil action:nil];
+        self.toolbarItems = @[space, [[UIBarButtonItem alloc] initWithCustomView:_disparitySlider], space];
     }
     return self;
 }
@@ -91,14 +106,21 @@
 
 - (void) viewDidLoad {
     [super viewDidLoad];
-        // Calculate the size of the underlying image, and then use that to set the scrollview's bounds.
-    NSError *error = nil;
-    UIImage *fullImage = [_stereogram stereogramImage:&error];
-    if (!fullImage) {
-        NSLog(@"viewDidLoad: Failed to load image from stereogram %@", _stereogram);
-    }
-    self.imageView.image = fullImage;
-    [self.imageView sizeToFit];
+    [self displayStereogram];
+    [self setupDisparitySlider];
+}
+
+-(void) viewWillAppear: (BOOL)animated {
+    [super viewWillAppear:animated];
+    [self.navigationController setToolbarHidden:NO animated:animated];
+}
+
+-(void) viewWillDisappear: (BOOL)animated {
+    [super viewWillDisappear:animated];
+    [self.navigationController setToolbarHidden:YES animated:animated];
+        // The preview photos are only worth keeping while the slider is on screen.
+    [_stereogram discardDisparityPreview];
+    _disparityPreviewReady = NO;
 }
 
 -(void) viewDidLayoutSubviews {
@@ -139,6 +161,27 @@
                                                  }];
     [_alertView addAction:wallEyedAction];
     
+    PWAction *anaglyphAction = [PWAction actionWithTitle: @"Red/cyan glasses"
+                                                   style: UIAlertActionStyleDefault
+                                                 handler: ^(PWAction *action) {
+                                                     [self changeViewingMethod:ViewingMethod_AnaglyphOptimised];
+                                                 }];
+    [_alertView addAction:anaglyphAction];
+    
+    PWAction *colourAnaglyphAction = [PWAction actionWithTitle: @"Red/cyan glasses (full colour)"
+                                                         style: UIAlertActionStyleDefault
+                                                       handler: ^(PWAction *action) {
+                                                           [self changeViewingMethod:ViewingMethod_Anaglyph];
+                                                       }];
+    [_alertView addAction:colourAnaglyphAction];
+    
+    PWAction *halfColourAnaglyphAction = [PWAction actionWithTitle: @"Red/cyan glasses (half colour)"
+                                                             style: UIAlertActionStyleDefault
+                                                           handler: ^(PWAction *action) {
+                                                               [self changeViewingMethod:ViewingMethod_AnaglyphHalfColour];
+                                                           }];
+    [_alertView addAction:halfColourAnaglyphAction];
+    
     _alertView.popoverPresentationItem = _selectViewModeButtonItem;
     [_alertView show];
 }
@@ -146,22 +189,20 @@
 
 -(void) changeViewingMethod: (ViewingMethod)viewingMethod {
     
-    self.showActivityIndicator = YES;
+        // The photo store builds images for the other methods while the app is idle, so there may be nothing to wait for.
+    self.showActivityIndicator = ![_stereogram hasCachedImageForViewingMethod:viewingMethod];
     dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
         
         _stereogram.viewingMethod = viewingMethod;
         
-             // Reload the image while we are in the background thread.
+             // Load the image while we are in the background thread. This is a cache hit if it was built ahead of time.
         NSError *error = nil;
-        if ([_stereogram refresh:&error]) {
+        if ([_stereogram stereogramImage:&error]) {
             dispatch_async(dispatch_get_main_queue(), ^{
                 
                     // Clear the activity indicator and update the image in this view.
                 self.showActivityIndicator = NO;
-                UIImage *fullImage = [_stereogram stereogramImage:nil];
-                NSAssert(fullImage, @"Stereogram %@ image was not properly cached.", _stereogram);
-                self.imageView.image = fullImage;
-                [self setupScrollviewAnimated:YES];
+                [self displayStereogram];
                     // Notify the system that the image has been changed in the view.
                 if ([self.delegate respondsToSelector:@selector(fullImageViewController:amendedStereogram:atIndexPath:)]) {
                     [self.delegate fullImageViewController:self
@@ -182,6 +223,114 @@
     });
 }
 
+#pragma mark Disparity slider
+
+    /// The slider moves the right photo by up to this fraction of the photo width either way.
+static const CGFloat MaximumDisparityFraction = 0.1;
+
+    /// Set the slider's range from the size of the photos, which means reading the photo file, so do it in the background.
+-(void) setupDisparitySlider {
+    _disparitySlider.enabled = NO;
+    Stereogram *stereogram = _stereogram;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        CGFloat limit = floor(stereogram.photoSize.width * MaximumDisparityFraction);
+        dispatch_async(dispatch_get_main_queue(), ^{
+            _disparitySlider.minimumValue = -limit;
+            _disparitySlider.maximumValue = limit;
+            _disparitySlider.value = stereogram.disparityOffset;
+            _disparitySlider.enabled = limit >= 2;
+        });
+    });
+}
+
+    /// The largest preview worth making: the scroll view's size in pixels.
+-(CGSize) disparityPreviewSize {
+    CGFloat scale = self.view.window.screen.scale ?: [UIScreen mainScreen].scale;
+    CGSize viewSize = self.scrollView.bounds.size;
+    return CGSizeMake(viewSize.width * scale, viewSize.height * scale);
+}
+
+    /// Cache the preview photos when the user first touches the slider, in the background as this decodes both photos.
+-(void) disparitySliderTouched: (UISlider *)slider {
+    if (_disparityPreviewReady) {
+        return;
+    }
+    Stereogram *stereogram = _stereogram;
+    CGSize previewSize = self.disparityPreviewSize;
+    FullImageViewController __weak *weakSelf = self;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_USER_INITIATED, 0), ^{
+        NSError *error = nil;
+        UIImage *previewImage = [stereogram disparityPreviewImageWithOffset:stereogram.disparityOffset maximumSize:previewSize error:&error];
+        if (!previewImage) {
+            NSLog(@"Failed to make disparity preview for stereogram %@: %@", stereogram, error);
+            return;
+        }
+        dispatch_async(dispatch_get_main_queue(), ^{
+            FullImageViewController *strongSelf = weakSelf;
+            if (strongSelf) {
+                strongSelf->_disparityPreviewReady = YES;
+                [strongSelf disparitySliderChanged:strongSelf->_disparitySlider];
+            }
+        });
+    });
+}
+
+    /// Redraw from the cached preview photos. This only copies a screenful of pixels, so it keeps up with the slider.
+-(void) disparitySliderChanged: (UISlider *)slider {
+    if (!_disparityPreviewReady) {
+        return;
+    }
+        // If low memory threw the photos away, making them again would decode both on the main thread mid-drag.
+        // Build them in the background as on the first touch, which redraws once they are ready.
+    if (!_stereogram.hasDisparityPreview) {
+        _disparityPreviewReady = NO;
+        [self disparitySliderTouched:slider];
+        return;
+    }
+    NSError *error = nil;
+    UIImage *previewImage = [_stereogram disparityPreviewImageWithOffset:(NSInteger)lround(slider.value)
+                                                            maximumSize:self.disparityPreviewSize
+                                                                  error:&error];
+    if (!previewImage) {
+        NSLog(@"Failed to update disparity preview for stereogram %@: %@", _stereogram, error);
+        return;
+    }
+    [self removeTiledImageView];
+    self.imageView.image = previewImage;
+    [self.imageView sizeToFit];
+    [self setupScrollviewAnimated:NO];
+}
+
+    /// Store the new offset, then build the full-size image for it in the background as changeViewingMethod: does.
+-(void) disparitySliderReleased: (UISlider *)slider {
+    NSInteger disparityOffset = (NSInteger)lround(slider.value);
+    if (disparityOffset / 2 * 2 == _stereogram.disparityOffset) {
+        [self displayStereogram];
+        return;
+    }
+    self.showActivityIndicator = YES;
+    Stereogram *stereogram = _stereogram;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        stereogram.disparityOffset = disparityOffset;
+        NSError *error = nil;
+        UIImage *stereogramImage = [stereogram stereogramImage:&error];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            self.showActivityIndicator = NO;
+            if (!stereogramImage) {
+                [error showAlertWithTitle:@"Error changing the depth"
+                     parentViewController:self];
+                return;
+            }
+            [self displayStereogram];
+            if ([self.delegate respondsToSelector:@selector(fullImageViewController:amendedStereogram:userInfo:)]) {
+                [self.delegate fullImageViewController:self
+                                     amendedStereogram:stereogram
+                                              userInfo:_userInfo];
+            }
+        });
+    });
+}
+
 -(void) keepPhoto {
     id<FullImageViewControllerDelegate> delegate = self.delegate;
     NSAssert(delegate, @"No delegate assigned to view controller %@", self);
@@ -245,16 +394,197 @@
 #pragma mark - Scrollview delegate
 
 -(UIView *) viewForZoomingInScrollView: (UIScrollView *)scrollView {
-    return self.imageView;
+    return self.zoomingView;
 }
 
 
 #pragma mark - Private methods
 
+    /// The view showing the stereogram: the tiled view if we have one, otherwise the image view.
+-(UIView *) zoomingView {
+    return _tiledImageView ? _tiledImageView : self.imageView;
+}
+
+/*!
+ * Show the stereogram in its current viewing method.
+ *
+ * If the stereogram has a tile pyramid, it is shown through a TiledImageView, which only loads the tiles on screen.
+ * Otherwise the full image is shown in imageView while the pyramid is built in the background, and the view switches over once it's ready.
+ * If the full image isn't cached either, a quick preview is stretched to its size until it has been built.
+ */
+-(void) displayStereogram {
+    [self removeTiledImageView];
+    if (_stereogram.hasTilePyramid && [self showTilePyramid:[_stereogram tilePyramidURL:nil] keepingZoom:NO]) {
+        return;
+    }
+    if (![_stereogram hasCachedImageForViewingMethod:_stereogram.viewingMethod] && [self displayQuickPreview]) {
+        return;
+    }
+
+    NSError *error = nil;
+    UIImage *fullImage = [_stereogram stereogramImage:&error];
+    if (!fullImage) {
+        NSLog(@"displayStereogram: Failed to load image from stereogram %@: %@", _stereogram, error);
+    }
+    self.imageView.image = fullImage;
+    [self.imageView sizeToFit];
+    [self setupScrollviewAnimated:NO];
+    [self buildTilePyramid];
+}
+
+/*!
+ * Show the stereogram's quick preview stretched to the size of the full image, then build the full image in the background
+ * and swap it in, keeping whatever zoom and scroll position the user has chosen by then.
+ *
+ * The preview comes from the photos' thumbnails or a reduced decode, so the first pixels appear in the same time however big
+ * the photos are. Returns NO, leaving the view alone, if the stereogram can't make one.
+ */
+-(BOOL) displayQuickPreview {
+    CGSize fullSize = CGSizeZero;
+    NSError *error = nil;
+    UIImage *previewImage = [_stereogram quickPreviewImageWithFullSize:&fullSize error:&error];
+    if (!previewImage || fullSize.width <= 0 || fullSize.height <= 0) {
+        NSLog(@"No quick preview for stereogram %@: %@", _stereogram, error);
+        return NO;
+    }
+    self.imageView.contentMode = UIViewContentModeScaleToFill;
+    self.imageView.image = previewImage;
+    self.imageView.bounds = CGRectMake(0, 0, fullSize.width, fullSize.height);
+    [self setupScrollviewAnimated:NO];
+
+    Stereogram *stereogram = _stereogram;
+    ViewingMethod viewingMethod = stereogram.viewingMethod;
+    FullImageViewController __weak *weakSelf = self;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
+        NSError *error = nil;
+        UIImage *fullImage = [stereogram stereogramImage:&error];
+        dispatch_async(dispatch_get_main_queue(), ^{
+                // Leave the view alone if the user has changed the viewing method, moved the slider or left the view meanwhile.
+            FullImageViewController *strongSelf = weakSelf;
+            if (!strongSelf || strongSelf->_tiledImageView || strongSelf.imageView.image != previewImage
+                || stereogram.viewingMethod != viewingMethod) {
+                return;
+            }
+            if (!fullImage) {
+                NSLog(@"displayQuickPreview: Failed to load image from stereogram %@: %@", stereogram, error);
+                return;
+            }
+            [strongSelf replacePreviewWithImage:fullImage];
+            [strongSelf buildTilePyramid];
+        });
+    });
+    return YES;
+}
+
+    /// Put FULLIMAGE in place of the stretched preview, keeping the zoom scale and scroll position.
+-(void) replacePreviewWithImage: (UIImage *)fullImage {
+    UIScrollView *scrollView = self.scrollView;
+    CGFloat zoomScale = scrollView.zoomScale;
+    CGPoint contentOffset = scrollView.contentOffset;
+    self.imageView.image = fullImage;
+    if (CGSizeEqualToSize(self.imageView.bounds.size, fullImage.size)) {
+        return;
+    }
+        // The preview's size was worked out from the small photos, so it may be a pixel or two out. Resize without jumping.
+    self.imageView.bounds = CGRectMake(0, 0, fullImage.size.width, fullImage.size.height);
+    [self setupScrollviewAnimated:NO];
+    [self restoreZoomScale:zoomScale contentOffset:contentOffset];
+}
+
+    /// Zoom to ZOOMSCALE and scroll to CONTENTOFFSET, as far as the scroll view's limits allow.
+    /// If the scale has to be limited, the offset is scaled with it so the same point stays at the top-left.
+-(void) restoreZoomScale: (CGFloat)zoomScale
+           contentOffset: (CGPoint)contentOffset {
+    UIScrollView *scrollView = self.scrollView;
+    CGFloat limitedScale = MIN(MAX(zoomScale, scrollView.minimumZoomScale), scrollView.maximumZoomScale);
+    if (zoomScale > 0 && limitedScale != zoomScale) {
+        contentOffset = CGPointMake(contentOffset.x * limitedScale / zoomScale, contentOffset.y * limitedScale / zoomScale);
+    }
+    scrollView.zoomScale = limitedScale;
+    CGPoint maximumOffset = CGPointMake(MAX(scrollView.contentSize.width  - scrollView.bounds.size.width, 0),
+                                        MAX(scrollView.contentSize.height - scrollView.bounds.size.height, 0));
+    scrollView.contentOffset = CGPointMake(MIN(MAX(contentOffset.x, 0), maximumOffset.x),
+                                           MIN(MAX(contentOffset.y, 0), maximumOffset.y));
+}
+
+    /// Build the tile pyramid for the current viewing method in the background, and show it once it's ready.
+-(void) buildTilePyramid {
+    if (_stereogram.viewingMethod == ViewingMethod_AnimatedGIF) {
+        return;
+    }
+    Stereogram *stereogram = _stereogram;
+    ViewingMethod viewingMethod = stereogram.viewingMethod;
+    FullImageViewController __weak *weakSelf = self;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+        NSError *error = nil;
+        NSURL *pyramidURL = [stereogram tilePyramidURL:&error];
+        if (!pyramidURL) {
+            NSLog(@"Failed to create tiles for stereogram %@: %@", stereogram, error);
+            return;
+        }
+        dispatch_async(dispatch_get_main_queue(), ^{
+                // Ignore the tiles if the user has changed the viewing method or left the view while we were building them.
+            FullImageViewController *strongSelf = weakSelf;
+            if (strongSelf && !strongSelf->_tiledImageView && stereogram.viewingMethod == viewingMethod) {
+                [strongSelf showTilePyramid:pyramidURL keepingZoom:YES];
+            }
+        });
+    });
+}
+
+    /// Replace the image view with a tiled view of the pyramid at PYRAMIDURL. Returns NO and leaves the image view alone on failure.
+    /// If KEEPINGZOOM is YES the tiled view shows the same part of the image, at the same size, as the image view did;
+    /// otherwise it is zoomed to fit, as for a newly shown image.
+-(BOOL) showTilePyramid: (NSURL *)pyramidURL
+            keepingZoom: (BOOL)keepingZoom {
+    if (!pyramidURL) {
+        return NO;
+    }
+    NSError *error = nil;
+    TiledImageView *tiledImageView = [[TiledImageView alloc] initWithPyramidURL:pyramidURL error:&error];
+    if (!tiledImageView) {
+        NSLog(@"Failed to load tiles for stereogram %@: %@", _stereogram, error);
+        return NO;
+    }
+        // Note what the user is looking at, as a zoom scale and offset for the tiled view's size, which may differ from the image's.
+    UIScrollView *scrollView = self.scrollView;
+    CGSize oldSize = self.imageView.bounds.size, newSize = tiledImageView.bounds.size;
+    CGFloat sizeRatio = oldSize.width > 0 ? oldSize.width / newSize.width : 1.0;
+    CGFloat zoomScale = scrollView.zoomScale * sizeRatio;
+    CGPoint contentOffset = scrollView.contentOffset;
+
+        // Reset the zoom so the image view's scaling doesn't carry over to the tiled view.
+    scrollView.zoomScale = 1.0;
+    _tiledImageView = tiledImageView;
+    [scrollView addSubview:tiledImageView];
+        // Release the full image; from now on only the visible tiles are kept in memory.
+    self.imageView.hidden = YES;
+    self.imageView.image = nil;
+    [self setupScrollviewAnimated:NO];
+    if (keepingZoom) {
+            // The content is the same size on screen at the new scale, so the offset carries over as it is.
+        [self restoreZoomScale:zoomScale contentOffset:contentOffset];
+    }
+    return YES;
+}
+
+-(void) removeTiledImageView {
+    if (_tiledImageView) {
+        self.scrollView.zoomScale = 1.0;
+        [_tiledImageView removeFromSuperview];
+        _tiledImageView = nil;
+    }
+    self.imageView.hidden = NO;
+}
+
 -(void) setupScrollviewAnimated: (BOOL)animated {
-    self.scrollView.contentSize = self.imageView.bounds.size;
+    UIView *zoomingView = self.zoomingView;
+    self.scrollView.contentSize = zoomingView.bounds.size;
         // Set the zoom info so the image fits in the window by default, but can be zoomed in. Respect the aspect ratio.
-    CGSize imageSize = self.imageView.image.size, viewSize = self.scrollView.bounds.size;
+    CGSize imageSize = zoomingView.bounds.size, viewSize = self.scrollView.bounds.size;
+    if (imageSize.width <= 0 || imageSize.height <= 0) {
+        return;  // No image to show.
+    }
     self.scrollView.maximumZoomScale = 1.0;  // Cannot zoom in past the 1:1 ratio.
     self.scrollView.minimumZoomScale = MIN(viewSize.width / imageSize.width, viewSize.height / imageSize.height);
         // Default to showing the whole image.
@@ -0,0 +1,73 @@
+/*!
+ @header ImageCacheStatistics
+ @abstract Counters describing how much decoded image memory the stereograms are holding and how well their caches are working.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+ */
+
+@import UIKit;
+#include "PWBufferPool.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*!
+ * @enum
+ * @brief The kinds of image a stereogram caches.
+ * @constant ImageCacheTier_Stereogram The full composited image returned by stereogramImage:
+ * @constant ImageCacheTier_Thumbnail  The small image returned by thumbnailImage:
+ * @constant ImageCacheTier_Preview    The scaled-down photos disparityPreviewImageWithOffset:maximumSize:error: recombines
+ * @constant ImageCacheTier_OtherMethods Stereogram images for viewing methods other than the current one, built ahead of time
+ */
+typedef enum ImageCacheTier {
+    ImageCacheTier_Stereogram,
+    ImageCacheTier_Thumbnail,
+    ImageCacheTier_Preview,
+    ImageCacheTier_OtherMethods,
+
+    ImageCacheTier_NUM_TIERS
+} ImageCacheTier;
+
+/*!
+ * Memory and hit-rate figures for one or more image caches. All arrays are indexed by ImageCacheTier.
+ */
+typedef struct ImageCacheStatistics {
+        /// Bytes of decoded pixel data currently held.
+    NSUInteger liveBytes[ImageCacheTier_NUM_TIERS];
+        /// The highest total of liveBytes seen so far.
+    NSUInteger peakBytes;
+        /// Requests answered from the cache.
+    NSUInteger hits[ImageCacheTier_NUM_TIERS];
+        /// Requests which had to build the image.
+    NSUInteger misses[ImageCacheTier_NUM_TIERS];
+        /// Misses for an image which had been built before and then thrown away. These are a subset of misses.
+    NSUInteger regenerations[ImageCacheTier_NUM_TIERS];
+        /// Number of images released because of a memory warning, and the bytes they held.
+    NSUInteger evictions[ImageCacheTier_NUM_TIERS];
+    NSUInteger evictedBytes[ImageCacheTier_NUM_TIERS];
+} ImageCacheStatistics;
+
+/*! Name of TIER for use in logs, e.g. @"stereogram". */
+NSString *ImageCacheTierName(ImageCacheTier tier);
+
+/*!
+ * Bytes of decoded pixel data IMAGE needs in memory, including every frame of an animated image. Returns 0 for nil.
+ * For images made by +[UIImage imageWithImageBuffer:scale:] this is the size of the compact buffer, not of a 32-bit bitmap.
+ */
+NSUInteger ImageCacheByteCount(UIImage * __nullable image);
+
+/*! Sum of liveBytes across all tiers. */
+NSUInteger ImageCacheStatisticsTotalLiveBytes(const ImageCacheStatistics *statistics);
+
+/*! Adjust the live bytes for TIER by DELTA (which may be negative) and update the peak. */
+void ImageCacheStatisticsAddLiveBytes(ImageCacheStatistics *statistics, ImageCacheTier tier, NSInteger delta);
+
+/*! Add every counter in OTHER to TOTAL. The peak becomes the larger of the two peaks. */
+void ImageCacheStatisticsAccumulate(ImageCacheStatistics *total, const ImageCacheStatistics *other);
+
+/*! A one-line summary suitable for logging. */
+NSString *ImageCacheStatisticsDescription(const ImageCacheStatistics *statistics);
+
+/*! A one-line summary of the image core's buffer pool, which the cached images take their pixel memory from, suitable for logging. */
+NSString *BufferPoolStatisticsDescription(const PWBufferPoolStatistics *statistics);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,95 @@
+//
+//  ImageCacheStatistics.m
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#import "ImageCacheStatistics.h"
+#import "UIImage+PWImageBuffer.h"
+
+NSString *ImageCacheTierName(ImageCacheTier tier) {
+    switch (tier) {
+        case ImageCacheTier_Stereogram: return @"stereogram";
+        case ImageCacheTier_Thumbnail : return @"thumbnail";
+        case ImageCacheTier_Preview   : return @"preview";
+        case ImageCacheTier_OtherMethods: return @"other methods";
+        default:
+            NSCAssert(NO, @"Invalid cache tier %d", tier);
+            return @"unknown";
+    }
+}
+
+static NSUInteger bytesInCGImage(CGImageRef image) {
+    return image ? CGImageGetBytesPerRow(image) * CGImageGetHeight(image) : 0;
+}
+
+NSUInteger ImageCacheByteCount(UIImage *image) {
+    if (!image) {
+        return 0;
+    }
+        // Compact images are converted to 32-bit pixels a few rows at a time, so only their buffers stay resident.
+    NSUInteger compactBytes = image.imageBufferByteCount;
+    if (compactBytes) {
+        return compactBytes;
+    }
+    if (image.images) {
+        NSUInteger total = 0;
+        for (UIImage *frame in image.images) {
+            total += bytesInCGImage(frame.CGImage);
+        }
+        return total;
+    }
+    return bytesInCGImage(image.CGImage);
+}
+
+NSUInteger ImageCacheStatisticsTotalLiveBytes(const ImageCacheStatistics *statistics) {
+    NSUInteger total = 0;
+    for (int tier = 0; tier < ImageCacheTier_NUM_TIERS; tier++) {
+        total += statistics->liveBytes[tier];
+    }
+    return total;
+}
+
+void ImageCacheStatisticsAddLiveBytes(ImageCacheStatistics *statistics, ImageCacheTier tier, NSInteger delta) {
+    NSCAssert(delta >= 0 || statistics->liveBytes[tier] >= (NSUInteger)-delta, @"Cache tier %@ released more bytes than it held.", ImageCacheTierName(tier));
+    statistics->liveBytes[tier] += delta;
+    statistics->peakBytes = MAX(statistics->peakBytes, ImageCacheStatisticsTotalLiveBytes(statistics));
+}
+
+void ImageCacheStatisticsAccumulate(ImageCacheStatistics *total, const ImageCacheStatistics *other) {
+    for (int tier = 0; tier < ImageCacheTier_NUM_TIERS; tier++) {
+        total->liveBytes[tier]     += other->liveBytes[tier];
+        total->hits[tier]          += other->hits[tier];
+        total->misses[tier]        += other->misses[tier];
+        total->regenerations[tier] += other->regenerations[tier];
+        total->evictions[tier]     += other->evictions[tier];
+        total->evictedBytes[tier]  += other->evictedBytes[tier];
+    }
+    total->peakBytes = MAX(total->peakBytes, other->peakBytes);
+}
+
+NSString *ImageCacheStatisticsDescription(const ImageCacheStatistics *statistics) {
+    NSMutableString *description = [NSMutableString stringWithFormat:@"live %@, peak %@"
+                                    , [NSByteCountFormatter stringFromByteCount:ImageCacheStatisticsTotalLiveBytes(statistics) countStyle:NSByteCountFormatterCountStyleMemory]
+                                    , [NSByteCountFormatter stringFromByteCount:statistics->peakBytes countStyle:NSByteCountFormatterCountStyleMemory]];
+    for (int tier = 0; tier < ImageCacheTier_NUM_TIERS; tier++) {
+        [description appendFormat:@"; %@: %@ live, %lu hits, %lu misses, %lu regenerated, %lu evicted (%@)"
+         , ImageCacheTierName(tier)
+         , [NSByteCountFormatter stringFromByteCount:statistics->liveBytes[tier] countStyle:NSByteCountFormatterCountStyleMemory]
+         , (unsigned long)statistics->hits[tier], (unsigned long)statistics->misses[tier]
+         , (unsigned long)statistics->regenerations[tier], (unsigned long)statistics->evictions[tier]
+         , [NSByteCountFormatter stringFromByteCount:statistics->evictedBytes[tier] countStyle:NSByteCountFormatterCountStyleMemory]];
+    }
+    return description;
+}
+
+NSString *BufferPoolStatisticsDescription(const PWBufferPoolStatistics *statistics) {
+    return [NSString stringWithFormat:@"%lu idle blocks holding %@, peak %@; %llu hits, %llu misses, %llu recycled, %llu discarded, %@ trimmed"
+            , (unsigned long)statistics->idleBlocks
+            , [NSByteCountFormatter stringFromByteCount:statistics->idleBytes countStyle:NSByteCountFormatterCountStyleMemory]
+            , [NSByteCountFormatter stringFromByteCount:statistics->peakIdleBytes countStyle:NSByteCountFormatterCountStyleMemory]
+            , statistics->hits, statistics->misses, statistics->recycled, statistics->discarded
+            , [NSByteCountFormatter stringFromByteCount:(long long)statistics->trimmedBytes countStyle:NSByteCountFormatterCountStyleMemory]];
+}
@@ -6,6 +6,9 @@
 */
 
 @import UIKit;
+#include "PWAlign.h"
+#include "PWAnaglyph.h"
+#include "PWJPEGEncoder.h"
 NS_ASSUME_NONNULL_BEGIN
 
 /*! Collection of class functions for handling images.
@@ -29,6 +32,148 @@ NS_ASSUME_NONNULL_BEGIN
 +(UIImage *) makeStereogramWithLeftPhoto: (UIImage *)leftPhoto
                               rightPhoto: (UIImage *)rightPhoto;
 
+/*! Returns a stereogram of two photos which have already been decoded, e.g. by createPhotoBuffersWithLeftData:rightData:cropRect:alignment:leftBuffer:rightBuffer:.
+ * Unlike makeStereogramWithLeftPhoto:rightPhoto:, this doesn't expand the photos to 32 bits per pixel.
+ * A typical camera JPEG stays as YCbCr 4:2:0, at 1.5 bytes per pixel, and is only converted as it is drawn.
+ * The photos are shifted by taking views of them, so the only pixels copied are the ones in the result.
+ * @param leftBuffer The left-hand photo.
+ * @param rightBuffer The right-hand photo, in the same pixel format.
+ * @param disparityOffset How far to move the right photo to the right of the left one. It is limited to leave at least 2 columns of each photo.
+ * @return The new image, or nil if the pixel formats differ or the result couldn't be allocated.
+ */
++(nullable UIImage *) makeCompactStereogramWithLeftBuffer: (PWImageBuffer *)leftBuffer
+                                              rightBuffer: (PWImageBuffer *)rightBuffer
+                                          disparityOffset: (NSInteger)disparityOffset;
+
+/*! Returns a red/cyan anaglyph of two photos which have already been decoded. The photos may be in different pixel formats.
+ * The photos are mixed a row at a time into a single RGB image, without building the side-by-side stereogram first,
+ * so the result takes half the memory of makeStereogramWithLeftPhoto:rightPhoto: or less.
+ * @param disparityOffset As for makeCompactStereogramWithLeftBuffer:rightBuffer:disparityOffset:.
+ */
++(nullable UIImage *) makeAnaglyphWithLeftBuffer: (PWImageBuffer *)leftBuffer
+                                     rightBuffer: (PWImageBuffer *)rightBuffer
+                                 disparityOffset: (NSInteger)disparityOffset
+                                          method: (PWAnaglyphMethod)method;
+
+/*! Returns an animation swinging between two photos which have already been decoded, through views made between them
+ * from their disparity (see PWDisparity.h). If the photos can't be matched, it just alternates between them.
+ * @param disparityOffset As for makeCompactStereogramWithLeftBuffer:rightBuffer:disparityOffset:.
+ * @param duration The time to go from the left photo to the right one and back, as for +[UIImage animatedImageWithImages:duration:].
+ * @param inBetweenViews NO to only alternate between the photos. Matching them takes tens of milliseconds, too long for a
+ *                       preview that is remade as a slider moves.
+ */
++(nullable UIImage *) makeAnimationWithLeftBuffer: (PWImageBuffer *)leftBuffer
+                                      rightBuffer: (PWImageBuffer *)rightBuffer
+                                  disparityOffset: (NSInteger)disparityOffset
+                                         duration: (NSTimeInterval)duration
+                                   inBetweenViews: (BOOL)inBetweenViews;
+
+/*! Decodes a photo into an upright image buffer and crops it, for the methods above that take buffers.
+ * JPEG files are decoded by the image core, keeping their compact pixel format; anything else by UIKit.
+ * @param data The image data.
+ * @param cropRect The part of the photo to keep, in pixels, or CGRectNull for all of it.
+ * @return A new buffer which the caller must release with PWImageBufferRelease(), or NULL if the data couldn't be decoded.
+ */
++(nullable PWImageBuffer *) createPhotoBufferWithData: (NSData *)data
+                                             cropRect: (CGRect)cropRect;
+
+/*! Decodes both photos of a pair as createPhotoBufferWithData:cropRect: does, then takes out their misalignment.
+ * A vertical offset is removed by taking views of the photos; a rotation means making a rotated copy of the right photo.
+ * See PWAlignCreateCorrectedPair(). Either way the photos end up the same size, and a little smaller than the crop.
+ * @param leftData The image data for the left-hand photo.
+ * @param rightData The image data for the right-hand photo.
+ * @param cropRect The part of each photo to use, in pixels, or CGRectNull for all of it. See Stereogram.cropRect.
+ * @param alignment The misalignment of the whole photos, from estimateAlignmentOfLeftPhoto:rightPhoto:alignment:. See Stereogram.alignment.
+ * @param leftPtr Receives the left photo, which the caller must release with PWImageBufferRelease().
+ * @param rightPtr Receives the right photo, as for leftPtr.
+ * @return YES if successful, NO if either photo couldn't be decoded or the buffers couldn't be allocated.
+ */
++(BOOL) createPhotoBuffersWithLeftData: (NSData *)leftData
+                             rightData: (NSData *)rightData
+                              cropRect: (CGRect)cropRect
+                             alignment: (PWAlignment)alignment
+                            leftBuffer: (PWImageBuffer * __nullable * __nonnull)leftPtr
+                           rightBuffer: (PWImageBuffer * __nullable * __nonnull)rightPtr;
+
+/*! Makes a small version of the pair createPhotoBuffersWithLeftData:rightData:cropRect:alignment:leftBuffer:rightBuffer: would make,
+ * to show while that runs. See PWStereoPairCreatePreviewPhotos().
+ * The photos' EXIF thumbnails are used if they have them, reading only the start of each file; otherwise both are decoded at 1/8 size.
+ * Either way this takes a few milliseconds however big the photos are.
+ * @param leftURL The left-hand photo, which must be a JPEG file.
+ * @param rightURL The right-hand photo, as for leftURL.
+ * @param cropRect As for createPhotoBuffersWithLeftData:rightData:cropRect:alignment:leftBuffer:rightBuffer:, in pixels of the full photos.
+ * @param alignment As for cropRect.
+ * @param leftPtr Receives the left photo, which the caller must release with PWImageBufferRelease().
+ * @param rightPtr Receives the right photo, as for leftPtr.
+ * @param scalePtr Receives the width of the small photos over the width of the full ones.
+ * @return YES if successful, NO if either photo couldn't be read, e.g. because it isn't a JPEG file.
+ */
++(BOOL) createPreviewPhotoBuffersWithLeftURL: (NSURL *)leftURL
+                                    rightURL: (NSURL *)rightURL
+                                    cropRect: (CGRect)cropRect
+                                   alignment: (PWAlignment)alignment
+                                  leftBuffer: (PWImageBuffer * __nullable * __nonnull)leftPtr
+                                 rightBuffer: (PWImageBuffer * __nullable * __nonnull)rightPtr
+                                       scale: (double *)scalePtr;
+
+/*! Measures how far the right photo of a newly taken pair is out of line with the left one. See PWAlignEstimate().
+ * This takes some tens of milliseconds, so call it from a background thread. Photos made by the image core are read
+ * without copying them.
+ * @param leftPhoto The left-hand photo, upright.
+ * @param rightPhoto The right-hand photo, upright and the same size.
+ * @param alignmentPtr Receives the misalignment, in pixels of the photos.
+ * @return YES if successful, NO if the photos have too little detail to line up or the parts of them disagree too much
+ *         for the result to be trusted, e.g. because something moved between the two shots.
+ */
++(BOOL) estimateAlignmentOfLeftPhoto: (UIImage *)leftPhoto
+                          rightPhoto: (UIImage *)rightPhoto
+                           alignment: (PWAlignment *)alignmentPtr;
+
+/*! Works out the perceptual hash of a photo, for finding duplicates later. See PWPerceptualHashCompute().
+ * This takes a few milliseconds. Photos made by the image core are read without copying them.
+ * @param photo The photo, upright.
+ * @param hashPtr Receives the hash.
+ * @return YES if successful, NO if the photo couldn't be read.
+ */
++(BOOL) perceptualHashOfPhoto: (UIImage *)photo
+                         hash: (uint64_t *)hashPtr;
+
+/*! Returns the size in pixels of a photo once it is upright, without decoding it if it is a JPEG file.
+ * @param data The image data.
+ * @return The size, or CGSizeZero if the data isn't an image.
+ */
++(CGSize) uprightPixelSizeOfPhotoData: (NSData *)data;
+
+/*! Returns JPEG data for a photo with a small copy of it embedded in the EXIF segment. See PWExifThumbnailAdd().
+ * This takes a few milliseconds. The image data itself is copied as it is.
+ * @param data The JPEG file, e.g. from UIImageJPEGRepresentation().
+ * @param photo The photo DATA was made from, so it needn't be decoded again, or nil.
+ * @return The new data, or nil if DATA is not a JPEG file the image core can read.
+ */
++(nullable NSData *) photoDataWithThumbnail: (NSData *)data
+                                      photo: (nullable UIImage *)photo;
+
+/*! Encodes an image as a JPEG file with the image core's encoder, which splits the work across the processor's cores.
+ * See PWJPEGEncode(). Images made by the image core are encoded without copying them, and YCbCr 4:2:0 ones without
+ * converting their colours. Other images are drawn upright first, so the file needs no orientation tag.
+ * @param image The image to encode. An animated image gives its first frame.
+ * @param options The quality, chroma subsampling, progressive or baseline output and any size limit, or NULL for the
+ *                defaults from PWJPEGEncodeOptionsInit(). Files the app reads back itself must be baseline.
+ * @param addThumbnail YES to embed a thumbnail of the image as photoDataWithThumbnail:photo: does.
+ * @return The JPEG data, or nil if the image couldn't be read or encoded.
+ */
++(nullable NSData *) JPEGDataOfImage: (UIImage *)image
+                             options: (nullable const PWJPEGEncodeOptions *)options
+                        addThumbnail: (BOOL)addThumbnail;
+
+/*! Loads the thumbnail embedded in a JPEG file, reading only the start of the file. See PWExifThumbnailCreateImage().
+ * @param url The JPEG file.
+ * @param photoSizePtr Receives the size in pixels of the photo itself once it is upright.
+ * @return The thumbnail, upright, or nil if the file has none, e.g. because an earlier version of the app saved it.
+ */
++(nullable UIImage *) thumbnailOfPhotoAtURL: (NSURL *)url
+                                  photoSize: (CGSize *)photoSizePtr;
+
 /*! Toggles the viewing method from crosseye to walleye and back
  * @param sourceImage The image to update.
  * @return A copy of sourceImage with the left and right halves swapped.
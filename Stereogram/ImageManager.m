@@ -8,6 +8,19 @@
 
 #import "ImageManager.h"
 #import "ErrorData.h"
+#import "UIImage+PWImageBuffer.h"
+#include "PWDisparity.h"
+#include "PWExifThumbnail.h"
+#include "PWJPEGDecoder.h"
+#include "PWOrientation.h"
+#include "PWPerceptualHash.h"
+#include "PWStereoPair.h"
+
+    /// Largest residual from PWAlignEstimate() to accept, as a fraction of the photo height.
+static const double MaximumAlignmentResidual = 0.01;
+
+    /// Views of the scene made between the left and right photos for the animated viewing method.
+static const int AnimationInBetweenViews = 2;
 
 @implementation ImageManager
 
@@ -20,6 +33,20 @@
 +(UIImage *) makeStereogramWithLeftPhoto: (UIImage *)leftPhoto
                               rightPhoto: (UIImage *)rightPhoto {
     NSAssert(leftPhoto.scale == rightPhoto.scale, @"Image scales %f and %f need to be the same.", leftPhoto.scale, rightPhoto.scale);
+        // Composite the pixels with the image core, so the result's memory comes from the buffer pool instead of a new bitmap
+        // context each time. Photos the core can't put side by side, e.g. in different pixel formats, are drawn by UIKit.
+    PWImageBuffer *left = PWImageBufferCreateFromUIImage(leftPhoto), *right = PWImageBufferCreateFromUIImage(rightPhoto);
+    PWImageBuffer *buffer = left && right && left->format == right->format ? PWImageBufferCreateSideBySide(left, right) : NULL;
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+    if (buffer) {
+        UIImage *stereogram = [UIImage imageWithImageBuffer:buffer scale:leftPhoto.scale];
+        PWImageBufferRelease(buffer);
+        if (stereogram) {
+            return stereogram;
+        }
+    }
+
     CGSize stereogramSize = CGSizeMake(leftPhoto.size.width + rightPhoto.size.width, MAX(leftPhoto.size.height, rightPhoto.size.height));
     UIImage *stereogram = nil;
     UIGraphicsBeginImageContextWithOptions(stereogramSize, NO, leftPhoto.scale);
@@ -35,6 +62,277 @@
     return stereogram;
 }
 
+    /// Decode DATA with the image core and turn it upright, or return NULL if the UIKit decoder should be used instead.
+static PWImageBuffer *decodeUprightJPEG(NSData *data) {
+    PWImageBuffer *buffer = NULL;
+    PWError error = PWStereoPairDecodePhoto(data.bytes, data.length, &buffer);
+    if (error != PWError_None && error != PWError_NotSupported && error != PWError_InvalidFormat) {
+        NSLog(@"Failed to decode JPEG data (error %d). Falling back to UIKit.", error);
+    }
+    return buffer;
+}
+
+    /// The crop as the image core stores it. A null rectangle means no crop.
+static PWCropRect coreCropRect(CGRect cropRect) {
+    if (CGRectIsNull(cropRect)) {
+        return (PWCropRect) { 0.0, 0.0, 0.0, 0.0 };
+    }
+    cropRect = CGRectStandardize(cropRect);
+    return (PWCropRect) { cropRect.origin.x, cropRect.origin.y, cropRect.size.width, cropRect.size.height };
+}
+
+    /// Replace BUFFER with a view of just the part inside CROPRECT, consuming the caller's reference. Nothing is copied.
+    /// See PWStereoPairCreateCroppedPhoto() for how the edges are rounded.
+static PWImageBuffer *cropBuffer(PWImageBuffer *buffer, CGRect cropRect) {
+    PWImageBuffer *cropped = PWStereoPairCreateCroppedPhoto(buffer, coreCropRect(cropRect));
+    PWImageBufferRelease(buffer);
+    return cropped;
+}
+
+    /// Wrap BUFFER in an image, consuming the caller's reference.
+static UIImage *imageConsumingBuffer(PWImageBuffer *buffer) {
+    if (!buffer) {
+        return nil;
+    }
+    UIImage *image = [UIImage imageWithImageBuffer:buffer scale:1.0];
+    PWImageBufferRelease(buffer);
+    return image;
+}
+
+    /// Make views of LEFT and RIGHT shifted by DISPARITYOFFSET (see Stereogram.disparityOffset).
+static BOOL createShiftedViews(PWImageBuffer *left, PWImageBuffer *right, NSInteger disparityOffset,
+                               PWImageBuffer **leftView, PWImageBuffer **rightView) {
+    return PWStereoPairCreateShiftedViews(left, right, (long)disparityOffset, leftView, rightView) == PWError_None;
+}
+
++(UIImage *) makeCompactStereogramWithLeftBuffer: (PWImageBuffer *)leftBuffer
+                                     rightBuffer: (PWImageBuffer *)rightBuffer
+                                 disparityOffset: (NSInteger)disparityOffset {
+    PWImageBuffer *left = NULL, *right = NULL, *stereogram = NULL;
+    if (leftBuffer->format == rightBuffer->format && createShiftedViews(leftBuffer, rightBuffer, disparityOffset, &left, &right)) {
+        stereogram = PWImageBufferCreateSideBySide(left, right);
+    }
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+    return imageConsumingBuffer(stereogram);
+}
+
+    /// Decode a photo into an upright image buffer, with the image core if it is a JPEG it can handle and with UIKit otherwise.
+static PWImageBuffer *decodeUprightPhoto(NSData *data) {
+    PWImageBuffer *buffer = decodeUprightJPEG(data);
+    if (!buffer) {
+        UIImage *image = [UIImage imageWithData:data];
+        buffer = image ? PWImageBufferCreateFromUIImage(image) : NULL;
+    }
+    return buffer;
+}
+
++(UIImage *) makeAnaglyphWithLeftBuffer: (PWImageBuffer *)leftBuffer
+                            rightBuffer: (PWImageBuffer *)rightBuffer
+                        disparityOffset: (NSInteger)disparityOffset
+                                 method: (PWAnaglyphMethod)method {
+    PWImageBuffer *left = NULL, *right = NULL, *anaglyph = NULL;
+    if (createShiftedViews(leftBuffer, rightBuffer, disparityOffset, &left, &right)) {
+        anaglyph = PWAnaglyphCreate(left, right, method);
+    }
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+    return imageConsumingBuffer(anaglyph);
+}
+
++(UIImage *) makeAnimationWithLeftBuffer: (PWImageBuffer *)leftBuffer
+                             rightBuffer: (PWImageBuffer *)rightBuffer
+                         disparityOffset: (NSInteger)disparityOffset
+                                duration: (NSTimeInterval)duration
+                          inBetweenViews: (BOOL)inBetweenViews {
+    PWImageBuffer *left = NULL, *right = NULL;
+    if (!createShiftedViews(leftBuffer, rightBuffer, disparityOffset, &left, &right)) {
+        return nil;
+    }
+        // Views from between the two cameras make the scene turn smoothly rather than jump. If the photos can't be matched,
+        // e.g. because there is too little detail or they are in different formats, just alternate between them.
+    NSMutableArray<UIImage *> *inBetweenFrames = [NSMutableArray arrayWithCapacity:AnimationInBetweenViews];
+    PWDisparityMap map;
+    PWError error = PWError_NotSupported;
+    if (inBetweenViews && left->format == right->format) {
+        error = PWDisparityEstimate(left, right, &map);
+    }
+    if (error == PWError_None) {
+        for (int i = 1; i <= AnimationInBetweenViews; i++) {
+            UIImage *frame = imageConsumingBuffer(PWDisparityCreateView(left, right, &map, (double)i / (AnimationInBetweenViews + 1)));
+            if (!frame) {
+                [inBetweenFrames removeAllObjects];
+                break;
+            }
+            [inBetweenFrames addObject:frame];
+        }
+        PWDisparityMapFree(&map);
+    } else if (error == PWError_OutOfMemory) {
+        NSLog(@"Couldn't match the photos for the animation (error %d). Alternating them instead.", error);
+    }
+
+        // The photos' frames read straight from the views, so nothing is copied until they are drawn.
+    UIImage *leftFrame = imageConsumingBuffer(left), *rightFrame = imageConsumingBuffer(right);
+    if (!leftFrame || !rightFrame) {
+        return nil;
+    }
+        // Swing from the left photo to the right one and back, e.g. L, 1, 2, R, 2, 1.
+    NSMutableArray<UIImage *> *frames = [NSMutableArray arrayWithObject:leftFrame];
+    [frames addObjectsFromArray:inBetweenFrames];
+    [frames addObject:rightFrame];
+    [frames addObjectsFromArray:inBetweenFrames.reverseObjectEnumerator.allObjects];
+    return [UIImage animatedImageWithImages:frames duration:duration];
+}
+
++(PWImageBuffer *) createPhotoBufferWithData: (NSData *)data
+                                    cropRect: (CGRect)cropRect {
+    return cropBuffer(decodeUprightPhoto(data), cropRect);
+}
+
++(BOOL) createPhotoBuffersWithLeftData: (NSData *)leftData
+                             rightData: (NSData *)rightData
+                              cropRect: (CGRect)cropRect
+                             alignment: (PWAlignment)alignment
+                            leftBuffer: (PWImageBuffer **)leftPtr
+                           rightBuffer: (PWImageBuffer **)rightPtr {
+    PWImageBuffer *left = decodeUprightPhoto(leftData), *right = decodeUprightPhoto(rightData);
+    BOOL success = left && right
+                && PWStereoPairCreatePhotos(left, right, coreCropRect(cropRect), alignment, leftPtr, rightPtr) == PWError_None;
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+    return success;
+}
+
++(BOOL) createPreviewPhotoBuffersWithLeftURL: (NSURL *)leftURL
+                                    rightURL: (NSURL *)rightURL
+                                    cropRect: (CGRect)cropRect
+                                   alignment: (PWAlignment)alignment
+                                  leftBuffer: (PWImageBuffer **)leftPtr
+                                 rightBuffer: (PWImageBuffer **)rightPtr
+                                       scale: (double *)scalePtr {
+    PWError error = PWStereoPairCreatePreviewPhotos(leftURL.fileSystemRepresentation, rightURL.fileSystemRepresentation,
+                                                    coreCropRect(cropRect), alignment, leftPtr, rightPtr, scalePtr);
+    if (error != PWError_None && error != PWError_NotSupported && error != PWError_InvalidFormat) {
+        NSLog(@"Couldn't make preview photos from %@ and %@ (error %d).", leftURL.path, rightURL.path, error);
+    }
+    return error == PWError_None;
+}
+
++(BOOL) estimateAlignmentOfLeftPhoto: (UIImage *)leftPhoto
+                          rightPhoto: (UIImage *)rightPhoto
+                           alignment: (PWAlignment *)alignmentPtr {
+    PWImageBuffer *left = PWImageBufferCreateFromUIImage(leftPhoto), *right = PWImageBufferCreateFromUIImage(rightPhoto);
+    PWAlignment alignment = { 0.0, 0.0, 0.0 };
+    PWError error = left && right ? PWAlignEstimate(left, right, &alignment) : PWError_OutOfMemory;
+    double height = left ? left->height : 0.0;
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+    if (error != PWError_None) {
+        NSLog(@"Couldn't measure the alignment of the photos (error %d). Leaving them as they are.", error);
+        return NO;
+    }
+        // Parts of the image disagreeing by more than this usually means something moved between the shots, and
+        // correcting for the average would make the pair worse rather than better.
+    if (alignment.residual > height * MaximumAlignmentResidual) {
+        NSLog(@"Alignment estimate %.1f rows, %.2f degrees has a residual of %.1f rows. Leaving the photos as they are.",
+              alignment.verticalOffset, alignment.rotation * 180.0 / M_PI, alignment.residual);
+        return NO;
+    }
+    *alignmentPtr = alignment;
+    return YES;
+}
+
++(BOOL) perceptualHashOfPhoto: (UIImage *)photo
+                         hash: (uint64_t *)hashPtr {
+    PWImageBuffer *buffer = PWImageBufferCreateFromUIImage(photo);
+    PWError error = buffer ? PWPerceptualHashCompute(buffer, hashPtr) : PWError_OutOfMemory;
+    PWImageBufferRelease(buffer);
+    if (error != PWError_None) {
+        NSLog(@"Couldn't work out the perceptual hash of photo %@ (error %d).", photo, error);
+        return NO;
+    }
+    return YES;
+}
+
++(CGSize) uprightPixelSizeOfPhotoData: (NSData *)data {
+    PWJPEGInfo info;
+    if (PWJPEGReadInfo(data.bytes, data.length, &info) == PWError_None) {
+        BOOL swapsAxes = PWOrientationSwapsAxes((PWOrientation)info.orientation);
+        return swapsAxes ? CGSizeMake(info.height, info.width) : CGSizeMake(info.width, info.height);
+    }
+    UIImage *image = [UIImage imageWithData:data];
+    return image ? CGSizeMake(image.size.width * image.scale, image.size.height * image.scale) : CGSizeZero;
+}
+
++(NSData *) photoDataWithThumbnail: (NSData *)data
+                             photo: (UIImage *)photo {
+        // The thumbnail is made from the pixels as stored, so an image which UIKit turns upright has to be decoded again.
+    PWImageBuffer *buffer = photo.imageOrientation == UIImageOrientationUp ? PWImageBufferCreateFromUIImage(photo) : NULL;
+    PWDataBuffer output;
+    if (!PWDataBufferInit(&output, data.length + 64 * 1024)) {
+        PWImageBufferRelease(buffer);
+        return nil;
+    }
+    PWError error = PWExifThumbnailAdd(data.bytes, data.length, buffer, &output);
+    if (error == PWError_InvalidParameter) {
+        error = PWExifThumbnailAdd(data.bytes, data.length, NULL, &output);
+    }
+    PWImageBufferRelease(buffer);
+    if (error != PWError_None) {
+        NSLog(@"Couldn't add a thumbnail to photo data of %lu bytes (error %d).", (unsigned long)data.length, error);
+        PWDataBufferFree(&output);
+        return nil;
+    }
+    return [NSData dataWithBytesNoCopy:output.bytes length:output.length freeWhenDone:YES];
+}
+
++(NSData *) JPEGDataOfImage: (UIImage *)image
+                     options: (const PWJPEGEncodeOptions *)options
+                addThumbnail: (BOOL)addThumbnail {
+    PWImageBuffer *buffer = PWImageBufferCreateFromUIImage(image);
+    if (!buffer) {
+        return nil;
+    }
+    PWDataBuffer output;
+    if (!PWDataBufferInit(&output, 0)) {
+        NSLog(@"Couldn't allocate the output to encode a %.0fx%.0f image as JPEG.", image.size.width, image.size.height);
+        PWImageBufferRelease(buffer);
+        return nil;
+    }
+    PWError error = PWJPEGEncode(buffer, options, &output);
+    if (error == PWError_None && addThumbnail) {
+            // The pixels encoded are the ones the thumbnail is made from, so they needn't be decoded again.
+            // Without the memory for it, the file is returned without a thumbnail, as when adding one fails.
+        PWDataBuffer withThumbnail;
+        if (PWDataBufferInit(&withThumbnail, 0)
+            && PWExifThumbnailAdd(output.bytes, output.length, buffer, &withThumbnail) == PWError_None) {
+            PWDataBufferFree(&output);
+            output = withThumbnail;
+        } else {
+            PWDataBufferFree(&withThumbnail);
+        }
+    }
+    PWImageBufferRelease(buffer);
+    if (error != PWError_None) {
+        NSLog(@"Couldn't encode a %.0fx%.0f image as JPEG (error %d).", image.size.width, image.size.height, error);
+        PWDataBufferFree(&output);
+        return nil;
+    }
+    return [NSData dataWithBytesNoCopy:output.bytes length:output.length freeWhenDone:YES];
+}
+
++(UIImage *) thumbnailOfPhotoAtURL: (NSURL *)url
+                         photoSize: (CGSize *)photoSizePtr {
+    PWImageBuffer *buffer = NULL;
+    PWExifThumbnailPhotoInfo info;
+    if (!url.isFileURL || PWExifThumbnailCreateImage(url.fileSystemRepresentation, &buffer, &info) != PWError_None) {
+        return nil;
+    }
+    BOOL swapsAxes = PWOrientationSwapsAxes((PWOrientation)info.orientation);
+    *photoSizePtr = swapsAxes ? CGSizeMake(info.height, info.width) : CGSizeMake(info.width, info.height);
+    return imageConsumingBuffer(buffer);
+}
+
 +(UIImage *) changeViewingMethod: (UIImage *)sourceImage {
     if (sourceImage) {
         UIImage *swappedImage = [self makeStereogramWithLeftPhoto:[self getHalfOfImage:sourceImage whichHalf:RightHalf]
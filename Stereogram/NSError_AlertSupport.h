@@ -6,6 +6,7 @@
  */
 
 @import Foundation;
+#include "PWImageBuffer.h"
 
     // These are keys into the userInfo dictionary for unknownError NSError objects.
 extern NSString * const kLocationKey, *const kCallerKey, *const kTargetKey;
@@ -67,4 +68,18 @@ extern NSString * const kLocationKey, *const kCallerKey, *const kTargetKey;
 +(NSError *) parameterErrorWithParameter: (NSString *)parameter
 							 valuePassed: (id)valuePassed;
 
+/*!
+ * Returns an error describing a failure reported by the portable image core.
+ *
+ * PWError_IO becomes an NSPOSIXErrorDomain error with the current value of errno, so call this straight after the failure.
+ *
+ * @param code      The error the image core returned. Must not be PWError_None.
+ * @param operation What we were trying to do, e.g. @"Creating tiles".
+ * @param path      The file or directory involved, or nil.
+ * @return An error whose description includes OPERATION and the reason for the failure.
+ */
++(NSError *) imageCoreErrorWithCode: (PWError)code
+                          operation: (NSString *)operation
+                               path: (NSString *)path;
+
 @end
@@ -9,6 +9,7 @@
 @import Foundation;
 #import "UIKit/UIKit.h"
 #import "ErrorData.h"
+#include <errno.h>
 
 @implementation NSError (AlertSupport)
 
@@ -89,4 +90,45 @@ NSString *const kParameterKey = @"Parameter", *const kParameterValueKey = @"Para
 						   userInfo:userInfo];
 }
 
++(NSError *) imageCoreErrorWithCode: (PWError)code
+                          operation: (NSString *)operation
+                               path: (NSString *)path {
+    NSAssert(code != PWError_None, @"%@ reported an error but the code was PWError_None.", operation);
+    NSString *domain = kErrorDomainPhotoStore, *reason = nil;
+    NSInteger errorCode = ErrorCode_UnknownError;
+    switch (code) {
+        case PWError_IO:
+            domain = NSPOSIXErrorDomain;
+            errorCode = errno;
+            reason = @(strerror(errno));
+            break;
+        case PWError_InvalidParameter:
+            errorCode = ErrorCode_InvalidParameter;
+            reason = @"Invalid parameter";
+            break;
+        case PWError_InvalidFormat:
+        case PWError_NotSupported:
+            errorCode = ErrorCode_InvalidFileFormat;
+            reason = (code == PWError_NotSupported) ? @"Unsupported image format" : @"Invalid image format";
+            break;
+        case PWError_OutOfMemory:
+            reason = @"Out of memory";
+            break;
+        case PWError_Cancelled:
+            reason = @"Cancelled";
+            break;
+        default:
+            reason = [NSString stringWithFormat:@"Error %d", code];
+            break;
+    }
+    NSMutableDictionary *userInfo = [NSMutableDictionary dictionaryWithObject:[NSString stringWithFormat:@"%@ failed: %@", operation, reason]
+                                                                       forKey:NSLocalizedDescriptionKey];
+    if (path) {
+        userInfo[NSFilePathErrorKey] = path;
+    }
+    return [NSError errorWithDomain:domain
+                               code:errorCode
+                           userInfo:userInfo];
+}
+
 @end
@@ -0,0 +1,475 @@
+//
+//  PWAlign.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWAlign.h"
+#include "PWParallel.h"
+#include "PWResample.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+    /// The photos are scaled down to at most this width before anything else. That is still fine enough to see a tilt of a tenth of a degree.
+enum { WorkingWidth = 512 };
+
+    /// The pyramid is halved until another halving would make it narrower than this.
+enum { CoarsestWidth = 96 };
+
+    /// The deepest pyramid we could need: WorkingWidth halved until it is below CoarsestWidth.
+enum { MaximumLevels = 4 };
+
+    /// The image is split into this many vertical bands, each of which is matched separately.
+enum { BandCount = 6 };
+
+    /// Bands whose pixels differ from the band's mean by less than this on average have too little detail to match.
+enum { MinimumDetail = 2 };
+
+    /// After the line is fitted, the band furthest from it is dropped if it is more than this many rows away, and the line fitted again.
+static const double OutlierRows = 1.0;
+
+    /// Rows handed to each call from PWParallelFor() when rotating a photo.
+enum { BandRows = 16 };
+
+// MARK: - Luma pyramid
+
+    /// One level of the pyramid: the luma of each photo, tightly packed, with that photo's mean level subtracted so that
+    /// a change of exposure between the two shots doesn't count as a difference.
+typedef struct Level {
+    size_t width, height;
+    int16_t *left, *right;
+} Level;
+
+    /// Scale SOURCE to WIDTH x HEIGHT and return just its luma as a Gray8 buffer.
+static PWImageBuffer *createScaledLuma(const PWImageBuffer *source, size_t width, size_t height) {
+    if (source->format == PWPixelFormat_YCbCr420 || source->format == PWPixelFormat_Gray8) {
+            // The luma plane of a YCbCr image is a greyscale image in its own right, so the chroma need never be read.
+        PWImageBuffer *luma = PWImageBufferCreateWithData(source->data, source->width, source->height, source->bytesPerRow, PWPixelFormat_Gray8);
+        PWImageBuffer *scaled = luma ? PWResampleCreate(luma, width, height, PWResampleFilter_Area) : NULL;
+        PWImageBufferRelease(luma);
+        return scaled;
+    }
+    PWImageBuffer *scaled = PWResampleCreate(source, width, height, PWResampleFilter_Area);
+    PWImageBuffer *gray = scaled ? PWImageBufferCreate(width, height, PWPixelFormat_Gray8) : NULL;
+    if (gray) {
+        uint8_t pixels[WorkingWidth * 4];
+        for (size_t y = 0; y < height; y++) {
+            PWImageBufferConvertRowToRGBX(scaled, y, 0, width, pixels);
+            uint8_t *row = PWImageBufferRow(gray, y);
+            for (size_t x = 0; x < width; x++) {
+                row[x] = (uint8_t)((77 * pixels[x * 4] + 150 * pixels[x * 4 + 1] + 29 * pixels[x * 4 + 2] + 128) >> 8);
+            }
+        }
+    }
+    PWImageBufferRelease(scaled);
+    return gray;
+}
+
+    /// Copy GRAY into DESTINATION as 16-bit differences from its mean.
+static void fillLevelPlane(int16_t *destination, const PWImageBuffer *gray) {
+    uint64_t sum = 0;
+    for (size_t y = 0; y < gray->height; y++) {
+        const uint8_t *row = PWImageBufferRow(gray, y);
+        for (size_t x = 0; x < gray->width; x++) {
+            sum += row[x];
+        }
+    }
+    int16_t mean = (int16_t)((sum + gray->width * gray->height / 2) / (gray->width * gray->height));
+    for (size_t y = 0; y < gray->height; y++) {
+        const uint8_t *row = PWImageBufferRow(gray, y);
+        int16_t *output = destination + y * gray->width;
+        for (size_t x = 0; x < gray->width; x++) {
+            output[x] = (int16_t)(row[x] - mean);
+        }
+    }
+}
+
+static void freeLevels(Level *levels, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free(levels[i].left);
+    }
+}
+
+    /// Fill LEVELS from the two luma images, halving them until they reach CoarsestWidth. Consumes both buffers.
+    /// Returns the number of levels made, or 0 if memory ran out.
+static size_t buildPyramid(PWImageBuffer *left, PWImageBuffer *right, Level levels[MaximumLevels]) {
+    size_t count = 0;
+    while (left && right) {
+        Level *level = &levels[count];
+        level->width = left->width;
+        level->height = left->height;
+            // One allocation holds both photos.
+        level->left = malloc(2 * left->width * left->height * sizeof(int16_t));
+        if (!level->left) {
+            break;
+        }
+        level->right = level->left + left->width * left->height;
+        fillLevelPlane(level->left, left);
+        fillLevelPlane(level->right, right);
+        count++;
+        if (left->width / 2 < CoarsestWidth || count == MaximumLevels) {
+            PWImageBufferRelease(left);
+            PWImageBufferRelease(right);
+            return count;
+        }
+        PWImageBuffer *halfLeft = PWImageBufferCreateHalfSize(left), *halfRight = PWImageBufferCreateHalfSize(right);
+        PWImageBufferRelease(left);
+        PWImageBufferRelease(right);
+        left = halfLeft;
+        right = halfRight;
+    }
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+    freeLevels(levels, count);
+    return 0;
+}
+
+// MARK: - Matching
+
+    /// Sum of the absolute differences of COUNT values. This is where nearly all the time goes, and it vectorises.
+static uint32_t rowDifference(const int16_t *restrict a, const int16_t *restrict b, size_t count) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        int difference = a[i] - b[i];
+        sum += (uint32_t)(difference < 0 ? -difference : difference);
+    }
+    return sum;
+}
+
+    /// The mean absolute difference between columns FIRSTX to ENDX - 1 of the left image and the right image moved by
+    /// (DX, DY), over the pixels that are in both. HUGE_VAL if they overlap by less than half the band.
+static double bandCost(const Level *level, long firstX, long endX, long dx, long dy) {
+    long width = (long)level->width, height = (long)level->height;
+    long left = firstX > -dx ? firstX : -dx, right = endX < width - dx ? endX : width - dx;
+    long top = dy < 0 ? -dy : 0, bottom = dy > 0 ? height - dy : height;
+    if (right <= left || bottom <= top || 2 * (right - left) * (bottom - top) < (endX - firstX) * height) {
+        return HUGE_VAL;
+    }
+    uint64_t sum = 0;
+    for (long y = top; y < bottom; y++) {
+        sum += rowDifference(level->left + y * width + left, level->right + (y + dy) * width + left + dx, (size_t)(right - left));
+    }
+    return (double)sum / (double)((right - left) * (bottom - top));
+}
+
+    /// True if the left image has enough detail in columns FIRSTX to ENDX - 1 to be worth matching.
+static bool bandHasDetail(const Level *level, long firstX, long endX) {
+    int64_t sum = 0, deviation = 0;
+    long count = (endX - firstX) * (long)level->height;
+    for (size_t y = 0; y < level->height; y++) {
+        const int16_t *row = level->left + y * level->width;
+        for (long x = firstX; x < endX; x++) {
+            sum += row[x];
+        }
+    }
+    int16_t mean = (int16_t)(sum / count);
+    for (size_t y = 0; y < level->height; y++) {
+        const int16_t *row = level->left + y * level->width;
+        for (long x = firstX; x < endX; x++) {
+            deviation += abs(row[x] - mean);
+        }
+    }
+    return deviation >= (int64_t)MinimumDetail * count;
+}
+
+    /// Everything the threads need to match the bands, and what they find.
+typedef struct MatchJob {
+    const Level *levels;
+    size_t levelCount;
+        /// Vertical shift of each band in rows of the finest level, and whether the band could be matched at all.
+    double shiftY[BandCount];
+    bool matched[BandCount];
+} MatchJob;
+
+    /// Try every shift within RADIUS of (*DXPTR, *DYPTR) for the band and leave the best in them. Returns its cost.
+static double searchBand(const Level *level, long firstX, long endX, long radiusX, long radiusY, long *dxPtr, long *dyPtr) {
+    long centreX = *dxPtr, centreY = *dyPtr;
+    double bestCost = HUGE_VAL;
+    for (long dy = centreY - radiusY; dy <= centreY + radiusY; dy++) {
+        for (long dx = centreX - radiusX; dx <= centreX + radiusX; dx++) {
+            double cost = bandCost(level, firstX, endX, dx, dy);
+                // Ties go to the smaller shift, so a featureless area doesn't drift.
+            if (cost < bestCost || (cost == bestCost && labs(dy) + labs(dx) < labs(*dyPtr) + labs(*dxPtr))) {
+                bestCost = cost;
+                *dxPtr = dx;
+                *dyPtr = dy;
+            }
+        }
+    }
+    return bestCost;
+}
+
+static void matchBand(void *context, size_t band) {
+    MatchJob *job = context;
+    const Level *finest = &job->levels[0];
+    if (!bandHasDetail(finest, (long)(band * finest->width / BandCount), (long)((band + 1) * finest->width / BandCount))) {
+        job->matched[band] = false;
+        return;
+    }
+        // Search widely at the coarsest level. The horizontal range allows for the parallax of near objects.
+    size_t level = job->levelCount - 1;
+    const Level *coarsest = &job->levels[level];
+    long dx = 0, dy = 0;
+    double cost = searchBand(coarsest, (long)(band * coarsest->width / BandCount), (long)((band + 1) * coarsest->width / BandCount),
+                             (long)coarsest->width / 4, (long)coarsest->height / 8, &dx, &dy);
+        // Each finer level doubles the shift and only needs to correct it by a pixel.
+    while (level-- > 0 && cost < HUGE_VAL) {
+        const Level *finer = &job->levels[level];
+        dx *= 2;
+        dy *= 2;
+        cost = searchBand(finer, (long)(band * finer->width / BandCount), (long)((band + 1) * finer->width / BandCount), 1, 1, &dx, &dy);
+    }
+    if (cost == HUGE_VAL) {
+        job->matched[band] = false;
+        return;
+    }
+        // Fit a parabola through the costs either side of the best row to get a fraction of a row.
+    long firstX = (long)(band * finest->width / BandCount), endX = (long)((band + 1) * finest->width / BandCount);
+    double above = bandCost(finest, firstX, endX, dx, dy - 1), below = bandCost(finest, firstX, endX, dx, dy + 1);
+    double curvature = above - 2 * cost + below, fraction = 0;
+    if (above < HUGE_VAL && below < HUGE_VAL && curvature > 0) {
+        fraction = (above - below) / (2 * curvature);
+    }
+    job->shiftY[band] = dy + fraction;
+    job->matched[band] = true;
+}
+
+    /// Least-squares fit of SHIFTY = INTERCEPT + SLOPE * X over the bands in USE. Returns false if no band is in use.
+static bool fitLine(const double x[BandCount], const double shiftY[BandCount], const bool use[BandCount],
+                    double *interceptPtr, double *slopePtr) {
+    double count = 0, meanX = 0, meanY = 0;
+    for (int band = 0; band < BandCount; band++) {
+        if (use[band]) {
+            count++;
+            meanX += x[band];
+            meanY += shiftY[band];
+        }
+    }
+    if (count == 0) {
+        return false;
+    }
+    meanX /= count;
+    meanY /= count;
+    double covariance = 0, variance = 0;
+    for (int band = 0; band < BandCount; band++) {
+        if (use[band]) {
+            covariance += (x[band] - meanX) * (shiftY[band] - meanY);
+            variance   += (x[band] - meanX) * (x[band] - meanX);
+        }
+    }
+        // With one band (or all of them in one place) there is no way to tell a rotation, so assume none.
+    *slopePtr = variance > 0 ? covariance / variance : 0;
+    *interceptPtr = meanY - *slopePtr * meanX;
+    return true;
+}
+
+PWError PWAlignEstimate(const PWImageBuffer *left, const PWImageBuffer *right, PWAlignment *alignment) {
+    if (!left || !right || !alignment) {
+        return PWError_InvalidParameter;
+    }
+    size_t width = left->width < WorkingWidth ? left->width : WorkingWidth;
+    size_t height = (size_t)lround((double)left->height * width / left->width);
+    if (width < CoarsestWidth || height < CoarsestWidth / 4) {
+        return PWError_InvalidParameter;
+    }
+    Level levels[MaximumLevels];
+    size_t levelCount = buildPyramid(createScaledLuma(left, width, height), createScaledLuma(right, width, height), levels);
+    if (levelCount == 0) {
+        return PWError_OutOfMemory;
+    }
+    MatchJob job = { .levels = levels, .levelCount = levelCount };
+    PWParallelFor(BandCount, &job, matchBand);
+    freeLevels(levels, levelCount);
+
+        // Measure the bands from the centre of the image, so the intercept is the offset at the centre.
+    double x[BandCount];
+    for (int band = 0; band < BandCount; band++) {
+        x[band] = (band + 0.5) * width / BandCount - width / 2.0;
+    }
+    double intercept, slope;
+    if (!fitLine(x, job.shiftY, job.matched, &intercept, &slope)) {
+        return PWError_NotSupported;
+    }
+        // One band can easily be fooled, e.g. by something that moved between the shots. If it is well off the line, leave it out.
+    int usedCount = 0, worstBand = -1;
+    double worstDistance = 0;
+    for (int band = 0; band < BandCount; band++) {
+        if (job.matched[band]) {
+            usedCount++;
+            double distance = fabs(job.shiftY[band] - (intercept + slope * x[band]));
+            if (distance > worstDistance) {
+                worstDistance = distance;
+                worstBand = band;
+            }
+        }
+    }
+    if (usedCount >= 4 && worstDistance > OutlierRows) {
+        job.matched[worstBand] = false;
+        fitLine(x, job.shiftY, job.matched, &intercept, &slope);
+    }
+    double squares = 0;
+    usedCount = 0;
+    for (int band = 0; band < BandCount; band++) {
+        if (job.matched[band]) {
+            double distance = job.shiftY[band] - (intercept + slope * x[band]);
+            squares += distance * distance;
+            usedCount++;
+        }
+    }
+
+        // Scale from the working size back up to the photos.
+    double scaleX = (double)left->width / width, scaleY = (double)left->height / height;
+    alignment->verticalOffset = intercept * scaleY;
+    alignment->rotation = atan(slope * scaleY / scaleX);
+    alignment->residual = sqrt(squares / usedCount) * scaleY;
+    return PWError_None;
+}
+
+// MARK: - Correction
+
+    /// Everything the threads need to rotate one plane of a photo. Coordinates are of pixel centres within the plane.
+typedef struct WarpJob {
+    const uint8_t *source;
+    size_t sourceBytesPerRow, sourceWidth, sourceHeight;
+    uint8_t *destination;
+    size_t destinationBytesPerRow, width, height;
+    size_t channels;
+    double centreX, centreY, sine, cosine, shiftY;
+} WarpJob;
+
+    /// Bilinear sample of the source at (FX, FY) in 16.16 fixed point. Positions outside the plane take the nearest edge pixel.
+static inline void samplePixel(const WarpJob *job, int32_t fx, int32_t fy, uint8_t *output) {
+    int32_t maxX = (int32_t)(job->sourceWidth - 1) << 16, maxY = (int32_t)(job->sourceHeight - 1) << 16;
+    fx = fx < 0 ? 0 : fx > maxX ? maxX : fx;
+    fy = fy < 0 ? 0 : fy > maxY ? maxY : fy;
+    size_t x0 = (size_t)(fx >> 16), y0 = (size_t)(fy >> 16);
+    size_t x1 = x0 + 1 < job->sourceWidth ? x0 + 1 : x0, y1 = y0 + 1 < job->sourceHeight ? y0 + 1 : y0;
+    uint32_t ax = (uint32_t)(fx >> 8) & 255, ay = (uint32_t)(fy >> 8) & 255;
+    const uint8_t *top = job->source + y0 * job->sourceBytesPerRow, *bottom = job->source + y1 * job->sourceBytesPerRow;
+    size_t channels = job->channels;
+    for (size_t c = 0; c < channels; c++) {
+        uint32_t upper = top[x0 * channels + c] * (256 - ax) + top[x1 * channels + c] * ax;
+        uint32_t lower = bottom[x0 * channels + c] * (256 - ax) + bottom[x1 * channels + c] * ax;
+        output[c] = (uint8_t)((upper * (256 - ay) + lower * ay + 32768) >> 16);
+    }
+}
+
+static void warpBand(void *context, size_t band) {
+    const WarpJob *job = context;
+    size_t firstY = band * BandRows, endY = firstY + BandRows < job->height ? firstY + BandRows : job->height;
+        // Along a row the source position moves by (cos, sin) per pixel, so it is stepped in fixed point rather than recomputed.
+    int32_t stepX = (int32_t)lround(job->cosine * 65536), stepY = (int32_t)lround(job->sine * 65536);
+    for (size_t y = firstY; y < endY; y++) {
+        double relativeY = y - job->centreY;
+        double startX = job->centreX - job->centreX * job->cosine - relativeY * job->sine;
+        double startY = job->centreY - job->centreX * job->sine + relativeY * job->cosine + job->shiftY;
+        int32_t fx = (int32_t)lround(startX * 65536), fy = (int32_t)lround(startY * 65536);
+        uint8_t *row = job->destination + y * job->destinationBytesPerRow;
+        for (size_t x = 0; x < job->width; x++, fx += stepX, fy += stepY) {
+            samplePixel(job, fx, fy, row + x * job->channels);
+        }
+    }
+}
+
+static void warpPlane(uint8_t *destination, size_t destinationBytesPerRow, const uint8_t *source, size_t sourceBytesPerRow,
+                      size_t width, size_t height, size_t channels, double sine, double cosine, double shiftY) {
+    WarpJob job = {
+        .source = source, .sourceBytesPerRow = sourceBytesPerRow, .sourceWidth = width, .sourceHeight = height,
+        .destination = destination, .destinationBytesPerRow = destinationBytesPerRow, .width = width, .height = height,
+        .channels = channels, .centreX = (width - 1) / 2.0, .centreY = (height - 1) / 2.0,
+        .sine = sine, .cosine = cosine, .shiftY = shiftY
+    };
+    PWParallelFor((height + BandRows - 1) / BandRows, &job, warpBand);
+}
+
+    /// A copy of SOURCE turned by ROTATION and moved up by VERTICALOFFSET, so that it lines up with the left photo.
+static PWImageBuffer *createCorrected(const PWImageBuffer *source, PWAlignment alignment) {
+    PWImageBuffer *corrected = PWImageBufferCreate(source->width, source->height, source->format);
+    if (!corrected) {
+        return NULL;
+    }
+    double sine = sin(alignment.rotation), cosine = cos(alignment.rotation);
+    warpPlane(corrected->data, corrected->bytesPerRow, source->data, source->bytesPerRow, source->width, source->height,
+              PWPixelFormatBytesPerPixel(source->format), sine, cosine, alignment.verticalOffset);
+    if (PWPixelFormatIsPlanar(source->format)) {
+        size_t chromaWidth = (source->width + 1) / 2, chromaHeight = (source->height + 1) / 2;
+        for (int plane = 0; plane < 2; plane++) {
+            warpPlane(corrected->chroma[plane], corrected->chromaBytesPerRow, source->chroma[plane], source->chromaBytesPerRow,
+                      chromaWidth, chromaHeight, 1, sine, cosine, alignment.verticalOffset / 2);
+        }
+    }
+    return corrected;
+}
+
+    /// Set the outputs to views of LEFT and RIGHT inside LEFTRECT and RIGHTRECT.
+static PWError createViews(PWImageBuffer *left, PWImageBuffer *right, PWImageRect leftRect, PWImageRect rightRect,
+                           PWImageBuffer **leftOutput, PWImageBuffer **rightOutput) {
+    *leftOutput  = PWImageBufferCreateSubImage(left, leftRect);
+    *rightOutput = PWImageBufferCreateSubImage(right, rightRect);
+    if (!*leftOutput || !*rightOutput) {
+        PWImageBufferRelease(*leftOutput);
+        PWImageBufferRelease(*rightOutput);
+        *leftOutput = *rightOutput = NULL;
+        return PWError_OutOfMemory;
+    }
+    return PWError_None;
+}
+
+    /// VALUE rounded up to a whole, even number of pixels.
+static size_t evenPixels(double value) {
+    size_t pixels = value > 0 ? (size_t)ceil(value) : 0;
+    return (pixels + 1) & ~(size_t)1;
+}
+
+PWError PWAlignCreateCorrectedPair(PWImageBuffer *left, PWImageBuffer *right, PWAlignment alignment,
+                                   PWImageBuffer **leftOutput, PWImageBuffer **rightOutput) {
+    if (!leftOutput || !rightOutput) {
+        return PWError_InvalidParameter;
+    }
+    *leftOutput = *rightOutput = NULL;
+    if (!left || !right) {
+        return PWError_InvalidParameter;
+    }
+    size_t width  = left->width  < right->width  ? left->width  : right->width;
+    size_t height = left->height < right->height ? left->height : right->height;
+    double sine = sin(alignment.rotation), offset = alignment.verticalOffset;
+
+        // How far the rotation moves the pixels furthest from the centre.
+    if (fabs(sine) * (width > height ? width : height) / 2 < 0.5) {
+        long rows = lround(offset);
+        if (PWPixelFormatIsPlanar(left->format) || PWPixelFormatIsPlanar(right->format)) {
+            rows = rows / 2 * 2;
+        }
+        if (rows == 0) {
+            *leftOutput  = PWImageBufferRetain(left);
+            *rightOutput = PWImageBufferRetain(right);
+            return PWError_None;
+        }
+        size_t shift = (size_t)labs(rows);
+        if (shift >= height) {
+            return PWError_InvalidParameter;
+        }
+            // Row Y of the left photo matches row Y + ROWS of the right, so leave out the top of whichever is lower.
+        PWImageRect leftRect  = { 0, rows < 0 ? shift : 0, left->width,  height - shift };
+        PWImageRect rightRect = { 0, rows > 0 ? shift : 0, right->width, height - shift };
+        return createViews(left, right, leftRect, rightRect, leftOutput, rightOutput);
+    }
+
+        // Crop away the rows and columns the rotated photo doesn't cover, which were filled from its edges.
+    double spillRows = fabs(sine) * width / 2, spillColumns = fabs(sine) * height / 2;
+    size_t top = evenPixels(spillRows - offset), bottom = evenPixels(spillRows + offset), side = evenPixels(spillColumns);
+    if (2 * side >= width || top + bottom >= height) {
+        return PWError_InvalidParameter;
+    }
+    PWImageBuffer *corrected = createCorrected(right, alignment);
+    if (!corrected) {
+        return PWError_OutOfMemory;
+    }
+    PWImageRect rect = { side, top, width - 2 * side, height - top - bottom };
+    PWError error = createViews(left, corrected, rect, rect, leftOutput, rightOutput);
+    PWImageBufferRelease(corrected);
+    return error;
+}
@@ -0,0 +1,76 @@
+/*!
+ @header PWAlign
+ @abstract Measures and corrects the vertical misalignment between the two photos of a handheld stereo pair.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ When the two photos are taken one after the other the camera is rarely held level, so one photo ends up a little
+ higher than the other or slightly rotated. Horizontal differences are what give the depth, but vertical ones make the
+ pair hard to fuse.
+
+ The estimate works on the luma alone, scaled down to at most 512 pixels wide and then halved repeatedly into a pyramid.
+ The image is split into vertical bands, and for each band the horizontal and vertical shift that best lines up the two
+ photos is found by a full search at the coarsest level, then refined by one pixel at each finer level. The search
+ compares 16-bit rows with a sum of absolute differences, which the compiler vectorises. Each band's search allows for
+ its own horizontal shift, since nearer objects have more parallax. Fitting a line to the bands' vertical shifts gives
+ the offset (where the line crosses the centre) and the rotation (its slope).
+ */
+
+#ifndef PWAlign_h
+#define PWAlign_h
+
+#include "PWImageBuffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * How the right photo is out of line with the left one, in pixels of the photos passed to PWAlignEstimate().
+ *
+ * A point at column X of the left photo is found VERTICALOFFSET + (X - width / 2) * tan(ROTATION) rows further down in
+ * the right photo, so a positive rotation means the right photo is turned clockwise.
+ */
+typedef struct PWAlignment {
+        /*! Rows the right photo is below the left one at the centre of the image. */
+    double verticalOffset;
+        /*! Clockwise rotation of the right photo relative to the left, in radians. */
+    double rotation;
+        /*! Set by PWAlignEstimate(): the RMS distance in rows between the bands' shifts and the fitted line.
+         *  Large values mean the photos didn't match well and the estimate shouldn't be trusted. Ignored elsewhere. */
+    double residual;
+} PWAlignment;
+
+/*!
+ * Estimate the misalignment of RIGHT relative to LEFT.
+ *
+ * The photos may be in any pixel format, and need not be in the same one, but should be the same size.
+ * Only the scaling down depends on the size of the photos; the search itself always works at 512 pixels wide or less.
+ *
+ * @return PWError_None, PWError_InvalidParameter if a photo is missing or too small, PWError_NotSupported if no part
+ *         of the image has enough detail to line up, or PWError_OutOfMemory.
+ */
+PWError PWAlignEstimate(const PWImageBuffer *left, const PWImageBuffer *right, PWAlignment *alignment);
+
+/*!
+ * Make a version of LEFT and RIGHT with ALIGNMENT taken out, for compositing.
+ *
+ * A vertical offset alone is removed without copying anything, by taking views of the photos which leave out rows from
+ * the top of one and the bottom of the other. A rotation means making a rotated copy of RIGHT with bilinear filtering,
+ * after which both photos are cropped by the same amount to remove the edges the rotation moved in from outside.
+ * Either way the outputs are the same size. If ALIGNMENT would move no pixel by as much as half a pixel, the outputs
+ * are just LEFT and RIGHT, retained. The crops, and for YCbCr420 the offset,
+ * are rounded to even pixels.
+ *
+ * @param leftOutput  Receives the corrected left photo, which the caller must release. Set to NULL on failure.
+ * @param rightOutput Receives the corrected right photo, as for LEFTOUTPUT.
+ * @return PWError_None, PWError_InvalidParameter if the correction would leave nothing of the photos, or PWError_OutOfMemory.
+ */
+PWError PWAlignCreateCorrectedPair(PWImageBuffer *left, PWImageBuffer *right, PWAlignment alignment,
+                                   PWImageBuffer **leftOutput, PWImageBuffer **rightOutput);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWAlign_h */
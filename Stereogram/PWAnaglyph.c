@@ -0,0 +1,143 @@
+//
+//  PWAnaglyph.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWAnaglyph.h"
+#include "PWParallel.h"
+
+#include <math.h>
+
+    /// The mixing weights are in 4.12 fixed point, small enough for 16 bits so that the multiplies are 16-bit vector operations.
+enum { MixBits = 12, MixRound = 1 << (MixBits - 1) };
+
+    /// Pixels are converted to RGBX this many at a time, so the converted left and right pixels stay in the L1 cache.
+enum { ChunkPixels = 256 };
+
+    /// Rows handed to each call from PWParallelFor().
+enum { BandRows = 16 };
+
+/*!
+ * Output red, green and blue (the rows) as a mix of the left photo's R, G, B and then the right photo's R, G, B (the columns).
+ *
+ * The optimised weights are from E. Dubois, "A projection method to generate anaglyph stereo images" (ICASSP 2001),
+ * for typical red/cyan glasses. They are applied to the gamma-encoded values, as most viewers do.
+ */
+static const double Mixes[PWAnaglyph_NUM_METHODS][3][6] = {
+    [PWAnaglyph_Colour] = {
+        { 1, 0, 0,   0, 0, 0 },
+        { 0, 0, 0,   0, 1, 0 },
+        { 0, 0, 0,   0, 0, 1 }
+    },
+    [PWAnaglyph_HalfColour] = {
+        { 0.299, 0.587, 0.114,   0, 0, 0 },
+        { 0,     0,     0,       0, 1, 0 },
+        { 0,     0,     0,       0, 0, 1 }
+    },
+    [PWAnaglyph_Optimised] = {
+        {  0.456,  0.500,  0.176,   -0.043, -0.088, -0.002 },
+        { -0.040, -0.038, -0.016,    0.378,  0.734, -0.018 },
+        { -0.015, -0.021, -0.005,   -0.072, -0.113,  1.226 }
+    }
+};
+
+static inline uint8_t clampMix(int32_t value) {
+    return value <= 0 ? 0 : value >= (255 << MixBits) ? 255 : (uint8_t)(value >> MixBits);
+}
+
+    /// Everything the threads need to make one anaglyph.
+typedef struct AnaglyphJob {
+    const PWImageBuffer *left, *right;
+    PWImageBuffer *output;
+    int16_t mix[3][6];
+        /// True for PWAnaglyph_Colour, where each output channel is just copied from one of the photos.
+    bool pickChannels;
+} AnaglyphJob;
+
+    /// Split COUNT RGBX pixels into separate red, green and blue arrays, so the mixing loop reads each with unit stride.
+static void splitChannels(const uint8_t *pixels, size_t count, int16_t planes[3][ChunkPixels]) {
+    for (size_t x = 0; x < count; x++) {
+        planes[0][x] = pixels[x * 4];
+        planes[1][x] = pixels[x * 4 + 1];
+        planes[2][x] = pixels[x * 4 + 2];
+    }
+}
+
+    /// Mix COUNT pixels of the LEFT and RIGHT channel arrays into OUTPUT (RGB). Each output channel is worked out for the
+    /// whole chunk in turn, so every loop is a plain multiply-add over arrays that the compiler vectorises.
+static void mixPixels(const int16_t left[3][ChunkPixels], const int16_t right[3][ChunkPixels], uint8_t *output, size_t count,
+                      const int16_t mix[3][6]) {
+    uint8_t mixed[3][ChunkPixels];
+    for (int channel = 0; channel < 3; channel++) {
+        const int16_t *weights = mix[channel];
+        const int16_t l0 = weights[0], l1 = weights[1], l2 = weights[2], r0 = weights[3], r1 = weights[4], r2 = weights[5];
+        uint8_t *out = mixed[channel];
+        for (size_t x = 0; x < count; x++) {
+            out[x] = clampMix(MixRound + l0 * left[0][x] + l1 * left[1][x] + l2 * left[2][x]
+                                       + r0 * right[0][x] + r1 * right[1][x] + r2 * right[2][x]);
+        }
+    }
+    for (size_t x = 0; x < count; x++) {
+        output[x * 3]     = mixed[0][x];
+        output[x * 3 + 1] = mixed[1][x];
+        output[x * 3 + 2] = mixed[2][x];
+    }
+}
+
+static void pickChannels(const uint8_t *left, const uint8_t *right, uint8_t *output, size_t count) {
+    for (size_t x = 0; x < count; x++, left += 4, right += 4, output += 3) {
+        output[0] = left[0];
+        output[1] = right[1];
+        output[2] = right[2];
+    }
+}
+
+static void makeBand(void *context, size_t band) {
+    const AnaglyphJob *job = context;
+    const PWImageBuffer *left = job->left, *right = job->right;
+    PWImageBuffer *output = job->output;
+    size_t firstY = band * BandRows, endY = firstY + BandRows < output->height ? firstY + BandRows : output->height;
+    uint8_t leftPixels[ChunkPixels * 4], rightPixels[ChunkPixels * 4];
+    int16_t leftPlanes[3][ChunkPixels], rightPlanes[3][ChunkPixels];
+    for (size_t y = firstY; y < endY; y++) {
+        uint8_t *row = PWImageBufferRow(output, y);
+        for (size_t x = 0; x < output->width; x += ChunkPixels) {
+            size_t count = output->width - x < ChunkPixels ? output->width - x : ChunkPixels;
+            PWImageBufferConvertRowToRGBX(left, y, x, count, leftPixels);
+            PWImageBufferConvertRowToRGBX(right, y, x, count, rightPixels);
+            if (job->pickChannels) {
+                pickChannels(leftPixels, rightPixels, row + x * 3, count);
+            } else {
+                splitChannels(leftPixels, count, leftPlanes);
+                splitChannels(rightPixels, count, rightPlanes);
+                mixPixels(leftPlanes, rightPlanes, row + x * 3, count, job->mix);
+            }
+        }
+    }
+}
+
+PWImageBuffer *PWAnaglyphCreate(const PWImageBuffer *left, const PWImageBuffer *right, PWAnaglyphMethod method) {
+    if (!left || !right || (unsigned)method >= PWAnaglyph_NUM_METHODS) {
+        return NULL;
+    }
+    size_t width = left->width < right->width ? left->width : right->width;
+    size_t height = left->height < right->height ? left->height : right->height;
+    if (width == 0 || height == 0) {
+        return NULL;
+    }
+    AnaglyphJob job = { .left = left, .right = right, .pickChannels = (method == PWAnaglyph_Colour) };
+    job.output = PWImageBufferCreate(width, height, PWPixelFormat_RGB888);
+    if (!job.output) {
+        return NULL;
+    }
+    for (int channel = 0; channel < 3; channel++) {
+        for (int source = 0; source < 6; source++) {
+            job.mix[channel][source] = (int16_t)lround(Mixes[method][channel][source] * (1 << MixBits));
+        }
+    }
+    PWParallelFor((height + BandRows - 1) / BandRows, &job, makeBand);
+    return job.output;
+}
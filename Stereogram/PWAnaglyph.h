@@ -0,0 +1,54 @@
+/*!
+ @header PWAnaglyph
+ @abstract Red/cyan anaglyphs made straight from the left and right photos.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ An anaglyph puts both photos into one image of the same size as either of them: the left photo is seen through the
+ red filter of the glasses and the right through the cyan one. Each output pixel is a fixed mix of the left and right
+ pixels at the same position, so the kernel reads a row of each photo and writes a row of the result in one pass,
+ without ever building the double-width side-by-side image.
+ */
+
+#ifndef PWAnaglyph_h
+#define PWAnaglyph_h
+
+#include "PWImageBuffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * @enum
+ * @brief How the colours of the two photos are mixed.
+ * @constant PWAnaglyph_Colour     Red from the left photo, green and blue from the right. Keeps the most colour, but
+ *                                 bright reds and cyans are seen by only one eye, which can shimmer.
+ * @constant PWAnaglyph_HalfColour As PWAnaglyph_Colour, but the red channel is the left photo's luminance. Less colour
+ *                                 and less shimmer.
+ * @constant PWAnaglyph_Optimised  Eric Dubois's least-squares mix for red/cyan glasses, which cancels most of the
+ *                                 ghosting from light leaking through the wrong filter.
+ */
+typedef enum PWAnaglyphMethod {
+    PWAnaglyph_Colour,
+    PWAnaglyph_HalfColour,
+    PWAnaglyph_Optimised,
+
+    PWAnaglyph_NUM_METHODS
+} PWAnaglyphMethod;
+
+/*!
+ * Make a red/cyan anaglyph of LEFT and RIGHT.
+ *
+ * The photos may be in any pixel format, and need not be in the same one. If they differ in size, only the area
+ * they share from the top-left corner is used. The rows are shared out between threads with PWParallelFor().
+ *
+ * @return A new RGB888 buffer, or NULL on failure.
+ */
+PWImageBuffer *PWAnaglyphCreate(const PWImageBuffer *left, const PWImageBuffer *right, PWAnaglyphMethod method);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWAnaglyph_h */
@@ -0,0 +1,181 @@
+//
+//  PWBufferPool.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWBufferPool.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+    /// Size classes per doubling of size. Each class is at most 1/ClassesPerOctave bigger than the sizes rounded up to it.
+enum { ClassesPerOctave = 8, ClassShift = 3 };
+
+    /// log2 of PWBufferPoolMinimumSize, the smallest class, and of the largest. Anything bigger isn't pooled.
+enum { MinimumSizeShift = 16, MaximumSizeShift = 47 };
+
+enum { BinCount = (MaximumSizeShift - MinimumSizeShift) * ClassesPerOctave + 1 };
+
+    /// The start of every pooled block, before the memory handed out. Padded to keep that memory 16-byte aligned.
+typedef union BlockHeader {
+    struct {
+            /// The block's size class, which may be bigger than the one asked for.
+        size_t bin;
+            /// The next idle block in the same bin.
+        union BlockHeader *next;
+    } link;
+    uint8_t padding[16];
+} BlockHeader;
+
+    /// Everything below is protected by poolLock.
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static BlockHeader *bins[BinCount];
+static size_t limit = PWBufferPoolDefaultLimit;
+static PWBufferPoolStatistics statistics;
+
+static unsigned floorLog2(size_t value) {
+    unsigned log = 0;
+    while (value >>= 1) {
+        log++;
+    }
+    return log;
+}
+
+    /// The size class SIZE rounds up to: its bin and the size of the blocks in it. False if SIZE isn't pooled.
+static bool sizeClass(size_t size, size_t *bin, size_t *classSize) {
+    if (size < PWBufferPoolMinimumSize || (uint64_t)size > (uint64_t)1 << MaximumSizeShift) {
+        return false;
+    }
+    size_t step = (size_t)1 << (floorLog2(size) - ClassShift);
+    size_t rounded = (size + step - 1) & ~(step - 1);
+    unsigned shift = floorLog2(rounded);
+    *bin = (shift - MinimumSizeShift) * ClassesPerOctave + ((rounded >> (shift - ClassShift)) - ClassesPerOctave);
+    *classSize = rounded;
+    return true;
+}
+
+    /// Size of the blocks in BIN. The inverse of sizeClass().
+static size_t binSize(size_t bin) {
+    size_t shift = MinimumSizeShift + bin / ClassesPerOctave;
+    return (ClassesPerOctave + bin % ClassesPerOctave) << (shift - ClassShift);
+}
+
+    /// Free idle blocks, the largest first, until no more than BYTESTOKEEP bytes are held. Call with poolLock held.
+static void trimLocked(size_t bytesToKeep) {
+    for (size_t bin = BinCount; bin-- > 0 && statistics.idleBytes > bytesToKeep; ) {
+        size_t size = binSize(bin);
+        while (bins[bin] && statistics.idleBytes > bytesToKeep) {
+            BlockHeader *block = bins[bin];
+            bins[bin] = block->link.next;
+            free(block);
+            statistics.idleBlocks--;
+            statistics.idleBytes -= size;
+            statistics.trimmedBlocks++;
+            statistics.trimmedBytes += size;
+        }
+    }
+}
+
+void *PWBufferPoolAllocate(size_t size) {
+    size_t bin, classSize;
+    if (!sizeClass(size, &bin, &classSize)) {
+        return malloc(size);
+    }
+    pthread_mutex_lock(&poolLock);
+        // A block of the next class up will do as well. The width of a stereogram changes with its depth, and this
+        // lets the sizes either side of a class boundary share blocks, for at most a quarter of a block unused.
+    BlockHeader *block = NULL;
+    for (size_t candidate = bin; !block && candidate <= bin + 1 && candidate < BinCount; candidate++) {
+        block = bins[candidate];
+        if (block) {
+            bins[candidate] = block->link.next;
+            statistics.idleBlocks--;
+            statistics.idleBytes -= binSize(candidate);
+        }
+    }
+    if (block) {
+        statistics.hits++;
+    } else {
+        statistics.misses++;
+    }
+    pthread_mutex_unlock(&poolLock);
+    if (!block) {
+            // Allocate the whole class, so the block can be handed out again for any size that rounds up to it.
+        block = malloc(sizeof(BlockHeader) + classSize);
+        if (!block) {
+            return NULL;
+        }
+        block->link.bin = bin;
+    }
+    return block + 1;
+}
+
+void PWBufferPoolRecycle(void *memory, size_t size) {
+    size_t bin, classSize;
+    if (!memory) {
+        return;
+    }
+    if (!sizeClass(size, &bin, &classSize)) {
+        free(memory);
+        return;
+    }
+    BlockHeader *block = (BlockHeader *)memory - 1;
+    bin = block->link.bin;
+    classSize = binSize(bin);
+    pthread_mutex_lock(&poolLock);
+    bool keep = statistics.idleBytes + classSize <= limit;
+    if (keep) {
+        block->link.next = bins[bin];
+        bins[bin] = block;
+        statistics.idleBlocks++;
+        statistics.idleBytes += classSize;
+        if (statistics.idleBytes > statistics.peakIdleBytes) {
+            statistics.peakIdleBytes = statistics.idleBytes;
+        }
+        statistics.recycled++;
+    } else {
+        statistics.discarded++;
+    }
+    pthread_mutex_unlock(&poolLock);
+    if (!keep) {
+        free(block);
+    }
+}
+
+void PWBufferPoolTrim(size_t bytesToKeep) {
+    pthread_mutex_lock(&poolLock);
+    trimLocked(bytesToKeep);
+    pthread_mutex_unlock(&poolLock);
+}
+
+size_t PWBufferPoolLimit(void) {
+    pthread_mutex_lock(&poolLock);
+    size_t bytes = limit;
+    pthread_mutex_unlock(&poolLock);
+    return bytes;
+}
+
+void PWBufferPoolSetLimit(size_t bytes) {
+    pthread_mutex_lock(&poolLock);
+    limit = bytes;
+    trimLocked(bytes);
+    pthread_mutex_unlock(&poolLock);
+}
+
+void PWBufferPoolGetStatistics(PWBufferPoolStatistics *result) {
+    pthread_mutex_lock(&poolLock);
+    *result = statistics;
+    pthread_mutex_unlock(&poolLock);
+}
+
+void PWBufferPoolResetStatistics(void) {
+    pthread_mutex_lock(&poolLock);
+    PWBufferPoolStatistics current = { .idleBlocks = statistics.idleBlocks, .idleBytes = statistics.idleBytes,
+                                       .peakIdleBytes = statistics.idleBytes };
+    statistics = current;
+    pthread_mutex_unlock(&poolLock);
+}
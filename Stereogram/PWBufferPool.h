@@ -0,0 +1,84 @@
+/*!
+ @header PWBufferPool
+ @abstract Keeps the pixel memory of released image buffers for the next image of about the same size.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ Browsing the library decodes and composites the same few sizes of image over and over: every photo from the camera
+ is the same size, and a stereogram only changes width when its depth is changed. Each of those images takes several
+ megabytes, which the allocator hands back to the system when it is freed and the kernel has to fault in again, page
+ by page, when the next one is written. PWImageBufferCreate() takes its pixel memory from this pool instead, and
+ PWImageBufferRelease() gives it back, so once the sizes in use have been seen, regenerating an image or switching
+ viewing method allocates nothing new.
+
+ Blocks are kept in size classes eight to each doubling of size. An allocation takes an idle block of its own class or
+ the next one up, so images a few columns apart share blocks and at most a quarter of a block goes unused. Blocks
+ smaller than PWBufferPoolMinimumSize aren't pooled, as the allocator already does well with them. The pool holds at
+ most PWBufferPoolLimit() bytes of idle blocks and should be emptied with PWBufferPoolTrim() when memory runs low.
+ All the functions are thread-safe.
+ */
+
+#ifndef PWBufferPool_h
+#define PWBufferPool_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Blocks smaller than this many bytes are allocated and freed as usual, and don't count in the statistics. */
+enum { PWBufferPoolMinimumSize = 64 * 1024 };
+
+/*! Bytes of idle blocks the pool holds at most by default: enough for the photos and composites of a few stereograms. */
+enum { PWBufferPoolDefaultLimit = 64 * 1024 * 1024 };
+
+/*! How well the pool is working. See PWBufferPoolGetStatistics(). */
+typedef struct PWBufferPoolStatistics {
+        /*! Allocations answered with an idle block, and those which had to allocate a new one. */
+    uint64_t hits, misses;
+        /*! Blocks given back and kept for reuse, and those freed because the pool was full. */
+    uint64_t recycled, discarded;
+        /*! Blocks and bytes freed by PWBufferPoolTrim(). */
+    uint64_t trimmedBlocks, trimmedBytes;
+        /*! Idle blocks held now, the bytes they take, and the most bytes held at once. */
+    size_t idleBlocks, idleBytes, peakIdleBytes;
+} PWBufferPoolStatistics;
+
+/*!
+ * Return a block of at least SIZE bytes, reusing an idle one of the same size class if there is one.
+ * The contents are undefined. Give the block back with PWBufferPoolRecycle() and the same SIZE.
+ *
+ * @return The block, or NULL if it couldn't be allocated.
+ */
+void *PWBufferPoolAllocate(size_t size);
+
+/*!
+ * Give back a block from PWBufferPoolAllocate(), keeping it for reuse unless that would take the pool over its limit.
+ *
+ * @param memory The block. NULL is ignored.
+ * @param size   The size that was asked for when it was allocated.
+ */
+void PWBufferPoolRecycle(void *memory, size_t size);
+
+/*! Free idle blocks, the largest first, until the pool holds no more than BYTESTOKEEP bytes. Pass 0 to empty it. */
+void PWBufferPoolTrim(size_t bytesToKeep);
+
+/*! The most bytes of idle blocks the pool holds. */
+size_t PWBufferPoolLimit(void);
+
+/*! Change the most bytes of idle blocks the pool holds, trimming it if need be. 0 turns pooling off. */
+void PWBufferPoolSetLimit(size_t bytes);
+
+/*! Copy the pool's counters into STATISTICS. */
+void PWBufferPoolGetStatistics(PWBufferPoolStatistics *statistics);
+
+/*! Set the counters back to 0, except for those describing the idle blocks held now. */
+void PWBufferPoolResetStatistics(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWBufferPool_h */
@@ -0,0 +1,451 @@
+//
+//  PWDisparity.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWDisparity.h"
+#include "PWParallel.h"
+#include "PWResample.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+    /// The photos are scaled down to at most this width before matching. Finer maps don't make the animation look any smoother.
+enum { WorkingWidth = 320 };
+
+    /// Each block is this many pixels square at the working size.
+enum { BlockSize = 8 };
+
+    /// Pixels either side of a block which are compared as well, so that a block has enough detail to match.
+enum { WindowMargin = 4 };
+
+    /// The furthest a block may move either way, at the working size.
+enum { MaximumShift = WorkingWidth / 8 };
+
+    /// Windows whose pixels differ from the window's mean by less than this on average have too little detail to match.
+enum { MinimumDetail = 3 };
+
+    /// Photos narrower or shorter than this are refused, as there would hardly be any blocks.
+enum { MinimumSize = 32 };
+
+    /// Rows handed to each call from PWParallelFor() when making a view.
+enum { BandRows = 16 };
+
+    /// A match is only trusted if every shift more than AmbiguousShifts from it costs more than the best by this factor.
+static const double AmbiguityRatio = 1.1;
+enum { AmbiguousShifts = 2 };
+
+// MARK: - Working luma
+
+    /// Scale SOURCE to WIDTH x HEIGHT and write its luma to DESTINATION as 16-bit differences from its mean, so that a
+    /// change of exposure between the two shots doesn't count as a difference. Returns false if memory ran out.
+static bool fillWorkingLuma(int16_t *destination, const PWImageBuffer *source, size_t width, size_t height) {
+    PWImageBuffer *scaled;
+    if (source->format == PWPixelFormat_YCbCr420 || source->format == PWPixelFormat_Gray8) {
+            // The luma plane of a YCbCr image is a greyscale image in its own right, so the chroma need never be read.
+        PWImageBuffer *luma = PWImageBufferCreateWithData(source->data, source->width, source->height, source->bytesPerRow, PWPixelFormat_Gray8);
+        scaled = luma ? PWResampleCreate(luma, width, height, PWResampleFilter_Area) : NULL;
+        PWImageBufferRelease(luma);
+    } else {
+        scaled = PWResampleCreate(source, width, height, PWResampleFilter_Area);
+    }
+    if (!scaled) {
+        return false;
+    }
+    uint8_t pixels[WorkingWidth * 4];
+    uint64_t sum = 0;
+    for (size_t y = 0; y < height; y++) {
+        int16_t *output = destination + y * width;
+        if (scaled->format == PWPixelFormat_Gray8) {
+            const uint8_t *row = PWImageBufferRow(scaled, y);
+            for (size_t x = 0; x < width; x++) {
+                output[x] = row[x];
+            }
+        } else {
+            PWImageBufferConvertRowToRGBX(scaled, y, 0, width, pixels);
+            for (size_t x = 0; x < width; x++) {
+                output[x] = (int16_t)((77 * pixels[x * 4] + 150 * pixels[x * 4 + 1] + 29 * pixels[x * 4 + 2] + 128) >> 8);
+            }
+        }
+        for (size_t x = 0; x < width; x++) {
+            sum += (uint64_t)output[x];
+        }
+    }
+    PWImageBufferRelease(scaled);
+    int16_t mean = (int16_t)((sum + width * height / 2) / (width * height));
+    for (size_t i = 0; i < width * height; i++) {
+        destination[i] -= mean;
+    }
+    return true;
+}
+
+// MARK: - Matching
+
+    /// Everything the threads need to match the blocks, and what they find.
+typedef struct MatchJob {
+    const int16_t *left, *right;
+    long width, height;
+    size_t columns, rows;
+    long maximumShift;
+        /// Shift of each block at the working size, and whether it could be matched.
+    float *shifts;
+    bool *matched;
+} MatchJob;
+
+    /// Sum of the absolute differences of COUNT values. This is where nearly all the time goes, and it vectorises.
+static uint32_t rowDifference(const int16_t *restrict a, const int16_t *restrict b, size_t count) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        int difference = a[i] - b[i];
+        sum += (uint32_t)(difference < 0 ? -difference : difference);
+    }
+    return sum;
+}
+
+    /// The mean absolute difference between the window of the left image from (FIRSTX, FIRSTY) to (ENDX, ENDY) and the
+    /// right image moved DX to the left, over the columns that are in both. HUGE_VAL if they overlap by less than half.
+static double windowCost(const MatchJob *job, long firstX, long endX, long firstY, long endY, long dx) {
+    long left = firstX > -dx ? firstX : -dx, right = endX < job->width - dx ? endX : job->width - dx;
+    if (2 * (right - left) < endX - firstX) {
+        return HUGE_VAL;
+    }
+    uint32_t sum = 0;
+    for (long y = firstY; y < endY; y++) {
+        sum += rowDifference(job->left + y * job->width + left, job->right + y * job->width + left + dx, (size_t)(right - left));
+    }
+    return (double)sum / (double)((right - left) * (endY - firstY));
+}
+
+    /// True if the left image has enough detail in the window to be worth matching.
+static bool windowHasDetail(const MatchJob *job, long firstX, long endX, long firstY, long endY) {
+    int32_t sum = 0, deviation = 0;
+    for (long y = firstY; y < endY; y++) {
+        for (long x = firstX; x < endX; x++) {
+            sum += job->left[y * job->width + x];
+        }
+    }
+    long count = (endX - firstX) * (endY - firstY);
+    int16_t mean = (int16_t)(sum / count);
+    for (long y = firstY; y < endY; y++) {
+        for (long x = firstX; x < endX; x++) {
+            deviation += abs(job->left[y * job->width + x] - mean);
+        }
+    }
+    return deviation >= MinimumDetail * count;
+}
+
+static void matchBlockRow(void *context, size_t row) {
+    MatchJob *job = context;
+    long firstY = (long)row * BlockSize - WindowMargin, endY = ((long)row + 1) * BlockSize + WindowMargin;
+    firstY = firstY > 0 ? firstY : 0;
+    endY = endY < job->height ? endY : job->height;
+    double costs[2 * MaximumShift + 1];
+    for (size_t column = 0; column < job->columns; column++) {
+        size_t index = row * job->columns + column;
+        long firstX = (long)column * BlockSize - WindowMargin, endX = ((long)column + 1) * BlockSize + WindowMargin;
+        firstX = firstX > 0 ? firstX : 0;
+        endX = endX < job->width ? endX : job->width;
+        job->shifts[index] = 0;
+        job->matched[index] = false;
+        if (!windowHasDetail(job, firstX, endX, firstY, endY)) {
+            continue;
+        }
+        long best = 0;
+        double bestCost = HUGE_VAL, otherCost = HUGE_VAL;
+        for (long dx = -job->maximumShift; dx <= job->maximumShift; dx++) {
+            double cost = windowCost(job, firstX, endX, firstY, endY, dx);
+            costs[dx + job->maximumShift] = cost;
+                // Ties go to the smaller shift, so a repeating pattern doesn't drift.
+            if (cost < bestCost || (cost == bestCost && labs(dx) < labs(best))) {
+                bestCost = cost;
+                best = dx;
+            }
+        }
+        for (long dx = -job->maximumShift; dx <= job->maximumShift; dx++) {
+            if (labs(dx - best) > AmbiguousShifts && costs[dx + job->maximumShift] < otherCost) {
+                otherCost = costs[dx + job->maximumShift];
+            }
+        }
+        if (bestCost == HUGE_VAL || (otherCost < HUGE_VAL && bestCost * AmbiguityRatio >= otherCost && bestCost > 0)) {
+            continue;
+        }
+            // Fit a parabola through the costs either side of the best shift to get a fraction of a pixel.
+        double fraction = 0;
+        if (best > -job->maximumShift && best < job->maximumShift) {
+            double before = costs[best - 1 + job->maximumShift], after = costs[best + 1 + job->maximumShift];
+            double curvature = before - 2 * bestCost + after;
+            if (before < HUGE_VAL && after < HUGE_VAL && curvature > 0) {
+                fraction = (before - after) / (2 * curvature);
+            }
+        }
+        job->shifts[index] = (float)(best + fraction);
+        job->matched[index] = true;
+    }
+}
+
+    /// Give each block which couldn't be matched the mean shift of its matched neighbours, spreading outwards until every
+    /// block has one. Returns false if no block was matched at all, or memory ran out.
+static bool fillUnmatched(float *shifts, bool *matched, size_t columns, size_t rows) {
+    size_t count = columns * rows, remaining = 0;
+    for (size_t i = 0; i < count; i++) {
+        remaining += !matched[i];
+    }
+    bool *filled = remaining < count ? malloc(count * sizeof(bool)) : NULL;
+    if (!filled) {
+        return remaining == 0;
+    }
+    while (remaining > 0) {
+        memcpy(filled, matched, count * sizeof(bool));
+        for (size_t row = 0; row < rows; row++) {
+            for (size_t column = 0; column < columns; column++) {
+                size_t index = row * columns + column, neighbours = 0;
+                if (matched[index]) {
+                    continue;
+                }
+                float sum = 0;
+                const long steps[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+                for (int i = 0; i < 4; i++) {
+                    long x = (long)column + steps[i][0], y = (long)row + steps[i][1];
+                    if (x >= 0 && y >= 0 && x < (long)columns && y < (long)rows && matched[(size_t)y * columns + (size_t)x]) {
+                        sum += shifts[(size_t)y * columns + (size_t)x];
+                        neighbours++;
+                    }
+                }
+                if (neighbours > 0) {
+                    shifts[index] = sum / (float)neighbours;
+                    filled[index] = true;
+                    remaining--;
+                }
+            }
+        }
+        memcpy(matched, filled, count * sizeof(bool));
+    }
+    free(filled);
+    return true;
+}
+
+    /// Replace each shift with the median of it and its neighbours, using SCRATCH for the result.
+static void medianFilter(float *shifts, float *scratch, size_t columns, size_t rows) {
+    for (size_t row = 0; row < rows; row++) {
+        for (size_t column = 0; column < columns; column++) {
+            float values[9];
+            size_t count = 0;
+            for (size_t y = row > 0 ? row - 1 : 0; y <= row + 1 && y < rows; y++) {
+                for (size_t x = column > 0 ? column - 1 : 0; x <= column + 1 && x < columns; x++) {
+                        // Insertion sort: there are never more than nine.
+                    float value = shifts[y * columns + x];
+                    size_t i = count++;
+                    for (; i > 0 && values[i - 1] > value; i--) {
+                        values[i] = values[i - 1];
+                    }
+                    values[i] = value;
+                }
+            }
+            scratch[row * columns + column] = count % 2 ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+        }
+    }
+    memcpy(shifts, scratch, columns * rows * sizeof(float));
+}
+
+PWError PWDisparityEstimate(const PWImageBuffer *left, const PWImageBuffer *right, PWDisparityMap *map) {
+    memset(map, 0, sizeof(PWDisparityMap));
+    if (!left || !right || left->width != right->width || left->height != right->height
+        || left->width < MinimumSize || left->height < MinimumSize) {
+        return PWError_InvalidParameter;
+    }
+    size_t width = left->width < WorkingWidth ? left->width : WorkingWidth;
+    size_t height = (size_t)lround((double)left->height * width / left->width);
+    if (height < BlockSize) {
+        return PWError_InvalidParameter;
+    }
+    size_t columns = (width + BlockSize - 1) / BlockSize, rows = (height + BlockSize - 1) / BlockSize;
+
+        // One allocation holds both images, and another the shifts with room for the median filter and the matched flags.
+    int16_t *planes = malloc(2 * width * height * sizeof(int16_t));
+    float *shifts = malloc(columns * rows * (2 * sizeof(float) + sizeof(bool)));
+    PWError error = planes && shifts ? PWError_None : PWError_OutOfMemory;
+    if (error == PWError_None && (!fillWorkingLuma(planes, left, width, height)
+                                  || !fillWorkingLuma(planes + width * height, right, width, height))) {
+        error = PWError_OutOfMemory;
+    }
+    if (error == PWError_None) {
+        MatchJob job = {
+            planes, planes + width * height, (long)width, (long)height, columns, rows,
+            width / 8 < MaximumShift ? (long)(width / 8) : MaximumShift, shifts, (bool *)(shifts + 2 * columns * rows)
+        };
+        PWParallelFor(rows, &job, matchBlockRow);
+        if (!fillUnmatched(shifts, job.matched, columns, rows)) {
+            error = PWError_NotSupported;
+        }
+    }
+    free(planes);
+    if (error != PWError_None) {
+        free(shifts);
+        return error;
+    }
+    medianFilter(shifts, shifts + columns * rows, columns, rows);
+
+        // Scale from the working size back up to the photos.
+    double scale = (double)left->width / width;
+    for (size_t i = 0; i < columns * rows; i++) {
+        shifts[i] = (float)(shifts[i] * scale);
+    }
+    *map = (PWDisparityMap) {
+        columns, rows, BlockSize * scale, BlockSize * (double)left->height / height, shifts
+    };
+    return PWError_None;
+}
+
+void PWDisparityMapFree(PWDisparityMap *map) {
+    free(map->shifts);
+    memset(map, 0, sizeof(PWDisparityMap));
+}
+
+double PWDisparityMapShiftAt(const PWDisparityMap *map, double x, double y) {
+    double u = x / map->blockWidth - 0.5, v = y / map->blockHeight - 0.5;
+    u = u < 0 ? 0 : u > map->columns - 1 ? map->columns - 1 : u;
+    v = v < 0 ? 0 : v > map->rows - 1 ? map->rows - 1 : v;
+    size_t column = (size_t)u, row = (size_t)v;
+    size_t nextColumn = column + 1 < map->columns ? column + 1 : column, nextRow = row + 1 < map->rows ? row + 1 : row;
+    double fx = u - column, fy = v - row;
+    const float *top = map->shifts + row * map->columns, *bottom = map->shifts + nextRow * map->columns;
+    double upper = top[column] + (top[nextColumn] - top[column]) * fx;
+    double lower = bottom[column] + (bottom[nextColumn] - bottom[column]) * fx;
+    return upper + (lower - upper) * fy;
+}
+
+// MARK: - Views
+
+    /// Where a column of a plane lies between the centres of the blocks either side of it.
+typedef struct ColumnWeight {
+    uint32_t block;
+    float fraction;
+} ColumnWeight;
+
+    /// Everything the threads need to make one plane of a view.
+typedef struct ViewJob {
+    const PWDisparityMap *map;
+    const uint8_t *left, *right;
+    size_t leftBytesPerRow, rightBytesPerRow;
+    uint8_t *destination;
+    size_t destinationBytesPerRow, width, height, channels;
+        /// Pixels of this plane in each pixel of the photos: 1, or 0.5 for chroma.
+    double planeScale;
+    double position;
+        /// One for each column of the plane, the same for every row.
+    const ColumnWeight *columnWeights;
+} ViewJob;
+
+    /// A position in 16.16 fixed point, clamped to the row, as the two pixels either side of it and the weight of the second.
+typedef struct Sample {
+    size_t x0, x1;
+    uint32_t weight;
+} Sample;
+
+static inline Sample samplePosition(float x, size_t width) {
+    int32_t fx = (int32_t)(x * 65536), maxX = (int32_t)(width - 1) << 16;
+    fx = fx < 0 ? 0 : fx > maxX ? maxX : fx;
+    size_t x0 = (size_t)(fx >> 16);
+    return (Sample) { x0, x0 + 1 < width ? x0 + 1 : x0, (uint32_t)(fx >> 8) & 255 };
+}
+
+    /// Make one row of a view from the rows of the photos. CHANNELS is a constant at each call site, so the channel loop is unrolled.
+static inline void makeViewRow(const ViewJob *job, const float *rowShifts, const uint8_t *leftRow, const uint8_t *rightRow,
+                               uint8_t *output, size_t channels) {
+    const ColumnWeight *columnWeights = job->columnWeights;
+    size_t width = job->width;
+    float position = (float)job->position;
+    uint32_t rightWeight = (uint32_t)lround(job->position * 256), leftWeight = 256 - rightWeight;
+    for (size_t x = 0; x < width; x++) {
+        ColumnWeight weight = columnWeights[x];
+        float shift = rowShifts[weight.block] + (rowShifts[weight.block + 1] - rowShifts[weight.block]) * weight.fraction;
+        Sample left = samplePosition((float)x - position * shift, width);
+        Sample right = samplePosition((float)x + (1 - position) * shift, width);
+            // Both blends in one: each of the four pixels read gets its share of the output.
+        uint32_t left0 = (256 - left.weight) * leftWeight, left1 = left.weight * leftWeight;
+        uint32_t right0 = (256 - right.weight) * rightWeight, right1 = right.weight * rightWeight;
+        for (size_t c = 0; c < channels; c++) {
+            uint32_t value = leftRow[left.x0 * channels + c] * left0 + leftRow[left.x1 * channels + c] * left1
+                           + rightRow[right.x0 * channels + c] * right0 + rightRow[right.x1 * channels + c] * right1;
+            output[x * channels + c] = (uint8_t)((value + 32768) >> 16);
+        }
+    }
+}
+
+static void makeViewBand(void *context, size_t band) {
+    const ViewJob *job = context;
+    const PWDisparityMap *map = job->map;
+    size_t firstY = band * BandRows, endY = firstY + BandRows < job->height ? firstY + BandRows : job->height;
+    float rowShifts[WorkingWidth / BlockSize + 1];
+    for (size_t y = firstY; y < endY; y++) {
+            // Interpolate the shifts down to this row once, then only across it for each pixel.
+        double v = (y + 0.5) / job->planeScale / map->blockHeight - 0.5;
+        v = v < 0 ? 0 : v > map->rows - 1 ? map->rows - 1 : v;
+        size_t row = (size_t)v, nextRow = row + 1 < map->rows ? row + 1 : row;
+        float fy = (float)(v - row);
+        for (size_t column = 0; column < map->columns; column++) {
+            float top = map->shifts[row * map->columns + column], bottom = map->shifts[nextRow * map->columns + column];
+            rowShifts[column] = (top + (bottom - top) * fy) * (float)job->planeScale;
+        }
+        rowShifts[map->columns] = rowShifts[map->columns - 1];
+        const uint8_t *leftRow = job->left + y * job->leftBytesPerRow, *rightRow = job->right + y * job->rightBytesPerRow;
+        uint8_t *output = job->destination + y * job->destinationBytesPerRow;
+        switch (job->channels) {
+            case 1:  makeViewRow(job, rowShifts, leftRow, rightRow, output, 1); break;
+            case 3:  makeViewRow(job, rowShifts, leftRow, rightRow, output, 3); break;
+            default: makeViewRow(job, rowShifts, leftRow, rightRow, output, 4); break;
+        }
+    }
+}
+
+static bool makeViewPlane(ViewJob job) {
+    ColumnWeight *weights = malloc(job.width * sizeof(ColumnWeight));
+    if (!weights) {
+        return false;
+    }
+    double blocksPerPixel = 1 / (job.planeScale * job.map->blockWidth);
+    for (size_t x = 0; x < job.width; x++) {
+        double u = (x + 0.5) * blocksPerPixel - 0.5;
+        u = u < 0 ? 0 : u > job.map->columns - 1 ? job.map->columns - 1 : u;
+        weights[x] = (ColumnWeight) { (uint32_t)u, (float)(u - (uint32_t)u) };
+    }
+    job.columnWeights = weights;
+    PWParallelFor((job.height + BandRows - 1) / BandRows, &job, makeViewBand);
+    free(weights);
+    return true;
+}
+
+PWImageBuffer *PWDisparityCreateView(const PWImageBuffer *left, const PWImageBuffer *right, const PWDisparityMap *map,
+                                     double position) {
+    if (!left || !right || !map || !map->shifts || left->width != right->width || left->height != right->height
+        || left->format != right->format || map->columns > WorkingWidth / BlockSize) {
+        return NULL;
+    }
+    PWImageBuffer *view = PWImageBufferCreate(left->width, left->height, left->format);
+    if (!view) {
+        return NULL;
+    }
+    position = position < 0 ? 0 : position > 1 ? 1 : position;
+    bool ok = makeViewPlane((ViewJob) {
+        map, left->data, right->data, left->bytesPerRow, right->bytesPerRow, view->data, view->bytesPerRow,
+        left->width, left->height, PWPixelFormatBytesPerPixel(left->format), 1, position, NULL
+    });
+    if (PWPixelFormatIsPlanar(left->format)) {
+        size_t chromaWidth = (left->width + 1) / 2, chromaHeight = (left->height + 1) / 2;
+        for (int plane = 0; plane < 2 && ok; plane++) {
+            ok = makeViewPlane((ViewJob) {
+                map, left->chroma[plane], right->chroma[plane], left->chromaBytesPerRow, right->chromaBytesPerRow,
+                view->chroma[plane], view->chromaBytesPerRow, chromaWidth, chromaHeight, 1, 0.5, position, NULL
+            });
+        }
+    }
+    if (!ok) {
+        PWImageBufferRelease(view);
+        return NULL;
+    }
+    return view;
+}
@@ -0,0 +1,74 @@
+/*!
+ @header PWDisparity
+ @abstract Measures how far each part of the scene moves between the two photos, and makes views from between them.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ The animated viewing method used to flick between the left and right photos, which looks jerky. With a disparity map
+ it can also show views from positions between the two cameras, so the scene seems to turn smoothly.
+
+ The estimate works on the luma of photos scaled down to at most 320 pixels wide, like PWAlign. That image is cut into
+ 8 x 8 blocks, and each block's horizontal shift is found by trying every shift up to an eighth of the width either way
+ and keeping the one with the smallest sum of absolute differences over a 16 x 16 window around the block. The rows
+ are compared as 16-bit values in a loop the compiler vectorises, and the rows of blocks are shared between the cores,
+ so the search takes about ten milliseconds on one core whatever the size of the photos. Blocks with too little detail,
+ or with more than one good match, take their shift from their neighbours, and a median filter removes any odd ones out.
+
+ The photos must already be lined up vertically (see PWAlign.h), so that only the horizontal shift remains.
+ */
+
+#ifndef PWDisparity_h
+#define PWDisparity_h
+
+#include "PWImageBuffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * The horizontal shift of each block of a stereo pair. A point at column X of the left photo, in a block whose shift
+ * is S, is at column X + S of the right photo.
+ */
+typedef struct PWDisparityMap {
+        /*! Number of blocks across and down. */
+    size_t columns, rows;
+        /*! Width and height of each block, in pixels of the photos. */
+    double blockWidth, blockHeight;
+        /*! Shift of each block in pixels of the photos, a row at a time. */
+    float *shifts;
+} PWDisparityMap;
+
+/*!
+ * Measure the shift of each part of RIGHT relative to LEFT.
+ *
+ * The photos may be in any pixel format, and need not be in the same one, but should be the same size.
+ *
+ * @param map Receives the shifts. Free them with PWDisparityMapFree(). Left empty on failure.
+ * @return PWError_None, PWError_InvalidParameter if the photos are different sizes or too small, PWError_NotSupported
+ *         if no part of them has enough detail to match, or PWError_OutOfMemory.
+ */
+PWError PWDisparityEstimate(const PWImageBuffer *left, const PWImageBuffer *right, PWDisparityMap *map);
+
+/*! Free the shifts in MAP, and empty it. */
+void PWDisparityMapFree(PWDisparityMap *map);
+
+/*! The shift at (X, Y) in pixels of the photos, interpolated between the centres of the blocks around it. */
+double PWDisparityMapShiftAt(const PWDisparityMap *map, double x, double y);
+
+/*!
+ * Make the view from POSITION of the way from the left camera to the right one, by moving each pixel of both photos
+ * along its shift and blending them. POSITION 0 gives LEFT and 1 gives RIGHT. Parts of the scene which only one photo
+ * shows come out a little doubled, which is hard to see while the animation is running.
+ *
+ * @param left  The photos MAP was made from. They must be the same size and pixel format.
+ * @return A new buffer the size and format of LEFT, or NULL if the photos don't match or memory ran out.
+ */
+PWImageBuffer *PWDisparityCreateView(const PWImageBuffer *left, const PWImageBuffer *right, const PWDisparityMap *map,
+                                     double position);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWDisparity_h */
@@ -0,0 +1,438 @@
+//
+//  PWExifThumbnail.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWExifThumbnail.h"
+#include "PWJPEGCommon.h"
+#include "PWJPEGDecoder.h"
+#include "PWJPEGEncoder.h"
+#include "PWOrientation.h"
+#include "PWResample.h"
+#include "PWStorage.h"
+
+#include <string.h>
+
+    /// TIFF tags used in the EXIF IFDs.
+enum {
+    Tag_Compression                 = 0x0103,
+    Tag_Orientation                 = 0x0112,
+    Tag_JPEGInterchangeFormat       = 0x0201,
+    Tag_JPEGInterchangeFormatLength = 0x0202
+};
+
+    /// TIFF field types, and the compression value meaning the thumbnail is a JPEG file.
+enum { Type_Short = 3, Type_Long = 4, Compression_JPEG = 6 };
+
+enum {
+        /// Length of the "Exif\0\0" identifier which starts the segment, before the TIFF header.
+    IdentifierLength = 6,
+    IFDEntrySize = 12,
+        /// Where things are in the EXIF data written here, counted from the start of the TIFF header. IFD0 holds only
+        /// the orientation, and IFD1, which describes the thumbnail, follows it, then the thumbnail itself.
+    IFD0Offset = 8,
+    IFD0EntryCount = 1,
+    IFD1Offset = IFD0Offset + 2 + IFD0EntryCount * IFDEntrySize + 4,
+    IFD1EntryCount = 3,
+    ThumbnailOffset = IFD1Offset + 2 + IFD1EntryCount * IFDEntrySize + 4,
+        /// The most a segment can hold after its marker and length.
+    MaximumSegmentContent = 0xFFFF - 2
+};
+
+    /// Quality of the thumbnails written. They are only ever shown shrunk further.
+enum { ThumbnailQuality = 75 };
+
+    /// Size of the reads made while looking through the headers, enough for the JFIF segment and a typical EXIF one.
+enum { ReadChunkLength = 4096 };
+
+// MARK: - Byte helpers
+
+static inline unsigned readUInt16(const uint8_t *bytes, bool bigEndian) {
+    return bigEndian ? (unsigned)bytes[0] << 8 | bytes[1] : (unsigned)bytes[1] << 8 | bytes[0];
+}
+
+static inline uint32_t readUInt32(const uint8_t *bytes, bool bigEndian) {
+    return bigEndian ? (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3]
+                     : (uint32_t)bytes[3] << 24 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[1] << 8 | bytes[0];
+}
+
+    /// Everything written here is big-endian, as JPEG itself is.
+static inline uint8_t *putUInt16(uint8_t *bytes, unsigned value) {
+    bytes[0] = (uint8_t)(value >> 8);
+    bytes[1] = (uint8_t)value;
+    return bytes + 2;
+}
+
+static inline uint8_t *putUInt32(uint8_t *bytes, uint32_t value) {
+    bytes[0] = (uint8_t)(value >> 24);
+    bytes[1] = (uint8_t)(value >> 16);
+    bytes[2] = (uint8_t)(value >> 8);
+    bytes[3] = (uint8_t)value;
+    return bytes + 4;
+}
+
+static uint8_t *putEntry(uint8_t *bytes, unsigned tag, unsigned type, uint32_t value) {
+    bytes = putUInt16(bytes, tag);
+    bytes = putUInt16(bytes, type);
+    bytes = putUInt32(bytes, 1);
+        // A SHORT is left-justified in the value field.
+    return type == Type_Short ? putUInt32(bytes, value << 16) : putUInt32(bytes, value);
+}
+
+    /// True if the segment at SEGMENT, LENGTH bytes long not counting the marker and length, is an EXIF segment.
+static bool isExifSegment(unsigned marker, const uint8_t *segment, size_t length) {
+    return marker == PWJPEGMarker_APP1 && length >= IdentifierLength + 8 && memcmp(segment, "Exif\0\0", IdentifierLength) == 0;
+}
+
+// MARK: - Reading
+
+    /// Find the thumbnail and the orientation in the EXIF segment SEGMENT, LENGTH bytes long not counting the marker
+    /// and length. Returns false if there is no thumbnail, or it lies outside the segment.
+static bool findThumbnail(const uint8_t *segment, size_t length, size_t *offset, size_t *thumbnailLength, int *orientation) {
+    const uint8_t *tiff = segment + IdentifierLength;
+    size_t tiffLength = length - IdentifierLength;
+    bool bigEndian;
+    if (tiff[0] == 'M' && tiff[1] == 'M') {
+        bigEndian = true;
+    } else if (tiff[0] == 'I' && tiff[1] == 'I') {
+        bigEndian = false;
+    } else {
+        return false;
+    }
+    *orientation = 1;
+    uint32_t thumbnailOffset = 0, thumbnailSize = 0;
+    uint32_t ifdOffset = readUInt32(tiff + 4, bigEndian);
+        // IFD0 describes the photo and IFD1, which it links to, the thumbnail.
+    for (int ifd = 0; ifd < 2; ifd++) {
+        if (ifdOffset < 8 || ifdOffset > tiffLength - 2) {
+            return false;
+        }
+        unsigned entryCount = readUInt16(tiff + ifdOffset, bigEndian);
+        size_t entriesEnd = ifdOffset + 2 + (size_t)entryCount * IFDEntrySize;
+        if (entriesEnd + 4 > tiffLength) {
+            return false;
+        }
+        for (size_t entry = ifdOffset + 2; entry < entriesEnd; entry += IFDEntrySize) {
+            unsigned tag = readUInt16(tiff + entry, bigEndian);
+            if (ifd == 0 && tag == Tag_Orientation) {
+                unsigned value = readUInt16(tiff + entry + 8, bigEndian);
+                *orientation = value >= 1 && value <= 8 ? (int)value : 1;
+            } else if (ifd == 1 && tag == Tag_JPEGInterchangeFormat) {
+                thumbnailOffset = readUInt32(tiff + entry + 8, bigEndian);
+            } else if (ifd == 1 && tag == Tag_JPEGInterchangeFormatLength) {
+                thumbnailSize = readUInt32(tiff + entry + 8, bigEndian);
+            }
+        }
+        ifdOffset = readUInt32(tiff + entriesEnd, bigEndian);
+    }
+    if (thumbnailSize < 4 || thumbnailOffset > tiffLength || thumbnailSize > tiffLength - thumbnailOffset
+        || tiff[thumbnailOffset] != 0xFF || tiff[thumbnailOffset + 1] != PWJPEGMarker_SOI) {
+        return false;
+    }
+    *offset = IdentifierLength + thumbnailOffset;
+    *thumbnailLength = thumbnailSize;
+    return true;
+}
+
+    /// Reads a file from the storage a chunk at a time, so skipping a segment doesn't read it anyway.
+typedef struct FileReader {
+    PWStorage *storage;
+    const char *path;
+        /// The next byte to read, and CHUNK, which holds the bytes of the file from CHUNKOFFSET.
+    size_t offset, chunkOffset;
+    PWDataBuffer chunk;
+    PWError error;
+} FileReader;
+
+    /// Read LENGTH bytes from READER into BYTES, adding them to *TOTAL.
+static bool readBytes(FileReader *reader, void *bytes, size_t length, size_t *total) {
+    size_t copied = 0;
+    while (copied < length) {
+        if (reader->offset >= reader->chunkOffset && reader->offset < reader->chunkOffset + reader->chunk.length) {
+            size_t available = reader->chunkOffset + reader->chunk.length - reader->offset;
+            size_t count = available < length - copied ? available : length - copied;
+            memcpy((uint8_t *)bytes + copied, reader->chunk.bytes + (reader->offset - reader->chunkOffset), count);
+            reader->offset += count;
+            copied += count;
+            continue;
+        }
+        size_t wanted = length - copied > ReadChunkLength ? length - copied : ReadChunkLength;
+        reader->chunk.length = 0;
+        reader->chunkOffset = reader->offset;
+        PWError error = PWStorageReadFile(reader->storage, reader->path, reader->offset, wanted, &reader->chunk);
+        if (error != PWError_None || reader->chunk.length == 0) {
+            reader->error = error;
+            break;  // An error, or the end of the file.
+        }
+    }
+    *total += copied;
+    return copied == length;
+}
+
+    /// True for the markers which start a frame, and give the size of the image.
+static bool isStartOfFrame(unsigned marker) {
+    return marker >= PWJPEGMarker_SOF0 && marker <= 0xCF && marker != PWJPEGMarker_DHT && marker != 0xC8 && marker != 0xCC;
+}
+
+    /// Read the thumbnail into THUMBNAIL and the photo's details into PHOTOINFO, walking the segments up to the image data.
+static PWError readThumbnail(FileReader *reader, PWDataBuffer *thumbnail, PWExifThumbnailPhotoInfo *photoInfo, size_t *bytesRead) {
+    uint8_t header[4];
+    if (!readBytes(reader, header, 2, bytesRead) || header[0] != 0xFF || header[1] != PWJPEGMarker_SOI) {
+        return PWError_InvalidFormat;
+    }
+    PWDataBuffer segment;
+    if (!PWDataBufferInit(&segment, 0)) {
+        return PWError_OutOfMemory;
+    }
+    size_t thumbnailOffset = 0, thumbnailLength = 0;
+    bool foundFrame = false;
+    PWError error = PWError_None;
+    while (error == PWError_None && !(foundFrame && thumbnailLength > 0)) {
+        if (!readBytes(reader, header, 4, bytesRead)) {
+            error = PWError_InvalidFormat;
+            break;
+        }
+        while (header[0] == 0xFF && header[1] == 0xFF && error == PWError_None) {  // Fill bytes.
+            memmove(header + 1, header + 2, 2);
+            if (!readBytes(reader, header + 3, 1, bytesRead)) {
+                error = PWError_InvalidFormat;
+            }
+        }
+        unsigned marker = header[1];
+        size_t contentLength = ((size_t)header[2] << 8 | header[3]) - 2;
+        if (error != PWError_None) {
+            break;
+        } else if (header[0] != 0xFF || contentLength > MaximumSegmentContent) {
+            error = PWError_InvalidFormat;
+        } else if (marker == PWJPEGMarker_SOS || marker == PWJPEGMarker_EOI) {
+                // The image data starts here, so there is no thumbnail.
+            error = foundFrame ? PWError_NotSupported : PWError_InvalidFormat;
+        } else if (isStartOfFrame(marker) || (marker == PWJPEGMarker_APP1 && thumbnailLength == 0)) {
+            segment.length = 0;
+            if (!PWDataBufferReserve(&segment, contentLength)) {
+                error = PWError_OutOfMemory;
+            } else if (!readBytes(reader, segment.bytes, contentLength, bytesRead)) {
+                error = PWError_InvalidFormat;
+            } else if (isStartOfFrame(marker)) {
+                if (contentLength < 6) {
+                    error = PWError_InvalidFormat;
+                } else {
+                    photoInfo->height = readUInt16(segment.bytes + 1, true);
+                    photoInfo->width  = readUInt16(segment.bytes + 3, true);
+                    foundFrame = true;
+                }
+            } else if (isExifSegment(marker, segment.bytes, contentLength)) {
+                if (!findThumbnail(segment.bytes, contentLength, &thumbnailOffset, &thumbnailLength, &photoInfo->orientation)) {
+                    error = PWError_NotSupported;
+                } else if (!PWDataBufferAppend(thumbnail, segment.bytes + thumbnailOffset, thumbnailLength)) {
+                    error = PWError_OutOfMemory;
+                }
+            }
+        } else {
+            reader->offset += contentLength;
+        }
+    }
+    PWDataBufferFree(&segment);
+    return error;
+}
+
+PWError PWExifThumbnailRead(const char *path, PWDataBuffer *thumbnail, PWExifThumbnailPhotoInfo *photoInfo, size_t *bytesRead) {
+    size_t total = 0, originalLength = thumbnail->length;
+    FileReader reader = { PWStorageDefault(), path, 0, 0, { NULL, 0, 0 }, PWError_None };
+    if (!path || !PWDataBufferInit(&reader.chunk, ReadChunkLength)) {
+        return path ? PWError_OutOfMemory : PWError_InvalidParameter;
+    }
+    PWExifThumbnailPhotoInfo info = { 0, 0, PWOrientation_Up };
+    PWError error = readThumbnail(&reader, thumbnail, &info, &total);
+        // A file which can't be read at all is an I/O error rather than a bad JPEG file.
+    if (reader.error != PWError_None) {
+        error = reader.error;
+    }
+    PWDataBufferFree(&reader.chunk);
+    if (error != PWError_None) {
+        thumbnail->length = originalLength;
+    } else if (photoInfo) {
+        *photoInfo = info;
+    }
+    if (bytesRead) {
+        *bytesRead = total;
+    }
+    return error;
+}
+
+PWError PWExifThumbnailCreateImage(const char *path, PWImageBuffer **image, PWExifThumbnailPhotoInfo *photoInfo) {
+    *image = NULL;
+    PWDataBuffer thumbnail;
+    if (!PWDataBufferInit(&thumbnail, 0)) {
+        return PWError_OutOfMemory;
+    }
+    PWExifThumbnailPhotoInfo info;
+    PWImageBuffer *stored = NULL;
+    PWError error = PWExifThumbnailRead(path, &thumbnail, &info, NULL);
+    if (error == PWError_None) {
+        error = PWJPEGDecode(thumbnail.bytes, thumbnail.length, &stored);
+    }
+    PWDataBufferFree(&thumbnail);
+    if (error != PWError_None) {
+        return error;
+    }
+    if (info.orientation != PWOrientation_Up) {
+        *image = PWImageBufferCreateOriented(stored, (PWOrientation)info.orientation);
+        PWImageBufferRelease(stored);
+    } else {
+        *image = stored;
+    }
+    if (!*image) {
+        return PWError_OutOfMemory;
+    }
+    if (photoInfo) {
+        *photoInfo = info;
+    }
+    return PWError_None;
+}
+
+// MARK: - Writing
+
+    /// Shrink PHOTO to fit in SIZE x SIZE pixels and append it to OUTPUT as a JPEG file.
+static PWError encodeThumbnail(const PWImageBuffer *photo, size_t size, PWDataBuffer *output) {
+    size_t width = photo->width >= photo->height ? size : (photo->width * size + photo->height / 2) / photo->height;
+    size_t height = photo->width >= photo->height ? (photo->height * size + photo->width / 2) / photo->width : size;
+    PWImageBuffer *small = PWResampleCreate(photo, width ? width : 1, height ? height : 1, PWResampleFilter_Area);
+    if (!small) {
+        return PWError_OutOfMemory;
+    }
+        // The encoder can't take planar images, but at this size converting the pixels costs nothing.
+    if (PWPixelFormatIsPlanar(small->format)) {
+        PWImageBuffer *converted = PWImageBufferCreate(small->width, small->height, PWPixelFormat_RGBA8888);
+        for (size_t y = 0; converted && y < small->height; y++) {
+            PWImageBufferConvertRowToRGBX(small, y, 0, small->width, PWImageBufferRow(converted, y));
+        }
+        PWImageBufferRelease(small);
+        small = converted;
+        if (!small) {
+            return PWError_OutOfMemory;
+        }
+    }
+    PWJPEGEncodeOptions options;
+    PWJPEGEncodeOptionsInit(&options);
+    options.quality = ThumbnailQuality;
+    PWError error = PWJPEGEncode(small, &options, output);
+    PWImageBufferRelease(small);
+    return error;
+}
+
+    /// Write the EXIF segment holding THUMBNAIL into SEGMENT, which must have room for it. Returns its length.
+static size_t makeSegment(uint8_t *segment, const PWDataBuffer *thumbnail, int orientation) {
+    size_t segmentLength = 4 + IdentifierLength + ThumbnailOffset + thumbnail->length;
+    segment[0] = 0xFF;
+    segment[1] = PWJPEGMarker_APP1;
+    putUInt16(segment + 2, (unsigned)(segmentLength - 2));
+    memcpy(segment + 4, "Exif\0\0", IdentifierLength);
+
+    uint8_t *tiff = segment + 4 + IdentifierLength, *bytes = tiff;
+    memcpy(bytes, "MM\0\x2A", 4);
+    bytes = putUInt32(bytes + 4, IFD0Offset);
+    bytes = putUInt16(bytes, IFD0EntryCount);
+    bytes = putEntry(bytes, Tag_Orientation, Type_Short, (uint32_t)orientation);
+    bytes = putUInt32(bytes, IFD1Offset);
+    bytes = putUInt16(bytes, IFD1EntryCount);
+    bytes = putEntry(bytes, Tag_Compression, Type_Short, Compression_JPEG);
+    bytes = putEntry(bytes, Tag_JPEGInterchangeFormat, Type_Long, ThumbnailOffset);
+    bytes = putEntry(bytes, Tag_JPEGInterchangeFormatLength, Type_Long, (uint32_t)thumbnail->length);
+    bytes = putUInt32(bytes, 0);  // No more IFDs.
+    memcpy(bytes, thumbnail->bytes, thumbnail->length);
+    return segmentLength;
+}
+
+    /// Append a copy of the JPEG file BYTES to OUTPUT with SEGMENT inserted after the JFIF segment, and any EXIF segment left out.
+static PWError appendWithSegment(PWDataBuffer *output, const uint8_t *bytes, size_t length,
+                                 const uint8_t *segment, size_t segmentLength) {
+    if (!PWDataBufferAppend(output, bytes, 2)) {
+        return PWError_OutOfMemory;
+    }
+    size_t position = 2;
+    bool inserted = false;
+    while (position + 4 <= length) {
+        if (bytes[position] != 0xFF) {
+            return PWError_InvalidFormat;
+        }
+        unsigned marker = bytes[position + 1];
+        if (marker == 0xFF) {  // Fill byte.
+            position++;
+            continue;
+        }
+        size_t fieldLength = (size_t)bytes[position + 2] << 8 | bytes[position + 3];
+        if (fieldLength < 2 || position + 2 + fieldLength > length) {
+            return PWError_InvalidFormat;
+        }
+        if (!inserted && marker != PWJPEGMarker_APP0) {
+            if (!PWDataBufferAppend(output, segment, segmentLength)) {
+                return PWError_OutOfMemory;
+            }
+            inserted = true;
+        }
+        if (marker == PWJPEGMarker_SOS) {
+                // Everything from here on is image data, copied as it is.
+            return PWDataBufferAppend(output, bytes + position, length - position) ? PWError_None : PWError_OutOfMemory;
+        }
+        if (!isExifSegment(marker, bytes + position + 4, fieldLength - 2)
+            && !PWDataBufferAppend(output, bytes + position, 2 + fieldLength)) {
+            return PWError_OutOfMemory;
+        }
+        position += 2 + fieldLength;
+    }
+    return PWError_InvalidFormat;
+}
+
+PWError PWExifThumbnailAdd(const uint8_t *bytes, size_t length, const PWImageBuffer *photo, PWDataBuffer *output) {
+    PWJPEGInfo info;
+    PWError error = PWJPEGReadInfo(bytes, length, &info);
+    if (error != PWError_None) {
+        return error;
+    }
+    PWImageBuffer *decoded = NULL;
+    if (!photo) {
+        error = PWJPEGDecode(bytes, length, &decoded);
+        if (error != PWError_None) {
+            return error;
+        }
+        photo = decoded;
+    } else if (photo->width != info.width || photo->height != info.height) {
+        return PWError_InvalidParameter;
+    }
+
+        // Busy photos may need a smaller thumbnail to fit in the segment.
+    PWDataBuffer thumbnail;
+    if (!PWDataBufferInit(&thumbnail, 16 * 1024)) {
+        PWImageBufferRelease(decoded);
+        return PWError_OutOfMemory;
+    }
+    size_t size = PWExifThumbnailMaximumSize;
+    do {
+        thumbnail.length = 0;
+        error = encodeThumbnail(photo, size, &thumbnail);
+        size /= 2;
+    } while (error == PWError_None && IdentifierLength + ThumbnailOffset + thumbnail.length > MaximumSegmentContent && size > 0);
+    PWImageBufferRelease(decoded);
+    if (error == PWError_None && IdentifierLength + ThumbnailOffset + thumbnail.length > MaximumSegmentContent) {
+        error = PWError_NotSupported;
+    }
+
+    size_t originalLength = output->length;
+    PWDataBuffer segment;
+    if (error == PWError_None && !PWDataBufferInit(&segment, 4 + IdentifierLength + ThumbnailOffset + thumbnail.length)) {
+        error = PWError_OutOfMemory;
+    } else if (error == PWError_None) {
+        size_t segmentLength = makeSegment(segment.bytes, &thumbnail, info.orientation);
+        error = appendWithSegment(output, bytes, length, segment.bytes, segmentLength);
+        PWDataBufferFree(&segment);
+    }
+    PWDataBufferFree(&thumbnail);
+    if (error != PWError_None) {
+        output->length = originalLength;
+    }
+    return error;
+}
@@ -0,0 +1,78 @@
+/*!
+ @header PWExifThumbnail
+ @abstract Embeds a small thumbnail in a JPEG file's EXIF segment, and reads it back without reading the rest of the file.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ The collection view shows a 100-pixel tile of each stereogram, but its left photo is a JPEG file of a few megabytes.
+ EXIF has room for a thumbnail, itself a small JPEG file, in the APP1 segment near the start of the file, before any
+ image data. PWExifThumbnailAdd() puts one there as a photo is saved. PWExifThumbnailRead() reads the file's headers a
+ few kilobytes at a time, seeking past segments it doesn't need, and stops once it has the thumbnail, so a tile costs
+ some kilobytes of I/O and a tiny decode instead of the whole photo. Photos from cameras usually have a thumbnail too.
+ Files without one, such as those saved by earlier versions of the app, give PWError_NotSupported, and the caller
+ should decode the whole photo instead.
+ */
+
+#ifndef PWExifThumbnail_h
+#define PWExifThumbnail_h
+
+#include "PWImageBuffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Longest side of the thumbnails PWExifThumbnailAdd() makes, in pixels. Smaller ones are made if need be to fit the segment. */
+enum { PWExifThumbnailMaximumSize = 256 };
+
+/*! What PWExifThumbnailRead() finds out about the photo besides its thumbnail. */
+typedef struct PWExifThumbnailPhotoInfo {
+        /*! Size of the photo as stored, before its orientation is applied. */
+    size_t width, height;
+        /*! The photo's EXIF orientation, 1 to 8, which the thumbnail should be turned upright by as well. */
+    int orientation;
+} PWExifThumbnailPhotoInfo;
+
+/*!
+ * Append a copy of the JPEG file BYTES to OUTPUT with a thumbnail of it in a new EXIF segment.
+ *
+ * The image data is copied without being decoded or re-encoded. Any EXIF segment already in the file is replaced, keeping
+ * only its orientation tag, which applies to the thumbnail as well as the photo; other segments are copied as they are.
+ *
+ * @param bytes  The JPEG file.
+ * @param length Number of bytes in BYTES.
+ * @param photo  The photo's pixels as stored in the file, i.e. before its EXIF orientation is applied, if the caller
+ *               has them to hand. NULL to decode them from BYTES.
+ * @param output The new file is appended to this. It is left as it was on failure.
+ * @return PWError_None, PWError_InvalidFormat if BYTES is not a JPEG file, PWError_InvalidParameter if PHOTO is not
+ *         the size of the stored image, PWError_NotSupported if PHOTO is NULL and the file can't be decoded, or
+ *         PWError_OutOfMemory.
+ */
+PWError PWExifThumbnailAdd(const uint8_t *bytes, size_t length, const PWImageBuffer *photo, PWDataBuffer *output);
+
+/*!
+ * Read the EXIF thumbnail of the JPEG file at PATH, reading only the headers before the image data.
+ *
+ * @param path      The JPEG file.
+ * @param thumbnail The thumbnail's own JPEG file is appended to this.
+ * @param photoInfo Receives the photo's size and orientation, e.g. to scale a crop rectangle to the thumbnail. May be NULL.
+ * @param bytesRead Receives the number of bytes read from the file, not counting the segments skipped. May be NULL.
+ * @return PWError_None, PWError_IO if the file couldn't be read, PWError_InvalidFormat if it is not a JPEG file,
+ *         PWError_NotSupported if it has no EXIF thumbnail, or PWError_OutOfMemory.
+ */
+PWError PWExifThumbnailRead(const char *path, PWDataBuffer *thumbnail, PWExifThumbnailPhotoInfo *photoInfo, size_t *bytesRead);
+
+/*!
+ * Read and decode the EXIF thumbnail of the JPEG file at PATH, turned upright by the photo's orientation.
+ *
+ * @param image     Receives the thumbnail, in the format PWJPEGDecode() gives. Release it with PWImageBufferRelease().
+ * @param photoInfo Receives the photo's size as stored and its orientation. May be NULL.
+ * @return As for PWExifThumbnailRead(), or an error from PWJPEGDecode() if the thumbnail can't be decoded.
+ */
+PWError PWExifThumbnailCreateImage(const char *path, PWImageBuffer **image, PWExifThumbnailPhotoInfo *photoInfo);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWExifThumbnail_h */
@@ -0,0 +1,154 @@
+//
+//  PWExport.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWExport.h"
+#include "PWGIFEncoder.h"
+#include "PWJPEGEncoder.h"
+#include "PWParallel.h"
+#include "PWResample.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+void PWExportPresetSize(const PWExportPreset *preset, size_t width, size_t height, size_t *outputWidth, size_t *outputHeight) {
+    size_t longest = width > height ? width : height;
+    if (preset->maximumSize == 0 || preset->maximumSize >= longest) {
+        *outputWidth = width;
+        *outputHeight = height;
+        return;
+    }
+    double scale = (double)preset->maximumSize / longest;
+    *outputWidth  = width  == longest ? preset->maximumSize : (size_t)fmax(1, round(width  * scale));
+    *outputHeight = height == longest ? preset->maximumSize : (size_t)fmax(1, round(height * scale));
+}
+
+// MARK: - Cascade
+
+    /// One file to make. IMAGE is the source itself for files at full size, and is otherwise owned by the file.
+typedef struct File {
+    const PWExportPreset *preset;
+    size_t width, height;
+    const PWImageBuffer *image;
+    PWDataBuffer *output;
+    PWError error;
+} File;
+
+    /// qsort() comparison putting the largest files first.
+static int compareSizes(const void *a, const void *b) {
+    const File *fileA = *(File *const *)a, *fileB = *(File *const *)b;
+    size_t areaA = fileA->width * fileA->height, areaB = fileB->width * fileB->height;
+    return areaA > areaB ? -1 : areaA < areaB;
+}
+
+    /// Make the image of each of COUNT files, largest first. Files of the same size share an image.
+static PWError makeImages(const PWImageBuffer *source, File **bySize, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        File *file = bySize[i];
+        if (file->width == source->width && file->height == source->height) {
+            file->image = source;
+            continue;
+        }
+        if (i > 0 && bySize[i - 1]->width == file->width && bySize[i - 1]->height == file->height) {
+            file->image = PWImageBufferRetain((PWImageBuffer *)bySize[i - 1]->image);
+            continue;
+        }
+            // Averaging at least 2x2 pixels into each one keeps the cascade as sharp as scaling from full size would be.
+        const PWImageBuffer *from = source;
+        for (size_t j = 0; j < i; j++) {
+            if (bySize[j]->width >= 2 * file->width && bySize[j]->height >= 2 * file->height) {
+                from = bySize[j]->image;
+            }
+        }
+        PWResampleRect rect = { 0, 0, from->width, from->height };
+        file->image = PWResampleCreateFromRect(from, rect, file->width, file->height, PWResampleFilter_Area);
+        if (!file->image) {
+            return PWError_OutOfMemory;
+        }
+    }
+    return PWError_None;
+}
+
+// MARK: - Encoding
+
+static PWError encodeGIF(const PWImageBuffer *image, PWDataBuffer *output) {
+    PWGIFEncoder *encoder = PWGIFEncoderCreate(output, image->width, image->height, 0);
+    if (!encoder) {
+        return PWError_OutOfMemory;
+    }
+    PWError error = PWGIFEncoderAddFrame(encoder, image, 0);
+    PWError finishError = PWGIFEncoderFinish(encoder);
+    return error ? error : finishError;
+}
+
+    /// PWParallelFunction encoding file INDEX. The JPEG encoder splits large files over the cores itself.
+static void encodeFile(void *context, size_t index) {
+    File *file = (File *)context + index;
+    size_t length = file->output->length;
+    if (file->preset->format == PWExportFormat_GIF) {
+        file->error = encodeGIF(file->image, file->output);
+    } else {
+            // As -[UIImage asJPEGData] encodes the single export.
+        PWJPEGEncodeOptions options;
+        PWJPEGEncodeOptionsInit(&options);
+        options.progressive = true;
+        if (file->preset->quality > 0) {
+            options.quality = file->preset->quality;
+        }
+        file->error = PWJPEGEncode(file->image, &options, file->output);
+    }
+    if (file->error) {
+        file->output->length = length;
+    }
+}
+
+PWError PWExportCreateFiles(const PWImageBuffer *image, const PWExportPreset *presets, size_t presetCount, PWDataBuffer *outputs) {
+    if (!image || (presetCount > 0 && (!presets || !outputs))) {
+        return PWError_InvalidParameter;
+    }
+    for (size_t i = 0; i < presetCount; i++) {
+        if ((unsigned)presets[i].format >= PWExportFormat_NUM_FORMATS || presets[i].quality < 0 || presets[i].quality > 100) {
+            return PWError_InvalidParameter;
+        }
+    }
+    if (presetCount == 0) {
+        return PWError_None;
+    }
+    File *files = calloc(presetCount, sizeof(File));
+    File **bySize = calloc(presetCount, sizeof(File *));
+    size_t *lengths = calloc(presetCount, sizeof(size_t));
+    PWError error = files && bySize && lengths ? PWError_None : PWError_OutOfMemory;
+    for (size_t i = 0; !error && i < presetCount; i++) {
+        files[i].preset = &presets[i];
+        files[i].output = &outputs[i];
+        lengths[i] = outputs[i].length;
+        PWExportPresetSize(&presets[i], image->width, image->height, &files[i].width, &files[i].height);
+        bySize[i] = &files[i];
+    }
+    if (!error) {
+        qsort(bySize, presetCount, sizeof(File *), compareSizes);
+        error = makeImages(image, bySize, presetCount);
+    }
+    if (!error) {
+        PWParallelFor(presetCount, files, encodeFile);
+        for (size_t i = 0; i < presetCount && !error; i++) {
+            error = files[i].error;
+        }
+        for (size_t i = 0; error && i < presetCount; i++) {
+            outputs[i].length = lengths[i];
+        }
+    }
+    for (size_t i = 0; files && i < presetCount; i++) {
+        if (files[i].image && files[i].image != image) {
+            PWImageBufferRelease((PWImageBuffer *)files[i].image);
+        }
+    }
+    free(files);
+    free(bySize);
+    free(lengths);
+    return error;
+}
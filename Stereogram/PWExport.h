@@ -0,0 +1,66 @@
+/*!
+ @header PWExport
+ @abstract Encodes one stereogram at several sizes and in several formats at once, for sharing.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ Sharing needs different sizes of the same image: full size for the camera roll, smaller for email, and tiny for
+ previews. Asking for each one separately builds and scales the stereogram every time. Here the caller builds it once
+ and passes a list of presets. The sizes are made as a cascade, largest first, each scaled from the smallest image
+ already made which is at least twice its size, so only the first is scaled from the full-size image. The files are
+ then all encoded at the same time, the smaller ones alongside the strips of the largest, so a bundle of sizes takes
+ little longer than the full-size file alone.
+ */
+
+#ifndef PWExport_h
+#define PWExport_h
+
+#include "PWImageBuffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * @enum
+ * @brief The kind of file a preset makes.
+ * @constant PWExportFormat_JPEG A progressive JPEG, which every other app can read and shows something sooner in a browser.
+ * @constant PWExportFormat_GIF  A single-frame GIF, in the GIF encoder's fixed palette.
+ */
+typedef enum PWExportFormat {
+    PWExportFormat_JPEG,
+    PWExportFormat_GIF,
+
+    PWExportFormat_NUM_FORMATS
+} PWExportFormat;
+
+/*! Longest side in pixels of the images the app attaches to email, and of the previews it shows before sharing. */
+enum { PWExportEmailSize = 1600, PWExportPreviewSize = 320 };
+
+/*! One file to make from the image. */
+typedef struct PWExportPreset {
+        /*! Length in pixels of the longest side of the file, or 0 for the size of the image. Images are never enlarged. */
+    size_t maximumSize;
+    PWExportFormat format;
+        /*! JPEG quality from 1 to 100, or 0 for PWJPEGDefaultQuality. Ignored for GIF. */
+    int quality;
+} PWExportPreset;
+
+/*! The size in pixels of the file PRESET makes from an image of WIDTH x HEIGHT. It keeps the image's shape. */
+void PWExportPresetSize(const PWExportPreset *preset, size_t width, size_t height, size_t *outputWidth, size_t *outputHeight);
+
+/*!
+ * Encode IMAGE once for each of the PRESETCOUNT presets, appending the Nth file to OUTPUTS[N].
+ *
+ * @param image   The stereogram, in any pixel format.
+ * @param outputs PRESETCOUNT initialised buffers. Each file is appended to whatever its buffer already contains.
+ * @return PWError_None, PWError_InvalidParameter if a preset is out of range, or PWError_OutOfMemory, in which case
+ *         every buffer in OUTPUTS is left as it was.
+ */
+PWError PWExportCreateFiles(const PWImageBuffer *image, const PWExportPreset *presets, size_t presetCount, PWDataBuffer *outputs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWExport_h */
@@ -0,0 +1,266 @@
+//
+//  PWGIFEncoder.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWGIFEncoder.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+    /// Levels per channel in the fixed palette. 6 * 7 * 6 = 252 colours; green gets the extra level as the eye is most sensitive to it.
+enum { RedLevels = 6, GreenLevels = 7, BlueLevels = 6 };
+
+enum {
+    MaxCodeBits = 12,
+    MaxCodes = 1 << MaxCodeBits,
+    ClearCode = 256,
+    EndOfInformationCode = 257,
+    FirstFreeCode = 258,
+        /// Prime larger than MaxCodes for the open-addressed string table.
+    HashTableSize = 5003
+};
+
+struct PWGIFEncoder {
+    PWDataBuffer *output;
+    size_t width, height;
+    PWError error;
+
+        /// Indexed pixels for the current frame.
+    uint8_t *indices;
+        /// One row of a frame which isn't packed RGB, converted to RGBX.
+    uint8_t *row;
+
+        /// LZW string table: key is (prefix code << 8 | next byte), value is the code for that string.
+    int32_t hashKeys[HashTableSize];
+    uint16_t hashCodes[HashTableSize];
+
+        /// Packed LZW output, written out in sub-blocks of up to 255 bytes.
+    uint32_t bitAccumulator;
+    int bitCount;
+    uint8_t block[255];
+    int blockLength;
+};
+
+// MARK: - Output helpers
+
+static void appendBytes(PWGIFEncoder *encoder, const void *bytes, size_t length) {
+    if (encoder->error == PWError_None && !PWDataBufferAppend(encoder->output, bytes, length)) {
+        encoder->error = PWError_OutOfMemory;
+    }
+}
+
+static void appendUInt16(PWGIFEncoder *encoder, unsigned value) {
+    uint8_t bytes[2] = { (uint8_t)value, (uint8_t)(value >> 8) };  // GIF is little-endian.
+    appendBytes(encoder, bytes, 2);
+}
+
+static void flushBlock(PWGIFEncoder *encoder) {
+    if (encoder->blockLength > 0) {
+        uint8_t length = (uint8_t)encoder->blockLength;
+        appendBytes(encoder, &length, 1);
+        appendBytes(encoder, encoder->block, (size_t)encoder->blockLength);
+        encoder->blockLength = 0;
+    }
+}
+
+static void writeCode(PWGIFEncoder *encoder, unsigned code, int codeSize) {
+    encoder->bitAccumulator |= (uint32_t)code << encoder->bitCount;
+    encoder->bitCount += codeSize;
+    while (encoder->bitCount >= 8) {
+        encoder->block[encoder->blockLength++] = (uint8_t)encoder->bitAccumulator;
+        encoder->bitAccumulator >>= 8;
+        encoder->bitCount -= 8;
+        if (encoder->blockLength == 255) {
+            flushBlock(encoder);
+        }
+    }
+}
+
+// MARK: - Colour quantisation
+
+static inline uint8_t paletteIndex(const uint8_t *pixel) {
+    unsigned r = (pixel[0] * (RedLevels   - 1) + 127) / 255;
+    unsigned g = (pixel[1] * (GreenLevels - 1) + 127) / 255;
+    unsigned b = (pixel[2] * (BlueLevels  - 1) + 127) / 255;
+    return (uint8_t)((r * GreenLevels + g) * BlueLevels + b);
+}
+
+static void writeColourTable(PWGIFEncoder *encoder) {
+    uint8_t table[256 * 3];
+    memset(table, 0, sizeof(table));
+    int index = 0;
+    for (int r = 0; r < RedLevels; r++) {
+        for (int g = 0; g < GreenLevels; g++) {
+            for (int b = 0; b < BlueLevels; b++, index++) {
+                table[index * 3 + 0] = (uint8_t)(r * 255 / (RedLevels   - 1));
+                table[index * 3 + 1] = (uint8_t)(g * 255 / (GreenLevels - 1));
+                table[index * 3 + 2] = (uint8_t)(b * 255 / (BlueLevels  - 1));
+            }
+        }
+    }
+    appendBytes(encoder, table, sizeof(table));
+}
+
+// MARK: - LZW
+
+static void resetStringTable(PWGIFEncoder *encoder) {
+    for (int i = 0; i < HashTableSize; i++) {
+        encoder->hashKeys[i] = -1;
+    }
+}
+
+static void compressIndices(PWGIFEncoder *encoder, const uint8_t *indices, size_t count) {
+    const int minimumCodeSize = 8;
+    int codeSize = minimumCodeSize + 1;
+    unsigned nextCode = FirstFreeCode;
+    encoder->bitAccumulator = 0;
+    encoder->bitCount = 0;
+    encoder->blockLength = 0;
+
+    uint8_t minimumCodeSizeByte = minimumCodeSize;
+    appendBytes(encoder, &minimumCodeSizeByte, 1);
+    resetStringTable(encoder);
+    writeCode(encoder, ClearCode, codeSize);
+
+    unsigned prefix = indices[0];
+    for (size_t i = 1; i < count; i++) {
+        uint8_t next = indices[i];
+        int32_t key = (int32_t)(prefix << 8 | next);
+        unsigned slot = (unsigned)key % HashTableSize;
+            // Linear probing. The table is never more than ~80% full so this terminates quickly.
+        while (encoder->hashKeys[slot] != -1 && encoder->hashKeys[slot] != key) {
+            slot = (slot + 1) % HashTableSize;
+        }
+        if (encoder->hashKeys[slot] == key) {
+            prefix = encoder->hashCodes[slot];
+            continue;
+        }
+
+        writeCode(encoder, prefix, codeSize);
+        if (nextCode < MaxCodes) {
+            encoder->hashKeys[slot] = key;
+            encoder->hashCodes[slot] = (uint16_t)nextCode;
+            if (nextCode == (1u << codeSize) && codeSize < MaxCodeBits) {
+                codeSize++;
+            }
+            nextCode++;
+        } else {
+                // Table full: start again rather than carry on with stale strings.
+            writeCode(encoder, ClearCode, codeSize);
+            resetStringTable(encoder);
+            codeSize = minimumCodeSize + 1;
+            nextCode = FirstFreeCode;
+        }
+        prefix = next;
+    }
+    writeCode(encoder, prefix, codeSize);
+    writeCode(encoder, EndOfInformationCode, codeSize);
+    if (encoder->bitCount > 0) {
+        encoder->block[encoder->blockLength++] = (uint8_t)encoder->bitAccumulator;
+        encoder->bitAccumulator = 0;
+        encoder->bitCount = 0;
+    }
+    flushBlock(encoder);
+    uint8_t terminator = 0;
+    appendBytes(encoder, &terminator, 1);
+}
+
+// MARK: - Public interface
+
+PWGIFEncoder *PWGIFEncoderCreate(PWDataBuffer *output, size_t width, size_t height, unsigned loopCount) {
+    if (!output || width == 0 || height == 0 || width > 0xFFFF || height > 0xFFFF) {
+        return NULL;
+    }
+    PWGIFEncoder *encoder = calloc(1, sizeof(PWGIFEncoder));
+    if (!encoder) {
+        return NULL;
+    }
+    encoder->indices = malloc(width * height);
+    encoder->row = malloc(width * 4);
+    if (!encoder->indices || !encoder->row) {
+        free(encoder->indices);
+        free(encoder->row);
+        free(encoder);
+        return NULL;
+    }
+    encoder->output = output;
+    encoder->width = width;
+    encoder->height = height;
+    encoder->error = PWError_None;
+
+        // Header and logical screen descriptor, with a 256-entry global colour table.
+    appendBytes(encoder, "GIF89a", 6);
+    appendUInt16(encoder, (unsigned)width);
+    appendUInt16(encoder, (unsigned)height);
+    static const uint8_t screenFlags[3] = { 0xF7, 0, 0 };  // Global table, 8 bits colour resolution, 2^(7+1) entries.
+    appendBytes(encoder, screenFlags, 3);
+    writeColourTable(encoder);
+
+        // NETSCAPE2.0 application extension to make the animation loop.
+    static const uint8_t loopExtension[16] = { 0x21, 0xFF, 11, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0', 3, 1 };
+    appendBytes(encoder, loopExtension, sizeof(loopExtension));
+    appendUInt16(encoder, loopCount);
+    uint8_t terminator = 0;
+    appendBytes(encoder, &terminator, 1);
+    return encoder;
+}
+
+PWError PWGIFEncoderAddFrame(PWGIFEncoder *encoder, const PWImageBuffer *frame, unsigned delayCentiseconds) {
+    if (!encoder || !frame) {
+        return PWError_InvalidParameter;
+    }
+    if (frame->width > encoder->width || frame->height > encoder->height) {
+        return PWError_InvalidParameter;
+    }
+    if (encoder->error != PWError_None) {
+        return encoder->error;
+    }
+
+    bool packed = frame->format == PWPixelFormat_RGBA8888 || frame->format == PWPixelFormat_RGB888;
+    size_t bytesPerPixel = packed ? PWPixelFormatBytesPerPixel(frame->format) : 4;
+    for (size_t y = 0; y < frame->height; y++) {
+        const uint8_t *pixel = PWImageBufferRow(frame, y);
+        if (!packed) {
+            PWImageBufferConvertRowToRGBX(frame, y, 0, frame->width, encoder->row);
+            pixel = encoder->row;
+        }
+        uint8_t *index = encoder->indices + y * frame->width;
+        for (size_t x = 0; x < frame->width; x++, pixel += bytesPerPixel) {
+            *index++ = paletteIndex(pixel);
+        }
+    }
+
+        // Graphic control extension: frame delay, no transparency, leave the frame in place when done.
+    uint8_t graphicControl[8] = { 0x21, 0xF9, 4, 0x04, (uint8_t)delayCentiseconds, (uint8_t)(delayCentiseconds >> 8), 0, 0 };
+    appendBytes(encoder, graphicControl, sizeof(graphicControl));
+
+        // Image descriptor: full frame at the origin, using the global colour table.
+    uint8_t separator = 0x2C;
+    appendBytes(encoder, &separator, 1);
+    appendUInt16(encoder, 0);
+    appendUInt16(encoder, 0);
+    appendUInt16(encoder, (unsigned)frame->width);
+    appendUInt16(encoder, (unsigned)frame->height);
+    uint8_t flags = 0;
+    appendBytes(encoder, &flags, 1);
+
+    compressIndices(encoder, encoder->indices, frame->width * frame->height);
+    return encoder->error;
+}
+
+PWError PWGIFEncoderFinish(PWGIFEncoder *encoder) {
+    if (!encoder) {
+        return PWError_InvalidParameter;
+    }
+    uint8_t trailer = 0x3B;
+    appendBytes(encoder, &trailer, 1);
+    PWError error = encoder->error;
+    free(encoder->indices);
+    free(encoder->row);
+    free(encoder);
+    return error;
+}
@@ -0,0 +1,56 @@
+/*!
+ @header PWGIFEncoder
+ @abstract A portable animated GIF encoder for the stereogram "animated" viewing method.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+ */
+
+#ifndef PWGIFEncoder_h
+#define PWGIFEncoder_h
+
+#include "PWImageBuffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Opaque encoder state. Frames are quantised to a fixed 6x7x6 colour cube and LZW-compressed as they are added,
+ * so only one frame needs to be in memory at a time.
+ */
+typedef struct PWGIFEncoder PWGIFEncoder;
+
+/*!
+ * Start a new GIF and write its header to OUTPUT.
+ *
+ * @param output    An initialised buffer. The file is appended to whatever it already contains. The encoder only ever
+ *                  appends, so the caller may write out what is there and empty it between frames to stream the file.
+ * @param width     Width of the animation in pixels.
+ * @param height    Height of the animation in pixels.
+ * @param loopCount Number of times to repeat the animation; 0 means loop forever.
+ * @return A new encoder, or NULL if the parameters were invalid or memory ran out.
+ */
+PWGIFEncoder *PWGIFEncoderCreate(PWDataBuffer *output, size_t width, size_t height, unsigned loopCount);
+
+/*!
+ * Append one frame to the animation.
+ *
+ * @param encoder            The encoder.
+ * @param frame              The image, in any pixel format. It is drawn at the top-left and must not be larger than the animation.
+ *                           Formats other than RGBA8888 and RGB888 are converted a row at a time, so nothing is copied.
+ * @param delayCentiseconds  How long to show the frame, in hundredths of a second.
+ * @return PWError_None on success.
+ */
+PWError PWGIFEncoderAddFrame(PWGIFEncoder *encoder, const PWImageBuffer *frame, unsigned delayCentiseconds);
+
+/*!
+ * Write the GIF trailer and free the encoder. The encoder must not be used after this call.
+ * @return PWError_None if the file is complete, or the first error hit while encoding.
+ */
+PWError PWGIFEncoderFinish(PWGIFEncoder *encoder);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWGIFEncoder_h */
@@ -0,0 +1,457 @@
+//
+//  PWImageBuffer.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWImageBuffer.h"
+#include "PWBufferPool.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+    /// Rows are padded to this many bytes so SIMD loads on a row start are aligned.
+static const size_t RowAlignment = 16;
+
+static size_t alignedRowBytes(size_t bytes) {
+    return (bytes + RowAlignment - 1) & ~(RowAlignment - 1);
+}
+
+size_t PWPixelFormatBytesPerPixel(PWPixelFormat format) {
+    switch (format) {
+        case PWPixelFormat_RGBA8888: return 4;
+        case PWPixelFormat_Gray8:    return 1;
+        case PWPixelFormat_RGB888:   return 3;
+        case PWPixelFormat_YCbCr420: return 1;
+        default:
+            assert(!"Unknown pixel format");
+            return 0;
+    }
+}
+
+bool PWPixelFormatIsPlanar(PWPixelFormat format) {
+    return format == PWPixelFormat_YCbCr420;
+}
+
+bool PWPixelFormatHasAlpha(PWPixelFormat format) {
+    return format == PWPixelFormat_RGBA8888;
+}
+
+    /// Width and height of the chroma planes for a YCbCr420 image of the given size.
+static inline size_t chromaLength(size_t lumaLength) {
+    return (lumaLength + 1) / 2;
+}
+
+PWImageBuffer *PWImageBufferCreate(size_t width, size_t height, PWPixelFormat format) {
+    if (width == 0 || height == 0 || format >= PWPixelFormat_NUM_FORMATS) {
+        return NULL;
+    }
+    size_t bytesPerRow = alignedRowBytes(width * PWPixelFormatBytesPerPixel(format));
+    size_t chromaBytesPerRow = 0, chromaPlaneSize = 0;
+    if (PWPixelFormatIsPlanar(format)) {
+        chromaBytesPerRow = alignedRowBytes(chromaLength(width));
+        chromaPlaneSize = chromaBytesPerRow * chromaLength(height);
+    }
+        // All the planes share one allocation, so data is the only pointer we need to give back to the pool.
+    size_t dataSize = bytesPerRow * height + chromaPlaneSize * 2;
+    uint8_t *data = PWBufferPoolAllocate(dataSize);
+    if (!data) {
+        return NULL;
+    }
+    PWImageBuffer *buffer = calloc(1, sizeof(PWImageBuffer));
+    if (!buffer) {
+        PWBufferPoolRecycle(data, dataSize);
+        return NULL;
+    }
+    buffer->width = width;
+    buffer->height = height;
+    buffer->bytesPerRow = bytesPerRow;
+    buffer->format = format;
+    buffer->data = data;
+    if (chromaPlaneSize) {
+        buffer->chroma[0] = data + bytesPerRow * height;
+        buffer->chroma[1] = buffer->chroma[0] + chromaPlaneSize;
+        buffer->chromaBytesPerRow = chromaBytesPerRow;
+    }
+    buffer->_retainCount = 1;
+    buffer->_ownsData = true;
+    return buffer;
+}
+
+PWImageBuffer *PWImageBufferCreateWithData(uint8_t *data, size_t width, size_t height, size_t bytesPerRow, PWPixelFormat format) {
+    if (!data || width == 0 || height == 0 || format >= PWPixelFormat_NUM_FORMATS || PWPixelFormatIsPlanar(format)
+        || bytesPerRow < width * PWPixelFormatBytesPerPixel(format)) {
+        return NULL;
+    }
+    PWImageBuffer *buffer = calloc(1, sizeof(PWImageBuffer));
+    if (!buffer) {
+        return NULL;
+    }
+    buffer->width = width;
+    buffer->height = height;
+    buffer->bytesPerRow = bytesPerRow;
+    buffer->format = format;
+    buffer->data = data;
+    buffer->_retainCount = 1;
+    buffer->_ownsData = false;
+    return buffer;
+}
+
+PWImageBuffer *PWImageBufferCreateSubImage(PWImageBuffer *source, PWImageRect rect) {
+    if (!source || rect.x >= source->width || rect.y >= source->height || rect.width == 0 || rect.height == 0) {
+        return NULL;
+    }
+    bool planar = PWPixelFormatIsPlanar(source->format);
+    if (planar && (rect.x % 2 != 0 || rect.y % 2 != 0)) {
+        return NULL;
+    }
+    PWImageBuffer *buffer = calloc(1, sizeof(PWImageBuffer));
+    if (!buffer) {
+        return NULL;
+    }
+    buffer->width  = rect.width  < source->width  - rect.x ? rect.width  : source->width  - rect.x;
+    buffer->height = rect.height < source->height - rect.y ? rect.height : source->height - rect.y;
+    buffer->bytesPerRow = source->bytesPerRow;
+    buffer->format = source->format;
+    buffer->data = PWImageBufferRow(source, rect.y) + rect.x * PWPixelFormatBytesPerPixel(source->format);
+    if (planar) {
+        for (int plane = 0; plane < 2; plane++) {
+            buffer->chroma[plane] = source->chroma[plane] + (rect.y / 2) * source->chromaBytesPerRow + rect.x / 2;
+        }
+        buffer->chromaBytesPerRow = source->chromaBytesPerRow;
+    }
+    buffer->_retainCount = 1;
+    buffer->_ownsData = false;
+    buffer->_parent = PWImageBufferRetain(source);
+    return buffer;
+}
+
+static void copyPlane(uint8_t *destination, size_t destinationBytesPerRow,
+                      const uint8_t *source, size_t sourceBytesPerRow, size_t rowLength, size_t rowCount) {
+    for (size_t y = 0; y < rowCount; y++) {
+        memcpy(destination + y * destinationBytesPerRow, source + y * sourceBytesPerRow, rowLength);
+    }
+}
+
+PWImageBuffer *PWImageBufferCreateCopy(const PWImageBuffer *source) {
+    if (!source) {
+        return NULL;
+    }
+    PWImageBuffer *copy = PWImageBufferCreate(source->width, source->height, source->format);
+    if (!copy) {
+        return NULL;
+    }
+    copyPlane(copy->data, copy->bytesPerRow, source->data, source->bytesPerRow,
+              source->width * PWPixelFormatBytesPerPixel(source->format), source->height);
+    if (PWPixelFormatIsPlanar(source->format)) {
+        for (int plane = 0; plane < 2; plane++) {
+            copyPlane(copy->chroma[plane], copy->chromaBytesPerRow, source->chroma[plane], source->chromaBytesPerRow,
+                      chromaLength(source->width), chromaLength(source->height));
+        }
+    }
+    return copy;
+}
+
+PWImageBuffer *PWImageBufferRetain(PWImageBuffer *buffer) {
+    if (buffer) {
+        __atomic_add_fetch(&buffer->_retainCount, 1, __ATOMIC_RELAXED);
+    }
+    return buffer;
+}
+
+void PWImageBufferRelease(PWImageBuffer *buffer) {
+    if (!buffer) {
+        return;
+    }
+    if (__atomic_sub_fetch(&buffer->_retainCount, 1, __ATOMIC_ACQ_REL) == 0) {
+        if (buffer->_ownsData) {
+                // For a buffer which owns its pixels, this is the size PWImageBufferCreate() asked the pool for.
+            PWBufferPoolRecycle(buffer->data, PWImageBufferByteCount(buffer));
+        }
+        PWImageBufferRelease(buffer->_parent);
+        free(buffer);
+    }
+}
+
+size_t PWImageBufferByteCount(const PWImageBuffer *buffer) {
+    if (!buffer) {
+        return 0;
+    }
+    size_t chromaBytes = buffer->chromaBytesPerRow * chromaLength(buffer->height) * (buffer->chroma[0] ? 2 : 0);
+    return buffer->bytesPerRow * buffer->height + chromaBytes;
+}
+
+    /// Value of a black sample in each plane: zero everywhere except the chroma planes, where the neutral value is 128.
+static const uint8_t BlackChroma = 128;
+
+void PWImageBufferClear(PWImageBuffer *buffer) {
+    size_t rowLength = buffer->width * PWPixelFormatBytesPerPixel(buffer->format);
+    for (size_t y = 0; y < buffer->height; y++) {
+        memset(PWImageBufferRow(buffer, y), 0, rowLength);
+    }
+    if (PWPixelFormatIsPlanar(buffer->format)) {
+        for (int plane = 0; plane < 2; plane++) {
+            for (size_t y = 0; y < chromaLength(buffer->height); y++) {
+                memset(buffer->chroma[plane] + y * buffer->chromaBytesPerRow, BlackChroma, chromaLength(buffer->width));
+            }
+        }
+    }
+}
+
+    /// Fill one row of a side-by-side image from the rows of the two photos, or with FILL where a photo doesn't reach.
+static inline void composeRow(uint8_t *row, const uint8_t *leftRow, size_t leftLength,
+                              const uint8_t *rightRow, size_t rightLength, uint8_t fill) {
+    if (leftRow) {
+        memcpy(row, leftRow, leftLength);
+    } else {
+        memset(row, fill, leftLength);
+    }
+    if (rightRow) {
+        memcpy(row + leftLength, rightRow, rightLength);
+    } else {
+        memset(row + leftLength, fill, rightLength);
+    }
+}
+
+PWImageBuffer *PWImageBufferCreateSideBySide(const PWImageBuffer *left, const PWImageBuffer *right) {
+    if (!left || !right || left->format != right->format) {
+        return NULL;
+    }
+    bool planar = PWPixelFormatIsPlanar(left->format);
+    if (planar && left->width % 2 != 0) {
+        return NULL;
+    }
+    size_t height = left->height > right->height ? left->height : right->height;
+    PWImageBuffer *stereogram = PWImageBufferCreate(left->width + right->width, height, left->format);
+    if (!stereogram) {
+        return NULL;
+    }
+    size_t bytesPerPixel = PWPixelFormatBytesPerPixel(left->format);
+    size_t leftLength = left->width * bytesPerPixel, rightLength = right->width * bytesPerPixel;
+
+        // Each output row is two straight copies, so this runs at memory bandwidth.
+        // Rows below the shorter photo are cleared rather than left undefined.
+    for (size_t y = 0; y < height; y++) {
+        composeRow(PWImageBufferRow(stereogram, y),
+                   y < left->height  ? PWImageBufferRow(left, y)  : NULL, leftLength,
+                   y < right->height ? PWImageBufferRow(right, y) : NULL, rightLength, 0);
+    }
+    if (planar) {
+        size_t leftChromaHeight = chromaLength(left->height), rightChromaHeight = chromaLength(right->height);
+        size_t leftChromaLength = left->width / 2, rightChromaLength = chromaLength(right->width);
+        for (int plane = 0; plane < 2; plane++) {
+            for (size_t y = 0; y < chromaLength(height); y++) {
+                composeRow(stereogram->chroma[plane] + y * stereogram->chromaBytesPerRow,
+                           y < leftChromaHeight  ? left->chroma[plane]  + y * left->chromaBytesPerRow  : NULL, leftChromaLength,
+                           y < rightChromaHeight ? right->chroma[plane] + y * right->chromaBytesPerRow : NULL, rightChromaLength,
+                           BlackChroma);
+            }
+        }
+    }
+    return stereogram;
+}
+
+PWError PWImageBufferCreateShiftedViews(PWImageBuffer *left, PWImageBuffer *right, long offset,
+                                        PWImageBuffer **leftView, PWImageBuffer **rightView) {
+    if (!leftView || !rightView) {
+        return PWError_InvalidParameter;
+    }
+    *leftView = *rightView = NULL;
+    if (!left || !right) {
+        return PWError_InvalidParameter;
+    }
+    if (PWPixelFormatIsPlanar(left->format) || PWPixelFormatIsPlanar(right->format)) {
+        offset = offset / 2 * 2;
+    }
+    size_t shift = (size_t)(offset < 0 ? -offset : offset);
+    if (shift >= left->width || shift >= right->width) {
+        return PWError_InvalidParameter;
+    }
+        // Moving the right photo right is the same as cutting columns off the left of the left photo and the right of the right photo.
+    PWImageRect leftRect  = { offset > 0 ? shift : 0, 0, left->width  - shift, left->height  };
+    PWImageRect rightRect = { offset < 0 ? shift : 0, 0, right->width - shift, right->height };
+    *leftView  = PWImageBufferCreateSubImage(left, leftRect);
+    *rightView = PWImageBufferCreateSubImage(right, rightRect);
+    if (!*leftView || !*rightView) {
+        PWImageBufferRelease(*leftView);
+        PWImageBufferRelease(*rightView);
+        *leftView = *rightView = NULL;
+        return PWError_OutOfMemory;
+    }
+    return PWError_None;
+}
+
+    /// Halve one plane of CHANNELS-byte pixels by averaging 2x2 blocks. The last row and column are repeated if the size is odd.
+static void halvePlane(uint8_t *destination, size_t destinationBytesPerRow, size_t destinationWidth, size_t destinationHeight,
+                       const uint8_t *source, size_t sourceBytesPerRow, size_t sourceWidth, size_t sourceHeight, size_t channels) {
+    for (size_t y = 0; y < destinationHeight; y++) {
+        const uint8_t *top = source + (y * 2) * sourceBytesPerRow;
+        const uint8_t *bottom = (y * 2 + 1 < sourceHeight) ? top + sourceBytesPerRow : top;
+        uint8_t *output = destination + y * destinationBytesPerRow;
+        for (size_t x = 0; x < destinationWidth; x++) {
+            size_t left = x * 2 * channels, right = (x * 2 + 1 < sourceWidth) ? left + channels : left;
+            for (size_t c = 0; c < channels; c++) {
+                *output++ = (uint8_t)((top[left + c] + top[right + c] + bottom[left + c] + bottom[right + c] + 2) >> 2);
+            }
+        }
+    }
+}
+
+PWImageBuffer *PWImageBufferCreateHalfSize(const PWImageBuffer *source) {
+    if (!source) {
+        return NULL;
+    }
+    size_t width = (source->width + 1) / 2, height = (source->height + 1) / 2;
+    PWImageBuffer *half = PWImageBufferCreate(width, height, source->format);
+    if (!half) {
+        return NULL;
+    }
+    halvePlane(half->data, half->bytesPerRow, width, height, source->data, source->bytesPerRow,
+               source->width, source->height, PWPixelFormatBytesPerPixel(source->format));
+    if (PWPixelFormatIsPlanar(source->format)) {
+        for (int plane = 0; plane < 2; plane++) {
+            halvePlane(half->chroma[plane], half->chromaBytesPerRow, chromaLength(width), chromaLength(height),
+                       source->chroma[plane], source->chromaBytesPerRow, chromaLength(source->width), chromaLength(source->height), 1);
+        }
+    }
+    return half;
+}
+
+// MARK: - Display conversion
+
+static inline uint8_t clampToByte(int value) {
+    return (uint8_t)(value < 0 ? 0 : value > 255 ? 255 : value);
+}
+
+    /// Fixed-point JFIF YCbCr to RGB coefficients, scaled by 2^16.
+enum {
+    CrToR = 91881,   // 1.402
+    CbToG = 22554,   // 0.344136
+    CrToG = 46802,   // 0.714136
+    CbToB = 116130,  // 1.772
+    ConversionRound = 1 << 15
+};
+
+void PWImageBufferConvertRowToRGBX(const PWImageBuffer *source, size_t y, size_t x, size_t count, uint8_t *destination) {
+    const uint8_t *row = PWImageBufferRow(source, y);
+    switch (source->format) {
+        case PWPixelFormat_RGBA8888:
+            memcpy(destination, row + x * 4, count * 4);
+            break;
+
+        case PWPixelFormat_RGB888:
+            for (const uint8_t *pixel = row + x * 3, *end = pixel + count * 3; pixel < end; pixel += 3, destination += 4) {
+                destination[0] = pixel[0];
+                destination[1] = pixel[1];
+                destination[2] = pixel[2];
+                destination[3] = 255;
+            }
+            break;
+
+        case PWPixelFormat_Gray8:
+            for (const uint8_t *pixel = row + x, *end = pixel + count; pixel < end; pixel++, destination += 4) {
+                destination[0] = destination[1] = destination[2] = *pixel;
+                destination[3] = 255;
+            }
+            break;
+
+        case PWPixelFormat_YCbCr420: {
+            const uint8_t *cbRow = source->chroma[0] + (y / 2) * source->chromaBytesPerRow;
+            const uint8_t *crRow = source->chroma[1] + (y / 2) * source->chromaBytesPerRow;
+            for (size_t column = x; column < x + count; column++, destination += 4) {
+                int luma = row[column], cb = cbRow[column / 2] - 128, cr = crRow[column / 2] - 128;
+                destination[0] = clampToByte(luma + ((CrToR * cr + ConversionRound) >> 16));
+                destination[1] = clampToByte(luma + ((-CbToG * cb - CrToG * cr + ConversionRound) >> 16));
+                destination[2] = clampToByte(luma + ((CbToB * cb + ConversionRound) >> 16));
+                destination[3] = 255;
+            }
+            break;
+        }
+
+        default:
+            assert(!"Unknown pixel format");
+            break;
+    }
+}
+
+size_t PWImageBufferReadRGBX(const PWImageBuffer *source, size_t position, size_t count, uint8_t *destination) {
+    size_t rowLength = source->width * 4, imageLength = rowLength * source->height;
+    if (position >= imageLength) {
+        return 0;
+    }
+    if (count > imageLength - position) {
+        count = imageLength - position;
+    }
+        // Requests can start and end part way through a pixel, so convert whole pixels and copy out the bytes we need.
+    size_t written = 0;
+    while (written < count) {
+        size_t offset = position + written;
+        size_t y = offset / rowLength, byteInRow = offset % rowLength;
+        size_t x = byteInRow / 4, byteInPixel = byteInRow % 4;
+        size_t wanted = count - written;
+        if (byteInPixel == 0 && wanted >= 4) {
+                // Whole pixels: convert straight into the destination, up to the end of the row.
+            size_t pixels = wanted / 4;
+            if (pixels > source->width - x) {
+                pixels = source->width - x;
+            }
+            PWImageBufferConvertRowToRGBX(source, y, x, pixels, destination + written);
+            written += pixels * 4;
+        } else {
+            uint8_t pixel[4];
+            PWImageBufferConvertRowToRGBX(source, y, x, 1, pixel);
+            size_t length = 4 - byteInPixel < wanted ? 4 - byteInPixel : wanted;
+            memcpy(destination + written, pixel + byteInPixel, length);
+            written += length;
+        }
+    }
+    return written;
+}
+
+// MARK: - Byte buffers
+
+bool PWDataBufferInit(PWDataBuffer *buffer, size_t capacity) {
+    buffer->length = 0;
+    buffer->capacity = capacity ? capacity : 256;
+    buffer->bytes = malloc(buffer->capacity);
+    if (!buffer->bytes) {
+        buffer->capacity = 0;
+        return false;
+    }
+    return true;
+}
+
+bool PWDataBufferReserve(PWDataBuffer *buffer, size_t extra) {
+    if (buffer->capacity - buffer->length >= extra) {
+        return true;
+    }
+    size_t newCapacity = buffer->capacity ? buffer->capacity : 256;
+    while (newCapacity - buffer->length < extra) {
+        newCapacity *= 2;
+    }
+    uint8_t *bytes = realloc(buffer->bytes, newCapacity);
+    if (!bytes) {
+        return false;
+    }
+    buffer->bytes = bytes;
+    buffer->capacity = newCapacity;
+    return true;
+}
+
+bool PWDataBufferAppend(PWDataBuffer *buffer, const void *bytes, size_t length) {
+    if (!PWDataBufferReserve(buffer, length)) {
+        return false;
+    }
+    memcpy(buffer->bytes + buffer->length, bytes, length);
+    buffer->length += length;
+    return true;
+}
+
+void PWDataBufferFree(PWDataBuffer *buffer) {
+    free(buffer->bytes);
+    buffer->bytes = NULL;
+    buffer->length = buffer->capacity = 0;
+}
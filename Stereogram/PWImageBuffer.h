@@ -0,0 +1,248 @@
+/*!
+ @header PWImageBuffer
+ @abstract Portable pixel buffers and the basic operations the stereogram pipeline performs on them.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ Everything in the PW image core is plain C with no UIKit or CoreGraphics dependency, so the same code
+ runs inside the app and in the Linux benchmark harness under "Stereogram Benchmarks".
+ */
+
+#ifndef PWImageBuffer_h
+#define PWImageBuffer_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * @enum
+ * @brief Error codes returned by the image core.
+ * @constant PWError_None             The operation succeeded.
+ * @constant PWError_OutOfMemory      An allocation failed.
+ * @constant PWError_InvalidParameter A parameter was NULL or out of range.
+ * @constant PWError_IO               A file system call failed. Check errno for details.
+ * @constant PWError_InvalidFormat    Input data was not in the expected format.
+ * @constant PWError_NotSupported     The input is valid but uses a feature this code doesn't handle.
+ * @constant PWError_Cancelled        The caller asked for the work to stop before it finished.
+ */
+typedef enum PWError {
+    PWError_None = 0,
+    PWError_OutOfMemory,
+    PWError_InvalidParameter,
+    PWError_IO,
+    PWError_InvalidFormat,
+    PWError_NotSupported,
+    PWError_Cancelled
+} PWError;
+
+/*!
+ * @enum
+ * @brief Memory layout of the pixels in a PWImageBuffer.
+ * @constant PWPixelFormat_RGBA8888 8-bit R, G, B, A in that byte order, premultiplied alpha.
+ *                                  Matches a CoreGraphics bitmap with kCGImageAlphaPremultipliedLast | kCGBitmapByteOrder32Big.
+ * @constant PWPixelFormat_Gray8    8-bit luminance, one byte per pixel.
+ * @constant PWPixelFormat_RGB888   8-bit R, G, B in that byte order with no alpha. Used for opaque photos.
+ * @constant PWPixelFormat_YCbCr420 Planar JFIF (full-range) YCbCr, with chroma at half resolution in both directions.
+ *                                  DATA and BYTESPERROW describe the luma plane; CHROMA and CHROMABYTESPERROW the Cb and Cr planes.
+ *                                  This is what a 2x2-subsampled JPEG decodes to, at 1.5 bytes per pixel.
+ */
+typedef enum PWPixelFormat {
+    PWPixelFormat_RGBA8888,
+    PWPixelFormat_Gray8,
+    PWPixelFormat_RGB888,
+    PWPixelFormat_YCbCr420,
+
+    PWPixelFormat_NUM_FORMATS
+} PWPixelFormat;
+
+/*!
+ * A rectangular block of pixels.
+ *
+ * The fields are public so kernels can walk rows directly. Use PWImageBufferCreate() to make one and
+ * PWImageBufferRelease() to free it. Buffers are reference counted so they can be shared between caches.
+ */
+typedef struct PWImageBuffer {
+        /*! Width and height in pixels. */
+    size_t width, height;
+        /*! Distance in bytes between the start of one row and the start of the next. */
+    size_t bytesPerRow;
+        /*! Layout of each pixel. */
+    PWPixelFormat format;
+        /*! Pointer to the top-left pixel. */
+    uint8_t *data;
+        /*! Planar formats only: the Cb and Cr planes and the distance in bytes between their rows. NULL and 0 otherwise. */
+    uint8_t *chroma[2];
+    size_t chromaBytesPerRow;
+
+        /*! Private: reference count and whether we must free data when the count drops to 0. */
+    int32_t _retainCount;
+    bool _ownsData;
+        /*! Private: for a sub-image, the buffer that owns the pixels. Retained until this buffer is freed. */
+    struct PWImageBuffer *_parent;
+} PWImageBuffer;
+
+/*! A rectangle of whole pixels, with the origin at the top-left of the image. */
+typedef struct PWImageRect {
+    size_t x, y, width, height;
+} PWImageRect;
+
+/*! Number of bytes used by one pixel in FORMAT. For planar formats this is the size of one luma sample. */
+size_t PWPixelFormatBytesPerPixel(PWPixelFormat format);
+
+/*! True if FORMAT stores its channels in separate planes. Kernels that walk packed rows must reject these. */
+bool PWPixelFormatIsPlanar(PWPixelFormat format);
+
+/*! True if FORMAT has an alpha channel. */
+bool PWPixelFormatHasAlpha(PWPixelFormat format);
+
+/*!
+ * Allocate a new buffer. The contents are undefined.
+ *
+ * @param width  Width in pixels. Must be > 0.
+ * @param height Height in pixels. Must be > 0.
+ * @param format Layout of the pixels.
+ * @return A new buffer with a retain count of 1, or NULL if the allocation failed.
+ */
+PWImageBuffer *PWImageBufferCreate(size_t width, size_t height, PWPixelFormat format);
+
+/*!
+ * Wrap existing pixel memory in a buffer without copying it.
+ *
+ * The caller must keep DATA alive for as long as the buffer exists. It will not be freed by PWImageBufferRelease().
+ * Planar formats are not supported.
+ */
+PWImageBuffer *PWImageBufferCreateWithData(uint8_t *data, size_t width, size_t height, size_t bytesPerRow, PWPixelFormat format);
+
+/*!
+ * Return a buffer showing just the part of SOURCE inside RECT, sharing its pixels rather than copying them.
+ *
+ * This is how crops are applied: every kernel reads rows through DATA and BYTESPERROW, so it sees only the sub-image.
+ * The result retains SOURCE until it is released. Writing to either buffer changes what the other sees.
+ *
+ * @param rect The area to show. It is clipped to the image. For YCbCr420, X and Y must be even so that the
+ *             chroma samples stay aligned with the luma.
+ * @return A new buffer, or NULL if RECT doesn't overlap the image, X or Y is odd for a planar format, or the allocation failed.
+ */
+PWImageBuffer *PWImageBufferCreateSubImage(PWImageBuffer *source, PWImageRect rect);
+
+/*! Make a deep copy of SOURCE with tightly packed rows. */
+PWImageBuffer *PWImageBufferCreateCopy(const PWImageBuffer *source);
+
+/*! Increment the reference count. Returns BUFFER for convenience. */
+PWImageBuffer *PWImageBufferRetain(PWImageBuffer *buffer);
+
+/*! Decrement the reference count, freeing the buffer when it reaches 0. NULL is ignored. */
+void PWImageBufferRelease(PWImageBuffer *buffer);
+
+/*! Total number of bytes of pixel memory the buffer refers to. For a sub-image this is just the part it shows. */
+size_t PWImageBufferByteCount(const PWImageBuffer *buffer);
+
+/*! Pointer to the first byte of row Y. */
+static inline uint8_t *PWImageBufferRow(const PWImageBuffer *buffer, size_t y) {
+    return buffer->data + y * buffer->bytesPerRow;
+}
+
+/*! Set every pixel in the buffer to black (transparent black for RGBA8888). */
+void PWImageBufferClear(PWImageBuffer *buffer);
+
+/*!
+ * Composite two photos side by side, LEFT at x = 0 and RIGHT immediately after it.
+ *
+ * This is the portable equivalent of +[ImageManager makeStereogramWithLeftPhoto:rightPhoto:].
+ * The result is as tall as the taller input; any area not covered by a photo is black (transparent for RGBA8888).
+ * Both inputs must have the same pixel format. For YCbCr420 the left photo must have an even width, so that
+ * the chroma samples of both photos stay aligned.
+ *
+ * @return A new buffer, or NULL on failure.
+ */
+PWImageBuffer *PWImageBufferCreateSideBySide(const PWImageBuffer *left, const PWImageBuffer *right);
+
+/*!
+ * Make views of LEFT and RIGHT in which the right photo has moved OFFSET pixels to the right of the left one.
+ * This changes the convergence of the pair: positive offsets push the scene further away, negative ones bring it nearer.
+ *
+ * Nothing is copied. Each view is a sub-image leaving out |OFFSET| columns, from the left edge of LEFT and the right
+ * edge of RIGHT for a positive offset and the other way round for a negative one, so the views are narrower than the
+ * photos by that much. Composite them with PWImageBufferCreateSideBySide() or PWAnaglyphCreate() as usual.
+ *
+ * @param offset    For planar formats this is rounded towards zero to an even number, so the chroma stays aligned.
+ * @param leftView  Receives the view of LEFT, which the caller must release. Set to NULL on failure.
+ * @param rightView Receives the view of RIGHT, as for LEFTVIEW.
+ * @return PWError_None, PWError_InvalidParameter if either photo is no wider than |OFFSET|, or PWError_OutOfMemory.
+ */
+PWError PWImageBufferCreateShiftedViews(PWImageBuffer *left, PWImageBuffer *right, long offset,
+                                        PWImageBuffer **leftView, PWImageBuffer **rightView);
+
+/*!
+ * Make a copy of SOURCE at half the width and height, rounding up, by averaging each 2x2 block of pixels.
+ *
+ * Works for every pixel format. Planar images keep their format, with each plane halved separately.
+ *
+ * @return A new buffer, or NULL on failure.
+ */
+PWImageBuffer *PWImageBufferCreateHalfSize(const PWImageBuffer *source);
+
+// MARK: - Display conversion
+
+/*!
+ * Read pixels from SOURCE as if it were a packed 4-bytes-per-pixel image with rows of exactly width * 4 bytes.
+ *
+ * This lets a buffer in any format be handed to CoreGraphics through a direct-access data provider, converting only
+ * the bytes that are actually asked for. RGBA8888 pixels are copied unchanged. Every other format is converted to
+ * R, G, B, 255, i.e. kCGImageAlphaNoneSkipLast | kCGBitmapByteOrder32Big.
+ *
+ * @param source      The buffer to read.
+ * @param position    Offset in bytes into the virtual RGBX image.
+ * @param count       Number of bytes to read.
+ * @param destination Receives the bytes.
+ * @return The number of bytes written, which is less than COUNT only if the range runs past the end of the image.
+ */
+size_t PWImageBufferReadRGBX(const PWImageBuffer *source, size_t position, size_t count, uint8_t *destination);
+
+/*!
+ * Convert COUNT pixels of row Y of SOURCE, starting at column X, to R, G, B, A bytes as described for PWImageBufferReadRGBX().
+ */
+void PWImageBufferConvertRowToRGBX(const PWImageBuffer *source, size_t y, size_t x, size_t count, uint8_t *destination);
+
+// MARK: - Byte buffers
+
+/*!
+ * A growable block of bytes, used for encoder output and file contents.
+ * Initialise with PWDataBufferInit() and free the contents with PWDataBufferFree().
+ */
+typedef struct PWDataBuffer {
+    uint8_t *bytes;
+    size_t length, capacity;
+} PWDataBuffer;
+
+/*! Initialise an empty buffer with room for CAPACITY bytes. Returns false if the allocation failed. */
+bool PWDataBufferInit(PWDataBuffer *buffer, size_t capacity);
+
+/*! Ensure there is room for EXTRA more bytes after the current end of the buffer. */
+bool PWDataBufferReserve(PWDataBuffer *buffer, size_t extra);
+
+/*! Append LENGTH bytes to the end of the buffer, growing it as needed. */
+bool PWDataBufferAppend(PWDataBuffer *buffer, const void *bytes, size_t length);
+
+/*! Append a single byte. */
+static inline bool PWDataBufferAppendByte(PWDataBuffer *buffer, uint8_t byte) {
+    if (buffer->length == buffer->capacity && !PWDataBufferReserve(buffer, 1)) {
+        return false;
+    }
+    buffer->bytes[buffer->length++] = byte;
+    return true;
+}
+
+/*! Free the memory held by the buffer and reset it to empty. */
+void PWDataBufferFree(PWDataBuffer *buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWImageBuffer_h */
@@ -0,0 +1,192 @@
+//
+//  PWImport.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWImport.h"
+#include "PWJPEGDecoder.h"
+#include "PWJPEGEncoder.h"
+#include "PWLibrary.h"
+#include "PWOrientation.h"
+#include "PWParallel.h"
+#include "PWStereoPair.h"
+#include "PWStorage.h"
+
+    /// The two halves being coded again by splitCoefficients(), one output each.
+typedef struct HalfJob {
+    const PWJPEGCoefficients *coefficients;
+    PWImageRect rects[2];
+    PWDataBuffer *outputs[2];
+    PWError errors[2];
+} HalfJob;
+
+static void encodeHalf(void *context, size_t index) {
+    HalfJob *job = context;
+    job->errors[index] = PWJPEGEncodeCoefficients(job->coefficients, job->rects[index], job->outputs[index]);
+}
+
+    /// Cut the halves from the coefficients. Returns PWError_NotSupported if the middle isn't on an MCU boundary.
+static PWError splitCoefficients(const uint8_t *bytes, size_t length, PWDataBuffer *first, PWDataBuffer *second) {
+    PWJPEGInfo info;
+    PWError error = PWJPEGReadInfo(bytes, length, &info);
+    if (error != PWError_None) {
+        return error;
+    }
+    size_t half = info.width / 2;
+    if (info.orientation != PWOrientation_Up || info.progressive || half == 0 || half % info.blockWidth != 0) {
+        return PWError_NotSupported;
+    }
+    PWJPEGCoefficients coefficients;
+    error = PWJPEGReadCoefficients(bytes, length, &coefficients);
+    if (error != PWError_None) {
+        return error;
+    }
+        // Huffman coding each half takes as long as reading the file, so code them both at once.
+    size_t firstLength = first->length, secondLength = second->length;
+    HalfJob job = { &coefficients, { { 0, 0, half, info.height }, { half, 0, half, info.height } },
+                    { first, second }, { PWError_None, PWError_None } };
+    PWParallelFor(2, &job, encodeHalf);
+    error = job.errors[0] != PWError_None ? job.errors[0] : job.errors[1];
+    if (error != PWError_None) {
+        first->length = firstLength;
+        second->length = secondLength;
+    }
+    PWJPEGCoefficientsFree(&coefficients);
+    return error;
+}
+
+    /// Decode the image upright, cut it in two and encode each half again.
+static PWError splitPixels(const uint8_t *bytes, size_t length, PWDataBuffer *first, PWDataBuffer *second) {
+    PWImageBuffer *image = NULL;
+    PWError error = PWStereoPairDecodePhoto(bytes, length, &image);
+    if (error != PWError_None) {
+        return error;
+    }
+        // Even widths and offsets keep YCbCr chroma aligned, at the cost of a column or two from an odd-sized image.
+    size_t secondX = ((image->width + 1) / 2 + 1) & ~(size_t)1;
+    size_t width = image->width / 2 < image->width - secondX ? image->width / 2 : image->width - secondX;
+    width &= ~(size_t)1;
+    if (width == 0) {
+        PWImageBufferRelease(image);
+        return PWError_InvalidParameter;
+    }
+    PWImageBuffer *firstHalf  = PWImageBufferCreateSubImage(image, (PWImageRect) { 0, 0, width, image->height });
+    PWImageBuffer *secondHalf = PWImageBufferCreateSubImage(image, (PWImageRect) { secondX, 0, width, image->height });
+    size_t firstLength = first->length;
+    error = firstHalf && secondHalf ? PWJPEGEncode(firstHalf, NULL, first) : PWError_OutOfMemory;
+    if (error == PWError_None) {
+        error = PWJPEGEncode(secondHalf, NULL, second);
+        if (error != PWError_None) {
+            first->length = firstLength;
+        }
+    }
+    PWImageBufferRelease(firstHalf);
+    PWImageBufferRelease(secondHalf);
+    PWImageBufferRelease(image);
+    return error;
+}
+
+PWError PWImportSplitSideBySide(const uint8_t *bytes, size_t length, bool crossEyed,
+                                PWDataBuffer *leftJPEG, PWDataBuffer *rightJPEG, bool *lossless) {
+    if (!bytes || !leftJPEG || !rightJPEG) {
+        return PWError_InvalidParameter;
+    }
+    PWDataBuffer *first = crossEyed ? rightJPEG : leftJPEG, *second = crossEyed ? leftJPEG : rightJPEG;
+    PWError error = splitCoefficients(bytes, length, first, second);
+    if (lossless) {
+        *lossless = error == PWError_None;
+    }
+    if (error == PWError_NotSupported) {
+        error = splitPixels(bytes, length, first, second);
+    }
+    return error;
+}
+
+    /// Append the contents of the file at PATH to CONTENTS, and return its modification time in MODIFIED.
+static PWError readFile(const char *path, PWDataBuffer *contents, time_t *modified) {
+    PWStorage *storage = PWStorageDefault();
+    PWStorageItemInfo info;
+    PWError error = PWStorageGetInfo(storage, path, &info);
+    if (error == PWError_None && info.kind != PWStorageItem_File) {
+        error = PWError_IO;
+    }
+    if (error == PWError_None && !PWDataBufferReserve(contents, info.length)) {
+        error = PWError_OutOfMemory;
+    }
+    if (error == PWError_None) {
+        *modified = info.modified;
+        error = PWStorageReadFile(storage, path, 0, PWStorageWholeFile, contents);
+    }
+    return error;
+}
+
+PWError PWImportSideBySideFile(const char *rootPath, const char *name, const char *path, const PWImportOptions *options,
+                               PWImportResult *result) {
+    PWImportResult ignored;
+    if (!result) {
+        result = &ignored;
+    }
+    *result = (PWImportResult) { PWError_InvalidParameter, false, 0, 0 };
+    if (!rootPath || !name || !path || !options) {
+        return result->error;
+    }
+    PWDataBuffer file = { NULL, 0, 0 }, left = { NULL, 0, 0 }, right = { NULL, 0, 0 };
+    if (!PWDataBufferInit(&file, 0) || !PWDataBufferInit(&left, 0) || !PWDataBufferInit(&right, 0)) {
+        PWDataBufferFree(&file);
+        PWDataBufferFree(&left);
+        return result->error = PWError_OutOfMemory;
+    }
+    time_t modified = 0;
+    PWError error = readFile(path, &file, &modified);
+    if (error == PWError_None) {
+        result->bytesRead = file.length;
+        error = PWImportSplitSideBySide(file.bytes, file.length, options->crossEyed, &left, &right, &result->lossless);
+    }
+        // The side-by-side file is no longer needed, so free it before writing to keep fewer files in memory at once.
+    PWDataBufferFree(&file);
+    if (error == PWError_None) {
+        error = PWLibraryCreateStereogramTakenAt(rootPath, name, &left, &right, options->viewingMethod, modified);
+    }
+    if (error == PWError_None) {
+        result->bytesWritten = left.length + right.length;
+    }
+    PWDataBufferFree(&left);
+    PWDataBufferFree(&right);
+    return result->error = error;
+}
+
+    /// The files being imported by PWImportSideBySideFiles(). Each index writes only its own result.
+typedef struct ImportJob {
+    const char *rootPath;
+    const char *const *names, *const *paths;
+    const PWImportOptions *options;
+    PWImportResult *results;
+} ImportJob;
+
+static void importJob(void *context, size_t index) {
+    const ImportJob *job = context;
+    PWImportSideBySideFile(job->rootPath, job->names[index], job->paths[index], job->options, &job->results[index]);
+}
+
+size_t PWImportSideBySideFiles(const char *rootPath, const char *const *names, const char *const *paths, size_t count,
+                               const PWImportOptions *options, PWImportResult *results) {
+    if (!results || count == 0) {
+        return 0;
+    }
+    if (!names || !paths) {
+        for (size_t i = 0; i < count; i++) {
+            results[i] = (PWImportResult) { PWError_InvalidParameter, false, 0, 0 };
+        }
+        return 0;
+    }
+    ImportJob job = { rootPath, names, paths, options, results };
+    PWParallelFor(count, &job, importJob);
+    size_t created = 0;
+    for (size_t i = 0; i < count; i++) {
+        created += results[i].error == PWError_None;
+    }
+    return created;
+}
@@ -0,0 +1,83 @@
+/*!
+ @header PWImport
+ @abstract Imports side-by-side stereograms made by other tools into the photo store, without re-encoding them.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ A side-by-side JPEG file holds both photos of a pair in one image. Cutting it in half through the pixels would mean
+ decoding it and encoding each half again, which takes most of the time and loses a little quality each way. When the
+ middle of the image falls on an MCU boundary, as it does for the usual sizes, the halves are instead cut from the
+ file's DCT coefficients and coded again as they are, so the photos hold exactly the pixels of the original. Only files
+ which can't be cut like that, e.g. because they are rotated by their EXIF orientation, are decoded and encoded again.
+ */
+
+#ifndef PWImport_h
+#define PWImport_h
+
+#include "PWImageBuffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! How PWImportSideBySideFile() reads a side-by-side image and what it stores. */
+typedef struct PWImportOptions {
+        /*! True if the image is for cross-eyed viewing, with the right eye's photo on the left, as the app shows them. */
+    bool crossEyed;
+        /*! The ViewingMethod to store in each new stereogram. */
+    int viewingMethod;
+} PWImportOptions;
+
+/*! What PWImportSideBySideFile() did with one file. */
+typedef struct PWImportResult {
+        /*! PWError_None if the stereogram was created. */
+    PWError error;
+        /*! True if the photos were cut from the coefficients, false if the image had to be decoded and encoded again. */
+    bool lossless;
+        /*! Bytes read from the side-by-side file, and written in the two photos. */
+    size_t bytesRead, bytesWritten;
+} PWImportResult;
+
+/*!
+ * Split the side-by-side JPEG file BYTES into left and right photos, losslessly if possible.
+ *
+ * @param crossEyed  True if the right eye's photo is on the left of the image.
+ * @param leftJPEG   The left eye's photo is appended to this.
+ * @param rightJPEG  The right eye's photo is appended to this.
+ * @param lossless   Receives true if the photos were cut from the coefficients. May be NULL.
+ * @return PWError_None, PWError_InvalidFormat if BYTES is not a JPEG file, PWError_NotSupported if it can't be decoded,
+ *         PWError_InvalidParameter if it is too narrow to split, or PWError_OutOfMemory.
+ */
+PWError PWImportSplitSideBySide(const uint8_t *bytes, size_t length, bool crossEyed,
+                                PWDataBuffer *leftJPEG, PWDataBuffer *rightJPEG, bool *lossless);
+
+/*!
+ * Read the side-by-side JPEG file at PATH and store its photos as a new stereogram ROOTPATH/NAME, as
+ * PWLibraryCreateStereogram() does, with the file's modification time as the date taken.
+ *
+ * The perceptual hash is not worked out, as that would mean decoding the photo; PhotoStore adds missing hashes later.
+ *
+ * @param result Receives what was done. May be NULL.
+ * @return PWError_None, PWError_IO if the file couldn't be read or the stereogram written, or an error from
+ *         PWImportSplitSideBySide().
+ */
+PWError PWImportSideBySideFile(const char *rootPath, const char *name, const char *path, const PWImportOptions *options,
+                               PWImportResult *result);
+
+/*!
+ * Import COUNT files as PWImportSideBySideFile() does, several at once, into directories named NAMES under ROOTPATH.
+ *
+ * The files are spread over PWParallelThreadCount() threads. Cutting the coefficients takes a few milliseconds a photo,
+ * so unless the files must be decoded this is limited by how fast they can be read and written.
+ *
+ * @param results COUNT results, one for each file, in the same order as PATHS.
+ * @return The number of stereograms created.
+ */
+size_t PWImportSideBySideFiles(const char *rootPath, const char *const *names, const char *const *paths, size_t count,
+                               const PWImportOptions *options, PWImportResult *results);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWImport_h */
@@ -0,0 +1,75 @@
+/*!
+ @header PWJPEGCommon
+ @abstract Tables and constants shared by the JPEG encoder and decoder in the image core.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ References are to ITU-T T.81 (the JPEG standard). Only what the core actually uses is here.
+ */
+
+#ifndef PWJPEGCommon_h
+#define PWJPEGCommon_h
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * @enum
+ * @brief Marker codes, i.e. the byte following 0xFF at the start of each segment.
+ */
+enum PWJPEGMarker {
+    PWJPEGMarker_SOF0 = 0xC0,   ///< Start of frame, baseline DCT.
+    PWJPEGMarker_SOF1 = 0xC1,   ///< Start of frame, extended sequential DCT.
+    PWJPEGMarker_SOF2 = 0xC2,   ///< Start of frame, progressive DCT.
+    PWJPEGMarker_DHT  = 0xC4,   ///< Define Huffman tables.
+    PWJPEGMarker_RST0 = 0xD0,   ///< Restart markers RST0 to RST7.
+    PWJPEGMarker_SOI  = 0xD8,   ///< Start of image.
+    PWJPEGMarker_EOI  = 0xD9,   ///< End of image.
+    PWJPEGMarker_SOS  = 0xDA,   ///< Start of scan.
+    PWJPEGMarker_DQT  = 0xDB,   ///< Define quantisation tables.
+    PWJPEGMarker_DRI  = 0xDD,   ///< Define restart interval.
+    PWJPEGMarker_APP0 = 0xE0,   ///< JFIF header.
+    PWJPEGMarker_APP1 = 0xE1,   ///< EXIF data.
+    PWJPEGMarker_APP2 = 0xE2,   ///< ICC profiles, MPF (multi-picture) data.
+    PWJPEGMarker_APP14 = 0xEE,  ///< Adobe colour transform flag.
+    PWJPEGMarker_COM  = 0xFE    ///< Comment.
+};
+
+/*! Maps zig-zag order index to natural (row-major) index in an 8x8 block. */
+extern const uint8_t PWJPEGZigzagToNatural[64];
+
+/*! Example luminance and chrominance quantisation tables from Annex K, in natural order, for quality 50. */
+extern const uint8_t PWJPEGStandardLuminanceQuantTable[64];
+extern const uint8_t PWJPEGStandardChrominanceQuantTable[64];
+
+/*!
+ * A Huffman table as stored in a DHT segment.
+ * BITS[i] is the number of codes of length i + 1, and VALUES holds the symbols in code order.
+ */
+typedef struct PWJPEGHuffmanSpec {
+    uint8_t bits[16];
+    uint8_t values[256];
+    int valueCount;
+} PWJPEGHuffmanSpec;
+
+/*! The example Huffman tables from Annex K.3. These cover every symbol baseline 8-bit data can produce. */
+extern const PWJPEGHuffmanSpec PWJPEGStandardLuminanceDC, PWJPEGStandardLuminanceAC;
+extern const PWJPEGHuffmanSpec PWJPEGStandardChrominanceDC, PWJPEGStandardChrominanceAC;
+
+/*!
+ * Scale a base quantisation table to QUALITY using the usual IJG formula.
+ *
+ * @param base    A table in natural order, e.g. PWJPEGStandardLuminanceQuantTable.
+ * @param quality 1 (smallest) to 100 (best). Values outside that range are clamped.
+ * @param output  Receives the scaled table in natural order. Entries are clamped to 1...255 for baseline.
+ */
+void PWJPEGScaleQuantTable(const uint8_t base[64], int quality, uint16_t output[64]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWJPEGCommon_h */
@@ -0,0 +1,846 @@
+//
+//  PWJPEGDecoder.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWJPEGDecoder.h"
+#include "PWJPEGCommon.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    MaxComponents = 3,
+        /// Codes up to this many bits are decoded with a single table lookup.
+    FastBits = 9
+};
+
+    /// Decoding tables for one Huffman table (Annex F.2.2.3).
+typedef struct HuffmanDecodeTable {
+        /// Indexed by the next FastBits bits: (code length << 8) | symbol, or 0 if the code is longer than FastBits.
+    uint16_t fast[1 << FastBits];
+        /// Largest code of each length, or -1 if there are none. maxCode[17] is a sentinel.
+    int32_t maxCode[18];
+        /// Add to a code of each length to get its index in values.
+    int32_t valueOffset[17];
+    uint8_t values[256];
+    bool defined;
+} HuffmanDecodeTable;
+
+typedef struct Component {
+    int identifier;
+    int horizontalSampling, verticalSampling;
+    int quantTable, dcTable, acTable;
+        /// One MCU row of decoded samples: blocksAcross * blockSize wide and verticalSampling * blockSize tall.
+    uint8_t *strip;
+    size_t stripBytesPerRow;
+    int previousDC;
+} Component;
+
+typedef struct Decoder {
+    const uint8_t *bytes;
+    size_t length, position;
+
+    PWJPEGInfo info;
+    bool frameFound;
+        /// Transform flag from an Adobe APP14 segment, or -1 if there wasn't one.
+    int adobeTransform;
+
+    uint16_t quantTables[4][64];
+        /// Dequantisation multipliers in natural order, including the AAN IDCT input scaling.
+    float multipliers[4][64];
+    bool quantDefined[4];
+    HuffmanDecodeTable dcTables[4], acTables[4];
+
+    Component components[MaxComponents];
+    int maxHorizontalSampling, maxVerticalSampling;
+    size_t mcusAcross, mcusDown;
+    unsigned restartInterval;
+        /// Samples across each decoded block: 8, or 1 when only the DC coefficients are used, for an image 1/8 the size.
+    size_t blockSize;
+        /// If not NULL, the blocks are stored here as they are decoded instead of being transformed into pixels.
+    PWJPEGCoefficients *coefficients;
+
+        /// Entropy decoder state.
+    uint32_t bitBuffer;
+    int bitCount;
+    bool corrupt;
+} Decoder;
+
+// MARK: - Byte reading
+
+static inline unsigned readUInt16(const uint8_t *bytes) {
+    return (unsigned)bytes[0] << 8 | bytes[1];
+}
+
+// MARK: - EXIF
+
+    /// Find the orientation tag in an APP1 segment. Returns 1 if it isn't there or can't be read.
+static int readExifOrientation(const uint8_t *segment, size_t length) {
+    if (length < 14 || memcmp(segment, "Exif\0\0", 6) != 0) {
+        return 1;
+    }
+    const uint8_t *tiff = segment + 6;
+    size_t tiffLength = length - 6;
+    bool bigEndian;
+    if (tiff[0] == 'M' && tiff[1] == 'M') {
+        bigEndian = true;
+    } else if (tiff[0] == 'I' && tiff[1] == 'I') {
+        bigEndian = false;
+    } else {
+        return 1;
+    }
+#define TIFF16(p) (bigEndian ? (unsigned)((p)[0] << 8 | (p)[1]) : (unsigned)((p)[1] << 8 | (p)[0]))
+#define TIFF32(p) (bigEndian ? ((uint32_t)(p)[0] << 24 | (uint32_t)(p)[1] << 16 | (uint32_t)(p)[2] << 8 | (p)[3]) \
+                             : ((uint32_t)(p)[3] << 24 | (uint32_t)(p)[2] << 16 | (uint32_t)(p)[1] << 8 | (p)[0]))
+    uint32_t ifdOffset = TIFF32(tiff + 4);
+    if (ifdOffset + 2 > tiffLength) {
+        return 1;
+    }
+    unsigned entryCount = TIFF16(tiff + ifdOffset);
+    for (unsigned i = 0; i < entryCount; i++) {
+        size_t entry = ifdOffset + 2 + i * 12;
+        if (entry + 12 > tiffLength) {
+            break;
+        }
+        if (TIFF16(tiff + entry) == 0x0112) {  // Orientation, a SHORT stored in the value field.
+            unsigned orientation = TIFF16(tiff + entry + 8);
+            return orientation >= 1 && orientation <= 8 ? (int)orientation : 1;
+        }
+    }
+#undef TIFF16
+#undef TIFF32
+    return 1;
+}
+
+// MARK: - Header segments
+
+static PWError readQuantTables(Decoder *decoder, const uint8_t *segment, size_t length) {
+    static const double aanScale[8] = {
+        1.0, 1.387039845, 1.306562965, 1.175875602, 1.0, 0.785694958, 0.541196100, 0.275899379
+    };
+    size_t offset = 0;
+    while (offset < length) {
+        int precision = segment[offset] >> 4, table = segment[offset] & 0x0F;
+        size_t tableLength = precision ? 128 : 64;
+        if (table > 3 || offset + 1 + tableLength > length) {
+            return PWError_InvalidFormat;
+        }
+        const uint8_t *values = segment + offset + 1;
+        for (int i = 0; i < 64; i++) {
+            int natural = PWJPEGZigzagToNatural[i];
+            decoder->quantTables[table][natural] = (uint16_t)(precision ? readUInt16(values + i * 2) : values[i]);
+        }
+            // The 1/8 here is the output scaling of the 2D IDCT.
+        for (int i = 0; i < 64; i++) {
+            decoder->multipliers[table][i] = (float)(decoder->quantTables[table][i] * aanScale[i / 8] * aanScale[i % 8] * 0.125);
+        }
+        decoder->quantDefined[table] = true;
+        offset += 1 + tableLength;
+    }
+    return PWError_None;
+}
+
+static PWError readHuffmanTables(Decoder *decoder, const uint8_t *segment, size_t length) {
+    size_t offset = 0;
+    while (offset < length) {
+        if (offset + 17 > length) {
+            return PWError_InvalidFormat;
+        }
+        int tableClass = segment[offset] >> 4, tableID = segment[offset] & 0x0F;
+        if (tableClass > 1 || tableID > 3) {
+            return PWError_InvalidFormat;
+        }
+        const uint8_t *bits = segment + offset + 1;
+        int valueCount = 0;
+        for (int i = 0; i < 16; i++) {
+            valueCount += bits[i];
+        }
+        if (valueCount > 256 || offset + 17 + (size_t)valueCount > length) {
+            return PWError_InvalidFormat;
+        }
+        HuffmanDecodeTable *table = tableClass == 0 ? &decoder->dcTables[tableID] : &decoder->acTables[tableID];
+        memset(table, 0, sizeof(HuffmanDecodeTable));
+        memcpy(table->values, segment + offset + 17, (size_t)valueCount);
+
+            // Generate the canonical codes (Annex C) and fill in the lookup tables as we go.
+        int32_t code = 0;
+        int k = 0;
+        for (int codeLength = 1; codeLength <= 16; codeLength++) {
+            table->valueOffset[codeLength] = k - code;
+            if (code + bits[codeLength - 1] > (1 << codeLength)) {
+                return PWError_InvalidFormat;  // More codes than fit in this many bits.
+            }
+            for (int i = 0; i < bits[codeLength - 1]; i++, k++, code++) {
+                if (codeLength <= FastBits) {
+                    int shift = FastBits - codeLength;
+                    for (int fill = 0; fill < (1 << shift); fill++) {
+                        table->fast[(code << shift) | fill] = (uint16_t)(codeLength << 8 | table->values[k]);
+                    }
+                }
+            }
+            table->maxCode[codeLength] = bits[codeLength - 1] ? code - 1 : -1;
+            code <<= 1;
+        }
+        table->maxCode[17] = INT32_MAX;
+        table->defined = true;
+        offset += 17 + (size_t)valueCount;
+    }
+    return PWError_None;
+}
+
+static PWError readFrameHeader(Decoder *decoder, const uint8_t *segment, size_t length) {
+    if (length < 6) {
+        return PWError_InvalidFormat;
+    }
+    int precision = segment[0];
+    decoder->info.height = readUInt16(segment + 1);
+    decoder->info.width  = readUInt16(segment + 3);
+    int componentCount = segment[5];
+    if (length < 6 + (size_t)componentCount * 3 || decoder->info.width == 0) {
+        return PWError_InvalidFormat;
+    }
+    if (decoder->info.height == 0) {
+        return PWError_NotSupported;  // Height given by a DNL marker later on. Cameras don't do this.
+    }
+    if (precision != 8 || (componentCount != 1 && componentCount != 3)) {
+        return PWError_NotSupported;
+    }
+    decoder->info.componentCount = componentCount;
+    decoder->maxHorizontalSampling = decoder->maxVerticalSampling = 1;
+    for (int i = 0; i < componentCount; i++) {
+        Component *component = &decoder->components[i];
+        const uint8_t *description = segment + 6 + i * 3;
+        component->identifier = description[0];
+        component->horizontalSampling = description[1] >> 4;
+        component->verticalSampling = description[1] & 0x0F;
+        component->quantTable = description[2] & 0x03;
+        if (component->horizontalSampling < 1 || component->horizontalSampling > 4
+            || component->verticalSampling < 1 || component->verticalSampling > 4) {
+            return PWError_InvalidFormat;
+        }
+        if (component->horizontalSampling > decoder->maxHorizontalSampling) {
+            decoder->maxHorizontalSampling = component->horizontalSampling;
+        }
+        if (component->verticalSampling > decoder->maxVerticalSampling) {
+            decoder->maxVerticalSampling = component->verticalSampling;
+        }
+    }
+    if (componentCount == 1) {
+            // A single-component scan is never interleaved, so each block is an MCU whatever the sampling factors say.
+        decoder->components[0].horizontalSampling = decoder->components[0].verticalSampling = 1;
+        decoder->maxHorizontalSampling = decoder->maxVerticalSampling = 1;
+    }
+    for (int i = 0; i < componentCount; i++) {
+        const Component *component = &decoder->components[i];
+        if (decoder->maxHorizontalSampling % component->horizontalSampling != 0
+            || decoder->maxVerticalSampling % component->verticalSampling != 0) {
+            return PWError_NotSupported;
+        }
+    }
+    size_t mcuWidth = (size_t)decoder->maxHorizontalSampling * 8, mcuHeight = (size_t)decoder->maxVerticalSampling * 8;
+    decoder->info.blockWidth  = mcuWidth;
+    decoder->info.blockHeight = mcuHeight;
+    decoder->mcusAcross = (decoder->info.width  + mcuWidth  - 1) / mcuWidth;
+    decoder->mcusDown   = (decoder->info.height + mcuHeight - 1) / mcuHeight;
+
+    const Component *components = decoder->components;
+    if (componentCount == 1) {
+        decoder->info.format = PWPixelFormat_Gray8;
+    } else if (components[0].horizontalSampling == 2 && components[0].verticalSampling == 2
+               && components[1].horizontalSampling == 1 && components[1].verticalSampling == 1
+               && components[2].horizontalSampling == 1 && components[2].verticalSampling == 1) {
+        decoder->info.format = PWPixelFormat_YCbCr420;
+    } else {
+        decoder->info.format = PWPixelFormat_RGB888;
+    }
+    decoder->frameFound = true;
+    return PWError_None;
+}
+
+/*!
+ * Read segments up to and including the next SOS marker, or up to SOF if STOPATFRAME is set.
+ * On return decoder->position is just after the last segment read.
+ */
+static PWError readHeaders(Decoder *decoder, bool stopAtFrame, const uint8_t **scanHeader, size_t *scanHeaderLength) {
+    if (decoder->length < 4 || decoder->bytes[0] != 0xFF || decoder->bytes[1] != PWJPEGMarker_SOI) {
+        return PWError_InvalidFormat;
+    }
+    decoder->position = 2;
+    while (decoder->position + 4 <= decoder->length) {
+        const uint8_t *bytes = decoder->bytes + decoder->position;
+        if (bytes[0] != 0xFF) {
+            return PWError_InvalidFormat;
+        }
+        uint8_t marker = bytes[1];
+        if (marker == 0xFF) {  // Fill byte.
+            decoder->position++;
+            continue;
+        }
+        size_t segmentLength = readUInt16(bytes + 2);
+        if (segmentLength < 2 || decoder->position + 2 + segmentLength > decoder->length) {
+            return PWError_InvalidFormat;
+        }
+        const uint8_t *segment = bytes + 4;
+        size_t length = segmentLength - 2;
+        decoder->position += 2 + segmentLength;
+
+        PWError error = PWError_None;
+        switch (marker) {
+            case PWJPEGMarker_SOF0:
+            case PWJPEGMarker_SOF1:
+                error = readFrameHeader(decoder, segment, length);
+                if (error == PWError_None && stopAtFrame) {
+                    return PWError_None;
+                }
+                break;
+
+            case PWJPEGMarker_SOF2:
+                decoder->info.progressive = true;
+                error = readFrameHeader(decoder, segment, length);
+                return error == PWError_None && !stopAtFrame ? PWError_NotSupported : error;
+
+            case PWJPEGMarker_DQT:
+                error = readQuantTables(decoder, segment, length);
+                break;
+
+            case PWJPEGMarker_DHT:
+                error = readHuffmanTables(decoder, segment, length);
+                break;
+
+            case PWJPEGMarker_DRI:
+                if (length < 2) {
+                    return PWError_InvalidFormat;
+                }
+                decoder->restartInterval = readUInt16(segment);
+                break;
+
+            case PWJPEGMarker_APP1:
+                if (decoder->info.orientation == 1) {
+                    decoder->info.orientation = readExifOrientation(segment, length);
+                }
+                break;
+
+            case PWJPEGMarker_APP14:  // The Adobe transform flag says whether the channels are YCbCr.
+                if (length >= 12 && memcmp(segment, "Adobe", 5) == 0) {
+                    decoder->adobeTransform = segment[11];
+                }
+                break;
+
+            case PWJPEGMarker_SOS:
+                if (!decoder->frameFound) {
+                    return PWError_InvalidFormat;
+                }
+                *scanHeader = segment;
+                *scanHeaderLength = length;
+                return PWError_None;
+
+            case PWJPEGMarker_EOI:
+                return PWError_InvalidFormat;
+
+            default:
+                    // Other start-of-frame markers are lossless, hierarchical or arithmetic coded.
+                if (marker >= 0xC3 && marker <= 0xCF && marker != PWJPEGMarker_DHT && marker != 0xC8 && marker != 0xCC) {
+                    return PWError_NotSupported;
+                }
+                break;  // APPn, COM etc. are skipped.
+        }
+        if (error != PWError_None) {
+            return error;
+        }
+    }
+    return stopAtFrame && decoder->frameFound ? PWError_None : PWError_InvalidFormat;
+}
+
+static void initDecoder(Decoder *decoder, const uint8_t *bytes, size_t length) {
+    memset(decoder, 0, sizeof(Decoder));
+    decoder->bytes = bytes;
+    decoder->length = length;
+    decoder->info.orientation = 1;
+    decoder->adobeTransform = -1;
+    decoder->blockSize = 8;
+}
+
+// MARK: - Entropy decoding
+
+    /// Top up the bit buffer to at least 25 bits. After a marker, or at the end of the data, zeros are shifted in.
+static inline void fillBits(Decoder *decoder) {
+    while (decoder->bitCount <= 24) {
+        uint32_t byte = 0;
+        if (decoder->position < decoder->length) {
+            byte = decoder->bytes[decoder->position];
+            if (byte == 0xFF) {
+                uint8_t next = decoder->position + 1 < decoder->length ? decoder->bytes[decoder->position + 1] : 0xD9;
+                if (next == 0x00) {
+                    decoder->position += 2;
+                } else {
+                    byte = 0;  // A marker: leave it for the restart handling and pad with zeros.
+                }
+            } else {
+                decoder->position++;
+            }
+        }
+        decoder->bitBuffer |= byte << (24 - decoder->bitCount);
+        decoder->bitCount += 8;
+    }
+}
+
+static inline uint32_t readBits(Decoder *decoder, int count) {
+    fillBits(decoder);
+    uint32_t bits = decoder->bitBuffer >> (32 - count);
+    decoder->bitBuffer <<= count;
+    decoder->bitCount -= count;
+    return bits;
+}
+
+static inline int decodeSymbol(Decoder *decoder, const HuffmanDecodeTable *table) {
+    fillBits(decoder);
+    uint16_t fast = table->fast[decoder->bitBuffer >> (32 - FastBits)];
+    if (fast) {
+        int codeLength = fast >> 8;
+        decoder->bitBuffer <<= codeLength;
+        decoder->bitCount -= codeLength;
+        return fast & 0xFF;
+    }
+    for (int codeLength = FastBits + 1; codeLength <= 16; codeLength++) {
+        int32_t code = (int32_t)(decoder->bitBuffer >> (32 - codeLength));
+        if (code <= table->maxCode[codeLength]) {
+            decoder->bitBuffer <<= codeLength;
+            decoder->bitCount -= codeLength;
+            int index = code + table->valueOffset[codeLength];
+            return index >= 0 && index < 256 ? table->values[index] : 0;
+        }
+    }
+    decoder->corrupt = true;
+    return 0;
+}
+
+    /// Read a CATEGORY-bit value and sign-extend it as in Annex F.2.2.1.
+static inline int receiveExtend(Decoder *decoder, int category) {
+    if (category == 0) {
+        return 0;
+    }
+    int value = (int)readBits(decoder, category);
+    return value < (1 << (category - 1)) ? value - (1 << category) + 1 : value;
+}
+
+    /// Decode one block's coefficients into natural order, not yet dequantised.
+static void decodeBlock(Decoder *decoder, Component *component, int16_t coefficients[64]) {
+    memset(coefficients, 0, 64 * sizeof(int16_t));
+    int category = decodeSymbol(decoder, &decoder->dcTables[component->dcTable]);
+    if (category > 11) {
+        decoder->corrupt = true;  // DC differences for 8-bit samples fit in 11 bits.
+        return;
+    }
+    component->previousDC += receiveExtend(decoder, category);
+    coefficients[0] = (int16_t)component->previousDC;
+
+    const HuffmanDecodeTable *acTable = &decoder->acTables[component->acTable];
+    for (int k = 1; k < 64; ) {
+        int symbol = decodeSymbol(decoder, acTable);
+        int run = symbol >> 4, size = symbol & 0x0F;
+        if (size == 0) {
+            if (run != 15) {
+                break;  // End of block.
+            }
+            k += 16;
+            continue;
+        }
+        k += run;
+        if (k > 63) {
+            decoder->corrupt = true;
+            break;
+        }
+        coefficients[PWJPEGZigzagToNatural[k++]] = (int16_t)receiveExtend(decoder, size);
+    }
+}
+
+    /// Skip to just after the next RSTn marker and reset the predictors.
+static void handleRestart(Decoder *decoder) {
+    decoder->bitBuffer = 0;
+    decoder->bitCount = 0;
+    while (decoder->position + 1 < decoder->length) {
+        if (decoder->bytes[decoder->position] == 0xFF) {
+            uint8_t marker = decoder->bytes[decoder->position + 1];
+            if (marker >= PWJPEGMarker_RST0 && marker <= PWJPEGMarker_RST0 + 7) {
+                decoder->position += 2;
+                break;
+            }
+            if (marker != 0x00 && marker != 0xFF) {
+                break;  // Some other marker: the data is damaged, so carry on and let the caller cope.
+            }
+        }
+        decoder->position++;
+    }
+    for (int i = 0; i < decoder->info.componentCount; i++) {
+        decoder->components[i].previousDC = 0;
+    }
+}
+
+// MARK: - Inverse DCT
+
+static inline uint8_t clampSample(float value) {
+    int sample = (int)(value + 128.5f);
+    return (uint8_t)(sample < 0 ? 0 : sample > 255 ? 255 : sample);
+}
+
+    /// AAN floating-point inverse DCT (as in IJG's jidctflt.c), writing 8x8 samples at OUTPUT.
+static void inverseDCT(const int16_t coefficients[64], const float multipliers[64], uint8_t *output, size_t outputBytesPerRow) {
+    float workspace[64];
+
+        // Pass 1: columns.
+    for (int column = 0; column < 8; column++) {
+        const int16_t *in = coefficients + column;
+        const float *q = multipliers + column;
+        float *ws = workspace + column;
+        if (!in[8] && !in[16] && !in[24] && !in[32] && !in[40] && !in[48] && !in[56]) {
+            float dc = in[0] * q[0];
+            for (int row = 0; row < 8; row++) {
+                ws[row * 8] = dc;
+            }
+            continue;
+        }
+        float tmp0 = in[0] * q[0], tmp1 = in[16] * q[16], tmp2 = in[32] * q[32], tmp3 = in[48] * q[48];
+        float tmp10 = tmp0 + tmp2, tmp11 = tmp0 - tmp2;
+        float tmp13 = tmp1 + tmp3, tmp12 = (tmp1 - tmp3) * 1.414213562f - tmp13;
+        tmp0 = tmp10 + tmp13;
+        tmp3 = tmp10 - tmp13;
+        tmp1 = tmp11 + tmp12;
+        tmp2 = tmp11 - tmp12;
+
+        float tmp4 = in[8] * q[8], tmp5 = in[24] * q[24], tmp6 = in[40] * q[40], tmp7 = in[56] * q[56];
+        float z13 = tmp6 + tmp5, z10 = tmp6 - tmp5, z11 = tmp4 + tmp7, z12 = tmp4 - tmp7;
+        tmp7 = z11 + z13;
+        tmp11 = (z11 - z13) * 1.414213562f;
+        float z5 = (z10 + z12) * 1.847759065f;
+        tmp10 = 1.082392200f * z12 - z5;
+        tmp12 = -2.613125930f * z10 + z5;
+        tmp6 = tmp12 - tmp7;
+        tmp5 = tmp11 - tmp6;
+        tmp4 = tmp10 + tmp5;
+
+        ws[0]  = tmp0 + tmp7;
+        ws[56] = tmp0 - tmp7;
+        ws[8]  = tmp1 + tmp6;
+        ws[48] = tmp1 - tmp6;
+        ws[16] = tmp2 + tmp5;
+        ws[40] = tmp2 - tmp5;
+        ws[32] = tmp3 + tmp4;
+        ws[24] = tmp3 - tmp4;
+    }
+
+        // Pass 2: rows, producing the output samples.
+    for (int row = 0; row < 8; row++) {
+        const float *ws = workspace + row * 8;
+        uint8_t *out = output + row * outputBytesPerRow;
+        float tmp10 = ws[0] + ws[4], tmp11 = ws[0] - ws[4];
+        float tmp13 = ws[2] + ws[6], tmp12 = (ws[2] - ws[6]) * 1.414213562f - tmp13;
+        float tmp0 = tmp10 + tmp13, tmp3 = tmp10 - tmp13, tmp1 = tmp11 + tmp12, tmp2 = tmp11 - tmp12;
+
+        float z13 = ws[5] + ws[3], z10 = ws[5] - ws[3], z11 = ws[1] + ws[7], z12 = ws[1] - ws[7];
+        float tmp7 = z11 + z13;
+        tmp11 = (z11 - z13) * 1.414213562f;
+        float z5 = (z10 + z12) * 1.847759065f;
+        tmp10 = 1.082392200f * z12 - z5;
+        tmp12 = -2.613125930f * z10 + z5;
+        float tmp6 = tmp12 - tmp7, tmp5 = tmp11 - tmp6, tmp4 = tmp10 + tmp5;
+
+        out[0] = clampSample(tmp0 + tmp7);
+        out[7] = clampSample(tmp0 - tmp7);
+        out[1] = clampSample(tmp1 + tmp6);
+        out[6] = clampSample(tmp1 - tmp6);
+        out[2] = clampSample(tmp2 + tmp5);
+        out[5] = clampSample(tmp2 - tmp5);
+        out[4] = clampSample(tmp3 + tmp4);
+        out[3] = clampSample(tmp3 - tmp4);
+    }
+}
+
+// MARK: - Output
+
+static inline uint8_t clampToByte(int value) {
+    return (uint8_t)(value < 0 ? 0 : value > 255 ? 255 : value);
+}
+
+    /// Copy ROWCOUNT rows of a strip plane into a plane of the output image, clipping to WIDTH.
+static void copyStripRows(const uint8_t *strip, size_t stripBytesPerRow, uint8_t *plane, size_t planeBytesPerRow,
+                          size_t firstRow, size_t rowCount, size_t width) {
+    for (size_t y = 0; y < rowCount; y++) {
+        memcpy(plane + (firstRow + y) * planeBytesPerRow, strip + y * stripBytesPerRow, width);
+    }
+}
+
+    /// Move one decoded MCU row into IMAGE, converting to RGB if the output format needs it.
+static void emitStrip(const Decoder *decoder, size_t mcuRow, PWImageBuffer *image) {
+    size_t stripHeight = (size_t)decoder->maxVerticalSampling * decoder->blockSize;
+    size_t firstRow = mcuRow * stripHeight;
+    size_t rowCount = image->height - firstRow < stripHeight ? image->height - firstRow : stripHeight;
+    const Component *components = decoder->components;
+
+    switch (image->format) {
+        case PWPixelFormat_Gray8:
+            copyStripRows(components[0].strip, components[0].stripBytesPerRow, image->data, image->bytesPerRow,
+                          firstRow, rowCount, image->width);
+            break;
+
+        case PWPixelFormat_YCbCr420: {
+            copyStripRows(components[0].strip, components[0].stripBytesPerRow, image->data, image->bytesPerRow,
+                          firstRow, rowCount, image->width);
+            size_t chromaRows = (rowCount + 1) / 2, chromaWidth = (image->width + 1) / 2;
+            for (int plane = 0; plane < 2; plane++) {
+                copyStripRows(components[plane + 1].strip, components[plane + 1].stripBytesPerRow,
+                              image->chroma[plane], image->chromaBytesPerRow, firstRow / 2, chromaRows, chromaWidth);
+            }
+            break;
+        }
+
+        case PWPixelFormat_RGB888: {
+                // Chroma is upsampled by replication. With the RGB conversion done inline it's one pass over each row.
+            int horizontalShift[MaxComponents], verticalShift[MaxComponents];
+            for (int c = 0; c < MaxComponents; c++) {
+                int horizontalRatio = decoder->maxHorizontalSampling / components[c].horizontalSampling;
+                int verticalRatio   = decoder->maxVerticalSampling   / components[c].verticalSampling;
+                horizontalShift[c] = horizontalRatio == 4 ? 2 : horizontalRatio - 1;
+                verticalShift[c]   = verticalRatio   == 4 ? 2 : verticalRatio   - 1;
+            }
+            bool isRGB = decoder->adobeTransform == 0;
+            for (size_t y = 0; y < rowCount; y++) {
+                const uint8_t *luma = components[0].strip + (y >> verticalShift[0]) * components[0].stripBytesPerRow;
+                const uint8_t *cb   = components[1].strip + (y >> verticalShift[1]) * components[1].stripBytesPerRow;
+                const uint8_t *cr   = components[2].strip + (y >> verticalShift[2]) * components[2].stripBytesPerRow;
+                uint8_t *out = PWImageBufferRow(image, firstRow + y);
+                for (size_t x = 0; x < image->width; x++, out += 3) {
+                    int c0 = luma[x >> horizontalShift[0]], c1 = cb[x >> horizontalShift[1]], c2 = cr[x >> horizontalShift[2]];
+                    if (isRGB) {
+                        out[0] = (uint8_t)c0;
+                        out[1] = (uint8_t)c1;
+                        out[2] = (uint8_t)c2;
+                    } else {
+                        c1 -= 128;
+                        c2 -= 128;
+                        out[0] = clampToByte(c0 + ((91881 * c2 + 32768) >> 16));
+                        out[1] = clampToByte(c0 + ((-22554 * c1 - 46802 * c2 + 32768) >> 16));
+                        out[2] = clampToByte(c0 + ((116130 * c1 + 32768) >> 16));
+                    }
+                }
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+    /// Keep block (H, V) of MCU (MCUX, MCUY) of a component in zig-zag order, as PWJPEGReadCoefficients() gives them.
+static void storeBlock(PWJPEGComponentCoefficients *component, size_t mcuX, size_t mcuY, int h, int v,
+                       const int16_t coefficients[64]) {
+    size_t blockX = mcuX * (size_t)component->horizontalSampling + (size_t)h;
+    size_t blockY = mcuY * (size_t)component->verticalSampling + (size_t)v;
+    int16_t *block = component->blocks + (blockY * component->blocksAcross + blockX) * 64;
+    for (int k = 0; k < 64; k++) {
+        block[k] = coefficients[PWJPEGZigzagToNatural[k]];
+    }
+}
+
+static PWError decodeScan(Decoder *decoder, const uint8_t *scanHeader, size_t scanHeaderLength, PWImageBuffer *image) {
+    int componentCount = decoder->info.componentCount;
+    if (scanHeaderLength < 1 || scanHeader[0] != componentCount || scanHeaderLength < 1 + (size_t)componentCount * 2 + 3) {
+        return PWError_NotSupported;  // Non-interleaved scans: one scan per component.
+    }
+    for (int i = 0; i < componentCount; i++) {
+        int identifier = scanHeader[1 + i * 2], tables = scanHeader[2 + i * 2];
+        Component *component = &decoder->components[i];
+        if (component->identifier != identifier) {
+            return PWError_NotSupported;  // Components in a different order to the frame header.
+        }
+        component->dcTable = tables >> 4;
+        component->acTable = tables & 0x0F;
+        if (component->dcTable > 3 || component->acTable > 3
+            || !decoder->dcTables[component->dcTable].defined || !decoder->acTables[component->acTable].defined
+            || !decoder->quantDefined[component->quantTable]) {
+            return PWError_InvalidFormat;
+        }
+    }
+
+    for (int i = 0; i < componentCount && !decoder->coefficients; i++) {
+        Component *component = &decoder->components[i];
+        component->stripBytesPerRow = decoder->mcusAcross * (size_t)component->horizontalSampling * decoder->blockSize;
+        component->strip = malloc(component->stripBytesPerRow * (size_t)component->verticalSampling * decoder->blockSize);
+        if (!component->strip) {
+            return PWError_OutOfMemory;
+        }
+    }
+
+    int16_t coefficients[64];
+    unsigned mcusUntilRestart = decoder->restartInterval;
+    for (size_t mcuY = 0; mcuY < decoder->mcusDown; mcuY++) {
+        for (size_t mcuX = 0; mcuX < decoder->mcusAcross; mcuX++) {
+            if (decoder->restartInterval) {
+                if (mcusUntilRestart == 0) {
+                    handleRestart(decoder);
+                    mcusUntilRestart = decoder->restartInterval;
+                }
+                mcusUntilRestart--;
+            }
+            for (int i = 0; i < componentCount; i++) {
+                Component *component = &decoder->components[i];
+                for (int v = 0; v < component->verticalSampling; v++) {
+                    for (int h = 0; h < component->horizontalSampling; h++) {
+                        decodeBlock(decoder, component, coefficients);
+                        if (decoder->coefficients) {
+                            storeBlock(&decoder->coefficients->components[i], mcuX, mcuY, h, v, coefficients);
+                            continue;
+                        }
+                        size_t x = (mcuX * component->horizontalSampling + h) * decoder->blockSize;
+                        uint8_t *output = component->strip + v * decoder->blockSize * component->stripBytesPerRow + x;
+                        if (decoder->blockSize == 1) {
+                                // The DC coefficient alone is the mean of the block, which is what the IDCT gives for it.
+                            *output = clampSample(coefficients[0] * decoder->multipliers[component->quantTable][0]);
+                        } else {
+                            inverseDCT(coefficients, decoder->multipliers[component->quantTable], output, component->stripBytesPerRow);
+                        }
+                    }
+                }
+            }
+            if (decoder->corrupt) {
+                return PWError_InvalidFormat;
+            }
+        }
+        if (image) {
+            emitStrip(decoder, mcuY, image);
+        }
+    }
+    return PWError_None;
+}
+
+// MARK: - Public interface
+
+PWError PWJPEGReadInfo(const uint8_t *bytes, size_t length, PWJPEGInfo *info) {
+    if (!bytes || !info) {
+        return PWError_InvalidParameter;
+    }
+    Decoder decoder;
+    initDecoder(&decoder, bytes, length);
+    const uint8_t *scanHeader = NULL;
+    size_t scanHeaderLength = 0;
+    PWError error = readHeaders(&decoder, true, &scanHeader, &scanHeaderLength);
+    if (error == PWError_None) {
+        *info = decoder.info;
+    }
+    return error;
+}
+
+PWImageRect PWJPEGAlignCropRect(PWImageRect rect, const PWJPEGInfo *info) {
+    size_t right  = rect.x + rect.width  < info->width  ? rect.x + rect.width  : info->width;
+    size_t bottom = rect.y + rect.height < info->height ? rect.y + rect.height : info->height;
+    size_t blockWidth  = info->blockWidth  ? info->blockWidth  : 8;
+    size_t blockHeight = info->blockHeight ? info->blockHeight : 8;
+    PWImageRect aligned = { rect.x / blockWidth * blockWidth, rect.y / blockHeight * blockHeight, 0, 0 };
+    if (aligned.x < right) {
+        aligned.width = right - aligned.x;
+    }
+    if (aligned.y < bottom) {
+        aligned.height = bottom - aligned.y;
+    }
+    return aligned;
+}
+
+    /// Decode the file at full size for a BLOCKSIZE of 8, or from the DC coefficients alone at 1/8 size for 1.
+static PWError decodeImage(const uint8_t *bytes, size_t length, size_t blockSize, PWImageBuffer **image) {
+    if (!bytes || !image) {
+        return PWError_InvalidParameter;
+    }
+    *image = NULL;
+    Decoder decoder;
+    initDecoder(&decoder, bytes, length);
+    decoder.blockSize = blockSize;
+    const uint8_t *scanHeader = NULL;
+    size_t scanHeaderLength = 0;
+    PWError error = readHeaders(&decoder, false, &scanHeader, &scanHeaderLength);
+    if (error != PWError_None) {
+        return error;
+    }
+    if (decoder.info.componentCount == 3 && decoder.adobeTransform == 0) {
+        decoder.info.format = PWPixelFormat_RGB888;  // Channels are RGB already, so they can't be kept as YCbCr.
+    }
+
+    size_t width  = (decoder.info.width  + 8 / blockSize - 1) / (8 / blockSize);
+    size_t height = (decoder.info.height + 8 / blockSize - 1) / (8 / blockSize);
+    PWImageBuffer *result = PWImageBufferCreate(width, height, decoder.info.format);
+    if (!result) {
+        return PWError_OutOfMemory;
+    }
+    error = decodeScan(&decoder, scanHeader, scanHeaderLength, result);
+    for (int i = 0; i < MaxComponents; i++) {
+        free(decoder.components[i].strip);
+    }
+    if (error != PWError_None) {
+        PWImageBufferRelease(result);
+        return error;
+    }
+    *image = result;
+    return PWError_None;
+}
+
+PWError PWJPEGDecode(const uint8_t *bytes, size_t length, PWImageBuffer **image) {
+    return decodeImage(bytes, length, 8, image);
+}
+
+PWError PWJPEGDecodeReduced(const uint8_t *bytes, size_t length, PWImageBuffer **image) {
+    return decodeImage(bytes, length, 1, image);
+}
+
+PWError PWJPEGReadCoefficients(const uint8_t *bytes, size_t length, PWJPEGCoefficients *coefficients) {
+    if (!bytes || !coefficients) {
+        return PWError_InvalidParameter;
+    }
+    memset(coefficients, 0, sizeof(PWJPEGCoefficients));
+    Decoder decoder;
+    initDecoder(&decoder, bytes, length);
+    const uint8_t *scanHeader = NULL;
+    size_t scanHeaderLength = 0;
+    PWError error = readHeaders(&decoder, false, &scanHeader, &scanHeaderLength);
+    if (error != PWError_None) {
+        return error;
+    }
+    coefficients->info = decoder.info;
+    coefficients->adobeTransform = decoder.adobeTransform;
+    for (int i = 0; i < decoder.info.componentCount && error == PWError_None; i++) {
+        const Component *component = &decoder.components[i];
+        PWJPEGComponentCoefficients *output = &coefficients->components[i];
+        output->horizontalSampling = component->horizontalSampling;
+        output->verticalSampling = component->verticalSampling;
+        output->blocksAcross = decoder.mcusAcross * (size_t)component->horizontalSampling;
+        output->blocksDown = decoder.mcusDown * (size_t)component->verticalSampling;
+        output->blocks = malloc(output->blocksAcross * output->blocksDown * 64 * sizeof(int16_t));
+        if (!output->blocks) {
+            error = PWError_OutOfMemory;
+        } else if (!decoder.quantDefined[component->quantTable]) {
+            error = PWError_InvalidFormat;
+        } else {
+            memcpy(output->quantTable, decoder.quantTables[component->quantTable], sizeof(output->quantTable));
+        }
+    }
+    if (error == PWError_None) {
+        decoder.coefficients = coefficients;
+        error = decodeScan(&decoder, scanHeader, scanHeaderLength, NULL);
+    }
+    if (error != PWError_None) {
+        PWJPEGCoefficientsFree(coefficients);
+    }
+    return error;
+}
+
+void PWJPEGCoefficientsFree(PWJPEGCoefficients *coefficients) {
+    if (!coefficients) {
+        return;
+    }
+    for (int i = 0; i < 3; i++) {
+        free(coefficients->components[i].blocks);
+    }
+    memset(coefficients, 0, sizeof(PWJPEGCoefficients));
+}
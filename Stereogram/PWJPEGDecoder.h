@@ -0,0 +1,125 @@
+/*!
+ @header PWJPEGDecoder
+ @abstract A portable baseline JPEG decoder that keeps photos in their most compact form.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ Decoding into UIImage always gives a 32-bit RGBA bitmap. This decoder instead returns whatever the JPEG
+ naturally holds: 2x2-subsampled colour files come back as planar YCbCr 4:2:0 (1.5 bytes per pixel), other colour
+ files as RGB888 and greyscale files as Gray8. Conversion for display is left to PWImageBufferReadRGBX().
+ */
+
+#ifndef PWJPEGDecoder_h
+#define PWJPEGDecoder_h
+
+#include "PWImageBuffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Basic facts about a JPEG file, read from its headers. */
+typedef struct PWJPEGInfo {
+        /*! Size of the image as stored, before any EXIF orientation is applied. */
+    size_t width, height;
+        /*! 1 for greyscale, 3 for colour. */
+    int componentCount;
+        /*! The EXIF orientation tag, 1 to 8. 1 (the default) means the stored pixels are already upright. */
+    int orientation;
+        /*! True if this is a progressive file, which PWJPEGDecode() cannot decode. */
+    bool progressive;
+        /*! The pixel format PWJPEGDecode() will produce for this file. */
+    PWPixelFormat format;
+        /*! Size of the blocks of pixels the file is coded in (the MCU): 16 x 16 for 4:2:0 colour, 8 x 8 for greyscale. */
+    size_t blockWidth, blockHeight;
+} PWJPEGInfo;
+
+/*!
+ * Read the headers of a JPEG file without decoding the image.
+ *
+ * @param bytes  The file contents.
+ * @param length Number of bytes in BYTES.
+ * @param info   Receives the details.
+ * @return PWError_None on success, PWError_InvalidFormat if this is not a JPEG file.
+ */
+PWError PWJPEGReadInfo(const uint8_t *bytes, size_t length, PWJPEGInfo *info);
+
+/*!
+ * Widen RECT so that it starts on a block boundary of the file described by INFO.
+ *
+ * The left and top edges move out to the block edge at or before them; the right and bottom edges don't move.
+ * A crop like this can be cut from the file without decoding it, by copying whole blocks of coefficients,
+ * so an exported crop needn't be re-encoded. RECT is in stored pixels, before any EXIF orientation is applied.
+ *
+ * @return The aligned rectangle, clipped to the image.
+ */
+PWImageRect PWJPEGAlignCropRect(PWImageRect rect, const PWJPEGInfo *info);
+
+/*!
+ * Decode a baseline (sequential, Huffman-coded, 8-bit) JPEG file.
+ *
+ * The EXIF orientation is reported by PWJPEGReadInfo() but not applied here. Pass the result to
+ * PWImageBufferCreateOriented() to turn it upright.
+ *
+ * @param bytes  The file contents.
+ * @param length Number of bytes in BYTES.
+ * @param image  Receives a new buffer in the format given by PWJPEGInfo.format. Release it with PWImageBufferRelease().
+ * @return PWError_None on success. PWError_NotSupported for progressive, arithmetic-coded, CMYK, 12-bit or
+ *         multi-scan files, which the caller should decode some other way. PWError_InvalidFormat for corrupt data.
+ */
+PWError PWJPEGDecode(const uint8_t *bytes, size_t length, PWImageBuffer **image);
+
+/*!
+ * Decode a baseline JPEG file at 1/8 of its width and height, rounding up, from the DC coefficient of each block.
+ *
+ * The DC coefficient is the mean of its block, so this is as good as scaling the full decode down with an area filter,
+ * and it skips the inverse DCT and 63/64 of the output. The whole file is still read. Use it for a preview of a photo
+ * which has no EXIF thumbnail.
+ *
+ * @return As for PWJPEGDecode().
+ */
+PWError PWJPEGDecodeReduced(const uint8_t *bytes, size_t length, PWImageBuffer **image);
+
+// MARK: - Coefficients
+
+/*! The quantised DCT coefficients of one component of a JPEG file. See PWJPEGReadCoefficients(). */
+typedef struct PWJPEGComponentCoefficients {
+        /*! Blocks across and down each MCU. */
+    int horizontalSampling, verticalSampling;
+        /*! The quantisation table the coefficients were divided by, in natural order. */
+    uint16_t quantTable[64];
+        /*! Blocks across and down the component, covering whole MCUs, so including those padding the last ones. */
+    size_t blocksAcross, blocksDown;
+        /*! blocksAcross * blocksDown blocks of 64 coefficients, in zig-zag order and row by row. */
+    int16_t *blocks;
+} PWJPEGComponentCoefficients;
+
+/*! Everything PWJPEGEncodeCoefficients() needs to write a file with the same pixels. */
+typedef struct PWJPEGCoefficients {
+        /*! The file's headers. INFO.componentCount is the number of COMPONENTS used. */
+    PWJPEGInfo info;
+        /*! The transform flag from an Adobe APP14 segment, 0 meaning the channels are RGB, or -1 if there wasn't one. */
+    int adobeTransform;
+    PWJPEGComponentCoefficients components[3];
+} PWJPEGCoefficients;
+
+/*!
+ * Read the quantised DCT coefficients of a baseline JPEG file, without dequantising or transforming them.
+ *
+ * This is the entropy decoding PWJPEGDecode() does and nothing more, so it takes about half as long. The coefficients
+ * can be cut up at block boundaries and written out again with PWJPEGEncodeCoefficients() without losing anything,
+ * e.g. to crop a photo or split a side-by-side image.
+ *
+ * @param coefficients Receives the coefficients. Free them with PWJPEGCoefficientsFree().
+ * @return As for PWJPEGDecode(). COEFFICIENTS is left empty on failure.
+ */
+PWError PWJPEGReadCoefficients(const uint8_t *bytes, size_t length, PWJPEGCoefficients *coefficients);
+
+/*! Free the blocks held by COEFFICIENTS and leave it empty. */
+void PWJPEGCoefficientsFree(PWJPEGCoefficients *coefficients);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWJPEGDecoder_h */
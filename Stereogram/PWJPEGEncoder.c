@@ -0,0 +1,828 @@
+//
+//  PWJPEGEncoder.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWJPEGEncoder.h"
+#include "PWJPEGCommon.h"
+#include "PWParallel.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+    /// Code words for every symbol in one Huffman table, indexed by symbol.
+typedef struct HuffmanTable {
+    uint16_t codes[256];
+    uint8_t lengths[256];
+} HuffmanTable;
+
+    /// Most blocks in one MCU: four luma blocks and one for each chroma channel.
+enum { MaxBlocksPerMCU = 6 };
+
+    /// Images with fewer pixels than this are encoded on one thread, as starting the others would cost more than it saves.
+enum { MinimumParallelPixels = 256 * 1024 };
+
+    /// MCU rows transformed at a time when working out the coefficients of a progressive file.
+enum { TransformRows = 4 };
+
+    /// The largest restart interval a DRI segment can hold, in MCUs.
+enum { MaximumRestartInterval = 0xFFFF };
+
+    /// One scan of the file: the components it codes, in order, and the range of zig-zag coefficients it codes for each.
+typedef struct Scan {
+    int componentCount;
+    int components[3];
+    int spectralStart, spectralEnd;
+} Scan;
+
+    /// Everything needed to encode the entropy-coded data for one image.
+typedef struct Encoder {
+    const PWImageBuffer *image;
+    size_t bytesPerPixel;
+    int componentCount;
+    bool subsampled, planar;
+    uint16_t quantTables[2][64];
+        /// Reciprocals of the quantisation steps, pre-multiplied by the AAN DCT output scaling. Natural order.
+    float divisors[2][64];
+    HuffmanTable dcTables[2], acTables[2];
+    size_t mcuSize, mcusAcross, mcusDown;
+        /// MCU rows between restart markers, or 0 for none. The rows between two markers are a strip, which can be
+        /// encoded apart from the others as the markers reset the DC predictors.
+    size_t restartRows;
+        /// Blocks across (and down) each MCU for each component: 2 for subsampled luma, otherwise 1.
+    size_t sampling[3];
+        /// Blocks across and down each component which hold pixels of the image. A scan of one component codes only these.
+    size_t blocksAcross[3], blocksDown[3];
+        /// Progressive files only: the quantised coefficients of each component in zig-zag order, 64 to a block, covering
+        /// whole MCUs, i.e. mcusAcross * sampling blocks to a row. NULL for baseline files, which are encoded straight from the pixels.
+    int16_t *coefficients[3];
+} Encoder;
+
+    /// Accumulates variable-length codes and writes them out with 0xFF byte stuffing.
+typedef struct BitWriter {
+    PWDataBuffer *output;
+    uint32_t accumulator;
+    int bitCount;
+    bool failed;
+} BitWriter;
+
+// MARK: - Huffman tables
+
+    /// Generate the canonical code for each symbol in SPEC (Annex C).
+static void buildHuffmanTable(const PWJPEGHuffmanSpec *spec, HuffmanTable *table) {
+    memset(table, 0, sizeof(HuffmanTable));
+    uint16_t code = 0;
+    int k = 0;
+    for (int length = 1; length <= 16; length++) {
+        for (int i = 0; i < spec->bits[length - 1]; i++) {
+            uint8_t symbol = spec->values[k++];
+            table->codes[symbol] = code++;
+            table->lengths[symbol] = (uint8_t)length;
+        }
+        code <<= 1;
+    }
+}
+
+// MARK: - Bit output
+
+static inline void emitByte(BitWriter *writer, uint8_t byte) {
+    if (!PWDataBufferAppendByte(writer->output, byte)) {
+        writer->failed = true;
+    }
+    if (byte == 0xFF && !PWDataBufferAppendByte(writer->output, 0)) {
+        writer->failed = true;
+    }
+}
+
+static inline void writeBits(BitWriter *writer, uint32_t bits, int length) {
+    writer->accumulator = (writer->accumulator << length) | (bits & ((1u << length) - 1));
+    writer->bitCount += length;
+    while (writer->bitCount >= 8) {
+        writer->bitCount -= 8;
+        emitByte(writer, (uint8_t)(writer->accumulator >> writer->bitCount));
+    }
+}
+
+    /// Pad the final partial byte with 1 bits, as the standard requires.
+static void flushBits(BitWriter *writer) {
+    if (writer->bitCount > 0) {
+        writeBits(writer, 0x7F, 8 - writer->bitCount);
+    }
+    writer->accumulator = 0;
+    writer->bitCount = 0;
+}
+
+    /// Number of bits needed to hold the magnitude of VALUE (its "category").
+static inline int magnitudeCategory(int value) {
+    unsigned magnitude = (unsigned)(value < 0 ? -value : value);
+    return magnitude ? 32 - __builtin_clz(magnitude) : 0;
+}
+
+    /// Write the extra bits after a category code: VALUE itself, or its one's complement if negative.
+static inline void writeValueBits(BitWriter *writer, int value, int category) {
+    if (category) {
+        writeBits(writer, (uint32_t)(value < 0 ? value - 1 : value), category);
+    }
+}
+
+// MARK: - DCT and quantisation
+
+    /// AAN forward DCT on one row or column of 8 samples, STRIDE floats apart. Output is scaled; see divisors.
+static inline void forwardDCT8(float *d, int stride) {
+    float tmp0 = d[0] + d[7 * stride], tmp7 = d[0] - d[7 * stride];
+    float tmp1 = d[1 * stride] + d[6 * stride], tmp6 = d[1 * stride] - d[6 * stride];
+    float tmp2 = d[2 * stride] + d[5 * stride], tmp5 = d[2 * stride] - d[5 * stride];
+    float tmp3 = d[3 * stride] + d[4 * stride], tmp4 = d[3 * stride] - d[4 * stride];
+
+        // Even part.
+    float tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3;
+    float tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+    d[0] = tmp10 + tmp11;
+    d[4 * stride] = tmp10 - tmp11;
+    float z1 = (tmp12 + tmp13) * 0.707106781f;
+    d[2 * stride] = tmp13 + z1;
+    d[6 * stride] = tmp13 - z1;
+
+        // Odd part.
+    tmp10 = tmp4 + tmp5;
+    tmp11 = tmp5 + tmp6;
+    tmp12 = tmp6 + tmp7;
+    float z5 = (tmp10 - tmp12) * 0.382683433f;
+    float z2 = 0.541196100f * tmp10 + z5;
+    float z4 = 1.306562965f * tmp12 + z5;
+    float z3 = tmp11 * 0.707106781f;
+    float z11 = tmp7 + z3, z13 = tmp7 - z3;
+    d[5 * stride] = z13 + z2;
+    d[3 * stride] = z13 - z2;
+    d[1 * stride] = z11 + z4;
+    d[7 * stride] = z11 - z4;
+}
+
+    /// Transform a level-shifted block and quantise it into zig-zag order.
+static void transformBlock(float block[64], const float divisors[64], int16_t coefficients[64]) {
+    for (int row = 0; row < 8; row++) {
+        forwardDCT8(block + row * 8, 1);
+    }
+    for (int column = 0; column < 8; column++) {
+        forwardDCT8(block + column, 8);
+    }
+    for (int i = 0; i < 64; i++) {
+        int natural = PWJPEGZigzagToNatural[i];
+        coefficients[i] = (int16_t)lrintf(block[natural] * divisors[natural]);
+    }
+}
+
+static void computeDivisors(const uint16_t quantTable[64], float divisors[64]) {
+    static const double aanScale[8] = {
+        1.0, 1.387039845, 1.306562965, 1.175875602, 1.0, 0.785694958, 0.541196100, 0.275899379
+    };
+    for (int row = 0; row < 8; row++) {
+        for (int column = 0; column < 8; column++) {
+            divisors[row * 8 + column] = (float)(1.0 / (quantTable[row * 8 + column] * aanScale[row] * aanScale[column] * 8.0));
+        }
+    }
+}
+
+// MARK: - Entropy coding
+
+static void encodeDC(BitWriter *writer, int value, int *previousDC, const HuffmanTable *dcTable) {
+    int difference = value - *previousDC;
+    *previousDC = value;
+    int category = magnitudeCategory(difference);
+    writeBits(writer, dcTable->codes[category], dcTable->lengths[category]);
+    writeValueBits(writer, difference, category);
+}
+
+    /// Code zig-zag coefficients START to END of a block. Baseline files code 1 to 63 after the DC coefficient; the AC
+    /// scans of a progressive file code a band of them, with an EOB in each block as for baseline.
+static void encodeAC(BitWriter *writer, const int16_t coefficients[64], int start, int end, const HuffmanTable *acTable) {
+    int run = 0;
+    for (int i = start; i <= end; i++) {
+        int value = coefficients[i];
+        if (value == 0) {
+            run++;
+            continue;
+        }
+        while (run > 15) {  // ZRL: a run of 16 zeros.
+            writeBits(writer, acTable->codes[0xF0], acTable->lengths[0xF0]);
+            run -= 16;
+        }
+        int category = magnitudeCategory(value);
+        int symbol = (run << 4) | category;
+        writeBits(writer, acTable->codes[symbol], acTable->lengths[symbol]);
+        writeValueBits(writer, value, category);
+        run = 0;
+    }
+    if (run > 0) {  // EOB
+        writeBits(writer, acTable->codes[0x00], acTable->lengths[0x00]);
+    }
+}
+
+    /// Clamp a coordinate to the image so partial MCUs at the right and bottom edges repeat the last pixel.
+static inline size_t clampCoordinate(size_t value, size_t limit) {
+    return value < limit ? value : limit - 1;
+}
+
+    /// Read an RGB pixel and convert it to level-shifted YCbCr (JFIF equations).
+static inline void pixelToYCbCr(const uint8_t *pixel, float *y, float *cb, float *cr) {
+    float r = pixel[0], g = pixel[1], b = pixel[2];
+    *y  =  0.299f    * r + 0.587f    * g + 0.114f    * b - 128.0f;
+    *cb = -0.168736f * r - 0.331264f * g + 0.5f      * b;
+    *cr =  0.5f      * r - 0.418688f * g - 0.081312f * b;
+}
+
+    /// Load the level-shifted samples of one MCU into BLOCKS: the luma blocks in order, then Cb and Cr.
+    /// Returns the number of blocks.
+static int loadMCU(const Encoder *encoder, size_t mcuX, size_t mcuY, float blocks[MaxBlocksPerMCU][64]) {
+    const PWImageBuffer *image = encoder->image;
+    size_t originX = mcuX * encoder->mcuSize, originY = mcuY * encoder->mcuSize;
+
+    if (encoder->componentCount == 1) {
+        for (size_t y = 0; y < 8; y++) {
+            const uint8_t *row = PWImageBufferRow(image, clampCoordinate(originY + y, image->height));
+            for (size_t x = 0; x < 8; x++) {
+                blocks[0][y * 8 + x] = row[clampCoordinate(originX + x, image->width)] - 128.0f;
+            }
+        }
+        return 1;
+    }
+
+    if (encoder->planar) {
+            // Already YCbCr with the chroma at half size, so only the level shift is needed.
+        for (size_t y = 0; y < 16; y++) {
+            const uint8_t *row = PWImageBufferRow(image, clampCoordinate(originY + y, image->height));
+            for (size_t x = 0; x < 16; x++) {
+                blocks[(y / 8) * 2 + x / 8][(y % 8) * 8 + x % 8] = row[clampCoordinate(originX + x, image->width)] - 128.0f;
+            }
+        }
+        size_t chromaWidth = (image->width + 1) / 2, chromaHeight = (image->height + 1) / 2;
+        for (int plane = 0; plane < 2; plane++) {
+            for (size_t y = 0; y < 8; y++) {
+                const uint8_t *row = image->chroma[plane] + clampCoordinate(originY / 2 + y, chromaHeight) * image->chromaBytesPerRow;
+                for (size_t x = 0; x < 8; x++) {
+                    blocks[4 + plane][y * 8 + x] = row[clampCoordinate(originX / 2 + x, chromaWidth)] - 128.0f;
+                }
+            }
+        }
+        return 6;
+    }
+
+    if (encoder->subsampled) {
+            // 16x16 MCU: four luma blocks plus one averaged block for each chroma channel.
+        float *cbBlock = blocks[4], *crBlock = blocks[5];
+        memset(cbBlock, 0, 64 * sizeof(float));
+        memset(crBlock, 0, 64 * sizeof(float));
+        for (size_t y = 0; y < 16; y++) {
+            const uint8_t *row = PWImageBufferRow(image, clampCoordinate(originY + y, image->height));
+            for (size_t x = 0; x < 16; x++) {
+                float luma, cb, cr;
+                pixelToYCbCr(row + clampCoordinate(originX + x, image->width) * encoder->bytesPerPixel, &luma, &cb, &cr);
+                blocks[(y / 8) * 2 + x / 8][(y % 8) * 8 + x % 8] = luma;
+                cbBlock[(y / 2) * 8 + x / 2] += cb * 0.25f;
+                crBlock[(y / 2) * 8 + x / 2] += cr * 0.25f;
+            }
+        }
+        return 6;
+    }
+
+    for (size_t y = 0; y < 8; y++) {
+        const uint8_t *row = PWImageBufferRow(image, clampCoordinate(originY + y, image->height));
+        for (size_t x = 0; x < 8; x++) {
+            pixelToYCbCr(row + clampCoordinate(originX + x, image->width) * encoder->bytesPerPixel,
+                         &blocks[0][y * 8 + x], &blocks[1][y * 8 + x], &blocks[2][y * 8 + x]);
+        }
+    }
+    return 3;
+}
+
+    /// The component block BLOCK of an MCU belongs to, given the blocks are in the order loadMCU() gives them.
+static inline int componentOfBlock(const Encoder *encoder, int block) {
+    int lumaBlocks = (int)(encoder->sampling[0] * encoder->sampling[0]);
+    return block < lumaBlocks ? 0 : block - lumaBlocks + 1;
+}
+
+    /// Encode MCU rows FIRSTROW up to (but not including) ENDROW of a baseline file, starting with fresh DC predictors.
+static void encodeMCURows(const Encoder *encoder, size_t firstRow, size_t endRow, BitWriter *writer) {
+    int previousDC[3] = { 0, 0, 0 };
+    float blocks[MaxBlocksPerMCU][64];
+    int16_t coefficients[64];
+
+    for (size_t mcuY = firstRow; mcuY < endRow && !writer->failed; mcuY++) {
+        for (size_t mcuX = 0; mcuX < encoder->mcusAcross; mcuX++) {
+            int blockCount = loadMCU(encoder, mcuX, mcuY, blocks);
+            for (int block = 0; block < blockCount; block++) {
+                int component = componentOfBlock(encoder, block), table = component == 0 ? 0 : 1;
+                transformBlock(blocks[block], encoder->divisors[table], coefficients);
+                encodeDC(writer, coefficients[0], &previousDC[component], &encoder->dcTables[table]);
+                encodeAC(writer, coefficients, 1, 63, &encoder->acTables[table]);
+            }
+        }
+    }
+}
+
+    /// Work out the coefficients of MCU rows FIRSTROW up to ENDROW of a progressive file.
+static void transformMCURows(const Encoder *encoder, size_t firstRow, size_t endRow) {
+    float blocks[MaxBlocksPerMCU][64];
+    for (size_t mcuY = firstRow; mcuY < endRow; mcuY++) {
+        for (size_t mcuX = 0; mcuX < encoder->mcusAcross; mcuX++) {
+            int blockCount = loadMCU(encoder, mcuX, mcuY, blocks);
+            for (int block = 0; block < blockCount; block++) {
+                int component = componentOfBlock(encoder, block), table = component == 0 ? 0 : 1;
+                size_t sampling = encoder->sampling[component], blocksPerRow = encoder->mcusAcross * sampling;
+                size_t blockX = mcuX * sampling + (component == 0 ? (size_t)block % sampling : 0);
+                size_t blockY = mcuY * sampling + (component == 0 ? (size_t)block / sampling : 0);
+                transformBlock(blocks[block], encoder->divisors[table],
+                               encoder->coefficients[component] + (blockY * blocksPerRow + blockX) * 64);
+            }
+        }
+    }
+}
+
+static void transformJob(void *context, size_t index) {
+    const Encoder *encoder = context;
+    size_t firstRow = index * TransformRows;
+    transformMCURows(encoder, firstRow, firstRow + TransformRows < encoder->mcusDown ? firstRow + TransformRows : encoder->mcusDown);
+}
+
+    /// Encode strip STRIP of SCAN, the MCU rows between two restart markers or the whole image if there are none.
+static void encodeStrip(const Encoder *encoder, const Scan *scan, size_t strip, BitWriter *writer) {
+    size_t rows = encoder->restartRows ? encoder->restartRows : encoder->mcusDown;
+    size_t firstRow = strip * rows, endRow = firstRow + rows < encoder->mcusDown ? firstRow + rows : encoder->mcusDown;
+    if (!encoder->coefficients[0]) {
+        encodeMCURows(encoder, firstRow, endRow, writer);
+        return;
+    }
+
+    int previousDC[3] = { 0, 0, 0 };
+    if (scan->componentCount > 1) {
+            // Interleaved scans code whole MCUs, so only the DC scan, which needs no EOBs, is interleaved.
+        for (size_t mcuY = firstRow; mcuY < endRow; mcuY++) {
+            for (size_t mcuX = 0; mcuX < encoder->mcusAcross; mcuX++) {
+                for (int i = 0; i < scan->componentCount; i++) {
+                    int component = scan->components[i];
+                    size_t sampling = encoder->sampling[component], blocksPerRow = encoder->mcusAcross * sampling;
+                    for (size_t y = 0; y < sampling; y++) {
+                        for (size_t x = 0; x < sampling; x++) {
+                            size_t block = (mcuY * sampling + y) * blocksPerRow + mcuX * sampling + x;
+                            encodeDC(writer, encoder->coefficients[component][block * 64], &previousDC[component],
+                                     &encoder->dcTables[component == 0 ? 0 : 1]);
+                        }
+                    }
+                }
+            }
+        }
+        return;
+    }
+
+        // A scan of one component codes its blocks in rows, leaving out those only there to fill the last MCUs.
+    int component = scan->components[0], table = component == 0 ? 0 : 1;
+    size_t sampling = encoder->sampling[component], blocksPerRow = encoder->mcusAcross * sampling;
+    size_t endBlockRow = endRow * sampling < encoder->blocksDown[component] ? endRow * sampling : encoder->blocksDown[component];
+    for (size_t blockY = firstRow * sampling; blockY < endBlockRow; blockY++) {
+        for (size_t blockX = 0; blockX < encoder->blocksAcross[component]; blockX++) {
+            const int16_t *coefficients = encoder->coefficients[component] + (blockY * blocksPerRow + blockX) * 64;
+            if (scan->spectralStart == 0) {
+                encodeDC(writer, coefficients[0], &previousDC[component], &encoder->dcTables[table]);
+            } else {
+                encodeAC(writer, coefficients, scan->spectralStart, scan->spectralEnd, &encoder->acTables[table]);
+            }
+        }
+    }
+}
+
+// MARK: - Headers
+
+static bool appendUInt16(PWDataBuffer *output, unsigned value) {
+    uint8_t bytes[2] = { (uint8_t)(value >> 8), (uint8_t)value };
+    return PWDataBufferAppend(output, bytes, 2);
+}
+
+static bool appendMarker(PWDataBuffer *output, uint8_t marker, unsigned segmentLength) {
+    uint8_t bytes[2] = { 0xFF, marker };
+    return PWDataBufferAppend(output, bytes, 2) && appendUInt16(output, segmentLength);
+}
+
+static bool appendHuffmanSpec(PWDataBuffer *output, int tableClass, int tableID, const PWJPEGHuffmanSpec *spec) {
+    return PWDataBufferAppendByte(output, (uint8_t)(tableClass << 4 | tableID))
+        && PWDataBufferAppend(output, spec->bits, 16)
+        && PWDataBufferAppend(output, spec->values, (size_t)spec->valueCount);
+}
+
+    /// Write everything before the first scan.
+static bool writeHeaders(const Encoder *encoder, bool progressive, PWDataBuffer *output) {
+    static const uint8_t startOfImage[2] = { 0xFF, PWJPEGMarker_SOI };
+    static const uint8_t jfif[14] = { 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+    bool ok = PWDataBufferAppend(output, startOfImage, 2)
+    &&        appendMarker(output, PWJPEGMarker_APP0, 2 + sizeof(jfif))
+    &&        PWDataBufferAppend(output, jfif, sizeof(jfif));
+
+    int tableCount = encoder->componentCount == 1 ? 1 : 2;
+    ok = ok && appendMarker(output, PWJPEGMarker_DQT, (unsigned)(2 + tableCount * 65));
+    for (int table = 0; ok && table < tableCount; table++) {
+        ok = PWDataBufferAppendByte(output, (uint8_t)table);
+        for (int i = 0; ok && i < 64; i++) {
+            ok = PWDataBufferAppendByte(output, (uint8_t)encoder->quantTables[table][PWJPEGZigzagToNatural[i]]);
+        }
+    }
+
+    const PWImageBuffer *image = encoder->image;
+    ok = ok && appendMarker(output, progressive ? PWJPEGMarker_SOF2 : PWJPEGMarker_SOF0, (unsigned)(8 + 3 * encoder->componentCount))
+    &&        PWDataBufferAppendByte(output, 8)
+    &&        appendUInt16(output, (unsigned)image->height)
+    &&        appendUInt16(output, (unsigned)image->width)
+    &&        PWDataBufferAppendByte(output, (uint8_t)encoder->componentCount);
+    for (int component = 0; ok && component < encoder->componentCount; component++) {
+        uint8_t sampling = (uint8_t)(encoder->sampling[component] << 4 | encoder->sampling[component]);
+        ok = PWDataBufferAppendByte(output, (uint8_t)(component + 1))
+        &&   PWDataBufferAppendByte(output, sampling)
+        &&   PWDataBufferAppendByte(output, component == 0 ? 0 : 1);
+    }
+
+        // The standard tables serve progressive scans too, as long as every block ends with its own EOB.
+    if (encoder->componentCount == 1) {
+        ok = ok && appendMarker(output, PWJPEGMarker_DHT, 2 + 17 * 2 + 12 + 162)
+        &&        appendHuffmanSpec(output, 0, 0, &PWJPEGStandardLuminanceDC)
+        &&        appendHuffmanSpec(output, 1, 0, &PWJPEGStandardLuminanceAC);
+    } else {
+        ok = ok && appendMarker(output, PWJPEGMarker_DHT, 2 + 17 * 4 + 12 * 2 + 162 * 2)
+        &&        appendHuffmanSpec(output, 0, 0, &PWJPEGStandardLuminanceDC)
+        &&        appendHuffmanSpec(output, 1, 0, &PWJPEGStandardLuminanceAC)
+        &&        appendHuffmanSpec(output, 0, 1, &PWJPEGStandardChrominanceDC)
+        &&        appendHuffmanSpec(output, 1, 1, &PWJPEGStandardChrominanceAC);
+    }
+    return ok;
+}
+
+    /// Number of MCUs between restart markers in SCAN. A scan of one component counts single blocks as MCUs.
+static size_t restartInterval(const Encoder *encoder, const Scan *scan) {
+    if (scan->componentCount > 1) {
+        return encoder->mcusAcross * encoder->restartRows;
+    }
+    int component = scan->components[0];
+    return encoder->blocksAcross[component] * encoder->sampling[component] * encoder->restartRows;
+}
+
+static bool writeScanHeader(const Encoder *encoder, const Scan *scan, PWDataBuffer *output) {
+    bool ok = true;
+    if (encoder->restartRows) {
+        ok = appendMarker(output, PWJPEGMarker_DRI, 4) && appendUInt16(output, (unsigned)restartInterval(encoder, scan));
+    }
+    ok = ok && appendMarker(output, PWJPEGMarker_SOS, (unsigned)(6 + 2 * scan->componentCount))
+    &&        PWDataBufferAppendByte(output, (uint8_t)scan->componentCount);
+    for (int i = 0; ok && i < scan->componentCount; i++) {
+        int component = scan->components[i];
+        ok = PWDataBufferAppendByte(output, (uint8_t)(component + 1))
+        &&   PWDataBufferAppendByte(output, component == 0 ? 0x00 : 0x11);
+    }
+    uint8_t spectralSelection[3] = { (uint8_t)scan->spectralStart, (uint8_t)scan->spectralEnd, 0 };
+    return ok && PWDataBufferAppend(output, spectralSelection, 3);
+}
+
+// MARK: - Scans
+
+    /// The strips of one scan being encoded on several threads, each into a buffer of its own.
+typedef struct StripJob {
+    const Encoder *encoder;
+    const Scan *scan;
+    PWDataBuffer *strips;
+        /// Set by any strip which ran out of memory.
+    bool failed;
+} StripJob;
+
+static void encodeStripJob(void *context, size_t index) {
+    StripJob *job = context;
+    PWDataBuffer *strip = &job->strips[index];
+    BitWriter writer = { .output = strip, .accumulator = 0, .bitCount = 0, .failed = false };
+    encodeStrip(job->encoder, job->scan, index, &writer);
+    flushBits(&writer);
+    if (writer.failed) {
+        __atomic_store_n(&job->failed, true, __ATOMIC_RELAXED);
+    }
+}
+
+static bool appendRestartMarker(PWDataBuffer *output, size_t index) {
+    uint8_t marker[2] = { 0xFF, (uint8_t)(PWJPEGMarker_RST0 + index % 8) };
+    return PWDataBufferAppend(output, marker, 2);
+}
+
+    /// Encode SCAN, its header and its data, with restart markers between the strips.
+static bool writeScan(const Encoder *encoder, const Scan *scan, PWDataBuffer *output) {
+    if (!writeScanHeader(encoder, scan, output)) {
+        return false;
+    }
+    size_t stripCount = encoder->restartRows ? (encoder->mcusDown + encoder->restartRows - 1) / encoder->restartRows : 1;
+    bool parallel = stripCount > 1 && PWParallelThreadCount() > 1
+                 && encoder->image->width * encoder->image->height >= MinimumParallelPixels;
+    if (!parallel) {
+        BitWriter writer = { .output = output, .accumulator = 0, .bitCount = 0, .failed = false };
+        for (size_t strip = 0; strip < stripCount && !writer.failed; strip++) {
+            encodeStrip(encoder, scan, strip, &writer);
+            flushBits(&writer);
+            if (strip + 1 < stripCount && !appendRestartMarker(output, strip)) {
+                writer.failed = true;
+            }
+        }
+        return !writer.failed;
+    }
+
+        // Each strip is coded into a buffer of its own, then they are joined with the restart markers between them.
+    StripJob job = { encoder, scan, calloc(stripCount, sizeof(PWDataBuffer)), false };
+    if (!job.strips) {
+        return false;
+    }
+    PWParallelFor(stripCount, &job, encodeStripJob);
+    bool ok = !job.failed;
+    for (size_t strip = 0; strip < stripCount; strip++) {
+        ok = ok && PWDataBufferAppend(output, job.strips[strip].bytes, job.strips[strip].length)
+                && (strip + 1 == stripCount || appendRestartMarker(output, strip));
+        PWDataBufferFree(&job.strips[strip]);
+    }
+    free(job.strips);
+    return ok;
+}
+
+    /// The scans of a progressive file: first the DC of every component, so a preview can be shown at once, then the
+    /// low luma frequencies, the chroma, and finally the rest of the luma, which is most of the file.
+static size_t progressiveScans(const Encoder *encoder, Scan scans[5]) {
+    if (encoder->componentCount == 1) {
+        scans[0] = (Scan){ 1, { 0 }, 0, 0 };
+        scans[1] = (Scan){ 1, { 0 }, 1, 5 };
+        scans[2] = (Scan){ 1, { 0 }, 6, 63 };
+        return 3;
+    }
+    scans[0] = (Scan){ 3, { 0, 1, 2 }, 0, 0 };
+    scans[1] = (Scan){ 1, { 0 }, 1, 5 };
+    scans[2] = (Scan){ 1, { 1 }, 1, 63 };
+    scans[3] = (Scan){ 1, { 2 }, 1, 63 };
+    scans[4] = (Scan){ 1, { 0 }, 6, 63 };
+    return 5;
+}
+
+// MARK: - Public interface
+
+void PWJPEGEncodeOptionsInit(PWJPEGEncodeOptions *options) {
+    options->quality = PWJPEGDefaultQuality;
+    options->subsampling = PWJPEGSubsampling_420;
+    options->progressive = false;
+    options->restartRows = PWJPEGDefaultRestartRows;
+    options->targetLength = 0;
+}
+
+    /// Set up ENCODER to encode IMAGE at QUALITY with OPTIONS.
+static void initEncoder(Encoder *encoder, const PWImageBuffer *image, const PWJPEGEncodeOptions *options, int quality) {
+    memset(encoder, 0, sizeof(Encoder));
+    encoder->image = image;
+    encoder->bytesPerPixel = PWPixelFormatBytesPerPixel(image->format);
+    encoder->componentCount = image->format == PWPixelFormat_Gray8 ? 1 : 3;
+    encoder->planar = image->format == PWPixelFormat_YCbCr420;
+    encoder->subsampled = encoder->planar || (encoder->componentCount == 3 && options->subsampling == PWJPEGSubsampling_420);
+    encoder->mcuSize = encoder->subsampled ? 16 : 8;
+    encoder->mcusAcross = (image->width  + encoder->mcuSize - 1) / encoder->mcuSize;
+    encoder->mcusDown   = (image->height + encoder->mcuSize - 1) / encoder->mcuSize;
+    for (int component = 0; component < encoder->componentCount; component++) {
+        size_t sampling = component == 0 && encoder->subsampled ? 2 : 1;
+        size_t pixelsPerBlock = encoder->mcuSize / sampling;
+        encoder->sampling[component] = sampling;
+        encoder->blocksAcross[component] = (image->width  + pixelsPerBlock - 1) / pixelsPerBlock;
+        encoder->blocksDown[component]   = (image->height + pixelsPerBlock - 1) / pixelsPerBlock;
+    }
+
+        // Fewer rows between markers if need be, so the interval of every scan fits in the DRI segment.
+    size_t widestRow = encoder->mcusAcross > encoder->blocksAcross[0] * encoder->sampling[0]
+                     ? encoder->mcusAcross : encoder->blocksAcross[0] * encoder->sampling[0];
+    encoder->restartRows = options->restartRows < MaximumRestartInterval / widestRow ? options->restartRows : MaximumRestartInterval / widestRow;
+
+    PWJPEGScaleQuantTable(PWJPEGStandardLuminanceQuantTable,   quality, encoder->quantTables[0]);
+    PWJPEGScaleQuantTable(PWJPEGStandardChrominanceQuantTable, quality, encoder->quantTables[1]);
+    computeDivisors(encoder->quantTables[0], encoder->divisors[0]);
+    computeDivisors(encoder->quantTables[1], encoder->divisors[1]);
+    buildHuffmanTable(&PWJPEGStandardLuminanceDC,   &encoder->dcTables[0]);
+    buildHuffmanTable(&PWJPEGStandardLuminanceAC,   &encoder->acTables[0]);
+    buildHuffmanTable(&PWJPEGStandardChrominanceDC, &encoder->dcTables[1]);
+    buildHuffmanTable(&PWJPEGStandardChrominanceAC, &encoder->acTables[1]);
+}
+
+    /// Work out every coefficient of a progressive file, which its scans then code a band at a time.
+static bool transformImage(Encoder *encoder) {
+    for (int component = 0; component < encoder->componentCount; component++) {
+        size_t sampling = encoder->sampling[component];
+        size_t blockCount = encoder->mcusAcross * sampling * encoder->mcusDown * sampling;
+        encoder->coefficients[component] = malloc(blockCount * 64 * sizeof(int16_t));
+        if (!encoder->coefficients[component]) {
+            return false;
+        }
+    }
+    size_t jobCount = (encoder->mcusDown + TransformRows - 1) / TransformRows;
+    if (encoder->image->width * encoder->image->height >= MinimumParallelPixels) {
+        PWParallelFor(jobCount, encoder, transformJob);
+    } else {
+        transformMCURows(encoder, 0, encoder->mcusDown);
+    }
+    return true;
+}
+
+    /// Append IMAGE encoded at QUALITY to OUTPUT. Leaves OUTPUT as it was on failure.
+static PWError encodeFile(const PWImageBuffer *image, const PWJPEGEncodeOptions *options, int quality, PWDataBuffer *output) {
+    Encoder encoder;
+    initEncoder(&encoder, image, options, quality);
+    Scan scans[5] = { { encoder.componentCount, { 0, 1, 2 }, 0, 63 } };
+    size_t scanCount = 1;
+    bool ok = true;
+    if (options->progressive) {
+        scanCount = progressiveScans(&encoder, scans);
+        ok = transformImage(&encoder);
+    }
+
+    size_t startLength = output->length;
+    ok = ok && writeHeaders(&encoder, options->progressive, output);
+    for (size_t scan = 0; ok && scan < scanCount; scan++) {
+        ok = writeScan(&encoder, &scans[scan], output);
+    }
+    static const uint8_t endOfImage[2] = { 0xFF, PWJPEGMarker_EOI };
+    ok = ok && PWDataBufferAppend(output, endOfImage, 2);
+    for (int component = 0; component < 3; component++) {
+        free(encoder.coefficients[component]);
+    }
+    if (!ok) {
+        output->length = startLength;
+        return PWError_OutOfMemory;
+    }
+    return PWError_None;
+}
+
+PWError PWJPEGEncode(const PWImageBuffer *image, const PWJPEGEncodeOptions *options, PWDataBuffer *output) {
+    if (!image || !output || image->width > 0xFFFF || image->height > 0xFFFF) {
+        return PWError_InvalidParameter;
+    }
+    if (image->format != PWPixelFormat_RGBA8888 && image->format != PWPixelFormat_RGB888
+        && image->format != PWPixelFormat_Gray8 && image->format != PWPixelFormat_YCbCr420) {
+        return PWError_NotSupported;
+    }
+    PWJPEGEncodeOptions defaults;
+    if (!options) {
+        PWJPEGEncodeOptionsInit(&defaults);
+        options = &defaults;
+    }
+
+    size_t startLength = output->length;
+    PWError error = encodeFile(image, options, options->quality, output);
+    if (error != PWError_None || options->targetLength == 0 || options->quality <= 1
+        || output->length - startLength <= options->targetLength) {
+        return error;
+    }
+
+        // Too big, so find the highest quality which fits by bisection. File size rises steadily with quality, so this
+        // takes at most seven more encodes. If even quality 1 doesn't fit, that is the file written.
+    output->length = startLength;
+    PWDataBuffer trial, best;
+    if (!PWDataBufferInit(&trial, options->targetLength) || !PWDataBufferInit(&best, options->targetLength)) {
+        PWDataBufferFree(&trial);
+        return PWError_OutOfMemory;
+    }
+    int lowest = 1, highest = options->quality - 1;
+    while (error == PWError_None && lowest <= highest) {
+        int quality = (lowest + highest + 1) / 2;
+        trial.length = 0;
+        error = encodeFile(image, options, quality, &trial);
+        if (trial.length <= options->targetLength || quality == 1) {
+            PWDataBuffer swap = best;
+            best = trial;
+            trial = swap;
+            lowest = quality + 1;
+        } else {
+            highest = quality - 1;
+        }
+    }
+    if (error == PWError_None && !PWDataBufferAppend(output, best.bytes, best.length)) {
+        error = PWError_OutOfMemory;
+    }
+    PWDataBufferFree(&trial);
+    PWDataBufferFree(&best);
+    return error;
+}
+
+// MARK: - Coefficients
+
+    /// Write everything before the scan of a file coded from COEFFICIENTS, WIDTH x HEIGHT pixels.
+static bool writeCoefficientHeaders(const PWJPEGCoefficients *coefficients, size_t width, size_t height, PWDataBuffer *output) {
+    static const uint8_t startOfImage[2] = { 0xFF, PWJPEGMarker_SOI };
+    static const uint8_t jfif[14] = { 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+    int componentCount = coefficients->info.componentCount;
+    bool ok = PWDataBufferAppend(output, startOfImage, 2);
+    if (coefficients->adobeTransform >= 0) {
+            // Keep the Adobe segment, which is all that says whether the channels are RGB or YCbCr.
+        uint8_t adobe[12] = { 'A', 'd', 'o', 'b', 'e', 0, 100, 0, 0, 0, 0, (uint8_t)coefficients->adobeTransform };
+        ok = ok && appendMarker(output, PWJPEGMarker_APP14, 2 + sizeof(adobe)) && PWDataBufferAppend(output, adobe, sizeof(adobe));
+    } else {
+        ok = ok && appendMarker(output, PWJPEGMarker_APP0, 2 + sizeof(jfif)) && PWDataBufferAppend(output, jfif, sizeof(jfif));
+    }
+
+        // One table for each component. Steps over 255 need 16-bit entries, which baseline files can't have.
+    bool extended = false;
+    for (int component = 0; component < componentCount; component++) {
+        for (int i = 0; i < 64; i++) {
+            extended = extended || coefficients->components[component].quantTable[i] > 255;
+        }
+    }
+    unsigned entrySize = extended ? 2 : 1;
+    ok = ok && appendMarker(output, PWJPEGMarker_DQT, (unsigned)(2 + componentCount * (1 + 64 * entrySize)));
+    for (int component = 0; ok && component < componentCount; component++) {
+        const uint16_t *table = coefficients->components[component].quantTable;
+        ok = PWDataBufferAppendByte(output, (uint8_t)((extended ? 0x10 : 0x00) | component));
+        for (int i = 0; ok && i < 64; i++) {
+            unsigned value = table[PWJPEGZigzagToNatural[i]];
+            ok = extended ? appendUInt16(output, value) : PWDataBufferAppendByte(output, (uint8_t)value);
+        }
+    }
+
+    ok = ok && appendMarker(output, extended ? PWJPEGMarker_SOF1 : PWJPEGMarker_SOF0, (unsigned)(8 + 3 * componentCount))
+    &&        PWDataBufferAppendByte(output, 8)
+    &&        appendUInt16(output, (unsigned)height)
+    &&        appendUInt16(output, (unsigned)width)
+    &&        PWDataBufferAppendByte(output, (uint8_t)componentCount);
+    for (int component = 0; ok && component < componentCount; component++) {
+        const PWJPEGComponentCoefficients *source = &coefficients->components[component];
+        ok = PWDataBufferAppendByte(output, (uint8_t)(component + 1))
+        &&   PWDataBufferAppendByte(output, (uint8_t)(source->horizontalSampling << 4 | source->verticalSampling))
+        &&   PWDataBufferAppendByte(output, (uint8_t)component);
+    }
+
+        // The standard tables cover every symbol 8-bit coefficients can need, whatever the original file's tables were.
+    if (componentCount == 1) {
+        ok = ok && appendMarker(output, PWJPEGMarker_DHT, 2 + 17 * 2 + 12 + 162)
+        &&        appendHuffmanSpec(output, 0, 0, &PWJPEGStandardLuminanceDC)
+        &&        appendHuffmanSpec(output, 1, 0, &PWJPEGStandardLuminanceAC);
+    } else {
+        ok = ok && appendMarker(output, PWJPEGMarker_DHT, 2 + 17 * 4 + 12 * 2 + 162 * 2)
+        &&        appendHuffmanSpec(output, 0, 0, &PWJPEGStandardLuminanceDC)
+        &&        appendHuffmanSpec(output, 1, 0, &PWJPEGStandardLuminanceAC)
+        &&        appendHuffmanSpec(output, 0, 1, &PWJPEGStandardChrominanceDC)
+        &&        appendHuffmanSpec(output, 1, 1, &PWJPEGStandardChrominanceAC);
+    }
+
+    ok = ok && appendMarker(output, PWJPEGMarker_SOS, (unsigned)(6 + 2 * componentCount))
+    &&        PWDataBufferAppendByte(output, (uint8_t)componentCount);
+    for (int component = 0; ok && component < componentCount; component++) {
+        ok = PWDataBufferAppendByte(output, (uint8_t)(component + 1))
+        &&   PWDataBufferAppendByte(output, component == 0 ? 0x00 : 0x11);
+    }
+    static const uint8_t spectralSelection[3] = { 0, 63, 0 };
+    return ok && PWDataBufferAppend(output, spectralSelection, 3);
+}
+
+PWError PWJPEGEncodeCoefficients(const PWJPEGCoefficients *coefficients, PWImageRect rect, PWDataBuffer *output) {
+    if (!coefficients || !output || !coefficients->components[0].blocks) {
+        return PWError_InvalidParameter;
+    }
+    const PWJPEGInfo *info = &coefficients->info;
+    size_t mcuWidth = info->blockWidth, mcuHeight = info->blockHeight;
+    if (rect.x % mcuWidth != 0 || rect.y % mcuHeight != 0 || rect.x >= info->width || rect.y >= info->height) {
+        return PWError_InvalidParameter;
+    }
+    size_t width  = rect.width  < info->width  - rect.x ? rect.width  : info->width  - rect.x;
+    size_t height = rect.height < info->height - rect.y ? rect.height : info->height - rect.y;
+    if (width == 0 || height == 0) {
+        return PWError_InvalidParameter;
+    }
+
+    HuffmanTable dcTables[2], acTables[2];
+    buildHuffmanTable(&PWJPEGStandardLuminanceDC,   &dcTables[0]);
+    buildHuffmanTable(&PWJPEGStandardLuminanceAC,   &acTables[0]);
+    buildHuffmanTable(&PWJPEGStandardChrominanceDC, &dcTables[1]);
+    buildHuffmanTable(&PWJPEGStandardChrominanceAC, &acTables[1]);
+
+    size_t startLength = output->length;
+    bool ok = writeCoefficientHeaders(coefficients, width, height, output);
+    BitWriter writer = { .output = output, .accumulator = 0, .bitCount = 0, .failed = !ok };
+    int previousDC[3] = { 0, 0, 0 };
+    size_t firstMCUX = rect.x / mcuWidth, firstMCUY = rect.y / mcuHeight;
+    size_t mcusAcross = (width + mcuWidth - 1) / mcuWidth, mcusDown = (height + mcuHeight - 1) / mcuHeight;
+    for (size_t mcuY = firstMCUY; mcuY < firstMCUY + mcusDown && !writer.failed; mcuY++) {
+        for (size_t mcuX = firstMCUX; mcuX < firstMCUX + mcusAcross; mcuX++) {
+            for (int component = 0; component < info->componentCount; component++) {
+                const PWJPEGComponentCoefficients *source = &coefficients->components[component];
+                int table = component == 0 ? 0 : 1;
+                for (size_t v = 0; v < (size_t)source->verticalSampling; v++) {
+                    for (size_t h = 0; h < (size_t)source->horizontalSampling; h++) {
+                        size_t blockX = mcuX * (size_t)source->horizontalSampling + h;
+                        size_t blockY = mcuY * (size_t)source->verticalSampling + v;
+                        const int16_t *block = source->blocks + (blockY * source->blocksAcross + blockX) * 64;
+                        encodeDC(&writer, block[0], &previousDC[component], &dcTables[table]);
+                        encodeAC(&writer, block, 1, 63, &acTables[table]);
+                    }
+                }
+            }
+        }
+    }
+    flushBits(&writer);
+    static const uint8_t endOfImage[2] = { 0xFF, PWJPEGMarker_EOI };
+    if (writer.failed || !PWDataBufferAppend(output, endOfImage, 2)) {
+        output->length = startLength;
+        return PWError_OutOfMemory;
+    }
+    return PWError_None;
+}
@@ -0,0 +1,96 @@
+/*!
+ @header PWJPEGEncoder
+ @abstract A portable JPEG encoder used for saving photos and exporting stereograms.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ Files are cut into strips of MCU rows with restart markers between them. Each marker resets the coder, so the strips
+ of a large image are encoded on all the cores at once and joined afterwards; the markers cost two bytes each. Files
+ can be baseline, which every decoder reads, or progressive, which shows a coarse image as soon as the first scan has
+ arrived. The image core's own decoder reads only baseline files, so photos the app reads back are saved as baseline.
+ A target length can be given instead of relying on the quality alone, for exports which must fit a size limit.
+ */
+
+#ifndef PWJPEGEncoder_h
+#define PWJPEGEncoder_h
+
+#include "PWImageBuffer.h"
+#include "PWJPEGDecoder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * @enum
+ * @brief How the chroma channels are sampled relative to luma.
+ * @constant PWJPEGSubsampling_444 Full resolution chroma. Largest files, best for text and sharp edges.
+ * @constant PWJPEGSubsampling_420 Chroma halved in both directions. The usual choice for photos.
+ */
+typedef enum PWJPEGSubsampling {
+    PWJPEGSubsampling_444,
+    PWJPEGSubsampling_420
+} PWJPEGSubsampling;
+
+/*! Quality of files encoded with the default options: much smaller than quality 100, and hard to tell from it. */
+enum { PWJPEGDefaultQuality = 90 };
+
+/*! MCU rows between restart markers by default: 64 pixel rows of a 4:2:0 file, about 20 strips for a photo. */
+enum { PWJPEGDefaultRestartRows = 4 };
+
+/*! Settings for PWJPEGEncode(). Call PWJPEGEncodeOptionsInit() to get the defaults before changing anything. */
+typedef struct PWJPEGEncodeOptions {
+        /*! 1 to 100. Defaults to PWJPEGDefaultQuality. With a target length, the highest quality to try. */
+    int quality;
+        /*! Defaults to 4:2:0. Ignored for Gray8 images, and YCbCr420 images are always 4:2:0. */
+    PWJPEGSubsampling subsampling;
+        /*! True for a progressive file: the DC of every block first, then bands of the other coefficients.
+            Progressive files are slightly bigger, as each scan ends every block with a code of its own. Defaults to false. */
+    bool progressive;
+        /*! MCU rows between restart markers, or 0 for none, which also means the file is encoded on one thread.
+            Lowered if need be for very wide images. Defaults to PWJPEGDefaultRestartRows. */
+    unsigned restartRows;
+        /*! If not 0, the largest file wanted in bytes. The quality is lowered from QUALITY as far as it must be to fit,
+            which costs several more encodes; if even quality 1 doesn't fit, that file is written anyway. Defaults to 0. */
+    size_t targetLength;
+} PWJPEGEncodeOptions;
+
+/*! Fill OPTIONS with the default settings. */
+void PWJPEGEncodeOptionsInit(PWJPEGEncodeOptions *options);
+
+/*!
+ * Encode IMAGE as a JFIF file and append it to OUTPUT.
+ *
+ * RGBA8888 and RGB888 images are encoded as YCbCr, dropping any alpha channel. Gray8 images are encoded as single-channel.
+ * YCbCr420 images, as PWJPEGDecode() gives, are encoded from their planes directly without converting the colours.
+ * Images of more than 256K pixels are encoded on several threads if they have restart markers.
+ *
+ * @param image   The image to encode.
+ * @param options Encoder settings, or NULL for the defaults.
+ * @param output  An initialised buffer. The file is appended to whatever it already contains.
+ * @return PWError_None on success, PWError_NotSupported for other pixel formats, or PWError_OutOfMemory, in
+ *         which case OUTPUT is left as it was.
+ */
+PWError PWJPEGEncode(const PWImageBuffer *image, const PWJPEGEncodeOptions *options, PWDataBuffer *output);
+
+/*!
+ * Write the part of COEFFICIENTS inside RECT as a baseline JPEG file and append it to OUTPUT, without losing anything.
+ *
+ * The coefficients are coded again as they are, with the same quantisation tables and sampling, so the file decodes to
+ * exactly the pixels of that part of the original. Only the Huffman tables change, to the standard ones, which can make
+ * the file a little bigger than the part of the original it came from. It has no restart markers and no EXIF segment.
+ *
+ * @param coefficients From PWJPEGReadCoefficients().
+ * @param rect         The part to keep, in stored pixels. The left and top edges must be on MCU boundaries; see
+ *                     PWJPEGAlignCropRect(). The right and bottom edges may fall anywhere, and are clipped to the image.
+ * @param output       An initialised buffer. The file is appended to whatever it already contains.
+ * @return PWError_None, PWError_InvalidParameter if RECT is not aligned or leaves nothing, or PWError_OutOfMemory,
+ *         in which case OUTPUT is left as it was.
+ */
+PWError PWJPEGEncodeCoefficients(const PWJPEGCoefficients *coefficients, PWImageRect rect, PWDataBuffer *output);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWJPEGEncoder_h */
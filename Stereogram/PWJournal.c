@@ -0,0 +1,398 @@
+//
+//  PWJournal.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWJournal.h"
+#include "PWLibrary.h"
+#include "PWStorage.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+const char *const PWJournalFileName = ".Journal";
+
+    /// Lines are appended one at a time, so each must be numbered from the last one without another thread in between.
+static pthread_mutex_t journalLock = PTHREAD_MUTEX_INITIALIZER;
+
+    /// The last sequence number is looked for in this much of the end of the journal, which holds several lines.
+enum { TailLength = 2048 };
+
+static const char *const KindNames[] = { "begin", "put", "delete", "synced" };
+static const size_t KindCount = sizeof(KindNames) / sizeof(KindNames[0]);
+
+static bool journalPath(char output[PATH_MAX], const char *rootPath) {
+    int length = snprintf(output, PATH_MAX, "%s/%s", rootPath, PWJournalFileName);
+    return length > 0 && length < PATH_MAX;
+}
+
+bool PWJournalExists(const char *rootPath) {
+    char path[PATH_MAX];
+    return rootPath && journalPath(path, rootPath) && PWStorageFileExists(PWStorageDefault(), path);
+}
+
+// MARK: - Lines
+
+size_t PWJournalFormatEntry(const PWJournalEntry *entry, char *line, size_t capacity) {
+    if (!entry || !line || !entry->path || entry->path[0] == '\0' || (unsigned)entry->kind >= KindCount
+        || strpbrk(entry->path, " \t\r\n")) {
+        return 0;
+    }
+    char digest[PWSHA256HexLength + 1] = "-";
+    if (entry->kind != PWJournalEntry_Delete) {
+        PWSHA256Format(&entry->digest, digest);
+    }
+    int length = snprintf(line, capacity, "%llu %s %zu %s %s\n", (unsigned long long)entry->sequence,
+                          KindNames[entry->kind], entry->length, entry->path, digest);
+    return length > 0 && (size_t)length < capacity ? (size_t)length : 0;
+}
+
+    /// Read a decimal number which fills the LENGTH characters at TEXT.
+static bool parseNumber(const char *text, size_t length, uint64_t *number) {
+    if (length == 0 || length > 19) {
+        return false;
+    }
+    *number = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] < '0' || text[i] > '9') {
+            return false;
+        }
+        *number = *number * 10 + (uint64_t)(text[i] - '0');
+    }
+    return true;
+}
+
+    /// Parse one line, without its newline, into ENTRY, with the path copied to PATH.
+static bool parseLine(const char *line, size_t length, PWJournalEntry *entry, char path[PATH_MAX]) {
+    const char *fields[5];
+    size_t lengths[5], count = 0;
+    for (size_t start = 0, i = 0; i <= length; i++) {
+        if (i == length || line[i] == ' ') {
+            if (count == 5 || i == start) {
+                return false;
+            }
+            fields[count] = line + start;
+            lengths[count++] = i - start;
+            start = i + 1;
+        }
+    }
+    uint64_t length64;
+    if (count != 5 || !parseNumber(fields[0], lengths[0], &entry->sequence) || !parseNumber(fields[2], lengths[2], &length64)
+        || lengths[3] >= PATH_MAX) {
+        return false;
+    }
+    entry->length = (size_t)length64;
+    size_t kind = 0;
+    while (kind < KindCount && !(strlen(KindNames[kind]) == lengths[1] && memcmp(KindNames[kind], fields[1], lengths[1]) == 0)) {
+        kind++;
+    }
+    if (kind == KindCount) {
+        return false;
+    }
+    entry->kind = (PWJournalEntryKind)kind;
+    memset(&entry->digest, 0, sizeof(entry->digest));
+    if (entry->kind == PWJournalEntry_Delete) {
+        if (lengths[4] != 1 || fields[4][0] != '-') {
+            return false;
+        }
+    } else if (lengths[4] != PWSHA256HexLength || !PWSHA256Parse(fields[4], &entry->digest)) {
+        return false;
+    }
+    memcpy(path, fields[3], lengths[3]);
+    path[lengths[3]] = '\0';
+    entry->path = path;
+    return true;
+}
+
+void PWJournalParseLines(const uint8_t *bytes, size_t length, PWJournalVisitor visitor, void *context) {
+    if (!bytes || !visitor) {
+        return;
+    }
+    const char *text = (const char *)bytes, *end = text + length;
+    char path[PATH_MAX];
+    while (text < end) {
+        const char *newline = memchr(text, '\n', (size_t)(end - text));
+        if (!newline) {
+            return;  // Cut short.
+        }
+        PWJournalEntry entry;
+        if (parseLine(text, (size_t)(newline - text), &entry, path) && !visitor(&entry, context)) {
+            return;
+        }
+        text = newline + 1;
+    }
+}
+
+// MARK: - Recording
+
+static bool findLastSequence(const PWJournalEntry *entry, void *context) {
+    uint64_t *last = context;
+    if (entry->sequence > *last) {
+        *last = entry->sequence;
+    }
+    return true;
+}
+
+    /// Number ENTRY after the last line of the journal at PATH and add it. Call with journalLock held.
+static PWError appendEntry(PWStorage *storage, const char *path, size_t journalLength, PWJournalEntry *entry) {
+    PWDataBuffer tail = { NULL, 0, 0 };
+    size_t offset = journalLength > TailLength ? journalLength - TailLength : 0;
+    PWError error = PWDataBufferInit(&tail, TailLength) ? PWStorageReadFile(storage, path, offset, TailLength, &tail) : PWError_OutOfMemory;
+    uint64_t last = 0;
+    if (error == PWError_None) {
+            // The first line of the tail is probably only part of one, so skip it.
+        const uint8_t *start = tail.bytes, *end = tail.bytes + tail.length;
+        if (offset > 0) {
+            const uint8_t *newline = memchr(start, '\n', tail.length);
+            start = newline ? newline + 1 : end;
+        }
+        PWJournalParseLines(start, (size_t)(end - start), findLastSequence, &last);
+    }
+    if (error == PWError_None && last == 0 && offset > 0) {
+            // A line longer than the tail. Read the lot.
+        tail.length = 0;
+        error = PWStorageReadFile(storage, path, 0, PWStorageWholeFile, &tail);
+        if (error == PWError_None) {
+            PWJournalParseLines(tail.bytes, tail.length, findLastSequence, &last);
+        }
+    }
+    if (error == PWError_None) {
+        char line[PATH_MAX + 128];
+            // End a line cut short by a crash, so it isn't taken as part of the new one.
+        bool torn = tail.length > 0 && tail.bytes[tail.length - 1] != '\n';
+        line[0] = '\n';
+        entry->sequence = last + 1;
+        size_t length = PWJournalFormatEntry(entry, line + torn, sizeof(line) - 1);
+        error = length == 0 ? PWError_InvalidParameter : PWStorageAppendFile(storage, path, line, length + torn);
+    }
+    PWDataBufferFree(&tail);
+    return error;
+}
+
+    /// Record ENTRY in the journal of the folder holding STEREOGRAMPATH, with the path made from the stereogram's name and FILENAME.
+static PWError recordEntry(const char *stereogramPath, const char *fileName, PWJournalEntry *entry) {
+    const char *slash = stereogramPath ? strrchr(stereogramPath, '/') : NULL;
+    if (!slash || slash[1] == '\0' || (size_t)(slash - stereogramPath) >= PATH_MAX) {
+        return PWError_InvalidParameter;
+    }
+    char rootPath[PATH_MAX], path[PATH_MAX], relativePath[PATH_MAX];
+    memcpy(rootPath, stereogramPath, (size_t)(slash - stereogramPath));
+    rootPath[slash - stereogramPath] = '\0';
+    int length = fileName ? snprintf(relativePath, sizeof(relativePath), "%s/%s", slash + 1, fileName)
+                          : snprintf(relativePath, sizeof(relativePath), "%s", slash + 1);
+    if (length <= 0 || length >= (int)sizeof(relativePath) || !journalPath(path, rootPath)) {
+        return PWError_InvalidParameter;
+    }
+    entry->path = relativePath;
+    PWStorage *storage = PWStorageDefault();
+    pthread_mutex_lock(&journalLock);
+    PWStorageItemInfo info;
+    PWError error = PWStorageGetInfo(storage, path, &info);
+    if (error == PWError_None && info.kind == PWStorageItem_File) {
+        error = appendEntry(storage, path, info.length, entry);
+    }
+    pthread_mutex_unlock(&journalLock);
+    return error;
+}
+
+PWError PWJournalRecordPut(const char *stereogramPath, const char *fileName, const void *bytes, size_t length) {
+    if (!fileName || (!bytes && length > 0)) {
+        return PWError_InvalidParameter;
+    }
+    PWJournalEntry entry = { 0, PWJournalEntry_Put, length, NULL, { { 0 } } };
+    PWSHA256Compute(bytes, length, &entry.digest);
+    return recordEntry(stereogramPath, fileName, &entry);
+}
+
+PWError PWJournalWriteFile(const char *stereogramPath, const char *fileName, const void *bytes, size_t length, bool atomic) {
+    char path[PATH_MAX];
+    int pathLength = stereogramPath && fileName ? snprintf(path, sizeof(path), "%s/%s", stereogramPath, fileName) : -1;
+    if (pathLength <= 0 || pathLength >= (int)sizeof(path)) {
+        return PWError_InvalidParameter;
+    }
+    PWError error = PWStorageWriteFile(PWStorageDefault(), path, bytes, length, atomic);
+    return error == PWError_None ? PWJournalRecordPut(stereogramPath, fileName, bytes, length) : error;
+}
+
+PWError PWJournalRecordDelete(const char *stereogramPath, const char *fileName) {
+    PWJournalEntry entry = { 0, PWJournalEntry_Delete, 0, NULL, { { 0 } } };
+    return recordEntry(stereogramPath, fileName, &entry);
+}
+
+// MARK: - Creating and reading
+
+    /// Names found in one directory by PWJournalCreate(), each followed by a zero.
+typedef struct NameList {
+    PWDataBuffer names;
+    size_t count;
+    bool failed;
+} NameList;
+
+static bool appendName(NameList *list, const char *name) {
+    size_t length = strlen(name) + 1;
+    if (!PWDataBufferReserve(&list->names, length)) {
+        list->failed = true;
+        return false;
+    }
+    memcpy(list->names.bytes + list->names.length, name, length);
+    list->names.length += length;
+    list->count++;
+    return true;
+}
+
+static bool collectStereogram(const PWLibraryEntry *entry, void *context) {
+    const char *slash = strrchr(entry->path, '/');
+    return appendName(context, slash ? slash + 1 : entry->path);
+}
+
+    /// Collect the files a stereogram's journal entries are about: its own, and the frames of a sequence.
+static bool collectFile(const char *name, PWStorageItemKind kind, void *context) {
+    if (name[0] == '.') {
+        return true;
+    }
+    if (kind == PWStorageItem_File || (kind == PWStorageItem_Directory && strcmp(name, PWLibraryFramesDirectoryName) == 0)) {
+        return appendName(context, name);
+    }
+    return true;
+}
+
+    /// Add a put line for ROOTPATH/PATH to JOURNAL, or, if it is the frames directory, one for each frame in it.
+static PWError addFileEntries(PWStorage *storage, const char *rootPath, const char *path, uint64_t *sequence, PWDataBuffer *journal) {
+    char fullPath[PATH_MAX];
+    int fullLength = snprintf(fullPath, sizeof(fullPath), "%s/%s", rootPath, path);
+    if (fullLength <= 0 || fullLength >= (int)sizeof(fullPath)) {
+        return PWError_InvalidParameter;
+    }
+    PWStorageItemInfo info;
+    PWError error = PWStorageGetInfo(storage, fullPath, &info);
+    if (error == PWError_None && info.kind == PWStorageItem_Directory) {
+        NameList frames = { { NULL, 0, 0 }, 0, false };
+        error = PWStorageListDirectory(storage, fullPath, collectFile, &frames);
+        const char *name = (const char *)frames.names.bytes;
+        char framePath[PATH_MAX];
+        for (size_t i = 0; i < frames.count && error == PWError_None; i++, name += strlen(name) + 1) {
+            int length = snprintf(framePath, sizeof(framePath), "%s/%s", path, name);
+            error = length > 0 && length < (int)sizeof(framePath) ? addFileEntries(storage, rootPath, framePath, sequence, journal)
+                                                                  : PWError_InvalidParameter;
+        }
+        error = frames.failed ? PWError_OutOfMemory : error;
+        PWDataBufferFree(&frames.names);
+        return error;
+    }
+    PWDataBuffer contents = { NULL, 0, 0 };
+    if (error == PWError_None) {
+        error = PWDataBufferInit(&contents, info.length) ? PWStorageReadFile(storage, fullPath, 0, PWStorageWholeFile, &contents)
+                                                        : PWError_OutOfMemory;
+    }
+    if (error == PWError_None) {
+        PWJournalEntry entry = { ++*sequence, PWJournalEntry_Put, contents.length, path, { { 0 } } };
+        PWSHA256Compute(contents.bytes, contents.length, &entry.digest);
+        char line[PATH_MAX + 128];
+        size_t length = PWJournalFormatEntry(&entry, line, sizeof(line));
+        if (length == 0) {
+            error = PWError_InvalidParameter;
+        } else if (!PWDataBufferReserve(journal, length)) {
+            error = PWError_OutOfMemory;
+        } else {
+            memcpy(journal->bytes + journal->length, line, length);
+            journal->length += length;
+        }
+    }
+    PWDataBufferFree(&contents);
+    return error;
+}
+
+    /// A digest of whatever is to hand which differs from one call to the next, to tell journals apart.
+static void makeIdentifier(const char *rootPath, PWSHA256Digest *identifier) {
+    PWSHA256Context context;
+    PWSHA256Init(&context);
+    struct timespec now[2];
+    clock_gettime(CLOCK_REALTIME, &now[0]);
+    clock_gettime(CLOCK_MONOTONIC, &now[1]);
+    pid_t process = getpid();
+    const void *address = &context;
+    PWSHA256Update(&context, now, sizeof(now));
+    PWSHA256Update(&context, &process, sizeof(process));
+    PWSHA256Update(&context, &address, sizeof(address));
+    PWSHA256Update(&context, rootPath, strlen(rootPath));
+    PWSHA256Final(&context, identifier);
+}
+
+PWError PWJournalCreate(const char *rootPath) {
+    char path[PATH_MAX];
+    if (!rootPath || !journalPath(path, rootPath)) {
+        return PWError_InvalidParameter;
+    }
+    PWStorage *storage = PWStorageDefault();
+    pthread_mutex_lock(&journalLock);
+    if (PWStorageFileExists(storage, path)) {
+        pthread_mutex_unlock(&journalLock);
+        return PWError_None;
+    }
+    NameList stereograms = { { NULL, 0, 0 }, 0, false };
+    PWDataBuffer journal = { NULL, 0, 0 };
+    PWError error = PWLibraryEnumerate(rootPath, collectStereogram, &stereograms, NULL);
+    if (error == PWError_None && (stereograms.failed || !PWDataBufferInit(&journal, 4096))) {
+        error = PWError_OutOfMemory;
+    }
+    if (error == PWError_None) {
+        PWJournalEntry begin = { 0, PWJournalEntry_Begin, 0, "-", { { 0 } } };
+        makeIdentifier(rootPath, &begin.digest);
+        journal.length = PWJournalFormatEntry(&begin, (char *)journal.bytes, journal.capacity);
+    }
+    uint64_t sequence = 0;
+    const char *name = (const char *)stereograms.names.bytes;
+    for (size_t i = 0; i < stereograms.count && error == PWError_None; i++, name += strlen(name) + 1) {
+        char stereogramPath[PATH_MAX], filePath[PATH_MAX];
+        NameList files = { { NULL, 0, 0 }, 0, false };
+        int length = snprintf(stereogramPath, sizeof(stereogramPath), "%s/%s", rootPath, name);
+        error = length > 0 && length < (int)sizeof(stereogramPath) ? PWStorageListDirectory(storage, stereogramPath, collectFile, &files)
+                                                                    : PWError_InvalidParameter;
+        error = error == PWError_None && files.failed ? PWError_OutOfMemory : error;
+        const char *fileName = (const char *)files.names.bytes;
+        for (size_t j = 0; j < files.count && error == PWError_None; j++, fileName += strlen(fileName) + 1) {
+            length = snprintf(filePath, sizeof(filePath), "%s/%s", name, fileName);
+            error = length > 0 && length < (int)sizeof(filePath) ? addFileEntries(storage, rootPath, filePath, &sequence, &journal)
+                                                                  : PWError_InvalidParameter;
+        }
+        PWDataBufferFree(&files.names);
+    }
+    if (error == PWError_None) {
+        error = PWStorageWriteFile(storage, path, journal.bytes, journal.length, true);
+    }
+    pthread_mutex_unlock(&journalLock);
+    PWDataBufferFree(&journal);
+    PWDataBufferFree(&stereograms.names);
+    return error;
+}
+
+PWError PWJournalRead(const char *rootPath, PWJournalVisitor visitor, void *context) {
+    char path[PATH_MAX];
+    if (!rootPath || !visitor || !journalPath(path, rootPath)) {
+        return PWError_InvalidParameter;
+    }
+    PWStorage *storage = PWStorageDefault();
+    PWDataBuffer contents = { NULL, 0, 0 };
+    PWStorageItemInfo info;
+    PWError error = PWStorageGetInfo(storage, path, &info);
+    if (error == PWError_None && info.kind != PWStorageItem_File) {
+        error = PWError_NotSupported;
+    }
+    if (error == PWError_None) {
+        error = PWDataBufferInit(&contents, info.length) ? PWStorageReadFile(storage, path, 0, PWStorageWholeFile, &contents)
+                                                        : PWError_OutOfMemory;
+    }
+    if (error == PWError_None) {
+        PWJournalParseLines(contents.bytes, contents.length, visitor, context);
+    }
+    PWDataBufferFree(&contents);
+    return error;
+}
@@ -0,0 +1,125 @@
+/*!
+ @header PWJournal
+ @abstract A log of the changes made to a photo folder, so a sync sends only what has changed since the last one.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ The journal is the file ".Journal" in the photo folder, with one line for each change:
+
+     <sequence> <kind> <length> <path> <digest>
+
+ e.g. "42 put 1048576 0A1B2C3D-.../LeftPhoto.jpg 9f86d0...". PATH is relative to the photo folder and DIGEST is the
+ SHA-256 of the file's contents. A delete has length 0, the path of the stereogram or file removed, and "-" for the
+ digest. The first line, with sequence 0, is "0 begin 0 - <identifier>", where the identifier is a random digest which
+ tells one journal from another, e.g. after the app has been reinstalled. Every line has five fields and ends in a
+ digest or "-", so one cut short by a crash is recognised and skipped.
+
+ Journalling is off until PWJournalCreate() is called for the folder, which PhotoStore does when it opens it. Until then
+ PWJournalRecordPut() and PWJournalRecordDelete() do nothing, so tools and tests which make libraries of their own
+ aren't affected. Puts are recorded once the file has been written and deletes once the files are gone, so the journal
+ never describes contents which aren't stored; write files with PWJournalWriteFile() to keep to this. If the app stops
+ in between, the change is sent when the file is next written. Tile pyramids and other things which can be made again
+ from the photos aren't recorded.
+
+ The journal is read and written through PWStorageDefault(). Recording is thread-safe.
+ */
+
+#ifndef PWJournal_h
+#define PWJournal_h
+
+#include "PWSHA256.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Name of the journal in the photo folder. It starts with a dot, so it is never taken for a stereogram. */
+extern const char *const PWJournalFileName;
+
+/*!
+ * The kinds of line.
+ *
+ * @constant PWJournalEntry_Begin  The first line of a journal. The digest is the journal's identifier.
+ * @constant PWJournalEntry_Put    A file was created or replaced with contents of the length and digest given.
+ * @constant PWJournalEntry_Delete A stereogram, or one of its files, was deleted.
+ * @constant PWJournalEntry_Synced Only in a sync target's manifest: the journal with the identifier in the digest has
+ *                                 been copied up to and including the sequence number given. See PWSync.h.
+ */
+typedef enum PWJournalEntryKind {
+    PWJournalEntry_Begin,
+    PWJournalEntry_Put,
+    PWJournalEntry_Delete,
+    PWJournalEntry_Synced
+} PWJournalEntryKind;
+
+/*! One line of a journal. */
+typedef struct PWJournalEntry {
+    uint64_t sequence;
+    PWJournalEntryKind kind;
+        /*! Length of the file for a put, otherwise 0. */
+    size_t length;
+        /*! Relative to the photo folder, e.g. "Name/LeftPhoto.jpg", or "-" for lines which aren't about a file. */
+    const char *path;
+        /*! Contents of a put, or the identifier of a journal. All zeros for a delete. */
+    PWSHA256Digest digest;
+} PWJournalEntry;
+
+/*! Called with each entry read. PATH is only valid during the call. Return false to stop early. */
+typedef bool (*PWJournalVisitor)(const PWJournalEntry *entry, void *context);
+
+/*! True if the photo folder ROOTPATH keeps a journal. */
+bool PWJournalExists(const char *rootPath);
+
+/*!
+ * Start keeping a journal in the photo folder ROOTPATH, if it doesn't already.
+ * The new journal begins with a put for each file of every stereogram already there, so the first sync copies them all.
+ *
+ * @return PWError_None if there is a journal now, PWError_InvalidFormat if a stereogram in the folder is missing files,
+ *         or an error from reading them.
+ */
+PWError PWJournalCreate(const char *rootPath);
+
+/*!
+ * Record that FILENAME in the stereogram directory STEREOGRAMPATH has been given the contents at BYTES. The photo
+ * folder is the directory holding the stereogram. FILENAME may have a directory in it, e.g. "Frames/Left-000001.jpg".
+ * Does nothing if the photo folder doesn't keep a journal.
+ */
+PWError PWJournalRecordPut(const char *stereogramPath, const char *fileName, const void *bytes, size_t length);
+
+/*!
+ * Write BYTES to FILENAME in the stereogram directory STEREOGRAMPATH through PWStorageDefault(), as PWStorageWriteFile()
+ * does, and record the put once the write has succeeded. If the write fails nothing is recorded.
+ *
+ * @return PWError_None, or the error from writing the file or the journal.
+ */
+PWError PWJournalWriteFile(const char *stereogramPath, const char *fileName, const void *bytes, size_t length, bool atomic);
+
+/*!
+ * Record that FILENAME in the stereogram directory STEREOGRAMPATH has been deleted, or the whole stereogram if FILENAME
+ * is NULL. Does nothing if the photo folder doesn't keep a journal.
+ */
+PWError PWJournalRecordDelete(const char *stereogramPath, const char *fileName);
+
+/*!
+ * Call VISITOR with each entry in the journal of the photo folder ROOTPATH, in order, starting with the begin entry.
+ *
+ * @return PWError_None, PWError_NotSupported if the folder doesn't keep a journal, or an error reading it.
+ */
+PWError PWJournalRead(const char *rootPath, PWJournalVisitor visitor, void *context);
+
+/*!
+ * Write ENTRY as a line in the journal's format, with its newline, into LINE. PWSync's manifests use the same format.
+ *
+ * @return The length of the line, or 0 if it doesn't fit in CAPACITY bytes or the path can't be stored, e.g. because it
+ *         has a space in it.
+ */
+size_t PWJournalFormatEntry(const PWJournalEntry *entry, char *line, size_t capacity);
+
+/*! Call VISITOR with each complete, well-formed line in the LENGTH bytes at BYTES. Others are skipped. */
+void PWJournalParseLines(const uint8_t *bytes, size_t length, PWJournalVisitor visitor, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWJournal_h */
@@ -0,0 +1,456 @@
+//
+//  PWLibrary.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWLibrary.h"
+#include "PWJournal.h"
+#include "PWPerceptualHash.h"
+#include "PWStorage.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+const char *const PWLibraryLeftPhotoFileName    = "LeftPhoto.jpg";
+const char *const PWLibraryRightPhotoFileName   = "RightPhoto.jpg";
+const char *const PWLibraryPropertyListFileName = "Properties.plist";
+const char *const PWLibraryFramesDirectoryName  = "Frames";
+
+    /// Names of the photos of the later frames of a sequence, in the Frames directory, numbered from 1.
+static const char *const LeftFrameFileFormat = "Left-%06zu.jpg", *const RightFrameFileFormat = "Right-%06zu.jpg";
+
+    /// Property list keys. These must match the keys in Stereogram.m.
+static const char *const ViewingMethodKey     = "<key>ViewingMethod</key>";
+static const char *const CropRectKey          = "<key>CropRect</key>";
+static const char *const DisparityOffsetKey   = "<key>DisparityOffset</key>";
+static const char *const AlignmentOffsetKey   = "<key>AlignmentOffset</key>";
+static const char *const AlignmentRotationKey = "<key>AlignmentRotation</key>";
+static const char *const PerceptualHashKey    = "<key>PerceptualHash</key>";
+
+    /// Property lists bigger than this are not ones we wrote.
+enum { MaximumPropertyListLength = 64 * 1024 };
+
+// MARK: - Helpers
+
+static bool joinPath(char *output, const char *directory, const char *name) {
+    int length = snprintf(output, PATH_MAX, "%s/%s", directory, name);
+    return length > 0 && length < PATH_MAX;
+}
+
+static bool fileExists(const char *directory, const char *name) {
+    char path[PATH_MAX];
+    return joinPath(path, directory, name) && PWStorageFileExists(PWStorageDefault(), path);
+}
+
+    /// Write DIRECTORY/NAME. If ATOMIC, the file is only there once all of it has been written.
+static PWError writeFile(const char *directory, const char *name, const void *bytes, size_t length, bool atomic) {
+    char path[PATH_MAX];
+    if (!joinPath(path, directory, name)) {
+        return PWError_InvalidParameter;
+    }
+    return PWStorageWriteFile(PWStorageDefault(), path, bytes, length, atomic);
+}
+
+    /// Append the contents of DIRECTORY/NAME to CONTENTS.
+static PWError readFile(const char *directory, const char *name, PWDataBuffer *contents) {
+    char path[PATH_MAX];
+    if (!joinPath(path, directory, name)) {
+        return PWError_InvalidParameter;
+    }
+    return PWStorageReadFile(PWStorageDefault(), path, 0, PWStorageWholeFile, contents);
+}
+
+    /// The names of the photos of frame INDEX of a sequence, relative to the stereogram directory.
+static bool frameFileNames(size_t index, char left[PATH_MAX], char right[PATH_MAX]) {
+    if (index == 0) {
+        snprintf(left, PATH_MAX, "%s", PWLibraryLeftPhotoFileName);
+        snprintf(right, PATH_MAX, "%s", PWLibraryRightPhotoFileName);
+        return true;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), LeftFrameFileFormat, index);
+    bool ok = joinPath(left, PWLibraryFramesDirectoryName, name);
+    snprintf(name, sizeof(name), RightFrameFileFormat, index);
+    return joinPath(right, PWLibraryFramesDirectoryName, name) && ok;
+}
+
+    /// Return the text of the value element following KEY in the property list CONTENTS, or NULL if KEY is missing.
+    /// TAG receives the element name, e.g. "integer", truncated to fit.
+static const char *findValue(const char *contents, const char *key, char tag[16]) {
+    const char *found = strstr(contents, key);
+    if (!found) {
+        return NULL;
+    }
+    const char *element = strchr(found + strlen(key), '<');
+    const char *end = element ? strchr(element, '>') : NULL;
+    if (!end || end - element - 1 < 1) {
+        return NULL;
+    }
+    size_t tagLength = (size_t)(end - element - 1) < 15 ? (size_t)(end - element - 1) : 15;
+    memcpy(tag, element + 1, tagLength);
+    tag[tagLength] = '\0';
+    return end + 1;
+}
+
+static bool readNumber(const char *contents, const char *key, double *number) {
+    char tag[16];
+    const char *value = findValue(contents, key, tag);
+    if (!value || (strcmp(tag, "integer") != 0 && strcmp(tag, "real") != 0)) {
+        return false;
+    }
+    char *end;
+    double parsed = strtod(value, &end);
+    if (end == value) {
+        return false;
+    }
+    *number = parsed;
+    return true;
+}
+
+    /// The crop is stored as a string from NSStringFromCGRect(), e.g. {{0, 12}, {1632, 1200}}.
+static bool readCropRect(const char *contents, PWCropRect *cropRect) {
+    char tag[16];
+    const char *value = findValue(contents, CropRectKey, tag);
+    PWCropRect parsed;
+    if (!value || strcmp(tag, "string") != 0
+        || sscanf(value, " {{ %lf , %lf } , { %lf , %lf }}", &parsed.x, &parsed.y, &parsed.width, &parsed.height) != 4) {
+        return false;
+    }
+    *cropRect = parsed;
+    return true;
+}
+
+    /// The hash is stored as a string of hexadecimal digits, as property list integers are signed.
+static bool readHash(const char *contents, uint64_t *hash) {
+    char tag[16];
+    const char *value = findValue(contents, PerceptualHashKey, tag);
+    if (!value || strcmp(tag, "string") != 0) {
+        return false;
+    }
+    char *end;
+    unsigned long long parsed = strtoull(value, &end, 16);
+    if (end == value || *end != '<') {
+        return false;
+    }
+    *hash = parsed;
+    return true;
+}
+
+    /// Load a whole file into a new null-terminated string, which the caller must free.
+static PWError loadTextFile(const char *path, size_t maximumLength, char **text) {
+    *text = NULL;
+    PWDataBuffer contents;
+    if (!PWDataBufferInit(&contents, maximumLength + 2)) {
+        return PWError_OutOfMemory;
+    }
+        // One byte more than is allowed, to tell a file which is too long from one which just fits.
+    PWError error = PWStorageReadFile(PWStorageDefault(), path, 0, maximumLength + 1, &contents);
+    if (error == PWError_None && contents.length > maximumLength) {
+        error = PWError_InvalidFormat;
+    }
+    if (error != PWError_None) {
+        PWDataBufferFree(&contents);
+        return error;
+    }
+    contents.bytes[contents.length] = '\0';
+    *text = (char *)contents.bytes;
+    return PWError_None;
+}
+
+// MARK: - Public interface
+
+    /// The state of one PWLibraryEnumerate() call, passed to enumerateItem() for each item in the photo folder.
+typedef struct Enumeration {
+    const char *rootPath;
+    PWLibraryVisitor visitor;
+    void *context;
+    size_t found;
+    PWError error;
+} Enumeration;
+
+static bool enumerateItem(const char *name, PWStorageItemKind kind, void *context) {
+    (void)kind;
+    Enumeration *enumeration = context;
+    if (name[0] == '.') {
+        return true;  // Hidden files.
+    }
+    char path[PATH_MAX];
+    if (!joinPath(path, enumeration->rootPath, name)) {
+        enumeration->error = PWError_InvalidParameter;
+        return false;
+    }
+    if (!fileExists(path, PWLibraryLeftPhotoFileName)
+        || !fileExists(path, PWLibraryRightPhotoFileName)
+        || !fileExists(path, PWLibraryPropertyListFileName)) {
+        enumeration->error = PWError_InvalidFormat;
+        return false;
+    }
+    enumeration->found++;
+    if (!enumeration->visitor) {
+        return true;
+    }
+        // An unreadable property list leaves the default viewing method, as in Stereogram.
+    PWLibraryProperties properties;
+    PWLibraryReadProperties(path, &properties);
+    PWLibraryEntry entry = { .path = path, .viewingMethod = properties.viewingMethod };
+    return enumeration->visitor(&entry, enumeration->context);
+}
+
+PWError PWLibraryEnumerate(const char *rootPath, PWLibraryVisitor visitor, void *context, size_t *count) {
+    if (count) {
+        *count = 0;
+    }
+    if (!rootPath) {
+        return PWError_InvalidParameter;
+    }
+    Enumeration enumeration = { rootPath, visitor, context, 0, PWError_None };
+    PWError error = PWStorageListDirectory(PWStorageDefault(), rootPath, enumerateItem, &enumeration);
+    if (count) {
+        *count = enumeration.found;
+    }
+    return error != PWError_None ? error : enumeration.error;
+}
+
+PWError PWLibraryReadProperties(const char *path, PWLibraryProperties *properties) {
+    if (!properties) {
+        return PWError_InvalidParameter;
+    }
+    *properties = (PWLibraryProperties) { 0 };
+    char propertyListPath[PATH_MAX];
+    if (!path || !joinPath(propertyListPath, path, PWLibraryPropertyListFileName)) {
+        return PWError_InvalidParameter;
+    }
+    char *contents;
+    PWError error = loadTextFile(propertyListPath, MaximumPropertyListLength, &contents);
+    if (error != PWError_None) {
+        return error;
+    }
+        // Missing keys keep their defaults, as they do in Stereogram, which removes a key rather than storing 0.
+    double number;
+    if (readNumber(contents, ViewingMethodKey, &number)) {
+        properties->viewingMethod = (int)number;
+    }
+    if (readNumber(contents, DisparityOffsetKey, &number)) {
+        properties->disparityOffset = (long)number;
+    }
+    readNumber(contents, AlignmentOffsetKey, &properties->alignment.verticalOffset);
+    readNumber(contents, AlignmentRotationKey, &properties->alignment.rotation);
+    readCropRect(contents, &properties->cropRect);
+    properties->hasPerceptualHash = readHash(contents, &properties->perceptualHash);
+    free(contents);
+    return PWError_None;
+}
+
+PWError PWLibraryComputePerceptualHash(const char *path, uint64_t *hash) {
+    if (!path || !hash) {
+        return PWError_InvalidParameter;
+    }
+    PWDataBuffer contents;
+    if (!PWDataBufferInit(&contents, 0)) {
+        return PWError_OutOfMemory;
+    }
+    PWImageBuffer *photo = NULL;
+    PWError error = readFile(path, PWLibraryLeftPhotoFileName, &contents);
+    if (error == PWError_None) {
+        error = PWStereoPairDecodePhoto(contents.bytes, contents.length, &photo);
+    }
+    PWDataBufferFree(&contents);
+    if (error == PWError_None) {
+        error = PWPerceptualHashCompute(photo, hash);
+    }
+    PWImageBufferRelease(photo);
+    return error;
+}
+
+PWError PWLibraryCreateStereogram(const char *rootPath, const char *name,
+                                  const PWDataBuffer *leftJPEG, const PWDataBuffer *rightJPEG, int viewingMethod) {
+    return PWLibraryCreateStereogramTakenAt(rootPath, name, leftJPEG, rightJPEG, viewingMethod, time(NULL));
+}
+
+PWError PWLibraryCreateStereogramTakenAt(const char *rootPath, const char *name, const PWDataBuffer *leftJPEG,
+                                         const PWDataBuffer *rightJPEG, int viewingMethod, time_t dateTaken) {
+    if (!rootPath || !name || !leftJPEG || !rightJPEG) {
+        return PWError_InvalidParameter;
+    }
+        // Build it under a hidden name and move it into place once complete, so an app killed part way through leaves
+        // only a directory enumeration skips, not a stereogram missing files, which would stop the library loading.
+    char path[PATH_MAX], hiddenName[NAME_MAX + 1], finalPath[PATH_MAX];
+    int hiddenNameLength = snprintf(hiddenName, sizeof(hiddenName), ".%s.partial", name);
+    if (hiddenNameLength <= 0 || hiddenNameLength >= (int)sizeof(hiddenName)
+        || !joinPath(path, rootPath, hiddenName) || !joinPath(finalPath, rootPath, name)) {
+        return PWError_InvalidParameter;
+    }
+    PWStorage *storage = PWStorageDefault();
+    PWStorageItemInfo info;
+    PWError error = PWStorageGetInfo(storage, finalPath, &info);
+    if (error == PWError_None && info.kind != PWStorageItem_None) {
+        error = PWError_IO;
+    }
+    if (error == PWError_None) {
+            // Anything left by an earlier attempt which was interrupted is out of date.
+        PWStorageRemoveTree(storage, path);
+        error = PWStorageMakeDirectory(storage, path, true);
+    }
+    if (error != PWError_None) {
+        return error;
+    }
+
+        // Same layout NSPropertyListSerialization produces for the dictionary Stereogram saves.
+    char dateString[32];
+    struct tm utc;
+    gmtime_r(&dateTaken, &utc);
+    strftime(dateString, sizeof(dateString), "%Y-%m-%dT%H:%M:%SZ", &utc);
+    char propertyList[1024];
+    int propertyListLength = snprintf(propertyList, sizeof(propertyList),
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+        "<plist version=\"1.0\">\n<dict>\n"
+        "\t<key>DateTaken</key>\n\t<date>%s</date>\n"
+        "\t%s\n\t<integer>%d</integer>\n"
+        "</dict>\n</plist>\n", dateString, ViewingMethodKey, viewingMethod);
+
+    error = writeFile(path, PWLibraryLeftPhotoFileName, leftJPEG->bytes, leftJPEG->length, false);
+    if (error == PWError_None) {
+        error = writeFile(path, PWLibraryRightPhotoFileName, rightJPEG->bytes, rightJPEG->length, false);
+    }
+    if (error == PWError_None) {
+        error = writeFile(path, PWLibraryPropertyListFileName, propertyList, (size_t)propertyListLength, false);
+    }
+    if (error == PWError_None) {
+        error = PWStorageMoveItem(storage, path, finalPath);
+    }
+    if (error != PWError_None) {
+        PWLibraryRemoveDirectory(path);
+        return error;
+    }
+        // The files are only recorded once they are in place, so the journal never lists a stereogram which isn't there.
+    error = PWJournalRecordPut(finalPath, PWLibraryLeftPhotoFileName, leftJPEG->bytes, leftJPEG->length);
+    if (error == PWError_None) {
+        error = PWJournalRecordPut(finalPath, PWLibraryRightPhotoFileName, rightJPEG->bytes, rightJPEG->length);
+    }
+    if (error == PWError_None) {
+        error = PWJournalRecordPut(finalPath, PWLibraryPropertyListFileName, propertyList, (size_t)propertyListLength);
+    }
+    return error;
+}
+
+PWError PWLibraryRemoveDirectory(const char *path) {
+    if (!path) {
+        return PWError_InvalidParameter;
+    }
+    return PWStorageRemoveTree(PWStorageDefault(), path);
+}
+
+PWError PWLibraryDeleteStereogram(const char *path) {
+    PWError error = PWLibraryRemoveDirectory(path);
+    return error == PWError_None ? PWJournalRecordDelete(path, NULL) : error;
+}
+
+    /// Collects the paths found by PWLibraryEnumerate() so we aren't deleting from a directory while reading it.
+typedef struct PathList {
+    char **paths;
+    size_t count, capacity;
+} PathList;
+
+static bool collectPath(const PWLibraryEntry *entry, void *context) {
+    PathList *list = context;
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        char **paths = realloc(list->paths, capacity * sizeof(char *));
+        if (!paths) {
+            return false;
+        }
+        list->paths = paths;
+        list->capacity = capacity;
+    }
+    char *path = strdup(entry->path);
+    if (!path) {
+        return false;
+    }
+    list->paths[list->count++] = path;
+    return true;
+}
+
+PWError PWLibraryDeleteAll(const char *rootPath, size_t *count) {
+    if (count) {
+        *count = 0;
+    }
+    PathList list = { NULL, 0, 0 };
+    size_t found = 0;
+    PWError error = PWLibraryEnumerate(rootPath, collectPath, &list, &found);
+    if (error == PWError_None && list.count != found) {
+        error = PWError_OutOfMemory;
+    }
+    size_t deleted = 0;
+    for (size_t i = 0; i < list.count; i++) {
+        if (error == PWError_None) {
+            error = PWLibraryDeleteStereogram(list.paths[i]);
+            if (error == PWError_None) {
+                deleted++;
+            }
+        }
+        free(list.paths[i]);
+    }
+    free(list.paths);
+    if (count) {
+        *count = deleted;
+    }
+    return error;
+}
+
+// MARK: - Sequences
+
+size_t PWLibrarySequenceFrameCount(const char *path) {
+    if (!path) {
+        return 0;
+    }
+    char left[PATH_MAX], right[PATH_MAX];
+    size_t count = 0;
+    while (frameFileNames(count, left, right) && fileExists(path, left) && fileExists(path, right)) {
+        count++;
+    }
+    return count;
+}
+
+PWError PWLibraryAddSequenceFrame(const char *path, const PWDataBuffer *leftJPEG, const PWDataBuffer *rightJPEG, size_t *index) {
+    if (!path || !leftJPEG || !rightJPEG) {
+        return PWError_InvalidParameter;
+    }
+    size_t frameIndex = PWLibrarySequenceFrameCount(path);
+    char directory[PATH_MAX], left[PATH_MAX], right[PATH_MAX];
+    if (frameIndex == 0) {
+        return PWError_InvalidParameter;  // Not a stereogram; the first frame is made with PWLibraryCreateStereogram().
+    }
+    if (!joinPath(directory, path, PWLibraryFramesDirectoryName) || !frameFileNames(frameIndex, left, right)) {
+        return PWError_InvalidParameter;
+    }
+    PWError error = PWStorageMakeDirectory(PWStorageDefault(), directory, false);
+    if (error != PWError_None) {
+        return error;
+    }
+        // The right photo goes last, and appears all at once, so an interrupted write leaves a frame which isn't counted,
+        // and is overwritten next time.
+    error = PWJournalWriteFile(path, left, leftJPEG->bytes, leftJPEG->length, false);
+    if (error == PWError_None) {
+        error = PWJournalWriteFile(path, right, rightJPEG->bytes, rightJPEG->length, true);
+    }
+    if (error == PWError_None && index) {
+        *index = frameIndex;
+    }
+    return error;
+}
+
+PWError PWLibraryReadSequenceFrame(const char *path, size_t index, PWDataBuffer *leftJPEG, PWDataBuffer *rightJPEG) {
+    char left[PATH_MAX], right[PATH_MAX];
+    if (!path || !leftJPEG || !rightJPEG || !frameFileNames(index, left, right)) {
+        return PWError_InvalidParameter;
+    }
+    PWError error = readFile(path, left, leftJPEG);
+    return error == PWError_None ? readFile(path, right, rightJPEG) : error;
+}
@@ -0,0 +1,148 @@
+/*!
+ @header PWLibrary
+ @abstract Portable access to the on-disk layout of the photo store.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ Each stereogram lives in its own directory under the photo folder, named with a UUID and holding
+ LeftPhoto.jpg, RightPhoto.jpg and Properties.plist. These functions mirror what PhotoStore and Stereogram
+ do, so the benchmark harness can run them on Linux. They go through PWStorageDefault(), which is the file system
+ unless a test or benchmark has set an in-memory storage. Stereograms and frames created and deleted here are recorded
+ in the folder's journal, if it keeps one (see PWJournal.h); removing other directories with PWLibraryRemoveDirectory()
+ isn't.
+ */
+
+#ifndef PWLibrary_h
+#define PWLibrary_h
+
+#include "PWStereoPair.h"
+
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Names of the files making up one stereogram. These must match the names used in Stereogram.m. */
+extern const char *const PWLibraryLeftPhotoFileName, *const PWLibraryRightPhotoFileName, *const PWLibraryPropertyListFileName;
+
+/*! Subdirectory holding the photos of the second and later frames of a sequence. */
+extern const char *const PWLibraryFramesDirectoryName;
+
+/*! Information about one stereogram found by PWLibraryEnumerate(). */
+typedef struct PWLibraryEntry {
+        /*! Full path to the stereogram directory. Only valid for the duration of the callback. */
+    const char *path;
+        /*! The ViewingMethod stored in the property list, or 0 (cross-eye) if none was found. */
+    int viewingMethod;
+} PWLibraryEntry;
+
+/*! Called once for each stereogram found. Return false to stop the enumeration early. */
+typedef bool (*PWLibraryVisitor)(const PWLibraryEntry *entry, void *context);
+
+/*!
+ * Find every stereogram under ROOTPATH.
+ *
+ * Hidden files are skipped, as with NSDirectoryEnumerationSkipsHiddenFiles. As in +[Stereogram allStereogramsUnderURL:error:],
+ * a directory missing any of its three files is treated as an error and stops the scan.
+ *
+ * @param rootPath The photo folder.
+ * @param visitor  Called for each stereogram, or NULL just to count them.
+ * @param context  Passed through to VISITOR.
+ * @param count    If not NULL, receives the number of stereograms visited.
+ * @return PWError_None on success, PWError_IO if a directory could not be read or PWError_InvalidFormat for an incomplete stereogram.
+ */
+PWError PWLibraryEnumerate(const char *rootPath, PWLibraryVisitor visitor, void *context, size_t *count);
+
+/*! The properties of a stereogram which change how it is drawn. Keys missing from the property list are left as 0. */
+typedef struct PWLibraryProperties {
+        /*! The ViewingMethod, 0 (cross-eye) by default. */
+    int viewingMethod;
+        /*! The CropRect, or an empty rectangle if the photos are not cropped. */
+    PWCropRect cropRect;
+        /*! The DisparityOffset in pixels. */
+    long disparityOffset;
+        /*! The AlignmentOffset and AlignmentRotation. The residual is always 0. */
+    PWAlignment alignment;
+        /*! The PerceptualHash of the left photo (see PWPerceptualHash.h), if hasPerceptualHash is set. */
+    uint64_t perceptualHash;
+        /*! False for stereograms made before the hash was stored. */
+    bool hasPerceptualHash;
+} PWLibraryProperties;
+
+/*!
+ * Read the properties of the stereogram in the directory PATH from its Properties.plist.
+ *
+ * This is not a general property list parser. It only needs to read the XML files written by Stereogram through
+ * NSPropertyListSerialization, or by PWLibraryCreateStereogram().
+ *
+ * @return PWError_None, PWError_IO if the file could not be read, or PWError_InvalidFormat if it is implausibly large.
+ *         PROPERTIES holds the defaults on failure.
+ */
+PWError PWLibraryReadProperties(const char *path, PWLibraryProperties *properties);
+
+/*!
+ * Work out the perceptual hash of the stereogram at PATH from its left photo, e.g. for one which doesn't have it stored.
+ * This decodes the photo, so it takes as long as making the thumbnail.
+ */
+PWError PWLibraryComputePerceptualHash(const char *path, uint64_t *hash);
+
+/*!
+ * Create a new stereogram directory under ROOTPATH with the given file contents.
+ * The files are written to a hidden directory which is renamed once they are all there, so the stereogram is either
+ * complete or missing; a hidden ".NAME.partial" directory may be left behind if the app stops part way through.
+ *
+ * @param rootPath      The photo folder. Must already exist.
+ * @param name          Name of the new directory, normally a UUID string.
+ * @param leftJPEG      Contents of LeftPhoto.jpg.
+ * @param rightJPEG     Contents of RightPhoto.jpg.
+ * @param viewingMethod Value to store for the ViewingMethod key in Properties.plist.
+ */
+PWError PWLibraryCreateStereogram(const char *rootPath, const char *name,
+                                  const PWDataBuffer *leftJPEG, const PWDataBuffer *rightJPEG, int viewingMethod);
+
+/*! As PWLibraryCreateStereogram(), but storing DATETAKEN as the DateTaken property instead of the current time, e.g. for imported photos. */
+PWError PWLibraryCreateStereogramTakenAt(const char *rootPath, const char *name, const PWDataBuffer *leftJPEG,
+                                         const PWDataBuffer *rightJPEG, int viewingMethod, time_t dateTaken);
+
+/*! Delete a stereogram directory and everything in it. Equivalent to -[Stereogram deleteFromDisk:]. */
+PWError PWLibraryDeleteStereogram(const char *path);
+
+/*! Delete the directory at PATH and everything under it. A directory which doesn't exist is not an error. */
+PWError PWLibraryRemoveDirectory(const char *path);
+
+/*! Delete every stereogram found under ROOTPATH. If COUNT is not NULL, it receives the number deleted. */
+PWError PWLibraryDeleteAll(const char *rootPath, size_t *count);
+
+// MARK: - Sequences
+
+/*!
+ * Number of stereo pairs in the stereogram at PATH.
+ *
+ * A sequence, e.g. a burst or a time-lapse, is a stereogram with more than one pair of photos. The first pair is the
+ * usual LeftPhoto.jpg and RightPhoto.jpg, so everything which shows a single pair just shows the first frame. The
+ * others are numbered from 1 in the Frames subdirectory, and share the first pair's properties.
+ *
+ * @return 1 for an ordinary stereogram, or 0 if PATH is not a stereogram.
+ */
+size_t PWLibrarySequenceFrameCount(const char *path);
+
+/*!
+ * Add a pair of photos to the end of the sequence at PATH.
+ *
+ * @param index If not NULL, receives the index of the new frame.
+ * @return PWError_None, PWError_InvalidParameter if PATH is not a stereogram, or PWError_IO.
+ */
+PWError PWLibraryAddSequenceFrame(const char *path, const PWDataBuffer *leftJPEG, const PWDataBuffer *rightJPEG, size_t *index);
+
+/*!
+ * Read the photos of frame INDEX of the sequence at PATH, appending them to LEFTJPEG and RIGHTJPEG.
+ * Frame 0 is the stereogram's own pair of photos.
+ */
+PWError PWLibraryReadSequenceFrame(const char *path, size_t index, PWDataBuffer *leftJPEG, PWDataBuffer *rightJPEG);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWLibrary_h */
@@ -0,0 +1,305 @@
+//
+//  PWMPO.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWMPO.h"
+#include "PWJPEGCommon.h"
+
+#include <string.h>
+
+    /// Tags in the MPF index and attribute IFDs (CIPA DC-007 section 5.2).
+enum {
+    Tag_MPFVersion       = 0xB000,
+    Tag_NumberOfImages   = 0xB001,
+    Tag_MPEntry          = 0xB002,
+    Tag_MPIndividualNum  = 0xB101
+};
+
+    /// TIFF field types used in the IFDs.
+enum { Type_Long = 4, Type_Undefined = 7 };
+
+    /// Parts of the attribute word in an MP entry.
+enum {
+    Attribute_Representative = 0x20000000,
+    Attribute_TypeMask       = 0x00FFFFFF,
+    Type_Unspecified         = 0x000000,
+    Type_Disparity           = 0x020002
+};
+
+enum {
+        /// Bytes in one MP entry, and in one IFD entry.
+    MPEntrySize = 16,
+    IFDEntrySize = 12,
+        /// Length of the "MPF\0" identifier which starts the segment, before the TIFF-style header.
+    IdentifierLength = 4,
+        /// Where things are in the first picture's MPF data, counted from the start of the TIFF header. The index IFD holds
+        /// the version, the number of pictures and the MP entries, and is followed by the attribute IFD for the picture itself.
+    IndexIFDOffset = 8,
+    IndexEntryCount = 3,
+    MPEntriesOffset = IndexIFDOffset + 2 + IndexEntryCount * IFDEntrySize + 4,
+    PairAttributeIFDOffset = MPEntriesOffset + 2 * MPEntrySize,
+    AttributeEntryCount = 2,
+    AttributeIFDLength = 2 + AttributeEntryCount * IFDEntrySize + 4,
+    FirstHeaderLength = PairAttributeIFDOffset + AttributeIFDLength,
+        /// The other pictures only have the attribute IFD, straight after the header.
+    OtherHeaderLength = IndexIFDOffset + AttributeIFDLength
+};
+
+// MARK: - Byte helpers
+
+static inline unsigned readUInt16(const uint8_t *bytes, bool bigEndian) {
+    return bigEndian ? (unsigned)bytes[0] << 8 | bytes[1] : (unsigned)bytes[1] << 8 | bytes[0];
+}
+
+static inline uint32_t readUInt32(const uint8_t *bytes, bool bigEndian) {
+    return bigEndian ? (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3]
+                     : (uint32_t)bytes[3] << 24 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[1] << 8 | bytes[0];
+}
+
+    /// Everything written here is big-endian, as JPEG itself is.
+static inline uint8_t *putUInt16(uint8_t *bytes, unsigned value) {
+    bytes[0] = (uint8_t)(value >> 8);
+    bytes[1] = (uint8_t)value;
+    return bytes + 2;
+}
+
+static inline uint8_t *putUInt32(uint8_t *bytes, uint32_t value) {
+    bytes[0] = (uint8_t)(value >> 24);
+    bytes[1] = (uint8_t)(value >> 16);
+    bytes[2] = (uint8_t)(value >> 8);
+    bytes[3] = (uint8_t)value;
+    return bytes + 4;
+}
+
+static uint8_t *putEntry(uint8_t *bytes, unsigned tag, unsigned type, uint32_t count, uint32_t value) {
+    bytes = putUInt16(bytes, tag);
+    bytes = putUInt16(bytes, type);
+    bytes = putUInt32(bytes, count);
+    return putUInt32(bytes, value);
+}
+
+    /// True if the segment at SEGMENT, LENGTH bytes long not counting the marker and length, is an MPF segment.
+static bool isMPFSegment(unsigned marker, const uint8_t *segment, size_t length) {
+    return marker == PWJPEGMarker_APP2 && length >= IdentifierLength + 8 && memcmp(segment, "MPF", IdentifierLength) == 0;
+}
+
+// MARK: - Writing
+
+    /// Write the APP2 segment for picture INDEX (1-based) into SEGMENT, which must have room for it.
+    /// The MP entries of the first picture are left as zeroes, to be filled in once the sizes are known. Returns its length.
+static size_t makeSegment(uint8_t *segment, unsigned index) {
+    size_t headerLength = index == 1 ? FirstHeaderLength : OtherHeaderLength;
+    size_t segmentLength = 4 + IdentifierLength + headerLength;
+    memset(segment, 0, segmentLength);
+    segment[0] = 0xFF;
+    segment[1] = PWJPEGMarker_APP2;
+    putUInt16(segment + 2, (unsigned)(segmentLength - 2));
+    memcpy(segment + 4, "MPF", IdentifierLength);
+
+    uint8_t *tiff = segment + 4 + IdentifierLength, *bytes = tiff;
+    memcpy(bytes, "MM\0\x2A", 4);
+    bytes = putUInt32(bytes + 4, IndexIFDOffset);
+    if (index == 1) {
+        bytes = putUInt16(bytes, IndexEntryCount);
+        bytes = putEntry(bytes, Tag_MPFVersion, Type_Undefined, 4, 0);
+        memcpy(bytes - 4, "0100", 4);
+        bytes = putEntry(bytes, Tag_NumberOfImages, Type_Long, 1, 2);
+        bytes = putEntry(bytes, Tag_MPEntry, Type_Undefined, 2 * MPEntrySize, MPEntriesOffset);
+        bytes = putUInt32(bytes, PairAttributeIFDOffset);
+        bytes = tiff + PairAttributeIFDOffset;
+    }
+    bytes = putUInt16(bytes, AttributeEntryCount);
+    bytes = putEntry(bytes, Tag_MPFVersion, Type_Undefined, 4, 0);
+    memcpy(bytes - 4, "0100", 4);
+    bytes = putEntry(bytes, Tag_MPIndividualNum, Type_Long, 1, index);
+    putUInt32(bytes, 0);  // No more IFDs.
+    return segmentLength;
+}
+
+    /// Offset just past the EOI marker of the JPEG file whose first scan starts at SCAN, or 0 if it isn't there.
+    /// The entropy-coded data can't contain 0xFF 0xD9, as every 0xFF in it is followed by 0 or a restart marker.
+static size_t findEnd(const uint8_t *bytes, size_t length, size_t scan) {
+    for (const uint8_t *p = bytes + scan; p + 1 < bytes + length; p++) {
+        p = memchr(p, 0xFF, (size_t)(bytes + length - 1 - p));
+        if (!p) {
+            break;
+        }
+        if (p[1] == PWJPEGMarker_EOI) {
+            return (size_t)(p - bytes) + 2;
+        }
+    }
+    return 0;
+}
+
+    /// Append a copy of the JPEG file BYTES to OUTPUT with SEGMENT inserted after the JFIF and EXIF segments, and any MPF segment
+    /// left out. Set *SEGMENTPOSITION to the position SEGMENT was written to in OUTPUT.
+static PWError appendPicture(PWDataBuffer *output, const uint8_t *bytes, size_t length,
+                             const uint8_t *segment, size_t segmentLength, size_t *segmentPosition) {
+    if (length < 4 || bytes[0] != 0xFF || bytes[1] != PWJPEGMarker_SOI) {
+        return PWError_InvalidFormat;
+    }
+    if (!PWDataBufferAppend(output, bytes, 2)) {
+        return PWError_OutOfMemory;
+    }
+    size_t position = 2;
+    bool inserted = false, scanFound = false;
+    while (!scanFound && position + 4 <= length) {
+        if (bytes[position] != 0xFF) {
+            return PWError_InvalidFormat;
+        }
+        unsigned marker = bytes[position + 1];
+        if (marker == 0xFF) {  // Fill byte.
+            position++;
+            continue;
+        }
+        size_t fieldLength = (size_t)bytes[position + 2] << 8 | bytes[position + 3];
+        if (fieldLength < 2 || position + 2 + fieldLength > length) {
+            return PWError_InvalidFormat;
+        }
+        if (!inserted && marker != PWJPEGMarker_APP0 && marker != PWJPEGMarker_APP1) {
+            *segmentPosition = output->length;
+            if (!PWDataBufferAppend(output, segment, segmentLength)) {
+                return PWError_OutOfMemory;
+            }
+            inserted = true;
+        }
+        if (!isMPFSegment(marker, bytes + position + 4, fieldLength - 2)
+            && !PWDataBufferAppend(output, bytes + position, 2 + fieldLength)) {
+            return PWError_OutOfMemory;
+        }
+        position += 2 + fieldLength;
+        scanFound = marker == PWJPEGMarker_SOS;
+    }
+    size_t end = scanFound ? findEnd(bytes, length, position) : 0;
+    if (end == 0) {
+        return PWError_InvalidFormat;
+    }
+    return PWDataBufferAppend(output, bytes + position, end - position) ? PWError_None : PWError_OutOfMemory;
+}
+
+// MARK: - Reading
+
+    /// Find the MPF segment among the headers of the JPEG file BYTES and return a pointer to its TIFF header, or NULL if there isn't one.
+static const uint8_t *findIndex(const uint8_t *bytes, size_t length, size_t *tiffLength) {
+    if (length < 4 || bytes[0] != 0xFF || bytes[1] != PWJPEGMarker_SOI) {
+        return NULL;
+    }
+    size_t position = 2;
+    while (position + 4 <= length && bytes[position] == 0xFF) {
+        unsigned marker = bytes[position + 1];
+        if (marker == 0xFF) {
+            position++;
+            continue;
+        }
+        size_t fieldLength = (size_t)bytes[position + 2] << 8 | bytes[position + 3];
+        if (marker == PWJPEGMarker_SOS || fieldLength < 2 || position + 2 + fieldLength > length) {
+            break;
+        }
+        if (isMPFSegment(marker, bytes + position + 4, fieldLength - 2)) {
+            *tiffLength = fieldLength - 2 - IdentifierLength;
+            return bytes + position + 4 + IdentifierLength;
+        }
+        position += 2 + fieldLength;
+    }
+    return NULL;
+}
+
+// MARK: - Public interface
+
+PWError PWMPOCreate(const uint8_t *leftBytes, size_t leftLength, const uint8_t *rightBytes, size_t rightLength,
+                    PWDataBuffer *output) {
+    uint8_t leftSegment[4 + IdentifierLength + FirstHeaderLength], rightSegment[4 + IdentifierLength + OtherHeaderLength];
+    size_t leftSegmentLength = makeSegment(leftSegment, 1), rightSegmentLength = makeSegment(rightSegment, 2);
+    size_t start = output->length, leftSegmentPosition = 0, rightSegmentPosition = 0;
+    PWError error = appendPicture(output, leftBytes, leftLength, leftSegment, leftSegmentLength, &leftSegmentPosition);
+    size_t rightStart = output->length;
+    if (error == PWError_None) {
+        error = appendPicture(output, rightBytes, rightLength, rightSegment, rightSegmentLength, &rightSegmentPosition);
+    }
+    if (error != PWError_None) {
+        output->length = start;
+        return error;
+    }
+
+        // Now the sizes are known, fill in the index. The first picture's offset is always 0; the others are counted
+        // from the TIFF header in the first picture's MPF segment.
+    size_t tiffPosition = leftSegmentPosition + 4 + IdentifierLength;
+    uint8_t *entries = output->bytes + tiffPosition + MPEntriesOffset;
+    entries = putUInt32(entries, Attribute_Representative | Type_Disparity);
+    entries = putUInt32(entries, (uint32_t)(rightStart - start));
+    entries += 8;  // Offset 0, and no dependent pictures.
+    entries = putUInt32(entries, Type_Disparity);
+    entries = putUInt32(entries, (uint32_t)(output->length - rightStart));
+    putUInt32(entries, (uint32_t)(rightStart - tiffPosition));
+    return PWError_None;
+}
+
+PWError PWMPOFindStereoPair(const uint8_t *bytes, size_t length, PWMPOImage *left, PWMPOImage *right) {
+    size_t tiffLength = 0;
+    const uint8_t *tiff = findIndex(bytes, length, &tiffLength);
+    if (!tiff || tiffLength < 8) {
+        return PWError_InvalidFormat;
+    }
+    bool bigEndian;
+    if (memcmp(tiff, "MM\0\x2A", 4) == 0) {
+        bigEndian = true;
+    } else if (memcmp(tiff, "II\x2A\0", 4) == 0) {
+        bigEndian = false;
+    } else {
+        return PWError_InvalidFormat;
+    }
+
+        // Find the list of MP entries in the index IFD.
+    uint32_t ifdOffset = readUInt32(tiff + 4, bigEndian), imageCount = 0, entriesOffset = 0, entriesLength = 0;
+    if (ifdOffset > tiffLength - 2) {
+        return PWError_InvalidFormat;
+    }
+    unsigned fieldCount = readUInt16(tiff + ifdOffset, bigEndian);
+    for (unsigned i = 0; i < fieldCount; i++) {
+        size_t field = ifdOffset + 2 + (size_t)i * IFDEntrySize;
+        if (field + IFDEntrySize > tiffLength) {
+            return PWError_InvalidFormat;
+        }
+        unsigned tag = readUInt16(tiff + field, bigEndian);
+        if (tag == Tag_NumberOfImages) {
+            imageCount = readUInt32(tiff + field + 8, bigEndian);
+        } else if (tag == Tag_MPEntry) {
+            entriesLength = readUInt32(tiff + field + 4, bigEndian);
+            entriesOffset = readUInt32(tiff + field + 8, bigEndian);
+        }
+    }
+    if (imageCount == 0 || entriesLength / MPEntrySize < imageCount
+        || entriesOffset > tiffLength || entriesLength > tiffLength - entriesOffset) {
+        return PWError_InvalidFormat;
+    }
+
+        // Take the first two views.
+    size_t tiffPosition = (size_t)(tiff - bytes), viewCount = 0;
+    PWMPOImage views[2];
+    for (uint32_t i = 0; i < imageCount && viewCount < 2; i++) {
+        const uint8_t *entry = tiff + entriesOffset + (size_t)i * MPEntrySize;
+        uint32_t type = readUInt32(entry, bigEndian) & Attribute_TypeMask;
+        size_t size = readUInt32(entry + 4, bigEndian), offset = i == 0 ? 0 : tiffPosition + readUInt32(entry + 8, bigEndian);
+        if (size < 4 || offset > length || size > length - offset) {
+            return PWError_InvalidFormat;
+        }
+        if (bytes[offset] != 0xFF || bytes[offset + 1] != PWJPEGMarker_SOI) {
+            return PWError_InvalidFormat;
+        }
+        if (type == Type_Disparity || type == Type_Unspecified) {
+            views[viewCount].offset = offset;
+            views[viewCount].length = size;
+            viewCount++;
+        }
+    }
+    if (viewCount < 2) {
+        return PWError_NotSupported;
+    }
+    *left = views[0];
+    *right = views[1];
+    return PWError_None;
+}
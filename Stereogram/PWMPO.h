@@ -0,0 +1,65 @@
+/*!
+ @header PWMPO
+ @abstract Reads and writes MPO (CIPA DC-007 Multi-Picture Object) files, the single-file stereo format used by 3D cameras.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ An MPO file is a series of complete JPEG files one after the other. The first has an APP2 "MPF" segment holding an
+ index of where every image starts and how long it is, and the images of a stereo pair are stored left first. Nothing
+ here decodes or re-encodes the pictures: writing copies the two JPEG files and adds the index, and reading finds the
+ byte range of each picture from the index.
+ */
+
+#ifndef PWMPO_h
+#define PWMPO_h
+
+#include "PWImageBuffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Where one picture of an MPO file is. The bytes in that range are a complete JPEG file. */
+typedef struct PWMPOImage {
+    size_t offset, length;
+} PWMPOImage;
+
+/*!
+ * Write a stereo pair as an MPO file.
+ *
+ * Both JPEG files are copied without being decoded. An MPF segment is added to each, after any JFIF and EXIF segments,
+ * marking the pair as a multi-view disparity image with the left picture as the one to show in 2D viewers. Any MPF
+ * segment already in the inputs, e.g. because they were split from another MPO file, is left out, as is anything after
+ * the end of each image.
+ *
+ * @param leftBytes   The left photo's JPEG file.
+ * @param leftLength  Number of bytes in LEFTBYTES.
+ * @param rightBytes  The right photo's JPEG file.
+ * @param rightLength Number of bytes in RIGHTBYTES.
+ * @param output      The file is appended to this.
+ * @return PWError_None, PWError_InvalidFormat if either input is not a JPEG file, or PWError_OutOfMemory.
+ */
+PWError PWMPOCreate(const uint8_t *leftBytes, size_t leftLength, const uint8_t *rightBytes, size_t rightLength,
+                    PWDataBuffer *output);
+
+/*!
+ * Find the left and right pictures of a stereo MPO file without decoding them.
+ *
+ * These are the first two pictures the index describes as views of a multi-view image. Files which don't say, as some
+ * older cameras write, are taken to hold the pair as their first two pictures. Thumbnails and other kinds of picture
+ * are skipped.
+ *
+ * @param bytes  The file contents.
+ * @param length Number of bytes in BYTES.
+ * @param left   Receives where the left picture is.
+ * @param right  Receives where the right picture is.
+ * @return PWError_None, PWError_InvalidFormat if this is not an MPO file or its index points outside the file,
+ *         or PWError_NotSupported if it holds fewer than two views.
+ */
+PWError PWMPOFindStereoPair(const uint8_t *bytes, size_t length, PWMPOImage *left, PWMPOImage *right);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWMPO_h */
@@ -0,0 +1,583 @@
+//
+//  PWMemoryStorage.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWMemoryStorage.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+    /// A file or directory. Every node is in the hash table by its path, and in its parent's list of children.
+typedef struct Node {
+        /// The normalised path, e.g. "/Photos/Name", or "" for the root. NAME points to the last part of it.
+    char *path;
+    const char *name;
+    PWStorageItemKind kind;
+    uint8_t *bytes;
+    size_t length;
+    time_t modified;
+    struct Node *parent, *firstChild, *nextSibling, *previousSibling;
+    struct Node *hashNext;
+} Node;
+
+typedef struct MemoryStorage {
+    PWStorage storage;
+        /// Everything below is protected by LOCK.
+    pthread_mutex_t lock;
+    Node **buckets;
+    size_t bucketCount, nodeCount;
+    Node root;
+    uint64_t nanosecondsPerOperation, nanosecondsPerMegabyte;
+    PWMemoryStorageFault fault;
+        /// True while FAULT applies, and the number of matching operations still to succeed.
+    bool hasFault;
+    uint64_t faultCountdown;
+    PWMemoryStorageStatistics statistics;
+} MemoryStorage;
+
+enum { InitialBucketCount = 256 };
+
+// MARK: - Paths and nodes
+
+    /// Copy PATH to OUTPUT without repeated or trailing slashes and with a leading one, so "a//b/" becomes "/a/b".
+    /// The root becomes "". Returns false if the result doesn't fit.
+static bool normalisePath(const char *path, char output[PATH_MAX]) {
+    size_t length = 0;
+    for (const char *c = path; *c; c++) {
+        if (*c == '/') {
+            continue;
+        }
+        if (c == path || c[-1] == '/') {
+            if (length + 1 >= PATH_MAX) {
+                return false;
+            }
+            output[length++] = '/';
+        }
+        if (length + 1 >= PATH_MAX) {
+            return false;
+        }
+        output[length++] = *c;
+    }
+    output[length] = '\0';
+    return true;
+}
+
+static uint64_t hashPath(const char *path) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const unsigned char *c = (const unsigned char *)path; *c; c++) {
+        hash = (hash ^ *c) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static Node *findNode(MemoryStorage *memory, const char *path) {
+    if (path[0] == '\0') {
+        return &memory->root;
+    }
+    for (Node *node = memory->buckets[hashPath(path) & (memory->bucketCount - 1)]; node; node = node->hashNext) {
+        if (strcmp(node->path, path) == 0) {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+    /// The directory which would hold PATH, or NULL if there isn't one.
+static Node *findParent(MemoryStorage *memory, const char *path) {
+    char parentPath[PATH_MAX];
+    const char *slash = strrchr(path, '/');
+    if (!slash) {
+        return NULL;
+    }
+    memcpy(parentPath, path, (size_t)(slash - path));
+    parentPath[slash - path] = '\0';
+    Node *parent = findNode(memory, parentPath);
+    return parent && parent->kind == PWStorageItem_Directory ? parent : NULL;
+}
+
+static void growBuckets(MemoryStorage *memory) {
+    size_t bucketCount = memory->bucketCount * 2;
+    Node **buckets = calloc(bucketCount, sizeof(Node *));
+    if (!buckets) {
+        return;  // The chains just get longer.
+    }
+    for (size_t i = 0; i < memory->bucketCount; i++) {
+        for (Node *node = memory->buckets[i], *next; node; node = next) {
+            next = node->hashNext;
+            size_t bucket = hashPath(node->path) & (bucketCount - 1);
+            node->hashNext = buckets[bucket];
+            buckets[bucket] = node;
+        }
+    }
+    free(memory->buckets);
+    memory->buckets = buckets;
+    memory->bucketCount = bucketCount;
+}
+
+    /// Add an empty node of KIND at PATH, which must not exist yet, under PARENT.
+static Node *addNode(MemoryStorage *memory, Node *parent, const char *path, PWStorageItemKind kind) {
+    Node *node = calloc(1, sizeof(Node));
+    char *nodePath = node ? strdup(path) : NULL;
+    if (!nodePath) {
+        free(node);
+        return NULL;
+    }
+    node->path = nodePath;
+    node->name = strrchr(nodePath, '/') + 1;
+    node->kind = kind;
+    node->modified = time(NULL);
+    node->parent = parent;
+    node->nextSibling = parent->firstChild;
+    if (parent->firstChild) {
+        parent->firstChild->previousSibling = node;
+    }
+    parent->firstChild = node;
+    if (memory->nodeCount >= memory->bucketCount) {
+        growBuckets(memory);
+    }
+    size_t bucket = hashPath(nodePath) & (memory->bucketCount - 1);
+    node->hashNext = memory->buckets[bucket];
+    memory->buckets[bucket] = node;
+    memory->nodeCount++;
+    if (kind == PWStorageItem_File) {
+        memory->statistics.files++;
+    } else {
+        memory->statistics.directories++;
+    }
+    return node;
+}
+
+static void removeNode(MemoryStorage *memory, Node *node) {
+    if (node->previousSibling) {
+        node->previousSibling->nextSibling = node->nextSibling;
+    } else {
+        node->parent->firstChild = node->nextSibling;
+    }
+    if (node->nextSibling) {
+        node->nextSibling->previousSibling = node->previousSibling;
+    }
+    Node **link = &memory->buckets[hashPath(node->path) & (memory->bucketCount - 1)];
+    while (*link != node) {
+        link = &(*link)->hashNext;
+    }
+    *link = node->hashNext;
+    memory->nodeCount--;
+    if (node->kind == PWStorageItem_File) {
+        memory->statistics.files--;
+        memory->statistics.bytesStored -= node->length;
+    } else {
+        memory->statistics.directories--;
+    }
+    free(node->bytes);
+    free(node->path);
+    free(node);
+}
+
+    /// Replace the contents of the file NODE with LENGTH bytes.
+static PWError setContents(MemoryStorage *memory, Node *node, const void *bytes, size_t length) {
+    uint8_t *copy = NULL;
+    if (length > 0) {
+        copy = malloc(length);
+        if (!copy) {
+            return PWError_OutOfMemory;
+        }
+        memcpy(copy, bytes, length);
+    }
+    free(node->bytes);
+    memory->statistics.bytesStored += length - node->length;
+    node->bytes = copy;
+    node->length = length;
+    node->modified = time(NULL);
+    return PWError_None;
+}
+
+// MARK: - Latency and faults
+
+    /// Start an operation: count it, and return the fault's error if it should fail. Call with the lock held.
+static PWError beginOperation(MemoryStorage *memory, unsigned operation) {
+    unsigned bit = 0;
+    while ((1u << bit) != operation) {
+        bit++;
+    }
+    memory->statistics.operations[bit]++;
+    if (!memory->hasFault || !(memory->fault.operations & operation)) {
+        return PWError_None;
+    }
+    if (memory->faultCountdown > 0) {
+        memory->faultCountdown--;
+        return PWError_None;
+    }
+    if (!memory->fault.persistent) {
+        memory->hasFault = false;
+    }
+    memory->statistics.faults++;
+    return memory->fault.error;
+}
+
+    /// Unlock the storage, then wait as long as an operation moving BYTES takes.
+static void endOperation(MemoryStorage *memory, size_t bytes) {
+    uint64_t nanoseconds = memory->nanosecondsPerOperation + memory->nanosecondsPerMegabyte * bytes / (1024 * 1024);
+    pthread_mutex_unlock(&memory->lock);
+    if (nanoseconds > 0) {
+        struct timespec delay = { (time_t)(nanoseconds / 1000000000u), (long)(nanoseconds % 1000000000u) };
+        while (nanosleep(&delay, &delay) != 0) {
+        }
+    }
+}
+
+// MARK: - Operations
+
+static PWError memoryGetInfo(PWStorage *storage, const char *path, PWStorageItemInfo *info) {
+    MemoryStorage *memory = (MemoryStorage *)storage;
+    char normalised[PATH_MAX];
+    *info = (PWStorageItemInfo) { PWStorageItem_None, 0, 0 };
+    if (!normalisePath(path, normalised)) {
+        return PWError_InvalidParameter;
+    }
+    pthread_mutex_lock(&memory->lock);
+    PWError error = beginOperation(memory, PWStorageOperation_GetInfo);
+    Node *node = error == PWError_None ? findNode(memory, normalised) : NULL;
+    if (node) {
+        *info = (PWStorageItemInfo) { node->kind, node->length, node->modified };
+    }
+    endOperation(memory, 0);
+    return error;
+}
+
+static PWError memoryReadFile(PWStorage *storage, const char *path, size_t offset, size_t maximumLength, PWDataBuffer *contents) {
+    MemoryStorage *memory = (MemoryStorage *)storage;
+    char normalised[PATH_MAX];
+    if (!normalisePath(path, normalised)) {
+        return PWError_InvalidParameter;
+    }
+    pthread_mutex_lock(&memory->lock);
+    PWError error = beginOperation(memory, PWStorageOperation_ReadFile);
+    Node *node = error == PWError_None ? findNode(memory, normalised) : NULL;
+    size_t length = 0;
+    if (error == PWError_None && (!node || node->kind != PWStorageItem_File)) {
+        error = PWError_IO;
+    } else if (error == PWError_None) {
+        length = offset >= node->length ? 0 : node->length - offset < maximumLength ? node->length - offset : maximumLength;
+        if (length > 0 && !PWDataBufferAppend(contents, node->bytes + offset, length)) {
+            error = PWError_OutOfMemory;
+            length = 0;
+        }
+        memory->statistics.bytesRead += length;
+    }
+    endOperation(memory, length);
+    return error;
+}
+
+static PWError memoryWriteFile(PWStorage *storage, const char *path, const void *bytes, size_t length, bool atomic) {
+    MemoryStorage *memory = (MemoryStorage *)storage;
+    char normalised[PATH_MAX];
+    if (!normalisePath(path, normalised) || normalised[0] == '\0') {
+        return PWError_InvalidParameter;
+    }
+    pthread_mutex_lock(&memory->lock);
+    bool tear = memory->hasFault && memory->fault.tearWrites && !atomic;
+    PWError error = beginOperation(memory, PWStorageOperation_WriteFile);
+    size_t written = error == PWError_None ? length : tear ? length / 2 : 0;
+    Node *node = findNode(memory, normalised), *parent = node ? node->parent : findParent(memory, normalised);
+    if ((node && node->kind != PWStorageItem_File) || !parent) {
+        error = PWError_IO;
+        written = 0;
+    } else if (error == PWError_None || tear) {
+        if (!node) {
+            node = addNode(memory, parent, normalised, PWStorageItem_File);
+        }
+        PWError writeError = node ? setContents(memory, node, bytes, written) : PWError_OutOfMemory;
+        if (writeError != PWError_None) {
+            error = writeError;
+            written = 0;
+        }
+        memory->statistics.bytesWritten += written;
+    }
+    endOperation(memory, written);
+    return error;
+}
+
+static PWError memoryAppendFile(PWStorage *storage, const char *path, const void *bytes, size_t length) {
+    MemoryStorage *memory = (MemoryStorage *)storage;
+    char normalised[PATH_MAX];
+    if (!normalisePath(path, normalised) || normalised[0] == '\0') {
+        return PWError_InvalidParameter;
+    }
+    pthread_mutex_lock(&memory->lock);
+    bool tear = memory->hasFault && memory->fault.tearWrites;
+    PWError error = beginOperation(memory, PWStorageOperation_AppendFile);
+    size_t written = error == PWError_None ? length : tear ? length / 2 : 0;
+    Node *node = findNode(memory, normalised), *parent = node ? node->parent : findParent(memory, normalised);
+    if ((node && node->kind != PWStorageItem_File) || !parent) {
+        error = PWError_IO;
+        written = 0;
+    } else if (error == PWError_None || tear) {
+        if (!node) {
+            node = addNode(memory, parent, normalised, PWStorageItem_File);
+        }
+        uint8_t *grown = node && written > 0 ? realloc(node->bytes, node->length + written) : NULL;
+        if (!node || (written > 0 && !grown)) {
+            error = PWError_OutOfMemory;
+            written = 0;
+        } else if (written > 0) {
+            memcpy(grown + node->length, bytes, written);
+            node->bytes = grown;
+            node->length += written;
+            node->modified = time(NULL);
+            memory->statistics.bytesStored += written;
+        }
+        memory->statistics.bytesWritten += written;
+    }
+    endOperation(memory, written);
+    return error;
+}
+
+static PWError memoryMakeDirectory(PWStorage *storage, const char *path, bool mustBeNew) {
+    MemoryStorage *memory = (MemoryStorage *)storage;
+    char normalised[PATH_MAX];
+    if (!normalisePath(path, normalised)) {
+        return PWError_InvalidParameter;
+    }
+    pthread_mutex_lock(&memory->lock);
+    PWError error = beginOperation(memory, PWStorageOperation_MakeDirectory);
+    if (error == PWError_None) {
+        Node *node = findNode(memory, normalised), *parent;
+        if (node) {
+            error = node->kind == PWStorageItem_Directory && !mustBeNew ? PWError_None : PWError_IO;
+        } else if (!(parent = findParent(memory, normalised))) {
+            error = PWError_IO;
+        } else if (!addNode(memory, parent, normalised, PWStorageItem_Directory)) {
+            error = PWError_OutOfMemory;
+        }
+    }
+    endOperation(memory, 0);
+    return error;
+}
+
+static PWError memoryRemove(PWStorage *storage, const char *path, PWStorageItemKind kind, unsigned operation) {
+    MemoryStorage *memory = (MemoryStorage *)storage;
+    char normalised[PATH_MAX];
+    if (!normalisePath(path, normalised)) {
+        return PWError_InvalidParameter;
+    }
+    pthread_mutex_lock(&memory->lock);
+    PWError error = beginOperation(memory, operation);
+    Node *node = error == PWError_None ? findNode(memory, normalised) : NULL;
+    if (error == PWError_None) {
+        if (!node || node == &memory->root || node->kind != kind || node->firstChild) {
+            error = PWError_IO;
+        } else {
+            removeNode(memory, node);
+        }
+    }
+    endOperation(memory, 0);
+    return error;
+}
+
+static PWError memoryRemoveFile(PWStorage *storage, const char *path) {
+    return memoryRemove(storage, path, PWStorageItem_File, PWStorageOperation_RemoveFile);
+}
+
+static PWError memoryRemoveDirectory(PWStorage *storage, const char *path) {
+    return memoryRemove(storage, path, PWStorageItem_Directory, PWStorageOperation_RemoveDirectory);
+}
+
+static PWError memoryListDirectory(PWStorage *storage, const char *path, PWStorageVisitor visitor, void *context) {
+    MemoryStorage *memory = (MemoryStorage *)storage;
+    char normalised[PATH_MAX];
+    if (!normalisePath(path, normalised)) {
+        return PWError_InvalidParameter;
+    }
+        // Copy the names, so the visitor can change the directory and use the storage without holding the lock.
+    pthread_mutex_lock(&memory->lock);
+    PWError error = beginOperation(memory, PWStorageOperation_ListDirectory);
+    Node *directory = error == PWError_None ? findNode(memory, normalised) : NULL;
+    size_t count = 0, namesLength = 0;
+    char *names = NULL;
+    PWStorageItemKind *kinds = NULL;
+    if (error == PWError_None && (!directory || directory->kind != PWStorageItem_Directory)) {
+        error = PWError_IO;
+    } else if (error == PWError_None) {
+        for (Node *child = directory->firstChild; child; child = child->nextSibling) {
+            count++;
+            namesLength += strlen(child->name) + 1;
+        }
+        names = malloc(namesLength ? namesLength : 1);
+        kinds = malloc((count ? count : 1) * sizeof(PWStorageItemKind));
+        if (!names || !kinds) {
+            error = PWError_OutOfMemory;
+        } else {
+            char *name = names;
+            size_t index = 0;
+            for (Node *child = directory->firstChild; child; child = child->nextSibling) {
+                size_t length = strlen(child->name) + 1;
+                memcpy(name, child->name, length);
+                name += length;
+                kinds[index++] = child->kind;
+            }
+        }
+    }
+    endOperation(memory, 0);
+    const char *name = names;
+    for (size_t i = 0; error == PWError_None && i < count; i++, name += strlen(name) + 1) {
+        if (!visitor(name, kinds[i], context)) {
+            break;
+        }
+    }
+    free(names);
+    free(kinds);
+    return error;
+}
+
+    /// Give NODE and everything under it the paths they would have if NODE's path were changed to NEWPATH.
+static PWError renameSubtree(MemoryStorage *memory, Node *node, const char *newPath) {
+    char *path = strdup(newPath);
+    if (!path) {
+        return PWError_OutOfMemory;
+    }
+    Node **link = &memory->buckets[hashPath(node->path) & (memory->bucketCount - 1)];
+    while (*link != node) {
+        link = &(*link)->hashNext;
+    }
+    *link = node->hashNext;
+    free(node->path);
+    node->path = path;
+    node->name = strrchr(path, '/') + 1;
+    size_t bucket = hashPath(path) & (memory->bucketCount - 1);
+    node->hashNext = memory->buckets[bucket];
+    memory->buckets[bucket] = node;
+    PWError error = PWError_None;
+    char childPath[PATH_MAX];
+    for (Node *child = node->firstChild; child && error == PWError_None; child = child->nextSibling) {
+        int length = snprintf(childPath, sizeof(childPath), "%s/%s", path, child->name);
+        error = length > 0 && length < (int)sizeof(childPath) ? renameSubtree(memory, child, childPath) : PWError_InvalidParameter;
+    }
+    return error;
+}
+
+static PWError memoryMoveItem(PWStorage *storage, const char *fromPath, const char *toPath) {
+    MemoryStorage *memory = (MemoryStorage *)storage;
+    char from[PATH_MAX], to[PATH_MAX];
+    if (!normalisePath(fromPath, from) || !normalisePath(toPath, to)) {
+        return PWError_InvalidParameter;
+    }
+    pthread_mutex_lock(&memory->lock);
+    PWError error = beginOperation(memory, PWStorageOperation_MoveItem);
+    if (error == PWError_None) {
+        Node *node = findNode(memory, from), *parent = findParent(memory, to);
+        size_t fromLength = strlen(from);
+            // Nothing may be moved into itself.
+        bool intoItself = strncmp(to, from, fromLength) == 0 && (to[fromLength] == '/' || to[fromLength] == '\0');
+        if (!node || node == &memory->root || !parent || findNode(memory, to) || intoItself) {
+            error = PWError_IO;
+        } else {
+            if (node->previousSibling) {
+                node->previousSibling->nextSibling = node->nextSibling;
+            } else {
+                node->parent->firstChild = node->nextSibling;
+            }
+            if (node->nextSibling) {
+                node->nextSibling->previousSibling = node->previousSibling;
+            }
+            node->parent = parent;
+            node->previousSibling = NULL;
+            node->nextSibling = parent->firstChild;
+            if (parent->firstChild) {
+                parent->firstChild->previousSibling = node;
+            }
+            parent->firstChild = node;
+            error = renameSubtree(memory, node, to);
+        }
+    }
+    endOperation(memory, 0);
+    return error;
+}
+
+static void memoryDestroy(PWStorage *storage) {
+    MemoryStorage *memory = (MemoryStorage *)storage;
+    for (size_t i = 0; i < memory->bucketCount; i++) {
+        for (Node *node = memory->buckets[i], *next; node; node = next) {
+            next = node->hashNext;
+            free(node->bytes);
+            free(node->path);
+            free(node);
+        }
+    }
+    free(memory->buckets);
+    pthread_mutex_destroy(&memory->lock);
+    free(memory);
+}
+
+static const PWStorageOperations MemoryOperations = {
+    memoryGetInfo, memoryReadFile, memoryWriteFile, memoryAppendFile, memoryMakeDirectory, memoryRemoveFile, memoryRemoveDirectory,
+    memoryListDirectory, memoryMoveItem, memoryDestroy
+};
+
+// MARK: - Public interface
+
+PWStorage *PWMemoryStorageCreate(void) {
+    MemoryStorage *memory = calloc(1, sizeof(MemoryStorage));
+    if (!memory) {
+        return NULL;
+    }
+    memory->buckets = calloc(InitialBucketCount, sizeof(Node *));
+    if (!memory->buckets || pthread_mutex_init(&memory->lock, NULL) != 0) {
+        free(memory->buckets);
+        free(memory);
+        return NULL;
+    }
+    memory->storage.operations = &MemoryOperations;
+    memory->bucketCount = InitialBucketCount;
+    memory->root.path = "";
+    memory->root.name = "";
+    memory->root.kind = PWStorageItem_Directory;
+    memory->root.modified = time(NULL);
+    return &memory->storage;
+}
+
+bool PWMemoryStorageIsMemoryStorage(const PWStorage *storage) {
+    return storage && storage->operations == &MemoryOperations;
+}
+
+void PWMemoryStorageSetLatency(PWStorage *storage, uint64_t nanosecondsPerOperation, uint64_t nanosecondsPerMegabyte) {
+    if (!PWMemoryStorageIsMemoryStorage(storage)) {
+        return;
+    }
+    MemoryStorage *memory = (MemoryStorage *)storage;
+    pthread_mutex_lock(&memory->lock);
+    memory->nanosecondsPerOperation = nanosecondsPerOperation;
+    memory->nanosecondsPerMegabyte = nanosecondsPerMegabyte;
+    pthread_mutex_unlock(&memory->lock);
+}
+
+void PWMemoryStorageSetFault(PWStorage *storage, const PWMemoryStorageFault *fault) {
+    if (!PWMemoryStorageIsMemoryStorage(storage)) {
+        return;
+    }
+    MemoryStorage *memory = (MemoryStorage *)storage;
+    pthread_mutex_lock(&memory->lock);
+    memory->hasFault = fault != NULL;
+    if (fault) {
+        memory->fault = *fault;
+        memory->faultCountdown = fault->after;
+    }
+    pthread_mutex_unlock(&memory->lock);
+}
+
+void PWMemoryStorageGetStatistics(PWStorage *storage, PWMemoryStorageStatistics *statistics) {
+    if (!PWMemoryStorageIsMemoryStorage(storage)) {
+        *statistics = (PWMemoryStorageStatistics) { .files = 0 };
+        return;
+    }
+    MemoryStorage *memory = (MemoryStorage *)storage;
+    pthread_mutex_lock(&memory->lock);
+    *statistics = memory->statistics;
+    pthread_mutex_unlock(&memory->lock);
+}
@@ -0,0 +1,93 @@
+/*!
+ @header PWMemoryStorage
+ @abstract A storage which keeps its files in memory, with optional latency and injected failures.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ Set one with PWStorageSetDefault() and the photo store's files are kept in memory instead of on disk, so tests and
+ library-scale benchmarks don't pay for the file system, and don't depend on how busy the disk is. Latency can be
+ added to every operation to stand in for a slow device, and a fault can be set to fail a chosen operation, or every
+ operation from then on, to check what is left behind when an app is killed part way through saving.
+
+ Paths start from an empty root directory "/". Directories have to be made before files are written in them, as on a
+ real file system.
+ */
+
+#ifndef PWMemoryStorage_h
+#define PWMemoryStorage_h
+
+#include "PWStorage.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! The kinds of operation, as bits for PWMemoryStorageFault.operations. */
+enum {
+    PWStorageOperation_GetInfo         = 1 << 0,
+    PWStorageOperation_ReadFile        = 1 << 1,
+    PWStorageOperation_WriteFile       = 1 << 2,
+    PWStorageOperation_MakeDirectory   = 1 << 3,
+    PWStorageOperation_RemoveFile      = 1 << 4,
+    PWStorageOperation_RemoveDirectory = 1 << 5,
+    PWStorageOperation_ListDirectory   = 1 << 6,
+    PWStorageOperation_MoveItem        = 1 << 7,
+    PWStorageOperation_AppendFile      = 1 << 8,
+
+        /*! Every operation which changes what is stored. */
+    PWStorageOperation_Changes = PWStorageOperation_WriteFile | PWStorageOperation_MakeDirectory
+                               | PWStorageOperation_RemoveFile | PWStorageOperation_RemoveDirectory
+                               | PWStorageOperation_MoveItem | PWStorageOperation_AppendFile,
+    PWStorageOperation_All = 0x1FF
+};
+
+/*! Number of kinds of operation, and of counters in PWMemoryStorageStatistics.operations. */
+enum { PWStorageOperationCount = 9 };
+
+/*! An injected failure. See PWMemoryStorageSetFault(). */
+typedef struct PWMemoryStorageFault {
+        /*! The PWStorageOperation bits of the operations which may fail. */
+    unsigned operations;
+        /*! How many of those operations succeed before the first one fails. */
+    uint64_t after;
+        /*! What the failing operations return. */
+    PWError error;
+        /*! If true, every later matching operation fails as well, as if the app had stopped there. Otherwise only one does. */
+    bool persistent;
+        /*! If true, a failing write or append which isn't atomic leaves the first half of its data in the file, as a crash might. */
+    bool tearWrites;
+} PWMemoryStorageFault;
+
+/*! What a memory storage has done and holds. */
+typedef struct PWMemoryStorageStatistics {
+        /*! Calls of each kind of operation, indexed by the bit number of its PWStorageOperation. */
+    uint64_t operations[PWStorageOperationCount];
+        /*! Bytes read and written, and operations failed by the fault. */
+    uint64_t bytesRead, bytesWritten, faults;
+        /*! Files and directories stored, not counting the root, and the bytes in the files. */
+    size_t files, directories, bytesStored;
+} PWMemoryStorageStatistics;
+
+/*! Create an empty storage. Free it with PWStorageRelease() once it is no longer the default. */
+PWStorage *PWMemoryStorageCreate(void);
+
+/*!
+ * Delay every operation on STORAGE by NANOSECONDSPEROPERATION, plus NANOSECONDSPERMEGABYTE for each megabyte read or
+ * written. The delay is outside the storage's lock, so operations from several threads overlap as they do on a device.
+ */
+void PWMemoryStorageSetLatency(PWStorage *storage, uint64_t nanosecondsPerOperation, uint64_t nanosecondsPerMegabyte);
+
+/*! Make operations on STORAGE fail as FAULT says, counting from now. NULL removes the fault. */
+void PWMemoryStorageSetFault(PWStorage *storage, const PWMemoryStorageFault *fault);
+
+/*! Copy STORAGE's counters into STATISTICS. */
+void PWMemoryStorageGetStatistics(PWStorage *storage, PWMemoryStorageStatistics *statistics);
+
+/*! True if STORAGE was made by PWMemoryStorageCreate(). The functions above ignore any other storage. */
+bool PWMemoryStorageIsMemoryStorage(const PWStorage *storage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWMemoryStorage_h */
@@ -0,0 +1,199 @@
+//
+//  PWOrientation.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWOrientation.h"
+
+#include <stddef.h>
+#include <string.h>
+
+    /// Side of the square blocks the transposing orientations are copied in. 32 rows of 32 RGBA pixels is 4KB read
+    /// and 4KB written, so a block's source and destination cache lines all fit in L1 together. One-byte pixels
+    /// use blocks twice the size, as 32 of them fill only half a cache line. Both must be multiples of 8.
+enum { BlockSize = 32, ByteBlockSize = 64 };
+
+bool PWOrientationSwapsAxes(PWOrientation orientation) {
+    return orientation >= PWOrientation_LeftMirrored && orientation <= PWOrientation_Left;
+}
+
+/*!
+ * Where source pixel (x, y) goes in the destination: ORIGIN + x * STEPX + y * STEPY.
+ *
+ * Every orientation is a combination of swapping the axes and running one or both of them backwards, so
+ * working out the byte offsets once up front lets a single loop handle all eight.
+ */
+typedef struct Placement {
+    uint8_t *origin;
+    ptrdiff_t stepX, stepY;
+} Placement;
+
+static Placement placementFor(PWOrientation orientation, uint8_t *destination, size_t destinationBytesPerRow,
+                              size_t width, size_t height, size_t bytesPerPixel) {
+    ptrdiff_t pixel = (ptrdiff_t)bytesPerPixel, row = (ptrdiff_t)destinationBytesPerRow;
+    ptrdiff_t lastColumn = (ptrdiff_t)width - 1, lastRow = (ptrdiff_t)height - 1;
+    switch (orientation) {
+        case PWOrientation_UpMirrored:    return (Placement){ destination + lastColumn * pixel                , -pixel,  row   };
+        case PWOrientation_Down:          return (Placement){ destination + lastRow * row + lastColumn * pixel, -pixel, -row   };
+        case PWOrientation_DownMirrored:  return (Placement){ destination + lastRow * row                      ,  pixel, -row   };
+        case PWOrientation_LeftMirrored:  return (Placement){ destination                                     ,  row  ,  pixel };
+        case PWOrientation_Right:         return (Placement){ destination + lastRow * pixel                   ,  row  , -pixel };
+        case PWOrientation_RightMirrored: return (Placement){ destination + lastColumn * row + lastRow * pixel, -row  , -pixel };
+        case PWOrientation_Left:          return (Placement){ destination + lastColumn * row                  , -row  ,  pixel };
+        default:                          return (Placement){ destination                                     ,  pixel,  row   };
+    }
+}
+
+// MARK: - Kernels
+
+    // BYTESPERPIXEL is always a constant at the call sites below, so each copy compiles to a single load and store.
+    // The placement is passed by value: stores through a uint8_t pointer may alias anything, so reading it through a
+    // pointer would reload it after every pixel.
+
+    /// Orientations which keep the axes: each source row becomes one destination row, possibly reversed.
+static inline void copyRows(Placement placement, const uint8_t *source, size_t sourceBytesPerRow,
+                            size_t width, size_t height, size_t bytesPerPixel) {
+    for (size_t y = 0; y < height; y++) {
+        const uint8_t *input = source + y * sourceBytesPerRow;
+        uint8_t *output = placement.origin + (ptrdiff_t)y * placement.stepY;
+        if (placement.stepX > 0) {
+            memcpy(output, input, width * bytesPerPixel);
+        } else {
+            for (size_t x = 0; x < width; x++, input += bytesPerPixel, output -= bytesPerPixel) {
+                memcpy(output, input, bytesPerPixel);
+            }
+        }
+    }
+}
+
+    /// Copy the source pixels from columns X0 to X1 and rows Y0 to Y1 (exclusive) one at a time.
+static inline void copyPixels(Placement placement, const uint8_t *source, size_t sourceBytesPerRow,
+                              size_t x0, size_t y0, size_t x1, size_t y1, size_t bytesPerPixel) {
+    for (size_t y = y0; y < y1; y++) {
+        const uint8_t *input = source + y * sourceBytesPerRow + x0 * bytesPerPixel;
+        uint8_t *output = placement.origin + (ptrdiff_t)x0 * placement.stepX + (ptrdiff_t)y * placement.stepY;
+        for (size_t x = x0; x < x1; x++, input += bytesPerPixel, output += placement.stepX) {
+            memcpy(output, input, bytesPerPixel);
+        }
+    }
+}
+
+    /// Orientations which swap the axes: source rows become destination columns, so copy a block at a time to keep both in cache.
+static inline void copyBlocks(Placement placement, const uint8_t *source, size_t sourceBytesPerRow,
+                              size_t width, size_t height, size_t bytesPerPixel) {
+    for (size_t blockY = 0; blockY < height; blockY += BlockSize) {
+        size_t endY = blockY + BlockSize < height ? blockY + BlockSize : height;
+        for (size_t blockX = 0; blockX < width; blockX += BlockSize) {
+            size_t endX = blockX + BlockSize < width ? blockX + BlockSize : width;
+            copyPixels(placement, source, sourceBytesPerRow, blockX, blockY, endX, endY, bytesPerPixel);
+        }
+    }
+}
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+    /// Swap the off-diagonal halves of the sub-blocks of A and B, each SHIFT bits wide, selected by MASK.
+static inline void swapBits(uint64_t *a, uint64_t *b, unsigned shift, uint64_t mask) {
+    uint64_t swap = ((*a >> shift) ^ *b) & mask;
+    *b ^= swap;
+    *a ^= swap << shift;
+}
+
+    /// Transpose an 8x8 block of bytes held as 8 rows of 8, so that R[j] ends up holding what was column j.
+    /// Swapping the off-diagonal halves of each 2x2, then 4x4, then the whole 8x8 block does it in 12 steps.
+static inline void transposeBytes8x8(uint64_t r[8]) {
+    const uint64_t bytes = 0x00FF00FF00FF00FFull, pairs = 0x0000FFFF0000FFFFull, quads = 0x00000000FFFFFFFFull;
+    swapBits(&r[0], &r[1],  8, bytes); swapBits(&r[2], &r[3],  8, bytes);
+    swapBits(&r[4], &r[5],  8, bytes); swapBits(&r[6], &r[7],  8, bytes);
+    swapBits(&r[0], &r[2], 16, pairs); swapBits(&r[1], &r[3], 16, pairs);
+    swapBits(&r[4], &r[6], 16, pairs); swapBits(&r[5], &r[7], 16, pairs);
+    swapBits(&r[0], &r[4], 32, quads); swapBits(&r[1], &r[5], 32, quads);
+    swapBits(&r[2], &r[6], 32, quads); swapBits(&r[3], &r[7], 32, quads);
+}
+
+    /// copyBlocks() for one-byte pixels. A byte at a time is slow, so whole 8x8 tiles are transposed in registers:
+    /// eight 8-byte loads and eight 8-byte stores instead of 64 of each.
+static void copyByteBlocks(Placement placement, const uint8_t *source, size_t sourceBytesPerRow,
+                           size_t width, size_t height) {
+        // Source pixel (x, y..y+7) ends up in eight adjacent destination bytes, backwards if stepY is negative.
+    bool reversed = placement.stepY < 0;
+    for (size_t blockY = 0; blockY < height; blockY += ByteBlockSize) {
+        size_t endY = blockY + ByteBlockSize < height ? blockY + ByteBlockSize : height;
+        for (size_t blockX = 0; blockX < width; blockX += ByteBlockSize) {
+            size_t endX = blockX + ByteBlockSize < width ? blockX + ByteBlockSize : width;
+            size_t tileEndX = blockX + ((endX - blockX) & ~(size_t)7), tileEndY = blockY + ((endY - blockY) & ~(size_t)7);
+            for (size_t y = blockY; y < tileEndY; y += 8) {
+                for (size_t x = blockX; x < tileEndX; x += 8) {
+                    uint64_t rows[8];
+                    for (unsigned i = 0; i < 8; i++) {
+                        memcpy(&rows[i], source + (y + i) * sourceBytesPerRow + x, 8);
+                    }
+                    transposeBytes8x8(rows);
+                    uint8_t *output = placement.origin + (ptrdiff_t)x * placement.stepX
+                                    + (ptrdiff_t)(reversed ? y + 7 : y) * placement.stepY;
+                    for (unsigned j = 0; j < 8; j++, output += placement.stepX) {
+                        uint64_t row = reversed ? __builtin_bswap64(rows[j]) : rows[j];
+                        memcpy(output, &row, 8);
+                    }
+                }
+            }
+                // The right and bottom edges of the block, if it isn't a multiple of 8.
+            copyPixels(placement, source, sourceBytesPerRow, tileEndX, blockY, endX, endY, 1);
+            copyPixels(placement, source, sourceBytesPerRow, blockX, tileEndY, tileEndX, endY, 1);
+        }
+    }
+}
+
+#else
+
+static void copyByteBlocks(Placement placement, const uint8_t *source, size_t sourceBytesPerRow,
+                           size_t width, size_t height) {
+    copyBlocks(placement, source, sourceBytesPerRow, width, height, 1);
+}
+
+#endif
+
+static void orientPlane(PWOrientation orientation, uint8_t *destination, size_t destinationBytesPerRow,
+                        const uint8_t *source, size_t sourceBytesPerRow, size_t width, size_t height, size_t bytesPerPixel) {
+    Placement placement = placementFor(orientation, destination, destinationBytesPerRow, width, height, bytesPerPixel);
+    if (!PWOrientationSwapsAxes(orientation)) {
+        switch (bytesPerPixel) {
+            case 1:  copyRows(placement, source, sourceBytesPerRow, width, height, 1); break;
+            case 3:  copyRows(placement, source, sourceBytesPerRow, width, height, 3); break;
+            default: copyRows(placement, source, sourceBytesPerRow, width, height, 4); break;
+        }
+    } else {
+        switch (bytesPerPixel) {
+            case 1:  copyByteBlocks(placement, source, sourceBytesPerRow, width, height); break;
+            case 3:  copyBlocks(placement, source, sourceBytesPerRow, width, height, 3); break;
+            default: copyBlocks(placement, source, sourceBytesPerRow, width, height, 4); break;
+        }
+    }
+}
+
+// MARK: - Public functions
+
+PWImageBuffer *PWImageBufferCreateOriented(const PWImageBuffer *source, PWOrientation orientation) {
+    if (!source || orientation < PWOrientation_Up || orientation > PWOrientation_Left) {
+        return NULL;
+    }
+    bool swap = PWOrientationSwapsAxes(orientation);
+    PWImageBuffer *oriented = PWImageBufferCreate(swap ? source->height : source->width,
+                                                  swap ? source->width : source->height, source->format);
+    if (!oriented) {
+        return NULL;
+    }
+    orientPlane(orientation, oriented->data, oriented->bytesPerRow, source->data, source->bytesPerRow,
+                source->width, source->height, PWPixelFormatBytesPerPixel(source->format));
+    if (PWPixelFormatIsPlanar(source->format)) {
+        size_t chromaWidth = (source->width + 1) / 2, chromaHeight = (source->height + 1) / 2;
+        for (int plane = 0; plane < 2; plane++) {
+            orientPlane(orientation, oriented->chroma[plane], oriented->chromaBytesPerRow,
+                        source->chroma[plane], source->chromaBytesPerRow, chromaWidth, chromaHeight, 1);
+        }
+    }
+    return oriented;
+}
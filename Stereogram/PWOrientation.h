@@ -0,0 +1,64 @@
+/*!
+ @header PWOrientation
+ @abstract Rotates and mirrors image buffers to undo an EXIF orientation, as a straight copy of the pixels.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ Cameras store photos the way the sensor was held and record the rotation needed to show them upright in the EXIF
+ orientation tag. UIKit applies it by redrawing the image through a CGAffineTransform, which resamples every pixel.
+ None of the eight orientations needs any resampling: each output pixel is exactly one input pixel, so this code
+ just copies them, working in small square blocks so that both the rows being read and the rows being written stay in the L1 cache.
+ */
+
+#ifndef PWOrientation_h
+#define PWOrientation_h
+
+#include "PWImageBuffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * @enum
+ * @brief The EXIF orientations, with the same values as the EXIF tag. The names give the equivalent UIImageOrientation.
+ * @constant PWOrientation_Up            1: Already upright.
+ * @constant PWOrientation_UpMirrored    2: Mirrored left to right.
+ * @constant PWOrientation_Down          3: Rotated 180 degrees.
+ * @constant PWOrientation_DownMirrored  4: Mirrored top to bottom.
+ * @constant PWOrientation_LeftMirrored  5: Mirrored along the top-left to bottom-right diagonal (transposed).
+ * @constant PWOrientation_Right         6: Must be rotated 90 degrees clockwise to display. Usual for photos taken in portrait.
+ * @constant PWOrientation_RightMirrored 7: Mirrored along the top-right to bottom-left diagonal.
+ * @constant PWOrientation_Left          8: Must be rotated 90 degrees anticlockwise to display.
+ */
+typedef enum PWOrientation {
+    PWOrientation_Up = 1,
+    PWOrientation_UpMirrored,
+    PWOrientation_Down,
+    PWOrientation_DownMirrored,
+    PWOrientation_LeftMirrored,
+    PWOrientation_Right,
+    PWOrientation_RightMirrored,
+    PWOrientation_Left
+} PWOrientation;
+
+/*! True if ORIENTATION swaps the width and height of the image. */
+bool PWOrientationSwapsAxes(PWOrientation orientation);
+
+/*!
+ * Make an upright copy of SOURCE, which was stored with the given ORIENTATION.
+ *
+ * Works for every pixel format. Planar images are turned a plane at a time; if a YCbCr420 image has an odd width
+ * or height, mirroring it moves the chroma by up to one pixel against the luma, which is not visible in a photo.
+ *
+ * @param source      The pixels as stored.
+ * @param orientation The EXIF orientation of SOURCE. PWOrientation_Up gives a plain copy.
+ * @return A new buffer with the width and height swapped if PWOrientationSwapsAxes(), or NULL on failure.
+ */
+PWImageBuffer *PWImageBufferCreateOriented(const PWImageBuffer *source, PWOrientation orientation);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWOrientation_h */
@@ -0,0 +1,85 @@
+//
+//  PWParallel.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWParallel.h"
+
+#include <stdbool.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <dispatch/dispatch.h>
+#include <pthread/qos.h>
+#else
+#include <pthread.h>
+#endif
+
+    /// Set by PWParallelSetThreadCount(). 0 means one thread per core.
+static unsigned threadLimit = 0;
+
+unsigned PWParallelThreadCount(void) {
+    unsigned limit = __atomic_load_n(&threadLimit, __ATOMIC_RELAXED);
+    if (limit > 0) {
+        return limit;
+    }
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 1 ? (unsigned)cores : 1;
+}
+
+void PWParallelSetThreadCount(unsigned threadCount) {
+    __atomic_store_n(&threadLimit, threadCount, __ATOMIC_RELAXED);
+}
+
+#ifndef __APPLE__
+
+    /// Shared by all the threads running one PWParallelFor() call. Each takes the next unclaimed index until none are left.
+typedef struct ParallelJob {
+    size_t count, next;
+    void *context;
+    PWParallelFunction function;
+} ParallelJob;
+
+static void *runJob(void *argument) {
+    ParallelJob *job = argument;
+    for (size_t index; (index = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->count; ) {
+        job->function(job->context, index);
+    }
+    return NULL;
+}
+
+#endif
+
+void PWParallelFor(size_t count, void *context, PWParallelFunction function) {
+    unsigned threadCount = PWParallelThreadCount();
+    if (count <= 1 || threadCount <= 1) {
+        for (size_t index = 0; index < count; index++) {
+            function(context, index);
+        }
+        return;
+    }
+#ifdef __APPLE__
+        // Run at the caller's QoS, so work started from a background queue doesn't compete with the UI at a higher one.
+        // (DISPATCH_APPLY_AUTO does the same, but needs iOS 11.)
+    dispatch_apply_f(count, dispatch_get_global_queue(qos_class_self(), 0), context, function);
+#else
+    ParallelJob job = { count, 0, context, function };
+    enum { MaxThreads = 64 };
+    pthread_t threads[MaxThreads];
+    size_t helpers = (count < threadCount ? count : threadCount) - 1, started = 0;
+    if (helpers > MaxThreads) {
+        helpers = MaxThreads;
+    }
+        // If a thread can't be started, the ones that did (and this one) just do more of the work.
+    while (started < helpers && pthread_create(&threads[started], NULL, runJob, &job) == 0) {
+        started++;
+    }
+    runJob(&job);
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+#endif
+}
@@ -0,0 +1,47 @@
+/*!
+ @header PWParallel
+ @abstract Runs independent pieces of image work on all the CPU cores.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ On Apple platforms this is a thin wrapper around dispatch_apply_f(), so it shares GCD's thread pool with the
+ rest of the app and the work runs at the QoS of the thread that started it. Elsewhere (the Linux benchmark harness)
+ it uses POSIX threads.
+ */
+
+#ifndef PWParallel_h
+#define PWParallel_h
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Does one piece of work. INDEX runs from 0 to one less than the count passed to PWParallelFor(). */
+typedef void (*PWParallelFunction)(void *context, size_t index);
+
+/*!
+ * Call FUNCTION once for each index from 0 to COUNT - 1, spread over several threads, and wait for them all to finish.
+ *
+ * The calls may run in any order and at the same time, so each must only write to memory no other index touches.
+ * Nothing is done in parallel if PWParallelThreadCount() is 1 or COUNT is 1.
+ */
+void PWParallelFor(size_t count, void *context, PWParallelFunction function);
+
+/*! The number of threads PWParallelFor() will use at most. Defaults to the number of CPU cores online. */
+unsigned PWParallelThreadCount(void);
+
+/*!
+ * Limit the number of threads PWParallelFor() uses. Pass 0 to go back to one per core.
+ *
+ * The image kernels give the same result whatever this is set to; it exists so tests can check that and benchmarks can
+ * measure the scaling. Don't change it while work is in progress.
+ */
+void PWParallelSetThreadCount(unsigned threadCount);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWParallel_h */
@@ -0,0 +1,327 @@
+//
+//  PWPerceptualHash.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWPerceptualHash.h"
+#include "PWParallel.h"
+#include "PWResample.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+    /// The photo is shrunk to this many pixels square before the DCT.
+enum { HashImageSize = 32 };
+
+    /// The hash has one bit for each of this many frequencies squared.
+enum { HashFrequencies = 8 };
+
+    /// Hashes are compared this many at a time, with the distances kept in a small array so the comparisons vectorise.
+enum { BlockLength = 256 };
+
+    /// For grouping, the hashes are indexed by each of this many chunks. See PWPerceptualHash.h.
+enum { ChunkCount = 6 };
+
+// MARK: - Hashing
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+PWError PWPerceptualHashCompute(const PWImageBuffer *image, uint64_t *hash) {
+    if (!image || !hash || image->width == 0 || image->height == 0) {
+        return PWError_InvalidParameter;
+    }
+    PWImageBuffer *small = PWResampleCreate(image, HashImageSize, HashImageSize, PWResampleFilter_Area);
+    if (!small) {
+        return PWError_OutOfMemory;
+    }
+    double luminance[HashImageSize][HashImageSize];
+    uint8_t row[HashImageSize * 4];
+    for (size_t y = 0; y < HashImageSize; y++) {
+        PWImageBufferConvertRowToRGBX(small, y, 0, HashImageSize, row);
+        for (size_t x = 0; x < HashImageSize; x++) {
+            luminance[y][x] = 0.299 * row[x * 4] + 0.587 * row[x * 4 + 1] + 0.114 * row[x * 4 + 2];
+        }
+    }
+    PWImageBufferRelease(small);
+
+        // Only frequencies 1 to 8 are needed in each direction. As in pHash, frequency 0 is left out, as it mostly
+        // measures the brightness of the whole photo and of whole rows and columns, which exposure changes.
+    double cosines[HashFrequencies][HashImageSize];
+    for (size_t u = 0; u < HashFrequencies; u++) {
+        for (size_t x = 0; x < HashImageSize; x++) {
+            cosines[u][x] = cos(M_PI * (2 * x + 1) * (u + 1) / (2 * HashImageSize));
+        }
+    }
+    double rows[HashImageSize][HashFrequencies];
+    for (size_t y = 0; y < HashImageSize; y++) {
+        for (size_t u = 0; u < HashFrequencies; u++) {
+            double sum = 0.0;
+            for (size_t x = 0; x < HashImageSize; x++) {
+                sum += luminance[y][x] * cosines[u][x];
+            }
+            rows[y][u] = sum;
+        }
+    }
+    double coefficients[HashFrequencies * HashFrequencies], sorted[HashFrequencies * HashFrequencies];
+    for (size_t v = 0; v < HashFrequencies; v++) {
+        for (size_t u = 0; u < HashFrequencies; u++) {
+            double sum = 0.0;
+            for (size_t y = 0; y < HashImageSize; y++) {
+                sum += rows[y][u] * cosines[v][y];
+            }
+            coefficients[v * HashFrequencies + u] = sum;
+        }
+    }
+
+    memcpy(sorted, coefficients, sizeof(sorted));
+    qsort(sorted, HashFrequencies * HashFrequencies, sizeof(double), compareDoubles);
+    double median = (sorted[HashFrequencies * HashFrequencies / 2 - 1] + sorted[HashFrequencies * HashFrequencies / 2]) / 2;
+    uint64_t bits = 0;
+    for (size_t i = 0; i < HashFrequencies * HashFrequencies; i++) {
+        if (coefficients[i] > median) {
+            bits |= 1ull << i;
+        }
+    }
+    *hash = bits;
+    return PWError_None;
+}
+
+// MARK: - Searching
+
+    /// Set DISTANCES[i] to the distance between HASH and HASHES[i] for each of the LENGTH hashes, at most BlockLength.
+static void measureBlock(const uint64_t *hashes, size_t length, uint64_t hash, uint8_t *distances) {
+    for (size_t i = 0; i < length; i++) {
+        distances[i] = (uint8_t)PWPerceptualHashDistance(hash, hashes[i]);
+    }
+}
+
+size_t PWPerceptualHashFind(const uint64_t *hashes, size_t count, uint64_t hash, unsigned maximumDistance,
+                            size_t *matches, size_t capacity) {
+    size_t found = 0;
+    uint8_t distances[BlockLength];
+    for (size_t start = 0; start < count; start += BlockLength) {
+        size_t length = count - start < BlockLength ? count - start : BlockLength;
+        measureBlock(hashes + start, length, hash, distances);
+        for (size_t i = 0; i < length; i++) {
+            if (distances[i] <= maximumDistance) {
+                if (found < capacity) {
+                    matches[found] = start + i;
+                }
+                found++;
+            }
+        }
+    }
+    return found;
+}
+
+// MARK: - Grouping
+
+    /// The groups are kept in union-find forests, where each index points at a lower one in its group and the root is
+    /// the lowest of all.
+static size_t findRoot(size_t *parents, size_t index) {
+    while (parents[index] != index) {
+        parents[index] = parents[parents[index]];
+        index = parents[index];
+    }
+    return index;
+}
+
+static void join(size_t *parents, size_t a, size_t b) {
+    a = findRoot(parents, a);
+    b = findRoot(parents, b);
+    if (a < b) {
+        parents[b] = a;
+    } else if (b < a) {
+        parents[a] = b;
+    }
+}
+
+    /// The hashes sorted by the value of each chunk: those whose chunk C is V are at ENTRIES[C][OFFSETS[C][V]] up to
+    /// ENTRIES[C][OFFSETS[C][V + 1]], in order of index. SORTED[C] holds copies of the hashes in the same order, so
+    /// a bucket's hashes are compared without jumping about the list.
+typedef struct ChunkIndex {
+    uint32_t *offsets[ChunkCount], *entries[ChunkCount];
+    uint64_t *sorted[ChunkCount];
+} ChunkIndex;
+
+    /// Chunk C is bits chunkStart(C) up to chunkStart(C + 1) of a hash, 10 or 11 bits.
+static inline unsigned chunkStart(unsigned chunk) {
+    return chunk * 64 / ChunkCount;
+}
+
+static inline unsigned chunkBits(unsigned chunk) {
+    return chunkStart(chunk + 1) - chunkStart(chunk);
+}
+
+static inline unsigned chunkOf(uint64_t hash, unsigned chunk) {
+    return (unsigned)(hash >> chunkStart(chunk)) & ((1u << chunkBits(chunk)) - 1);
+}
+
+static void freeChunkIndex(ChunkIndex *index) {
+    for (unsigned chunk = 0; chunk < ChunkCount; chunk++) {
+        free(index->offsets[chunk]);
+        free(index->entries[chunk]);
+        free(index->sorted[chunk]);
+    }
+}
+
+static bool makeChunkIndex(ChunkIndex *index, const uint64_t *hashes, size_t count) {
+    memset(index, 0, sizeof(ChunkIndex));
+    for (unsigned chunk = 0; chunk < ChunkCount; chunk++) {
+        size_t values = (size_t)1 << chunkBits(chunk);
+        uint32_t *offsets = index->offsets[chunk] = calloc(values + 1, sizeof(uint32_t));
+        uint32_t *entries = index->entries[chunk] = malloc(count * sizeof(uint32_t));
+        uint64_t *sorted = index->sorted[chunk] = malloc(count * sizeof(uint64_t));
+        if (!offsets || !entries || !sorted) {
+            freeChunkIndex(index);
+            return false;
+        }
+            // A counting sort: count each value, turn the counts into where each value starts, then place the indexes.
+        for (size_t i = 0; i < count; i++) {
+            offsets[chunkOf(hashes[i], chunk) + 1]++;
+        }
+        for (size_t value = 0; value < values; value++) {
+            offsets[value + 1] += offsets[value];
+        }
+        for (size_t i = 0; i < count; i++) {
+            entries[offsets[chunkOf(hashes[i], chunk)]++] = (uint32_t)i;
+        }
+            // Placing the indexes moved each start up to the next value's, so move them back.
+        memmove(offsets + 1, offsets, values * sizeof(uint32_t));
+        offsets[0] = 0;
+        for (size_t k = 0; k < count; k++) {
+            sorted[k] = hashes[entries[k]];
+        }
+    }
+    return true;
+}
+
+    /// The number of values of the widest chunk within RADIUS bits of any one, i.e. how many buckets a search looks in.
+static size_t chunkBallSize(unsigned radius) {
+    unsigned bits = chunkBits(ChunkCount - 1);
+    size_t size = 0, combinations = 1;
+    for (unsigned k = 0; k <= radius && k <= bits; k++) {
+        size += combinations;
+        combinations = combinations * (bits - k) / (k + 1);
+    }
+    return size;
+}
+
+    /// Each band compares every BANDCOUNT'th hash with those after it, so the bands get about the same number of pairs,
+    /// and joins the matches in a forest of its own. The forests are merged once all the bands are done.
+typedef struct GroupJob {
+    const uint64_t *hashes;
+    size_t count, bandCount;
+    unsigned maximumDistance;
+        /// If not NULL, only hashes sharing a bucket with each one are compared, rather than all those after it.
+    const ChunkIndex *index;
+        /// One forest for each band. Left NULL if the band couldn't allocate one.
+    size_t **forests;
+} GroupJob;
+
+    /// Join hash I with the hashes after it whose chunk CHUNK is within RADIUS bits of VALUE, flipping only bits from
+    /// FIRSTBIT up so that each value is looked at once.
+static void searchChunk(const GroupJob *job, size_t *parents, size_t i, unsigned chunk, unsigned value,
+                        unsigned radius, unsigned firstBit) {
+    const uint32_t *entries = job->index->entries[chunk], *offsets = job->index->offsets[chunk];
+    for (uint32_t entry = offsets[value]; entry < offsets[value + 1]; entry++) {
+        size_t j = entries[entry];
+        if (j > i && PWPerceptualHashDistance(job->hashes[i], job->hashes[j]) <= job->maximumDistance) {
+            join(parents, i, j);
+        }
+    }
+    if (radius > 0) {
+        for (unsigned bit = firstBit; bit < chunkBits(chunk); bit++) {
+            searchChunk(job, parents, i, chunk, value ^ (1u << bit), radius - 1, bit + 1);
+        }
+    }
+}
+
+static void groupBand(void *context, size_t band) {
+    GroupJob *job = context;
+    size_t *parents = malloc(job->count * sizeof(size_t));
+    if (!parents) {
+        return;
+    }
+    for (size_t i = 0; i < job->count; i++) {
+        parents[i] = i;
+    }
+    if (job->index) {
+            // Hashes within MAXIMUMDISTANCE of each other differ in at most a sixth of that in one of the chunks.
+        for (size_t i = band; i < job->count; i += job->bandCount) {
+            for (unsigned chunk = 0; chunk < ChunkCount; chunk++) {
+                searchChunk(job, parents, i, chunk, chunkOf(job->hashes[i], chunk), job->maximumDistance / ChunkCount, 0);
+            }
+        }
+        job->forests[band] = parents;
+        return;
+    }
+    uint8_t distances[BlockLength];
+    for (size_t i = band; i < job->count; i += job->bandCount) {
+        for (size_t start = i + 1; start < job->count; start += BlockLength) {
+            size_t length = job->count - start < BlockLength ? job->count - start : BlockLength;
+            measureBlock(job->hashes + start, length, job->hashes[i], distances);
+            for (size_t k = 0; k < length; k++) {
+                if (distances[k] <= job->maximumDistance) {
+                    join(parents, i, start + k);
+                }
+            }
+        }
+    }
+    job->forests[band] = parents;
+}
+
+PWError PWPerceptualHashGroup(const uint64_t *hashes, size_t count, unsigned maximumDistance, size_t *groups) {
+    for (size_t i = 0; i < count; i++) {
+        groups[i] = i;
+    }
+    if (count < 2) {
+        return PWError_None;
+    }
+        // Looking in a bucket costs several times as much as comparing two hashes in a scan, so the index only pays when
+        // each hash looks in far fewer buckets than there are hashes. At large distances every pair is compared instead.
+    ChunkIndex index;
+    bool indexed = count <= UINT32_MAX && ChunkCount * chunkBallSize(maximumDistance / ChunkCount) * 8 < count
+                && makeChunkIndex(&index, hashes, count);
+    size_t bandCount = PWParallelThreadCount();
+    bandCount = bandCount < count ? bandCount : count;
+    GroupJob job = { hashes, count, bandCount, maximumDistance, indexed ? &index : NULL, calloc(bandCount, sizeof(size_t *)) };
+    if (!job.forests) {
+        if (indexed) {
+            freeChunkIndex(&index);
+        }
+        return PWError_OutOfMemory;
+    }
+    PWParallelFor(bandCount, &job, groupBand);
+    if (indexed) {
+        freeChunkIndex(&index);
+    }
+
+    PWError error = PWError_None;
+    for (size_t band = 0; band < bandCount; band++) {
+        size_t *forest = job.forests[band];
+        if (!forest) {
+            error = PWError_OutOfMemory;
+            continue;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (forest[i] != i) {
+                join(groups, i, findRoot(forest, i));
+            }
+        }
+        free(forest);
+    }
+    free(job.forests);
+    for (size_t i = 0; i < count; i++) {
+        groups[i] = findRoot(groups, i);
+    }
+    return error;
+}
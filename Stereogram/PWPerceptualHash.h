@@ -0,0 +1,82 @@
+/*!
+ @header PWPerceptualHash
+ @abstract Perceptual hashes of photos, for finding duplicates and near-duplicates without decoding them.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ A perceptual hash is 64 bits summing up the coarse structure of a photo: whether each of its lowest-frequency DCT
+ coefficients is above or below their median, taken from a 32 x 32 greyscale copy. Resizing, recompressing or slightly
+ re-exposing a photo flips few of the bits, while different scenes differ in about half of them, so the Hamming distance
+ between two hashes says how alike the photos look. The hash is worked out once, when a stereogram is made, and kept in
+ its properties (see PWLibraryProperties), so finding duplicates only compares numbers.
+
+ A single search scans every hash, which the compiler vectorises. Grouping a whole library instead indexes the hashes by
+ each of six chunks of 10 or 11 bits: hashes within D bits of each other differ in at most D / 6 bits of one chunk, so each
+ hash is only compared with the few in the buckets near its own chunks, rather than with every other hash.
+ */
+
+#ifndef PWPerceptualHash_h
+#define PWPerceptualHash_h
+
+#include "PWImageBuffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Hashes this close or closer are almost always of the same scene, e.g. a re-shoot from the same spot. */
+enum { PWPerceptualHashNearDuplicateDistance = 10 };
+
+/*!
+ * Work out the perceptual hash of IMAGE, which may be in any format.
+ * Takes a few milliseconds for a full-size photo, almost all of it shrinking the photo.
+ *
+ * @return PWError_None, PWError_InvalidParameter if IMAGE is empty, or PWError_OutOfMemory.
+ */
+PWError PWPerceptualHashCompute(const PWImageBuffer *image, uint64_t *hash);
+
+/*! The number of bits which differ between A and B, from 0 for the same hash to 64. */
+static inline unsigned PWPerceptualHashDistance(uint64_t a, uint64_t b) {
+#if defined(__POPCNT__) || defined(__ARM_NEON)
+    return (unsigned)__builtin_popcountll(a ^ b);
+#else
+        // Without a population count instruction the builtin is a library call, which stops the loops vectorising.
+    uint64_t bits = a ^ b;
+    bits -= (bits >> 1) & 0x5555555555555555ull;
+    bits = (bits & 0x3333333333333333ull) + ((bits >> 2) & 0x3333333333333333ull);
+    bits = (bits + (bits >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+    return (unsigned)((bits * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+/*!
+ * Find the hashes within MAXIMUMDISTANCE of HASH.
+ *
+ * @param hashes  The hashes to search, e.g. one for each stereogram in the library.
+ * @param matches Receives the indexes in HASHES of the first CAPACITY matches, in order. May be NULL if CAPACITY is 0.
+ * @return The number of matches, which may be more than CAPACITY.
+ */
+size_t PWPerceptualHashFind(const uint64_t *hashes, size_t count, uint64_t hash, unsigned maximumDistance,
+                            size_t *matches, size_t capacity);
+
+/*!
+ * Sort HASHES into groups of near-duplicates, on all the CPU cores.
+ *
+ * Up to a distance of 11 each hash looks in 72 buckets, so the time grows with the number of hashes rather than its
+ * square while the buckets stay small. With few hashes, or at larger distances, every pair is compared instead, as that
+ * is then quicker.
+ *
+ * Two hashes are in the same group if they are within MAXIMUMDISTANCE of each other, or of another hash in the group.
+ * Each group is named by its lowest index, so GROUPS[i] == i for a hash with no duplicates, and the result is the same
+ * whatever the number of threads.
+ *
+ * @param groups Receives COUNT entries: for each hash, the lowest index in its group.
+ * @return PWError_None or PWError_OutOfMemory.
+ */
+PWError PWPerceptualHashGroup(const uint64_t *hashes, size_t count, unsigned maximumDistance, size_t *groups);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWPerceptualHash_h */
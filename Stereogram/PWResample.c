@@ -0,0 +1,392 @@
+//
+//  PWResample.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWResample.h"
+#include "PWParallel.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+    /// Filter weights are in 2.14 fixed point, so a sum of 255 * weight over a few hundred taps fits easily in 32 bits.
+enum { WeightBits = 14, WeightOne = 1 << WeightBits, WeightRound = 1 << (WeightBits - 1) };
+
+    /// Bands of output rows are at least this tall, so the rows shared with the neighbouring bands aren't a large fraction of the work,
+    /// and at most this tall, so the horizontally-scaled rows each band keeps stay small enough to be in cache.
+enum { MinBandRows = 8, MaxBandRows = 64 };
+
+    /// Aim for this many bands per thread, so a thread that finishes early can pick up more work.
+enum { BandsPerThread = 4 };
+
+// MARK: - Filters
+
+    /// How far from its centre each filter reaches, in source pixels, before it is widened for shrinking.
+static double filterSupport(PWResampleFilter filter) {
+    switch (filter) {
+        case PWResampleFilter_Area:     return 0.5;
+        case PWResampleFilter_Bilinear: return 1.0;
+        default:                        return 3.0;
+    }
+}
+
+static double triangle(double x) {
+    x = fabs(x);
+    return x < 1.0 ? 1.0 - x : 0.0;
+}
+
+static double lanczos3(double x) {
+    x = fabs(x);
+    if (x < 1e-8) {
+        return 1.0;
+    }
+    if (x >= 3.0) {
+        return 0.0;
+    }
+    double pix = M_PI * x;
+    return 3.0 * sin(pix) * sin(pix / 3.0) / (pix * pix);
+}
+
+// MARK: - Coefficient tables
+
+/*!
+ * The source pixels and weights used for each output column or row along one axis.
+ *
+ * Output pixel i is the sum of WEIGHTS[i * MAXTAPS + k] * source pixel FIRST[i] + k, for k from 0 to COUNT[i] - 1.
+ */
+typedef struct Contributions {
+    size_t *first, *count;
+    int32_t *weights;
+    size_t maxTaps;
+        /// True if every output pixel is exactly one source pixel, so the pass along this axis can be a copy.
+    bool identity;
+} Contributions;
+
+static void freeContributions(Contributions *contributions) {
+    free(contributions->first);
+    free(contributions->count);
+    free(contributions->weights);
+    memset(contributions, 0, sizeof(Contributions));
+}
+
+    /// Work out the weights for OUTPUTLENGTH pixels covering source pixels START to START + EXTENT of a SOURCELENGTH-pixel axis.
+static bool computeContributions(Contributions *contributions, size_t outputLength, double start, double extent,
+                                 size_t sourceLength, PWResampleFilter filter) {
+    memset(contributions, 0, sizeof(Contributions));
+    double scale = extent / outputLength;
+        // When shrinking, stretch the filter to cover the whole of each output pixel's footprint.
+    double filterScale = scale > 1.0 ? scale : 1.0;
+    double radius = filterSupport(filter) * filterScale;
+    size_t maxTaps = (size_t)ceil(radius * 2.0) + 2;
+    contributions->first   = malloc(sizeof(size_t) * outputLength);
+    contributions->count   = malloc(sizeof(size_t) * outputLength);
+    contributions->weights = calloc(outputLength * maxTaps, sizeof(int32_t));
+    double *exact = malloc(sizeof(double) * maxTaps);
+    if (!contributions->first || !contributions->count || !contributions->weights || !exact) {
+        freeContributions(contributions);
+        free(exact);
+        return false;
+    }
+    contributions->maxTaps = maxTaps;
+    contributions->identity = true;
+
+    for (size_t i = 0; i < outputLength; i++) {
+        double centre = start + (i + 0.5) * scale;
+        double low = floor(centre - radius), high = ceil(centre + radius);
+        size_t left  = low < 0 ? 0 : (size_t)low;
+        size_t right = high > sourceLength ? sourceLength : (size_t)high;
+        if (left >= sourceLength) {
+            left = sourceLength - 1;
+        }
+        if (right <= left) {
+            right = left + 1;
+        }
+        if (right - left > maxTaps) {
+            right = left + maxTaps;
+        }
+
+        double total = 0;
+        for (size_t j = left; j < right; j++) {
+            double weight;
+            if (filter == PWResampleFilter_Area) {
+                    // The exact overlap between source pixel j and the output pixel's footprint.
+                double overlapStart = j > centre - radius ? j : centre - radius;
+                double overlapEnd = j + 1 < centre + radius ? j + 1 : centre + radius;
+                weight = overlapEnd > overlapStart ? overlapEnd - overlapStart : 0;
+            } else {
+                double distance = (j + 0.5 - centre) / filterScale;
+                weight = filter == PWResampleFilter_Bilinear ? triangle(distance) : lanczos3(distance);
+            }
+            exact[j - left] = weight;
+            total += weight;
+        }
+            // Trim taps with no weight from both ends.
+        size_t firstTap = 0, lastTap = right - left;
+        while (firstTap + 1 < lastTap && exact[firstTap] == 0) {
+            firstTap++;
+        }
+        while (lastTap - 1 > firstTap && exact[lastTap - 1] == 0) {
+            lastTap--;
+        }
+        if (total == 0) {
+                // Can only happen if the filter misses every pixel: use the nearest one.
+            exact[firstTap] = total = 1;
+            lastTap = firstTap + 1;
+        }
+
+            // Convert to fixed point, putting any rounding error on the biggest weight so they still add up to exactly 1.
+        int32_t *weights = contributions->weights + i * maxTaps;
+        int32_t sum = 0;
+        size_t biggest = 0;
+        for (size_t k = 0; k < lastTap - firstTap; k++) {
+            weights[k] = (int32_t)lround(exact[firstTap + k] / total * WeightOne);
+            sum += weights[k];
+            if (weights[k] > weights[biggest]) {
+                biggest = k;
+            }
+        }
+        weights[biggest] += WeightOne - sum;
+        contributions->first[i] = left + firstTap;
+        contributions->count[i] = lastTap - firstTap;
+        if (contributions->count[i] != 1 || (i > 0 && contributions->first[i] != contributions->first[i - 1] + 1)) {
+            contributions->identity = false;
+        }
+    }
+    free(exact);
+    return true;
+}
+
+// MARK: - Kernels
+
+static inline uint8_t clampFixed(int32_t value) {
+    return value <= 0 ? 0 : value >= (256 << WeightBits) ? 255 : (uint8_t)(value >> WeightBits);
+}
+
+    /// Scale one row horizontally. CHANNELS is a constant at each call site, so the channel loop is unrolled.
+static inline void resampleRow(const uint8_t *input, uint8_t *output, size_t width, const Contributions *columns, size_t channels) {
+        // Copy the table pointers out first: stores through OUTPUT could alias them, so they would be reloaded every pixel.
+    const size_t *first = columns->first, *counts = columns->count, maxTaps = columns->maxTaps;
+    const int32_t *allWeights = columns->weights;
+    for (size_t x = 0; x < width; x++) {
+        const int32_t *weights = allWeights + x * maxTaps;
+        const uint8_t *pixel = input + first[x] * channels;
+        size_t count = counts[x];
+        int32_t sums[4] = { WeightRound, WeightRound, WeightRound, WeightRound };
+        for (size_t k = 0; k < count; k++, pixel += channels) {
+            for (size_t c = 0; c < channels; c++) {
+                sums[c] += weights[k] * pixel[c];
+            }
+        }
+        for (size_t c = 0; c < channels; c++) {
+            *output++ = clampFixed(sums[c]);
+        }
+    }
+}
+
+static void resampleRowWithChannels(const uint8_t *input, uint8_t *output, size_t width, const Contributions *columns, size_t channels) {
+    switch (channels) {
+        case 1:  resampleRow(input, output, width, columns, 1); break;
+        case 3:  resampleRow(input, output, width, columns, 3); break;
+        default: resampleRow(input, output, width, columns, 4); break;
+    }
+}
+
+    /// Scale a block of rows vertically into OUTPUT. Every step works along a whole row, so the compiler can vectorise it.
+    /// The pointers are marked restrict as otherwise the byte stores could alias SUMS and the loops would stay scalar.
+static void resampleColumn(const uint8_t *const *rows, const int32_t *weights, size_t count,
+                           int32_t *restrict sums, uint8_t *restrict output, size_t rowBytes) {
+    const uint8_t *restrict row = rows[0];
+    int32_t weight = weights[0];
+    for (size_t i = 0; i < rowBytes; i++) {
+        sums[i] = WeightRound + weight * row[i];
+    }
+    for (size_t k = 1; k < count; k++) {
+        const uint8_t *restrict next = rows[k];
+        weight = weights[k];
+        for (size_t i = 0; i < rowBytes; i++) {
+            sums[i] += weight * next[i];
+        }
+    }
+    for (size_t i = 0; i < rowBytes; i++) {
+        output[i] = clampFixed(sums[i]);
+    }
+}
+
+    /// Lanczos overshoot can leave a premultiplied colour brighter than its alpha, which isn't a valid pixel.
+static void clampToAlpha(uint8_t *row, size_t width) {
+    for (size_t x = 0; x < width; x++, row += 4) {
+        uint8_t alpha = row[3];
+        for (int c = 0; c < 3; c++) {
+            if (row[c] > alpha) {
+                row[c] = alpha;
+            }
+        }
+    }
+}
+
+// MARK: - Bands
+
+    /// Everything needed to scale one plane, shared by the threads working on its bands.
+typedef struct PlaneJob {
+    const uint8_t *source;
+    size_t sourceBytesPerRow;
+    uint8_t *destination;
+    size_t destinationBytesPerRow;
+    size_t width, height, channels;
+    Contributions columns, rows;
+    size_t bandHeight;
+    bool premultiplied;
+        /// Called with each output row once it is made, if not NULL.
+    PWResampleRowFunction finishRow;
+    void *finishContext;
+        /// Set if any band failed to allocate its working memory.
+    bool failed;
+} PlaneJob;
+
+static void resampleBand(void *context, size_t band) {
+    PlaneJob *job = context;
+    size_t firstY = band * job->bandHeight;
+    size_t endY = firstY + job->bandHeight < job->height ? firstY + job->bandHeight : job->height;
+    size_t rowBytes = job->width * job->channels;
+
+        // The source rows this band draws on. Each is scaled horizontally once, into SCALED, unless the columns are
+        // just copied, in which case the source rows are used directly.
+    size_t firstRow = job->rows.first[firstY], endRow = firstRow;
+    for (size_t y = firstY; y < endY; y++) {
+        size_t end = job->rows.first[y] + job->rows.count[y];
+        if (end > endRow) {
+            endRow = end;
+        }
+    }
+    bool copyColumns = job->columns.identity;
+    uint8_t *scaled = copyColumns ? NULL : malloc((endRow - firstRow) * rowBytes);
+    int32_t *sums = malloc(rowBytes * sizeof(int32_t));
+    const uint8_t **rows = malloc(job->rows.maxTaps * sizeof(uint8_t *));
+    if ((!copyColumns && !scaled) || !sums || !rows) {
+        __atomic_store_n(&job->failed, true, __ATOMIC_RELAXED);
+        free(scaled);
+        free(sums);
+        free(rows);
+        return;
+    }
+    const uint8_t *scaledRows = scaled;
+    size_t scaledBytesPerRow = rowBytes;
+    if (copyColumns) {
+        scaledRows = job->source + firstRow * job->sourceBytesPerRow + job->columns.first[0] * job->channels;
+        scaledBytesPerRow = job->sourceBytesPerRow;
+    } else {
+        for (size_t row = firstRow; row < endRow; row++) {
+            resampleRowWithChannels(job->source + row * job->sourceBytesPerRow, scaled + (row - firstRow) * rowBytes,
+                                    job->width, &job->columns, job->channels);
+        }
+    }
+
+    for (size_t y = firstY; y < endY; y++) {
+        uint8_t *output = job->destination + y * job->destinationBytesPerRow;
+        size_t count = job->rows.count[y];
+        for (size_t k = 0; k < count; k++) {
+            rows[k] = scaledRows + (job->rows.first[y] + k - firstRow) * scaledBytesPerRow;
+        }
+        if (job->rows.identity) {
+            memcpy(output, rows[0], rowBytes);
+        } else {
+            resampleColumn(rows, job->rows.weights + y * job->rows.maxTaps, count, sums, output, rowBytes);
+            if (job->premultiplied) {
+                clampToAlpha(output, job->width);
+            }
+        }
+        if (job->finishRow) {
+            job->finishRow(job->finishContext, y, output, job->width);
+        }
+    }
+    free(scaled);
+    free(sums);
+    free(rows);
+}
+
+static bool resamplePlane(const uint8_t *source, size_t sourceBytesPerRow, size_t sourceWidth, size_t sourceHeight,
+                          uint8_t *destination, size_t destinationBytesPerRow, size_t width, size_t height,
+                          size_t channels, bool premultiplied, PWResampleRect rect, PWResampleFilter filter,
+                          PWResampleRowFunction finishRow, void *finishContext) {
+    PlaneJob job = {
+        .source = source, .sourceBytesPerRow = sourceBytesPerRow,
+        .destination = destination, .destinationBytesPerRow = destinationBytesPerRow,
+        .width = width, .height = height, .channels = channels, .premultiplied = premultiplied,
+        .finishRow = finishRow, .finishContext = finishContext
+    };
+    if (!computeContributions(&job.columns, width, rect.x, rect.width, sourceWidth, filter)
+        || !computeContributions(&job.rows, height, rect.y, rect.height, sourceHeight, filter)) {
+        freeContributions(&job.columns);
+        freeContributions(&job.rows);
+        return false;
+    }
+    size_t bands = (size_t)PWParallelThreadCount() * BandsPerThread;
+    job.bandHeight = (height + bands - 1) / bands;
+    job.bandHeight = job.bandHeight < MinBandRows ? MinBandRows : job.bandHeight > MaxBandRows ? MaxBandRows : job.bandHeight;
+    PWParallelFor((height + job.bandHeight - 1) / job.bandHeight, &job, resampleBand);
+    freeContributions(&job.columns);
+    freeContributions(&job.rows);
+    return !job.failed;
+}
+
+// MARK: - Public functions
+
+    /// True if RECT lies within SOURCE and the other parameters make sense.
+static bool validParameters(const PWImageBuffer *source, PWResampleRect rect, size_t width, size_t height, PWResampleFilter filter) {
+    return source && width > 0 && height > 0 && (unsigned)filter < PWResampleFilter_NUM_FILTERS
+        && rect.width > 0 && rect.height > 0 && rect.x >= 0 && rect.y >= 0
+        && rect.x + rect.width <= source->width + 1e-6 && rect.y + rect.height <= source->height + 1e-6;
+}
+
+PWImageBuffer *PWResampleCreateFromRect(const PWImageBuffer *source, PWResampleRect rect,
+                                        size_t width, size_t height, PWResampleFilter filter) {
+    if (!validParameters(source, rect, width, height, filter)) {
+        return NULL;
+    }
+    PWImageBuffer *result = PWImageBufferCreate(width, height, source->format);
+    if (!result) {
+        return NULL;
+    }
+    bool ok = resamplePlane(source->data, source->bytesPerRow, source->width, source->height,
+                            result->data, result->bytesPerRow, width, height,
+                            PWPixelFormatBytesPerPixel(source->format), PWPixelFormatHasAlpha(source->format), rect, filter, NULL, NULL);
+    if (ok && PWPixelFormatIsPlanar(source->format)) {
+            // Chroma is at half resolution, so the same area is half the size in chroma samples.
+        PWResampleRect chromaRect = { rect.x / 2, rect.y / 2, rect.width / 2, rect.height / 2 };
+        for (int plane = 0; ok && plane < 2; plane++) {
+            ok = resamplePlane(source->chroma[plane], source->chromaBytesPerRow, (source->width + 1) / 2, (source->height + 1) / 2,
+                               result->chroma[plane], result->chromaBytesPerRow, (width + 1) / 2, (height + 1) / 2,
+                               1, false, chromaRect, filter, NULL, NULL);
+        }
+    }
+    if (!ok) {
+        PWImageBufferRelease(result);
+        return NULL;
+    }
+    return result;
+}
+
+PWImageBuffer *PWResampleCreate(const PWImageBuffer *source, size_t width, size_t height, PWResampleFilter filter) {
+    if (!source) {
+        return NULL;
+    }
+    PWResampleRect all = { 0, 0, source->width, source->height };
+    return PWResampleCreateFromRect(source, all, width, height, filter);
+}
+
+PWError PWResampleIntoBuffer(const PWImageBuffer *source, PWResampleRect rect, PWImageBuffer *destination,
+                             PWResampleFilter filter, PWResampleRowFunction finishRow, void *context) {
+    if (!destination || !validParameters(source, rect, destination->width, destination->height, filter)
+        || destination->format != source->format || PWPixelFormatIsPlanar(source->format)) {
+        return PWError_InvalidParameter;
+    }
+    bool ok = resamplePlane(source->data, source->bytesPerRow, source->width, source->height,
+                            destination->data, destination->bytesPerRow, destination->width, destination->height,
+                            PWPixelFormatBytesPerPixel(source->format), PWPixelFormatHasAlpha(source->format), rect, filter,
+                            finishRow, context);
+    return ok ? PWError_None : PWError_OutOfMemory;
+}
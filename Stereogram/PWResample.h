@@ -0,0 +1,89 @@
+/*!
+ @header PWResample
+ @abstract High-quality image scaling with a choice of filters, spread over all the CPU cores.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ Scaling is done in two passes, first along the rows and then down the columns. For each output column (and row) the
+ source pixels it draws on and their weights are worked out once, in 2.14 fixed point, so the inner loops are nothing
+ but integer multiply-adds that the compiler can vectorise. When shrinking, each filter is widened by the scale
+ factor so that every source pixel contributes and fine detail doesn't alias.
+
+ The output rows are split into bands which are scaled in parallel with PWParallelFor(). Each output pixel is
+ computed the same way whichever band it is in, so the result doesn't depend on the number of threads.
+ */
+
+#ifndef PWResample_h
+#define PWResample_h
+
+#include "PWImageBuffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * @enum
+ * @brief The filters used to weight source pixels.
+ * @constant PWResampleFilter_Area     Each output pixel is the average of the source area it covers. The fastest,
+ *                                     and exact for whole-number reductions such as halving. The same as bilinear when enlarging.
+ * @constant PWResampleFilter_Bilinear A triangle filter. The same as bilinear interpolation when enlarging.
+ * @constant PWResampleFilter_Lanczos3 A windowed sinc with 3 lobes. The sharpest, and the slowest.
+ */
+typedef enum PWResampleFilter {
+    PWResampleFilter_Area,
+    PWResampleFilter_Bilinear,
+    PWResampleFilter_Lanczos3,
+
+    PWResampleFilter_NUM_FILTERS
+} PWResampleFilter;
+
+/*! A rectangle of the source image, in pixels. It need not be on whole pixels. */
+typedef struct PWResampleRect {
+    double x, y, width, height;
+} PWResampleRect;
+
+/*!
+ * Scale the whole of SOURCE to WIDTH x HEIGHT pixels.
+ *
+ * @return A new buffer in the same format as SOURCE, or NULL on failure. All formats are supported; planar
+ *         images are scaled a plane at a time.
+ */
+PWImageBuffer *PWResampleCreate(const PWImageBuffer *source, size_t width, size_t height, PWResampleFilter filter);
+
+/*!
+ * Scale the part of SOURCE inside RECT to WIDTH x HEIGHT pixels.
+ *
+ * Pixels just outside RECT still contribute to the edges of the result, as they would if the whole image had been
+ * scaled and then cropped. RECT must lie within the image.
+ *
+ * @return A new buffer in the same format as SOURCE, or NULL on failure.
+ */
+PWImageBuffer *PWResampleCreateFromRect(const PWImageBuffer *source, PWResampleRect rect,
+                                        size_t width, size_t height, PWResampleFilter filter);
+
+/*!
+ * Called with each row of the result of PWResampleIntoBuffer() as soon as it has been made, while it is still in the
+ * cache. Y is the row's index in the result and ROW points to its WIDTH pixels. Rows of different bands are passed at
+ * the same time on different threads, so it must only change the row it is given, or memory no other row touches.
+ */
+typedef void (*PWResampleRowFunction)(void *context, size_t y, uint8_t *row, size_t width);
+
+/*!
+ * Scale the part of SOURCE inside RECT to fill DESTINATION, and call FINISHROW with each row of it as it is made.
+ *
+ * This lets a caller finish the pixels in the same pass, e.g. masking them, and write straight into part of a larger
+ * image by passing a sub-image as DESTINATION, so nothing is allocated but the working memory of each band.
+ *
+ * @param destination Decides the size of the result. It must be in the same format as SOURCE, and not planar.
+ * @param finishRow   May be NULL.
+ * @return PWError_None, PWError_InvalidParameter if the formats don't match or RECT isn't within SOURCE, or PWError_OutOfMemory.
+ */
+PWError PWResampleIntoBuffer(const PWImageBuffer *source, PWResampleRect rect, PWImageBuffer *destination,
+                             PWResampleFilter filter, PWResampleRowFunction finishRow, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWResample_h */
@@ -0,0 +1,56 @@
+/*!
+ @header PWSHA256
+ @abstract SHA-256 digests, which identify the contents of the files in the change journal and on a sync target.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ A straightforward implementation of FIPS 180-4. It hashes over 100MB a second on one core, so a photo of a megabyte or
+ so takes a few milliseconds, far less than encoding it.
+ */
+
+#ifndef PWSHA256_h
+#define PWSHA256_h
+
+#include "PWImageBuffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! A digest, and its length as hex digits without the terminating zero. */
+typedef struct PWSHA256Digest {
+    uint8_t bytes[32];
+} PWSHA256Digest;
+
+enum { PWSHA256HexLength = 64 };
+
+/*! The state of a digest being worked out a piece at a time. */
+typedef struct PWSHA256Context {
+    uint32_t state[8];
+    uint64_t length;
+    uint8_t block[64];
+    size_t blockLength;
+} PWSHA256Context;
+
+void PWSHA256Init(PWSHA256Context *context);
+
+/*! Add LENGTH bytes to the data being hashed. */
+void PWSHA256Update(PWSHA256Context *context, const void *bytes, size_t length);
+
+/*! Finish the digest and store it in DIGEST. CONTEXT must be initialised again before it is reused. */
+void PWSHA256Final(PWSHA256Context *context, PWSHA256Digest *digest);
+
+/*! The digest of LENGTH bytes at BYTES, in one call. */
+void PWSHA256Compute(const void *bytes, size_t length, PWSHA256Digest *digest);
+
+/*! Write DIGEST as lower-case hex digits, with a terminating zero, to HEX. */
+void PWSHA256Format(const PWSHA256Digest *digest, char hex[PWSHA256HexLength + 1]);
+
+/*! Read a digest from the first PWSHA256HexLength characters of HEX. Returns false if they aren't all hex digits. */
+bool PWSHA256Parse(const char *hex, PWSHA256Digest *digest);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWSHA256_h */
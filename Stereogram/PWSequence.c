@@ -0,0 +1,303 @@
+//
+//  PWSequence.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWSequence.h"
+#include "PWGIFEncoder.h"
+#include "PWLibrary.h"
+#include "PWStereoPair.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+    /// Room for the encoded bytes of one frame before they go to the sink. The buffer grows if a frame needs more.
+enum { OutputCapacity = 256 * 1024 };
+
+void PWSequenceOptionsInit(PWSequenceOptions *options) {
+    options->layout = PWSequenceLayout_SideBySide;
+    options->anaglyphMethod = PWAnaglyph_Optimised;
+    options->frameDelay = 10;
+    options->loopCount = 0;
+    options->lookAhead = 2;
+}
+
+static PWError makeFrame(PWSequenceFrameSource source, void *context, size_t index, const PWSequenceOptions *options,
+                         PWImageBuffer **frame) {
+    PWImageBuffer *left = NULL, *right = NULL;
+    *frame = NULL;
+    PWError error = source(context, index, &left, &right);
+    if (error == PWError_None) {
+        switch (options->layout) {
+            case PWSequenceLayout_SideBySide:
+            case PWSequenceLayout_Swapped:
+                if (left->format != right->format) {
+                    error = PWError_NotSupported;
+                } else if (options->layout == PWSequenceLayout_Swapped) {
+                    *frame = PWImageBufferCreateSideBySide(right, left);
+                } else {
+                    *frame = PWImageBufferCreateSideBySide(left, right);
+                }
+                break;
+            case PWSequenceLayout_Anaglyph:
+                *frame = PWAnaglyphCreate(left, right, options->anaglyphMethod);
+                break;
+            default:
+                error = PWError_InvalidParameter;
+                break;
+        }
+        if (error == PWError_None && !*frame) {
+            error = PWError_OutOfMemory;
+        }
+    }
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+    return error;
+}
+
+// MARK: - Look-ahead queue
+
+    /// Frames made by the producer thread and not yet encoded, in a ring of CAPACITY slots. The frame being encoded keeps
+    /// its slot until it is finished, so CAPACITY is one more than the look-ahead. The producer only starts a frame once
+    /// there is a slot free for it, which is what bounds the memory.
+typedef struct FrameQueue {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    PWImageBuffer **slots;
+    size_t capacity, produced, consumed;
+        /// Set if the producer stopped before the end. No more frames will come.
+    PWError producerError;
+        /// Set if the encoder stopped before the end, so the producer should too.
+    bool cancelled;
+
+    size_t frameCount;
+    PWSequenceFrameSource source;
+    void *sourceContext;
+    const PWSequenceOptions *options;
+} FrameQueue;
+
+static void *produceFrames(void *argument) {
+    FrameQueue *queue = argument;
+    for (size_t index = 0; index < queue->frameCount; index++) {
+        pthread_mutex_lock(&queue->lock);
+        while (queue->produced - queue->consumed == queue->capacity && !queue->cancelled) {
+            pthread_cond_wait(&queue->changed, &queue->lock);
+        }
+        bool cancelled = queue->cancelled;
+        pthread_mutex_unlock(&queue->lock);
+        if (cancelled) {
+            break;
+        }
+
+        PWImageBuffer *frame;
+        PWError error = makeFrame(queue->source, queue->sourceContext, index, queue->options, &frame);
+        pthread_mutex_lock(&queue->lock);
+        if (error == PWError_None) {
+            queue->slots[queue->produced % queue->capacity] = frame;
+            queue->produced++;
+        } else {
+            queue->producerError = error;
+        }
+        pthread_cond_broadcast(&queue->changed);
+        pthread_mutex_unlock(&queue->lock);
+        if (error != PWError_None) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+    /// Wait for the next frame. Returns NULL, with ERROR set, if the producer stopped before making it.
+static PWImageBuffer *waitForFrame(FrameQueue *queue, PWError *error) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->produced == queue->consumed && queue->producerError == PWError_None) {
+        pthread_cond_wait(&queue->changed, &queue->lock);
+    }
+    PWImageBuffer *frame = queue->produced > queue->consumed ? queue->slots[queue->consumed % queue->capacity] : NULL;
+    if (!frame) {
+        *error = queue->producerError;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return frame;
+}
+
+    /// Release the frame returned by waitForFrame() and free its slot for the producer.
+static void finishFrame(FrameQueue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    size_t slot = queue->consumed % queue->capacity;
+    PWImageBufferRelease(queue->slots[slot]);
+    queue->slots[slot] = NULL;
+    queue->consumed++;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+    /// Stop the producer, wait for it and free any frames it made which weren't used.
+static void stopProducer(FrameQueue *queue, pthread_t thread) {
+    pthread_mutex_lock(&queue->lock);
+    queue->cancelled = true;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    pthread_join(thread, NULL);
+    for (size_t i = 0; i < queue->capacity; i++) {
+        PWImageBufferRelease(queue->slots[i]);
+    }
+    free(queue->slots);
+    pthread_cond_destroy(&queue->changed);
+    pthread_mutex_destroy(&queue->lock);
+}
+
+// MARK: - Encoding
+
+    /// Add FRAME to the animation, which is WIDTH x HEIGHT, cutting it down first if it is bigger.
+static PWError addFrame(PWGIFEncoder *encoder, PWImageBuffer *frame, size_t width, size_t height, unsigned delay) {
+    if (frame->width <= width && frame->height <= height) {
+        return PWGIFEncoderAddFrame(encoder, frame, delay);
+    }
+    PWImageRect rect = { 0, 0, frame->width < width ? frame->width : width, frame->height < height ? frame->height : height };
+    PWImageBuffer *visible = PWImageBufferCreateSubImage(frame, rect);
+    PWError error = visible ? PWGIFEncoderAddFrame(encoder, visible, delay) : PWError_OutOfMemory;
+    PWImageBufferRelease(visible);
+    return error;
+}
+
+    /// Pass whatever is in OUTPUT to SINK and empty it.
+static PWError drain(PWDataBuffer *output, PWSequenceSink sink, void *sinkContext) {
+    bool ok = output->length == 0 || sink(sinkContext, output->bytes, output->length);
+    output->length = 0;
+    return ok ? PWError_None : PWError_IO;
+}
+
+PWError PWSequenceEncodeGIF(size_t frameCount, PWSequenceFrameSource source, void *sourceContext,
+                            const PWSequenceOptions *options, PWSequenceSink sink, void *sinkContext) {
+    if (frameCount == 0 || !source || !sink) {
+        return PWError_InvalidParameter;
+    }
+    PWSequenceOptions defaults;
+    if (!options) {
+        PWSequenceOptionsInit(&defaults);
+        options = &defaults;
+    }
+    PWDataBuffer output;
+    if (!PWDataBufferInit(&output, OutputCapacity)) {
+        return PWError_OutOfMemory;
+    }
+
+        // With no look-ahead, or if the thread can't be started, each frame is made just before it is encoded.
+    FrameQueue queue = { .capacity = options->lookAhead + 1, .frameCount = frameCount,
+                         .source = source, .sourceContext = sourceContext, .options = options };
+    pthread_t producer;
+    bool threaded = options->lookAhead > 0 && frameCount > 1 && (queue.slots = calloc(queue.capacity, sizeof(PWImageBuffer *)));
+    if (threaded) {
+        pthread_mutex_init(&queue.lock, NULL);
+        pthread_cond_init(&queue.changed, NULL);
+        if (pthread_create(&producer, NULL, produceFrames, &queue) != 0) {
+            pthread_cond_destroy(&queue.changed);
+            pthread_mutex_destroy(&queue.lock);
+            free(queue.slots);
+            threaded = false;
+        }
+    }
+
+    PWGIFEncoder *encoder = NULL;
+    size_t width = 0, height = 0;
+    PWError error = PWError_None;
+    for (size_t index = 0; index < frameCount && error == PWError_None; index++) {
+        PWImageBuffer *frame = NULL;
+        if (threaded) {
+            frame = waitForFrame(&queue, &error);
+        } else {
+            error = makeFrame(source, sourceContext, index, options, &frame);
+        }
+        if (!frame) {
+            break;
+        }
+        if (!encoder) {
+            width = frame->width;
+            height = frame->height;
+            encoder = PWGIFEncoderCreate(&output, width, height, options->loopCount);
+            if (!encoder) {
+                error = width > 0xFFFF || height > 0xFFFF ? PWError_InvalidParameter : PWError_OutOfMemory;
+            }
+        }
+        if (encoder) {
+            error = addFrame(encoder, frame, width, height, options->frameDelay);
+        }
+        if (threaded) {
+            finishFrame(&queue);
+        } else {
+            PWImageBufferRelease(frame);
+        }
+        if (error == PWError_None) {
+            error = drain(&output, sink, sinkContext);
+        }
+    }
+    if (threaded) {
+        stopProducer(&queue, producer);
+    }
+    if (encoder) {
+        PWError finishError = PWGIFEncoderFinish(encoder);
+        if (error == PWError_None) {
+            error = finishError == PWError_None ? drain(&output, sink, sinkContext) : finishError;
+        }
+    }
+    PWDataBufferFree(&output);
+    return error;
+}
+
+// MARK: - Stored sequences
+
+    /// Reads the frames of a sequence from disk. The file buffers are reused for every frame.
+typedef struct StoredSequence {
+    const char *path;
+    PWLibraryProperties properties;
+    PWDataBuffer leftJPEG, rightJPEG;
+} StoredSequence;
+
+static PWError readStoredFrame(void *context, size_t index, PWImageBuffer **leftView, PWImageBuffer **rightView) {
+    StoredSequence *sequence = context;
+    sequence->leftJPEG.length = sequence->rightJPEG.length = 0;
+    PWImageBuffer *left = NULL, *right = NULL, *leftPhoto = NULL, *rightPhoto = NULL;
+    PWError error = PWLibraryReadSequenceFrame(sequence->path, index, &sequence->leftJPEG, &sequence->rightJPEG);
+    if (error == PWError_None) {
+        error = PWStereoPairDecodePhoto(sequence->leftJPEG.bytes, sequence->leftJPEG.length, &left);
+    }
+    if (error == PWError_None) {
+        error = PWStereoPairDecodePhoto(sequence->rightJPEG.bytes, sequence->rightJPEG.length, &right);
+    }
+    if (error == PWError_None) {
+        error = PWStereoPairCreatePhotos(left, right, sequence->properties.cropRect, sequence->properties.alignment,
+                                         &leftPhoto, &rightPhoto);
+    }
+    if (error == PWError_None) {
+        error = PWStereoPairCreateShiftedViews(leftPhoto, rightPhoto, sequence->properties.disparityOffset, leftView, rightView);
+    }
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+    PWImageBufferRelease(leftPhoto);
+    PWImageBufferRelease(rightPhoto);
+    return error;
+}
+
+PWError PWSequenceWriteGIF(const char *path, const PWSequenceOptions *options, PWSequenceSink sink, void *sinkContext) {
+    StoredSequence sequence = { .path = path };
+    size_t frameCount = PWLibrarySequenceFrameCount(path);
+    if (frameCount == 0) {
+        return PWError_InvalidParameter;
+    }
+    PWError error = PWLibraryReadProperties(path, &sequence.properties);
+    if (error != PWError_None) {
+        return error;
+    }
+    if (!PWDataBufferInit(&sequence.leftJPEG, 0) || !PWDataBufferInit(&sequence.rightJPEG, 0)) {
+        PWDataBufferFree(&sequence.leftJPEG);
+        return PWError_OutOfMemory;
+    }
+    error = PWSequenceEncodeGIF(frameCount, readStoredFrame, &sequence, options, sink, sinkContext);
+    PWDataBufferFree(&sequence.leftJPEG);
+    PWDataBufferFree(&sequence.rightJPEG);
+    return error;
+}
@@ -0,0 +1,90 @@
+/*!
+ @header PWSequence
+ @abstract Streams a sequence of stereo pairs into an animated GIF, one frame at a time.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ A burst or time-lapse may have hundreds of pairs, too many to decode up front. Instead a producer thread fetches,
+ composites and queues each frame while the calling thread encodes the frame before it, and the encoded bytes are
+ handed to the caller after every frame rather than collected. At most the look-ahead queue, the frame being encoded
+ and the frame being made are in memory at once, however long the sequence is.
+ */
+
+#ifndef PWSequence_h
+#define PWSequence_h
+
+#include "PWAnaglyph.h"
+#include "PWImageBuffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * @enum
+ * @brief How each pair becomes one frame of the animation.
+ * @constant PWSequenceLayout_SideBySide Left photo on the left, for cross-eyed viewing.
+ * @constant PWSequenceLayout_Swapped    Right photo on the left, for wall-eyed viewing.
+ * @constant PWSequenceLayout_Anaglyph   A red/cyan anaglyph, mixed as PWSequenceOptions.anaglyphMethod says.
+ */
+typedef enum PWSequenceLayout {
+    PWSequenceLayout_SideBySide,
+    PWSequenceLayout_Swapped,
+    PWSequenceLayout_Anaglyph,
+
+    PWSequenceLayout_NUM_LAYOUTS
+} PWSequenceLayout;
+
+/*! Settings for PWSequenceWriteGIF(). Call PWSequenceOptionsInit() to get the defaults before changing anything. */
+typedef struct PWSequenceOptions {
+        /*! Defaults to PWSequenceLayout_SideBySide. */
+    PWSequenceLayout layout;
+        /*! Used for PWSequenceLayout_Anaglyph. Defaults to PWAnaglyph_Optimised. */
+    PWAnaglyphMethod anaglyphMethod;
+        /*! How long each frame is shown, in hundredths of a second. Defaults to 10. */
+    unsigned frameDelay;
+        /*! Number of times to repeat the animation; 0, the default, means loop forever. */
+    unsigned loopCount;
+        /*! Most frames made ahead of the one being encoded. Defaults to 2. 0 makes each frame on the calling thread. */
+    size_t lookAhead;
+} PWSequenceOptions;
+
+/*! Fill OPTIONS with the default settings. */
+void PWSequenceOptionsInit(PWSequenceOptions *options);
+
+/*!
+ * Fetch the photos of frame INDEX, ready to composite, i.e. already cropped, aligned and shifted.
+ * Frames are fetched in order, on the producer thread, and the function must set both photos or return an error.
+ */
+typedef PWError (*PWSequenceFrameSource)(void *context, size_t index, PWImageBuffer **left, PWImageBuffer **right);
+
+/*! Receives the next LENGTH bytes of the GIF file. Return false to stop, e.g. if they couldn't be written. */
+typedef bool (*PWSequenceSink)(void *context, const uint8_t *bytes, size_t length);
+
+/*!
+ * Make an animated GIF of FRAMECOUNT stereo pairs fetched from SOURCE, passing the file to SINK as it is encoded.
+ *
+ * The animation is the size of the first frame. Later frames are cut down to that size if they are bigger, and drawn
+ * at the top-left over what was there if they are smaller. For the side-by-side layouts both photos of a pair must be
+ * in the same pixel format.
+ *
+ * @return PWError_None, PWError_IO if SINK returned false, PWError_InvalidParameter if there are no frames or they are
+ *         too large for a GIF, PWError_NotSupported if a pair's photos are in different formats, or the first error
+ *         from SOURCE.
+ */
+PWError PWSequenceEncodeGIF(size_t frameCount, PWSequenceFrameSource source, void *sourceContext,
+                            const PWSequenceOptions *options, PWSequenceSink sink, void *sinkContext);
+
+/*!
+ * Make an animated GIF of every pair in the sequence stored at PATH (see PWLibrarySequenceFrameCount()).
+ *
+ * Each pair is decoded and cropped, aligned and shifted with the stereogram's properties as PWStereoPair does for a
+ * single pair, then composited and encoded as for PWSequenceEncodeGIF().
+ */
+PWError PWSequenceWriteGIF(const char *path, const PWSequenceOptions *options, PWSequenceSink sink, void *sinkContext);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWSequence_h */
@@ -0,0 +1,211 @@
+//
+//  PWStereoPair.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWStereoPair.h"
+#include "PWExifThumbnail.h"
+#include "PWJPEGDecoder.h"
+#include "PWOrientation.h"
+#include "PWStorage.h"
+
+#include <math.h>
+
+static bool isEmptyCrop(PWCropRect cropRect) {
+    return !(cropRect.width > 0.0 && cropRect.height > 0.0);  // Also catches NaN.
+}
+
+    /// Clamp VALUE, which may be fractional or negative, to the whole pixels 0...LIMIT.
+static size_t clampToPixels(double value, size_t limit) {
+    return value <= 0.0 ? 0 : value >= (double)limit ? limit : (size_t)value;
+}
+
+PWError PWStereoPairDecodePhoto(const uint8_t *bytes, size_t length, PWImageBuffer **photo) {
+    if (!photo) {
+        return PWError_InvalidParameter;
+    }
+    *photo = NULL;
+    PWJPEGInfo info;
+    PWError error = PWJPEGReadInfo(bytes, length, &info);
+    PWImageBuffer *buffer = NULL;
+    if (error == PWError_None) {
+        error = PWJPEGDecode(bytes, length, &buffer);
+    }
+    if (buffer && info.orientation != PWOrientation_Up) {
+        PWImageBuffer *upright = PWImageBufferCreateOriented(buffer, (PWOrientation)info.orientation);
+        PWImageBufferRelease(buffer);
+        buffer = upright;
+        if (!upright) {
+            error = PWError_OutOfMemory;
+        }
+    }
+    *photo = buffer;
+    return error;
+}
+
+PWImageBuffer *PWStereoPairCreateCroppedPhoto(PWImageBuffer *photo, PWCropRect cropRect) {
+    if (!photo || isEmptyCrop(cropRect)) {
+        return PWImageBufferRetain(photo);
+    }
+        // As CGRectIntegral(): the smallest rectangle of whole pixels containing the crop.
+    size_t x = clampToPixels(floor(cropRect.x), photo->width) & ~(size_t)1;
+    size_t y = clampToPixels(floor(cropRect.y), photo->height) & ~(size_t)1;
+    size_t right  = clampToPixels(ceil(cropRect.x + cropRect.width), photo->width);
+    size_t bottom = clampToPixels(ceil(cropRect.y + cropRect.height), photo->height);
+    if (right < x + 2 || bottom < y + 2) {
+        return PWImageBufferRetain(photo);
+    }
+    PWImageRect rect = { x, y, (right - x) & ~(size_t)1, (bottom - y) & ~(size_t)1 };
+    return PWImageBufferCreateSubImage(photo, rect);
+}
+
+PWError PWStereoPairCreatePhotos(PWImageBuffer *left, PWImageBuffer *right, PWCropRect cropRect, PWAlignment alignment,
+                                 PWImageBuffer **leftOutput, PWImageBuffer **rightOutput) {
+    if (!leftOutput || !rightOutput) {
+        return PWError_InvalidParameter;
+    }
+    *leftOutput = *rightOutput = NULL;
+    if (!left || !right) {
+        return PWError_InvalidParameter;
+    }
+        // The alignment was measured on the whole photos. Away from the middle, the rotation adds to the vertical offset.
+    if (!isEmptyCrop(cropRect)) {
+        double minX = fmax(cropRect.x, 0.0), maxX = fmin(cropRect.x + cropRect.width, (double)left->width);
+        double minY = fmax(cropRect.y, 0.0), maxY = fmin(cropRect.y + cropRect.height, (double)left->height);
+        if (maxX > minX && maxY > minY) {
+            alignment.verticalOffset += ((minX + maxX) / 2.0 - left->width / 2.0) * tan(alignment.rotation);
+        }
+    }
+    PWImageBuffer *croppedLeft  = PWStereoPairCreateCroppedPhoto(left, cropRect);
+    PWImageBuffer *croppedRight = PWStereoPairCreateCroppedPhoto(right, cropRect);
+    PWError error = PWError_OutOfMemory;
+    if (croppedLeft && croppedRight) {
+        error = PWAlignCreateCorrectedPair(croppedLeft, croppedRight, alignment, leftOutput, rightOutput);
+    }
+    PWImageBufferRelease(croppedLeft);
+    PWImageBufferRelease(croppedRight);
+    return error;
+}
+
+PWError PWStereoPairCreateShiftedViews(PWImageBuffer *left, PWImageBuffer *right, long disparityOffset,
+                                       PWImageBuffer **leftView, PWImageBuffer **rightView) {
+    if (!left || !right) {
+        return PWError_InvalidParameter;
+    }
+    size_t narrowest = left->width < right->width ? left->width : right->width;
+    long limit = narrowest > 2 ? (long)(narrowest - 2) : 0;
+    long offset = disparityOffset < -limit ? -limit : disparityOffset > limit ? limit : disparityOffset;
+    return PWImageBufferCreateShiftedViews(left, right, offset, leftView, rightView);
+}
+
+// MARK: - Previews
+
+    /// How far the shape of a thumbnail may be from the photo's, as a fraction, before it is assumed to be letterboxed.
+static const double ThumbnailAspectTolerance = 0.02;
+
+    /// Size of a photo stored as WIDTH x HEIGHT once ORIENTATION has turned it upright.
+static void uprightSize(size_t width, size_t height, int orientation, size_t *uprightWidth, size_t *uprightHeight) {
+    bool swap = PWOrientationSwapsAxes((PWOrientation)orientation);
+    *uprightWidth  = swap ? height : width;
+    *uprightHeight = swap ? width : height;
+}
+
+    /// Make an upright preview of the photo at PATH, from its EXIF thumbnail if ALLOWTHUMBNAIL is set and it has a suitable one.
+    /// Also returns the size of the photo itself once upright.
+static PWError createPreviewPhoto(const char *path, bool allowThumbnail, PWImageBuffer **preview,
+                                  size_t *photoWidth, size_t *photoHeight) {
+    *preview = NULL;
+    if (allowThumbnail) {
+        PWImageBuffer *thumbnail = NULL;
+        PWExifThumbnailPhotoInfo info;
+        if (PWExifThumbnailCreateImage(path, &thumbnail, &info) == PWError_None) {
+            uprightSize(info.width, info.height, info.orientation, photoWidth, photoHeight);
+            double photoAspect = (double)*photoWidth / (double)*photoHeight;
+            double thumbnailAspect = (double)thumbnail->width / (double)thumbnail->height;
+            if (fabs(thumbnailAspect / photoAspect - 1.0) <= ThumbnailAspectTolerance) {
+                *preview = thumbnail;
+                return PWError_None;
+            }
+            PWImageBufferRelease(thumbnail);
+        }
+    }
+    PWDataBuffer contents;
+    if (!PWDataBufferInit(&contents, 0)) {
+        return PWError_OutOfMemory;
+    }
+    PWError error = PWStorageReadFile(PWStorageDefault(), path, 0, PWStorageWholeFile, &contents);
+    PWJPEGInfo info;
+    if (error == PWError_None) {
+        error = PWJPEGReadInfo(contents.bytes, contents.length, &info);
+    }
+    PWImageBuffer *buffer = NULL;
+    if (error == PWError_None) {
+        error = PWJPEGDecodeReduced(contents.bytes, contents.length, &buffer);
+    }
+    PWDataBufferFree(&contents);
+    if (buffer && info.orientation != PWOrientation_Up) {
+        PWImageBuffer *upright = PWImageBufferCreateOriented(buffer, (PWOrientation)info.orientation);
+        PWImageBufferRelease(buffer);
+        buffer = upright;
+        if (!upright) {
+            error = PWError_OutOfMemory;
+        }
+    }
+    if (buffer) {
+        uprightSize(info.width, info.height, info.orientation, photoWidth, photoHeight);
+    }
+    *preview = buffer;
+    return error;
+}
+
+PWError PWStereoPairCreatePreviewPhotos(const char *leftPath, const char *rightPath, PWCropRect cropRect,
+                                        PWAlignment alignment, PWImageBuffer **leftOutput, PWImageBuffer **rightOutput,
+                                        double *scale) {
+    if (!leftOutput || !rightOutput) {
+        return PWError_InvalidParameter;
+    }
+    *leftOutput = *rightOutput = NULL;
+    if (!leftPath || !rightPath) {
+        return PWError_InvalidParameter;
+    }
+    PWImageBuffer *left = NULL, *right = NULL;
+    size_t leftWidth = 0, leftHeight = 0, rightWidth = 0, rightHeight = 0;
+    PWError error = PWError_None;
+        // Both previews must be the same size and format to be composited, so if only one photo has a thumbnail
+        // (or they have different ones) decode both files at reduced size instead.
+    for (int attempt = 0; attempt < 2; attempt++) {
+        bool allowThumbnail = attempt == 0;
+        PWImageBufferRelease(left);
+        PWImageBufferRelease(right);
+        right = NULL;
+        error = createPreviewPhoto(leftPath, allowThumbnail, &left, &leftWidth, &leftHeight);
+        if (error == PWError_None) {
+            error = createPreviewPhoto(rightPath, allowThumbnail, &right, &rightWidth, &rightHeight);
+        }
+        if (error != PWError_None || (left->width == right->width && left->height == right->height
+                                      && left->format == right->format)) {
+            break;
+        }
+    }
+    if (error == PWError_None && (leftWidth != rightWidth || leftHeight != rightHeight
+                                  || left->width != right->width || left->height != right->height)) {
+        error = PWError_InvalidParameter;
+    }
+    if (error == PWError_None) {
+        double scaleX = (double)left->width / (double)leftWidth;
+        double scaleY = (double)left->height / (double)leftHeight;
+        PWCropRect previewCrop = { cropRect.x * scaleX, cropRect.y * scaleY,
+                                   cropRect.width * scaleX, cropRect.height * scaleY };
+        alignment.verticalOffset *= scaleY;
+        error = PWStereoPairCreatePhotos(left, right, previewCrop, alignment, leftOutput, rightOutput);
+        if (scale) {
+            *scale = scaleX;
+        }
+    }
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+    return error;
+}
@@ -0,0 +1,92 @@
+/*!
+ @header PWStereoPair
+ @abstract Turns the two saved photos of a stereogram into the pair of images that are composited, as the app does.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ A stereogram's photos are stored as taken. Before they are shown they are decoded and turned upright, cropped to the
+ stored crop, corrected for the stored alignment and shifted by the stored disparity offset. ImageManager does this
+ inside the app and the batch converter does it on Linux, so both go through these functions.
+ */
+
+#ifndef PWStereoPair_h
+#define PWStereoPair_h
+
+#include "PWAlign.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * A crop in upright photo pixels, as stored in the CropRect property. It may have fractional edges, as CGRect can.
+ * A rectangle with no area means the photos are not cropped.
+ */
+typedef struct PWCropRect {
+    double x, y, width, height;
+} PWCropRect;
+
+/*!
+ * Decode a JPEG photo and turn it upright according to its EXIF orientation.
+ *
+ * @param photo Receives a new buffer, which the caller must release. Set to NULL on failure.
+ * @return PWError_None, or the error from PWJPEGDecode(). PWError_NotSupported means the file is valid but must be
+ *         decoded some other way.
+ */
+PWError PWStereoPairDecodePhoto(const uint8_t *bytes, size_t length, PWImageBuffer **photo);
+
+/*!
+ * Return a view of the part of PHOTO inside CROPRECT. Nothing is copied.
+ *
+ * The crop is widened to whole pixels and its edges rounded to even pixels, so YCbCr chroma stays aligned and cropped
+ * photos can still be put side by side. An empty crop, or one leaving less than 2 x 2 pixels, returns PHOTO itself.
+ *
+ * @return A new reference, which the caller must release, or NULL if memory ran out.
+ */
+PWImageBuffer *PWStereoPairCreateCroppedPhoto(PWImageBuffer *photo, PWCropRect cropRect);
+
+/*!
+ * Crop both photos and take ALIGNMENT out of them, giving the pair the app composites before any disparity offset.
+ *
+ * ALIGNMENT was measured on the uncropped photos, so the part of the offset due to the rotation is adjusted for how far
+ * the middle of the crop is from the middle of the photo. See PWAlignCreateCorrectedPair() for what is copied.
+ *
+ * @param leftOutput  Receives the left photo, which the caller must release. Set to NULL on failure.
+ * @param rightOutput Receives the right photo, as for LEFTOUTPUT.
+ * @return PWError_None, PWError_InvalidParameter if the correction would leave nothing, or PWError_OutOfMemory.
+ */
+PWError PWStereoPairCreatePhotos(PWImageBuffer *left, PWImageBuffer *right, PWCropRect cropRect, PWAlignment alignment,
+                                 PWImageBuffer **leftOutput, PWImageBuffer **rightOutput);
+
+/*!
+ * Make views of LEFT and RIGHT shifted by DISPARITYOFFSET, as PWImageBufferCreateShiftedViews() does.
+ *
+ * The offset is limited so at least 2 columns of each photo are left, as a stored offset may outlive a smaller crop.
+ */
+PWError PWStereoPairCreateShiftedViews(PWImageBuffer *left, PWImageBuffer *right, long disparityOffset,
+                                       PWImageBuffer **leftView, PWImageBuffer **rightView);
+
+/*!
+ * Make a small version of the pair PWStereoPairCreatePhotos() would make from the JPEG files at LEFTPATH and RIGHTPATH,
+ * to show while the full-size photos are decoded.
+ *
+ * The photos' EXIF thumbnails are used if both have one with the photo's shape, reading only the start of each file.
+ * Otherwise both files are decoded at 1/8 size with PWJPEGDecodeReduced(). Either way the time taken hardly depends on
+ * the size of the photos. CROPRECT and ALIGNMENT are in pixels of the full photos and are scaled to match.
+ *
+ * @param leftOutput  Receives the left photo, which the caller must release. Set to NULL on failure.
+ * @param rightOutput Receives the right photo, as for LEFTOUTPUT.
+ * @param scale       Receives the width of the previews over the width of the full photos, e.g. to scale a disparity
+ *                    offset. May be NULL.
+ * @return PWError_None, PWError_IO if a file couldn't be read, PWError_InvalidParameter if the photos are different
+ *         sizes, or an error from PWJPEGDecode() or PWStereoPairCreatePhotos().
+ */
+PWError PWStereoPairCreatePreviewPhotos(const char *leftPath, const char *rightPath, PWCropRect cropRect,
+                                        PWAlignment alignment, PWImageBuffer **leftOutput, PWImageBuffer **rightOutput,
+                                        double *scale);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWStereoPair_h */
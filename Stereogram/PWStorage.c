@@ -0,0 +1,339 @@
+//
+//  PWStorage.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWStorage.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static PWStorage *defaultStorage;
+
+// MARK: - POSIX
+
+static PWError posixGetInfo(PWStorage *storage, const char *path, PWStorageItemInfo *info) {
+    (void)storage;
+    struct stat status;
+    *info = (PWStorageItemInfo) { PWStorageItem_None, 0, 0 };
+    if (stat(path, &status) != 0) {
+        return errno == ENOENT || errno == ENOTDIR ? PWError_None : PWError_IO;
+    }
+    if (S_ISREG(status.st_mode)) {
+        *info = (PWStorageItemInfo) { PWStorageItem_File, (size_t)status.st_size, status.st_mtime };
+    } else if (S_ISDIR(status.st_mode)) {
+        *info = (PWStorageItemInfo) { PWStorageItem_Directory, 0, status.st_mtime };
+    }
+    return PWError_None;
+}
+
+static PWError posixReadFile(PWStorage *storage, const char *path, size_t offset, size_t maximumLength, PWDataBuffer *contents) {
+    (void)storage;
+    int file = open(path, O_RDONLY);
+    if (file < 0) {
+        return PWError_IO;
+    }
+    PWError error = PWError_IO;
+    struct stat status;
+    if (fstat(file, &status) == 0 && S_ISREG(status.st_mode)) {
+        size_t fileLength = (size_t)status.st_size;
+        size_t length = offset >= fileLength ? 0 : fileLength - offset < maximumLength ? fileLength - offset : maximumLength;
+        if (!PWDataBufferReserve(contents, length)) {
+            error = PWError_OutOfMemory;
+        } else {
+            size_t done = 0;
+            ssize_t count = 1;
+            while (done < length && (count = pread(file, contents->bytes + contents->length + done, length - done,
+                                                   (off_t)(offset + done))) > 0) {
+                done += (size_t)count;
+            }
+                // A file which shrank while being read gives what was there.
+            if (count >= 0) {
+                contents->length += done;
+                error = PWError_None;
+            }
+        }
+    }
+    close(file);
+    return error;
+}
+
+static PWError writeAll(const char *path, const void *bytes, size_t length) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        return PWError_IO;
+    }
+    bool ok = fwrite(bytes, 1, length, file) == length;
+    ok = (fclose(file) == 0) && ok;
+    return ok ? PWError_None : PWError_IO;
+}
+
+static PWError posixWriteFile(PWStorage *storage, const char *path, const void *bytes, size_t length, bool atomic) {
+    (void)storage;
+    if (!atomic) {
+        return writeAll(path, bytes, length);
+    }
+        // Write beside the file and rename over it, as NSDataWritingAtomic does.
+    char temporaryPath[PATH_MAX];
+    int pathLength = snprintf(temporaryPath, sizeof(temporaryPath), "%s.XXXXXX", path);
+    if (pathLength <= 0 || pathLength >= (int)sizeof(temporaryPath)) {
+        return PWError_InvalidParameter;
+    }
+    int descriptor = mkstemp(temporaryPath);
+    if (descriptor < 0) {
+        return PWError_IO;
+    }
+    FILE *file = fdopen(descriptor, "wb");
+    if (!file) {
+        close(descriptor);
+        unlink(temporaryPath);
+        return PWError_IO;
+    }
+    bool ok = fwrite(bytes, 1, length, file) == length;
+    ok = fchmod(descriptor, 0644) == 0 && ok;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(temporaryPath, path) != 0) {
+        unlink(temporaryPath);
+        return PWError_IO;
+    }
+    return PWError_None;
+}
+
+static PWError posixAppendFile(PWStorage *storage, const char *path, const void *bytes, size_t length) {
+    (void)storage;
+    int file = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (file < 0) {
+        return PWError_IO;
+    }
+    const uint8_t *next = bytes;
+    size_t done = 0;
+    ssize_t count = 1;
+    while (done < length && (count = write(file, next + done, length - done)) > 0) {
+        done += (size_t)count;
+    }
+    bool ok = done == length;
+    return close(file) == 0 && ok ? PWError_None : PWError_IO;
+}
+
+static PWError posixMakeDirectory(PWStorage *storage, const char *path, bool mustBeNew) {
+    if (mkdir(path, 0755) == 0) {
+        return PWError_None;
+    }
+    PWStorageItemInfo info;
+    return errno == EEXIST && !mustBeNew && posixGetInfo(storage, path, &info) == PWError_None
+        && info.kind == PWStorageItem_Directory ? PWError_None : PWError_IO;
+}
+
+static PWError posixRemoveFile(PWStorage *storage, const char *path) {
+    (void)storage;
+    return unlink(path) == 0 ? PWError_None : PWError_IO;
+}
+
+static PWError posixRemoveDirectory(PWStorage *storage, const char *path) {
+    (void)storage;
+    return rmdir(path) == 0 ? PWError_None : PWError_IO;
+}
+
+static PWError posixListDirectory(PWStorage *storage, const char *path, PWStorageVisitor visitor, void *context) {
+    (void)storage;
+    DIR *directory = opendir(path);
+    if (!directory) {
+        return PWError_IO;
+    }
+    PWError error = PWError_None;
+    char itemPath[PATH_MAX];
+    struct dirent *item;
+    while ((item = readdir(directory)) != NULL) {
+        if (strcmp(item->d_name, ".") == 0 || strcmp(item->d_name, "..") == 0) {
+            continue;
+        }
+        PWStorageItemKind kind = item->d_type == DT_DIR ? PWStorageItem_Directory
+                               : item->d_type == DT_REG ? PWStorageItem_File : PWStorageItem_None;
+        if (item->d_type == DT_UNKNOWN) {
+                // Some file systems don't fill in the type, so look it up. Links are reported as what they are, not followed.
+            struct stat status;
+            int length = snprintf(itemPath, sizeof(itemPath), "%s/%s", path, item->d_name);
+            if (length > 0 && length < (int)sizeof(itemPath) && lstat(itemPath, &status) == 0) {
+                kind = S_ISDIR(status.st_mode) ? PWStorageItem_Directory : S_ISREG(status.st_mode) ? PWStorageItem_File : PWStorageItem_None;
+            }
+        }
+        if (!visitor(item->d_name, kind, context)) {
+            break;
+        }
+    }
+    closedir(directory);
+    return error;
+}
+
+static PWError posixMoveItem(PWStorage *storage, const char *fromPath, const char *toPath) {
+        // rename() replaces an existing file or empty directory, so check first. This is only used for new names.
+    PWStorageItemInfo info;
+    PWError error = posixGetInfo(storage, toPath, &info);
+    if (error != PWError_None || info.kind != PWStorageItem_None) {
+        return PWError_IO;
+    }
+    return rename(fromPath, toPath) == 0 ? PWError_None : PWError_IO;
+}
+
+static const PWStorageOperations POSIXOperations = {
+    posixGetInfo, posixReadFile, posixWriteFile, posixAppendFile, posixMakeDirectory, posixRemoveFile, posixRemoveDirectory,
+    posixListDirectory, posixMoveItem, NULL
+};
+
+static PWStorage POSIXStorage = { &POSIXOperations };
+
+PWStorage *PWStoragePOSIX(void) {
+    return &POSIXStorage;
+}
+
+// MARK: - Default storage
+
+PWStorage *PWStorageDefault(void) {
+    PWStorage *storage = __atomic_load_n(&defaultStorage, __ATOMIC_ACQUIRE);
+    return storage ? storage : &POSIXStorage;
+}
+
+void PWStorageSetDefault(PWStorage *storage) {
+    __atomic_store_n(&defaultStorage, storage, __ATOMIC_RELEASE);
+}
+
+void PWStorageRelease(PWStorage *storage) {
+    if (storage && storage->operations->destroy) {
+        storage->operations->destroy(storage);
+    }
+}
+
+// MARK: - Operations
+
+PWError PWStorageGetInfo(PWStorage *storage, const char *path, PWStorageItemInfo *info) {
+    if (!storage || !path || !info) {
+        return PWError_InvalidParameter;
+    }
+    return storage->operations->getInfo(storage, path, info);
+}
+
+PWError PWStorageReadFile(PWStorage *storage, const char *path, size_t offset, size_t maximumLength, PWDataBuffer *contents) {
+    if (!storage || !path || !contents) {
+        return PWError_InvalidParameter;
+    }
+    return storage->operations->readFile(storage, path, offset, maximumLength, contents);
+}
+
+PWError PWStorageWriteFile(PWStorage *storage, const char *path, const void *bytes, size_t length, bool atomic) {
+    if (!storage || !path || (!bytes && length > 0)) {
+        return PWError_InvalidParameter;
+    }
+    return storage->operations->writeFile(storage, path, bytes, length, atomic);
+}
+
+PWError PWStorageAppendFile(PWStorage *storage, const char *path, const void *bytes, size_t length) {
+    if (!storage || !path || (!bytes && length > 0)) {
+        return PWError_InvalidParameter;
+    }
+    return storage->operations->appendFile(storage, path, bytes, length);
+}
+
+PWError PWStorageMakeDirectory(PWStorage *storage, const char *path, bool mustBeNew) {
+    if (!storage || !path) {
+        return PWError_InvalidParameter;
+    }
+    return storage->operations->makeDirectory(storage, path, mustBeNew);
+}
+
+PWError PWStorageRemoveFile(PWStorage *storage, const char *path) {
+    if (!storage || !path) {
+        return PWError_InvalidParameter;
+    }
+    return storage->operations->removeFile(storage, path);
+}
+
+PWError PWStorageRemoveDirectory(PWStorage *storage, const char *path) {
+    if (!storage || !path) {
+        return PWError_InvalidParameter;
+    }
+    return storage->operations->removeDirectory(storage, path);
+}
+
+PWError PWStorageListDirectory(PWStorage *storage, const char *path, PWStorageVisitor visitor, void *context) {
+    if (!storage || !path || !visitor) {
+        return PWError_InvalidParameter;
+    }
+    return storage->operations->listDirectory(storage, path, visitor, context);
+}
+
+PWError PWStorageMoveItem(PWStorage *storage, const char *fromPath, const char *toPath) {
+    if (!storage || !fromPath || !toPath) {
+        return PWError_InvalidParameter;
+    }
+    return storage->operations->moveItem(storage, fromPath, toPath);
+}
+
+bool PWStorageFileExists(PWStorage *storage, const char *path) {
+    PWStorageItemInfo info;
+    return PWStorageGetInfo(storage, path, &info) == PWError_None && info.kind == PWStorageItem_File;
+}
+
+    /// The items of one directory being removed by PWStorageRemoveTree(). Nothing is deleted while it is being listed.
+typedef struct TreeItems {
+    char (*names)[NAME_MAX + 1];
+    PWStorageItemKind *kinds;
+    size_t count, capacity;
+} TreeItems;
+
+static bool collectItem(const char *name, PWStorageItemKind kind, void *context) {
+    TreeItems *items = context;
+    if (items->count == items->capacity) {
+        size_t capacity = items->capacity ? items->capacity * 2 : 16;
+        char (*names)[NAME_MAX + 1] = realloc(items->names, capacity * sizeof(items->names[0]));
+        if (names) {
+            items->names = names;
+        }
+        PWStorageItemKind *kinds = names ? realloc(items->kinds, capacity * sizeof(PWStorageItemKind)) : NULL;
+        if (!kinds) {
+            return false;
+        }
+        items->kinds = kinds;
+        items->capacity = capacity;
+    }
+    snprintf(items->names[items->count], sizeof(items->names[0]), "%s", name);
+    items->kinds[items->count++] = kind;
+    return true;
+}
+
+PWError PWStorageRemoveTree(PWStorage *storage, const char *path) {
+    PWStorageItemInfo info;
+    PWError error = PWStorageGetInfo(storage, path, &info);
+    if (error != PWError_None || info.kind == PWStorageItem_None) {
+        return error;
+    }
+    TreeItems items = { NULL, NULL, 0, 0 };
+    error = PWStorageListDirectory(storage, path, collectItem, &items);
+    char itemPath[PATH_MAX];
+    for (size_t i = 0; i < items.count; i++) {
+        int length = snprintf(itemPath, sizeof(itemPath), "%s/%s", path, items.names[i]);
+        PWError itemError = length <= 0 || length >= (int)sizeof(itemPath) ? PWError_InvalidParameter
+                            // Only the tile pyramid and the frames of a sequence are stored in subdirectories, so this
+                            // never goes more than one level deep.
+                          : items.kinds[i] == PWStorageItem_Directory ? PWStorageRemoveTree(storage, itemPath)
+                          : PWStorageRemoveFile(storage, itemPath);
+        if (itemError != PWError_None) {
+            error = itemError;
+        }
+    }
+    free(items.names);
+    free(items.kinds);
+    if (PWStorageRemoveDirectory(storage, path) != PWError_None) {
+        error = PWError_IO;
+    }
+    return error;
+}
@@ -0,0 +1,119 @@
+/*!
+ @header PWStorage
+ @abstract The file system operations the photo store needs, behind a table of functions so they can be swapped out.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ PWLibrary, the tile pyramid, imports and the thumbnail reader, and Stereogram's own file handling, all reach the disk
+ through the storage returned by PWStorageDefault(). Normally that is PWStoragePOSIX(), which uses the usual system
+ calls. Tests and benchmarks can set an in-memory storage instead (see PWMemoryStorage.h), so a library of thousands
+ of stereograms is built in milliseconds and failures can be injected at any operation.
+
+ Paths are POSIX paths with '/' separators. All the functions are thread-safe if the storage's operations are, as both
+ built-in ones are.
+ */
+
+#ifndef PWStorage_h
+#define PWStorage_h
+
+#include "PWImageBuffer.h"
+
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! What is at a path. */
+typedef enum PWStorageItemKind {
+    PWStorageItem_None,
+    PWStorageItem_File,
+    PWStorageItem_Directory
+} PWStorageItemKind;
+
+/*! Details of a file or directory, from PWStorageGetInfo(). */
+typedef struct PWStorageItemInfo {
+    PWStorageItemKind kind;
+        /*! Length in bytes of a file, 0 for a directory. */
+    size_t length;
+        /*! When the file was last changed. */
+    time_t modified;
+} PWStorageItemInfo;
+
+/*! Called for each item in a directory. Return false to stop early. */
+typedef bool (*PWStorageVisitor)(const char *name, PWStorageItemKind kind, void *context);
+
+typedef struct PWStorage PWStorage;
+
+/*!
+ * The operations a storage implements. Each returns PWError_IO if the storage can't do it, e.g. because a path
+ * doesn't exist. They are called through the PWStorage functions below, which check the parameters first.
+ */
+typedef struct PWStorageOperations {
+        /*! Fill INFO, with kind PWStorageItem_None and PWError_None if nothing is at PATH. */
+    PWError (*getInfo)(PWStorage *storage, const char *path, PWStorageItemInfo *info);
+        /*! Append up to MAXIMUMLENGTH bytes from OFFSET in the file PATH to CONTENTS. Fewer at the end of the file. */
+    PWError (*readFile)(PWStorage *storage, const char *path, size_t offset, size_t maximumLength, PWDataBuffer *contents);
+        /*! Create or replace the file PATH. If ATOMIC, PATH is left as it was unless the whole file is written. */
+    PWError (*writeFile)(PWStorage *storage, const char *path, const void *bytes, size_t length, bool atomic);
+        /*! Add BYTES to the end of the file PATH, creating it if need be. */
+    PWError (*appendFile)(PWStorage *storage, const char *path, const void *bytes, size_t length);
+        /*! Create the directory PATH, whose parent must exist. An existing directory is an error only if MUSTBENEW. */
+    PWError (*makeDirectory)(PWStorage *storage, const char *path, bool mustBeNew);
+        /*! Delete the file PATH. */
+    PWError (*removeFile)(PWStorage *storage, const char *path);
+        /*! Delete the directory PATH, which must be empty. */
+    PWError (*removeDirectory)(PWStorage *storage, const char *path);
+        /*! Call VISITOR with each item in the directory PATH, in no particular order, except . and .. */
+    PWError (*listDirectory)(PWStorage *storage, const char *path, PWStorageVisitor visitor, void *context);
+        /*! Move the file or directory FROMPATH to TOPATH, which must not exist, in one step, as rename() does. */
+    PWError (*moveItem)(PWStorage *storage, const char *fromPath, const char *toPath);
+        /*! Free the storage and everything in it. NULL for storages which live for ever. */
+    void (*destroy)(PWStorage *storage);
+} PWStorageOperations;
+
+/*! A storage. Implementations embed this as their first member. */
+struct PWStorage {
+    const PWStorageOperations *operations;
+};
+
+/*! Pass as MAXIMUMLENGTH to PWStorageReadFile() to read to the end of the file. */
+#define PWStorageWholeFile SIZE_MAX
+
+/*! The storage which uses the file system. It is never freed. */
+PWStorage *PWStoragePOSIX(void);
+
+/*! The storage used by the photo store: PWStoragePOSIX() unless another has been set. */
+PWStorage *PWStorageDefault(void);
+
+/*!
+ * Make STORAGE the one PWStorageDefault() returns, or go back to PWStoragePOSIX() if it is NULL.
+ * Set it before starting any work which uses it. The storage is not retained; keep it until it has been replaced.
+ */
+void PWStorageSetDefault(PWStorage *storage);
+
+/*! Free STORAGE, if it can be freed. NULL is ignored. */
+void PWStorageRelease(PWStorage *storage);
+
+/*! See PWStorageOperations. These check for NULL parameters and call the storage's operation. */
+PWError PWStorageGetInfo(PWStorage *storage, const char *path, PWStorageItemInfo *info);
+PWError PWStorageReadFile(PWStorage *storage, const char *path, size_t offset, size_t maximumLength, PWDataBuffer *contents);
+PWError PWStorageWriteFile(PWStorage *storage, const char *path, const void *bytes, size_t length, bool atomic);
+PWError PWStorageAppendFile(PWStorage *storage, const char *path, const void *bytes, size_t length);
+PWError PWStorageMakeDirectory(PWStorage *storage, const char *path, bool mustBeNew);
+PWError PWStorageRemoveFile(PWStorage *storage, const char *path);
+PWError PWStorageRemoveDirectory(PWStorage *storage, const char *path);
+PWError PWStorageListDirectory(PWStorage *storage, const char *path, PWStorageVisitor visitor, void *context);
+PWError PWStorageMoveItem(PWStorage *storage, const char *fromPath, const char *toPath);
+
+/*! True if there is a file (not a directory) at PATH. */
+bool PWStorageFileExists(PWStorage *storage, const char *path);
+
+/*! Delete the directory at PATH and everything under it. A directory which doesn't exist is not an error. */
+PWError PWStorageRemoveTree(PWStorage *storage, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWStorage_h */
@@ -0,0 +1,455 @@
+//
+//  PWSync.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWSync.h"
+#include "PWJournal.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *const ManifestFileName = ".Manifest", *const UploadsDirectoryName = ".Uploads";
+
+    /// The manifest is rewritten when it has more than this many lines and at least twice as many as it needs.
+enum { MinimumManifestLinesToCompact = 64 };
+
+// MARK: - Records
+
+    /// The last change to one path, from the journal, or what the target holds there, from the manifest.
+typedef struct Record {
+        /// NULL in an empty slot.
+    char *path;
+    PWJournalEntryKind kind;
+        /// When the change was made, in the order the changes were made. Journal sequence numbers, or manifest line numbers.
+    uint64_t order;
+        /// The journal sequence number of the change.
+    uint64_t sequence;
+    size_t length;
+    PWSHA256Digest digest;
+} Record;
+
+    /// Records by path, in an open-addressed hash table which is never more than half full.
+typedef struct RecordTable {
+    Record *records;
+    size_t capacity, count;
+} RecordTable;
+
+static uint64_t hashPath(const char *path, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)path[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+    /// The slot for the LENGTH characters at PATH: the one holding that path, or the empty one where it would go.
+static Record *findSlot(const RecordTable *table, const char *path, size_t length) {
+    size_t mask = table->capacity - 1;
+    for (size_t i = hashPath(path, length) & mask;; i = (i + 1) & mask) {
+        Record *record = &table->records[i];
+        if (!record->path || (strncmp(record->path, path, length) == 0 && record->path[length] == '\0')) {
+            return record;
+        }
+    }
+}
+
+static const Record *findRecord(const RecordTable *table, const char *path, size_t length) {
+    const Record *record = table->capacity ? findSlot(table, path, length) : NULL;
+    return record && record->path ? record : NULL;
+}
+
+    /// The record for PATH, added if it isn't there yet. Records move when the table grows. NULL if out of memory.
+static Record *addRecord(RecordTable *table, const char *path) {
+    if ((table->count + 1) * 2 > table->capacity) {
+        size_t capacity = table->capacity ? table->capacity * 2 : 256;
+        RecordTable grown = { calloc(capacity, sizeof(Record)), capacity, table->count };
+        if (!grown.records) {
+            return NULL;
+        }
+        for (size_t i = 0; i < table->capacity; i++) {
+            if (table->records[i].path) {
+                *findSlot(&grown, table->records[i].path, strlen(table->records[i].path)) = table->records[i];
+            }
+        }
+        free(table->records);
+        *table = grown;
+    }
+    Record *record = findSlot(table, path, strlen(path));
+    if (!record->path) {
+        record->path = strdup(path);
+        if (!record->path) {
+            return NULL;
+        }
+        table->count++;
+    }
+    return record;
+}
+
+static void freeRecords(RecordTable *table) {
+    for (size_t i = 0; i < table->capacity; i++) {
+        free(table->records[i].path);
+    }
+    free(table->records);
+}
+
+    /// True if TABLE has a delete of a directory holding PATH, e.g. its stereogram, made after ORDER.
+static bool deletedAfter(const RecordTable *table, const char *path, uint64_t order) {
+    for (const char *slash = strchr(path, '/'); slash; slash = strchr(slash + 1, '/')) {
+        const Record *record = findRecord(table, path, (size_t)(slash - path));
+        if (record && record->kind == PWJournalEntry_Delete && record->order > order) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int compareOrder(const void *a, const void *b) {
+    uint64_t x = (*(const Record *const *)a)->order, y = (*(const Record *const *)b)->order;
+    return (x > y) - (x < y);
+}
+
+// MARK: - Sync
+
+typedef struct Sync {
+    const char *rootPath, *targetPath;
+    PWStorage *target;
+    size_t chunkLength;
+    PWSyncStatistics *statistics;
+        /// What the target holds, and the changes to make to it.
+    RecordTable manifest, pending;
+    uint64_t manifestOrder;
+    size_t manifestLines;
+        /// True if the manifest ends in a line cut short, which must be ended before another is added.
+    bool manifestTorn;
+    bool hasSynced, hasIdentifier;
+    PWSHA256Digest syncedIdentifier, identifier;
+    uint64_t syncedSequence, afterSequence, lastSequence;
+    char manifestPath[PATH_MAX], uploadsPath[PATH_MAX];
+    PWError error;
+} Sync;
+
+static bool loadManifestEntry(const PWJournalEntry *entry, void *context) {
+    Sync *sync = context;
+    sync->manifestLines++;
+    if (entry->kind == PWJournalEntry_Synced) {
+        sync->hasSynced = true;
+        sync->syncedIdentifier = entry->digest;
+        sync->syncedSequence = entry->sequence;
+    } else if (entry->kind == PWJournalEntry_Put || entry->kind == PWJournalEntry_Delete) {
+        Record *record = addRecord(&sync->manifest, entry->path);
+        if (!record) {
+            sync->error = PWError_OutOfMemory;
+            return false;
+        }
+        *record = (Record) { record->path, entry->kind, ++sync->manifestOrder, entry->sequence, entry->length, entry->digest };
+    }
+    return true;
+}
+
+static bool readJournalEntry(const PWJournalEntry *entry, void *context) {
+    Sync *sync = context;
+    if (entry->kind == PWJournalEntry_Begin) {
+            // Carry on from the last sync of this journal, or go through all of it if the target hasn't seen it.
+        bool sameJournal = sync->hasSynced && memcmp(&sync->syncedIdentifier, &entry->digest, sizeof(entry->digest)) == 0;
+        sync->afterSequence = sync->lastSequence = sameJournal ? sync->syncedSequence : 0;
+        sync->identifier = entry->digest;
+        sync->hasIdentifier = true;
+        return true;
+    }
+    if (!sync->hasIdentifier || entry->sequence <= sync->afterSequence
+        || (entry->kind != PWJournalEntry_Put && entry->kind != PWJournalEntry_Delete)) {
+        return true;
+    }
+    Record *record = addRecord(&sync->pending, entry->path);
+    if (!record) {
+        sync->error = PWError_OutOfMemory;
+        return false;
+    }
+    *record = (Record) { record->path, entry->kind, entry->sequence, entry->sequence, entry->length, entry->digest };
+    if (entry->sequence > sync->lastSequence) {
+        sync->lastSequence = entry->sequence;
+    }
+    return true;
+}
+
+static PWError appendManifestEntry(Sync *sync, const PWJournalEntry *entry) {
+    char line[PATH_MAX + 128];
+    line[0] = '\n';
+    size_t length = PWJournalFormatEntry(entry, line + sync->manifestTorn, sizeof(line) - 1);
+    if (length == 0) {
+        return PWError_InvalidParameter;
+    }
+    PWError error = PWStorageAppendFile(sync->target, sync->manifestPath, line, length + sync->manifestTorn);
+    if (error == PWError_None) {
+        sync->manifestTorn = false;
+        sync->manifestLines++;
+    }
+    return error;
+}
+
+    /// Note that the target now holds CHANGE, in memory and in the manifest.
+static PWError recordOnTarget(Sync *sync, const Record *change, size_t length, const PWSHA256Digest *digest) {
+    Record *record = addRecord(&sync->manifest, change->path);
+    if (!record) {
+        return PWError_OutOfMemory;
+    }
+    *record = (Record) { record->path, change->kind, ++sync->manifestOrder, change->sequence, length, *digest };
+    PWJournalEntry entry = { change->sequence, change->kind, length, change->path, *digest };
+    return appendManifestEntry(sync, &entry);
+}
+
+static bool joinPath(char output[PATH_MAX], const char *directory, const char *name) {
+    int length = snprintf(output, PATH_MAX, "%s/%s", directory, name);
+    return length > 0 && length < PATH_MAX;
+}
+
+    /// True if the manifest says the target holds PATH with these contents, and a file of the right length is there.
+static bool isOnTarget(const Sync *sync, const char *path, const char *targetFilePath, size_t length, const PWSHA256Digest *digest) {
+    const Record *record = findRecord(&sync->manifest, path, strlen(path));
+    if (!record || record->kind != PWJournalEntry_Put || record->length != length
+        || memcmp(&record->digest, digest, sizeof(*digest)) != 0 || deletedAfter(&sync->manifest, path, record->order)) {
+        return false;
+    }
+    PWStorageItemInfo info;
+    return PWStorageGetInfo(sync->target, targetFilePath, &info) == PWError_None
+        && info.kind == PWStorageItem_File && info.length == length;
+}
+
+static PWError applyDelete(Sync *sync, const Record *change) {
+    char targetItemPath[PATH_MAX];
+    if (!joinPath(targetItemPath, sync->targetPath, change->path)) {
+        return PWError_InvalidParameter;
+    }
+    PWStorageItemInfo info;
+    PWError error = PWStorageGetInfo(sync->target, targetItemPath, &info);
+    if (error == PWError_None && info.kind != PWStorageItem_None) {
+        error = info.kind == PWStorageItem_Directory ? PWStorageRemoveTree(sync->target, targetItemPath)
+                                                     : PWStorageRemoveFile(sync->target, targetItemPath);
+        sync->statistics->itemsDeleted += error == PWError_None;
+    }
+    PWSHA256Digest none = { { 0 } };
+    return error == PWError_None ? recordOnTarget(sync, change, 0, &none) : error;
+}
+
+    /// Send CONTENTS to the uploads directory a chunk at a time, carrying on from any earlier attempt, then move it to TARGETFILEPATH.
+static PWError upload(Sync *sync, const char *path, const char *targetFilePath, const PWDataBuffer *contents, const PWSHA256Digest *digest) {
+    char hex[PWSHA256HexLength + 1], uploadPath[PATH_MAX], directoryPath[PATH_MAX];
+    PWSHA256Format(digest, hex);
+    if (!joinPath(uploadPath, sync->uploadsPath, hex)) {
+        return PWError_InvalidParameter;
+    }
+    PWStorageItemInfo info;
+    PWError error = PWStorageGetInfo(sync->target, uploadPath, &info);
+    size_t offset = 0;
+    if (error == PWError_None && info.kind == PWStorageItem_File && info.length <= contents->length) {
+        offset = info.length;
+        sync->statistics->bytesResumed += offset;
+    } else if (error == PWError_None && info.kind != PWStorageItem_None) {
+        error = info.kind == PWStorageItem_File ? PWStorageRemoveFile(sync->target, uploadPath) : PWError_IO;
+        info.kind = PWStorageItem_None;
+    }
+    if (error == PWError_None && info.kind == PWStorageItem_None) {
+            // Create it, even if it is empty.
+        size_t length = contents->length < sync->chunkLength ? contents->length : sync->chunkLength;
+        error = PWStorageWriteFile(sync->target, uploadPath, contents->bytes, length, false);
+        offset = length;
+        sync->statistics->bytesSent += error == PWError_None ? length : 0;
+    }
+    while (error == PWError_None && offset < contents->length) {
+        size_t length = contents->length - offset < sync->chunkLength ? contents->length - offset : sync->chunkLength;
+        error = PWStorageAppendFile(sync->target, uploadPath, contents->bytes + offset, length);
+        offset += length;
+        sync->statistics->bytesSent += error == PWError_None ? length : 0;
+    }
+
+        // Make the directories the file goes in, e.g. its stereogram and the frames directory.
+    for (const char *slash = strchr(path, '/'); slash && error == PWError_None; slash = strchr(slash + 1, '/')) {
+        int length = snprintf(directoryPath, sizeof(directoryPath), "%s/%.*s", sync->targetPath, (int)(slash - path), path);
+        error = length > 0 && length < (int)sizeof(directoryPath) ? PWStorageMakeDirectory(sync->target, directoryPath, false)
+                                                                  : PWError_InvalidParameter;
+    }
+    if (error == PWError_None) {
+        error = PWStorageGetInfo(sync->target, targetFilePath, &info);
+    }
+    if (error == PWError_None && info.kind != PWStorageItem_None) {
+        error = info.kind == PWStorageItem_File ? PWStorageRemoveFile(sync->target, targetFilePath) : PWError_IO;
+    }
+    return error == PWError_None ? PWStorageMoveItem(sync->target, uploadPath, targetFilePath) : error;
+}
+
+static PWError applyPut(Sync *sync, const Record *change) {
+    char targetFilePath[PATH_MAX], sourcePath[PATH_MAX];
+    if (!joinPath(targetFilePath, sync->targetPath, change->path) || !joinPath(sourcePath, sync->rootPath, change->path)) {
+        return PWError_InvalidParameter;
+    }
+    if (isOnTarget(sync, change->path, targetFilePath, change->length, &change->digest)) {
+        sync->statistics->filesUnchanged++;
+        return PWError_None;
+    }
+        // Send what the file holds now. If it has gone, it was never written, or its delete is later in the journal.
+    PWStorage *source = PWStorageDefault();
+    PWStorageItemInfo info;
+    PWError error = PWStorageGetInfo(source, sourcePath, &info);
+    if (error != PWError_None || info.kind != PWStorageItem_File) {
+        return error;
+    }
+    PWDataBuffer contents = { NULL, 0, 0 };
+    error = PWDataBufferInit(&contents, info.length) ? PWStorageReadFile(source, sourcePath, 0, PWStorageWholeFile, &contents)
+                                                    : PWError_OutOfMemory;
+    PWSHA256Digest digest;
+    if (error == PWError_None) {
+        PWSHA256Compute(contents.bytes, contents.length, &digest);
+        if (isOnTarget(sync, change->path, targetFilePath, contents.length, &digest)) {
+            sync->statistics->filesUnchanged++;
+            PWDataBufferFree(&contents);
+            return PWError_None;
+        }
+        error = upload(sync, change->path, targetFilePath, &contents, &digest);
+    }
+    if (error == PWError_None) {
+        sync->statistics->filesSent++;
+        error = recordOnTarget(sync, change, contents.length, &digest);
+    }
+    PWDataBufferFree(&contents);
+    return error;
+}
+
+    /// Write the manifest again with only the lines which still matter, if most of them don't.
+static PWError compactManifest(Sync *sync) {
+    size_t live = 0;
+    for (size_t i = 0; i < sync->manifest.capacity; i++) {
+        const Record *record = &sync->manifest.records[i];
+        live += record->path && record->kind == PWJournalEntry_Put && !deletedAfter(&sync->manifest, record->path, record->order);
+    }
+    if (sync->manifestLines <= MinimumManifestLinesToCompact || sync->manifestLines < live * 2 + 2) {
+        return PWError_None;
+    }
+    PWDataBuffer manifest = { NULL, 0, 0 };
+    if (!PWDataBufferInit(&manifest, (live + 1) * 160)) {
+        return PWError_OutOfMemory;
+    }
+    PWError error = PWError_None;
+    char line[PATH_MAX + 128];
+    for (size_t i = 0; i <= sync->manifest.capacity && error == PWError_None; i++) {
+        const Record *record = i < sync->manifest.capacity ? &sync->manifest.records[i] : NULL;
+        PWJournalEntry entry = { sync->lastSequence, PWJournalEntry_Synced, 0, "-", sync->identifier };
+        if (record) {
+            if (!record->path || record->kind != PWJournalEntry_Put || deletedAfter(&sync->manifest, record->path, record->order)) {
+                continue;
+            }
+            entry = (PWJournalEntry) { record->sequence, PWJournalEntry_Put, record->length, record->path, record->digest };
+        }
+        size_t length = PWJournalFormatEntry(&entry, line, sizeof(line));
+        if (length == 0) {
+            error = PWError_InvalidParameter;
+        } else if (!PWDataBufferReserve(&manifest, length)) {
+            error = PWError_OutOfMemory;
+        } else {
+            memcpy(manifest.bytes + manifest.length, line, length);
+            manifest.length += length;
+        }
+    }
+    if (error == PWError_None) {
+        error = PWStorageWriteFile(sync->target, sync->manifestPath, manifest.bytes, manifest.length, true);
+    }
+    PWDataBufferFree(&manifest);
+    return error;
+}
+
+    /// Read the manifest, if there is one, and then the journal.
+static PWError loadChanges(Sync *sync) {
+    PWStorageItemInfo info;
+    PWError error = PWStorageGetInfo(sync->target, sync->manifestPath, &info);
+    if (error == PWError_None && info.kind == PWStorageItem_File) {
+        PWDataBuffer manifest = { NULL, 0, 0 };
+        error = PWDataBufferInit(&manifest, info.length) ? PWStorageReadFile(sync->target, sync->manifestPath, 0, PWStorageWholeFile, &manifest)
+                                                        : PWError_OutOfMemory;
+        if (error == PWError_None) {
+            PWJournalParseLines(manifest.bytes, manifest.length, loadManifestEntry, sync);
+            sync->manifestTorn = manifest.length > 0 && manifest.bytes[manifest.length - 1] != '\n';
+            error = sync->error;
+        }
+        PWDataBufferFree(&manifest);
+    }
+    if (error == PWError_None) {
+        error = PWJournalRead(sync->rootPath, readJournalEntry, sync);
+    }
+    if (error == PWError_None) {
+        error = sync->error != PWError_None ? sync->error : sync->hasIdentifier ? PWError_None : PWError_InvalidFormat;
+    }
+    return error;
+}
+
+PWError PWSyncLibrary(const char *rootPath, PWStorage *target, const char *targetPath, const PWSyncOptions *options,
+                      PWSyncStatistics *statistics) {
+    PWSyncStatistics ignored;
+    if (!statistics) {
+        statistics = &ignored;
+    }
+    *statistics = (PWSyncStatistics) { 1, 0, 0, 0, 0, 0, 0 };
+    if (!rootPath || !target || !targetPath) {
+        return PWError_InvalidParameter;
+    }
+    Sync sync;
+    memset(&sync, 0, sizeof(sync));
+    sync.rootPath = rootPath;
+    sync.targetPath = targetPath;
+    sync.target = target;
+    sync.chunkLength = options && options->chunkLength ? options->chunkLength : PWSyncDefaultChunkLength;
+    sync.statistics = statistics;
+    if (!joinPath(sync.manifestPath, targetPath, ManifestFileName) || !joinPath(sync.uploadsPath, targetPath, UploadsDirectoryName)) {
+        return PWError_InvalidParameter;
+    }
+    PWError error = PWStorageMakeDirectory(target, targetPath, false);
+    if (error == PWError_None) {
+        error = PWStorageMakeDirectory(target, sync.uploadsPath, false);
+    }
+    if (error == PWError_None) {
+        error = loadChanges(&sync);
+    }
+
+        // Make the changes in the order they were made, skipping those to stereograms which were deleted afterwards.
+    Record **changes = NULL;
+    size_t changeCount = 0;
+    if (error == PWError_None && sync.pending.count > 0) {
+        changes = malloc(sync.pending.count * sizeof(Record *));
+        error = changes ? PWError_None : PWError_OutOfMemory;
+        for (size_t i = 0; changes && i < sync.pending.capacity; i++) {
+            if (sync.pending.records[i].path) {
+                changes[changeCount++] = &sync.pending.records[i];
+            }
+        }
+        if (changes) {
+            qsort(changes, changeCount, sizeof(Record *), compareOrder);
+        }
+    }
+    if (error == PWError_None) {
+        statistics->firstSequence = sync.afterSequence + 1;
+        statistics->lastSequence = sync.lastSequence;
+    }
+    for (size_t i = 0; i < changeCount && error == PWError_None; i++) {
+        if (!deletedAfter(&sync.pending, changes[i]->path, changes[i]->order)) {
+            error = changes[i]->kind == PWJournalEntry_Delete ? applyDelete(&sync, changes[i]) : applyPut(&sync, changes[i]);
+        }
+    }
+    free(changes);
+
+    bool upToDate = sync.hasSynced && sync.syncedSequence == sync.lastSequence
+                 && memcmp(&sync.syncedIdentifier, &sync.identifier, sizeof(sync.identifier)) == 0;
+    if (error == PWError_None && !upToDate) {
+        PWJournalEntry synced = { sync.lastSequence, PWJournalEntry_Synced, 0, "-", sync.identifier };
+        error = appendManifestEntry(&sync, &synced);
+    }
+    if (error == PWError_None) {
+        error = compactManifest(&sync);
+    }
+    freeRecords(&sync.manifest);
+    freeRecords(&sync.pending);
+    return error;
+}
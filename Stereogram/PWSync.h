@@ -0,0 +1,70 @@
+/*!
+ @header PWSync
+ @abstract Copies the changes recorded in a photo folder's journal to another storage, sending only files which changed.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ The target is any PWStorage: PWStoragePOSIX() for a directory on another disk, a PWMemoryStorage in tests, or one
+ written for a server, whose operations map onto requests (getInfo onto HEAD, appendFile onto a PATCH at the current
+ length, and so on). It ends up holding a copy of the photo folder's stereograms, plus:
+
+ .Manifest, what the target holds, in the journal's line format (see PWJournal.h): a put for each file sent, a delete for
+ each stereogram deleted and, at the end of each sync, a synced line with the journal's identifier and the last sequence
+ number copied. Lines are added as each file is sent, so if a sync stops part way through, the next one doesn't send the
+ same files again. It is rewritten without the out-of-date lines once they are most of it.
+
+ .Uploads/, files being sent, named after their digests. They are sent a chunk at a time, and one which was interrupted
+ carries on from its length next time. Each is moved into place once it is complete.
+
+ A sync reads the journal after the last synced sequence number, keeps only the last change to each path, drops puts to
+ stereograms which were deleted later, and makes the rest in order. A put whose path the manifest already holds with the
+ same digest, and which is on the target with the right length, isn't sent. If the journal's identifier doesn't match,
+ e.g. because it was made again, the whole journal is gone through in this way, so again only what differs is sent.
+
+ Only one sync should run against a target at a time. The photo folder is read through PWStorageDefault().
+ */
+
+#ifndef PWSync_h
+#define PWSync_h
+
+#include "PWStorage.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Files are sent in pieces of this many bytes unless PWSyncOptions says otherwise. */
+enum { PWSyncDefaultChunkLength = 256 * 1024 };
+
+/*! How to sync. */
+typedef struct PWSyncOptions {
+        /*! Bytes sent in each appendFile operation, so at most this much is sent again after an interruption. 0 for the default. */
+    size_t chunkLength;
+} PWSyncOptions;
+
+/*! What a sync did. */
+typedef struct PWSyncStatistics {
+        /*! The journal entries copied, if any. FIRSTSEQUENCE is greater than LASTSEQUENCE if there were none. */
+    uint64_t firstSequence, lastSequence;
+        /*! Files sent, files already on the target, and stereograms or files deleted from it. */
+    size_t filesSent, filesUnchanged, itemsDeleted;
+        /*! Bytes sent, and bytes of interrupted uploads which didn't need sending again. */
+    uint64_t bytesSent, bytesResumed;
+} PWSyncStatistics;
+
+/*!
+ * Bring the copy of the photo folder ROOTPATH at TARGETPATH in TARGET up to date.
+ *
+ * @param options    May be NULL for the defaults.
+ * @param statistics If not NULL, receives what was done, even if the sync failed part way through.
+ * @return PWError_None, PWError_NotSupported if the photo folder doesn't keep a journal, or the first error reading the
+ *         photo folder or writing to the target. Whatever was copied before an error doesn't need copying again.
+ */
+PWError PWSyncLibrary(const char *rootPath, PWStorage *target, const char *targetPath, const PWSyncOptions *options,
+                      PWSyncStatistics *statistics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWSync_h */
@@ -0,0 +1,287 @@
+//
+//  PWThumbnail.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWThumbnail.h"
+#include "PWParallel.h"
+
+#include <math.h>
+#include <string.h>
+
+    /// The part of SOURCE which fills the thumbnail when it is scaled to THUMBNAILSIZE.
+static PWResampleRect cropRect(const PWImageBuffer *source, size_t thumbnailSize) {
+    double horizontalRatio = (double)thumbnailSize / source->width;
+    double verticalRatio   = (double)thumbnailSize / source->height;
+    double ratio = horizontalRatio > verticalRatio ? horizontalRatio : verticalRatio;
+
+        // The crop rectangle is centred on the scaled image, as in -thumbnailImage:...
+        // Scaling just that part of the source gives the same pixels without making the larger image first.
+    double cropX = round((source->width  * ratio - thumbnailSize) / 2);
+    double cropY = round((source->height * ratio - thumbnailSize) / 2);
+    PWResampleRect rect = { cropX / ratio, cropY / ratio, thumbnailSize / ratio, thumbnailSize / ratio };
+    if (rect.x + rect.width > source->width) {
+        rect.x = source->width - rect.width;
+    }
+    if (rect.y + rect.height > source->height) {
+        rect.y = source->height - rect.height;
+    }
+    return rect;
+}
+
+PWImageBuffer *PWThumbnailCreate(const PWImageBuffer *source, size_t thumbnailSize) {
+    return PWThumbnailCreateWithOptions(source, thumbnailSize, NULL);
+}
+
+PWThumbnailOptions PWThumbnailOptionsInit(void) {
+    PWThumbnailOptions options = { 0, 0.0, PWResampleFilter_Area };
+    return options;
+}
+
+// MARK: - Block averaging
+
+    /// One plane of a block average. WIDTH and HEIGHT are the size of DESTINATION, in pixels of CHANNELS bytes.
+typedef struct BlockPlane {
+    const uint8_t *source;
+    size_t sourceBytesPerRow;
+    uint8_t *destination;
+    size_t destinationBytesPerRow, width, height, channels;
+} BlockPlane;
+
+    /// The planes to average, with the side of each block in source pixels.
+typedef struct BlockJob {
+    BlockPlane planes[3];
+    size_t planeCount, factor;
+} BlockJob;
+
+    /// Source bytes summed down the block at a time, so the column sums fit on the stack and stay in the L1 cache.
+    /// Blocks are at most MaxBlockFactor pixels across, so a column of 255s still fits in 16 bits.
+enum { ColumnSumLength = 4096, MaxBlockFactor = 256 };
+
+    /// Average each block along row Y of the destination. The rows of the blocks are added down each column first, which
+    /// reads each source row straight through and vectorises, then the few column sums across each block are added.
+    /// CHANNELS is a constant at each call site, so the channel loop is unrolled.
+static inline void averageBlocks(const BlockPlane *plane, size_t factor, size_t y, size_t channels) {
+    uint16_t columnSums[ColumnSumLength];
+    size_t blockLength = factor * channels, blocksPerChunk = ColumnSumLength / blockLength;
+    uint32_t area = (uint32_t)(factor * factor);
+    const uint8_t *top = plane->source + y * factor * plane->sourceBytesPerRow;
+    uint8_t *output = plane->destination + y * plane->destinationBytesPerRow;
+    for (size_t first = 0; first < plane->width; first += blocksPerChunk) {
+        size_t blockCount = plane->width - first < blocksPerChunk ? plane->width - first : blocksPerChunk;
+        size_t length = blockCount * blockLength;
+        const uint8_t *row = top + first * blockLength;
+        memset(columnSums, 0, length * sizeof(uint16_t));
+        for (size_t v = 0; v < factor; v++, row += plane->sourceBytesPerRow) {
+            for (size_t i = 0; i < length; i++) {
+                columnSums[i] = (uint16_t)(columnSums[i] + row[i]);
+            }
+        }
+        const uint16_t *column = columnSums;
+        for (size_t block = 0; block < blockCount; block++) {
+            uint32_t sums[4] = { area / 2, area / 2, area / 2, area / 2 };
+            for (size_t h = 0; h < factor; h++, column += channels) {
+                for (size_t c = 0; c < channels; c++) {
+                    sums[c] += column[c];
+                }
+            }
+            for (size_t c = 0; c < channels; c++) {
+                *output++ = (uint8_t)(sums[c] / area);
+            }
+        }
+    }
+}
+
+    /// PWParallelFunction which averages one row of blocks. INDEX counts the rows of each plane in turn.
+static void averageBlockRow(void *context, size_t index) {
+    const BlockJob *job = context;
+    const BlockPlane *plane = job->planes;
+    while (index >= plane->height) {
+        index -= plane->height;
+        plane++;
+    }
+    switch (plane->channels) {
+        case 1:  averageBlocks(plane, job->factor, index, 1); break;
+        case 3:  averageBlocks(plane, job->factor, index, 3); break;
+        default: averageBlocks(plane, job->factor, index, 4); break;
+    }
+}
+
+    /// Area-averaging a whole photo down to a thumbnail weighs a dozen or more taps per pixel along each axis, which is most
+    /// of the cost. Plain sums over square blocks give the same average for less than half the work, so the crop is first
+    /// reduced by the largest whole factor that leaves it at least twice the thumbnail's size, and only that last step is
+    /// left to the resampler. RECT is moved into the result. Returns NULL if there is too little reduction to be worth it.
+static PWImageBuffer *createBlockAveragedCrop(const PWImageBuffer *source, PWResampleRect *rect, size_t thumbnailSize) {
+    size_t factor = (size_t)((rect->width < rect->height ? rect->width : rect->height) / (2 * thumbnailSize));
+    if (factor < 2) {
+        return NULL;
+    }
+    if (factor > MaxBlockFactor) {
+        factor = MaxBlockFactor;
+    }
+        // Whole blocks covering the crop, starting on an even pixel for planar formats so the chroma blocks line up.
+    bool planar = PWPixelFormatIsPlanar(source->format);
+    size_t left = (size_t)rect->x, top = (size_t)rect->y;
+    if (planar) {
+        left &= ~(size_t)1;
+        top  &= ~(size_t)1;
+    }
+    size_t width  = (size_t)ceil((rect->x + rect->width  - left) / factor);
+    size_t height = (size_t)ceil((rect->y + rect->height - top)  / factor);
+    width  = width  < (source->width  - left) / factor ? width  : (source->width  - left) / factor;
+    height = height < (source->height - top)  / factor ? height : (source->height - top)  / factor;
+    if (planar) {
+        width  &= ~(size_t)1;
+        height &= ~(size_t)1;
+    }
+    PWImageBuffer *reduced = width && height ? PWImageBufferCreate(width, height, source->format) : NULL;
+    if (!reduced) {
+        return NULL;
+    }
+
+    size_t channels = PWPixelFormatBytesPerPixel(source->format);
+    BlockJob job = { { { PWImageBufferRow(source, top) + left * channels, source->bytesPerRow, reduced->data, reduced->bytesPerRow,
+                         width, height, channels } }, 1, factor };
+    if (planar) {
+            // Each chroma block covers the same part of the photo as 2x2 luma blocks.
+        for (int plane = 0; plane < 2; plane++) {
+            BlockPlane chroma = { source->chroma[plane] + (top / 2) * source->chromaBytesPerRow + left / 2, source->chromaBytesPerRow,
+                                  reduced->chroma[plane], reduced->chromaBytesPerRow, width / 2, height / 2, 1 };
+            job.planes[job.planeCount++] = chroma;
+        }
+    }
+    PWParallelFor(planar ? height * 2 : height, &job, averageBlockRow);
+        // Whole blocks can stop just short of the crop at the edge of the photo, so the crop is trimmed to fit.
+    PWResampleRect reducedRect = { (rect->x - left) / factor, (rect->y - top) / factor, rect->width / factor, rect->height / factor };
+    reducedRect.width  = fmin(reducedRect.width,  width  - reducedRect.x);
+    reducedRect.height = fmin(reducedRect.height, height - reducedRect.y);
+    *rect = reducedRect;
+    return reduced;
+}
+
+// MARK: - Border and corners
+
+    /// What finishRow() needs to know. The rows it is given are inside the border, in the full-size result.
+typedef struct Mask {
+    size_t size, borderSize;
+    double radius;
+} Mask;
+
+    /// How much of pixel (X, Y) of the inside of the thumbnail lies within its rounded corners, from 0 to 255.
+    /// DY is the distance of the row's centre from the centre of the corners' circles, or 0 if it isn't next to a corner.
+static unsigned cornerCoverage(const Mask *mask, size_t x, double dy) {
+    double centre = x + 0.5, dx = 0;
+    if (centre < mask->radius) {
+        dx = mask->radius - centre;
+    } else if (centre > mask->size - mask->radius) {
+        dx = centre - (mask->size - mask->radius);
+    }
+    if (dx == 0 || dy == 0) {
+        return 255;
+    }
+        // The share of the pixel inside the circle is close to how far inside the edge its centre is.
+    double coverage = mask->radius - sqrt(dx * dx + dy * dy) + 0.5;
+    return coverage <= 0 ? 0 : coverage >= 1 ? 255 : (unsigned)lround(coverage * 255);
+}
+
+    /// PWResampleRowFunction which clears the border either side of ROW and masks its corners.
+static void finishRow(void *context, size_t y, uint8_t *row, size_t width) {
+    const Mask *mask = context;
+    if (mask->borderSize > 0) {
+        memset(row - mask->borderSize * 4, 0, mask->borderSize * 4);
+        memset(row + width * 4, 0, mask->borderSize * 4);
+    }
+    double centre = y + 0.5, dy = 0;
+    if (centre < mask->radius) {
+        dy = mask->radius - centre;
+    } else if (centre > mask->size - mask->radius) {
+        dy = centre - (mask->size - mask->radius);
+    }
+    if (dy == 0) {
+        return;
+    }
+        // Only the ends of the row can be outside the corners.
+    size_t end = (size_t)ceil(mask->radius);
+    for (size_t x = 0; x < width; x++) {
+        if (x == end && width > 2 * end) {
+            x = width - end;
+        }
+        unsigned coverage = cornerCoverage(mask, x, dy);
+        if (coverage < 255) {
+                // The pixels are premultiplied, so the colour fades out with the alpha.
+            uint8_t *pixel = row + x * 4;
+            for (size_t c = 0; c < 4; c++) {
+                pixel[c] = (uint8_t)((pixel[c] * coverage + 127) / 255);
+            }
+        }
+    }
+}
+
+    /// Make the thumbnail from RECT of SOURCE. OPTIONS have been checked.
+static PWImageBuffer *createThumbnail(const PWImageBuffer *source, PWResampleRect rect, size_t thumbnailSize, const PWThumbnailOptions *options) {
+    if (options->borderSize == 0 && options->cornerRadius == 0) {
+        return PWResampleCreateFromRect(source, rect, thumbnailSize, thumbnailSize, options->filter);
+    }
+
+    Mask mask = { thumbnailSize, options->borderSize, options->cornerRadius };
+    if (mask.radius > thumbnailSize / 2.0) {
+        mask.radius = thumbnailSize / 2.0;
+    }
+    size_t fullSize = thumbnailSize + 2 * options->borderSize;
+    PWImageBuffer *result = PWImageBufferCreate(fullSize, fullSize, PWPixelFormat_RGBA8888);
+    if (!result) {
+        return NULL;
+    }
+    size_t borderRows = options->borderSize;
+    if (borderRows > 0) {
+        memset(PWImageBufferRow(result, 0), 0, borderRows * result->bytesPerRow);
+        memset(PWImageBufferRow(result, borderRows + thumbnailSize), 0, borderRows * result->bytesPerRow);
+    }
+    PWImageRect insideRect = { borderRows, borderRows, thumbnailSize, thumbnailSize };
+    PWImageBuffer *inside = PWImageBufferCreateSubImage(result, insideRect);
+    PWError error = inside ? PWError_None : PWError_OutOfMemory;
+
+    if (!error && source->format == PWPixelFormat_RGBA8888) {
+        error = PWResampleIntoBuffer(source, rect, inside, options->filter, finishRow, &mask);
+    } else if (!error) {
+            // Scale in the source's own format, as that is what the resampler works in, then convert and mask each row.
+        PWImageBuffer *scaled = PWResampleCreateFromRect(source, rect, thumbnailSize, thumbnailSize, options->filter);
+        if (!scaled) {
+            error = PWError_OutOfMemory;
+        } else {
+            for (size_t y = 0; y < thumbnailSize; y++) {
+                uint8_t *row = PWImageBufferRow(inside, y);
+                PWImageBufferConvertRowToRGBX(scaled, y, 0, thumbnailSize, row);
+                finishRow(&mask, y, row, thumbnailSize);
+            }
+            PWImageBufferRelease(scaled);
+        }
+    }
+    PWImageBufferRelease(inside);
+    if (error) {
+        PWImageBufferRelease(result);
+        return NULL;
+    }
+    return result;
+}
+
+PWImageBuffer *PWThumbnailCreateWithOptions(const PWImageBuffer *source, size_t thumbnailSize, const PWThumbnailOptions *options) {
+    if (!source || thumbnailSize == 0) {
+        return NULL;
+    }
+    PWThumbnailOptions defaults = PWThumbnailOptionsInit();
+    if (!options) {
+        options = &defaults;
+    }
+    if (!(options->cornerRadius >= 0) || (unsigned)options->filter >= PWResampleFilter_NUM_FILTERS) {
+        return NULL;
+    }
+    PWResampleRect rect = cropRect(source, thumbnailSize);
+    PWImageBuffer *reduced = options->filter == PWResampleFilter_Area ? createBlockAveragedCrop(source, &rect, thumbnailSize) : NULL;
+    PWImageBuffer *result = createThumbnail(reduced ? reduced : source, rect, thumbnailSize, options);
+    PWImageBufferRelease(reduced);
+    return result;
+}
@@ -0,0 +1,64 @@
+/*!
+ @header PWThumbnail
+ @abstract Portable thumbnail generation for stereogram tiles.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+ */
+
+#ifndef PWThumbnail_h
+#define PWThumbnail_h
+
+#include "PWResample.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Return a square thumbnail of SOURCE.
+ *
+ * The source is scaled to fill a THUMBNAILSIZE x THUMBNAILSIZE square, keeping its aspect ratio, and the
+ * overflow is cropped equally from both sides. This matches
+ * -[UIImage thumbnailImage:transparentBorder:cornerRadius:interpolationQuality:] with no border or corners,
+ * except that every source pixel is averaged in with PWResampleFilter_Area rather than sampling a few of them,
+ * which aliases badly at this much reduction.
+ *
+ * @param source        The image to shrink. Any format.
+ * @param thumbnailSize Length of each side of the result, in pixels.
+ * @return A new buffer in the same format as SOURCE, or NULL on failure.
+ */
+PWImageBuffer *PWThumbnailCreate(const PWImageBuffer *source, size_t thumbnailSize);
+
+/*! How PWThumbnailCreateWithOptions() finishes the thumbnail. Set up with PWThumbnailOptionsInit(). */
+typedef struct PWThumbnailOptions {
+        /*! Width in pixels of a transparent border added around the thumbnail, which makes it that much bigger on each side. */
+    size_t borderSize;
+        /*! Radius in pixels of the thumbnail's rounded corners, which are anti-aliased. 0 for square corners. */
+    double cornerRadius;
+        /*! How the source is scaled. */
+    PWResampleFilter filter;
+} PWThumbnailOptions;
+
+/*! Options for a thumbnail with no border and square corners, scaled with PWResampleFilter_Area, as PWThumbnailCreate() makes. */
+PWThumbnailOptions PWThumbnailOptionsInit(void);
+
+/*!
+ * Return a square thumbnail of SOURCE with a transparent border and rounded corners, as
+ * -[UIImage thumbnailImage:transparentBorder:cornerRadius:interpolationQuality:] makes.
+ *
+ * That method scales the image, crops it, adds an alpha channel and a border, and masks the corners, drawing into a
+ * new bitmap at each step. Here only the cropped part of the source is scaled, straight into the inside of the result,
+ * and the border and corner mask are applied to each row as soon as it has been made, so there is one pass and one
+ * image allocated. Sources in other formats than RGBA8888 are scaled first, then converted and masked in one pass.
+ *
+ * @param options May be NULL for the defaults.
+ * @return A new buffer THUMBNAILSIZE + 2 x the border on each side, or NULL on failure. It is in RGBA8888 if there is a
+ *         border or rounded corners, as these must be transparent, and in the format of SOURCE if not.
+ */
+PWImageBuffer *PWThumbnailCreateWithOptions(const PWImageBuffer *source, size_t thumbnailSize, const PWThumbnailOptions *options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWThumbnail_h */
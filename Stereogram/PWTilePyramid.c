@@ -0,0 +1,225 @@
+//
+//  PWTilePyramid.c
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+#include "PWTilePyramid.h"
+#include "PWStorage.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const char *const PWTilePyramidManifestFileName = "Pyramid.plist";
+
+    /// Manifest keys, in the order they are written.
+static const char *const WidthKey = "Width", *const HeightKey = "Height", *const TileSizeKey = "TileSize", *const LevelsKey = "Levels";
+
+// MARK: - Geometry
+
+void PWTilePyramidInfoInit(PWTilePyramidInfo *info, size_t width, size_t height, size_t tileSize) {
+    info->width = width;
+    info->height = height;
+    info->tileSize = tileSize;
+    info->levelCount = 1;
+    while (tileSize && (width > tileSize || height > tileSize)) {
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+        info->levelCount++;
+    }
+}
+
+void PWTilePyramidLevelSize(const PWTilePyramidInfo *info, unsigned level, size_t *width, size_t *height) {
+    size_t levelWidth = info->width, levelHeight = info->height;
+    for (unsigned i = 0; i < level; i++) {
+        levelWidth = (levelWidth + 1) / 2;
+        levelHeight = (levelHeight + 1) / 2;
+    }
+    *width = levelWidth;
+    *height = levelHeight;
+}
+
+void PWTilePyramidTileGrid(const PWTilePyramidInfo *info, unsigned level, size_t *columns, size_t *rows) {
+    size_t width, height;
+    PWTilePyramidLevelSize(info, level, &width, &height);
+    *columns = (width + info->tileSize - 1) / info->tileSize;
+    *rows = (height + info->tileSize - 1) / info->tileSize;
+}
+
+bool PWTilePyramidTilePath(char *output, size_t outputSize, const char *directory, unsigned level, size_t column, size_t row) {
+    int length = snprintf(output, outputSize, "%s/%u-%zu-%zu.jpg", directory, level, column, row);
+    return length > 0 && (size_t)length < outputSize;
+}
+
+// MARK: - Writing
+
+static PWError writeFile(const char *path, const void *bytes, size_t length) {
+    return PWStorageWriteFile(PWStorageDefault(), path, bytes, length, false);
+}
+
+    /// Encode and save every tile of one level. TILEPIXELS is scratch space for one RGBA tile.
+static PWError writeLevel(const PWImageBuffer *level, unsigned levelIndex, const char *directory, size_t tileSize,
+                          const PWJPEGEncodeOptions *options, PWTilePyramidShouldContinue shouldContinue, void *context,
+                          uint8_t *tilePixels, PWDataBuffer *output) {
+    size_t tileBytesPerRow = tileSize * 4;
+    char path[PATH_MAX];
+    for (size_t tileY = 0, row = 0; tileY < level->height; tileY += tileSize, row++) {
+        size_t tileHeight = level->height - tileY < tileSize ? level->height - tileY : tileSize;
+        for (size_t tileX = 0, column = 0; tileX < level->width; tileX += tileSize, column++) {
+            if (shouldContinue && !shouldContinue(context)) {
+                return PWError_Cancelled;
+            }
+            size_t tileWidth = level->width - tileX < tileSize ? level->width - tileX : tileSize;
+                // Converting just this tile's rows keeps planar sources compact; the encoder only needs one tile at a time.
+            for (size_t y = 0; y < tileHeight; y++) {
+                PWImageBufferConvertRowToRGBX(level, tileY + y, tileX, tileWidth, tilePixels + y * tileBytesPerRow);
+            }
+            PWImageBuffer *tile = PWImageBufferCreateWithData(tilePixels, tileWidth, tileHeight, tileBytesPerRow, PWPixelFormat_RGBA8888);
+            if (!tile) {
+                return PWError_OutOfMemory;
+            }
+            output->length = 0;
+            PWError error = PWJPEGEncode(tile, options, output);
+            PWImageBufferRelease(tile);
+            if (error == PWError_None) {
+                error = PWTilePyramidTilePath(path, sizeof(path), directory, levelIndex, column, row)
+                      ? writeFile(path, output->bytes, output->length) : PWError_InvalidParameter;
+            }
+            if (error != PWError_None) {
+                return error;
+            }
+        }
+    }
+    return PWError_None;
+}
+
+static PWError writeManifest(const char *directory, const PWTilePyramidInfo *info) {
+    char path[PATH_MAX];
+    int pathLength = snprintf(path, sizeof(path), "%s/%s", directory, PWTilePyramidManifestFileName);
+    if (pathLength <= 0 || pathLength >= (int)sizeof(path)) {
+        return PWError_InvalidParameter;
+    }
+    char propertyList[1024];
+    int propertyListLength = snprintf(propertyList, sizeof(propertyList),
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+        "<plist version=\"1.0\">\n<dict>\n"
+        "\t<key>%s</key>\n\t<integer>%zu</integer>\n"
+        "\t<key>%s</key>\n\t<integer>%zu</integer>\n"
+        "\t<key>%s</key>\n\t<integer>%zu</integer>\n"
+        "\t<key>%s</key>\n\t<integer>%u</integer>\n"
+        "</dict>\n</plist>\n",
+        WidthKey, info->width, HeightKey, info->height, TileSizeKey, info->tileSize, LevelsKey, info->levelCount);
+    return writeFile(path, propertyList, (size_t)propertyListLength);
+}
+
+PWError PWTilePyramidWrite(const PWImageBuffer *image, const char *directory, size_t tileSize,
+                           const PWJPEGEncodeOptions *options, PWTilePyramidShouldContinue shouldContinue, void *context,
+                           PWTilePyramidInfo *info) {
+    if (!image || !directory || tileSize == 0) {
+        return PWError_InvalidParameter;
+    }
+    PWError error = PWStorageMakeDirectory(PWStorageDefault(), directory, false);
+    if (error != PWError_None) {
+        return error;
+    }
+    PWTilePyramidInfo pyramid;
+    PWTilePyramidInfoInit(&pyramid, image->width, image->height, tileSize);
+
+    uint8_t *tilePixels = malloc(tileSize * tileSize * 4);
+    PWDataBuffer output;
+    if (!tilePixels || !PWDataBufferInit(&output, tileSize * tileSize)) {
+        free(tilePixels);
+        return PWError_OutOfMemory;
+    }
+
+        // Each level is made from the one before, so only two levels are in memory at once.
+    PWImageBuffer *level = PWImageBufferRetain((PWImageBuffer *)image);
+    for (unsigned levelIndex = 0; levelIndex < pyramid.levelCount && error == PWError_None; levelIndex++) {
+        if (levelIndex > 0) {
+            PWImageBuffer *smaller = PWImageBufferCreateHalfSize(level);
+            PWImageBufferRelease(level);
+            level = smaller;
+            if (!level) {
+                error = PWError_OutOfMemory;
+                break;
+            }
+        }
+        error = writeLevel(level, levelIndex, directory, tileSize, options, shouldContinue, context, tilePixels, &output);
+    }
+    PWImageBufferRelease(level);
+    PWDataBufferFree(&output);
+    free(tilePixels);
+
+        // The manifest marks the pyramid complete, so it mustn't be written for an image that has changed since.
+    if (error == PWError_None && shouldContinue && !shouldContinue(context)) {
+        error = PWError_Cancelled;
+    }
+    if (error == PWError_None) {
+        error = writeManifest(directory, &pyramid);
+    }
+    if (error == PWError_None && info) {
+        *info = pyramid;
+    }
+    return error;
+}
+
+// MARK: - Reading
+
+    /// Find <key>KEY</key> followed by an <integer> in a property list we wrote. Returns false if it isn't there.
+static bool readInteger(const char *propertyList, const char *key, size_t *value) {
+    char keyElement[64];
+    snprintf(keyElement, sizeof(keyElement), "<key>%s</key>", key);
+    const char *found = strstr(propertyList, keyElement);
+    if (!found) {
+        return false;
+    }
+    const char *integer = strstr(found, "<integer>");
+    if (!integer) {
+        return false;
+    }
+    char *end = NULL;
+    unsigned long long number = strtoull(integer + strlen("<integer>"), &end, 10);
+    if (end == integer + strlen("<integer>")) {
+        return false;
+    }
+    *value = (size_t)number;
+    return true;
+}
+
+PWError PWTilePyramidReadInfo(const char *directory, PWTilePyramidInfo *info) {
+    if (!directory || !info) {
+        return PWError_InvalidParameter;
+    }
+    char path[PATH_MAX];
+    int pathLength = snprintf(path, sizeof(path), "%s/%s", directory, PWTilePyramidManifestFileName);
+    if (pathLength <= 0 || pathLength >= (int)sizeof(path)) {
+        return PWError_InvalidParameter;
+    }
+    enum { MaximumManifestLength = 2048 };
+    PWDataBuffer contents;
+    if (!PWDataBufferInit(&contents, MaximumManifestLength)) {
+        return PWError_OutOfMemory;
+    }
+    PWError error = PWStorageReadFile(PWStorageDefault(), path, 0, MaximumManifestLength - 1, &contents);
+    size_t width, height, tileSize, levelCount;
+    if (error == PWError_None) {
+        contents.bytes[contents.length] = '\0';
+        const char *text = (const char *)contents.bytes;
+        if (!readInteger(text, WidthKey, &width) || !readInteger(text, HeightKey, &height)
+            || !readInteger(text, TileSizeKey, &tileSize) || !readInteger(text, LevelsKey, &levelCount)
+            || width == 0 || height == 0 || tileSize == 0) {
+            error = PWError_InvalidFormat;
+        }
+    }
+    PWDataBufferFree(&contents);
+    if (error != PWError_None) {
+        return error;
+    }
+    PWTilePyramidInfoInit(info, width, height, tileSize);
+    return info->levelCount == levelCount ? PWError_None : PWError_InvalidFormat;
+}
@@ -0,0 +1,90 @@
+/*!
+ @header PWTilePyramid
+ @abstract Writes a stereogram as square JPEG tiles at successively halved resolutions, for zooming without decoding the whole image.
+ @author Patrick Wallace
+ @copyright (c) 2026 Patrick Wallace. All rights reserved.
+
+ A pyramid is a directory holding a manifest (Pyramid.plist) and one JPEG per tile. Level 0 is full size, level 1 is
+ half size and so on, up to the first level that fits in a single tile. Tile (column, row) of level L is named
+ "L-column-row.jpg" and covers pixels starting at (column * tileSize, row * tileSize) of that level.
+ Tiles on the right and bottom edges are smaller than tileSize if the level isn't an exact multiple.
+ */
+
+#ifndef PWTilePyramid_h
+#define PWTilePyramid_h
+
+#include "PWImageBuffer.h"
+#include "PWJPEGEncoder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+        /*! Tile size used by the app. Matches the default tile size of CATiledLayer. */
+    PWTilePyramidDefaultTileSize = 256
+};
+
+/*! Name of the manifest file in a pyramid directory. It is written last, so a pyramid without one is incomplete. */
+extern const char *const PWTilePyramidManifestFileName;
+
+/*! The shape of a pyramid. */
+typedef struct PWTilePyramidInfo {
+        /*! Size of the full-resolution image in pixels. */
+    size_t width, height;
+        /*! Width and height of each tile in pixels. */
+    size_t tileSize;
+        /*! Number of levels, including level 0. */
+    unsigned levelCount;
+} PWTilePyramidInfo;
+
+/*! Fill INFO for an image of WIDTH x HEIGHT cut into tiles of TILESIZE, calculating the number of levels. */
+void PWTilePyramidInfoInit(PWTilePyramidInfo *info, size_t width, size_t height, size_t tileSize);
+
+/*! Size in pixels of LEVEL. Each level is half the size of the one before, rounding up. */
+void PWTilePyramidLevelSize(const PWTilePyramidInfo *info, unsigned level, size_t *width, size_t *height);
+
+/*! Number of tile columns and rows in LEVEL. */
+void PWTilePyramidTileGrid(const PWTilePyramidInfo *info, unsigned level, size_t *columns, size_t *rows);
+
+/*!
+ * Write the path of a tile into OUTPUT.
+ *
+ * @return false if the path didn't fit in OUTPUTSIZE bytes.
+ */
+bool PWTilePyramidTilePath(char *output, size_t outputSize, const char *directory, unsigned level, size_t column, size_t row);
+
+/*! Called before each tile is written. Return false to stop writing the pyramid, e.g. because the image has changed. */
+typedef bool (*PWTilePyramidShouldContinue)(void *context);
+
+/*!
+ * Cut IMAGE into a tile pyramid under DIRECTORY.
+ *
+ * DIRECTORY is created if needed. Any existing tiles are overwritten but stale ones are not removed, so delete an
+ * old pyramid with PWLibraryRemoveDirectory() first. Tiles are always 3-channel JPEGs; any alpha channel is dropped.
+ *
+ * @param image     The full-resolution image, in any pixel format.
+ * @param directory Where to write the pyramid.
+ * @param tileSize  Width and height of the tiles, normally PWTilePyramidDefaultTileSize.
+ * @param options   JPEG settings for the tiles, or NULL for the defaults.
+ * @param shouldContinue If not NULL, called with CONTEXT before each tile. Once it returns false no more is written.
+ * @param context   Passed to SHOULDCONTINUE.
+ * @param info      If not NULL, receives the shape of the pyramid written.
+ * @return PWError_None on success, or PWError_Cancelled if SHOULDCONTINUE stopped it, leaving the pyramid incomplete.
+ */
+PWError PWTilePyramidWrite(const PWImageBuffer *image, const char *directory, size_t tileSize,
+                           const PWJPEGEncodeOptions *options, PWTilePyramidShouldContinue shouldContinue, void *context,
+                           PWTilePyramidInfo *info);
+
+/*!
+ * Read the manifest of the pyramid in DIRECTORY.
+ *
+ * @return PWError_None on success, PWError_IO if there is no complete pyramid there or PWError_InvalidFormat if the manifest is damaged.
+ */
+PWError PWTilePyramidReadInfo(const char *directory, PWTilePyramidInfo *info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWTilePyramid_h */
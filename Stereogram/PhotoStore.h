@@ -5,6 +5,7 @@
  */
 
 @import UIKit;
+#import "ImageCacheStatistics.h"
 @class Stereogram;
 
 NS_ASSUME_NONNULL_BEGIN
@@ -54,6 +55,34 @@ NS_ASSUME_NONNULL_BEGIN
                                             rightImage: (UIImage *)rightImage
                                                  error: (NSError **)errorPtr;
 
+/*!
+ * Create a new Stereogram object from an MPO file, e.g. one opened in this app from another, and add it to the store.
+ *
+ * The photos are copied out of the file as they are; see +[Stereogram stereogramWithDirectoryURL:MPOData:error:].
+ *
+ * @param url      A file URL to the MPO file.
+ * @param errorPtr A Pointer to an NSError object to return errors to the caller.
+ * @returns A new Stereogram object or nil if the file couldn't be read or is not a stereo MPO file.
+ */
+-(nullable Stereogram *) importStereogramFromMPOURL: (NSURL *)url
+                                              error: (NSError **)errorPtr;
+
+/*!
+ * Create new Stereogram objects from side-by-side JPEG files made by other tools, and add them to the store.
+ *
+ * Each image is cut down the middle into the left and right photos. Where the middle falls on a JPEG block boundary,
+ * as it does for the usual sizes, the halves are cut without decoding the image, so they hold exactly its pixels;
+ * see PWImport.h. The files are read several at once, and the date taken is the date each file was last changed.
+ *
+ * @param urls      File URLs to the JPEG files.
+ * @param crossEyed YES if the images are for cross-eyed viewing, with the right eye's photo on the left.
+ * @param errorPtr  Receives the error for the first file which couldn't be imported, if any.
+ * @returns The new Stereogram objects, in the order of URLS, leaving out any which failed.
+ */
+-(NSArray<Stereogram *> *) importSideBySideJPEGsFromURLs: (NSArray<NSURL *> *)urls
+                                                crossEyed: (BOOL)crossEyed
+                                                    error: (NSError **)errorPtr;
+
 /*! Retrieves a stereogram from the collection
  @return index The index of the stereogram to return.
  */
@@ -96,6 +125,92 @@ NS_ASSUME_NONNULL_BEGIN
 -(BOOL) copyStereogramToCameraRoll: (NSUInteger)index
                              error: (NSError **)errorPtr;
 
+#pragma mark - Duplicates
+
+/*!
+ * Find stereograms which look like shots of the same scene, by comparing their perceptual hashes (see Stereogram.perceptualHash).
+ *
+ * No photos are decoded, so this takes milliseconds even for thousands of stereograms. Stereograms without a hash, e.g.
+ * those imported side by side and not yet hashed while the app was idle, are left out; see addMissingPerceptualHashes:.
+ *
+ * @param maximumDistance How many of the 64 bits of two hashes may differ. PWPerceptualHashNearDuplicateDistance suits re-shoots.
+ * @return An array of groups, each an array of two or more Stereogram objects in the order they are in the store.
+ *         The groups are in the order of their first stereogram.
+ */
+-(NSArray *) duplicateGroupsWithMaximumDistance: (NSUInteger)maximumDistance;
+
+/*!
+ * Find the stereograms which look like STEREOGRAM, in the order they are in the store. STEREOGRAM itself is left out.
+ * Returns an empty array if it has no perceptual hash.
+ */
+-(NSArray *) stereogramsLike: (Stereogram *)stereogram
+             maximumDistance: (NSUInteger)maximumDistance;
+
+/*!
+ * Work out the perceptual hash of each stereogram which doesn't have one, e.g. those made by earlier versions of the app.
+ * The store does this itself, one stereogram at a time, while the app is idle (see stereogramWasOpened:); call this
+ * to have them all hashed at once. It decodes their left photos, so call it from a background thread.
+ *
+ * @param errorPtr Optional pointer to an error object to return error information.
+ * @return YES if every stereogram now has a hash, NO if any failed. The others are still updated.
+ */
+-(BOOL) addMissingPerceptualHashes: (NSError **)errorPtr;
+
+#pragma mark - Syncing
+
+/*!
+ * Bring a copy of the photo folder in the directory at URL up to date, e.g. on an external drive or in a synced folder.
+ *
+ * The first sync starts a journal of the changes made to the store, and copies everything. Later ones copy only the
+ * files created, replaced or deleted since, and carry on where an interrupted sync stopped; see PWSync.h. This reads
+ * and hashes photos, so call it from a background thread.
+ *
+ * @param url      A file URL to the directory to copy to. It is created if its parent exists.
+ * @param errorPtr Optional pointer to an error object to return error information.
+ * @return YES if the copy is up to date, NO if the sync failed.
+ */
+-(BOOL) syncToDirectoryURL: (NSURL *)url
+                     error: (NSError **)errorPtr;
+
+#pragma mark - Building images ahead of time
+
+/*!
+ * Note that the user has opened STEREOGRAM, so it is worth building its images for other viewing methods ahead of time.
+ *
+ * While the app is idle the store builds the images for the methods the user is most likely to switch to, for the few
+ * stereograms opened most recently, newest first, so changing the viewing method doesn't have to wait. One image is built
+ * at a time, at background priority. Nothing new is started while a stereogram is building an image the user is waiting
+ * for (see +[Stereogram isBuildingImage]), in Low Power Mode, while the app is inactive, or once the cached images hold
+ * precomputeBudgetBytes. A memory warning forgets the stereograms opened so far. Call this on the main thread.
+ *
+ * Stereograms without a perceptual hash, e.g. those imported side by side, are hashed the same way, one at a time,
+ * once there are no images to build, whether or not any stereogram has been opened.
+ */
+-(void) stereogramWasOpened: (Stereogram *)stereogram;
+
+/*!
+ * Most bytes the cached images of all the stereograms may hold for the store to start building another image ahead of
+ * time. Defaults to an eighth of the device's memory. Set it to 0 to stop building images ahead of time.
+ */
+@property (nonatomic) NSUInteger precomputeBudgetBytes;
+
+#pragma mark - Memory accounting
+
+/*!
+ * Cache statistics for all the stereograms in the app.
+ *
+ * This is the same as +[Stereogram globalCacheStatistics], so peakBytes is the true high-water mark of all the cached images together.
+ */
+@property (nonatomic, readonly) ImageCacheStatistics cacheStatistics;
+
+/*!
+ * A report of cache memory use, suitable for logging.
+ *
+ * The first line holds the totals, followed by one line for each stereogram in the store that is holding cached images
+ * or has had images evicted, largest first, and a last line for the buffer pool the images take their pixel memory from
+ * (see PWBufferPool.h). The store writes this to the log whenever the app receives a memory warning.
+ */
+-(NSString *) cacheReport;
 
 
 @end
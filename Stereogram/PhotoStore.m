@@ -10,11 +10,24 @@
 #import "PWFunctional.h"
 #import "Stereogram.h"
 #import "ErrorData.h"
+#import "ImageManager.h"
 #import "NSError_AlertSupport.h"
 #import "UIImage+Resize.h"
+#import "UIImage+PWImageBuffer.h"
+#include "PWImport.h"
+#include "PWJournal.h"
+#include "PWPerceptualHash.h"
+#include "PWStorage.h"
+#include "PWSync.h"
 
 NSString *const PhotoStoreErrorDomain = @"PhotoStore";
 
+    /// Number of recently opened stereograms whose images for other viewing methods are built ahead of time.
+static const NSUInteger RecentStereogramCount = 5;
+
+    /// How long to wait before looking again for a chance to build images ahead of time, when the app is busy.
+static const NSTimeInterval PrecomputeRetryDelay = 1.0;
+
     /*! PhotoStore private extensions. */
 @interface PhotoStore () {
     
@@ -23,6 +36,18 @@ NSString *const PhotoStoreErrorDomain = @"PhotoStore";
     
         /*! Array of stereogram objects currently stored. */
     NSMutableArray *_stereograms;
+
+        /*! Stereograms opened most recently, newest first, whose other images are built ahead of time. Main thread only. */
+    NSMutableArray *_recentStereograms;
+
+        /*! Serial queue building images ahead of time, at background priority. */
+    dispatch_queue_t _precomputeQueue;
+
+        /*! Stereograms without a perceptual hash, e.g. imported side by side, which are hashed while the app is idle. Main thread only. */
+    NSMutableArray *_stereogramsToHash;
+
+        /*! YES while an image is being built or a stereogram hashed ahead of time, or another look is scheduled. Main thread only. */
+    BOOL _precomputeScheduled;
 }
 
 @end
@@ -41,9 +66,9 @@ NSString *const PhotoStoreErrorDomain = @"PhotoStore";
 			}
 			return nil;
 		}
-		NSFileManager *fileManager = [NSFileManager defaultManager];
-		BOOL isDir = NO, res = [fileManager fileExistsAtPath:folderURL.path isDirectory:&isDir];
-		if (!(isDir && res)) {
+		PWStorageItemInfo info;
+		if (PWStorageGetInfo(PWStorageDefault(), folderURL.fileSystemRepresentation, &info) != PWError_None
+		    || info.kind != PWStorageItem_Directory) {
 			if (errorPtr) {
 				*errorPtr = [NSError unknownErrorWithLocation:@"PhotoStore initWithFolderURL:error"];
 			}
@@ -52,10 +77,48 @@ NSString *const PhotoStoreErrorDomain = @"PhotoStore";
 		_photoFolderURL = folderURL;
 		_stereograms = [Stereogram allStereogramsUnderURL:_photoFolderURL error:errorPtr].mutableCopy;
 		if (!_stereograms) { return nil; }
+
+		_recentStereograms = [NSMutableArray array];
+		_precomputeQueue = dispatch_queue_create("PhotoStore.precompute", DISPATCH_QUEUE_SERIAL);
+		dispatch_set_target_queue(_precomputeQueue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0));
+		_precomputeBudgetBytes = (NSUInteger)([NSProcessInfo processInfo].physicalMemory / 8);
+		_stereogramsToHash = [NSMutableArray array];
+		for (Stereogram *stereogram in _stereograms) {
+			if (!stereogram.hasPerceptualHash) {
+				[_stereogramsToHash addObject:stereogram];
+			}
+		}
+		if (_stereogramsToHash.count > 0) {
+			dispatch_async(dispatch_get_main_queue(), ^{
+				[self precomputeNextImage];
+			});
+		}
+
+			// Log what the caches were holding when memory runs low.
+		[[NSNotificationCenter defaultCenter] addObserver:self
+		                                         selector:@selector(lowMemoryNotification:)
+		                                             name:UIApplicationDidReceiveMemoryWarningNotification
+		                                           object:nil];
 	}
 	return self;
 }
 
+-(void) dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+-(void) lowMemoryNotification: (NSNotification *)notification {
+        // Stop building images ahead of time until the user opens another stereogram.
+    [_recentStereograms removeAllObjects];
+        // Each stereogram frees its own images in response to the same notification, and there is no guarantee which
+        // observer runs first. Wait until they have all run so the report shows what was evicted and what was left,
+        // and so the pixel memory they gave back to the buffer pool can be freed with the rest.
+    dispatch_async(dispatch_get_main_queue(), ^{
+        PWBufferPoolTrim(0);
+        NSLog(@"%@ - Low memory notification. Image cache report:\n%@", self, self.cacheReport);
+    });
+}
+
 - (NSEnumerator * __nonnull)objectEnumerator {
 	return _stereograms.objectEnumerator;
 }
@@ -77,21 +140,54 @@ NSString *const PhotoStoreErrorDomain = @"PhotoStore";
 -(void) addStereogram: (Stereogram *)stereogram {
     if (![_stereograms containsObject:stereogram]) {
         [_stereograms addObject:stereogram];
+        [self hashWhenIdle:stereogram];
+    }
+}
+
+    /// Have STEREOGRAM hashed while the app is idle if it has no perceptual hash. Stereograms are made on background
+    /// threads, so this hands it to the main thread, where the precompute state is kept.
+-(void) hashWhenIdle: (Stereogram *)stereogram {
+    if (!stereogram.hasPerceptualHash) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [_stereogramsToHash addObject:stereogram];
+            [self precomputeNextImage];
+        });
     }
 }
 
 
+    /// Halve the size of a photo from the camera and turn it upright, ready to be saved.
+static UIImage *halfSizeImage(UIImage *image) {
+    UIImage *halfImage = [image uprightImageAtHalfSize];
+    if (!halfImage) {
+        NSLog(@"Failed to halve image %@ with the image core. Redrawing it instead.", image);
+        halfImage = [image resizedImage:CGSizeMake(image.size.width / 2.0, image.size.height / 2.0)
+                   interpolationQuality:kCGInterpolationHigh];
+    }
+    return halfImage;
+}
+
 -(Stereogram *) createStereogramFromLeftImage: (UIImage *)leftImage
                                    rightImage: (UIImage *)rightImage
                                         error: (NSError **)errorPtr {
-    UIImage *scaledLeft  = [leftImage  resizedImage:CGSizeMake(leftImage.size.width / 2.0, leftImage.size.height / 2.0)
-                               interpolationQuality:kCGInterpolationHigh];
-    UIImage *scaledRight = [rightImage resizedImage:CGSizeMake(rightImage.size.width / 2.0, rightImage.size.height / 2.0)
-                               interpolationQuality:kCGInterpolationHigh];
+    UIImage *scaledLeft  = halfSizeImage(leftImage);
+    UIImage *scaledRight = halfSizeImage(rightImage);
     
+        // The halved photos are already image buffers, so measuring them doesn't copy them. Both measurements are made
+        // before the stereogram is saved, so its properties are written and journalled once. Only the alignment is saved;
+        // it is taken out each time the stereogram is composited.
+    PWAlignment alignment;
+    if (![ImageManager estimateAlignmentOfLeftPhoto:scaledLeft rightPhoto:scaledRight alignment:&alignment]) {
+        alignment = (PWAlignment) { 0.0, 0.0, 0.0 };
+    }
+    uint64_t hash;
+    NSNumber *perceptualHash = [ImageManager perceptualHashOfPhoto:scaledLeft hash:&hash] ? @(hash) : nil;
+
     Stereogram *newStereogram = [Stereogram stereogramWithDirectoryURL:_photoFolderURL
                                                              leftImage:scaledLeft
                                                             rightImage:scaledRight
+                                                             alignment:alignment
+                                                        perceptualHash:perceptualHash
                                                                  error:errorPtr];
     if (!newStereogram) {
         return nil;
@@ -100,6 +196,81 @@ NSString *const PhotoStoreErrorDomain = @"PhotoStore";
     return newStereogram;
 }
 
+-(Stereogram *) importStereogramFromMPOURL: (NSURL *)url
+                                     error: (NSError **)errorPtr {
+    NSData *data = [NSData dataWithContentsOfURL:url options:NSDataReadingMappedIfSafe error:errorPtr];
+    if (!data) {
+        return nil;
+    }
+    Stereogram *newStereogram = [Stereogram stereogramWithDirectoryURL:_photoFolderURL
+                                                               MPOData:data
+                                                                 error:errorPtr];
+    if (!newStereogram) {
+        return nil;
+    }
+        // The photos have not been decoded yet, so this costs one decode. Without the hash the stereogram is only left
+        // out of duplicate searches until it is hashed while the app is idle, so the import doesn't fail.
+    NSError *hashError = nil;
+    if (![newStereogram updatePerceptualHash:&hashError]) {
+        NSLog(@"Couldn't work out the perceptual hash of %@: %@", newStereogram, hashError);
+    }
+    [self addStereogram:newStereogram];
+    return newStereogram;
+}
+
+-(NSArray<Stereogram *> *) importSideBySideJPEGsFromURLs: (NSArray<NSURL *> *)urls
+                                                crossEyed: (BOOL)crossEyed
+                                                    error: (NSError **)errorPtr {
+    NSUInteger count = urls.count;
+    NSMutableArray<NSString *> *names = [NSMutableArray arrayWithCapacity:count];
+    const char **namePointers = malloc(count * sizeof(char *)), **paths = malloc(count * sizeof(char *));
+    PWImportResult *results = malloc(count * sizeof(PWImportResult));
+    if (count > 0 && (!namePointers || !paths || !results)) {
+        free(namePointers);
+        free(paths);
+        free(results);
+        if (errorPtr) {
+            *errorPtr = [NSError imageCoreErrorWithCode:PWError_OutOfMemory operation:@"Importing side-by-side photos" path:nil];
+        }
+        return @[];
+    }
+    for (NSUInteger i = 0; i < count; i++) {
+        [names addObject:[NSUUID UUID].UUIDString];
+        namePointers[i] = names[i].fileSystemRepresentation;
+        paths[i] = urls[i].fileSystemRepresentation;
+    }
+        // The view is the one the image was made for, so a cross-eyed image is shown cross-eyed and vice versa.
+    PWImportOptions options = { crossEyed, crossEyed ? ViewingMethod_CrossEye : ViewingMethod_WallEye };
+    PWImportSideBySideFiles(_photoFolderURL.fileSystemRepresentation, namePointers, paths, count, &options, results);
+
+        // The hashes are worked out while the app is idle, as working them out here would mean decoding every photo.
+    NSMutableArray<Stereogram *> *imported = [NSMutableArray arrayWithCapacity:count];
+    NSError *firstError = nil;
+    for (NSUInteger i = 0; i < count; i++) {
+        NSError *error = nil;
+        Stereogram *newStereogram = nil;
+        if (results[i].error != PWError_None) {
+            error = [NSError imageCoreErrorWithCode:results[i].error operation:@"Importing a side-by-side photo" path:urls[i].path];
+        } else {
+            newStereogram = [Stereogram stereogramWithURL:[_photoFolderURL URLByAppendingPathComponent:names[i] isDirectory:YES]
+                                                    error:&error];
+        }
+        if (newStereogram) {
+            [self addStereogram:newStereogram];
+            [imported addObject:newStereogram];
+        } else if (!firstError) {
+            firstError = error;
+        }
+    }
+    free(namePointers);
+    free(paths);
+    free(results);
+    if (firstError && errorPtr) {
+        *errorPtr = firstError;
+    }
+    return imported;
+}
+
 -(BOOL) replaceStereogramAtIndex: (NSUInteger)index
                   withStereogram: (Stereogram *)newStereogram
                            error: (NSError **)errorPtr {
@@ -109,6 +280,8 @@ NSString *const PhotoStoreErrorDomain = @"PhotoStore";
             return NO; // Failed.
         }
         _stereograms[index] = newStereogram;
+        [_stereogramsToHash removeObject:stereogramToGo];
+        [self hashWhenIdle:newStereogram];
     }
     return YES;
 }
@@ -119,6 +292,8 @@ NSString *const PhotoStoreErrorDomain = @"PhotoStore";
         return NO;
     }
     [_stereograms removeObject:stereogram];
+    [_recentStereograms removeObject:stereogram];
+    [_stereogramsToHash removeObject:stereogram];
     return YES;
 }
 
@@ -159,10 +334,257 @@ NSString *const PhotoStoreErrorDomain = @"PhotoStore";
 
 - (NSString *) description {
     NSString *superDescription = [super description];
-    NSString *desc = [NSString stringWithFormat:@"%@ <%lu images loaded>", superDescription, (unsigned long)self.count];
+    ImageCacheStatistics statistics = self.cacheStatistics;
+    NSString *liveBytes = [NSByteCountFormatter stringFromByteCount:ImageCacheStatisticsTotalLiveBytes(&statistics)
+                                                         countStyle:NSByteCountFormatterCountStyleMemory];
+    NSString *desc = [NSString stringWithFormat:@"%@ <%lu images loaded, %@ cached>", superDescription, (unsigned long)self.count, liveBytes];
     return desc;
 }
 
+#pragma mark Duplicates
+
+    /// The stereograms with a perceptual hash, and their hashes in a C array of the same length for the image core to scan.
+    /// Gathering them afresh for each search takes a fraction of a millisecond, and can't go out of date.
+-(NSArray *) hashedStereograms: (NSMutableData *)hashes {
+    NSMutableArray *stereograms = [NSMutableArray arrayWithCapacity:_stereograms.count];
+    for (Stereogram *stereogram in _stereograms) {
+        if (stereogram.hasPerceptualHash) {
+            uint64_t hash = stereogram.perceptualHash;
+            [hashes appendBytes:&hash length:sizeof(hash)];
+            [stereograms addObject:stereogram];
+        }
+    }
+    return stereograms;
+}
+
+-(NSArray *) duplicateGroupsWithMaximumDistance: (NSUInteger)maximumDistance {
+    NSMutableData *hashes = [NSMutableData data];
+    NSArray *stereograms = [self hashedStereograms:hashes];
+    NSMutableData *groups = [NSMutableData dataWithLength:stereograms.count * sizeof(size_t)];
+    size_t *groupOf = groups.mutableBytes;
+    PWError error = PWPerceptualHashGroup(hashes.bytes, stereograms.count, (unsigned)MIN(maximumDistance, 64), groupOf);
+    if (error != PWError_None) {
+        NSLog(@"Couldn't search %lu stereograms for duplicates (error %d).", (unsigned long)stereograms.count, error);
+        return @[];
+    }
+        // Each group is named by its first member, so the groups are made in order of their first stereogram.
+    NSMutableArray *result = [NSMutableArray array];
+    NSMutableDictionary *groupsByFirst = [NSMutableDictionary dictionary];
+    for (NSUInteger i = 0; i < stereograms.count; i++) {
+        if (groupOf[i] == i) {
+            continue;
+        }
+        NSMutableArray *group = groupsByFirst[@(groupOf[i])];
+        if (!group) {
+            group = [NSMutableArray arrayWithObject:stereograms[groupOf[i]]];
+            groupsByFirst[@(groupOf[i])] = group;
+            [result addObject:group];
+        }
+        [group addObject:stereograms[i]];
+    }
+    return result;
+}
+
+-(NSArray *) stereogramsLike: (Stereogram *)stereogram
+             maximumDistance: (NSUInteger)maximumDistance {
+    if (!stereogram.hasPerceptualHash) {
+        return @[];
+    }
+    NSMutableData *hashes = [NSMutableData data];
+    NSArray *stereograms = [self hashedStereograms:hashes];
+    unsigned distance = (unsigned)MIN(maximumDistance, 64);
+    size_t count = PWPerceptualHashFind(hashes.bytes, stereograms.count, stereogram.perceptualHash, distance, NULL, 0);
+    NSMutableData *matches = [NSMutableData dataWithLength:count * sizeof(size_t)];
+    const size_t *indexes = matches.mutableBytes;
+    PWPerceptualHashFind(hashes.bytes, stereograms.count, stereogram.perceptualHash, distance, matches.mutableBytes, count);
+    NSMutableArray *result = [NSMutableArray arrayWithCapacity:count];
+    for (size_t i = 0; i < count; i++) {
+        if (stereograms[indexes[i]] != stereogram) {
+            [result addObject:stereograms[indexes[i]]];
+        }
+    }
+    return result;
+}
+
+-(BOOL) addMissingPerceptualHashes: (NSError **)errorPtr {
+    BOOL ok = YES;
+    for (Stereogram *stereogram in _stereograms.copy) {
+        if (!stereogram.hasPerceptualHash && ![stereogram updatePerceptualHash:errorPtr]) {
+            ok = NO;
+        }
+    }
+    return ok;
+}
+
+#pragma mark Syncing
+
+-(BOOL) syncToDirectoryURL: (NSURL *)url
+                     error: (NSError **)errorPtr {
+        // The journal's first entries are every file already in the store, so there is no need for it until now.
+    const char *rootPath = _photoFolderURL.fileSystemRepresentation;
+    PWSyncStatistics statistics;
+    PWError error = PWJournalCreate(rootPath);
+    if (error == PWError_None) {
+        error = PWSyncLibrary(rootPath, PWStoragePOSIX(), url.fileSystemRepresentation, NULL, &statistics);
+    }
+    if (error != PWError_None) {
+        if (errorPtr) {
+            *errorPtr = [NSError imageCoreErrorWithCode:error operation:@"Syncing the photos" path:url.path];
+        }
+        return NO;
+    }
+    NSLog(@"Synced to %@: sent %lu files (%llu bytes), %lu unchanged, %lu deleted.", url.path, (unsigned long)statistics.filesSent,
+          (unsigned long long)statistics.bytesSent, (unsigned long)statistics.filesUnchanged, (unsigned long)statistics.itemsDeleted);
+    return YES;
+}
+
+#pragma mark Building images ahead of time
+
+    /// The viewing methods to build ahead of time for a stereogram shown with VIEWINGMETHOD, the likeliest first.
+    /// Cross-eyed and wall-eyed viewers usually try the other one, and anyone else is most likely to try cross-eyed.
+static NSArray *alternateViewingMethods(enum ViewingMethod viewingMethod) {
+    enum ViewingMethod partner = (viewingMethod == ViewingMethod_CrossEye) ? ViewingMethod_WallEye : ViewingMethod_CrossEye;
+    NSMutableArray *methods = [NSMutableArray arrayWithObject:@(partner)];
+    for (int method = 0; method < ViewingMethod_NUM_METHODS; method++) {
+        if (method != viewingMethod && method != partner) {
+            [methods addObject:@(method)];
+        }
+    }
+    return methods;
+}
+
+-(void) stereogramWasOpened: (Stereogram *)stereogram {
+    [_recentStereograms removeObject:stereogram];
+    [_recentStereograms insertObject:stereogram atIndex:0];
+    if (_recentStereograms.count > RecentStereogramCount) {
+        [_recentStereograms removeLastObject];
+    }
+    [self precomputeNextImage];
+}
+
+    /// NO if the user is doing something which needs the CPU, or the device needs to save power.
+-(BOOL) isIdle {
+    if ([UIApplication sharedApplication].applicationState != UIApplicationStateActive || [Stereogram isBuildingImage]) {
+        return NO;
+    }
+    NSProcessInfo *processInfo = [NSProcessInfo processInfo];
+    return !([processInfo respondsToSelector:@selector(isLowPowerModeEnabled)] && processInfo.lowPowerModeEnabled);
+}
+
+    /// Find the next image to build ahead of time: the likeliest alternative for each recent stereogram, newest first,
+    /// then the next likeliest for each, and so on. Returns nil if they have all been built.
+-(Stereogram *) nextStereogramToPrecompute: (enum ViewingMethod *)viewingMethodPtr {
+    for (NSUInteger rank = 0; rank + 1 < ViewingMethod_NUM_METHODS; rank++) {
+        for (Stereogram *stereogram in _recentStereograms) {
+            enum ViewingMethod viewingMethod = (enum ViewingMethod)[alternateViewingMethods(stereogram.viewingMethod)[rank] integerValue];
+            if (![stereogram hasCachedImageForViewingMethod:viewingMethod]) {
+                *viewingMethodPtr = viewingMethod;
+                return stereogram;
+            }
+        }
+    }
+    return nil;
+}
+
+    /// Build the next image ahead of time, if the app is idle and there is room for it, and then look for the one after.
+    /// Once all the images are built, or there is no room for more, hash the stereograms which have no perceptual hash.
+    /// Only one image is built or photo hashed at a time, so foreground work waits for at most one to finish before it
+    /// has the CPU to itself.
+-(void) precomputeNextImage {
+        // Without room for images, try again when the next stereogram is opened, by when some images may have been released.
+    ImageCacheStatistics statistics = self.cacheStatistics;
+    BOOL roomForImages = _recentStereograms.count > 0 && ImageCacheStatisticsTotalLiveBytes(&statistics) < self.precomputeBudgetBytes;
+    if (_precomputeScheduled || (!roomForImages && _stereogramsToHash.count == 0)) {
+        return;
+    }
+    _precomputeScheduled = YES;
+    if (![self isIdle]) {
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(PrecomputeRetryDelay * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+            _precomputeScheduled = NO;
+            [self precomputeNextImage];
+        });
+        return;
+    }
+    enum ViewingMethod viewingMethod;
+    Stereogram *stereogram = roomForImages ? [self nextStereogramToPrecompute:&viewingMethod] : nil;
+    if (!stereogram) {
+        if (_stereogramsToHash.count > 0) {
+            [self hashNextStereogram];
+        } else {
+            _precomputeScheduled = NO;
+        }
+        return;
+    }
+    dispatch_async(_precomputeQueue, ^{
+        NSError *error = nil;
+        BOOL built = [stereogram cacheImageForViewingMethod:viewingMethod error:&error];
+        if (!built) {
+            NSLog(@"%@ - Couldn't build the %ld image of %@ ahead of time: %@", self, (long)viewingMethod, stereogram, error);
+        }
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (!built) {
+                [_recentStereograms removeObject:stereogram];  // Don't keep trying a stereogram which can't be built.
+            }
+            _precomputeScheduled = NO;
+            [self precomputeNextImage];
+        });
+    });
+}
+
+    /// Work out the perceptual hash of the next stereogram without one, on the precompute queue, then look for more work.
+    /// A stereogram which can't be hashed isn't tried again until the app is next launched.
+-(void) hashNextStereogram {
+    Stereogram *stereogram = _stereogramsToHash.firstObject;
+    [_stereogramsToHash removeObjectAtIndex:0];
+    dispatch_async(_precomputeQueue, ^{
+        NSError *error = nil;
+        if (!stereogram.hasPerceptualHash && ![stereogram updatePerceptualHash:&error]) {
+            NSLog(@"%@ - Couldn't work out the perceptual hash of %@ ahead of time: %@", self, stereogram, error);
+        }
+        dispatch_async(dispatch_get_main_queue(), ^{
+            _precomputeScheduled = NO;
+            [self precomputeNextImage];
+        });
+    });
+}
+
+#pragma mark Memory accounting
+
+-(ImageCacheStatistics) cacheStatistics {
+    return [Stereogram globalCacheStatistics];
+}
+
+-(NSString *) cacheReport {
+    ImageCacheStatistics totals = self.cacheStatistics;
+    NSMutableString *report = [NSMutableString stringWithFormat:@"All stereograms: %@", ImageCacheStatisticsDescription(&totals)];
+
+        // Take a snapshot of each stereogram's figures so the sort and the report agree even if other threads are using the caches.
+    NSMutableArray *entries = [NSMutableArray array];
+    for (Stereogram *stereogram in _stereograms) {
+        ImageCacheStatistics statistics = stereogram.cacheStatistics;
+        NSUInteger evictedBytes = 0;
+        for (int tier = 0; tier < ImageCacheTier_NUM_TIERS; tier++) {
+            evictedBytes += statistics.evictedBytes[tier];
+        }
+        NSUInteger liveBytes = ImageCacheStatisticsTotalLiveBytes(&statistics);
+        if (liveBytes > 0 || evictedBytes > 0) {
+            [entries addObject:@{ @"name"       : stereogram.baseURL.lastPathComponent ?: @"(deleted)",
+                                  @"bytes"      : @(liveBytes + evictedBytes),
+                                  @"statistics" : [NSValue valueWithBytes:&statistics objCType:@encode(ImageCacheStatistics)] }];
+        }
+    }
+    [entries sortUsingDescriptors:@[[NSSortDescriptor sortDescriptorWithKey:@"bytes" ascending:NO]]];
+    for (NSDictionary *entry in entries) {
+        ImageCacheStatistics statistics;
+        [entry[@"statistics"] getValue:&statistics];
+        [report appendFormat:@"\n  %@: %@", entry[@"name"], ImageCacheStatisticsDescription(&statistics)];
+    }
+    PWBufferPoolStatistics poolStatistics;
+    PWBufferPoolGetStatistics(&poolStatistics);
+    [report appendFormat:@"\nBuffer pool: %@", BufferPoolStatisticsDescription(&poolStatistics)];
+    return report;
+}
+
 
 -(Stereogram *) stereogramAtIndex: (NSUInteger)index {
     return _stereograms[index];
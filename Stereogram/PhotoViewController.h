@@ -10,7 +10,7 @@
 @import MessageUI;
 #import "FullImageViewController.h"
 #import "StereogramViewController.h"
-@class PhotoStore;
+@class PhotoStore, Stereogram;
 
 /*
  * View controller presenting a view which shows a collection of thumbnail images and allows the user to select or deselect them.
@@ -35,4 +35,11 @@
  */
 @property (nonatomic, strong) PhotoStore *photoStore;
 
+/*!
+ * Show a stereogram which has just been added to the photo store from outside the app, e.g. an MPO file opened in another app.
+ *
+ * @param stereogram The new stereogram. It must already be in photoStore.
+ */
+-(void) showImportedStereogram: (Stereogram *)stereogram;
+
 @end
@@ -23,6 +23,9 @@
 
 static NSString *const IMAGE_THUMBNAIL_CELL_ID = @"CollectionViewCell_Thumbnail";
 
+    /// Stereograms attached to email are scaled down, as full-size ones are too big for many mail servers.
+static const PWExportPreset EmailExportPreset = { PWExportEmailSize, PWExportFormat_JPEG, 0 };
+
 static NSString *formatDeleteMessage(NSUInteger numToDelete) {
     NSString * const postscript = @"This operation cannot be undone.";
     return numToDelete == 1 ? [NSString stringWithFormat:@"Do you really want to delete this photo?\n%@", postscript]
@@ -259,19 +262,27 @@ didDeselectItemAtIndexPath: (NSIndexPath *)indexPath {
                                              handler:copyBlock];
     
     PWActionHandler emailBlock = ^(PWAction *action) {
-        [self sendPhotosViaEmail:self.photoCollectionView.indexPathsForSelectedItems];
+        [self sendPhotosViaEmail:self.photoCollectionView.indexPathsForSelectedItems asMPO:NO];
     };
     PWAction *emailAction = [PWAction actionWithTitle:@"Email"
                                               handler:emailBlock];
-    [_actionSheet addActions:@[cancelAction, deleteAction, copyAction, emailAction]];
+    
+    PWActionHandler emailMPOBlock = ^(PWAction *action) {
+        [self sendPhotosViaEmail:self.photoCollectionView.indexPathsForSelectedItems asMPO:YES];
+    };
+    PWAction *emailMPOAction = [PWAction actionWithTitle:@"Email for 3D viewers (MPO)"
+                                                 handler:emailMPOBlock];
+    [_actionSheet addActions:@[cancelAction, deleteAction, copyAction, emailAction, emailMPOAction]];
     [_actionSheet showFromBarButtonItem:_exportItem
                                animated:YES];
 }
 
--(void) sendPhotosViaEmail: (NSArray *)indexPaths {
+-(void) sendPhotosViaEmail: (NSArray *)indexPaths
+                     asMPO: (BOOL)asMPO {
         /// Present an email message with the selected stereograms attached.
         ///
         /// :param: selectedIndexes - An array of NSIndexPath objects identifying stereograms in the photo store which we want to export.
+        /// :param: asMPO - YES to attach both photos of each stereogram as an MPO file, NO to attach the image for its viewing method.
     
     
             // Abort if there are no email accounts on this device.
@@ -293,8 +304,15 @@ didDeselectItemAtIndexPath: (NSIndexPath *)indexPath {
         return [_photoStore stereogramAtIndex:[object indexAtPosition:1]];
     }];
     for (Stereogram *stereogram in stereograms) {
-        NSString *mimeType = nil;
-        NSData *exportData = [stereogram exportDataWithMimeType:&mimeType error:&error];
+        NSString *mimeType = @"image/mpo";
+        NSData *exportData = nil;
+        if (asMPO) {
+            exportData = [stereogram MPOData:&error];
+        } else {
+            NSArray *mimeTypes = nil;
+            exportData = [stereogram exportDataForPresets:&EmailExportPreset count:1 mimeTypes:&mimeTypes error:&error].firstObject;
+            mimeType = mimeTypes.firstObject;
+        }
         if (!exportData) {
             failedStereogram = stereogram;
             break; // Exit the loop on the first error.
@@ -305,7 +323,7 @@ didDeselectItemAtIndexPath: (NSIndexPath *)indexPath {
     if (failedStereogram) {
         error = error ? error : [NSError unknownErrorWithCaller: @"sendPhotosViaEmail:"
                                                          target: failedStereogram
-                                                         method: @selector(exportDataWithMimeType:error:)];
+                                                         method: asMPO ? @selector(MPOData:) : @selector(exportDataForPresets:count:mimeTypes:error:)];
         [error showAlertWithTitle: @"Error exporting to email" parentViewController: self];
         return;
     }
@@ -323,7 +341,8 @@ didDeselectItemAtIndexPath: (NSIndexPath *)indexPath {
     
     NSUInteger index = 1;
     for (NSArray *stereogramData in allImages) {
-        NSString *fileName = [NSString stringWithFormat:@"Image%lu", (unsigned long)index++];
+            // 3D viewers go by the extension to recognise an MPO file.
+        NSString *fileName = [NSString stringWithFormat:(asMPO ? @"Image%lu.mpo" : @"Image%lu"), (unsigned long)index++];
         [mailVC addAttachmentData:stereogramData[0]
                          mimeType:stereogramData[1]
                          fileName:fileName];
@@ -337,6 +356,19 @@ didDeselectItemAtIndexPath: (NSIndexPath *)indexPath {
 }
 
 
+-(void) showImportedStereogram: (Stereogram *)stereogram {
+    [self.photoCollectionView reloadData];
+    NSUInteger index = 0;
+    for (Stereogram *storedStereogram in self.photoStore.objectEnumerator) {
+        if (storedStereogram == stereogram) {
+            [self showImageAtIndexPath:[NSIndexPath indexPathForItem:index inSection:0]];
+            break;
+        }
+        index++;
+    }
+}
+
+
     /// Present a FullImageViewController in "View" mode showing the image at the given index path.
 -(void) showImageAtIndexPath: (NSIndexPath*)indexPath {
     Stereogram *stereogram = [_photoStore stereogramAtIndex:indexPath.item];
@@ -346,6 +378,7 @@ didDeselectItemAtIndexPath: (NSIndexPath *)indexPath {
                                                                                                   delegate:self
                                                                                                   userInfo:indexPath];
         [self.navigationController pushViewController:imageViewController animated:YES];
+        [_photoStore stereogramWasOpened:stereogram];
     } else {
         NSLog(@"Error accessing image at index %ld", (long)indexPath.item);
     }
@@ -419,6 +452,10 @@ didDeselectItemAtIndexPath: (NSIndexPath *)indexPath {
                 case ViewingMethod_WallEye:
                     stereogram.viewingMethod = ViewingMethod_CrossEye;
                     break;
+                case ViewingMethod_Anaglyph:
+                case ViewingMethod_AnaglyphHalfColour:
+                case ViewingMethod_AnaglyphOptimised:
+                    break;  // The glasses decide which eye sees which photo, so there is nothing to swap.
                 default:
                     [NSException raise:@"Not implemented"
                                 format:@"Viewing method: %ld in stereogram %@ is not implemented.", (long)stereogram.viewingMethod, stereogram];
@@ -6,6 +6,9 @@
 */
 
 @import UIKit;
+#import "ImageCacheStatistics.h"
+#include "PWAlign.h"
+#include "PWExport.h"
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -15,6 +18,9 @@ NS_ASSUME_NONNULL_BEGIN
  * @constant ViewingMethod_CrossEye    Images shown side-by-side with cross-eyed view
  * @constant ViewingMethod_WallEye     Images shown side-by-side with wall-eyed view
  * @constant ViewingMethod_AnimatedGIF Images shown as frames in an animation
+ * @constant ViewingMethod_Anaglyph    Images combined into one red/cyan anaglyph, for viewing with coloured glasses
+ * @constant ViewingMethod_AnaglyphHalfColour As ViewingMethod_Anaglyph, with the red channel in grey, to reduce shimmer
+ * @constant ViewingMethod_AnaglyphOptimised  As ViewingMethod_Anaglyph, with the colours mixed to reduce ghosting
  *
  * See 
  * @link //apple_ref/occ/instm/Stereogram/stereogramImage: @/link
@@ -23,6 +29,9 @@ typedef enum ViewingMethod {
     ViewingMethod_CrossEye,
     ViewingMethod_WallEye,
     ViewingMethod_AnimatedGIF,
+    ViewingMethod_Anaglyph,
+    ViewingMethod_AnaglyphHalfColour,
+    ViewingMethod_AnaglyphOptimised,
     
     ViewingMethod_NUM_METHODS
 } ViewingMethod;
@@ -41,6 +50,19 @@ typedef enum ViewingMethod {
  */
 +(CGSize) thumbnailSize;
 
+/*!
+ * Cache statistics totalled over every Stereogram object in the app.
+ *
+ * Unlike adding up the cacheStatistics of individual stereograms, peakBytes here is the true high-water mark of all the caches together.
+ */
++(ImageCacheStatistics) globalCacheStatistics;
+
+/*!
+ * YES while any stereogram is building an image in stereogramImage: for a caller who is waiting for it.
+ * Work done ahead of time, such as cacheImageForViewingMethod:error:, should wait until this is NO.
+ */
++(BOOL) isBuildingImage;
+
 /*!
  * Create a new stereogram from two images.
  *
@@ -56,8 +78,39 @@ typedef enum ViewingMethod {
                                 rightImage: (UIImage *)rightImage
                                      error: (NSError **)errorPtr;
 
+/*!
+ * Create a new stereogram from two images, with its alignment and perceptual hash already known.
+ *
+ * The properties file is written once with everything in it, rather than once for the new stereogram and again for each
+ * property set afterwards.
+ *
+ * @param alignment      The alignment to store. Zero for none.
+ * @param perceptualHash The perceptual hash of LEFTIMAGE, or nil if it isn't known yet.
+ * @see stereogramWithDirectoryURL:leftImage:rightImage:error:
+ */
++(instancetype) stereogramWithDirectoryURL: (NSURL *)directoryURL
+                                 leftImage: (UIImage *)leftImage
+                                rightImage: (UIImage *)rightImage
+                                 alignment: (PWAlignment)alignment
+                            perceptualHash: (nullable NSNumber *)perceptualHash
+                                     error: (NSError **)errorPtr;
 
 
+/*!
+ * Create a new stereogram from an MPO file, the single-file stereo format written by 3D cameras.
+ *
+ * The first two views in the file become the left and right photos. They are saved exactly as they are in the file,
+ * without being decoded, so this is quick and loses nothing.
+ *
+ * @param directoryURL A File URL pointing to a parent directory. The new stereogram will be given a unique name and stored in here.
+ * @param data The contents of the MPO file.
+ * @param errorPtr Optional pointer to an object to pass error information back to the caller.
+ * @return Either a new Stereogram object or nil if the data is not a stereo MPO file or something else failed.
+ */
++(nullable instancetype) stereogramWithDirectoryURL: (NSURL *)directoryURL
+                                            MPOData: (NSData *)data
+                                              error: (NSError * __nullable *)errorPtr;
+
 /*!
  * Load all the stereograms in a given directory and return them in an array.
  * @param url The base directory to search. Must be a file URL pointing to a directory.
@@ -112,6 +165,25 @@ NS_DESIGNATED_INITIALIZER;
                           rightImage: (UIImage *)rightImage
                                error: (NSError **)errorPtr;
 
+/*!
+ * Initialize a stereogram with its alignment and perceptual hash. See stereogramWithDirectoryURL:leftImage:rightImage:alignment:perceptualHash:error:.
+ */
+-(instancetype) initWithDirectoryURL: (NSURL *)directoryURL
+                           leftImage: (UIImage *)leftImage
+                          rightImage: (UIImage *)rightImage
+                           alignment: (PWAlignment)alignment
+                      perceptualHash: (nullable NSNumber *)perceptualHash
+                               error: (NSError **)errorPtr;
+
+
+
+/*!
+ * Initialize a stereogram from an MPO file. See stereogramWithDirectoryURL:MPOData:error:.
+ */
+-(nullable instancetype) initWithDirectoryURL: (NSURL *)directoryURL
+                                      MPOData: (NSData *)data
+                                        error: (NSError * __nullable *)errorPtr;
+
 
 
 #pragma mark Properties
@@ -126,9 +198,79 @@ NS_DESIGNATED_INITIALIZER;
 /*!
  * @property viewingMethod
  * The current way the user wants to display this stereogram. Affects the result of stereogramImage.
+ *
+ * Changing it keeps the old stereogram image as an image for another method, so changing back is instant, and uses any
+ * image already built for the new method; see cacheImageForViewingMethod:error:.
  */
 @property (nonatomic) enum ViewingMethod viewingMethod;
 
+/*!
+ * @property cropRect
+ * The part of each photo to show, in pixels of the upright photo, or CGRectNull (the default) to show all of it.
+ *
+ * The same rectangle is cut from both photos. The photo files are never changed: the crop is stored in the properties
+ * and applied whenever the stereogram image, the thumbnail or the export data is made, so changing it only costs
+ * a write of the property list. Edges are rounded to even pixels.
+ */
+@property (nonatomic) CGRect cropRect;
+
+/*!
+ * @property disparityOffset
+ * How many pixels the right photo is moved to the right of the left one, to set how far away the scene appears. 0 (the default)
+ * shows the photos as taken; positive values push the scene back and negative values bring it forward.
+ *
+ * The shift is made by leaving out columns from opposite edges of the cropped photos, so the stereogram gets narrower by
+ * that many pixels. Like cropRect it is stored in the properties and applied to the stereogram image, the tiles and the
+ * export data. Use disparityPreviewImageWithOffset:maximumSize:error: to show the effect of an offset while it is being chosen.
+ */
+@property (nonatomic) NSInteger disparityOffset;
+
+/*!
+ * @property alignment
+ * How far the right photo is out of line with the left one, vertically and by rotation, in pixels of the whole upright photos.
+ * PhotoStore measures this when the pair is taken, and it is zero if the measurement failed.
+ *
+ * The photo files are never resampled. Like cropRect, the alignment is stored in the properties and taken out whenever
+ * the stereogram image, the tiles or the export data is made: a vertical offset by leaving out rows from the top of one
+ * photo and the bottom of the other, a rotation by making a rotated copy of the right photo. Either way the stereogram
+ * gets a little smaller. The residual field is not stored.
+ */
+@property (nonatomic) PWAlignment alignment;
+
+/*!
+ * @property perceptualHash
+ * The perceptual hash of the left photo (see PWPerceptualHash.h), which PhotoStore compares to find duplicates without
+ * decoding any photos. PhotoStore sets it when the stereogram is made. 0 if hasPerceptualHash is NO.
+ */
+@property (nonatomic) uint64_t perceptualHash;
+
+/*!
+ * @property hasPerceptualHash
+ * NO for stereograms made before the hash was stored. Call updatePerceptualHash: to add it.
+ */
+@property (nonatomic, readonly) BOOL hasPerceptualHash;
+
+/*!
+ * @property photoSize
+ * Size in pixels of the left photo once it is upright and cropped. This only reads the photo's header if it is a JPEG file.
+ * CGSizeZero if the photo can't be read.
+ */
+@property (nonatomic, readonly) CGSize photoSize;
+
+/*!
+ * @property frameCount
+ * How many stereo pairs the stereogram holds. 1 for an ordinary stereogram; more for a sequence, such as a burst or a
+ * time-lapse, made by adding frames with addFrameWithLeftImage:rightImage:error:. The first pair is the left and right
+ * photo, and is the one shown by stereogramImage: and the thumbnail.
+ */
+@property (nonatomic, readonly) NSUInteger frameCount;
+
+/*!
+ * @property cacheStatistics
+ * How much memory this stereogram's cached images are using, and how often the caches have been hit or rebuilt.
+ */
+@property (nonatomic, readonly) ImageCacheStatistics cacheStatistics;
+
 
 #pragma mark Methods
 
@@ -154,11 +296,90 @@ NS_DESIGNATED_INITIALIZER;
  */
 -(nullable UIImage *) thumbnailImage: (NSError * __nullable *)errorPtr;
 
+/*!
+ * Return a small version of stereogramImage: to show while that builds, made in a few milliseconds whatever the size of the photos.
+ *
+ * It is made from the photos' embedded thumbnails if they have them, or by decoding them at 1/8 size, and is not cached.
+ *
+ * @param fullSizePtr Receives the size in pixels stereogramImage: will have, so the preview can be stretched to fit it.
+ * @param errorPtr    Optional error information if something went wrong.
+ * @return The preview image, or nil if it can't be made quickly, e.g. because the photos aren't JPEG files.
+ */
+-(nullable UIImage *) quickPreviewImageWithFullSize: (CGSize *)fullSizePtr
+                                              error: (NSError * __nullable *)errorPtr;
+
+/*!
+ * Return the stereogram image as it would look with disparityOffset set to OFFSET, quickly enough to follow a slider.
+ *
+ * The first call decodes both photos and scales them down so the result fits in MAXIMUMSIZE pixels, which takes about as
+ * long as stereogramImage:. The scaled photos are then cached, and later calls only take views of them and recombine them,
+ * which takes a few milliseconds whatever the size of the originals. The size given on the first call is kept until
+ * discardDisparityPreview is called. The offset is not stored; set disparityOffset for that.
+ *
+ * @param offset      The offset to show, in pixels of the full-size photos.
+ * @param maximumSize The largest image wanted, e.g. the size of the screen in pixels.
+ * @param errorPtr    Optional error information if something went wrong.
+ * @return The preview image if successful, nil if not.
+ */
+-(nullable UIImage *) disparityPreviewImageWithOffset: (NSInteger)offset
+                                          maximumSize: (CGSize)maximumSize
+                                                error: (NSError * __nullable *)errorPtr;
+
+/*! Release the scaled photos kept by disparityPreviewImageWithOffset:maximumSize:error:, e.g. once the user has finished adjusting the offset. */
+-(void) discardDisparityPreview;
+
+/*!
+ * @property hasDisparityPreview
+ * YES if disparityPreviewImageWithOffset:maximumSize:error: has its scaled photos and can return at once.
+ * They are thrown away when memory is low, after which the next preview decodes both photos again.
+ */
+@property (nonatomic, readonly) BOOL hasDisparityPreview;
+
+/*!
+ * YES if stereogramImage: would return at once if viewingMethod were changed to VIEWINGMETHOD.
+ */
+-(BOOL) hasCachedImageForViewingMethod: (enum ViewingMethod)viewingMethod;
+
+/*!
+ * Build the stereogram image for VIEWINGMETHOD and keep it, so that changing viewingMethod to it doesn't have to wait.
+ *
+ * Takes as long as stereogramImage:, so call it from a background thread. Does nothing if the image is already cached.
+ * The image is thrown away if anything it depends on, such as the crop or the disparity offset, changes while it is being
+ * built, and it is released along with the other cached images on a memory warning.
+ *
+ * @param viewingMethod The method to build the image for. May be the current method, in which case this fills the stereogram image cache.
+ * @param errorPtr      Optional error information if something went wrong.
+ * @return YES if the image is now cached, or was thrown away because it went out of date, NO if it couldn't be built.
+ */
+-(BOOL) cacheImageForViewingMethod: (enum ViewingMethod)viewingMethod
+                             error: (NSError * __nullable *)errorPtr;
+
+
+/*!
+ * Return the directory holding the tile pyramid for the current stereogram image, building it first if necessary.
+ *
+ * The pyramid (see PWTilePyramid.h) stores the side-by-side image as 256-pixel JPEG tiles at successively halved resolutions,
+ * so a viewer can draw just the tiles on screen at the current zoom level. It is stored under baseURL and rebuilt when the viewing method changes.
+ * Building it needs the full stereogram image and can take a second or so, so call this from a background thread.
+ *
+ * @param errorPtr Optional error information if something went wrong.
+ * @return The directory URL, or nil on failure or if the viewing method is animated (which has no single image to tile).
+ */
+-(nullable NSURL *) tilePyramidURL: (NSError * __nullable *)errorPtr;
+
+/*!
+ * @property hasTilePyramid
+ * YES if tilePyramidURL: can return at once without building anything.
+ */
+@property (nonatomic, readonly) BOOL hasTilePyramid;
 
 /*!
  * Return the image representation data in a form suitable for exporting beyond this application.
  * For example, in an email or written out to a file.
  *
+ * For a sequence (frameCount above 1) this is the animation from writeSequenceAnimationToURL:error:, written to a
+ * temporary file and mapped rather than read into memory.
+ *
  * @param mimeTypePtr Pointer to a string which will be passed the MIME type of the data.
  * @param errorPtr    Optional pointer to an NSError object which if set will be provided if something went wrong.
  * @return A populated NSData object on success, or nil and a value in errorPtr on failure.
@@ -166,6 +387,74 @@ NS_DESIGNATED_INITIALIZER;
 -(nullable NSData *) exportDataWithMimeType: (NSString * __nullable * __nonnull )mimeTypePtr
                                       error: (NSError * __nullable *)errorPtr;
 
+/*!
+ * Return the image in several sizes and formats at once, e.g. full size for the camera roll, smaller for email and
+ * tiny for a preview.
+ *
+ * The stereogram image is built once and handed to PWExportCreateFiles(), which scales it down in a cascade and
+ * encodes all the files at the same time, so this costs little more than exportDataWithMimeType:error:.
+ * Animated stereograms and sequences can't be resized this way, so every preset gets the same animated GIF.
+ *
+ * @param presets      COUNT presets describing the files wanted (see PWExport.h).
+ * @param mimeTypesPtr Receives the MIME type of each file.
+ * @param errorPtr     Optional error information if something went wrong.
+ * @return One NSData object for each preset in the same order, or nil and a value in errorPtr on failure.
+ */
+-(nullable NSArray<NSData *> *) exportDataForPresets: (const PWExportPreset *)presets
+                                               count: (NSUInteger)count
+                                           mimeTypes: (NSArray<NSString *> * __nullable * __nonnull)mimeTypesPtr
+                                               error: (NSError * __nullable *)errorPtr;
+
+/*!
+ * Add another stereo pair to the end of the sequence, making this stereogram a sequence if it wasn't one already.
+ *
+ * The photos are saved as they are. cropRect, alignment and disparityOffset apply to every pair in the sequence.
+ *
+ * @param leftImage  The left photo. Should be the same size as the first one.
+ * @param rightImage The right photo.
+ * @param errorPtr   Optional error information if something went wrong.
+ * @return YES if successful, NO if not.
+ */
+-(BOOL) addFrameWithLeftImage: (UIImage *)leftImage
+                   rightImage: (UIImage *)rightImage
+                        error: (NSError * __nullable *)errorPtr;
+
+/*!
+ * Write an animated GIF with one frame for each stereo pair, laid out as viewingMethod says.
+ *
+ * The cross-eyed and animated viewing methods give side-by-side frames, the wall-eyed method swaps the photos and the
+ * anaglyph methods give anaglyph frames. The pairs are decoded, combined and encoded one at a time and the file is
+ * written as it goes, so only a few pairs are in memory at once however long the sequence is. Can take a while, so call
+ * this from a background thread.
+ *
+ * @param url      File URL to write the animation to. Any existing file is replaced.
+ * @param errorPtr Optional error information if something went wrong.
+ * @return YES if successful, NO if not.
+ */
+-(BOOL) writeSequenceAnimationToURL: (NSURL *)url
+                              error: (NSError * __nullable *)errorPtr;
+
+/*!
+ * Return both photos as an MPO file, for 3D viewers, TVs and cameras.
+ *
+ * The saved JPEG files are copied into the MPO file as they are, without decoding or re-encoding them, so this takes
+ * a fraction of a millisecond and loses nothing. For the same reason cropRect, alignment and disparityOffset are not
+ * applied; the viewer makes its own adjustments. The MIME type is "image/mpo".
+ *
+ * @param errorPtr Optional pointer to an NSError object which if set will be provided if something went wrong.
+ * @return The contents of the MPO file, or nil and a value in errorPtr on failure.
+ */
+-(nullable NSData *) MPOData: (NSError * __nullable *)errorPtr;
+
+/*!
+ * Work out perceptualHash from the saved left photo and store it, e.g. for a stereogram made before the hash was stored.
+ * This decodes the photo, so call it from a background thread.
+ *
+ * @param errorPtr Optional error information if something went wrong.
+ * @return YES if successful, NO if not.
+ */
+-(BOOL) updatePerceptualHash: (NSError * __nullable *)errorPtr;
+
 /*! 
  * Update the stereogram and thumbnail, replacing the cached images.
  *
@@ -13,12 +13,48 @@
 #import "UIImage+Export.h"
 #import "PWFunctional.h"
 #import "NSError_AlertSupport.h"
+#import "UIImage+PWImageBuffer.h"
+#include "PWJournal.h"
+#include "PWLibrary.h"
+#include "PWMPO.h"
+#include "PWSequence.h"
+#include "PWStorage.h"
+#include "PWTilePyramid.h"
 
 static const CGFloat _thumbSize = 100;
 static const CGSize _thumbnailSize = (CGSize) { .width = _thumbSize, .height = _thumbSize };
 
-NSString *const kViewingMethod = @"ViewingMethod", *const kDateTaken = @"DateTaken";
+NSString *const kViewingMethod = @"ViewingMethod", *const kDateTaken = @"DateTaken", *const kCropRect = @"CropRect", *const kDisparityOffset = @"DisparityOffset";
+NSString *const kAlignmentOffset = @"AlignmentOffset", *const kAlignmentRotation = @"AlignmentRotation";
+    /// Stored as a string of hexadecimal digits, as property list integers are signed.
+NSString *const kPerceptualHash = @"PerceptualHash";
 static NSString *const LeftPhotoFileName = @"LeftPhoto.jpg", *const RightPhotoFileName = @"RightPhoto.jpg", *const PropertyListFileName = @"Properties.plist";
+    /// Subdirectory holding the tile pyramid.
+static NSString *const TilePyramidDirectoryName = @"Tiles";
+    /// Seconds to swing from the left photo to the right one and back in the animated viewing method, through the views between them.
+static const NSTimeInterval AnimationDuration = 0.25;
+
+    /// Cache statistics for all stereograms together. Protected by @synchronized on the Stereogram class.
+static ImageCacheStatistics _globalCacheStatistics;
+
+    /// Number of stereogram images being built for a caller who is waiting for them. Protected by @synchronized([Stereogram class]).
+static NSUInteger _waitingImageBuildCount;
+
+    /// PERCEPTUALHASH as it is stored under kPerceptualHash.
+static NSString *perceptualHashString(uint64_t perceptualHash) {
+    return [NSString stringWithFormat:@"%016llx", (unsigned long long)perceptualHash];
+}
+
+    /// Store ALIGNMENT in the property list PROPERTIES, leaving the keys out altogether if there is no alignment.
+static void setAlignmentProperties(NSMutableDictionary *properties, PWAlignment alignment) {
+    if (alignment.verticalOffset == 0.0 && alignment.rotation == 0.0) {
+        [properties removeObjectForKey:kAlignmentOffset];
+        [properties removeObjectForKey:kAlignmentRotation];
+    } else {
+        properties[kAlignmentOffset] = @(alignment.verticalOffset);
+        properties[kAlignmentRotation] = @(alignment.rotation);
+    }
+}
 
 
 typedef enum WhichImage {
@@ -30,10 +66,35 @@ typedef enum WhichImage {
 
 
 @interface Stereogram () {
+        /// Read and changed from the UI, the hashing and alignment code and the background image builds.
+        /// Protected by @synchronized(self).
     NSMutableDictionary *_properties;
     
         /// Cached images in memory. Free these if needed.
+        /// Always set them through setCachedImage:forTier:evicted: so the cache statistics stay correct.
     UIImage *_stereogramImage, *_thumbnailImage;
+        /// Stereogram images for viewing methods other than the current one, keyed by the method as an NSNumber.
+        /// Protected by @synchronized(self). Always change it through setOtherMethodImages:evicted:.
+    NSDictionary *_otherMethodImages;
+        /// Incremented whenever the stereogram images go out of date, so an image which was being built meanwhile isn't kept.
+        /// Protected by @synchronized(self).
+    NSUInteger _imageGeneration;
+        /// The cropped photos scaled down for disparity previews, and the scale they were reduced by. Protected by @synchronized(self).
+        /// Always set them through setPreviewPhotosLeft:right:scale:evicted:.
+    PWImageBuffer *_previewPhotos[2];
+    double _previewScale;
+
+        /// Memory and hit counts for the images above, and whether each image has ever been built. Protected by @synchronized(self).
+    ImageCacheStatistics _cacheStatistics;
+    BOOL _hasBuiltImage[ImageCacheTier_NUM_TIERS];
+
+        /// Held while the tile pyramid is being built, so two threads don't build it at once. Discarding it doesn't wait for this.
+    NSObject *_tilePyramidLock;
+        /// Incremented whenever the tile pyramid is discarded, so a build of the old image stops at its next tile.
+        /// Changed under @synchronized(self); read with __atomic_load_n() by the build, which doesn't hold the lock.
+    NSUInteger _tilePyramidGeneration;
+        /// Held while the properties are written, so an older copy can't be written over a newer one.
+    NSObject *_propertiesSaveLock;
 }
 
 /*! URL to the left image under the base URL */
@@ -55,6 +116,12 @@ typedef enum WhichImage {
     return _thumbnailSize;
 }
 
++(ImageCacheStatistics) globalCacheStatistics {
+    @synchronized([Stereogram class]) {
+        return _globalCacheStatistics;
+    }
+}
+
 
 +(instancetype) stereogramWithDirectoryURL: (NSURL * )directoryURL
                                  leftImage: (UIImage *)leftImage
@@ -66,42 +133,51 @@ typedef enum WhichImage {
                                               error:errorPtr];
 }
 
++(instancetype) stereogramWithDirectoryURL: (NSURL *)directoryURL
+                                 leftImage: (UIImage *)leftImage
+                                rightImage: (UIImage *)rightImage
+                                 alignment: (PWAlignment)alignment
+                            perceptualHash: (NSNumber *)perceptualHash
+                                     error: (NSError **)errorPtr {
+    return [[self.class alloc] initWithDirectoryURL:directoryURL
+                                          leftImage:leftImage
+                                         rightImage:rightImage
+                                          alignment:alignment
+                                     perceptualHash:perceptualHash
+                                              error:errorPtr];
+}
+
 
 -(instancetype) initWithDirectoryURL: (NSURL * )directoryURL
                            leftImage: (UIImage *)leftImage
                           rightImage: (UIImage *)rightImage
                                error: (NSError **)errorPtr {
-        // Write the data the stereogram will read into a new stereogram 'object' (actually a directory) under errorPtr.
-    NSURL *newStereogramURL = getUniqueStereogramURL(directoryURL);
-    NSDictionary *propertyList = @{ kDateTaken : [NSDate date] };
+    PWAlignment noAlignment = { 0.0, 0.0, 0.0 };
+    return [self initWithDirectoryURL:directoryURL
+                            leftImage:leftImage
+                           rightImage:rightImage
+                            alignment:noAlignment
+                       perceptualHash:nil
+                                error:errorPtr];
+}
 
-        // Save the left and right images, and the property list into the directory specified by URL.
-    NSFileManager *fileManager = [NSFileManager defaultManager];
-    BOOL isDirectory = NO, fileExists = [fileManager fileExistsAtPath:directoryURL.path
-                                                          isDirectory:&isDirectory];
-    if (fileExists && !isDirectory) {
-        if (errorPtr) {
-            *errorPtr = [NSError errorWithDomain:kErrorDomainPhotoStore
-                                            code:ErrorCode_InvalidFileFormat
-                                        userInfo:@{NSLocalizedDescriptionKey : @"File exists and is not a directory.",
-                                                   NSFilePathErrorKey        : directoryURL.path}];
-        }
+-(instancetype) initWithDirectoryURL: (NSURL *)directoryURL
+                           leftImage: (UIImage *)leftImage
+                          rightImage: (UIImage *)rightImage
+                           alignment: (PWAlignment)alignment
+                      perceptualHash: (NSNumber *)perceptualHash
+                               error: (NSError **)errorPtr {
+        // Write the data the stereogram will read into a new stereogram 'object' (actually a directory) under errorPtr.
+    NSURL *newStereogramURL = createStereogramDirectory(directoryURL, errorPtr);
+    if (!newStereogramURL) {
         return nil;
     }
-    
-        // Create the directory (ignoring any errors about it already existing).
-    NSError *error = nil;
-    if (![fileManager createDirectoryAtURL:newStereogramURL
-               withIntermediateDirectories:NO
-                                attributes:nil
-                                     error:&error]) {
-            // IF (error.code != TODO_DirectoryAlreadyExists)
-        if (errorPtr) {
-            *errorPtr = error;
-        }
-        return nil;
-            // END IF
+    NSMutableDictionary *propertyList = [NSMutableDictionary dictionaryWithObject:[NSDate date] forKey:kDateTaken];
+    setAlignmentProperties(propertyList, alignment);
+    if (perceptualHash) {
+        propertyList[kPerceptualHash] = perceptualHashString(perceptualHash.unsignedLongLongValue);
     }
+
         // Directory exists now. Add the files underneath it.
     NSURL *leftURL = [newStereogramURL URLByAppendingPathComponent:LeftPhotoFileName];
     if (!saveImageIntoURL(leftImage, leftURL, errorPtr)) {
@@ -122,18 +198,72 @@ typedef enum WhichImage {
 }
 
 
++(instancetype) stereogramWithDirectoryURL: (NSURL *)directoryURL
+                                   MPOData: (NSData *)data
+                                     error: (NSError **)errorPtr {
+    return [[self.class alloc] initWithDirectoryURL:directoryURL
+                                            MPOData:data
+                                              error:errorPtr];
+}
+
+
+-(instancetype) initWithDirectoryURL: (NSURL *)directoryURL
+                             MPOData: (NSData *)data
+                               error: (NSError **)errorPtr {
+        // Find the pictures before creating anything, so a file that isn't a stereo MPO leaves nothing behind.
+    PWMPOImage left, right;
+    PWError error = PWMPOFindStereoPair(data.bytes, data.length, &left, &right);
+    if (error != PWError_None) {
+        if (errorPtr) {
+            *errorPtr = [NSError imageCoreErrorWithCode:error operation:@"Reading the MPO file" path:nil];
+        }
+        return nil;
+    }
+    NSURL *newStereogramURL = createStereogramDirectory(directoryURL, errorPtr);
+    if (!newStereogramURL) {
+        return nil;
+    }
+
+        // Each picture is already a complete JPEG file, so it is saved exactly as it is in the MPO file.
+    NSDictionary *propertyList = @{ kDateTaken : [NSDate date] };
+    NSData *leftData  = [data subdataWithRange:NSMakeRange(left.offset, left.length)];
+    NSData *rightData = [data subdataWithRange:NSMakeRange(right.offset, right.length)];
+    NSURL *propertyFileURL = [newStereogramURL URLByAppendingPathComponent:PropertyListFileName];
+    if (!writeDataToURL(leftData, [newStereogramURL URLByAppendingPathComponent:LeftPhotoFileName], errorPtr)
+        || !writeDataToURL(rightData, [newStereogramURL URLByAppendingPathComponent:RightPhotoFileName], errorPtr)
+        || !savePropertyData(propertyList, propertyFileURL, errorPtr)) {
+        PWStorageRemoveTree(PWStorageDefault(), newStereogramURL.fileSystemRepresentation);
+        return nil;
+    }
+    return [self initWithBaseURL:newStereogramURL
+                    propertyList:propertyList];
+}
+
+
+    /// Add each item in a directory to the NSMutableArray CONTEXT, skipping hidden files as NSDirectoryEnumerationSkipsHiddenFiles does.
+static bool collectItemName(const char *name, PWStorageItemKind kind, void *context) {
+    if (name[0] != '.') {
+        [(__bridge NSMutableArray *)context addObject:@(name)];
+    }
+    return true;
+}
+
     // Return all the image URLs in the image directory.
 +(NSArray *) allStereogramsUnderURL: (NSURL *)url
                               error: (NSError **)errorPtr {
-    
-    NSFileManager *fileManager = [NSFileManager defaultManager];
-    NSArray *fileNames = [fileManager contentsOfDirectoryAtURL:url
-                                    includingPropertiesForKeys:nil
-                                                       options:NSDirectoryEnumerationSkipsHiddenFiles
-                                                         error:errorPtr];
+    NSMutableArray *fileNames = [NSMutableArray array];
+    PWError error = PWStorageListDirectory(PWStorageDefault(), url.fileSystemRepresentation, collectItemName,
+                                           (__bridge void *)fileNames);
+    if (error != PWError_None) {
+        if (errorPtr) {
+            *errorPtr = [NSError imageCoreErrorWithCode:error operation:@"Reading the photo folder" path:url.path];
+        }
+        return nil;
+    }
     
     NSMutableArray *stereogramArray = [NSMutableArray array];
-    for (NSURL *stereogramURL in fileNames) {
+    for (NSString *fileName in fileNames) {
+        NSURL *stereogramURL = [url URLByAppendingPathComponent:fileName isDirectory:YES];
         Stereogram *stereogram = [Stereogram stereogramWithURL:stereogramURL
                                                          error:errorPtr];
         if (!stereogram) {
@@ -151,19 +281,20 @@ typedef enum WhichImage {
     
     NSDictionary *defaultPropertyDict = @{ kViewingMethod : @(ViewingMethod_CrossEye) };
     
-    NSError *error = nil;
-    BOOL ok = fileExists(baseURL, LeftPhotoFileName   , &error)
-    &&        fileExists(baseURL, RightPhotoFileName  , &error)
-    &&        fileExists(baseURL, PropertyListFileName, &error);
+    BOOL ok = fileExists(baseURL, LeftPhotoFileName   , errorPtr)
+    &&        fileExists(baseURL, RightPhotoFileName  , errorPtr)
+    &&        fileExists(baseURL, PropertyListFileName, errorPtr);
     if (!ok) {
         return nil;
     }
     
-        // Load the property list at the given URL.
-    NSDictionary *propertyList = defaultPropertyDict;
-    if (!loadPropertyList([baseURL URLByAppendingPathComponent:PropertyListFileName], &error)) {
+        // Load the property list at the given URL. Anything saved overrides the defaults.
+    NSDictionary *loadedPropertyList = loadPropertyList([baseURL URLByAppendingPathComponent:PropertyListFileName], errorPtr);
+    if (!loadedPropertyList) {
         return nil;
     }
+    NSMutableDictionary *propertyList = defaultPropertyDict.mutableCopy;
+    [propertyList addEntriesFromDictionary:loadedPropertyList];
     return [[Stereogram alloc] initWithBaseURL:baseURL propertyList:propertyList];
 }
 
@@ -185,6 +316,8 @@ typedef enum WhichImage {
     }
 
     _thumbnailImage = _stereogramImage = nil;
+    _tilePyramidLock = [[NSObject alloc] init];
+    _propertiesSaveLock = [[NSObject alloc] init];
     
     NSAssert(self.viewingMethod >= 0 && self.viewingMethod < ViewingMethod_NUM_METHODS
 			 , @"initWithPropertyList:leftImageURL:rightImageURL: invalid viewing method: %ld", (long)self.viewingMethod);
@@ -199,14 +332,17 @@ typedef enum WhichImage {
 
 -(void) dealloc {
     [[NSNotificationCenter defaultCenter] removeObserver:self];
+    [self discardCachedImages];  // Take our images out of the global totals.
 }
 
 #pragma mark Callbacks
 
 -(void) lowMemoryNotification: (NSNotification *)notification {
-    NSLog(@"%@ - Low memory notification. Freeing cached images.", self);
-    _thumbnailImage = nil;
-    _stereogramImage = nil;
+    ImageCacheStatistics statistics = self.cacheStatistics;
+    NSLog(@"%@ - Low memory notification. Freeing cached images: %@", self, ImageCacheStatisticsDescription(&statistics));
+    [self setCachedImage:nil forTier:ImageCacheTier_Thumbnail  evicted:YES];
+    [self discardStereogramImagesEvicted:YES];
+    [self setPreviewPhotosLeft:NULL right:NULL scale:0 evicted:YES];
 }
 
 #pragma mark Methods
@@ -217,69 +353,161 @@ typedef enum WhichImage {
         return YES;  // Nothing to do.
     }
 //    NSLog(@"Deleting %@", _baseURL);
-    NSFileManager *fileManager = [NSFileManager defaultManager];
-    BOOL success = [fileManager removeItemAtURL:_baseURL
-                                          error:errorPtr];
+    PWError error = PWStorageRemoveTree(PWStorageDefault(), _baseURL.fileSystemRepresentation);
+    BOOL success = error == PWError_None;
+    if (!success && errorPtr) {
+        *errorPtr = [NSError imageCoreErrorWithCode:error operation:@"Deleting the stereogram" path:_baseURL.path];
+    }
     if (success) {
+            // The stereogram has gone whether or not this works, so it isn't a reason to fail.
+        PWError journalError = PWJournalRecordDelete(_baseURL.fileSystemRepresentation, NULL);
+        if (journalError != PWError_None) {
+            NSLog(@"Stereogram %@ couldn't record its deletion in the journal (error %d).", self, journalError);
+        }
         _baseURL = nil;
-        _thumbnailImage = _stereogramImage = nil;
+        [self discardCachedImages];
     }
     return success;
 }
 
 -(UIImage *) stereogramImage: (NSError **)errorPtr {
         // The image is cached. Just return the cached image.
-    if (_stereogramImage) {
-        return _stereogramImage;
+        // The precompute queue can replace it at any moment, so read it under the same lock as it is written.
+    UIImage *cachedImage;
+    @synchronized(self) {
+        cachedImage = _stereogramImage;
     }
-    
-    
+    if (cachedImage) {
+        [self recordCacheHit:ImageCacheTier_Stereogram];
+        return cachedImage;
+    }
+    [self recordCacheMiss:ImageCacheTier_Stereogram];
+
+    NSUInteger generation;
+    enum ViewingMethod viewingMethod;
+    @synchronized(self) {
+        generation = _imageGeneration;
+        viewingMethod = self.viewingMethod;
+    }
+    @synchronized([Stereogram class]) {
+        _waitingImageBuildCount++;
+    }
+    UIImage *stereogramImage = [self createImageForViewingMethod:viewingMethod error:errorPtr];
+    @synchronized([Stereogram class]) {
+        _waitingImageBuildCount--;
+    }
+    if (stereogramImage) {
+        @synchronized(self) {
+                // Don't keep the image if it went out of date, or the viewing method changed, while it was built.
+            if (generation == _imageGeneration && viewingMethod == self.viewingMethod) {
+                [self setCachedImage:stereogramImage forTier:ImageCacheTier_Stereogram evicted:NO];
+            }
+        }
+    }
+    return stereogramImage;
+}
+
+    /// Build the stereogram image for VIEWINGMETHOD from the photos on disk. The caller caches it.
+-(nullable UIImage *) createImageForViewingMethod: (enum ViewingMethod)viewingMethod
+                                            error: (NSError **)errorPtr {
         // Get the left and right images.
     NSData *leftImageData = [NSData dataWithContentsOfURL:self.leftImageURL
                                               options:0
                                                 error:errorPtr];
-    UIImage *leftImage = [UIImage imageWithData:leftImageData];
-    if (!leftImage) {
+    if (!leftImageData) {
         return nil;
     }
-
     NSData *rightImageData = [NSData dataWithContentsOfURL:self.rightImageURL
                                               options:0
                                                 error:errorPtr];
+    if (!rightImageData) {
+        return nil;
+    }
+
+        // The crop, alignment and shift are applied as the photos are read, so none of the code below ever sees the rest of each photo.
+        // The photos keep their compact pixel format, so side-by-side images are only expanded as they are drawn.
+    CGRect cropRect = self.cropRect;
+    NSInteger disparityOffset = self.disparityOffset;
+    PWImageBuffer *left = NULL, *right = NULL;
+    UIImage *stereogramImage = nil;
+    if ([ImageManager createPhotoBuffersWithLeftData:leftImageData
+                                           rightData:rightImageData
+                                            cropRect:cropRect
+                                           alignment:self.alignment
+                                          leftBuffer:&left
+                                         rightBuffer:&right]) {
+        stereogramImage = [self imageWithLeftPhoto:left rightPhoto:right viewingMethod:viewingMethod disparityOffset:disparityOffset preview:NO];
+        PWImageBufferRelease(left);
+        PWImageBufferRelease(right);
+    }
+    if (stereogramImage) {
+        return stereogramImage;
+    }
+
+        // Anaglyphs can only be made by the image core.
+    PWAnaglyphMethod anaglyphMethod;
+    if (anaglyphMethodForViewingMethod(viewingMethod, &anaglyphMethod)) {
+        if (errorPtr) {
+            *errorPtr = [NSError errorWithDomain:kErrorDomainPhotoStore
+                                            code:ErrorCode_InvalidFileFormat
+                                        userInfo:@{NSLocalizedDescriptionKey : @"Invalid image format in file",
+                                                   NSFilePathErrorKey        : _baseURL.path }];
+        }
+        return nil;
+    }
+
+        // Otherwise the photos couldn't be decoded or are in different formats, so draw them with UIKit. This ignores the alignment.
+    UIImage *leftImage = [UIImage imageWithData:leftImageData];
+    if (!leftImage) {
+        return nil;
+    }
     UIImage *rightImage = [UIImage imageWithData:rightImageData];
     if (!rightImage) {
         return nil;
     }
+    leftImage  = shiftedPhoto(croppedPhoto(leftImage, cropRect), disparityOffset);
+    rightImage = shiftedPhoto(croppedPhoto(rightImage, cropRect), -disparityOffset);
     
-        // Create the stereogram image, cache it and return it.
-    switch (self.viewingMethod) {
+        // Create the stereogram image and return it.
+    switch (viewingMethod) {
         case ViewingMethod_CrossEye:
-            _stereogramImage = [ImageManager makeStereogramWithLeftPhoto:leftImage
-                                                              rightPhoto:rightImage];
+            stereogramImage = [ImageManager makeStereogramWithLeftPhoto:leftImage
+                                                             rightPhoto:rightImage];
             break;
             
         case ViewingMethod_WallEye:
-            _stereogramImage = [ImageManager makeStereogramWithLeftPhoto:rightImage
-                                                              rightPhoto:leftImage];
+            stereogramImage = [ImageManager makeStereogramWithLeftPhoto:rightImage
+                                                             rightPhoto:leftImage];
             break;
             
         case ViewingMethod_AnimatedGIF:
-            _stereogramImage = [UIImage animatedImageWithImages:@[leftImage, rightImage]
-                                                       duration:0.25];
+            stereogramImage = [UIImage animatedImageWithImages:@[leftImage, rightImage]
+                                                      duration:AnimationDuration];
             break;
             
         default:
             [NSException raise:@"Not implemented"
-                        format:@"Viewing method %ld is not implemented yet.", (long)self.viewingMethod];
-            _stereogramImage = nil;
+                        format:@"Viewing method %ld is not implemented yet.", (long)viewingMethod];
             break;
     }
-//    NSLog(@"Stereogram %@ created stereogram image %@", self, _stereogramImage);
-    return _stereogramImage;
+//    NSLog(@"Stereogram %@ created stereogram image %@", self, stereogramImage);
+    return stereogramImage;
 }
 
 -(UIImage *) thumbnailImage: (NSError **)errorPtr {
-    if (!_thumbnailImage) {
+    UIImage *thumbnailImage;
+    @synchronized(self) {
+        thumbnailImage = _thumbnailImage;
+    }
+    if (thumbnailImage) {
+        [self recordCacheHit:ImageCacheTier_Thumbnail];
+    } else {
+        [self recordCacheMiss:ImageCacheTier_Thumbnail];
+        thumbnailImage = [self thumbnailFromEmbeddedImage];
+        if (thumbnailImage) {
+            [self setCachedImage:thumbnailImage forTier:ImageCacheTier_Thumbnail evicted:NO];
+            return thumbnailImage;
+        }
         NSURL *urlToLoad = self.leftImageURL;
             // Get either the left or the right image file URL to use as the thumbnail.
         NSData *data = [NSData dataWithContentsOfURL:urlToLoad
@@ -306,23 +534,364 @@ typedef enum WhichImage {
             }
             return nil;
         }
-        _thumbnailImage = [image thumbnailImage:_thumbSize
-                              transparentBorder:0
-                                   cornerRadius:0
-                           interpolationQuality:kCGInterpolationLow];
+        image = croppedPhoto(image, self.cropRect);
+        thumbnailImage = [image thumbnailImage:_thumbSize
+                             transparentBorder:0
+                                  cornerRadius:0
+                          interpolationQuality:kCGInterpolationLow];
+        [self setCachedImage:thumbnailImage forTier:ImageCacheTier_Thumbnail evicted:NO];
+    }
+    NSLog(@"Stereogram %@ created thumbnail image %@", self, thumbnailImage);
+    return thumbnailImage;
+}
 
+/*!
+ * Make the thumbnail from the small copy of the left photo embedded in its file, which reads only the start of the file.
+ *
+ * @return The thumbnail, or nil if the file has no embedded copy, as with photos saved by earlier versions, or if the
+ *         crop leaves too little of it to fill the thumbnail.
+ */
+-(nullable UIImage *) thumbnailFromEmbeddedImage {
+    CGSize photoSize;
+    UIImage *image = [ImageManager thumbnailOfPhotoAtURL:self.leftImageURL photoSize:&photoSize];
+    if (!image || photoSize.width == 0) {
+        return nil;
+    }
+    CGRect cropRect = self.cropRect;
+    if (!CGRectIsNull(cropRect)) {
+        CGFloat scale = CGImageGetWidth(image.CGImage) / photoSize.width;
+        CGRect bounds = CGRectMake(0, 0, CGImageGetWidth(image.CGImage), CGImageGetHeight(image.CGImage));
+        CGRect rect = CGRectIntersection(CGRectIntegral(CGRectMake(cropRect.origin.x * scale, cropRect.origin.y * scale,
+                                                                   cropRect.size.width * scale, cropRect.size.height * scale)), bounds);
+        if (CGRectIsEmpty(rect) || MIN(rect.size.width, rect.size.height) < _thumbSize) {
+            return nil;
+        }
+        image = [image croppedImage:rect];
+    }
+    return [image thumbnailImage:_thumbSize
+               transparentBorder:0
+                    cornerRadius:0
+            interpolationQuality:kCGInterpolationLow];
+}
+
+-(BOOL) hasDisparityPreview {
+    @synchronized(self) {
+        return _previewPhotos[LeftImage] != NULL;
+    }
+}
+
+-(UIImage *) disparityPreviewImageWithOffset: (NSInteger)offset
+                                 maximumSize: (CGSize)maximumSize
+                                       error: (NSError **)errorPtr {
+    PWImageBuffer *left = NULL, *right = NULL;
+    double scale = 0;
+    @synchronized(self) {
+        if (_previewPhotos[LeftImage]) {
+            left  = PWImageBufferRetain(_previewPhotos[LeftImage]);
+            right = PWImageBufferRetain(_previewPhotos[RightImage]);
+            scale = _previewScale;
+        }
+    }
+    if (left) {
+        [self recordCacheHit:ImageCacheTier_Preview];
+    } else {
+        [self recordCacheMiss:ImageCacheTier_Preview];
+        if (![self createPreviewPhotosLeft:&left right:&right scale:&scale maximumSize:maximumSize error:errorPtr]) {
+            return nil;
+        }
+        [self setPreviewPhotosLeft:left right:right scale:scale evicted:NO];
+    }
+
+        // The photos are already decoded, cropped and small, so this is only a copy of the pixels on screen.
+    NSInteger previewOffset = 2 * (NSInteger)lround(offset * scale / 2);
+    UIImage *previewImage = [self imageWithLeftPhoto:left rightPhoto:right viewingMethod:self.viewingMethod disparityOffset:previewOffset preview:YES];
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+    if (!previewImage && errorPtr) {
+        *errorPtr = [NSError imageCoreErrorWithCode:PWError_OutOfMemory operation:@"Previewing the disparity offset" path:nil];
+    }
+    return previewImage;
+}
+
+-(UIImage *) quickPreviewImageWithFullSize: (CGSize *)fullSizePtr
+                                     error: (NSError **)errorPtr {
+    PWImageBuffer *left = NULL, *right = NULL;
+    double scale = 0;
+    if (![ImageManager createPreviewPhotoBuffersWithLeftURL:self.leftImageURL
+                                                   rightURL:self.rightImageURL
+                                                   cropRect:self.cropRect
+                                                  alignment:self.alignment
+                                                 leftBuffer:&left
+                                                rightBuffer:&right
+                                                      scale:&scale]) {
+        if (errorPtr) {
+            *errorPtr = [NSError errorWithDomain:kErrorDomainPhotoStore
+                                            code:ErrorCode_InvalidFileFormat
+                                        userInfo:@{NSLocalizedDescriptionKey : @"Invalid image format in file",
+                                                   NSFilePathErrorKey        : _baseURL.path }];
+        }
+        return nil;
+    }
+    NSInteger previewOffset = 2 * (NSInteger)lround(self.disparityOffset * scale / 2);
+    UIImage *previewImage = [self imageWithLeftPhoto:left rightPhoto:right viewingMethod:self.viewingMethod disparityOffset:previewOffset preview:YES];
+    PWImageBufferRelease(left);
+    PWImageBufferRelease(right);
+    if (!previewImage) {
+        if (errorPtr) {
+            *errorPtr = [NSError imageCoreErrorWithCode:PWError_OutOfMemory operation:@"Previewing the stereogram" path:nil];
+        }
+        return nil;
+    }
+        // Near enough: the full image's crop and alignment are rounded to even pixels at the full scale, not this one.
+    CGSize previewSize = CGSizeMake(CGImageGetWidth(previewImage.CGImage), CGImageGetHeight(previewImage.CGImage));
+    if (!previewImage.CGImage && previewImage.images.count > 0) {
+        previewSize = CGSizeMake(CGImageGetWidth(previewImage.images[0].CGImage), CGImageGetHeight(previewImage.images[0].CGImage));
+    }
+    *fullSizePtr = CGSizeMake(round(previewSize.width / scale), round(previewSize.height / scale));
+    return previewImage;
+}
+
+/*!
+ * Combine two decoded photos according to VIEWINGMETHOD, moving the right one DISPARITYOFFSET pixels to the right.
+ * Wall-eyed images swap the photos over, so the offset is negated to still move the right photo to the right.
+ * Previews are animated without the views between the photos, which would need the photos matched for every frame shown.
+ *
+ * @return The image, or nil if it couldn't be allocated or the photos are in different formats for a side-by-side image.
+ */
+-(nullable UIImage *) imageWithLeftPhoto: (PWImageBuffer *)left
+                              rightPhoto: (PWImageBuffer *)right
+                           viewingMethod: (enum ViewingMethod)viewingMethod
+                         disparityOffset: (NSInteger)disparityOffset
+                                 preview: (BOOL)preview {
+    PWAnaglyphMethod anaglyphMethod;
+    if (anaglyphMethodForViewingMethod(viewingMethod, &anaglyphMethod)) {
+        return [ImageManager makeAnaglyphWithLeftBuffer:left rightBuffer:right disparityOffset:disparityOffset method:anaglyphMethod];
+    }
+    switch (viewingMethod) {
+        case ViewingMethod_CrossEye:
+            return [ImageManager makeCompactStereogramWithLeftBuffer:left rightBuffer:right disparityOffset:disparityOffset];
+        case ViewingMethod_WallEye:
+            return [ImageManager makeCompactStereogramWithLeftBuffer:right rightBuffer:left disparityOffset:-disparityOffset];
+        default:
+            return [ImageManager makeAnimationWithLeftBuffer:left
+                                                 rightBuffer:right
+                                             disparityOffset:disparityOffset
+                                                    duration:AnimationDuration
+                                              inBetweenViews:!preview];
+    }
+}
+
+-(void) discardDisparityPreview {
+    [self setPreviewPhotosLeft:NULL right:NULL scale:0 evicted:NO];
+}
+
++(BOOL) isBuildingImage {
+    @synchronized([Stereogram class]) {
+        return _waitingImageBuildCount > 0;
+    }
+}
+
+-(BOOL) hasCachedImageForViewingMethod: (enum ViewingMethod)viewingMethod {
+    @synchronized(self) {
+        return viewingMethod == self.viewingMethod ? _stereogramImage != nil : _otherMethodImages[@(viewingMethod)] != nil;
+    }
+}
+
+-(BOOL) cacheImageForViewingMethod: (enum ViewingMethod)viewingMethod
+                             error: (NSError **)errorPtr {
+    NSUInteger generation;
+    @synchronized(self) {
+        if ([self hasCachedImageForViewingMethod:viewingMethod]) {
+            return YES;
+        }
+        generation = _imageGeneration;
     }
-    NSLog(@"Stereogram %@ created thumbnail image %@", self, _thumbnailImage);
-    return _thumbnailImage;
+    UIImage *image = [self createImageForViewingMethod:viewingMethod error:errorPtr];
+    if (!image) {
+        return NO;
+    }
+        // The viewing method may have changed while the image was built, so only decide now which cache it belongs in.
+    @synchronized(self) {
+        if (generation == _imageGeneration && ![self hasCachedImageForViewingMethod:viewingMethod]) {
+            if (viewingMethod == self.viewingMethod) {
+                [self setCachedImage:image forTier:ImageCacheTier_Stereogram evicted:NO];
+            } else {
+                NSMutableDictionary *images = _otherMethodImages ? _otherMethodImages.mutableCopy : [NSMutableDictionary dictionary];
+                images[@(viewingMethod)] = image;
+                [self setOtherMethodImages:images evicted:NO];
+            }
+        }
+    }
+    return YES;
+}
+
+/*!
+ * Decode, crop and align both photos and scale them down for disparityPreviewImageWithOffset:maximumSize:error:.
+ *
+ * The scale is worked out from the left photo so that the image for the current viewing method fits in MAXIMUMSIZE,
+ * and the widths are kept even so that YCbCr photos can still be put side by side. Photos are never enlarged.
+ */
+-(BOOL) createPreviewPhotosLeft: (PWImageBuffer **)leftPtr
+                          right: (PWImageBuffer **)rightPtr
+                          scale: (double *)scalePtr
+                    maximumSize: (CGSize)maximumSize
+                          error: (NSError **)errorPtr {
+    PWImageBuffer *photos[2] = { NULL, NULL };
+    NSData *leftData = [NSData dataWithContentsOfURL:self.leftImageURL options:0 error:errorPtr];
+    if (!leftData) {
+        return NO;
+    }
+    NSData *rightData = [NSData dataWithContentsOfURL:self.rightImageURL options:0 error:errorPtr];
+    if (!rightData) {
+        return NO;
+    }
+    if (![ImageManager createPhotoBuffersWithLeftData:leftData
+                                            rightData:rightData
+                                             cropRect:self.cropRect
+                                            alignment:self.alignment
+                                           leftBuffer:&photos[LeftImage]
+                                          rightBuffer:&photos[RightImage]]) {
+        if (errorPtr) {
+            *errorPtr = [NSError errorWithDomain:kErrorDomainPhotoStore
+                                            code:ErrorCode_InvalidFileFormat
+                                        userInfo:@{NSLocalizedDescriptionKey : @"Invalid image format in file",
+                                                   NSFilePathErrorKey        : _baseURL.path }];
+        }
+        return NO;
+    }
+    BOOL sideBySide = self.viewingMethod == ViewingMethod_CrossEye || self.viewingMethod == ViewingMethod_WallEye;
+    double imageWidth = photos[LeftImage]->width * (sideBySide ? 2.0 : 1.0), imageHeight = photos[LeftImage]->height;
+    double scale = MIN(1.0, MIN(maximumSize.width / imageWidth, maximumSize.height / imageHeight));
+    for (int i = LeftImage; i <= RightImage; i++) {
+        size_t width  = MAX(2 * (size_t)(photos[i]->width * scale / 2), 2);
+        size_t height = MAX((size_t)lround(photos[i]->height * scale), 1);
+        if (width != photos[i]->width || height != photos[i]->height) {
+            PWImageBuffer *scaled = PWResampleCreate(photos[i], width, height, PWResampleFilter_Area);
+            PWImageBufferRelease(photos[i]);
+            photos[i] = scaled;
+        }
+    }
+    if (!photos[LeftImage] || !photos[RightImage]) {
+        PWImageBufferRelease(photos[LeftImage]);
+        PWImageBufferRelease(photos[RightImage]);
+        if (errorPtr) {
+            *errorPtr = [NSError imageCoreErrorWithCode:PWError_OutOfMemory operation:@"Previewing the disparity offset" path:nil];
+        }
+        return NO;
+    }
+    *leftPtr = photos[LeftImage];
+    *rightPtr = photos[RightImage];
+    *scalePtr = scale;
+    return YES;
 }
 
 
 
 
+    /// The pyramid generation a build started at, checked before each tile it writes.
+typedef struct TilePyramidBuild {
+    const NSUInteger *currentGeneration;
+    NSUInteger generation;
+} TilePyramidBuild;
+
+    /// PWTilePyramidShouldContinue stopping a build once the pyramid it was making has been discarded.
+static bool tilePyramidBuildIsCurrent(void *context) {
+    const TilePyramidBuild *build = context;
+    return __atomic_load_n(build->currentGeneration, __ATOMIC_RELAXED) == build->generation;
+}
+
+    /// A directory next to the tile pyramid with a name of its own, for building or deleting a pyramid out of the way of the real one.
+-(NSURL *) uniqueTilePyramidURL {
+    NSString *name = [NSString stringWithFormat:@"%@-%@", TilePyramidDirectoryName, [NSUUID UUID].UUIDString];
+    return [_baseURL URLByAppendingPathComponent:name isDirectory:YES];
+}
+
+-(NSURL *) tilePyramidURL: (NSError **)errorPtr {
+    if (self.viewingMethod == ViewingMethod_AnimatedGIF) {
+        return nil;
+    }
+    NSURL *pyramidURL = [_baseURL URLByAppendingPathComponent:TilePyramidDirectoryName isDirectory:YES];
+    @synchronized(_tilePyramidLock) {
+        if (self.hasTilePyramid) {
+            return pyramidURL;
+        }
+        TilePyramidBuild build = { &_tilePyramidGeneration, __atomic_load_n(&_tilePyramidGeneration, __ATOMIC_RELAXED) };
+        UIImage *stereogramImage = [self stereogramImage:errorPtr];
+        if (!stereogramImage) {
+            return nil;
+        }
+        PWImageBuffer *buffer = PWImageBufferCreateFromUIImage(stereogramImage);
+        if (!buffer) {
+            if (errorPtr) {
+                *errorPtr = [NSError imageCoreErrorWithCode:PWError_OutOfMemory operation:@"Creating tiles" path:nil];
+            }
+            return nil;
+        }
+            // The pyramid is built in a directory of its own and moved into place when complete, so discardTilePyramid
+            // neither waits for the build nor deletes part of a newer one.
+        NSURL *buildURL = [self uniqueTilePyramidURL];
+        const char *buildPath = buildURL.fileSystemRepresentation, *path = pyramidURL.fileSystemRepresentation;
+        PWError error = PWTilePyramidWrite(buffer, buildPath, PWTilePyramidDefaultTileSize, NULL, tilePyramidBuildIsCurrent, &build, NULL);
+        PWImageBufferRelease(buffer);
+        if (error == PWError_None) {
+            @synchronized(self) {
+                if (!tilePyramidBuildIsCurrent(&build)) {
+                    error = PWError_Cancelled;
+                } else if ((error = PWLibraryRemoveDirectory(path)) == PWError_None) {
+                        // Only a pyramid left partly written by an older version of the app is ever deleted here.
+                    error = PWStorageMoveItem(PWStorageDefault(), buildPath, path);
+                }
+            }
+        }
+        if (error != PWError_None) {
+            if (errorPtr) {
+                *errorPtr = [NSError imageCoreErrorWithCode:error operation:@"Creating tiles" path:pyramidURL.path];
+            }
+            PWLibraryRemoveDirectory(buildPath);
+            return nil;
+        }
+    }
+    return pyramidURL;
+}
+
+-(BOOL) hasTilePyramid {
+    NSURL *manifestURL = [[_baseURL URLByAppendingPathComponent:TilePyramidDirectoryName isDirectory:YES]
+                          URLByAppendingPathComponent:@(PWTilePyramidManifestFileName)];
+    return self.viewingMethod != ViewingMethod_AnimatedGIF && PWStorageFileExists(PWStorageDefault(), manifestURL.fileSystemRepresentation);
+}
+
+    /// Delete the tile pyramid, e.g. because the stereogram image has changed. It will be rebuilt when next requested.
+    /// Any build in progress stops at its next tile. The old pyramid is moved aside first and deleted without holding any lock.
+-(void) discardTilePyramid {
+    NSURL *pyramidURL = [_baseURL URLByAppendingPathComponent:TilePyramidDirectoryName isDirectory:YES];
+    NSURL *discardedURL = [self uniqueTilePyramidURL];
+    BOOL moved;
+    @synchronized(self) {
+        __atomic_add_fetch(&_tilePyramidGeneration, 1, __ATOMIC_RELAXED);
+        moved = PWStorageMoveItem(PWStorageDefault(), pyramidURL.fileSystemRepresentation, discardedURL.fileSystemRepresentation) == PWError_None;
+    }
+        // The move fails when there is no pyramid, and then there is nothing to delete.
+    if (moved && PWLibraryRemoveDirectory(discardedURL.fileSystemRepresentation) != PWError_None) {
+        NSLog(@"Stereogram %@ failed to delete tile pyramid at %@: %s", self, discardedURL.path, strerror(errno));
+    }
+}
+
 -(nullable NSData *)exportDataWithMimeType:(NSString * __nullable * __nonnull)mimeTypePtr
                                      error:(NSError * __nullable * __nullable)errorPtr {
     NSAssert(mimeTypePtr, @"MIME Type pointer was not provided.");
     
+    if (self.frameCount > 1) {
+        NSURL *url = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:[NSUUID UUID].UUIDString]];
+        NSData *data = nil;
+        if ([self writeSequenceAnimationToURL:url error:errorPtr]) {
+            *mimeTypePtr = @"image/gif";
+            data = [NSData dataWithContentsOfURL:url options:NSDataReadingMappedIfSafe error:errorPtr];
+        }
+            // A mapped file stays readable once it is unlinked.
+        [[NSFileManager defaultManager] removeItemAtURL:url error:nil];
+        return data;
+    }
+
     UIImage *stereogramImage = [self stereogramImage:errorPtr];
     if (!stereogramImage) {
         return nil;
@@ -339,11 +908,170 @@ typedef enum WhichImage {
     return data;
 }
 
+-(nullable NSArray<NSData *> *) exportDataForPresets: (const PWExportPreset *)presets
+                                               count: (NSUInteger)count
+                                           mimeTypes: (NSArray<NSString *> * __nullable * __nonnull)mimeTypesPtr
+                                               error: (NSError * __nullable *)errorPtr {
+    NSAssert(mimeTypesPtr, @"MIME Types pointer was not provided.");
+
+    if (self.frameCount > 1 || self.viewingMethod == ViewingMethod_AnimatedGIF) {
+        NSString *mimeType = nil;
+        NSData *data = [self exportDataWithMimeType:&mimeType error:errorPtr];
+        if (!data) {
+            return nil;
+        }
+        NSMutableArray *allData = [NSMutableArray arrayWithCapacity:count], *mimeTypes = [NSMutableArray arrayWithCapacity:count];
+        for (NSUInteger i = 0; i < count; i++) {
+            [allData addObject:data];
+            [mimeTypes addObject:mimeType];
+        }
+        *mimeTypesPtr = mimeTypes;
+        return allData;
+    }
+
+    UIImage *stereogramImage = [self stereogramImage:errorPtr];
+    if (!stereogramImage) {
+        return nil;
+    }
+    PWImageBuffer *buffer = PWImageBufferCreateFromUIImage(stereogramImage);
+    PWDataBuffer *outputs = calloc(count ? count : 1, sizeof(PWDataBuffer));
+    PWError error = buffer && outputs ? PWError_None : PWError_OutOfMemory;
+    for (NSUInteger i = 0; !error && i < count; i++) {
+        error = PWDataBufferInit(&outputs[i], 0) ? PWError_None : PWError_OutOfMemory;
+    }
+    if (!error) {
+        error = PWExportCreateFiles(buffer, presets, count, outputs);
+    }
+    PWImageBufferRelease(buffer);
+    if (error != PWError_None) {
+        for (NSUInteger i = 0; outputs && i < count; i++) {
+            PWDataBufferFree(&outputs[i]);
+        }
+        free(outputs);
+        if (errorPtr) {
+            *errorPtr = [NSError imageCoreErrorWithCode:error operation:@"Exporting the stereogram" path:nil];
+        }
+        return nil;
+    }
+    NSMutableArray *allData = [NSMutableArray arrayWithCapacity:count], *mimeTypes = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        [allData addObject:[NSData dataWithBytesNoCopy:outputs[i].bytes length:outputs[i].length freeWhenDone:YES]];
+        [mimeTypes addObject:(presets[i].format == PWExportFormat_GIF ? @"image/gif" : @"image/jpeg")];
+    }
+    free(outputs);
+    *mimeTypesPtr = mimeTypes;
+    return allData;
+}
+
+
+
+-(NSUInteger) frameCount {
+    return PWLibrarySequenceFrameCount(_baseURL.fileSystemRepresentation);
+}
+
+-(BOOL) addFrameWithLeftImage: (UIImage *)leftImage
+                   rightImage: (UIImage *)rightImage
+                        error: (NSError **)errorPtr {
+    NSData *leftData = [ImageManager JPEGDataOfImage:leftImage options:NULL addThumbnail:NO];
+    NSData *rightData = [ImageManager JPEGDataOfImage:rightImage options:NULL addThumbnail:NO];
+    if (!leftData || !rightData) {
+        if (errorPtr) {
+            *errorPtr = [NSError parameterErrorWithNilParameter:leftData ? @"rightImage" : @"leftImage"];
+        }
+        return NO;
+    }
+        // The library only reads the buffers, so they can wrap the data without copying it.
+    PWDataBuffer left = { (uint8_t *)leftData.bytes, leftData.length, leftData.length };
+    PWDataBuffer right = { (uint8_t *)rightData.bytes, rightData.length, rightData.length };
+    PWError error = PWLibraryAddSequenceFrame(_baseURL.fileSystemRepresentation, &left, &right, NULL);
+    if (error != PWError_None) {
+        if (errorPtr) {
+            *errorPtr = [NSError imageCoreErrorWithCode:error operation:@"Adding a frame" path:_baseURL.path];
+        }
+        return NO;
+    }
+    return YES;
+}
+
+    /// PWSequenceSink writing to a stdio file.
+static bool writeToFile(void *context, const uint8_t *bytes, size_t length) {
+    return fwrite(bytes, 1, length, context) == length;
+}
+
+-(BOOL) writeSequenceAnimationToURL: (NSURL *)url
+                              error: (NSError **)errorPtr {
+    PWSequenceOptions options;
+    PWSequenceOptionsInit(&options);
+    options.frameDelay = (unsigned)round(AnimationDuration * 100);
+    if (anaglyphMethodForViewingMethod(self.viewingMethod, &options.anaglyphMethod)) {
+        options.layout = PWSequenceLayout_Anaglyph;
+    } else if (self.viewingMethod == ViewingMethod_WallEye) {
+        options.layout = PWSequenceLayout_Swapped;
+    }
 
+    PWError error = PWError_IO;
+    FILE *file = fopen(url.fileSystemRepresentation, "wb");
+    if (file) {
+        error = PWSequenceWriteGIF(_baseURL.fileSystemRepresentation, &options, writeToFile, file);
+        if (fclose(file) != 0 && error == PWError_None) {
+            error = PWError_IO;
+        }
+        if (error != PWError_None) {
+            [[NSFileManager defaultManager] removeItemAtURL:url error:nil];
+        }
+    }
+    if (error != PWError_None) {
+        if (errorPtr) {
+            *errorPtr = [NSError imageCoreErrorWithCode:error operation:@"Writing the sequence" path:url.path];
+        }
+        return NO;
+    }
+    return YES;
+}
+
+-(NSData *) MPOData: (NSError **)errorPtr {
+    NSData *leftData = [NSData dataWithContentsOfURL:self.leftImageURL options:NSDataReadingMappedIfSafe error:errorPtr];
+    if (!leftData) {
+        return nil;
+    }
+    NSData *rightData = [NSData dataWithContentsOfURL:self.rightImageURL options:NSDataReadingMappedIfSafe error:errorPtr];
+    if (!rightData) {
+        return nil;
+    }
+    PWDataBuffer output;
+    if (!PWDataBufferInit(&output, leftData.length + rightData.length + 256)) {
+        if (errorPtr) {
+            *errorPtr = [NSError imageCoreErrorWithCode:PWError_OutOfMemory operation:@"Exporting the MPO file" path:nil];
+        }
+        return nil;
+    }
+    PWError error = PWMPOCreate(leftData.bytes, leftData.length, rightData.bytes, rightData.length, &output);
+    if (error != PWError_None) {
+        PWDataBufferFree(&output);
+        if (errorPtr) {
+            *errorPtr = [NSError imageCoreErrorWithCode:error operation:@"Exporting the MPO file" path:_baseURL.path];
+        }
+        return nil;
+    }
+        // Hand the bytes over to the NSData rather than copying them.
+    return [NSData dataWithBytesNoCopy:output.bytes length:output.length freeWhenDone:YES];
+}
+
+-(BOOL) updatePerceptualHash: (NSError **)errorPtr {
+    uint64_t hash;
+    PWError error = PWLibraryComputePerceptualHash(_baseURL.fileSystemRepresentation, &hash);
+    if (error != PWError_None) {
+        if (errorPtr) {
+            *errorPtr = [NSError imageCoreErrorWithCode:error operation:@"Hashing the photo" path:self.leftImageURL.path];
+        }
+        return NO;
+    }
+    self.perceptualHash = hash;
+    return YES;
+}
 
 -(BOOL) refresh: (NSError **)errorPtr {
-    _thumbnailImage = nil;
-    _stereogramImage = nil;
+    [self discardCachedImages];
     
     if (![self thumbnailImage:errorPtr]) {
         return NO;
@@ -369,8 +1097,12 @@ typedef enum WhichImage {
 }
 
 -(NSString *)description {
+    NSDictionary *properties;
+    @synchronized(self) {
+        properties = _properties.copy;
+    }
     NSString *description = [NSString stringWithFormat:@"%@ <viewingMethod = %ld, baseURL = %@, Proprty Dict = %@>"
-                             , super.description, (long)self.viewingMethod, _baseURL, _properties];
+                             , super.description, (long)self.viewingMethod, _baseURL, properties];
     return description;
 }
 
@@ -380,9 +1112,17 @@ typedef enum WhichImage {
  * This determines the type of image that stereogramImage: will return.
  */
 
+-(ImageCacheStatistics) cacheStatistics {
+    @synchronized(self) {
+        return _cacheStatistics;
+    }
+}
+
 -(enum ViewingMethod) viewingMethod {
-    NSNumber *viewingMethodNumber = _properties[kViewingMethod];
-    return (enum ViewingMethod)viewingMethodNumber.integerValue;
+    @synchronized(self) {
+        NSNumber *viewingMethodNumber = _properties[kViewingMethod];
+        return (enum ViewingMethod)viewingMethodNumber.integerValue;
+    }
 }
 
 /*!
@@ -396,18 +1136,318 @@ typedef enum WhichImage {
 -(void) setViewingMethod: (enum ViewingMethod)viewingMethod {
     if (viewingMethod != self.viewingMethod) {
         NSNumber *viewingMethodNumber = [NSNumber numberWithInteger:viewingMethod];
-        _properties[kViewingMethod] = viewingMethodNumber;
+            // The tiles are of the old image, so remove them before the property file says the method has changed.
+        [self discardTilePyramid];
+
+            // Swap the stereogram image for the one built for the new method, if there is one, and keep the old one in case
+            // the user changes back. The thumbnail and the preview photos don't depend on the method.
+        @synchronized(self) {
+            NSMutableDictionary *images = _otherMethodImages ? _otherMethodImages.mutableCopy : [NSMutableDictionary dictionary];
+            UIImage *newImage = images[viewingMethodNumber];
+            images[@(self.viewingMethod)] = _stereogramImage;
+            [images removeObjectForKey:viewingMethodNumber];
+            _properties[kViewingMethod] = viewingMethodNumber;
+            if (newImage) {
+                [self recordCacheHit:ImageCacheTier_OtherMethods];
+            } else {
+                [self recordCacheMiss:ImageCacheTier_OtherMethods];
+            }
+                // Empty the stereogram cache first so the peak never counts an image in both caches.
+            [self setCachedImage:nil forTier:ImageCacheTier_Stereogram evicted:NO];
+            [self setOtherMethodImages:images evicted:NO];
+            [self setCachedImage:newImage forTier:ImageCacheTier_Stereogram evicted:NO];
+        }
         [self saveProperties:nil];
-        
-            // Force a reload of the cached images once the viewing method changes.
-        _thumbnailImage = nil;
-        _stereogramImage = nil;
     }
 }
 
 
+-(NSInteger) disparityOffset {
+    @synchronized(self) {
+        NSNumber *offsetNumber = _properties[kDisparityOffset];
+        return offsetNumber.integerValue;
+    }
+}
+
+    /// The offset is rounded towards zero to an even number, as PWImageBufferCreateShiftedViews() does for YCbCr photos,
+    /// so the stereogram is the same size however the photos were decoded.
+-(void) setDisparityOffset: (NSInteger)disparityOffset {
+    disparityOffset = disparityOffset / 2 * 2;
+    if (disparityOffset != self.disparityOffset) {
+        [self discardTilePyramid];
+        @synchronized(self) {
+            if (disparityOffset == 0) {
+                [_properties removeObjectForKey:kDisparityOffset];
+            } else {
+                _properties[kDisparityOffset] = @(disparityOffset);
+            }
+        }
+        [self saveProperties:nil];
+            // The thumbnail is of the left photo alone, and the preview photos are not shifted, so only the stereograms are out of date.
+        [self discardStereogramImagesEvicted:NO];
+    }
+}
+
+-(PWAlignment) alignment {
+    NSNumber *offsetNumber, *rotationNumber;
+    @synchronized(self) {
+        offsetNumber = _properties[kAlignmentOffset];
+        rotationNumber = _properties[kAlignmentRotation];
+    }
+    return (PWAlignment) { .verticalOffset = offsetNumber.doubleValue, .rotation = rotationNumber.doubleValue, .residual = 0.0 };
+}
+
+-(void) setAlignment: (PWAlignment)alignment {
+    PWAlignment oldAlignment = self.alignment;
+    if (alignment.verticalOffset != oldAlignment.verticalOffset || alignment.rotation != oldAlignment.rotation) {
+        [self discardTilePyramid];
+        @synchronized(self) {
+            setAlignmentProperties(_properties, alignment);
+        }
+        [self saveProperties:nil];
+            // The thumbnail is of the left photo alone, so only the images showing both photos are out of date.
+        [self discardStereogramImagesEvicted:NO];
+        [self discardDisparityPreview];
+    }
+}
+
+-(BOOL) hasPerceptualHash {
+    @synchronized(self) {
+        return _properties[kPerceptualHash] != nil;
+    }
+}
+
+-(uint64_t) perceptualHash {
+    NSString *hashString;
+    @synchronized(self) {
+        hashString = _properties[kPerceptualHash];
+    }
+    return hashString ? strtoull(hashString.UTF8String, NULL, 16) : 0;
+}
+
+-(void) setPerceptualHash: (uint64_t)perceptualHash {
+    NSString *hashString = perceptualHashString(perceptualHash);
+    BOOL changed;
+    @synchronized(self) {
+        changed = ![hashString isEqualToString:_properties[kPerceptualHash]];
+        _properties[kPerceptualHash] = hashString;
+    }
+    if (changed) {
+        [self saveProperties:nil];
+    }
+}
+
+-(CGSize) photoSize {
+    NSData *data = [NSData dataWithContentsOfURL:self.leftImageURL options:NSDataReadingMappedIfSafe error:nil];
+    CGSize size = data ? [ImageManager uprightPixelSizeOfPhotoData:data] : CGSizeZero;
+    CGRect cropRect = self.cropRect;
+    if (!CGRectIsNull(cropRect)) {
+        CGRect cropped = CGRectIntersection(CGRectIntegral(cropRect), CGRectMake(0, 0, size.width, size.height));
+        if (!CGRectIsEmpty(cropped)) {
+            size = cropped.size;
+        }
+    }
+    return size;
+}
+
+-(CGRect) cropRect {
+    NSString *cropString;
+    @synchronized(self) {
+        cropString = _properties[kCropRect];
+    }
+    return cropString ? CGRectFromString(cropString) : CGRectNull;
+}
+
+-(void) setCropRect: (CGRect)cropRect {
+    if (!CGRectEqualToRect(cropRect, self.cropRect)) {
+            // As for the viewing method, the tiles show the old crop, so remove them first.
+        [self discardTilePyramid];
+        @synchronized(self) {
+            if (CGRectIsNull(cropRect)) {
+                [_properties removeObjectForKey:kCropRect];
+            } else {
+                _properties[kCropRect] = NSStringFromCGRect(cropRect);
+            }
+        }
+        [self saveProperties:nil];
+        [self discardCachedImages];
+    }
+}
+
+
+#pragma mark Cache accounting
+
+-(void) recordCacheHit: (ImageCacheTier)tier {
+    @synchronized(self) {
+        _cacheStatistics.hits[tier]++;
+    }
+    @synchronized([Stereogram class]) {
+        _globalCacheStatistics.hits[tier]++;
+    }
+}
+
+    /// A miss for an image we have built before means something threw it away. Count those separately as regenerations.
+-(void) recordCacheMiss: (ImageCacheTier)tier {
+    BOOL isRegeneration;
+    @synchronized(self) {
+        isRegeneration = _hasBuiltImage[tier];
+        _cacheStatistics.misses[tier]++;
+        if (isRegeneration) {
+            _cacheStatistics.regenerations[tier]++;
+        }
+    }
+    @synchronized([Stereogram class]) {
+        _globalCacheStatistics.misses[tier]++;
+        if (isRegeneration) {
+            _globalCacheStatistics.regenerations[tier]++;
+        }
+    }
+}
+
+/*!
+ * Replace the cached image for TIER and update the live byte counts.
+ *
+ * @param image   The new image, or nil to empty the cache.
+ * @param tier    Which cache to update.
+ * @param evicted YES if the old image is being thrown away because memory is low.
+ */
+-(void) setCachedImage: (nullable UIImage *)image
+               forTier: (ImageCacheTier)tier
+               evicted: (BOOL)evicted {
+    NSAssert(tier == ImageCacheTier_Stereogram || tier == ImageCacheTier_Thumbnail, @"Cache tier %@ doesn't hold an image.", ImageCacheTierName(tier));
+    @synchronized(self) {
+        UIImage *__strong *cache = (tier == ImageCacheTier_Stereogram) ? &_stereogramImage : &_thumbnailImage;
+        BOOL wasEvicted = evicted && *cache;
+        *cache = image;
+        [self recordCacheTier:tier bytes:ImageCacheByteCount(image) evicted:wasEvicted];
+    }
+}
+
+/*!
+ * Replace the photos cached for disparity previews and update the live byte counts.
+ *
+ * @param left, right The new photos, which are retained, or NULL to empty the cache.
+ * @param scale       How much the photos were reduced by.
+ * @param evicted     YES if the old photos are being thrown away because memory is low.
+ */
+-(void) setPreviewPhotosLeft: (nullable PWImageBuffer *)left
+                       right: (nullable PWImageBuffer *)right
+                       scale: (double)scale
+                     evicted: (BOOL)evicted {
+    @synchronized(self) {
+        BOOL wasEvicted = evicted && _previewPhotos[LeftImage];
+        PWImageBufferRelease(_previewPhotos[LeftImage]);
+        PWImageBufferRelease(_previewPhotos[RightImage]);
+        _previewPhotos[LeftImage]  = PWImageBufferRetain(left);
+        _previewPhotos[RightImage] = PWImageBufferRetain(right);
+        _previewScale = scale;
+        NSUInteger bytes = (left ? PWImageBufferByteCount(left) : 0) + (right ? PWImageBufferByteCount(right) : 0);
+        [self recordCacheTier:ImageCacheTier_Preview bytes:bytes evicted:wasEvicted];
+    }
+}
+
+/*!
+ * Replace the images cached for other viewing methods and update the live byte counts. Call this while synchronized on self.
+ *
+ * @param images  The new images keyed by viewing method, or nil to empty the cache.
+ * @param evicted YES if the old images are being thrown away because memory is low.
+ */
+-(void) setOtherMethodImages: (nullable NSDictionary *)images
+                     evicted: (BOOL)evicted {
+    BOOL wasEvicted = evicted && _otherMethodImages.count > 0;
+    _otherMethodImages = images.count > 0 ? [images copy] : nil;
+    NSUInteger bytes = 0;
+    for (UIImage *image in _otherMethodImages.objectEnumerator) {
+        bytes += ImageCacheByteCount(image);
+    }
+    [self recordCacheTier:ImageCacheTier_OtherMethods bytes:bytes evicted:wasEvicted];
+}
+
+/*!
+ * Update the statistics after the contents of a cache have been replaced. Call this while synchronized on self.
+ *
+ * @param tier    The cache which changed.
+ * @param bytes   The size of the new contents, 0 if the cache is now empty.
+ * @param evicted YES if the old contents were thrown away because memory is low.
+ */
+-(void) recordCacheTier: (ImageCacheTier)tier
+                  bytes: (NSUInteger)bytes
+                evicted: (BOOL)evicted {
+    NSUInteger oldBytes = _cacheStatistics.liveBytes[tier];
+    if (evicted) {
+        _cacheStatistics.evictions[tier]++;
+        _cacheStatistics.evictedBytes[tier] += oldBytes;
+    }
+    if (bytes) {
+        _hasBuiltImage[tier] = YES;
+    }
+    NSInteger delta = (NSInteger)bytes - (NSInteger)oldBytes;
+    ImageCacheStatisticsAddLiveBytes(&_cacheStatistics, tier, delta);
+    @synchronized([Stereogram class]) {
+        if (evicted) {
+            _globalCacheStatistics.evictions[tier]++;
+            _globalCacheStatistics.evictedBytes[tier] += oldBytes;
+        }
+        ImageCacheStatisticsAddLiveBytes(&_globalCacheStatistics, tier, delta);
+    }
+}
+
+    /// Empty the stereogram image caches for every viewing method, and drop any image being built for them.
+-(void) discardStereogramImagesEvicted: (BOOL)evicted {
+    @synchronized(self) {
+        _imageGeneration++;
+        [self setCachedImage:nil forTier:ImageCacheTier_Stereogram evicted:evicted];
+        [self setOtherMethodImages:nil evicted:evicted];
+    }
+}
+
+    /// Empty all the caches, e.g. because the images are out of date.
+-(void) discardCachedImages {
+    [self setCachedImage:nil forTier:ImageCacheTier_Thumbnail  evicted:NO];
+    [self discardStereogramImagesEvicted:NO];
+    [self discardDisparityPreview];
+}
+
 #pragma mark Private 
 
+    /// Return the part of PHOTO inside CROPRECT (see the cropRect property), or PHOTO itself if CROPRECT is null or misses it.
+    /// This is a CGImage sub-image, so the pixels aren't copied. The saved photos are always upright, so orientation is ignored.
+static UIImage *croppedPhoto(UIImage *photo, CGRect cropRect) {
+    if (CGRectIsNull(cropRect)) {
+        return photo;
+    }
+    CGRect bounds = CGRectMake(0, 0, CGImageGetWidth(photo.CGImage), CGImageGetHeight(photo.CGImage));
+    CGRect rect = CGRectIntersection(CGRectIntegral(cropRect), bounds);
+    if (CGRectIsEmpty(rect)) {
+        return photo;
+    }
+        // Round to even pixels, as the image core does, so both ways of building the image give the same size.
+    CGFloat x = 2 * floor(rect.origin.x / 2), y = 2 * floor(rect.origin.y / 2);
+    rect = CGRectMake(x, y, 2 * floor((CGRectGetMaxX(rect) - x) / 2), 2 * floor((CGRectGetMaxY(rect) - y) / 2));
+    return CGRectIsEmpty(rect) ? photo : [photo croppedImage:rect];
+}
+
+    /// Return PHOTO with COLUMNS columns left out from its left edge, or from its right edge if COLUMNS is negative.
+    /// This is how the UIKit fallback applies disparityOffset; like the image core, it always leaves at least 2 columns.
+static UIImage *shiftedPhoto(UIImage *photo, NSInteger columns) {
+    CGFloat width = CGImageGetWidth(photo.CGImage), height = CGImageGetHeight(photo.CGImage);
+    CGFloat shift = MIN(ABS(columns), MAX(width - 2, 0));
+    if (shift == 0) {
+        return photo;
+    }
+    return [photo croppedImage:CGRectMake(columns > 0 ? shift : 0, 0, width - shift, height)];
+}
+
+    /// If VIEWINGMETHOD is one of the anaglyphs, set *METHODPTR to the matching image core method and return YES.
+static BOOL anaglyphMethodForViewingMethod(ViewingMethod viewingMethod, PWAnaglyphMethod *methodPtr) {
+    switch (viewingMethod) {
+        case ViewingMethod_Anaglyph:           *methodPtr = PWAnaglyph_Colour;     return YES;
+        case ViewingMethod_AnaglyphHalfColour: *methodPtr = PWAnaglyph_HalfColour; return YES;
+        case ViewingMethod_AnaglyphOptimised:  *methodPtr = PWAnaglyph_Optimised;  return YES;
+        default:                               return NO;
+    }
+}
+
 /*!
  * Return a URL pointing to a unique file name under photoDir.
  *
@@ -432,10 +1472,44 @@ static NSURL *getUniqueStereogramURL(NSURL *photoDir) {
     CFRelease(newUID);
     
         // Name should be unique so no photo should exist yet.
-    NSCAssert(![[NSFileManager defaultManager] fileExistsAtPath:newURL.path], @"'Unique' file URL %@ already exists", newURL);
+    PWStorageItemInfo info;
+    NSCAssert(PWStorageGetInfo(PWStorageDefault(), newURL.fileSystemRepresentation, &info) == PWError_None
+              && info.kind == PWStorageItem_None, @"'Unique' file URL %@ already exists", newURL);
     return newURL;
 }
 
+/*!
+ * Create a new, empty directory for a stereogram under DIRECTORYURL.
+ *
+ * @param directoryURL The photo folder. It is an error if this exists and is not a directory.
+ * @param errorPtr     Optional error information if something went wrong.
+ * @return The URL of the new directory, or nil if it couldn't be created.
+ */
+static NSURL *createStereogramDirectory(NSURL *directoryURL, NSError **errorPtr) {
+    NSURL *newStereogramURL = getUniqueStereogramURL(directoryURL);
+
+    PWStorage *storage = PWStorageDefault();
+    PWStorageItemInfo info;
+    if (PWStorageGetInfo(storage, directoryURL.fileSystemRepresentation, &info) == PWError_None && info.kind == PWStorageItem_File) {
+        if (errorPtr) {
+            *errorPtr = [NSError errorWithDomain:kErrorDomainPhotoStore
+                                            code:ErrorCode_InvalidFileFormat
+                                        userInfo:@{NSLocalizedDescriptionKey : @"File exists and is not a directory.",
+                                                   NSFilePathErrorKey        : directoryURL.path}];
+        }
+        return nil;
+    }
+    
+    PWError error = PWStorageMakeDirectory(storage, newStereogramURL.fileSystemRepresentation, YES);
+    if (error != PWError_None) {
+        if (errorPtr) {
+            *errorPtr = [NSError imageCoreErrorWithCode:error operation:@"Creating the stereogram" path:newStereogramURL.path];
+        }
+        return nil;
+    }
+    return newStereogramURL;
+}
+
 static BOOL saveImageIntoURL(UIImage *image, NSURL *url, NSError **errorPtr) {
 	if (!image) {
 		if (errorPtr) {
@@ -443,10 +1517,17 @@ static BOOL saveImageIntoURL(UIImage *image, NSURL *url, NSError **errorPtr) {
 		}
 		return NO;
 	}
-    NSData *fileData = UIImageJPEGRepresentation(image, 1.0);
-    return [fileData writeToURL:url
-                        options:NSDataWritingAtomic
-                          error:errorPtr];
+        // The photo is saved at the encoder's default quality, in baseline JPEG so the image core can decode it again, with a
+        // thumbnail embedded so the collection view can show it without reading all of it.
+    NSData *fileData = [ImageManager JPEGDataOfImage:image options:NULL addThumbnail:YES];
+    if (!fileData) {
+        fileData = UIImageJPEGRepresentation(image, PWJPEGDefaultQuality / 100.0);
+        NSData *dataWithThumbnail = [ImageManager photoDataWithThumbnail:fileData photo:image];
+        if (dataWithThumbnail) {
+            fileData = dataWithThumbnail;
+        }
+    }
+    return writeDataToURL(fileData, url, errorPtr);
 }
 
 /*!
@@ -457,7 +1538,15 @@ static BOOL saveImageIntoURL(UIImage *image, NSURL *url, NSError **errorPtr) {
  */
 
 -(BOOL) saveProperties: (NSError **)errorPtr {
-    return savePropertyData(_properties, [_baseURL URLByAppendingPathComponent:PropertyListFileName], errorPtr);
+        // Copy the properties under the lock so they can't change while they are serialised, but don't hold it while
+        // writing. Saves are made one at a time, each copying after the one before, so the newest copy is written last.
+    @synchronized(_propertiesSaveLock) {
+        NSDictionary *properties;
+        @synchronized(self) {
+            properties = _properties.copy;
+        }
+        return savePropertyData(properties, [_baseURL URLByAppendingPathComponent:PropertyListFileName], errorPtr);
+    }
 }
 
 /*!
@@ -478,12 +1567,27 @@ static BOOL savePropertyData(NSDictionary *propertyDict, NSURL *propertyFileURL,
         return NO;
     }
     
-    if (![propertyListData writeToURL:propertyFileURL
-                              options:NSDataWritingAtomic
-                                error:errorPtr]) {
+    return writeDataToURL(propertyListData, propertyFileURL, errorPtr);
+}
+
+/*!
+ * Writes DATA to the file at URL through the image core's storage (see PWStorage.h), replacing it atomically as
+ * NSDataWritingAtomic does. URL is a file in a stereogram's directory, and once it has been written the change is
+ * recorded in the photo folder's journal, so the next sync sends it.
+ *
+ * @return YES on success, NO on failure.
+ */
+
+static BOOL writeDataToURL(NSData *data, NSURL *url, NSError **errorPtr) {
+    PWError error = PWJournalWriteFile(url.URLByDeletingLastPathComponent.fileSystemRepresentation,
+                                       url.lastPathComponent.fileSystemRepresentation, data.bytes, data.length, true);
+    if (error != PWError_None) {
+        if (errorPtr) {
+            *errorPtr = [NSError imageCoreErrorWithCode:error operation:@"Saving the file" path:url.path];
+        }
         return NO;
     }
-    return YES; // Success.
+    return YES;
 }
 
 /*!
@@ -496,8 +1600,9 @@ static BOOL savePropertyData(NSDictionary *propertyDict, NSURL *propertyFileURL,
  */
 
 static BOOL fileExists(NSURL *baseURL, NSString *fileName, NSError **errorPtr) {
-    NSString *fullURLPath = [baseURL URLByAppendingPathComponent:fileName].path;
-    if ([[NSFileManager defaultManager] fileExistsAtPath:fullURLPath]) {
+    NSURL *fullURL = [baseURL URLByAppendingPathComponent:fileName];
+    NSString *fullURLPath = fullURL.path;
+    if (PWStorageFileExists(PWStorageDefault(), fullURL.fileSystemRepresentation)) {
         return YES;
     }
     
@@ -516,14 +1621,32 @@ static BOOL fileExists(NSURL *baseURL, NSString *fileName, NSError **errorPtr) {
  * @return A Dictionary on success, nil on failure.
  */
 NSDictionary *loadPropertyList(NSURL *url, NSError **errorPtr) {
-    NSData *propertyData = [NSData dataWithContentsOfURL:url options:0 error:errorPtr];
+    NSData *propertyData = nil;
+    PWDataBuffer contents;
+    if (PWDataBufferInit(&contents, 0)) {
+        PWError error = PWStorageReadFile(PWStorageDefault(), url.fileSystemRepresentation, 0, PWStorageWholeFile, &contents);
+        if (error == PWError_None) {
+            propertyData = [NSData dataWithBytesNoCopy:contents.bytes length:contents.length freeWhenDone:YES];
+        } else {
+            PWDataBufferFree(&contents);
+            if (errorPtr) {
+                *errorPtr = [NSError imageCoreErrorWithCode:error operation:@"Reading the properties" path:url.path];
+            }
+        }
+    }
     if (propertyData) {
         NSInteger options = NSPropertyListMutableContainersAndLeaves;
         NSMutableDictionary *propObject = [NSPropertyListSerialization propertyListWithData:propertyData
                                                                                     options:options
                                                                                      format:nil
                                                                                       error:errorPtr];
-        NSCAssert(propObject != nil, @"Property list object %@ cannot be converted to a dictionary", propObject);
+        if (propObject && ![propObject isKindOfClass:[NSDictionary class]]) {
+            if (errorPtr) {
+                NSDictionary *userInfo = @{ NSFilePathErrorKey : url.path ? url.path : @"<no path>" };
+                *errorPtr = [NSError errorWithDomain:NSCocoaErrorDomain code:NSPropertyListReadCorruptError userInfo:userInfo];
+            }
+            return nil;
+        }
         return propObject;
     }
     return nil;
@@ -0,0 +1,37 @@
+//
+//  TiledImageView.h
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+@import UIKit;
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*!
+ * View which draws an image from a tile pyramid on disk (see PWTilePyramid.h) using a CATiledLayer.
+ *
+ * Only the tiles covering the visible area are loaded, from the pyramid level closest to the current zoom.
+ * So the first paint of a large image is quick, and memory use stays bounded however far the user zooms in.
+ * The view's bounds are the size of the full image in points, so put it in a UIScrollView and zoom it like a UIImageView.
+ */
+@interface TiledImageView : UIView
+
+/*!
+ * Initialise the view to show the pyramid in PYRAMIDURL.
+ *
+ * @param pyramidURL A file URL to a directory written by PWTilePyramidWrite().
+ * @param errorPtr   Optional error information if something went wrong.
+ * @return The view, sized to fit the full image, or nil if the pyramid couldn't be read.
+ */
+-(nullable instancetype) initWithPyramidURL: (NSURL *)pyramidURL
+                                      error: (NSError * __nullable *)errorPtr;
+
+/*! Size of the full-resolution image in pixels. */
+@property (nonatomic, readonly) CGSize imageSize;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,101 @@
+//
+//  TiledImageView.m
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+@import QuartzCore;
+#import "TiledImageView.h"
+#import "NSError_AlertSupport.h"
+#include "PWTilePyramid.h"
+
+@interface TiledImageView () {
+        /// Directory containing the tiles. A C string so drawRect: can build paths without touching Objective-C objects on the drawing threads.
+    char _pyramidPath[PATH_MAX];
+    PWTilePyramidInfo _pyramid;
+}
+@end
+
+@implementation TiledImageView
+
++(Class) layerClass {
+    return [CATiledLayer class];
+}
+
+-(instancetype) initWithPyramidURL: (NSURL *)pyramidURL
+                             error: (NSError **)errorPtr {
+    PWTilePyramidInfo pyramid;
+    PWError error = PWTilePyramidReadInfo(pyramidURL.fileSystemRepresentation, &pyramid);
+    if (error != PWError_None) {
+        if (errorPtr) {
+            *errorPtr = [NSError imageCoreErrorWithCode:error operation:@"Loading tiles" path:pyramidURL.path];
+        }
+        return nil;
+    }
+    self = [super initWithFrame:CGRectMake(0, 0, pyramid.width, pyramid.height)];
+    if (!self) { return nil; }
+
+    _pyramid = pyramid;
+    strlcpy(_pyramidPath, pyramidURL.fileSystemRepresentation, sizeof(_pyramidPath));
+
+        // One point per image pixel, matching what a UIImageView with a scale-1 image would show.
+        // One extra level of detail covers the 2x device scale of a Retina screen on top of the pyramid's own levels.
+    CATiledLayer *tiledLayer = (CATiledLayer *)self.layer;
+    CGFloat tileSize = (CGFloat)pyramid.tileSize;
+    tiledLayer.tileSize = CGSizeMake(tileSize, tileSize);
+    tiledLayer.levelsOfDetail = pyramid.levelCount + 1;
+    tiledLayer.levelsOfDetailBias = 0;
+    self.opaque = YES;
+    self.backgroundColor = [UIColor blackColor];
+    return self;
+}
+
+-(CGSize) imageSize {
+    return CGSizeMake(_pyramid.width, _pyramid.height);
+}
+
+#pragma mark Drawing
+
+    /// The coarsest pyramid level that still has at least one pixel per device pixel at drawing scale SCALE.
+-(unsigned) levelForScale: (CGFloat)scale {
+    unsigned level = 0;
+    while (level + 1 < _pyramid.levelCount && scale * (CGFloat)(1u << (level + 1)) <= 1.0) {
+        level++;
+    }
+    return level;
+}
+
+    // Called on CATiledLayer's background threads, once per layer tile.
+-(void) drawRect: (CGRect)rect {
+    CGContextRef context = UIGraphicsGetCurrentContext();
+    CGFloat scale = fabs(CGContextGetCTM(context).a);
+    unsigned level = [self levelForScale:scale];
+
+        // Size of one pyramid tile at this level, in points.
+    CGFloat levelScale = (CGFloat)(1u << level), tileExtent = (CGFloat)_pyramid.tileSize * levelScale;
+    size_t columns, rows;
+    PWTilePyramidTileGrid(&_pyramid, level, &columns, &rows);
+    size_t firstColumn = (size_t)MAX(0, floor(CGRectGetMinX(rect) / tileExtent)), lastColumn = MIN(columns, (size_t)ceil(CGRectGetMaxX(rect) / tileExtent));
+    size_t firstRow    = (size_t)MAX(0, floor(CGRectGetMinY(rect) / tileExtent)), lastRow    = MIN(rows   , (size_t)ceil(CGRectGetMaxY(rect) / tileExtent));
+
+    char path[PATH_MAX];
+    for (size_t row = firstRow; row < lastRow; row++) {
+        for (size_t column = firstColumn; column < lastColumn; column++) {
+            if (!PWTilePyramidTilePath(path, sizeof(path), _pyramidPath, level, column, row)) {
+                continue;
+            }
+            UIImage *tile = [UIImage imageWithContentsOfFile:@(path)];
+            if (!tile) {
+                NSLog(@"TiledImageView: tile %s is missing.", path);
+                continue;
+            }
+                // Edge tiles are smaller than tileSize, so size each tile from the image rather than the grid.
+                // Anything beyond the bounds (at most a point or so, from rounding odd sizes up) is clipped by the layer.
+            [tile drawInRect:CGRectMake(column * tileExtent, row * tileExtent, tile.size.width * levelScale, tile.size.height * levelScale)];
+        }
+    }
+}
+
+@end
@@ -9,6 +9,7 @@
 @import ImageIO;
 @import MobileCoreServices.UTCoreTypes;
 #import "UIImage+Export.h"
+#import "ImageManager.h"
 
 @implementation UIImage (Export)
 
@@ -29,7 +30,12 @@
 }
 
 -(NSData *) asJPEGData {
-    return UIImageJPEGRepresentation(self, 1.0);
+        // Exported files are for other apps, which can all read progressive JPEG, and it shows something sooner in a browser.
+    PWJPEGEncodeOptions options;
+    PWJPEGEncodeOptionsInit(&options);
+    options.progressive = true;
+    NSData *data = [ImageManager JPEGDataOfImage:self options:&options addThumbnail:NO];
+    return data ? data : UIImageJPEGRepresentation(self, options.quality / 100.0);
 }
 
 @end
@@ -0,0 +1,103 @@
+//
+//  UIImage+PWImageBuffer.h
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+@import UIKit;
+#include "PWImageBuffer.h"
+#include "PWResample.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/*!
+ * Extension to display image-core buffers without expanding them to a full 32-bit bitmap first.
+ */
+@interface UIImage (PWImageBuffer)
+
+/*!
+ * Return an image which reads its pixels from BUFFER on demand.
+ *
+ * The image retains BUFFER until it and every CGImage made from it have been released.
+ * CoreGraphics asks for pixels through a direct-access data provider, so YCbCr and RGB888 buffers are only converted
+ * to 32-bit pixels for the rows actually drawn, and the converted rows are not kept.
+ *
+ * @param buffer The pixels. Do not modify them after this call.
+ * @param scale  The scale factor for the UIImage, as for +[UIImage imageWithCGImage:scale:orientation:].
+ * @return The image, or nil if a CGImage couldn't be created.
+ */
++(nullable UIImage *) imageWithImageBuffer: (PWImageBuffer *)buffer
+                                     scale: (CGFloat)scale;
+
+/*!
+ * Return an upright copy of this image at half its width and height in pixels, with a scale of 1.
+ *
+ * This does the same job as resizedImage:interpolationQuality: for an exact halving, but without redrawing through
+ * an affine transform: each 2x2 block of pixels is averaged, then the result is rotated or mirrored as a straight copy
+ * by PWImageBufferCreateOriented(). Animated images give their first frame.
+ *
+ * @return The new image, or nil if the pixels couldn't be read.
+ */
+-(nullable UIImage *) uprightImageAtHalfSize;
+
+/*!
+ * Return an upright copy of this image scaled to SIZE pixels with the image core's resampler, with the same scale as this image.
+ *
+ * The scaling is spread over all the CPU cores, and shrinking averages in every source pixel, so the result doesn't
+ * alias the way a low-quality CGContextDrawImage() does. Animated images give their first frame.
+ *
+ * @param size   The size of the result in pixels. Fractions are rounded to the nearest whole pixel.
+ * @param filter The filter to weight the source pixels with.
+ * @return The new image, or nil if the pixels couldn't be read or SIZE is empty.
+ */
+-(nullable UIImage *) resampledImageWithSize: (CGSize)size
+                                      filter: (PWResampleFilter)filter;
+
+/*!
+ * Return an upright square thumbnail of this image, THUMBNAILSIZE pixels on each side, made by PWThumbnailCreate().
+ * The thumbnail has the same scale as this image.
+ *
+ * The image is scaled to fill the square and the overflow cropped from both sides, as for
+ * thumbnailImage:transparentBorder:cornerRadius:interpolationQuality: with no border or corners.
+ *
+ * @return The thumbnail, or nil if the pixels couldn't be read.
+ */
+-(nullable UIImage *) squareThumbnailImage: (NSUInteger)thumbnailSize;
+
+/*!
+ * Return an upright square thumbnail of this image with a transparent border and rounded corners, made by
+ * PWThumbnailCreateWithOptions() in one pass rather than the four redraws of
+ * thumbnailImage:transparentBorder:cornerRadius:interpolationQuality:, which it otherwise matches.
+ *
+ * The thumbnail has the same scale as this image.
+ *
+ * @param borderSize   Width of the border in pixels. The result is THUMBNAILSIZE + 2 x this on each side.
+ * @param cornerRadius Radius of the corners in pixels, or 0 for square ones.
+ * @return The thumbnail, or nil if the pixels couldn't be read.
+ */
+-(nullable UIImage *) squareThumbnailImage: (NSUInteger)thumbnailSize
+                         transparentBorder: (NSUInteger)borderSize
+                              cornerRadius: (CGFloat)cornerRadius
+                                    filter: (PWResampleFilter)filter;
+
+/*!
+ * Bytes of pixel memory held by the image buffer behind this image, or 0 if it wasn't created by imageWithImageBuffer:scale:.
+ */
+@property (nonatomic, readonly) NSUInteger imageBufferByteCount;
+
+@end
+
+/*!
+ * Return the pixels of IMAGE as an image buffer.
+ *
+ * For an image made by +[UIImage imageWithImageBuffer:scale:] this is the original buffer, retained, so no memory is copied.
+ * Any other image is drawn into a new RGBA8888 buffer and turned upright according to its imageOrientation.
+ * Animated images give their first frame.
+ *
+ * @return A buffer the caller must release with PWImageBufferRelease(), or NULL if the image couldn't be drawn.
+ */
+PWImageBuffer * __nullable PWImageBufferCreateFromUIImage(UIImage *image);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,213 @@
+//
+//  UIImage+PWImageBuffer.m
+//  Stereogram
+//
+//  Created by Patrick Wallace on 19/10/2026.
+//  Copyright (c) 2026 Patrick Wallace. All rights reserved.
+//
+
+@import ObjectiveC.runtime;
+#import "UIImage+PWImageBuffer.h"
+#import "PWOrientation.h"
+#import "PWThumbnail.h"
+
+    /// Key for the ImageBufferHolder associated with images made from a buffer.
+static const void *const ImageBufferHolderKey = &ImageBufferHolderKey;
+
+    /// Keeps a reference to the buffer behind an image, so it can be found again from the UIImage.
+@interface ImageBufferHolder : NSObject
+@property (nonatomic, readonly) PWImageBuffer *buffer;
+-(instancetype) initWithBuffer: (PWImageBuffer *)buffer;
+@end
+
+@implementation ImageBufferHolder
+
+-(instancetype) initWithBuffer: (PWImageBuffer *)buffer {
+    self = [super init];
+    if (self) {
+        _buffer = PWImageBufferRetain(buffer);
+    }
+    return self;
+}
+
+-(void) dealloc {
+    PWImageBufferRelease(_buffer);
+}
+
+@end
+
+#pragma mark Data provider callbacks
+
+static const void *getBytePointer(void *info) {
+    return NULL;  // Force CoreGraphics to use getBytesAtPosition, so only the requested range is converted.
+}
+
+static void releaseBytePointer(void *info, const void *pointer) {
+}
+
+static size_t getBytesAtPosition(void *info, void *buffer, off_t position, size_t count) {
+    return PWImageBufferReadRGBX(info, (size_t)position, count, buffer);
+}
+
+static void releaseInfo(void *info) {
+    PWImageBufferRelease(info);
+}
+
+#pragma mark Orientation
+
+    /// The EXIF orientation matching a UIKit orientation.
+static PWOrientation orientationFromImageOrientation(UIImageOrientation orientation) {
+    switch (orientation) {
+        case UIImageOrientationUpMirrored:    return PWOrientation_UpMirrored;
+        case UIImageOrientationDown:          return PWOrientation_Down;
+        case UIImageOrientationDownMirrored:  return PWOrientation_DownMirrored;
+        case UIImageOrientationLeftMirrored:  return PWOrientation_LeftMirrored;
+        case UIImageOrientationRight:         return PWOrientation_Right;
+        case UIImageOrientationRightMirrored: return PWOrientation_RightMirrored;
+        case UIImageOrientationLeft:          return PWOrientation_Left;
+        default:                              return PWOrientation_Up;
+    }
+}
+
+    /// Draw CGIMAGE into a new RGBA8888 buffer as stored, ignoring any orientation.
+static PWImageBuffer *createBufferFromCGImage(CGImageRef cgImage) {
+    if (!cgImage) {
+        return NULL;
+    }
+    size_t width = CGImageGetWidth(cgImage), height = CGImageGetHeight(cgImage);
+    PWImageBuffer *buffer = PWImageBufferCreate(width, height, PWPixelFormat_RGBA8888);
+    if (!buffer) {
+        return NULL;
+    }
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    CGContextRef context = CGBitmapContextCreate(buffer->data, width, height, 8, buffer->bytesPerRow, colorSpace,
+                                                 kCGImageAlphaPremultipliedLast | kCGBitmapByteOrder32Big);
+    CGColorSpaceRelease(colorSpace);
+    if (!context) {
+        PWImageBufferRelease(buffer);
+        return NULL;
+    }
+    CGContextClearRect(context, CGRectMake(0, 0, width, height));
+    CGContextDrawImage(context, CGRectMake(0, 0, width, height), cgImage);
+    CGContextRelease(context);
+    return buffer;
+}
+
+    /// Turn BUFFER upright, consuming the caller's reference to it. Returns the upright buffer, which may be BUFFER itself.
+static PWImageBuffer *orientBuffer(PWImageBuffer *buffer, UIImageOrientation imageOrientation) {
+    PWOrientation orientation = orientationFromImageOrientation(imageOrientation);
+    if (!buffer || orientation == PWOrientation_Up) {
+        return buffer;
+    }
+    PWImageBuffer *oriented = PWImageBufferCreateOriented(buffer, orientation);
+    PWImageBufferRelease(buffer);
+    return oriented;
+}
+
+#pragma mark -
+
+@implementation UIImage (PWImageBuffer)
+
++(UIImage *) imageWithImageBuffer: (PWImageBuffer *)buffer
+                            scale: (CGFloat)scale {
+    NSAssert(buffer, @"No image buffer provided.");
+    const CGDataProviderDirectCallbacks callbacks = {
+        .version            = 0,
+        .getBytePointer     = getBytePointer,
+        .releaseBytePointer = releaseBytePointer,
+        .getBytesAtPosition = getBytesAtPosition,
+        .releaseInfo        = releaseInfo
+    };
+    size_t bytesPerRow = buffer->width * 4;
+    CGDataProviderRef provider = CGDataProviderCreateDirect(PWImageBufferRetain(buffer), bytesPerRow * buffer->height, &callbacks);
+    if (!provider) {
+        PWImageBufferRelease(buffer);
+        return nil;
+    }
+        // PWImageBufferReadRGBX gives RGBA8888 buffers unchanged and pads everything else with an unused byte.
+    CGBitmapInfo bitmapInfo = kCGBitmapByteOrder32Big
+        | (PWPixelFormatHasAlpha(buffer->format) ? kCGImageAlphaPremultipliedLast : kCGImageAlphaNoneSkipLast);
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    CGImageRef cgImage = CGImageCreate(buffer->width, buffer->height, 8, 32, bytesPerRow, colorSpace, bitmapInfo,
+                                       provider, NULL, false, kCGRenderingIntentDefault);
+    CGColorSpaceRelease(colorSpace);
+    CGDataProviderRelease(provider);
+    if (!cgImage) {
+        return nil;
+    }
+    UIImage *image = [UIImage imageWithCGImage:cgImage
+                                         scale:scale
+                                   orientation:UIImageOrientationUp];
+    CGImageRelease(cgImage);
+    objc_setAssociatedObject(image, ImageBufferHolderKey, [[ImageBufferHolder alloc] initWithBuffer:buffer], OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+    return image;
+}
+
+-(UIImage *) uprightImageAtHalfSize {
+        // Halve first, so there are only a quarter as many pixels to turn.
+    PWImageBuffer *raw = createBufferFromCGImage(self.images ? self.images.firstObject.CGImage : self.CGImage);
+    PWImageBuffer *half = orientBuffer(PWImageBufferCreateHalfSize(raw), self.imageOrientation);
+    PWImageBufferRelease(raw);
+    if (!half) {
+        return nil;
+    }
+    UIImage *image = [UIImage imageWithImageBuffer:half scale:1.0];
+    PWImageBufferRelease(half);
+    return image;
+}
+
+-(UIImage *) resampledImageWithSize: (CGSize)size
+                             filter: (PWResampleFilter)filter {
+    size_t width = (size_t)round(size.width), height = (size_t)round(size.height);
+    if (width == 0 || height == 0) {
+        return nil;
+    }
+    PWImageBuffer *source = PWImageBufferCreateFromUIImage(self);
+    PWImageBuffer *resampled = source ? PWResampleCreate(source, width, height, filter) : NULL;
+    PWImageBufferRelease(source);
+    if (!resampled) {
+        return nil;
+    }
+    UIImage *image = [UIImage imageWithImageBuffer:resampled scale:self.scale];
+    PWImageBufferRelease(resampled);
+    return image;
+}
+
+-(UIImage *) squareThumbnailImage: (NSUInteger)thumbnailSize {
+    return [self squareThumbnailImage:thumbnailSize transparentBorder:0 cornerRadius:0 filter:PWResampleFilter_Area];
+}
+
+-(UIImage *) squareThumbnailImage: (NSUInteger)thumbnailSize
+                transparentBorder: (NSUInteger)borderSize
+                     cornerRadius: (CGFloat)cornerRadius
+                           filter: (PWResampleFilter)filter {
+    PWThumbnailOptions options = PWThumbnailOptionsInit();
+    options.borderSize = borderSize;
+    options.cornerRadius = cornerRadius;
+    options.filter = filter;
+    PWImageBuffer *source = PWImageBufferCreateFromUIImage(self);
+    PWImageBuffer *thumbnail = source ? PWThumbnailCreateWithOptions(source, thumbnailSize, &options) : NULL;
+    PWImageBufferRelease(source);
+    if (!thumbnail) {
+        return nil;
+    }
+    UIImage *image = [UIImage imageWithImageBuffer:thumbnail scale:self.scale];
+    PWImageBufferRelease(thumbnail);
+    return image;
+}
+
+-(NSUInteger) imageBufferByteCount {
+    ImageBufferHolder *holder = objc_getAssociatedObject(self, ImageBufferHolderKey);
+    return holder ? PWImageBufferByteCount(holder.buffer) : 0;
+}
+
+@end
+
+PWImageBuffer *PWImageBufferCreateFromUIImage(UIImage *image) {
+    ImageBufferHolder *holder = objc_getAssociatedObject(image, ImageBufferHolderKey);
+    if (holder) {
+        return PWImageBufferRetain(holder.buffer);
+    }
+    CGImageRef cgImage = image.images ? image.images.firstObject.CGImage : image.CGImage;
+    return orientBuffer(createBufferFromCGImage(cgImage), image.imageOrientation);
+}
@@ -6,6 +6,19 @@
 #import "UIImage+Resize.h"
 #import "UIImage+RoundedCorner.h"
 #import "UIImage+Alpha.h"
+#import "UIImage+PWImageBuffer.h"
+
+// The image core filter to use in place of each CoreGraphics interpolation quality.
+// Even the lowest quality averages every source pixel, so thumbnails no longer alias.
+static PWResampleFilter filterForInterpolationQuality(CGInterpolationQuality quality)
+{
+    switch (quality) {
+        case kCGInterpolationHigh:    return PWResampleFilter_Lanczos3;
+        case kCGInterpolationMedium:
+        case kCGInterpolationDefault: return PWResampleFilter_Bilinear;
+        default:                      return PWResampleFilter_Area;
+    }
+}
 
 @implementation UIImage (Resize)
 
@@ -27,6 +40,16 @@
                cornerRadius:(NSUInteger)cornerRadius
        interpolationQuality:(CGInterpolationQuality)quality
 {
+    // The image core scales just the cropped part and masks the border and corners as it goes, in one pass using every core.
+    // Fall back to redrawing through CoreGraphics at each step only if the pixels couldn't be read.
+    UIImage *thumbnail = [self squareThumbnailImage:thumbnailSize
+                                  transparentBorder:borderSize
+                                       cornerRadius:cornerRadius
+                                             filter:filterForInterpolationQuality(quality)];
+    if (thumbnail) {
+        return thumbnail;
+    }
+
     UIImage *resizedImage = [self resizedImageWithContentMode:UIViewContentModeScaleAspectFill
                                                        bounds:CGSizeMake(thumbnailSize, thumbnailSize)
                                          interpolationQuality:quality];
@@ -49,6 +72,14 @@
 // The image will be scaled disproportionately if necessary to fit the bounds specified by the parameter
 - (UIImage *)resizedImage:(CGSize)newSize interpolationQuality:(CGInterpolationQuality)quality
 {
+    // Scale with the image core where possible; it is multi-threaded and filters properly when shrinking.
+    // Redraw through CoreGraphics only if the pixels couldn't be read.
+    UIImage *resampledImage = [self resampledImageWithSize:CGRectIntegral(CGRectMake(0, 0, newSize.width, newSize.height)).size
+                                                    filter:filterForInterpolationQuality(quality)];
+    if (resampledImage) {
+        return resampledImage;
+    }
+
     BOOL drawTransposed;
     
     switch (self.imageOrientation) {